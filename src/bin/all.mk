@@ -1,6 +1,7 @@
 SUBMAKEFILES := \
     radclient.mk \
     radclient-ng.mk \
+    raddetail.mk \
     radict.mk \
     radiusd.mk \
     radlast.mk \
@@ -54,6 +54,7 @@ typedef struct request_s request_t;	/* to shut up warnings about mschap.h */
 #include "mschap.h"
 
 #include "radclient.h"
+#include "radclient_load.h"
 
 #define pair_update_request(_attr, _da) do { \
 		_attr = fr_pair_find_by_da(&request->request_pairs, NULL, _da); \
@@ -145,6 +146,7 @@ static NEVER_RETURNS void usage(void)
 	fprintf(stderr, "  <command>                         One of auth, acct, status, coa, disconnect or auto.\n");
 	fprintf(stderr, "  -4                                Use IPv4 address of server\n");
 	fprintf(stderr, "  -6                                Use IPv6 address of server.\n");
+	fprintf(stderr, "  -a <arrival>                      With -L, space packets evenly (constant), or randomly (poisson).\n");
 	fprintf(stderr, "  -C [<client_ip>:]<client_port>    Client source port and source IP address.  Port values may be 1..65535\n");
 	fprintf(stderr, "  -c <count>			     Send each packet 'count' times.\n");
 	fprintf(stderr, "  -d <raddb>                        Set user dictionary directory (defaults to " RADDBDIR ").\n");
@@ -154,11 +156,17 @@ static NEVER_RETURNS void usage(void)
 	fprintf(stderr, "  -F                                Print the file name, packet number and reply code.\n");
 	fprintf(stderr, "  -h                                Print usage help information.\n");
 	fprintf(stderr, "  -i <id>                           Set request id to 'id'.  Values may be 0..255\n");
+	fprintf(stderr, "  -I <interval>                     With -L, seconds between reports (defaults to 1).\n");
+	fprintf(stderr, "  -L <rate>                         Send packets at 'rate' per second, without waiting for replies.\n");
+	fprintf(stderr, "  -n <duration>                     With -L, seconds to send packets for (defaults to 10).\n");
+	fprintf(stderr, "  -o <format>                       With -L, print reports as csv or json.\n");
+	fprintf(stderr, "  -p <file>                         With -L, send the requests in a pcap file, as well as any from -f.\n");
 	fprintf(stderr, "  -P <proto>                        Use proto (tcp or udp) for transport.\n");
 	fprintf(stderr, "  -r <retries>                      If timeout, retry sending the packet 'retries' times.\n");
 	fprintf(stderr, "  -s                                Print out summary information of auth results.\n");
 	fprintf(stderr, "  -S <file>                         read secret from file, not command line.\n");
 	fprintf(stderr, "  -t <timeout>                      Wait 'timeout' seconds before retrying (may be a floating point number).\n");
+	fprintf(stderr, "  -T <threads>                      With -L, the number of threads sending packets.\n");
 	fprintf(stderr, "  -v                                Show program version information.\n");
 	fprintf(stderr, "  -x                                Debugging mode.\n");
 
@@ -723,6 +731,49 @@ static void deallocate_id(rc_request_t *request)
 	if (request->reply) fr_radius_packet_free(&request->reply);
 }
 
+/*
+ *	Update the password, so it can be encrypted with the
+ *	new authentication vector.
+ */
+static void radclient_password_update(rc_request_t *request)
+{
+	fr_pair_t *vp;
+
+	if (!request->password) return;
+
+	if ((vp = fr_pair_find_by_da(&request->request_pairs, NULL, attr_user_password)) != NULL) {
+		fr_pair_value_strdup(vp, request->password->vp_strvalue, false);
+
+	} else if ((vp = fr_pair_find_by_da(&request->request_pairs, NULL, attr_chap_password)) != NULL) {
+		uint8_t		buffer[17];
+		fr_pair_t	*challenge;
+		uint8_t	const	*vector;
+
+		/*
+		 *	Use Chap-Challenge pair if present,
+		 *	Request Authenticator otherwise.
+		 */
+		challenge = fr_pair_find_by_da(&request->request_pairs, NULL, attr_chap_challenge);
+		if (challenge && (challenge->vp_length == RADIUS_AUTH_VECTOR_LENGTH)) {
+			vector = challenge->vp_octets;
+		} else {
+			vector = request->packet->vector;
+		}
+
+		fr_chap_encode(buffer,
+			       fr_rand() & 0xff, vector, RADIUS_AUTH_VECTOR_LENGTH,
+			       request->password->vp_strvalue,
+			       request->password->vp_length);
+		fr_pair_value_memdup(vp, buffer, sizeof(buffer), false);
+
+	} else if (fr_pair_find_by_da_nested(&request->request_pairs, NULL, attr_ms_chap_password) != NULL) {
+		mschapv1_encode(request->packet, &request->request_pairs, request->password->vp_strvalue);
+
+	} else {
+		DEBUG("WARNING: No password in the request");
+	}
+}
+
 /*
  *	Send one packet.
  */
@@ -768,45 +819,7 @@ static int send_one_packet(rc_request_t *request)
 		assert(request->packet->id != -1);
 		assert(request->packet->data == NULL);
 
-		/*
-		 *	Update the password, so it can be encrypted with the
-		 *	new authentication vector.
-		 */
-		if (request->password) {
-			fr_pair_t *vp;
-
-			if ((vp = fr_pair_find_by_da(&request->request_pairs, NULL, attr_user_password)) != NULL) {
-				fr_pair_value_strdup(vp, request->password->vp_strvalue, false);
-
-			} else if ((vp = fr_pair_find_by_da(&request->request_pairs, NULL, attr_chap_password)) != NULL) {
-				uint8_t		buffer[17];
-				fr_pair_t	*challenge;
-				uint8_t	const	*vector;
-
-				/*
-				 *	Use Chap-Challenge pair if present,
-				 *	Request Authenticator otherwise.
-				 */
-				challenge = fr_pair_find_by_da(&request->request_pairs, NULL, attr_chap_challenge);
-				if (challenge && (challenge->vp_length == RADIUS_AUTH_VECTOR_LENGTH)) {
-					vector = challenge->vp_octets;
-				} else {
-					vector = request->packet->vector;
-				}
-
-				fr_chap_encode(buffer,
-					       fr_rand() & 0xff, vector, RADIUS_AUTH_VECTOR_LENGTH,
-					       request->password->vp_strvalue,
-					       request->password->vp_length);
-				fr_pair_value_memdup(vp, buffer, sizeof(buffer), false);
-
-			} else if (fr_pair_find_by_da_nested(&request->request_pairs, NULL, attr_ms_chap_password) != NULL) {
-				mschapv1_encode(request->packet, &request->request_pairs, request->password->vp_strvalue);
-
-			} else {
-				DEBUG("WARNING: No password in the request");
-			}
-		}
+		radclient_password_update(request);
 
 		request->timestamp = fr_time();
 		request->tries = 1;
@@ -1069,6 +1082,15 @@ int main(int argc, char **argv)
 	int		do_summary = false;
 	TALLOC_CTX	*autofree;
 	fr_dlist_head_t	filenames;
+	char const	*pcap_file = NULL;
+	rc_load_packet_t *load_packets = NULL;
+	rc_load_config_t load_config = {
+				.threads = 1,
+				.arrival = RC_LOAD_ARRIVAL_CONSTANT,
+				.duration = fr_time_delta_wrap((int64_t)10 * NSEC),
+				.interval = fr_time_delta_wrap(NSEC),
+				.report = RC_LOAD_REPORT_CSV,
+			};
 
 	/*
 	 *	It's easier having two sets of flags to set the
@@ -1127,7 +1149,7 @@ int main(int argc, char **argv)
 	};
 
 
-	while ((c = getopt(argc, argv, "46c:C:d:D:f:Fhi:P:r:sS:t:vx")) != -1) switch (c) {
+	while ((c = getopt(argc, argv, "46a:c:C:d:D:f:Fhi:I:L:n:o:p:P:r:sS:t:T:vx")) != -1) switch (c) {
 		case '4':
 			fd_config.dst_ipaddr.af = AF_INET;
 			break;
@@ -1136,6 +1158,16 @@ int main(int argc, char **argv)
 			fd_config.dst_ipaddr.af = AF_INET6;
 			break;
 
+		case 'a':
+			if (!strcmp(optarg, "constant")) {
+				load_config.arrival = RC_LOAD_ARRIVAL_CONSTANT;
+			} else if (!strcmp(optarg, "poisson")) {
+				load_config.arrival = RC_LOAD_ARRIVAL_POISSON;
+			} else {
+				usage();
+			}
+			break;
+
 		case 'c':
 			if (!isdigit((uint8_t) *optarg)) usage();
 
@@ -1222,6 +1254,45 @@ int main(int argc, char **argv)
 			}
 			break;
 
+		case 'I':
+			if (fr_time_delta_from_str(&load_config.interval, optarg, strlen(optarg), FR_TIME_RES_SEC) < 0) {
+				fr_perror("Failed parsing report interval");
+				fr_exit_now(EXIT_FAILURE);
+			}
+			if (!fr_time_delta_ispos(load_config.interval)) usage();
+			break;
+
+		case 'L':
+		{
+			char *end;
+
+			load_config.rate = strtod(optarg, &end);
+			if (*end || (load_config.rate <= 0)) usage();
+		}
+			break;
+
+		case 'n':
+			if (fr_time_delta_from_str(&load_config.duration, optarg, strlen(optarg), FR_TIME_RES_SEC) < 0) {
+				fr_perror("Failed parsing duration");
+				fr_exit_now(EXIT_FAILURE);
+			}
+			if (!fr_time_delta_ispos(load_config.duration)) usage();
+			break;
+
+		case 'o':
+			if (!strcmp(optarg, "csv")) {
+				load_config.report = RC_LOAD_REPORT_CSV;
+			} else if (!strcmp(optarg, "json")) {
+				load_config.report = RC_LOAD_REPORT_JSON;
+			} else {
+				usage();
+			}
+			break;
+
+		case 'p':
+			pcap_file = optarg;
+			break;
+
 		case 'P':
 			if (!strcmp(optarg, "tcp")) {
 				fd_config.socket_type = SOCK_STREAM;
@@ -1281,6 +1352,12 @@ int main(int argc, char **argv)
 			}
 			break;
 
+		case 'T':
+			if (!isdigit((uint8_t) *optarg)) usage();
+			load_config.threads = atoi(optarg);
+			if ((load_config.threads == 0) || (load_config.threads > 1024)) usage();
+			break;
+
 		case 'v':
 			fr_debug_lvl = 1;
 			DEBUG("%s", radclient_version);
@@ -1302,6 +1379,25 @@ int main(int argc, char **argv)
 		ERROR("Insufficient arguments");
 		usage();
 	}
+
+	if (pcap_file && (load_config.rate <= 0)) {
+		ERROR("Reading packets from a pcap file requires -L");
+		usage();
+	}
+
+	if ((load_config.rate > 0) && (ipproto != IPPROTO_UDP)) {
+		ERROR("Load generation (-L) is only supported over UDP");
+		fr_exit_now(1);
+	}
+
+	/*
+	 *	Each thread opens its own socket, so they can't all
+	 *	bind to the same port.
+	 */
+	if ((load_config.threads > 1) && fd_config.src_port) {
+		ERROR("A client port (-C) can't be used with more than one thread (-T)");
+		fr_exit_now(1);
+	}
 	/*
 	 *	Mismatch between the binary and the libraries it depends on
 	 */
@@ -1375,9 +1471,9 @@ int main(int argc, char **argv)
 	if (argv[3]) secret = talloc_strdup(NULL, argv[3]);
 
 	/*
-	 *	If no '-f' is specified, we're reading from stdin.
+	 *	If no '-f' or '-p' is specified, we're reading from stdin.
 	 */
-	if (fr_dlist_num_elements(&filenames) == 0) {
+	if ((fr_dlist_num_elements(&filenames) == 0) && !pcap_file) {
 		rc_file_pair_t *files;
 
 		files = talloc_zero(talloc_autofree_context(), rc_file_pair_t);
@@ -1398,13 +1494,64 @@ int main(int argc, char **argv)
 	/*
 	 *	No packets read.  Die.
 	 */
-	if (!fr_dlist_num_elements(&rc_request_list)) {
+	if (!fr_dlist_num_elements(&rc_request_list) && !pcap_file) {
 		ERROR("Nothing to send");
 		fr_exit_now(1);
 	}
 
 	openssl3_init();
 
+	/*
+	 *	Open-loop load generation.  Each request is encoded
+	 *	once, and the sending threads re-sign a copy of it for
+	 *	every packet they send.
+	 */
+	if (load_config.rate > 0) {
+		fr_dlist_foreach(&rc_request_list, rc_request_t, this) {
+			this->packet->socket.inet.src_ipaddr = fd_config.src_ipaddr;
+			this->packet->socket.inet.src_port = fd_config.src_port;
+			if (radclient_sane(this) != 0) {
+				fr_exit_now(1);
+			}
+
+			radclient_password_update(this);
+
+			this->packet->id = 0;
+			if ((fr_radius_packet_encode(this->packet, &this->request_pairs, NULL, secret) < 0) ||
+			    (fr_radius_packet_sign(this->packet, NULL, secret) < 0) ||
+			    (rc_load_packet_add(autofree, &load_packets, this->packet->data, this->packet->data_len,
+						secret) < 0)) {
+				fr_perror("Failed preparing request %" PRIu64 " in file %s",
+					  this->num, this->files->packets);
+				fr_exit_now(1);
+			}
+		}
+
+		if (pcap_file && (rc_load_pcap_read(autofree, &load_packets, pcap_file, secret) < 0)) {
+			fr_perror("radclient");
+			fr_exit_now(1);
+		}
+
+		load_config.timeout = timeout;
+		load_config.fd_config = &fd_config;
+		load_config.secret = secret;
+
+		switch (rc_load_run(&load_config, load_packets)) {
+		case 0:
+			break;
+
+		case 1:
+			ret = EXIT_FAILURE;
+			break;
+
+		default:
+			fr_perror("radclient");
+			ret = EXIT_FAILURE;
+			break;
+		}
+		goto finish;
+	}
+
 	bio = fr_bio_fd_alloc(autofree, NULL, &fd_config, 0);
 	if (!bio) {
 		ERROR("Failed opening socket: %s", fr_strerror());
@@ -1526,6 +1673,7 @@ int main(int argc, char **argv)
 		}
 	} while (!done);
 
+finish:
 	fr_packet_list_free(packet_list);
 
 	fr_dlist_talloc_free(&rc_request_list);
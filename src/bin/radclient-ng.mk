@@ -1,11 +1,12 @@
 TARGET		:= radclient-ng$(E)
-SOURCES		:= radclient-ng.c ${top_srcdir}/src/modules/rlm_mschap/smbdes.c \
+SOURCES		:= radclient-ng.c radclient_load.c ${top_srcdir}/src/modules/rlm_mschap/smbdes.c \
 		   ${top_srcdir}/src/modules/rlm_mschap/mschap.c \
 		   ${top_srcdir}/src/lib/server/packet.c \
 
 TGT_PREREQS	:= libfreeradius-radius$(L) libfreeradius-bio$(L)
 
 SRC_CFLAGS	:= -I${top_srcdir}/src/modules/rlm_mschap
-TGT_LDLIBS	:= $(LIBS)
+TGT_LDLIBS	:= $(LIBS) $(PCAP_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(PCAP_LDFLAGS)
 
 TGT_INSTALLDIR	:= $(BUILD_DIR)/bin/ignore
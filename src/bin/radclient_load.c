@@ -0,0 +1,1005 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file src/bin/radclient_load.c
+ * @brief Open-loop load generation for radclient-ng.
+ *
+ * Packets are sent at a fixed average rate, whether or not the server
+ * is keeping up.  Each sender thread has its own socket, and therefore
+ * its own space of 256 IDs.
+ *
+ * Latency is measured from the time a packet *should* have been sent,
+ * not from the time it was sent.  If the sender falls behind, e.g.
+ * because all of its IDs are in use, the time the packet spends
+ * waiting is counted against the server, instead of being silently
+ * omitted.  The time from the actual send to the reply is recorded
+ * separately, as the "service" time.
+ *
+ * Packets which never get a reply are recorded too, so that they
+ * don't vanish from the percentiles.  A lost packet is recorded as
+ * getting its reply at the timeout.  A packet which was due but never
+ * sent is recorded as taking from when it was due, to the end of the
+ * run.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/histogram.h>
+#include <freeradius-devel/util/md5.h>
+#include <freeradius-devel/util/nbo.h>
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/syserror.h>
+#ifdef HAVE_LIBPCAP
+#  include <freeradius-devel/util/pcap.h>
+#endif
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/select.h>
+
+#include "radclient_load.h"
+
+/*
+ *	Packets sent more than this long after they were due are
+ *	counted as "late".
+ */
+#define RC_LOAD_LATE		fr_time_delta_from_msec(1)
+
+/*
+ *	How often each thread checks for packets which have timed out,
+ *	and the longest it waits in select().
+ */
+#define RC_LOAD_TICK		fr_time_delta_from_msec(1)
+
+#define TO_USEC(_x) (((double) (_x)) / 1000)
+
+typedef struct {
+	fr_time_t		intended;			//!< When the packet should have been sent.
+	fr_time_t		sent;				//!< When it was actually sent.
+	uint8_t			vector[RADIUS_AUTH_VECTOR_LENGTH];	//!< To verify the reply.
+	bool			in_use;
+} rc_load_outstanding_t;
+
+/** Counters, written by the owning thread, and read by the main thread
+ *
+ */
+typedef struct {
+	atomic_uint_fast64_t	sent;
+	atomic_uint_fast64_t	received;
+	atomic_uint_fast64_t	accepted;			//!< Accepts and ACKs.
+	atomic_uint_fast64_t	rejected;			//!< Everything else.
+	atomic_uint_fast64_t	lost;				//!< Timed out.
+	atomic_uint_fast64_t	late;				//!< Sent more than RC_LOAD_LATE after they were due.
+	atomic_uint_fast64_t	unsent;				//!< Due before the end of the run, but never sent.
+	atomic_uint_fast64_t	errors;				//!< Failed writes, and invalid replies.
+} rc_load_stats_t;
+
+typedef struct {
+	uint32_t		num;				//!< Of this thread.
+	pthread_t		pthread_id;
+
+	rc_load_config_t const	*config;
+	rc_load_packet_t const	*packets;
+	size_t			num_packets;
+	size_t			next_packet;			//!< Index of the next packet to send.
+
+	fr_bio_t		*bio;
+	int			fd;
+
+	fr_fast_rand_t		rand_ctx;
+	double			rate;				//!< Of this thread.
+	fr_time_t		start;
+	fr_time_t		end;
+
+	uint64_t		counter;			//!< For the Proxy-State of each packet.
+	unsigned int		num_outstanding;
+	unsigned int		last_id;
+	rc_load_outstanding_t	outstanding[256];
+
+	fr_histogram_t		latency;			//!< From when the packet was due, to the reply.
+	fr_histogram_t		service;			//!< From when the packet was sent, to the reply.
+	rc_load_stats_t		stats;
+
+	atomic_bool		done;
+} rc_load_thread_t;
+
+/** Snapshot of the totals for all threads
+ *
+ */
+typedef struct {
+	uint64_t		sent;
+	uint64_t		received;
+	uint64_t		accepted;
+	uint64_t		rejected;
+	uint64_t		lost;
+	uint64_t		late;
+	uint64_t		unsent;
+	uint64_t		errors;
+	fr_histogram_t		latency;
+	fr_histogram_t		service;
+} rc_load_totals_t;
+
+/** XOR a password with the RADIUS keystream
+ *
+ * Which is MD5(secret + vector) for the first block, and
+ * MD5(secret + previous ciphertext block) for every other block.
+ *
+ * @param[out] out		where the result is written.
+ * @param[in] in		the data to XOR.
+ * @param[in] len		of in and out, a multiple of AUTH_PASS_LEN.
+ * @param[in] vector		Request Authenticator.
+ * @param[in] secret		shared secret.
+ * @param[in] decrypt		whether the input is the ciphertext.
+ */
+static void rc_load_password_crypt(uint8_t *out, uint8_t const *in, size_t len,
+				   uint8_t const *vector, char const *secret, bool decrypt)
+{
+	fr_md5_ctx_t	*md5_ctx, *md5_ctx_old;
+	uint8_t		digest[RADIUS_AUTH_VECTOR_LENGTH];
+	uint8_t		block[AUTH_PASS_LEN];
+	uint8_t const	*prev = vector;
+	size_t		i, n;
+
+	md5_ctx = fr_md5_ctx_alloc_from_list();
+	md5_ctx_old = fr_md5_ctx_alloc_from_list();
+
+	fr_md5_update(md5_ctx_old, (uint8_t const *) secret, strlen(secret));
+
+	for (n = 0; n < len; n += AUTH_PASS_LEN) {
+		fr_md5_ctx_copy(md5_ctx, md5_ctx_old);
+		fr_md5_update(md5_ctx, prev, AUTH_PASS_LEN);
+		fr_md5_final(digest, md5_ctx);
+
+		/*
+		 *	The next block is keyed from the ciphertext,
+		 *	which is the input if we're decrypting, and the
+		 *	output if we're encrypting.  Either may be
+		 *	the same buffer as the other.
+		 */
+		memcpy(block, in + n, AUTH_PASS_LEN);
+		for (i = 0; i < AUTH_PASS_LEN; i++) out[n + i] = block[i] ^ digest[i];
+
+		if (decrypt) {
+			memcpy(digest, block, AUTH_PASS_LEN);
+			prev = digest;
+		} else {
+			prev = out + n;
+		}
+	}
+
+	fr_md5_ctx_free_from_list(&md5_ctx);
+	fr_md5_ctx_free_from_list(&md5_ctx_old);
+}
+
+/** Check that a request doesn't contain attributes we can't re-encrypt
+ *
+ * Access-Requests get a new Request Authenticator each time they're
+ * sent.  We re-encrypt User-Password, but anything else which uses
+ * the Request Authenticator, e.g. an encrypted VSA, would decrypt to
+ * garbage on the server.
+ *
+ * Other requests use a Request Authenticator of zero for encryption,
+ * so their encrypted attributes don't change.
+ *
+ * @param[in] data		encoded Access-Request or Status-Server.
+ * @param[in] data_len		length of the data.
+ * @param[in] secret		the request was encoded with.
+ * @return
+ *	- 0 if the packet can be sent.
+ *	- -1 if it can't be decoded, or contains other encrypted attributes.
+ */
+static int rc_load_encrypted_check(uint8_t const *data, size_t data_len, char const *secret)
+{
+	TALLOC_CTX	*tmp_ctx;
+	fr_pair_list_t	list;
+	uint8_t		*packet;
+	int		ret = 0;
+
+	tmp_ctx = talloc_init_const("rc_load_encrypted_check");
+	if (!tmp_ctx) {
+	oom:
+		fr_strerror_const("Out of memory");
+		return -1;
+	}
+
+	packet = talloc_memdup(tmp_ctx, data, data_len);
+	if (!packet) {
+		talloc_free(tmp_ctx);
+		goto oom;
+	}
+
+	fr_pair_list_init(&list);
+	if (fr_radius_decode_simple(tmp_ctx, &list, packet, data_len, data + 4, secret) < 0) {
+		fr_strerror_const_push("Failed decoding request");
+		talloc_free(tmp_ctx);
+		return -1;
+	}
+
+	fr_pair_list_foreach_leaf(&list, vp) {
+		if (!flag_encrypted(&vp->da->flags)) continue;
+
+		if (fr_dict_attr_is_top_level(vp->da) && (vp->da->attr == FR_USER_PASSWORD)) continue;
+
+		fr_strerror_printf("%s is encrypted using the Request Authenticator, which is changed "
+				   "every time the packet is sent", vp->da->name);
+		ret = -1;
+		break;
+	}
+
+	talloc_free(tmp_ctx);
+
+	return ret;
+}
+
+/** Add an encoded request to the set of packets to send
+ *
+ * The packet is copied, and prepared so that each copy of it which is
+ * sent can be made unique.
+ *
+ * - For Access-Request and Status-Server, the plaintext of any
+ *   User-Password is saved, so that it can be re-encrypted with a new
+ *   Request Authenticator.  CHAP-Password uses the Request
+ *   Authenticator as the challenge, unless there's a CHAP-Challenge,
+ *   so we add one.
+ * - For all other requests, we add an 8 octet Proxy-State, which is
+ *   used as a counter.
+ *
+ * Access-Requests with other attributes which are encrypted using the
+ * Request Authenticator are rejected, as they would not decrypt
+ * correctly on the server.
+ *
+ * @param[in] ctx		to allocate the packet data in.
+ * @param[in,out] packets	talloc array of packets, which may be NULL.
+ * @param[in] data		encoded request.
+ * @param[in] data_len		length of the data.
+ * @param[in] secret		the request was encoded with.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the packet isn't a valid request, or can't be sent more than once.
+ */
+int rc_load_packet_add(TALLOC_CTX *ctx, rc_load_packet_t **packets,
+		       uint8_t const *data, size_t data_len, char const *secret)
+{
+	rc_load_packet_t	*array, *packet;
+	uint8_t			*p, *end;
+	uint8_t const		*password = NULL, *chap_password = NULL, *chap_challenge = NULL;
+	size_t			packet_len, num;
+
+	if (data_len < RADIUS_HEADER_LENGTH) {
+		fr_strerror_printf("Packet is too short (%zu bytes)", data_len);
+		return -1;
+	}
+
+	packet_len = fr_nbo_to_uint16(data + 2);
+	if ((packet_len < RADIUS_HEADER_LENGTH) || (packet_len > data_len)) {
+		fr_strerror_printf("Packet length %zu is invalid", packet_len);
+		return -1;
+	}
+
+	switch (data[0]) {
+	case FR_RADIUS_CODE_ACCESS_REQUEST:
+	case FR_RADIUS_CODE_STATUS_SERVER:
+	case FR_RADIUS_CODE_ACCOUNTING_REQUEST:
+	case FR_RADIUS_CODE_COA_REQUEST:
+	case FR_RADIUS_CODE_DISCONNECT_REQUEST:
+		break;
+
+	default:
+		fr_strerror_printf("Packet code %u is not a request", data[0]);
+		return -1;
+	}
+
+	for (p = UNCONST(uint8_t *, data) + RADIUS_HEADER_LENGTH, end = UNCONST(uint8_t *, data) + packet_len;
+	     p < end;
+	     p += p[1]) {
+		if (((end - p) < 2) || (p[1] < 2) || ((p + p[1]) > end)) {
+			fr_strerror_printf("Invalid attribute at offset %zu", (size_t) (p - data));
+			return -1;
+		}
+
+		switch (p[0]) {
+		case FR_USER_PASSWORD:
+			password = p;
+			break;
+
+		case FR_CHAP_PASSWORD:
+			chap_password = p;
+			break;
+
+		case FR_CHAP_CHALLENGE:
+			chap_challenge = p;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (((data[0] == FR_RADIUS_CODE_ACCESS_REQUEST) || (data[0] == FR_RADIUS_CODE_STATUS_SERVER)) &&
+	    (rc_load_encrypted_check(data, packet_len, secret) < 0)) return -1;
+
+	num = *packets ? talloc_array_length(*packets) : 0;
+	array = talloc_realloc(ctx, *packets, rc_load_packet_t, num + 1);
+	if (!array) {
+		fr_strerror_const("Out of memory");
+		return -1;
+	}
+	*packets = array;
+	packet = &array[num];
+	*packet = (rc_load_packet_t) {};
+
+	/*
+	 *	Leave room for a CHAP-Challenge or Proxy-State.
+	 */
+	packet->data = talloc_zero_array(array, uint8_t, packet_len + 2 + RADIUS_AUTH_VECTOR_LENGTH);
+	if (!packet->data) {
+	oom:
+		fr_strerror_const("Out of memory");
+		goto error;
+	}
+	memcpy(packet->data, data, packet_len);
+	packet->data_len = packet_len;
+
+	switch (data[0]) {
+	case FR_RADIUS_CODE_ACCESS_REQUEST:
+	case FR_RADIUS_CODE_STATUS_SERVER:
+		if (password) {
+			size_t len = password[1] - 2;
+
+			if ((len == 0) || ((len % AUTH_PASS_LEN) != 0)) {
+				fr_strerror_printf("User-Password has invalid length %zu", len);
+				goto error;
+			}
+
+			packet->password = talloc_array(array, uint8_t, len);
+			if (!packet->password) goto oom;
+
+			packet->password_offset = (password + 2) - data;
+			packet->password_len = len;
+			rc_load_password_crypt(packet->password, password + 2, len, data + 4, secret, true);
+		}
+
+		if (chap_password && !chap_challenge) {
+			p = packet->data + packet->data_len;
+			p[0] = FR_CHAP_CHALLENGE;
+			p[1] = 2 + RADIUS_AUTH_VECTOR_LENGTH;
+			memcpy(p + 2, data + 4, RADIUS_AUTH_VECTOR_LENGTH);
+			packet->data_len += p[1];
+		}
+		break;
+
+	default:
+		p = packet->data + packet->data_len;
+		p[0] = FR_PROXY_STATE;
+		p[1] = 2 + sizeof(uint64_t);
+		packet->counter_offset = packet->data_len + 2;
+		packet->data_len += p[1];
+		break;
+	}
+
+	if (packet->data_len > RADIUS_MAX_PACKET_SIZE) {
+		fr_strerror_printf("Packet is too large (%zu bytes)", packet->data_len);
+	error:
+		talloc_free(packet->data);
+		talloc_free(packet->password);
+		*packets = talloc_realloc(ctx, array, rc_load_packet_t, num);
+		return -1;
+	}
+
+	fr_nbo_from_uint16(packet->data + 2, packet->data_len);
+
+	return 0;
+}
+
+#ifdef HAVE_LIBPCAP
+/** Read requests from a pcap file
+ *
+ * Every UDP packet which looks like a RADIUS request is added, no
+ * matter which port it was sent to.
+ *
+ * @param[in] ctx		to allocate the packet data in.
+ * @param[in,out] packets	talloc array of packets, which may be NULL.
+ * @param[in] filename		of the pcap file.
+ * @param[in] secret		the requests were encoded with.
+ * @return
+ *	- The number of packets read.
+ *	- -1 on error.
+ */
+int rc_load_pcap_read(TALLOC_CTX *ctx, rc_load_packet_t **packets, char const *filename, char const *secret)
+{
+	fr_pcap_t		*pcap;
+	struct pcap_pkthdr	*header;
+	uint8_t const		*data;
+	int			ret, count = 0;
+
+	pcap = fr_pcap_init(ctx, filename, PCAP_FILE_IN);
+	if (!pcap) return -1;
+
+	if (fr_pcap_open(pcap) < 0) {
+		talloc_free(pcap);
+		return -1;
+	}
+
+	while ((ret = pcap_next_ex(pcap->handle, &header, &data)) == 1) {
+		uint8_t const		*p = data;
+		udp_header_t const	*udp;
+		ssize_t			len;
+		size_t			udp_len;
+
+		len = fr_pcap_link_layer_offset(data, header->caplen, pcap->link_layer);
+		if (len < 0) continue;
+		p += len;
+
+		if ((size_t) (p - data) >= header->caplen) continue;
+
+		switch ((p[0] & 0xf0) >> 4) {
+		case 4:
+			p += (((ip_header_t const *) p)->ip_vhl & 0x0f) * 4;
+			break;
+
+		case 6:
+			p += sizeof(ip_header6_t);
+			break;
+
+		default:
+			continue;
+		}
+
+		if ((size_t) ((p - data) + sizeof(udp_header_t) + RADIUS_HEADER_LENGTH) > header->caplen) continue;
+
+		udp = (udp_header_t const *) p;
+		p += sizeof(udp_header_t);
+
+		udp_len = ntohs(udp->len);
+		if ((udp_len < sizeof(udp_header_t)) || ((p - data) + (udp_len - sizeof(udp_header_t)) > header->caplen)) {
+			continue;
+		}
+
+		/*
+		 *	Skip replies, and anything else which isn't a
+		 *	request we can send.
+		 */
+		if (rc_load_packet_add(ctx, packets, p, udp_len - sizeof(udp_header_t), secret) < 0) continue;
+		count++;
+	}
+
+	if (ret == -1) {
+		fr_strerror_printf("Failed reading %s: %s", filename, pcap_geterr(pcap->handle));
+		talloc_free(pcap);
+		return -1;
+	}
+
+	talloc_free(pcap);
+
+	return count;
+}
+#else
+int rc_load_pcap_read(UNUSED TALLOC_CTX *ctx, UNUSED rc_load_packet_t **packets, char const *filename,
+		      UNUSED char const *secret)
+{
+	fr_strerror_printf("Can't read %s, radclient was built without libpcap", filename);
+	return -1;
+}
+#endif
+
+/** Time until the next packet is due, in nanoseconds
+ *
+ */
+static int64_t rc_load_gap(rc_load_thread_t *t)
+{
+	double u;
+
+	if (t->config->arrival == RC_LOAD_ARRIVAL_CONSTANT) return NSEC / t->rate;
+
+	/*
+	 *	Exponentially distributed, with a mean of 1/rate.
+	 *	u is in (0, 1], so the log is always finite.
+	 */
+	u = ((double) fr_fast_rand(&t->rand_ctx) + 1) / ((double) UINT32_MAX + 1);
+
+	return -log(u) * NSEC / t->rate;
+}
+
+/** Send the next packet, which was due at "intended"
+ *
+ * @return
+ *	- 0 on success, or if the write failed.
+ *	- -1 if there are no free IDs.
+ */
+static int rc_load_send(rc_load_thread_t *t, fr_time_t intended, fr_time_t now)
+{
+	rc_load_packet_t const	*packet;
+	rc_load_outstanding_t	*out;
+	uint8_t			buffer[RADIUS_MAX_PACKET_SIZE];
+	unsigned int		id, i;
+	ssize_t			slen;
+
+	if (t->num_outstanding == 256) return -1;
+
+	for (i = 1; i <= 256; i++) {
+		id = (t->last_id + i) & 0xff;
+		if (!t->outstanding[id].in_use) break;
+	}
+	t->last_id = id;
+
+	packet = &t->packets[t->next_packet++];
+	if (t->next_packet == t->num_packets) t->next_packet = 0;
+
+	memcpy(buffer, packet->data, packet->data_len);
+	buffer[1] = id;
+
+	switch (buffer[0]) {
+	case FR_RADIUS_CODE_ACCESS_REQUEST:
+	case FR_RADIUS_CODE_STATUS_SERVER:
+		for (i = 0; i < RADIUS_AUTH_VECTOR_LENGTH; i += sizeof(uint32_t)) {
+			uint32_t r = fr_fast_rand(&t->rand_ctx);
+
+			memcpy(buffer + 4 + i, &r, sizeof(r));
+		}
+
+		if (packet->password_offset) {
+			rc_load_password_crypt(buffer + packet->password_offset, packet->password, packet->password_len,
+					       buffer + 4, t->config->secret, false);
+		}
+		break;
+
+	default:
+		fr_nbo_from_uint64(buffer + packet->counter_offset, t->counter++);
+		break;
+	}
+
+	/*
+	 *	Sets the Request Authenticator for accounting
+	 *	packets, and updates the Message-Authenticator.
+	 */
+	if (fr_radius_sign(buffer, NULL, (uint8_t const *) t->config->secret, strlen(t->config->secret)) < 0) {
+		fr_histogram_counter_inc(&t->stats.errors);
+		return 0;
+	}
+
+	slen = fr_bio_write(t->bio, NULL, buffer, packet->data_len);
+	if (slen <= 0) {
+		fr_histogram_counter_inc(&t->stats.errors);
+		return 0;
+	}
+
+	out = &t->outstanding[id];
+	out->intended = intended;
+	out->sent = now;
+	memcpy(out->vector, buffer + 4, sizeof(out->vector));
+	out->in_use = true;
+	t->num_outstanding++;
+
+	fr_histogram_counter_inc(&t->stats.sent);
+	if (fr_time_delta_gt(fr_time_sub(now, intended), RC_LOAD_LATE)) fr_histogram_counter_inc(&t->stats.late);
+
+	return 0;
+}
+
+/** Read all of the replies which are waiting
+ *
+ */
+static void rc_load_recv(rc_load_thread_t *t)
+{
+	uint8_t			buffer[RADIUS_MAX_PACKET_SIZE];
+	fr_bio_fd_packet_ctx_t	packet_ctx;
+	rc_load_outstanding_t	*out;
+	ssize_t			slen;
+	fr_time_t		now;
+
+	while (true) {
+		slen = fr_bio_read(t->bio, &packet_ctx, buffer, sizeof(buffer));
+		if (slen <= 0) return;
+
+		now = fr_time();
+
+		if ((slen < RADIUS_HEADER_LENGTH) || (fr_nbo_to_uint16(buffer + 2) > (size_t) slen)) {
+		bad:
+			fr_histogram_counter_inc(&t->stats.errors);
+			continue;
+		}
+
+		/*
+		 *	Either a reply to a packet we've already given
+		 *	up on, or junk.
+		 */
+		out = &t->outstanding[buffer[1]];
+		if (!out->in_use) goto bad;
+
+		if (fr_radius_verify(buffer, out->vector, (uint8_t const *) t->config->secret,
+				     strlen(t->config->secret), false) < 0) goto bad;
+
+		fr_histogram_record(&t->latency, fr_time_delta_unwrap(fr_time_sub(now, out->intended)));
+		fr_histogram_record(&t->service, fr_time_delta_unwrap(fr_time_sub(now, out->sent)));
+
+		out->in_use = false;
+		t->num_outstanding--;
+
+		fr_histogram_counter_inc(&t->stats.received);
+
+		switch (buffer[0]) {
+		case FR_RADIUS_CODE_ACCESS_ACCEPT:
+		case FR_RADIUS_CODE_ACCOUNTING_RESPONSE:
+		case FR_RADIUS_CODE_COA_ACK:
+		case FR_RADIUS_CODE_DISCONNECT_ACK:
+			fr_histogram_counter_inc(&t->stats.accepted);
+			break;
+
+		default:
+			fr_histogram_counter_inc(&t->stats.rejected);
+			break;
+		}
+	}
+}
+
+/** Give up on packets which haven't had a reply within the timeout
+ *
+ * They're still recorded in the histograms, as if the reply had
+ * arrived at the timeout.
+ */
+static void rc_load_expire(rc_load_thread_t *t, fr_time_t now)
+{
+	unsigned int i;
+
+	if (!t->num_outstanding) return;
+
+	for (i = 0; i < 256; i++) {
+		rc_load_outstanding_t *out = &t->outstanding[i];
+
+		if (!out->in_use) continue;
+		if (fr_time_delta_lt(fr_time_sub(now, out->sent), t->config->timeout)) continue;
+
+		fr_histogram_record(&t->latency,
+				    fr_time_delta_unwrap(fr_time_sub(fr_time_add(out->sent, t->config->timeout), out->intended)));
+		fr_histogram_record(&t->service, fr_time_delta_unwrap(t->config->timeout));
+
+		out->in_use = false;
+		t->num_outstanding--;
+		fr_histogram_counter_inc(&t->stats.lost);
+	}
+}
+
+static void *rc_load_thread(void *arg)
+{
+	rc_load_thread_t	*t = arg;
+	fr_time_t		next, now, last_expire;
+	fr_time_delta_t		wait;
+	bool			blocked;
+
+	/*
+	 *	Spread the first packet of each thread over the first gap.
+	 */
+	if (t->config->arrival == RC_LOAD_ARRIVAL_CONSTANT) {
+		next = fr_time_add(t->start, fr_time_delta_wrap(rc_load_gap(t) * t->num / t->config->threads));
+	} else {
+		next = fr_time_add(t->start, fr_time_delta_wrap(rc_load_gap(t)));
+	}
+	last_expire = t->start;
+
+	while (true) {
+		fd_set			fds;
+		struct timeval		tv;
+
+		now = fr_time();
+
+		/*
+		 *	Send everything which is due.  If we've run out
+		 *	of IDs, the packet stays due, and its latency
+		 *	includes the time spent waiting for an ID.
+		 */
+		blocked = false;
+		while (fr_time_lteq(next, now) && fr_time_lt(next, t->end)) {
+			if (rc_load_send(t, next, now) < 0) {
+				blocked = true;
+				break;
+			}
+			next = fr_time_add(next, fr_time_delta_wrap(rc_load_gap(t)));
+		}
+
+		rc_load_recv(t);
+
+		now = fr_time();
+		if (fr_time_delta_gteq(fr_time_sub(now, last_expire), RC_LOAD_TICK)) {
+			rc_load_expire(t, now);
+			last_expire = now;
+		}
+
+		if (fr_time_gteq(now, t->end) && !t->num_outstanding) break;
+
+		/*
+		 *	Wait for a reply, or for the next packet to be due.
+		 */
+		wait = RC_LOAD_TICK;
+		if (!blocked && fr_time_lt(next, t->end)) {
+			fr_time_delta_t until = fr_time_sub(next, now);
+
+			if (fr_time_delta_lt(until, wait)) wait = until;
+		}
+		if (!fr_time_delta_ispos(wait)) continue;
+
+		FD_ZERO(&fds);
+		FD_SET(t->fd, &fds);
+		tv = fr_time_delta_to_timeval(wait);
+
+		(void) select(t->fd + 1, &fds, NULL, NULL, &tv);
+	}
+
+	/*
+	 *	Count the packets which were due, but which we never
+	 *	managed to send.  They waited until the end of the
+	 *	run, which is what goes into the latency histogram.
+	 */
+	while (fr_time_lt(next, t->end)) {
+		fr_histogram_record(&t->latency, fr_time_delta_unwrap(fr_time_sub(t->end, next)));
+		fr_histogram_counter_inc(&t->stats.unsent);
+		next = fr_time_add(next, fr_time_delta_wrap(rc_load_gap(t)));
+	}
+
+	atomic_store(&t->done, true);
+
+	return NULL;
+}
+
+static void rc_load_totals(rc_load_totals_t *totals, rc_load_thread_t **threads, uint32_t num_threads)
+{
+	uint32_t i;
+
+	memset(totals, 0, sizeof(*totals));
+	fr_histogram_init(&totals->latency);
+	fr_histogram_init(&totals->service);
+
+	for (i = 0; i < num_threads; i++) {
+		rc_load_stats_t const *stats = &threads[i]->stats;
+
+		totals->sent += atomic_load_explicit(&stats->sent, memory_order_relaxed);
+		totals->received += atomic_load_explicit(&stats->received, memory_order_relaxed);
+		totals->accepted += atomic_load_explicit(&stats->accepted, memory_order_relaxed);
+		totals->rejected += atomic_load_explicit(&stats->rejected, memory_order_relaxed);
+		totals->lost += atomic_load_explicit(&stats->lost, memory_order_relaxed);
+		totals->late += atomic_load_explicit(&stats->late, memory_order_relaxed);
+		totals->unsent += atomic_load_explicit(&stats->unsent, memory_order_relaxed);
+		totals->errors += atomic_load_explicit(&stats->errors, memory_order_relaxed);
+
+		fr_histogram_merge(&totals->latency, &threads[i]->latency);
+		fr_histogram_merge(&totals->service, &threads[i]->service);
+	}
+}
+
+static void rc_load_report(rc_load_config_t const *config, double elapsed, double period,
+			   rc_load_totals_t const *now, rc_load_totals_t const *prev)
+{
+	fr_histogram_t	latency;
+	uint64_t	sent = now->sent - prev->sent;
+	uint64_t	received = now->received - prev->received;
+	uint64_t	lost = now->lost - prev->lost;
+	uint64_t	late = now->late - prev->late;
+	uint64_t	errors = now->errors - prev->errors;
+
+	fr_histogram_sub(&latency, &now->latency, &prev->latency);
+
+	switch (config->report) {
+	case RC_LOAD_REPORT_CSV:
+		printf("%.3f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+		       elapsed, sent, received, lost, late, errors,
+		       period > 0 ? received / period : 0,
+		       TO_USEC(fr_histogram_percentile(&latency, 50)), TO_USEC(fr_histogram_percentile(&latency, 90)),
+		       TO_USEC(fr_histogram_percentile(&latency, 99)), TO_USEC(fr_histogram_percentile(&latency, 99.9)),
+		       TO_USEC(fr_histogram_max(&latency)));
+		break;
+
+	case RC_LOAD_REPORT_JSON:
+		printf("{\"time\":%.3f,\"sent\":%" PRIu64 ",\"received\":%" PRIu64 ",\"lost\":%" PRIu64
+		       ",\"late\":%" PRIu64 ",\"errors\":%" PRIu64 ",\"rate\":%.1f,"
+		       "\"latency_us\":{\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p99.9\":%.1f,\"max\":%.1f}}\n",
+		       elapsed, sent, received, lost, late, errors,
+		       period > 0 ? received / period : 0,
+		       TO_USEC(fr_histogram_percentile(&latency, 50)), TO_USEC(fr_histogram_percentile(&latency, 90)),
+		       TO_USEC(fr_histogram_percentile(&latency, 99)), TO_USEC(fr_histogram_percentile(&latency, 99.9)),
+		       TO_USEC(fr_histogram_max(&latency)));
+		break;
+	}
+
+	fflush(stdout);
+}
+
+static void rc_load_summary_latency(char const *name, fr_histogram_t const *hist)
+{
+	fprintf(stderr, "\t%-13s : min %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n", name,
+		TO_USEC(fr_histogram_min(hist)),
+		TO_USEC(fr_histogram_percentile(hist, 50)), TO_USEC(fr_histogram_percentile(hist, 90)),
+		TO_USEC(fr_histogram_percentile(hist, 99)), TO_USEC(fr_histogram_percentile(hist, 99.9)),
+		TO_USEC(fr_histogram_max(hist)));
+}
+
+/** Send packets at a fixed rate, and report on the replies
+ *
+ * Periodic reports are written to stdout, and a summary to stderr.
+ *
+ * @param[in] config	for the run.
+ * @param[in] packets	talloc array of packets to send.  Each thread
+ *			cycles through all of them.
+ * @return
+ *	- 0 if every packet got a reply.
+ *	- 1 if any packets were lost, or never sent.
+ *	- -1 on error.
+ */
+int rc_load_run(rc_load_config_t const *config, rc_load_packet_t const *packets)
+{
+	TALLOC_CTX		*ctx;
+	rc_load_thread_t	**threads;
+	rc_load_totals_t	*totals, *prev;
+	pthread_attr_t		attr;
+	fr_time_t		start, next_report, last_report, now;
+	uint32_t		i, num_started = 0;
+	double			elapsed;
+	bool			done;
+	int			ret = -1;
+
+	if (!packets || !talloc_array_length(packets)) {
+		fr_strerror_const("Nothing to send");
+		return -1;
+	}
+
+	if ((config->rate <= 0) || !config->threads) {
+		fr_strerror_const("Rate and number of threads must be greater than zero");
+		return -1;
+	}
+
+	ctx = talloc_init_const("rc_load");
+	threads = talloc_zero_array(ctx, rc_load_thread_t *, config->threads);
+	totals = talloc_zero(ctx, rc_load_totals_t);
+	prev = talloc_zero(ctx, rc_load_totals_t);
+	if (!threads || !totals || !prev) {
+		fr_strerror_const("Out of memory");
+		goto finish;
+	}
+
+	/*
+	 *	Give the threads a moment to start, so that they
+	 *	don't begin with a backlog of packets.
+	 */
+	start = fr_time_add(fr_time(), fr_time_delta_from_msec(10));
+
+	for (i = 0; i < config->threads; i++) {
+		rc_load_thread_t *t;
+
+		t = threads[i] = talloc_zero(threads, rc_load_thread_t);
+		if (!t) {
+			fr_strerror_const("Out of memory");
+			goto finish;
+		}
+
+		t->num = i;
+		t->config = config;
+		t->packets = packets;
+		t->num_packets = talloc_array_length(packets);
+		t->next_packet = (t->num_packets * i) / config->threads;
+		t->rate = config->rate / config->threads;
+		t->start = start;
+		t->end = fr_time_add(start, config->duration);
+		t->last_id = fr_rand() & 0xff;
+
+		/*
+		 *	fr_rand() isn't thread safe, so the threads
+		 *	are seeded here.
+		 */
+		t->rand_ctx.a = fr_rand();
+		t->rand_ctx.b = fr_rand();
+
+		fr_histogram_init(&t->latency);
+		fr_histogram_init(&t->service);
+
+		t->bio = fr_bio_fd_alloc(t, NULL, config->fd_config, 0);
+		if (!t->bio) {
+			fr_strerror_printf_push("Failed opening socket for thread %u", i);
+			goto finish;
+		}
+		t->fd = fr_bio_fd_info(t->bio)->socket.fd;
+	}
+
+	(void) pthread_attr_init(&attr);
+	(void) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+	for (i = 0; i < config->threads; i++) {
+		if (pthread_create(&threads[i]->pthread_id, &attr, rc_load_thread, threads[i]) != 0) {
+			fr_strerror_printf("Failed creating thread: %s", fr_syserror(errno));
+			break;
+		}
+		num_started++;
+	}
+	(void) pthread_attr_destroy(&attr);
+
+	/*
+	 *	If we couldn't start all of the threads, wait for the
+	 *	ones which did start, and then give up.
+	 */
+	if (num_started < config->threads) {
+		for (i = 0; i < num_started; i++) (void) pthread_join(threads[i]->pthread_id, NULL);
+		goto finish;
+	}
+
+	if (config->report == RC_LOAD_REPORT_CSV) {
+		printf("time,sent,received,lost,late,errors,rate,p50_us,p90_us,p99_us,p999_us,max_us\n");
+	}
+
+	fr_histogram_init(&prev->latency);
+	fr_histogram_init(&prev->service);
+	last_report = start;
+	next_report = fr_time_add(start, config->interval);
+
+	do {
+		struct timespec ts;
+
+		now = fr_time();
+		if (fr_time_lt(now, next_report)) {
+			fr_time_delta_t	wait = fr_time_sub(next_report, now);
+
+			ts = fr_time_delta_to_timespec(wait);
+			(void) nanosleep(&ts, NULL);
+			now = fr_time();
+		}
+
+		done = true;
+		for (i = 0; i < config->threads; i++) {
+			if (!atomic_load(&threads[i]->done)) done = false;
+		}
+
+		rc_load_totals(totals, threads, config->threads);
+		rc_load_report(config, fr_time_delta_unwrap(fr_time_sub(now, start)) / (double) NSEC,
+			       fr_time_delta_unwrap(fr_time_sub(now, last_report)) / (double) NSEC,
+			       totals, prev);
+		memcpy(prev, totals, sizeof(*prev));
+		last_report = now;
+
+		while (fr_time_lteq(next_report, now)) next_report = fr_time_add(next_report, config->interval);
+	} while (!done);
+
+	for (i = 0; i < config->threads; i++) (void) pthread_join(threads[i]->pthread_id, NULL);
+
+	rc_load_totals(totals, threads, config->threads);
+
+	elapsed = fr_time_delta_unwrap(config->duration) / (double) NSEC;
+
+	fprintf(stderr, "Load summary:\n"
+		"\tThreads       : %u\n"
+		"\tRequested     : %.1f packets/s for %.3fs\n"
+		"\tSent          : %" PRIu64 " (%.1f packets/s)\n"
+		"\tReceived      : %" PRIu64 " (%.1f packets/s)\n"
+		"\tAccepted      : %" PRIu64 "\n"
+		"\tRejected      : %" PRIu64 "\n"
+		"\tLost          : %" PRIu64 "\n"
+		"\tLate          : %" PRIu64 "\n"
+		"\tUnsent        : %" PRIu64 "\n"
+		"\tErrors        : %" PRIu64 "\n",
+		config->threads, config->rate, elapsed,
+		totals->sent, totals->sent / elapsed,
+		totals->received, totals->received / elapsed,
+		totals->accepted, totals->rejected, totals->lost, totals->late, totals->unsent, totals->errors);
+	rc_load_summary_latency("Latency (us)", &totals->latency);
+	rc_load_summary_latency("Service (us)", &totals->service);
+
+	ret = ((totals->lost > 0) || (totals->unsent > 0)) ? 1 : 0;
+
+finish:
+	talloc_free(ctx);
+
+	return ret;
+}
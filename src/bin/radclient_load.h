@@ -0,0 +1,88 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file radclient_load.h
+ * @brief Open-loop load generation for radclient-ng.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(radclient_load_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/radius/radius.h>
+#include <freeradius-devel/bio/fd.h>
+#include <freeradius-devel/util/time.h>
+
+typedef enum {
+	RC_LOAD_ARRIVAL_CONSTANT = 0,		//!< Evenly spaced packets.
+	RC_LOAD_ARRIVAL_POISSON			//!< Exponentially distributed gaps between packets.
+} rc_load_arrival_t;
+
+typedef enum {
+	RC_LOAD_REPORT_CSV = 0,			//!< One comma separated line per interval.
+	RC_LOAD_REPORT_JSON			//!< One JSON object per interval.
+} rc_load_report_t;
+
+typedef struct {
+	double			rate;		//!< Packets per second, across all threads.
+	uint32_t		threads;	//!< Number of sender threads.
+	rc_load_arrival_t	arrival;	//!< How packets are spaced.
+	fr_time_delta_t		duration;	//!< How long to send packets for.
+	fr_time_delta_t		interval;	//!< Time between reports.
+	fr_time_delta_t		timeout;	//!< After which a packet is counted as lost.
+	rc_load_report_t	report;		//!< Format of the periodic reports.
+
+	fr_bio_fd_config_t const *fd_config;	//!< For each thread's socket.
+	char const		*secret;	//!< Shared secret.
+} rc_load_config_t;
+
+/** An encoded packet to send
+ *
+ * Every copy of the packet which is sent has to be different, otherwise
+ * the server treats it as a retransmission, and replies from its cache.
+ * So each time the packet is sent, the ID is overwritten, Access-Requests
+ * get a new Request Authenticator (and their User-Password re-encrypted),
+ * and other packets get a new value for a Proxy-State we add to them.
+ * Access-Requests with any other encrypted attributes are rejected.
+ */
+typedef struct {
+	uint8_t			*data;		//!< Packet, with room for the Proxy-State.
+	size_t			data_len;	//!< Length of the packet.
+
+	size_t			password_offset;	//!< Of the User-Password value, or 0 if there isn't one.
+	size_t			password_len;		//!< Length of the encrypted value.
+	uint8_t			*password;		//!< Padded plaintext, password_len bytes.
+
+	size_t			counter_offset;		//!< Of the Proxy-State value, or 0 if there isn't one.
+} rc_load_packet_t;
+
+int	rc_load_packet_add(TALLOC_CTX *ctx, rc_load_packet_t **packets,
+			   uint8_t const *data, size_t data_len, char const *secret);
+
+int	rc_load_pcap_read(TALLOC_CTX *ctx, rc_load_packet_t **packets, char const *filename, char const *secret);
+
+int	rc_load_run(rc_load_config_t const *config, rc_load_packet_t const *packets);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,489 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file raddetail.c
+ * @brief Convert detail files between the text and binary formats.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/internal/detail.h>
+#include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/conf.h>
+#include <freeradius-devel/util/pair_legacy.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+DIAG_OFF(unused-macros)
+#define DEBUG(fmt, ...)		if (fr_log_fp && (fr_debug_lvl > 1)) fprintf(fr_log_fp , fmt "\n", ## __VA_ARGS__)
+#define INFO(fmt, ...)		if (fr_log_fp && (fr_debug_lvl > 0)) fprintf(fr_log_fp , fmt "\n", ## __VA_ARGS__)
+DIAG_ON(unused-macros)
+
+static fr_dict_t *dict_internal;
+static fr_dict_t *dict_protocol;
+
+static fr_dict_attr_t const *attr_net;
+static fr_dict_attr_t const *attr_net_src_ip;
+static fr_dict_attr_t const *attr_net_dst_ip;
+static fr_dict_attr_t const *attr_net_src_port;
+static fr_dict_attr_t const *attr_net_dst_port;
+static fr_dict_attr_t const *attr_packet_type;
+
+static bool convert_all = false;
+
+static NEVER_RETURNS void usage(int ret)
+{
+	fprintf(stderr, "usage: raddetail [OPTS] <input> <output>\n");
+	fprintf(stderr, "  -a               Convert entries which have already been processed.\n");
+	fprintf(stderr, "  -D <dictdir>     Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -p <protocol>    Protocol of text detail files (defaults to radius).\n");
+	fprintf(stderr, "  -x               Debugging mode.\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Converts text detail files to binary, and binary detail files to text.\n");
+	fprintf(stderr, "The input format is detected automatically.\n");
+
+	fr_exit_now(ret);
+}
+
+/** Convert one text entry to a binary record
+ *
+ */
+static int text_entry_to_binary(FILE *out, char *start, char *end, int lineno)
+{
+	TALLOC_CTX		*ctx;
+	fr_pair_list_t		list;
+	fr_pair_parse_t		root, relative;
+	fr_pair_t		*vp;
+	fr_detail_binary_t	hdr = { .protocol = fr_dict_root(dict_protocol)->attr };
+	fr_dcursor_t		cursor;
+	fr_dbuff_t		*dbuff;
+	ssize_t			slen;
+	char			*p, *eol;
+	int			ret = -1;
+
+	/*
+	 *	Skip the header line, it's just a human readable
+	 *	version of "Timestamp".
+	 */
+	p = memchr(start, '\n', end - start);
+	if (!p) return 0;
+	p++;
+	lineno++;
+
+	ctx = talloc_new(NULL);
+	fr_pair_list_init(&list);
+
+	for (; p < end; p = eol + 1, lineno++) {
+		eol = memchr(p, '\n', end - p);
+		if (!eol) eol = end;
+		*eol = '\0';
+
+		if (*p != '\t') {
+			fr_strerror_printf("Malformed line %d", lineno);
+			goto finish;
+		}
+		p++;
+
+		if (strncmp(p, "Timestamp = ", 12) == 0) {
+			hdr.timestamp = fr_unix_time_from_sec(strtoul(p + 12, NULL, 10));
+			continue;
+		}
+
+		/*
+		 *	"Donestamp" is what the detail reader writes
+		 *	over "Timestamp" once the entry is processed.
+		 */
+		if (strncmp(p, "Donestamp = ", 12) == 0) {
+			if (!convert_all) {
+				ret = 0;
+				goto finish;
+			}
+			hdr.timestamp = fr_unix_time_from_sec(strtoul(p + 12, NULL, 10));
+			hdr.flags |= FR_DETAIL_BINARY_FLAG_DONE;
+			continue;
+		}
+
+		if (strncasecmp(p, "Request-Authenticator", 21) == 0) continue;
+
+		root = (fr_pair_parse_t) {
+			.ctx = ctx,
+			.da = fr_dict_root(dict_protocol),
+			.list = &list,
+		};
+		relative = (fr_pair_parse_t) { };
+
+		if (fr_pair_list_afrom_substr(&root, &relative, &FR_SBUFF_IN(p, eol)) <= 0) {
+			fr_strerror_printf_push("Failed parsing line %d", lineno);
+			goto finish;
+		}
+	}
+
+	/*
+	 *	The packet type and addresses live in the header.
+	 */
+	if (attr_packet_type && (vp = fr_pair_find_by_da(&list, NULL, attr_packet_type))) {
+		hdr.code = vp->vp_uint32;
+		fr_pair_delete_by_da(&list, attr_packet_type);
+	}
+
+	vp = fr_pair_find_by_da_nested(&list, NULL, attr_net_src_ip);
+	if (vp) hdr.src_ipaddr = vp->vp_ip;
+	vp = fr_pair_find_by_da_nested(&list, NULL, attr_net_dst_ip);
+	if (vp) hdr.dst_ipaddr = vp->vp_ip;
+	vp = fr_pair_find_by_da_nested(&list, NULL, attr_net_src_port);
+	if (vp) hdr.src_port = vp->vp_uint16;
+	vp = fr_pair_find_by_da_nested(&list, NULL, attr_net_dst_port);
+	if (vp) hdr.dst_port = vp->vp_uint16;
+	fr_pair_delete_by_da(&list, attr_net);
+
+	FR_DBUFF_TALLOC_THREAD_LOCAL(&dbuff, 4096, 1024 * 1024);
+
+	fr_pair_dcursor_init(&cursor, &list);
+	slen = fr_detail_binary_encode(dbuff, &hdr, &cursor);
+	if (slen <= 0) {
+		fr_strerror_printf_push("Failed encoding entry ending at line %d", lineno);
+		goto finish;
+	}
+
+	if (fwrite(fr_dbuff_start(dbuff), slen, 1, out) != 1) {
+		fr_strerror_printf("Failed writing output: %s", fr_syserror(errno));
+		goto finish;
+	}
+
+	ret = 1;
+
+finish:
+	talloc_free(ctx);
+	return ret;
+}
+
+static int text_to_binary(FILE *out, char *data, size_t data_len)
+{
+	char	*p = data, *end = data + data_len;
+	char	*next;
+	int	lineno = 1;
+	int	count = 0;
+
+	while (p < end) {
+		char	*q;
+		int	rcode, lines = 0;
+
+		/*
+		 *	Entries are separated by a blank line.
+		 */
+		next = memmem(p, end - p, "\n\n", 2);
+		if (!next) next = end;
+
+		/*
+		 *	Skip any extra blank lines.
+		 */
+		if (p == next) {
+			p++;
+			lineno++;
+			continue;
+		}
+
+		for (q = p; q < next; q++) if (*q == '\n') lines++;
+
+		rcode = text_entry_to_binary(out, p, next, lineno);
+		if (rcode < 0) return -1;
+		count += rcode;
+
+		lineno += lines + 2;
+		p = next + 2;
+	}
+
+	INFO("Wrote %d binary entries", count);
+
+	return 0;
+}
+
+static int binary_to_text(FILE *out, uint8_t const *data, size_t data_len)
+{
+	uint8_t const	*p = data, *end = data + data_len;
+	int		count = 0;
+
+	while (p < end) {
+		TALLOC_CTX		*ctx;
+		fr_pair_list_t		list;
+		fr_detail_binary_t	hdr;
+		ssize_t			record_len, slen;
+		char			buff[1024];
+		fr_sbuff_t		sbuff;
+		time_t			when;
+		struct tm		tm;
+		fr_dict_t const		*dict;
+
+		record_len = fr_detail_binary_record_len(p, end - p);
+		if (record_len < 0) {
+			fr_strerror_printf_push("Malformed record at offset %zu", (size_t) (p - data));
+			return -1;
+		}
+
+		if ((record_len == 0) || (record_len > (end - p))) {
+			fprintf(stderr, "raddetail - Ignoring truncated record at offset %zu\n", (size_t) (p - data));
+			break;
+		}
+
+		if (!convert_all && ((p[FR_DETAIL_BINARY_FLAGS_OFFSET] & FR_DETAIL_BINARY_FLAG_DONE) != 0)) {
+			p += record_len;
+			continue;
+		}
+
+		ctx = talloc_new(NULL);
+		fr_pair_list_init(&list);
+
+		slen = fr_detail_binary_decode(ctx, &list, NULL, &hdr, p, record_len);
+		if (slen < 0) {
+			fr_perror("raddetail - Ignoring record at offset %zu", (size_t) (p - data));
+			talloc_free(ctx);
+			p += record_len;
+			continue;
+		}
+
+		when = fr_unix_time_to_sec(hdr.timestamp);
+		localtime_r(&when, &tm);
+		strftime(buff, sizeof(buff), "%a %b %e %H:%M:%S %Y", &tm);
+		fprintf(out, "%s\n", buff);
+
+		dict = fr_dict_by_protocol_num(hdr.protocol);
+		if (dict && hdr.code) {
+			fr_dict_attr_t const	*da;
+			char const		*name = NULL;
+
+			da = fr_dict_attr_by_name(NULL, fr_dict_root(dict), "Packet-Type");
+			if (da) name = fr_dict_enum_name_by_value(da, fr_box_uint32(hdr.code));
+
+			if (name) {
+				fprintf(out, "\tPacket-Type = %s\n", name);
+			} else {
+				fprintf(out, "\tPacket-Type = %u\n", hdr.code);
+			}
+		}
+
+		if (hdr.src_ipaddr.af != AF_UNSPEC) {
+			fprintf(out, "\tNet.Src.IP = %s\n", fr_inet_ntop(buff, sizeof(buff), &hdr.src_ipaddr));
+			fprintf(out, "\tNet.Src.Port = %u\n", hdr.src_port);
+		}
+		if (hdr.dst_ipaddr.af != AF_UNSPEC) {
+			fprintf(out, "\tNet.Dst.IP = %s\n", fr_inet_ntop(buff, sizeof(buff), &hdr.dst_ipaddr));
+			fprintf(out, "\tNet.Dst.Port = %u\n", hdr.dst_port);
+		}
+
+		fr_pair_list_foreach_leaf(&list, vp) {
+			sbuff = FR_SBUFF_OUT(buff, sizeof(buff));
+
+			(void) fr_sbuff_in_char(&sbuff, '\t');
+			(void) fr_pair_print(&sbuff, NULL, vp);
+			(void) fr_sbuff_in_char(&sbuff, '\n');
+
+			fputs(buff, out);
+		}
+
+		fprintf(out, "\t%s = %lu\n\n", (hdr.flags & FR_DETAIL_BINARY_FLAG_DONE) ? "Donestamp" : "Timestamp",
+			(unsigned long) when);
+
+		talloc_free(ctx);
+		p += record_len;
+		count++;
+	}
+
+	INFO("Wrote %d text entries", count);
+
+	return 0;
+}
+
+/**
+ *
+ * @hidecallgraph
+ */
+int main(int argc, char *argv[])
+{
+	char const		*dict_dir = DICTDIR;
+	char const		*protocol = "radius";
+	int			c, fd;
+	int			ret = EXIT_FAILURE;
+	struct stat		buf;
+	void			*data = MAP_FAILED;
+	FILE			*out = NULL;
+
+	TALLOC_CTX		*autofree;
+
+	/*
+	 *	Must be called first, so the handler is called last
+	 */
+	fr_atexit_global_setup();
+
+	autofree = talloc_autofree_context();
+
+#ifndef NDEBUG
+	if (fr_fault_setup(autofree, getenv("PANIC_ACTION"), argv[0]) < 0) {
+		fr_perror("raddetail - Fault setup");
+		fr_exit(EXIT_FAILURE);
+	}
+#endif
+
+	talloc_set_log_stderr();
+
+	fr_debug_lvl = 0;
+
+	while ((c = getopt(argc, argv, "aD:p:xh")) != -1) switch (c) {
+		case 'a':
+			convert_all = true;
+			break;
+
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'p':
+			protocol = optarg;
+			break;
+
+		case 'x':
+			fr_log_fp = stdout;
+			fr_debug_lvl++;
+			break;
+
+		case 'h':
+			usage(EXIT_SUCCESS);
+
+		default:
+			usage(EXIT_FAILURE);
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 2) usage(EXIT_FAILURE);
+
+	/*
+	 *	Mismatch between the binary and the libraries it depends on
+	 */
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) {
+		fr_perror("raddetail - library mismatch");
+		goto finish;
+	}
+
+	if (!fr_dict_global_ctx_init(NULL, true, dict_dir)) {
+		fr_perror("raddetail - Global context init failed");
+		goto finish;
+	}
+
+	if (fr_dict_internal_afrom_file(&dict_internal, FR_DICTIONARY_INTERNAL_DIR, __FILE__) < 0) {
+		fr_perror("raddetail - Loading internal dictionary failed");
+		goto finish;
+	}
+
+	if (fr_dict_protocol_afrom_file(&dict_protocol, protocol, NULL, __FILE__) < 0) {
+		fr_perror("raddetail - Loading dictionary for protocol %s failed", protocol);
+		goto finish;
+	}
+
+	attr_net = fr_dict_attr_by_oid(NULL, fr_dict_root(dict_internal), "Net");
+	attr_net_src_ip = fr_dict_attr_by_oid(NULL, fr_dict_root(dict_internal), "Net.Src.IP");
+	attr_net_dst_ip = fr_dict_attr_by_oid(NULL, fr_dict_root(dict_internal), "Net.Dst.IP");
+	attr_net_src_port = fr_dict_attr_by_oid(NULL, fr_dict_root(dict_internal), "Net.Src.Port");
+	attr_net_dst_port = fr_dict_attr_by_oid(NULL, fr_dict_root(dict_internal), "Net.Dst.Port");
+	if (!attr_net || !attr_net_src_ip || !attr_net_dst_ip || !attr_net_src_port || !attr_net_dst_port) {
+		fr_perror("raddetail - Failed resolving Net.* attributes");
+		goto finish;
+	}
+	attr_packet_type = fr_dict_attr_by_name(NULL, fr_dict_root(dict_protocol), "Packet-Type");
+
+	fd = open(argv[0], O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "raddetail - Failed opening %s: %s\n", argv[0], fr_syserror(errno));
+		goto finish;
+	}
+
+	if (fstat(fd, &buf) < 0) {
+		fprintf(stderr, "raddetail - Failed examining %s: %s\n", argv[0], fr_syserror(errno));
+		close(fd);
+		goto finish;
+	}
+
+	if (buf.st_size == 0) {
+		fprintf(stderr, "raddetail - %s is empty\n", argv[0]);
+		close(fd);
+		goto finish;
+	}
+
+	/*
+	 *	Map the file privately, as the text parser writes
+	 *	NULs into the buffer.
+	 */
+	data = mmap(NULL, buf.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "raddetail - Failed mapping %s: %s\n", argv[0], fr_syserror(errno));
+		goto finish;
+	}
+
+	out = fopen(argv[1], "w");
+	if (!out) {
+		fprintf(stderr, "raddetail - Failed opening %s: %s\n", argv[1], fr_syserror(errno));
+		goto finish;
+	}
+
+	if (fr_detail_binary_is(data, buf.st_size)) {
+		INFO("Converting binary detail file %s to text", argv[0]);
+		if (binary_to_text(out, data, buf.st_size) < 0) {
+			fr_perror("raddetail - Failed converting %s", argv[0]);
+			goto finish;
+		}
+	} else {
+		INFO("Converting text detail file %s to binary", argv[0]);
+		if (text_to_binary(out, data, buf.st_size) < 0) {
+			fr_perror("raddetail - Failed converting %s", argv[0]);
+			goto finish;
+		}
+	}
+
+	if (fflush(out) != 0) {
+		fprintf(stderr, "raddetail - Failed writing %s: %s\n", argv[1], fr_syserror(errno));
+		goto finish;
+	}
+
+	ret = EXIT_SUCCESS;
+
+finish:
+	if (out) fclose(out);
+	if (data != MAP_FAILED) munmap(data, buf.st_size);
+
+	if (dict_protocol) fr_dict_free(&dict_protocol, __FILE__);
+	if (dict_internal) fr_dict_free(&dict_internal, __FILE__);
+
+	if (talloc_free(autofree) < 0) fr_perror("raddetail - Error freeing dictionaries");
+
+	/*
+	 *	Ensure our atexit handlers run before any other
+	 *	atexit handlers registered by third party libraries.
+	 */
+	fr_atexit_global_trigger_all();
+
+	return ret;
+}
@@ -0,0 +1,5 @@
+TARGET		:= raddetail$(E)
+SOURCES		:= raddetail.c
+
+TGT_PREREQS	:= libfreeradius-util$(L) libfreeradius-internal$(L)
+TGT_LDLIBS	:= $(LIBS)
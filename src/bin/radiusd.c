@@ -792,6 +792,25 @@ int main(int argc, char *argv[])
 	 */
 	if (unlang_global_init() < 0) EXIT_WITH_FAILURE;
 
+	/*
+	 *	Profiling has to be enabled before any requests
+	 *	are processed.
+	 */
+	if (config->profile) {
+		unlang_profile_config_t profile = {
+			.slow_request = config->profile_slow_request,
+			.sample = config->profile_sample,
+			.max_traces = config->profile_traces
+		};
+
+		if (unlang_profile_enable(&profile) < 0) {
+			PERROR("Failed enabling interpreter profiling");
+			EXIT_WITH_FAILURE;
+		}
+	}
+
+	unlang_compile_flatten(config->unlang_flatten);
+
 	if (server_init(config->root_cs) < 0) EXIT_WITH_FAILURE;
 
 	/*
@@ -810,6 +829,13 @@ int main(int argc, char *argv[])
 		EXIT_WITH_FAILURE;
 	}
 
+#ifdef HAVE_REGEX
+	/*
+	 *	Must be done before the worker threads start.
+	 */
+	regex_cache_size_set(config->regex_cache_size);
+#endif
+
 	/*
 	 *  Initialize the global event loop which handles things like
 	 *  systemd.
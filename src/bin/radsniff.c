@@ -2285,6 +2285,8 @@ static NEVER_RETURNS void usage(int status)
 	fprintf(output, "  -h                    This help message.\n");
 	fprintf(output, "  -i <interface>        Capture packets from interface (defaults to all if supported).\n");
 	fprintf(output, "  -I <file>             Read packets from <file>\n");
+	fprintf(output, "  -j <threads>          Capture with multiple threads, only gathering statistics.\n");
+	fprintf(output, "                        Files are replayed as fast as possible.\n");
 	fprintf(output, "  -l <attr>[,<attr>]    Output packet sig and a list of attributes.\n");
 	fprintf(output, "  -L <attr>[,<attr>]    Detect retransmissions using these attributes to link requests.\n");
 	fprintf(output, "  -m                    Don't put interface(s) into promiscuous mode.\n");
@@ -2384,7 +2386,7 @@ int main(int argc, char *argv[])
 	/*
 	 *  Get options
 	 */
-	while ((c = getopt(argc, argv, "ab:c:C:d:D:e:Ef:hi:I:l:L:mp:P:qr:R:s:St:vw:xXW:T:P:N:O:Z:")) != -1) {
+	while ((c = getopt(argc, argv, "ab:c:C:d:D:e:Ef:hi:I:j:l:L:mp:P:qr:R:s:St:vw:xXW:T:P:N:O:Z:")) != -1) {
 		switch (c) {
 		case 'a':
 		{
@@ -2479,6 +2481,14 @@ int main(int argc, char *argv[])
 			conf->from_file = true;
 			break;
 
+		case 'j':
+			conf->threads = atoi(optarg);
+			if (conf->threads == 0) {
+				ERROR("Invalid number of threads \"%s\"", optarg);
+				usage(64);
+			}
+			break;
+
 		case 'l':
 			conf->list_attributes = optarg;
 			break;
@@ -2636,6 +2646,36 @@ int main(int argc, char *argv[])
 		usage(64);
 	}
 
+	/*
+	 *	The capture threads only look at the RADIUS header,
+	 *	they don't decode, filter, log, or write packets.
+	 */
+	if (conf->threads) {
+		if (conf->to_file || conf->to_stdout || conf->to_output_dir || conf->list_attributes ||
+		    conf->link_attributes || conf->filter_request || conf->filter_response ||
+		    conf->daemonize) {
+			ERROR("Multi-threaded capture (-j) can only be used with statistics options");
+			usage(64);
+		}
+
+#ifdef HAVE_COLLECTDC_H
+		if (conf->stats.out == RS_STATS_OUT_COLLECTD) {
+			ERROR("Multi-threaded capture (-j) can't write statistics to collectd");
+			usage(64);
+		}
+#endif
+
+		if (conf->from_dev && in->next) {
+			ERROR("Multi-threaded capture (-j) can only capture from one interface");
+			usage(64);
+		}
+
+		if (!conf->from_dev && !conf->from_file) {
+			ERROR("Multi-threaded capture (-j) requires an interface (-i) or pcap files");
+			usage(64);
+		}
+	}
+
 	/* Can't set stats export mode if we're not writing stats */
 	if ((conf->stats.out == RS_STATS_OUT_STDIO_CSV) && !conf->stats.interval) {
 		ERROR("CSV output requires a statistics interval (-W)");
@@ -2943,6 +2983,14 @@ int main(int argc, char *argv[])
 	}
 #endif
 
+	/*
+	 *	The capture threads open their own sockets.
+	 */
+	if (conf->threads && conf->from_dev) {
+		ret = (rs_fanout_live(conf, in->name, timeout) < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+		goto finish;
+	}
+
 	/*
 	 *	This actually opens the capture interfaces/files (we just allocated the memory earlier)
 	 */
@@ -2999,6 +3047,11 @@ int main(int argc, char *argv[])
 		fr_strerror_clear();
 	}
 
+	if (conf->threads) {
+		ret = (rs_fanout_replay(conf, in) < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+		goto finish;
+	}
+
 	/*
 	 *	Open our output interface (if we have one);
 	 */
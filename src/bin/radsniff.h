@@ -304,6 +304,7 @@ struct rs {
 
 	int			buffer_pkts;		//!< Size of the ring buffer to setup for live capture.
 	uint64_t		limit;			//!< Maximum number of packets to capture
+	uint32_t		threads;		//!< Number of capture threads, 0 for the normal event loop.
 
 	struct {
 		int			interval;		//!< Time between stats updates in seconds.
@@ -319,6 +320,12 @@ struct rs {
 	} stats;
 };
 
+/*
+ *	radsniff_fanout.c - Multi-threaded capture
+ */
+int rs_fanout_live(rs_t *conf, char const *interface, unsigned int timeout);
+int rs_fanout_replay(rs_t *conf, fr_pcap_t *in);
+
 #ifdef HAVE_COLLECTDC_H
 
 /** Callback for processing stats values.
@@ -4,7 +4,7 @@ else
 TARGET		:=
 endif
 
-SOURCES		:= radsniff.c collectd.c
+SOURCES		:= radsniff.c collectd.c radsniff_fanout.c
 
 TGT_PREREQS	:= libfreeradius-radius$(L)
 TGT_LDLIBS	:= $(LIBS) $(PCAP_LIBS) $(COLLECTDC_LIBS)
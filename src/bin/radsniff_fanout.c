@@ -0,0 +1,1153 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file src/bin/radsniff_fanout.c
+ * @brief Multi-threaded capture and correlation for radsniff.
+ *
+ * The normal radsniff event loop runs on one thread, and decodes every
+ * packet.  On a busy mirror port it can't keep up with libpcap, and
+ * packets are dropped.
+ *
+ * With -j, packets are spread over several threads, each of which
+ * correlates requests and responses for its share of the flows, and
+ * records latency statistics.  Only the RADIUS header is examined,
+ * attributes are never decoded.
+ *
+ * For live capture (Linux only) each thread has its own AF_PACKET
+ * socket with a TPACKET_V3 ring, and the sockets are joined into a
+ * PACKET_FANOUT_HASH group.  The kernel's flow hash is symmetric, so a
+ * request and its response are always delivered to the same thread.
+ *
+ * For pcap files, the packets are read into memory, split between the
+ * threads by the same kind of symmetric flow hash, and then processed
+ * as fast as possible.  This is intended for regression benchmarking.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/histogram.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <pthread.h>
+#include <signal.h>
+
+#ifdef __linux__
+#  include <linux/filter.h>
+#  include <linux/if_ether.h>
+#  include <linux/if_packet.h>
+#  include <net/if.h>
+#  include <net/if_arp.h>
+#  include <poll.h>
+#  include <sys/ioctl.h>
+#  include <sys/mman.h>
+#  include <sys/socket.h>
+#  if defined(PACKET_FANOUT) && defined(TP_STATUS_BLK_TMO)
+#    define HAVE_TPACKET_V3
+#  endif
+#endif
+
+#include "radsniff.h"
+
+#define RS_FANOUT_BLOCK_SIZE	(1 << 20)	//!< Size of each block in the capture ring.
+#define RS_FANOUT_BLOCK_NUM	(64)		//!< Number of blocks in each thread's ring.
+#define RS_FANOUT_FRAME_SIZE	(2048)		//!< Largest frame we expect.
+#define RS_FANOUT_BLOCK_TMO	(10)		//!< Milliseconds before a partial block is returned.
+
+#define TO_MSEC(_x) (((double) (_x)) / 1000000)
+
+/** The request types we track
+ *
+ * Responses are counted against the request they answer.
+ */
+static fr_radius_packet_code_t const rs_fanout_codes[] = {
+	FR_RADIUS_CODE_ACCESS_REQUEST,
+	FR_RADIUS_CODE_ACCOUNTING_REQUEST,
+	FR_RADIUS_CODE_COA_REQUEST,
+	FR_RADIUS_CODE_DISCONNECT_REQUEST,
+	FR_RADIUS_CODE_STATUS_SERVER
+};
+#define RS_FANOUT_NUM_CODES	NUM_ELEMENTS(rs_fanout_codes)
+
+/** Identifies an exchange, whichever direction the packet is going in
+ *
+ * The endpoints are sorted, so a request and its response have the
+ * same key.
+ */
+typedef struct {
+	uint8_t			addr[2][16];			//!< Lower, then higher endpoint address.
+	uint16_t		port[2];			//!< Lower, then higher endpoint port.
+	uint8_t			af;				//!< Of both addresses.
+	uint8_t			id;				//!< RADIUS ID.
+} rs_fanout_key_t;
+
+/** A request we've seen, and are waiting for a response to
+ *
+ */
+typedef struct rs_fanout_track_s rs_fanout_track_t;
+struct rs_fanout_track_s {
+	rs_fanout_key_t		key;
+	unsigned int		code_idx;			//!< Index into rs_fanout_codes.
+	uint8_t			vector[RADIUS_AUTH_VECTOR_LENGTH];	//!< To detect ID re-use.
+	int64_t			when;				//!< When the first copy of the request was seen.
+	unsigned int		rtx;				//!< Number of retransmissions seen.
+
+	fr_dlist_t		entry;				//!< In the list of pending requests, oldest first.
+	rs_fanout_track_t	*next_free;			//!< In the free list.
+};
+
+/** Statistics for one type of exchange
+ *
+ * Written by the owning thread, and read by the main thread.
+ */
+typedef struct {
+	atomic_uint_fast64_t	requests;			//!< Including retransmissions.
+	atomic_uint_fast64_t	linked;				//!< Responses matched to a request.
+	atomic_uint_fast64_t	rtx;				//!< Retransmitted requests.
+	atomic_uint_fast64_t	reused;				//!< IDs re-used before a response was seen.
+	atomic_uint_fast64_t	lost;				//!< Requests which never got a response.
+	fr_histogram_t		latency;			//!< Between the first request and the response.
+} rs_fanout_exchange_t;
+
+typedef struct {
+	atomic_uint_fast64_t	packets;			//!< All packets processed.
+	atomic_uint_fast64_t	malformed;			//!< Too short, or not RADIUS.
+	atomic_uint_fast64_t	unlinked;			//!< Responses with no request.
+	rs_fanout_exchange_t	exchange[RS_FANOUT_NUM_CODES];
+} rs_fanout_stats_t;
+
+/** A captured packet, when replaying a file
+ *
+ */
+typedef struct {
+	uint8_t const		*data;
+	size_t			len;
+	int64_t			when;				//!< Capture time, in nanoseconds.
+	int			link_layer;
+	uint32_t		thread;				//!< Which thread will process it.
+} rs_fanout_capture_t;
+
+typedef struct {
+	uint32_t		num;				//!< Of this thread.
+	pthread_t		pthread_id;
+	rs_t const		*conf;
+
+	TALLOC_CTX		*ctx;				//!< Everything the thread allocates.
+	fr_hash_table_t		*tracked;			//!< Outstanding requests.
+	fr_dlist_head_t		pending;			//!< Outstanding requests, oldest first.
+	rs_fanout_track_t	*free_list;			//!< Entries to re-use.
+	int64_t			timeout;			//!< Nanoseconds before a request is lost.
+
+	rs_fanout_capture_t const **captures;			//!< To replay.
+	size_t			num_captures;
+
+#ifdef HAVE_TPACKET_V3
+	int			fd;				//!< AF_PACKET socket.
+	int			link_layer;			//!< DLT_* of the interface.
+	bool			loopback;			//!< Ignore the outgoing copy of each frame.
+	uint8_t			*ring;				//!< Mapped ring of blocks.
+	size_t			ring_len;
+	uint64_t		drops;				//!< Read by the main thread only.
+#endif
+
+	rs_fanout_stats_t	stats;
+} rs_fanout_thread_t;
+
+/** A plain copy of the statistics for all threads
+ *
+ */
+typedef struct {
+	uint64_t		packets;
+	uint64_t		malformed;
+	uint64_t		unlinked;
+	uint64_t		drops;
+	struct {
+		uint64_t		requests;
+		uint64_t		linked;
+		uint64_t		rtx;
+		uint64_t		reused;
+		uint64_t		lost;
+		fr_histogram_t		latency;
+	} exchange[RS_FANOUT_NUM_CODES];
+} rs_fanout_totals_t;
+
+static volatile sig_atomic_t rs_fanout_stop = 0;
+
+static void rs_fanout_signal(UNUSED int sig)
+{
+	rs_fanout_stop = 1;
+}
+
+static inline CC_HINT(always_inline) int rs_fanout_code_idx(uint8_t code)
+{
+	switch (code) {
+	case FR_RADIUS_CODE_ACCESS_REQUEST:
+		return 0;
+
+	case FR_RADIUS_CODE_ACCOUNTING_REQUEST:
+		return 1;
+
+	case FR_RADIUS_CODE_COA_REQUEST:
+		return 2;
+
+	case FR_RADIUS_CODE_DISCONNECT_REQUEST:
+		return 3;
+
+	case FR_RADIUS_CODE_STATUS_SERVER:
+		return 4;
+
+	default:
+		return -1;
+	}
+}
+
+static uint32_t rs_fanout_track_hash(void const *data)
+{
+	rs_fanout_track_t const *track = data;
+
+	return fr_hash_fast(&track->key, sizeof(track->key));
+}
+
+static int8_t rs_fanout_track_cmp(void const *one, void const *two)
+{
+	rs_fanout_track_t const *a = one, *b = two;
+	int ret;
+
+	ret = memcmp(&a->key, &b->key, sizeof(a->key));
+	return CMP(ret, 0);
+}
+
+/** Find the RADIUS header of a captured packet, and the key for its exchange
+ *
+ * @param[out] key		for the exchange.
+ * @param[out] packet		RADIUS header.
+ * @param[in] data		captured frame.
+ * @param[in] len		of the captured frame.
+ * @param[in] link_layer	of the frame.
+ * @return
+ *	- 0 on success.
+ *	- -1 if the packet isn't a UDP packet containing a RADIUS header.
+ */
+static int rs_fanout_parse(rs_fanout_key_t *key, radius_packet_t const **packet,
+			   uint8_t const *data, size_t len, int link_layer)
+{
+	uint8_t const		*p = data, *end = data + len;
+	uint8_t const		*src, *dst;
+	udp_header_t const	*udp;
+	ssize_t			slen;
+	size_t			addr_len;
+	uint16_t		sport, dport;
+
+	slen = fr_pcap_link_layer_offset(data, len, link_layer);
+	if (slen < 0) return -1;
+	p += slen;
+
+	if (p >= end) return -1;
+
+	switch ((p[0] & 0xf0) >> 4) {
+	case 4:
+	{
+		ip_header_t const *ip = (ip_header_t const *) p;
+
+		if ((size_t) (end - p) < sizeof(*ip)) return -1;
+		if (ip->ip_p != IPPROTO_UDP) return -1;
+
+		key->af = AF_INET;
+		src = (uint8_t const *) &ip->ip_src;
+		dst = (uint8_t const *) &ip->ip_dst;
+		addr_len = sizeof(ip->ip_src);
+		p += (ip->ip_vhl & 0x0f) * 4;
+	}
+		break;
+
+	case 6:
+	{
+		ip_header6_t const *ip6 = (ip_header6_t const *) p;
+
+		if ((size_t) (end - p) < sizeof(*ip6)) return -1;
+		if (ip6->ip_next != IPPROTO_UDP) return -1;
+
+		key->af = AF_INET6;
+		src = (uint8_t const *) &ip6->ip_src;
+		dst = (uint8_t const *) &ip6->ip_dst;
+		addr_len = sizeof(ip6->ip_src);
+		p += sizeof(*ip6);
+	}
+		break;
+
+	default:
+		return -1;
+	}
+
+	if ((p + sizeof(udp_header_t) + RADIUS_HEADER_LENGTH) > end) return -1;
+
+	udp = (udp_header_t const *) p;
+	sport = ntohs(udp->src);
+	dport = ntohs(udp->dst);
+
+	*packet = (radius_packet_t const *) (p + sizeof(udp_header_t));
+
+	/*
+	 *	Sort the endpoints, so both directions of the
+	 *	exchange produce the same key.
+	 */
+	memset(key->addr, 0, sizeof(key->addr));
+	if ((memcmp(src, dst, addr_len) < 0) || ((memcmp(src, dst, addr_len) == 0) && (sport < dport))) {
+		memcpy(key->addr[0], src, addr_len);
+		memcpy(key->addr[1], dst, addr_len);
+		key->port[0] = sport;
+		key->port[1] = dport;
+	} else {
+		memcpy(key->addr[0], dst, addr_len);
+		memcpy(key->addr[1], src, addr_len);
+		key->port[0] = dport;
+		key->port[1] = sport;
+	}
+	key->id = (*packet)->id;
+
+	return 0;
+}
+
+static void rs_fanout_track_release(rs_fanout_thread_t *t, rs_fanout_track_t *track)
+{
+	fr_hash_table_remove(t->tracked, track);
+	fr_dlist_remove(&t->pending, track);
+	track->next_free = t->free_list;
+	t->free_list = track;
+}
+
+/** Count requests which have been waiting for longer than the timeout as lost
+ *
+ * @param[in] t		thread.
+ * @param[in] now	capture time of the latest packet.
+ */
+static void rs_fanout_expire(rs_fanout_thread_t *t, int64_t now)
+{
+	rs_fanout_track_t *track;
+
+	while ((track = fr_dlist_head(&t->pending)) && ((now - track->when) > t->timeout)) {
+		fr_histogram_counter_inc(&t->stats.exchange[track->code_idx].lost);
+		rs_fanout_track_release(t, track);
+	}
+}
+
+/** Correlate one captured packet
+ *
+ */
+static void rs_fanout_process(rs_fanout_thread_t *t, uint8_t const *data, size_t len, int link_layer, int64_t when)
+{
+	rs_fanout_track_t	find, *track;
+	radius_packet_t const	*packet;
+	int			idx;
+
+	fr_histogram_counter_inc(&t->stats.packets);
+
+	if (rs_fanout_parse(&find.key, &packet, data, len, link_layer) < 0) {
+		fr_histogram_counter_inc(&t->stats.malformed);
+		return;
+	}
+
+	rs_fanout_expire(t, when);
+
+	track = fr_hash_table_find(t->tracked, &find);
+
+	idx = rs_fanout_code_idx(packet->code);
+	if (idx >= 0) {
+		rs_fanout_exchange_t *exchange = &t->stats.exchange[idx];
+
+		fr_histogram_counter_inc(&exchange->requests);
+
+		if (track) {
+			if ((track->code_idx == (unsigned int) idx) &&
+			    (memcmp(track->vector, packet->vector, sizeof(track->vector)) == 0)) {
+				track->rtx++;
+				fr_histogram_counter_inc(&exchange->rtx);
+				return;
+			}
+
+			/*
+			 *	A different request with the same ID,
+			 *	so we'll never see the response to the
+			 *	previous one.
+			 */
+			fr_histogram_counter_inc(&exchange->reused);
+			fr_dlist_remove(&t->pending, track);
+		} else {
+			track = t->free_list;
+			if (track) {
+				t->free_list = track->next_free;
+			} else {
+				track = talloc_zero(t->ctx, rs_fanout_track_t);
+				if (!track) return;
+			}
+
+			track->key = find.key;
+			if (!fr_hash_table_insert(t->tracked, track)) {
+				track->next_free = t->free_list;
+				t->free_list = track;
+				return;
+			}
+		}
+
+		track->code_idx = idx;
+		memcpy(track->vector, packet->vector, sizeof(track->vector));
+		track->when = when;
+		track->rtx = 0;
+		fr_dlist_insert_tail(&t->pending, track);
+		return;
+	}
+
+	/*
+	 *	Must be a response, or something we don't track.
+	 */
+	if (!track) {
+		fr_histogram_counter_inc(&t->stats.unlinked);
+		return;
+	}
+
+	fr_histogram_counter_inc(&t->stats.exchange[track->code_idx].linked);
+	fr_histogram_record(&t->stats.exchange[track->code_idx].latency, when - track->when);
+
+	rs_fanout_track_release(t, track);
+}
+
+static int rs_fanout_thread_init(rs_fanout_thread_t *t, rs_t const *conf, uint32_t num)
+{
+	size_t i;
+
+	t->num = num;
+	t->conf = conf;
+	t->timeout = (int64_t) conf->stats.timeout * 1000000;
+
+	/*
+	 *	Not parented, so the thread never allocates from a
+	 *	talloc tree the main thread is using.
+	 */
+	t->ctx = talloc_init_const("rs_fanout_thread");
+	if (!t->ctx) return -1;
+
+	t->tracked = fr_hash_table_open_alloc(t->ctx, rs_fanout_track_hash, rs_fanout_track_cmp, NULL);
+	if (!t->tracked) return -1;
+
+	fr_dlist_init(&t->pending, rs_fanout_track_t, entry);
+
+	for (i = 0; i < RS_FANOUT_NUM_CODES; i++) fr_histogram_init(&t->stats.exchange[i].latency);
+
+	return 0;
+}
+
+static void rs_fanout_totals(rs_fanout_totals_t *totals, rs_fanout_thread_t *threads, uint32_t num_threads)
+{
+	uint32_t	i;
+	size_t		j;
+
+	memset(totals, 0, sizeof(*totals));
+	for (j = 0; j < RS_FANOUT_NUM_CODES; j++) fr_histogram_init(&totals->exchange[j].latency);
+
+	for (i = 0; i < num_threads; i++) {
+		rs_fanout_stats_t const *stats = &threads[i].stats;
+
+		totals->packets += atomic_load_explicit(&stats->packets, memory_order_relaxed);
+		totals->malformed += atomic_load_explicit(&stats->malformed, memory_order_relaxed);
+		totals->unlinked += atomic_load_explicit(&stats->unlinked, memory_order_relaxed);
+#ifdef HAVE_TPACKET_V3
+		totals->drops += threads[i].drops;
+#endif
+
+		for (j = 0; j < RS_FANOUT_NUM_CODES; j++) {
+			rs_fanout_exchange_t const *exchange = &stats->exchange[j];
+
+			totals->exchange[j].requests += atomic_load_explicit(&exchange->requests, memory_order_relaxed);
+			totals->exchange[j].linked += atomic_load_explicit(&exchange->linked, memory_order_relaxed);
+			totals->exchange[j].rtx += atomic_load_explicit(&exchange->rtx, memory_order_relaxed);
+			totals->exchange[j].reused += atomic_load_explicit(&exchange->reused, memory_order_relaxed);
+			totals->exchange[j].lost += atomic_load_explicit(&exchange->lost, memory_order_relaxed);
+			fr_histogram_merge(&totals->exchange[j].latency, &exchange->latency);
+		}
+	}
+}
+
+static void rs_fanout_print_csv_header(void)
+{
+	size_t i;
+
+	fprintf(stdout, "\"Iteration\",\"Packets/s\",\"Dropped/s\",\"Malformed/s\",\"Unlinked/s\"");
+
+	for (i = 0; i < RS_FANOUT_NUM_CODES; i++) {
+		char const *name = fr_radius_packet_names[rs_fanout_codes[i]];
+
+		fprintf(stdout,
+			",\"%s received/s\""
+			",\"%s linked/s\""
+			",\"%s lost/s\""
+			",\"%s rtx/s\""
+			",\"%s reused/s\""
+			",\"%s lat p50 (ms)\""
+			",\"%s lat p99 (ms)\""
+			",\"%s lat max (ms)\"",
+			name, name, name, name, name, name, name, name);
+	}
+
+	fprintf(stdout, "\n");
+}
+
+/** Print the statistics for one interval, or for the whole run
+ *
+ * @param[in] conf	radsniff configuration.
+ * @param[in] iteration	number of the interval.
+ * @param[in] period	length of the interval in seconds.
+ * @param[in] now	current totals.
+ * @param[in] prev	totals at the start of the interval.
+ */
+static void rs_fanout_print(rs_t const *conf, int iteration, double period,
+			    rs_fanout_totals_t const *now, rs_fanout_totals_t const *prev)
+{
+	fr_histogram_t	latency;
+	size_t		i;
+
+	if (period <= 0) period = 1;
+
+#define RATE(_field) (((double) (now->_field - prev->_field)) / period)
+
+	if (conf->stats.out == RS_STATS_OUT_STDIO_CSV) {
+		fprintf(stdout, "%i,%.3lf,%.3lf,%.3lf,%.3lf", iteration,
+			RATE(packets), RATE(drops), RATE(malformed), RATE(unlinked));
+
+		for (i = 0; i < RS_FANOUT_NUM_CODES; i++) {
+			fr_histogram_sub(&latency, &now->exchange[i].latency, &prev->exchange[i].latency);
+
+			fprintf(stdout, ",%.3lf,%.3lf,%.3lf,%.3lf,%.3lf,%.3lf,%.3lf,%.3lf",
+				RATE(exchange[i].requests), RATE(exchange[i].linked), RATE(exchange[i].lost),
+				RATE(exchange[i].rtx), RATE(exchange[i].reused),
+				TO_MSEC(fr_histogram_percentile(&latency, 50)),
+				TO_MSEC(fr_histogram_percentile(&latency, 99)),
+				TO_MSEC(fr_histogram_max(&latency)));
+		}
+		fprintf(stdout, "\n");
+		fflush(stdout);
+		return;
+	}
+
+	INFO("######### Stats Iteration %i #########", iteration);
+	INFO("Capture rate:");
+	INFO("\tPackets   : %.3lf/s", RATE(packets));
+	if (now->drops != prev->drops) INFO("\tDropped   : %.3lf/s", RATE(drops));
+	if (now->malformed != prev->malformed) INFO("\tMalformed : %.3lf/s", RATE(malformed));
+	if (now->unlinked != prev->unlinked) INFO("\tUnlinked  : %.3lf/s", RATE(unlinked));
+
+	for (i = 0; i < RS_FANOUT_NUM_CODES; i++) {
+		char const *name = fr_radius_packet_names[rs_fanout_codes[i]];
+
+		if (now->exchange[i].requests == prev->exchange[i].requests) continue;
+
+		INFO("%s counters:", name);
+		INFO("\tTotal     : %.3lf/s", RATE(exchange[i].requests));
+		INFO("\tLinked    : %.3lf/s", RATE(exchange[i].linked));
+		if (now->exchange[i].lost != prev->exchange[i].lost) {
+			INFO("\tLost      : %.3lf/s", RATE(exchange[i].lost));
+		}
+		if (now->exchange[i].rtx != prev->exchange[i].rtx) {
+			INFO("\tRTX       : %.3lf/s", RATE(exchange[i].rtx));
+		}
+		if (now->exchange[i].reused != prev->exchange[i].reused) {
+			INFO("\tID Reused : %.3lf/s", RATE(exchange[i].reused));
+		}
+
+		fr_histogram_sub(&latency, &now->exchange[i].latency, &prev->exchange[i].latency);
+		if (!fr_histogram_count(&latency)) continue;
+
+		INFO("%s latency:", name);
+		INFO("\tLow       : %.3lfms", TO_MSEC(fr_histogram_min(&latency)));
+		INFO("\tp50       : %.3lfms", TO_MSEC(fr_histogram_percentile(&latency, 50)));
+		INFO("\tp90       : %.3lfms", TO_MSEC(fr_histogram_percentile(&latency, 90)));
+		INFO("\tp99       : %.3lfms", TO_MSEC(fr_histogram_percentile(&latency, 99)));
+		INFO("\tp99.9     : %.3lfms", TO_MSEC(fr_histogram_percentile(&latency, 99.9)));
+		INFO("\tHigh      : %.3lfms", TO_MSEC(fr_histogram_max(&latency)));
+	}
+
+#undef RATE
+}
+
+/** Print the number of packets seen, for comparison with a single threaded run
+ *
+ */
+static void rs_fanout_print_counts(rs_fanout_totals_t const *totals)
+{
+	size_t i;
+
+	INFO("Packet counts:");
+	INFO("\tPackets   : %" PRIu64, totals->packets);
+	INFO("\tMalformed : %" PRIu64, totals->malformed);
+	INFO("\tUnlinked  : %" PRIu64, totals->unlinked);
+
+	for (i = 0; i < RS_FANOUT_NUM_CODES; i++) {
+		if (!totals->exchange[i].requests) continue;
+
+		INFO("\t%s : requests %" PRIu64 ", linked %" PRIu64 ", rtx %" PRIu64 ", reused %" PRIu64
+		     ", lost %" PRIu64, fr_radius_packet_names[rs_fanout_codes[i]],
+		     totals->exchange[i].requests, totals->exchange[i].linked, totals->exchange[i].rtx,
+		     totals->exchange[i].reused, totals->exchange[i].lost);
+	}
+}
+
+static void rs_fanout_free(rs_fanout_thread_t *threads, uint32_t num_threads)
+{
+	uint32_t i;
+
+	for (i = 0; i < num_threads; i++) {
+#ifdef HAVE_TPACKET_V3
+		if (threads[i].ring) munmap(threads[i].ring, threads[i].ring_len);
+		if (threads[i].fd > 0) close(threads[i].fd);
+#endif
+		talloc_free(threads[i].ctx);
+	}
+}
+
+static void *rs_fanout_replay_thread(void *arg)
+{
+	rs_fanout_thread_t	*t = arg;
+	size_t			i;
+
+	for (i = 0; i < t->num_captures; i++) {
+		rs_fanout_capture_t const *cap = t->captures[i];
+
+		rs_fanout_process(t, cap->data, cap->len, cap->link_layer, cap->when);
+	}
+
+	/*
+	 *	Anything still outstanding at the end of the capture
+	 *	is only lost if it had already timed out.
+	 */
+	if (t->num_captures) rs_fanout_expire(t, t->captures[t->num_captures - 1]->when);
+
+	return NULL;
+}
+
+/** Replay pcap files across several threads, as fast as possible
+ *
+ * @param[in] conf	radsniff configuration.
+ * @param[in] in	list of opened pcap files.
+ * @return
+ *	- 0 on success.
+ *	- -1 on error.
+ */
+int rs_fanout_replay(rs_t *conf, fr_pcap_t *in)
+{
+	TALLOC_CTX		*ctx;
+	rs_fanout_thread_t	*threads;
+	rs_fanout_capture_t	*captures = NULL;
+	rs_fanout_totals_t	*totals, *zero;
+	size_t			num_captures = 0, i, *counts;
+	fr_pcap_t		*in_p;
+	pthread_attr_t		attr;
+	fr_time_t		start;
+	double			elapsed;
+	uint32_t		num_started = 0, j;
+	int			ret = -1;
+
+	ctx = talloc_init_const("rs_fanout_replay");
+	threads = talloc_zero_array(ctx, rs_fanout_thread_t, conf->threads);
+	counts = talloc_zero_array(ctx, size_t, conf->threads);
+	totals = talloc_zero(ctx, rs_fanout_totals_t);
+	zero = talloc_zero(ctx, rs_fanout_totals_t);
+	if (!threads || !counts || !totals || !zero) {
+	oom:
+		ERROR("Out of memory");
+		goto finish;
+	}
+
+	/*
+	 *	Read everything first, so the run measures packet
+	 *	processing, and not file I/O.
+	 */
+	for (in_p = in; in_p; in_p = in_p->next) {
+		struct pcap_pkthdr	*header;
+		uint8_t const		*data;
+		int			rcode;
+
+		while ((rcode = pcap_next_ex(in_p->handle, &header, &data)) == 1) {
+			rs_fanout_capture_t	*cap;
+			rs_fanout_key_t		key;
+			radius_packet_t const	*packet;
+
+			if ((num_captures % 4096) == 0) {
+				captures = talloc_realloc(ctx, captures, rs_fanout_capture_t, num_captures + 4096);
+				if (!captures) goto oom;
+			}
+
+			cap = &captures[num_captures++];
+			cap->data = talloc_memdup(ctx, data, header->caplen);
+			if (!cap->data) goto oom;
+			cap->len = header->caplen;
+			cap->when = ((int64_t) header->ts.tv_sec * NSEC) + ((int64_t) header->ts.tv_usec * 1000);
+			cap->link_layer = in_p->link_layer;
+
+			/*
+			 *	Packets we can't parse go to the first
+			 *	thread, which will count them as malformed.
+			 */
+			if (rs_fanout_parse(&key, &packet, cap->data, cap->len, cap->link_layer) < 0) {
+				cap->thread = 0;
+			} else {
+				key.id = 0;	/* All IDs for a flow go to the same thread */
+				cap->thread = fr_hash_fast(&key, sizeof(key)) % conf->threads;
+			}
+			counts[cap->thread]++;
+
+			if (conf->limit && (num_captures >= conf->limit)) break;
+		}
+
+		if (rcode == -1) {
+			ERROR("Failed reading %s: %s", in_p->name, pcap_geterr(in_p->handle));
+			goto finish;
+		}
+
+		if (conf->limit && (num_captures >= conf->limit)) break;
+	}
+
+	for (j = 0; j < conf->threads; j++) {
+		if (rs_fanout_thread_init(&threads[j], conf, j) < 0) goto oom;
+
+		threads[j].captures = talloc_array(ctx, rs_fanout_capture_t const *, counts[j]);
+		if (!threads[j].captures) goto oom;
+	}
+
+	for (i = 0; i < num_captures; i++) {
+		rs_fanout_thread_t *t = &threads[captures[i].thread];
+
+		t->captures[t->num_captures++] = &captures[i];
+	}
+
+	INFO("Replaying %zu packets across %u threads", num_captures, conf->threads);
+
+	(void) pthread_attr_init(&attr);
+	(void) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+	start = fr_time();
+	for (j = 0; j < conf->threads; j++) {
+		if (pthread_create(&threads[j].pthread_id, &attr, rs_fanout_replay_thread, &threads[j]) != 0) {
+			ERROR("Failed creating thread: %s", fr_syserror(errno));
+			break;
+		}
+		num_started++;
+	}
+	(void) pthread_attr_destroy(&attr);
+
+	for (j = 0; j < num_started; j++) (void) pthread_join(threads[j].pthread_id, NULL);
+	if (num_started < conf->threads) goto finish;
+
+	elapsed = fr_time_delta_unwrap(fr_time_sub(fr_time(), start)) / (double) NSEC;
+
+	INFO("Replayed %zu packets in %.6fs (%.1f packets/s)", num_captures, elapsed,
+	     elapsed > 0 ? num_captures / elapsed : 0);
+
+	/*
+	 *	The rates are per second of capture time, not of
+	 *	replay time.
+	 */
+	rs_fanout_totals(totals, threads, conf->threads);
+	if (conf->stats.out == RS_STATS_OUT_STDIO_CSV) rs_fanout_print_csv_header();
+	rs_fanout_print(conf, 1, num_captures ?
+			(captures[num_captures - 1].when - captures[0].when) / (double) NSEC : 0,
+			totals, zero);
+	if (conf->stats.out != RS_STATS_OUT_STDIO_CSV) rs_fanout_print_counts(totals);
+
+	ret = 0;
+
+finish:
+	rs_fanout_free(threads, num_started ? conf->threads : 0);
+	talloc_free(ctx);
+
+	return ret;
+}
+
+#ifdef HAVE_TPACKET_V3
+/** Attach the radsniff capture filter to a packet socket
+ *
+ */
+static int rs_fanout_filter(int fd, int link_layer, char const *filter)
+{
+	pcap_t			*dead;
+	struct bpf_program	prog;
+	struct sock_fprog	fprog;
+	int			ret;
+
+	dead = pcap_open_dead(link_layer, RS_FANOUT_FRAME_SIZE);
+	if (!dead) {
+		fr_strerror_const("Failed allocating pcap handle");
+		return -1;
+	}
+
+	if (pcap_compile(dead, &prog, filter, 1, PCAP_NETMASK_UNKNOWN) < 0) {
+		fr_strerror_printf("Failed compiling filter \"%s\": %s", filter, pcap_geterr(dead));
+		pcap_close(dead);
+		return -1;
+	}
+
+	/*
+	 *	struct bpf_insn and struct sock_filter have the
+	 *	same layout.
+	 */
+	fprog.len = prog.bf_len;
+	fprog.filter = (struct sock_filter *) prog.bf_insns;
+
+	ret = setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog));
+	if (ret < 0) fr_strerror_printf("Failed attaching filter: %s", fr_syserror(errno));
+
+	pcap_freecode(&prog);
+	pcap_close(dead);
+
+	return ret;
+}
+
+/** Open a packet socket with a TPACKET_V3 ring, and add it to the fanout group
+ *
+ */
+static int rs_fanout_socket(rs_fanout_thread_t *t, char const *interface, int ifindex, int group)
+{
+	rs_t const		*conf = t->conf;
+	struct tpacket_req3	req;
+	struct sockaddr_ll	ll;
+	int			version = TPACKET_V3;
+	int			fanout = group | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+
+	t->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+	if (t->fd < 0) {
+		fr_strerror_printf("Failed opening packet socket: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	if (setsockopt(t->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+		fr_strerror_printf("Failed selecting TPACKET_V3: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	/*
+	 *	Filter before binding, so we never see packets we
+	 *	don't want.
+	 */
+	if (conf->pcap_filter &&
+	    (!conf->pcap_filter_vlan || (rs_fanout_filter(t->fd, t->link_layer, conf->pcap_filter_vlan) < 0)) &&
+	    (rs_fanout_filter(t->fd, t->link_layer, conf->pcap_filter) < 0)) return -1;
+
+	req = (struct tpacket_req3) {
+		.tp_block_size = RS_FANOUT_BLOCK_SIZE,
+		.tp_block_nr = RS_FANOUT_BLOCK_NUM,
+		.tp_frame_size = RS_FANOUT_FRAME_SIZE,
+		.tp_frame_nr = (RS_FANOUT_BLOCK_SIZE / RS_FANOUT_FRAME_SIZE) * RS_FANOUT_BLOCK_NUM,
+		.tp_retire_blk_tov = RS_FANOUT_BLOCK_TMO,
+	};
+
+	if (setsockopt(t->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+		fr_strerror_printf("Failed creating capture ring: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	t->ring_len = (size_t) req.tp_block_size * req.tp_block_nr;
+	t->ring = mmap(NULL, t->ring_len, PROT_READ | PROT_WRITE, MAP_SHARED, t->fd, 0);
+	if (t->ring == MAP_FAILED) {
+		t->ring = NULL;
+		fr_strerror_printf("Failed mapping capture ring: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	if (conf->promiscuous) {
+		struct packet_mreq mreq = {
+			.mr_ifindex = ifindex,
+			.mr_type = PACKET_MR_PROMISC
+		};
+
+		if (setsockopt(t->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+			fr_strerror_printf("Failed putting %s into promiscuous mode: %s",
+					   interface, fr_syserror(errno));
+			return -1;
+		}
+	}
+
+	ll = (struct sockaddr_ll) {
+		.sll_family = AF_PACKET,
+		.sll_protocol = htons(ETH_P_ALL),
+		.sll_ifindex = ifindex
+	};
+
+	if (bind(t->fd, (struct sockaddr *) &ll, sizeof(ll)) < 0) {
+		fr_strerror_printf("Failed binding to %s: %s", interface, fr_syserror(errno));
+		return -1;
+	}
+
+	if (setsockopt(t->fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0) {
+		fr_strerror_printf("Failed joining fanout group: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+static void *rs_fanout_live_thread(void *arg)
+{
+	rs_fanout_thread_t	*t = arg;
+	unsigned int		block = 0;
+
+	while (!rs_fanout_stop) {
+		struct tpacket_block_desc	*bd;
+		struct tpacket3_hdr		*hdr;
+		uint32_t			i;
+
+		bd = (struct tpacket_block_desc *) (t->ring + ((size_t) block * RS_FANOUT_BLOCK_SIZE));
+
+		if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+			struct pollfd	pfd = { .fd = t->fd, .events = POLLIN | POLLERR };
+			struct timespec	ts;
+
+			(void) poll(&pfd, 1, 100);
+
+			/*
+			 *	Requests can still time out when there's
+			 *	no traffic.
+			 */
+			(void) clock_gettime(CLOCK_REALTIME, &ts);
+			rs_fanout_expire(t, ((int64_t) ts.tv_sec * NSEC) + ts.tv_nsec);
+			continue;
+		}
+
+		hdr = (struct tpacket3_hdr *) ((uint8_t *) bd + bd->hdr.bh1.offset_to_first_pkt);
+		for (i = 0; i < bd->hdr.bh1.num_pkts; i++) {
+			struct sockaddr_ll const *ll = (struct sockaddr_ll const *)
+				((uint8_t const *) hdr + TPACKET_ALIGN(sizeof(*hdr)));
+
+			/*
+			 *	On loopback we see every frame twice, once
+			 *	going out, and once coming back in.  libpcap
+			 *	ignores the first copy, and so do we.
+			 */
+			if (!t->loopback || (ll->sll_pkttype != PACKET_OUTGOING)) {
+				rs_fanout_process(t, (uint8_t const *) hdr + hdr->tp_mac, hdr->tp_snaplen, t->link_layer,
+						  ((int64_t) hdr->tp_sec * NSEC) + hdr->tp_nsec);
+			}
+			hdr = (struct tpacket3_hdr *) ((uint8_t *) hdr + hdr->tp_next_offset);
+		}
+
+		/*
+		 *	Give the block back to the kernel.
+		 */
+		__atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+		block = (block + 1) % RS_FANOUT_BLOCK_NUM;
+	}
+
+	return NULL;
+}
+
+/** Read the number of packets the kernel dropped since the last call
+ *
+ */
+static void rs_fanout_drops(rs_fanout_thread_t *threads, uint32_t num_threads)
+{
+	uint32_t i;
+
+	for (i = 0; i < num_threads; i++) {
+		struct tpacket_stats_v3	tp_stats;
+		socklen_t		len = sizeof(tp_stats);
+
+		/*
+		 *	The kernel resets the counters each time
+		 *	they're read.
+		 */
+		if (getsockopt(threads[i].fd, SOL_PACKET, PACKET_STATISTICS, &tp_stats, &len) < 0) continue;
+		threads[i].drops += tp_stats.tp_drops;
+	}
+}
+
+/** Capture from an interface using several threads
+ *
+ * @param[in] conf	radsniff configuration.
+ * @param[in] interface	to capture from.
+ * @param[in] timeout	stop after this many seconds, or 0 to run until signalled.
+ * @return
+ *	- 0 on success.
+ *	- -1 on error.
+ */
+int rs_fanout_live(rs_t *conf, char const *interface, unsigned int timeout)
+{
+	TALLOC_CTX		*ctx;
+	rs_fanout_thread_t	*threads;
+	rs_fanout_totals_t	*totals, *prev;
+	pthread_attr_t		attr;
+	struct ifreq		ifr;
+	fr_time_t		start, last, next;
+	uint32_t		num_started = 0, j;
+	int			ifindex, link_layer, group, ret = -1, iteration = 0;
+	bool			loopback = false;
+
+	ctx = talloc_init_const("rs_fanout_live");
+	threads = talloc_zero_array(ctx, rs_fanout_thread_t, conf->threads);
+	totals = talloc_zero(ctx, rs_fanout_totals_t);
+	prev = talloc_zero(ctx, rs_fanout_totals_t);
+	if (!threads || !totals || !prev) {
+		ERROR("Out of memory");
+		goto finish;
+	}
+
+	ifindex = if_nametoindex(interface);
+	if (!ifindex) {
+		ERROR("Unknown interface %s", interface);
+		goto finish;
+	}
+
+	/*
+	 *	Packet sockets return frames with the link layer
+	 *	header of the interface, so that decides how they're
+	 *	parsed and how the filter is compiled.  Loopback
+	 *	interfaces have Ethernet headers.  Interfaces with
+	 *	no link layer header (e.g. tun) have raw IP.
+	 */
+	{
+		int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+		memset(&ifr, 0, sizeof(ifr));
+		strlcpy(ifr.ifr_name, interface, sizeof(ifr.ifr_name));
+		if ((fd < 0) || (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0)) {
+			ERROR("Failed getting link type of %s: %s", interface, fr_syserror(errno));
+			if (fd >= 0) close(fd);
+			goto finish;
+		}
+		close(fd);
+
+		switch (ifr.ifr_hwaddr.sa_family) {
+		case ARPHRD_LOOPBACK:
+			loopback = true;
+			FALL_THROUGH;
+
+		case ARPHRD_ETHER:
+			link_layer = DLT_EN10MB;
+			break;
+
+		case ARPHRD_NONE:
+			link_layer = DLT_RAW;
+			break;
+
+		default:
+			ERROR("Interface %s has unsupported link type %u, -j needs Ethernet or raw IP",
+			      interface, ifr.ifr_hwaddr.sa_family);
+			goto finish;
+		}
+	}
+
+	group = getpid() & 0xffff;
+
+	for (j = 0; j < conf->threads; j++) {
+		threads[j].fd = -1;
+		threads[j].link_layer = link_layer;
+		threads[j].loopback = loopback;
+		if ((rs_fanout_thread_init(&threads[j], conf, j) < 0) ||
+		    (rs_fanout_socket(&threads[j], interface, ifindex, group) < 0)) {
+			fr_perror("radsniff: Failed setting up capture thread %u on %s", j, interface);
+			goto finish;
+		}
+	}
+
+	rs_fanout_stop = 0;
+	fr_set_signal(SIGINT, rs_fanout_signal);
+	fr_set_signal(SIGTERM, rs_fanout_signal);
+#ifdef SIGQUIT
+	fr_set_signal(SIGQUIT, rs_fanout_signal);
+#endif
+
+	(void) pthread_attr_init(&attr);
+	(void) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+	for (j = 0; j < conf->threads; j++) {
+		if (pthread_create(&threads[j].pthread_id, &attr, rs_fanout_live_thread, &threads[j]) != 0) {
+			ERROR("Failed creating thread: %s", fr_syserror(errno));
+			rs_fanout_stop = 1;
+			break;
+		}
+		num_started++;
+	}
+	(void) pthread_attr_destroy(&attr);
+
+	INFO("Capturing on %s with %u threads", interface, num_started);
+
+	if (conf->stats.interval && (conf->stats.out == RS_STATS_OUT_STDIO_CSV)) rs_fanout_print_csv_header();
+
+	start = last = fr_time();
+	next = fr_time_add(start, fr_time_delta_from_sec(conf->stats.interval ? conf->stats.interval : 1));
+
+	/*
+	 *	The main thread just collects statistics.
+	 */
+	while (!rs_fanout_stop) {
+		fr_time_t		now = fr_time();
+		struct timespec		ts;
+
+		if (fr_time_lt(now, next)) {
+			ts = fr_time_delta_to_timespec(fr_time_sub(next, now));
+			(void) nanosleep(&ts, NULL);
+			continue;
+		}
+
+		rs_fanout_drops(threads, num_started);
+		rs_fanout_totals(totals, threads, num_started);
+
+		if (conf->stats.interval) {
+			rs_fanout_print(conf, ++iteration, fr_time_delta_unwrap(fr_time_sub(now, last)) / (double) NSEC,
+					totals, prev);
+		}
+		memcpy(prev, totals, sizeof(*prev));
+		last = now;
+
+		if (timeout && fr_time_delta_gteq(fr_time_sub(now, start), fr_time_delta_from_sec(timeout))) break;
+		if (conf->limit && (totals->packets >= conf->limit)) break;
+
+		next = fr_time_add(next, fr_time_delta_from_sec(conf->stats.interval ? conf->stats.interval : 1));
+	}
+
+	rs_fanout_stop = 1;
+	for (j = 0; j < num_started; j++) (void) pthread_join(threads[j].pthread_id, NULL);
+	if (num_started < conf->threads) goto finish;
+
+	/*
+	 *	Print totals for the whole run.
+	 */
+	rs_fanout_drops(threads, num_started);
+	rs_fanout_totals(totals, threads, num_started);
+	memset(prev, 0, sizeof(*prev));
+	for (j = 0; j < RS_FANOUT_NUM_CODES; j++) fr_histogram_init(&prev->exchange[j].latency);
+
+	if (conf->stats.out != RS_STATS_OUT_STDIO_CSV) {
+		rs_fanout_print(conf, 0, fr_time_delta_unwrap(fr_time_sub(fr_time(), start)) / (double) NSEC,
+				totals, prev);
+	}
+
+	ret = 0;
+
+finish:
+	rs_fanout_free(threads, conf->threads);
+	talloc_free(ctx);
+
+	return ret;
+}
+#else
+int rs_fanout_live(UNUSED rs_t *conf, UNUSED char const *interface, UNUSED unsigned int timeout)
+{
+	ERROR("Multi-threaded live capture (-j) requires Linux with TPACKET_V3 support");
+	return -1;
+}
+#endif
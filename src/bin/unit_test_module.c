@@ -929,6 +929,8 @@ int main(int argc, char *argv[])
 		client_add(NULL, client);
 	}
 
+	unlang_compile_flatten(config->unlang_flatten);
+
 	if (server_init(config->root_cs) < 0) EXIT_WITH_FAILURE;
 
 	server_cs = virtual_server_find("default");
@@ -1079,6 +1081,8 @@ int main(int argc, char *argv[])
 	} else {
 		int i;
 		request_t *cached = request;
+		fr_time_t start = fr_time();
+		fr_time_delta_t elapsed;
 
 		for (i = 0; i < count; i++) {
 #ifndef NDEBUG
@@ -1116,6 +1120,14 @@ int main(int argc, char *argv[])
 #endif
 		}
 
+		/*
+		 *	Interpreter microbenchmark, e.g. for comparing
+		 *	"interpret { flatten = yes }" against the default.
+		 */
+		elapsed = fr_time_sub(fr_time(), start);
+		INFO("Ran %d requests in %.6fs (%" PRId64 " ns per request)", count,
+		     fr_time_delta_unwrap(elapsed) / (double) NSEC, fr_time_delta_unwrap(elapsed) / count);
+
 		request = cached;
 	}
 
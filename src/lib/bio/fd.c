@@ -1140,8 +1140,21 @@ int fr_bio_fd_connect(fr_bio_t *bio)
 		return fr_bio_error(IO);
 	}
 
+	/*
+	 *	The connection failed.  Tell the caller why.
+	 */
+	if (error) {
+		errno = error;
+		goto fail;
+	}
+
 	my->info.state = FR_BIO_FD_STATE_OPEN;
 
+	/*
+	 *	The source IP may have changed, so get the new one.
+	 */
+	if (fr_bio_fd_socket_name(my) < 0) goto fail;
+
 	/*
 	 *	The socket is connected, so initialize the normal IO handlers.
 	 */
@@ -1206,3 +1219,59 @@ int fr_bio_fd_write_only(fr_bio_t *bio)
 	my->bio.read = fr_bio_fd_read_discard;
 	return 0;
 }
+
+/** Give a socket returned by accept() to an FD bio
+ *
+ *  The bio must have been allocated without a configuration, and must still be closed.  On success, the bio
+ *  owns the socket, and will close it when it is freed.  On failure, the caller still owns the socket.
+ *
+ *  @param bio	the FD bio
+ *  @param fd	the connected stream socket
+ *  @return
+ *	- <0 on error
+ *	- 0 on success
+ */
+int fr_bio_fd_accepted(fr_bio_t *bio, int fd)
+{
+	fr_bio_fd_t *my = talloc_get_type_abort(bio, fr_bio_fd_t);
+	socklen_t salen;
+	struct sockaddr_storage sockaddr;
+
+	if (my->info.state != FR_BIO_FD_STATE_CLOSED) {
+		fr_strerror_const("Cannot give a socket to an FD bio which is already open");
+		return -1;
+	}
+
+	salen = sizeof(sockaddr);
+	memset(&sockaddr, 0, salen);
+	if (getpeername(fd, (struct sockaddr *) &sockaddr, &salen) < 0) {
+		fr_strerror_printf("Failed getting peer name: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	my->info = (fr_bio_fd_info_t) {
+		.socket = {
+			.af = sockaddr.ss_family,
+			.type = SOCK_STREAM,
+			.fd = fd,
+		},
+		.type = FR_BIO_FD_CONNECTED,
+		.state = FR_BIO_FD_STATE_CLOSED,
+	};
+
+	if (fr_ipaddr_from_sockaddr(&my->info.socket.inet.dst_ipaddr, &my->info.socket.inet.dst_port,
+				    &sockaddr, salen) < 0) return -1;
+
+	my->info.socket.inet.src_ipaddr.af = my->info.socket.af;
+	if (fr_bio_fd_socket_name(my) < 0) return -1;
+
+#ifdef SO_NOSIGPIPE
+	{
+		int on = 1;
+
+		setsockopt(my->info.socket.fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+	}
+#endif
+
+	return fr_bio_fd_init_common(my);
+}
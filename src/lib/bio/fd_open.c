@@ -891,7 +891,12 @@ int fr_bio_fd_open(fr_bio_t *bio, fr_bio_fd_config_t const *cfg)
 			return -1;
 		}
 
-		if (fr_bio_fd_init_connected(my) < 0) goto fail;
+		/*
+		 *	Non-blocking connects usually return "would block".  The caller then
+		 *	waits for the socket to become writable, and calls fr_bio_fd_connect().
+		 */
+		rcode = fr_bio_fd_init_connected(my);
+		if ((rcode < 0) && (rcode != fr_bio_error(IO_WOULD_BLOCK))) goto fail;
 		break;
 
 		/*
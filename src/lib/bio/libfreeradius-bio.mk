@@ -13,3 +13,10 @@ SOURCES	:=		\
 	pipe.c
 
 TGT_PREREQS	:= libfreeradius-util$(L)
+
+ifneq ($(OPENSSL_LIBS),)
+SOURCES		+= tls.c
+
+TGT_LDLIBS	:= $(OPENSSL_LIBS)
+TGT_LDFLAGS	:= $(OPENSSL_FLAGS)
+endif
@@ -0,0 +1,409 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file lib/bio/tls.c
+ * @brief BIO abstractions for TLS
+ *
+ *  OpenSSL reads and writes ciphertext through a custom BIO_METHOD,
+ *  which calls the next bio directly.  There are no intermediate
+ *  buffers in the bio.  OpenSSL is told to release its own record
+ *  buffers when they are empty, so an idle connection costs little
+ *  more than the SSL structure.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+USES_APPLE_DEPRECATED_API	/* OpenSSL API has been deprecated by Apple */
+
+#include <freeradius-devel/bio/bio_priv.h>
+#include <freeradius-devel/bio/null.h>
+#include <freeradius-devel/bio/tls.h>
+#include <freeradius-devel/util/atexit.h>
+
+#ifdef WITH_TLS
+#include <openssl/err.h>
+
+/** The TLS bio
+ *
+ */
+typedef struct {
+	FR_BIO_COMMON;
+
+	SSL			*ssl;		//!< the TLS session.  We own it.
+
+	fr_bio_tls_info_t	info;		//!< information about the session
+
+	ssize_t			next_error;	//!< error returned by the next bio, if any
+} fr_bio_tls_t;
+
+/** Glue between OpenSSL and the next bio
+ *
+ *  This is the same for all bios, so it is only created once.
+ */
+static BIO_METHOD *fr_bio_tls_meth;
+
+/** Give OpenSSL data from the next bio
+ *
+ */
+static int _fr_bio_tls_meth_read(BIO *b, char *buffer, int size)
+{
+	ssize_t rcode;
+	fr_bio_tls_t *my = talloc_get_type_abort(BIO_get_data(b), fr_bio_tls_t);
+	fr_bio_t *next;
+
+	BIO_clear_retry_flags(b);
+
+	next = fr_bio_next(&my->bio);
+	fr_assert(next != NULL);
+
+	rcode = next->read(next, NULL, buffer, size);
+	if (rcode > 0) return rcode;
+
+	if ((rcode == 0) || (rcode == fr_bio_error(IO_WOULD_BLOCK))) {
+		BIO_set_retry_read(b);
+		return -1;
+	}
+
+	/*
+	 *	Tell OpenSSL that the connection is gone.  The caller gets the real error.
+	 */
+	my->next_error = rcode;
+	if (rcode == fr_bio_error(EOF)) return 0;
+
+	return -1;
+}
+
+/** Give the next bio data from OpenSSL
+ *
+ */
+static int _fr_bio_tls_meth_write(BIO *b, char const *buffer, int size)
+{
+	ssize_t rcode;
+	fr_bio_tls_t *my = talloc_get_type_abort(BIO_get_data(b), fr_bio_tls_t);
+	fr_bio_t *next;
+
+	BIO_clear_retry_flags(b);
+
+	next = fr_bio_next(&my->bio);
+	fr_assert(next != NULL);
+
+	rcode = next->write(next, NULL, buffer, size);
+	if (rcode > 0) return rcode;
+
+	if ((rcode == 0) || (rcode == fr_bio_error(IO_WOULD_BLOCK))) {
+		BIO_set_retry_write(b);
+		return -1;
+	}
+
+	my->next_error = rcode;
+	return -1;
+}
+
+/** OpenSSL calls BIO_flush(), which we have to say "yes" to.
+ *
+ *  The next bio doesn't buffer data, so there's nothing to flush.
+ */
+static long _fr_bio_tls_meth_ctrl(UNUSED BIO *b, int cmd, UNUSED long num, UNUSED void *ptr)
+{
+	switch (cmd) {
+	case BIO_CTRL_FLUSH:
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+static int _fr_bio_tls_meth_init(UNUSED void *uctx)
+{
+	fr_bio_tls_meth = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "fr_bio_tls_t");
+	if (!fr_bio_tls_meth) return -1;
+
+	BIO_meth_set_read(fr_bio_tls_meth, _fr_bio_tls_meth_read);
+	BIO_meth_set_write(fr_bio_tls_meth, _fr_bio_tls_meth_write);
+	BIO_meth_set_ctrl(fr_bio_tls_meth, _fr_bio_tls_meth_ctrl);
+
+	return 0;
+}
+
+static int _fr_bio_tls_meth_free(UNUSED void *uctx)
+{
+	BIO_meth_free(fr_bio_tls_meth);
+	fr_bio_tls_meth = NULL;
+
+	return 0;
+}
+
+/** Convert an OpenSSL error to a bio error
+ *
+ *  The OpenSSL error stack is always cleared.
+ */
+static ssize_t fr_bio_tls_error(fr_bio_tls_t *my, int ret)
+{
+	ssize_t rcode;
+	unsigned long error;
+
+	switch (SSL_get_error(my->ssl, ret)) {
+	case SSL_ERROR_WANT_READ:
+	case SSL_ERROR_WANT_WRITE:
+		return fr_bio_error(IO_WOULD_BLOCK);
+
+		/*
+		 *	The other end sent us a close_notify.
+		 */
+	case SSL_ERROR_ZERO_RETURN:
+		rcode = fr_bio_error(EOF);
+		break;
+
+	case SSL_ERROR_SYSCALL:
+		rcode = my->next_error ? my->next_error : fr_bio_error(EOF);
+		break;
+
+	default:
+		/*
+		 *	OpenSSL 3 calls an EOF in the middle of a record an error.  Prefer the real error.
+		 */
+		if (my->next_error) {
+			rcode = my->next_error;
+			break;
+		}
+
+		error = ERR_peek_error();
+		if (error) {
+			fr_strerror_printf("TLS failure - %s", ERR_reason_error_string(error));
+		} else {
+			fr_strerror_const("TLS failure");
+		}
+		rcode = fr_bio_error(GENERIC);
+		break;
+	}
+
+	ERR_clear_error();
+
+	/*
+	 *	Any error here is fatal.
+	 */
+	my->bio.read = fr_bio_eof_read;
+	my->bio.write = fr_bio_null_write;
+
+	return rcode;
+}
+
+/** Check if the handshake has completed, and tell the caller if so.
+ *
+ */
+static int fr_bio_tls_established(fr_bio_tls_t *my)
+{
+	if (my->info.established || !SSL_is_init_finished(my->ssl)) return 0;
+
+	my->info.established = true;
+	my->info.resumed = (SSL_session_reused(my->ssl) == 1);
+
+	if (!my->cb.activate) return 0;
+
+	return my->cb.activate(&my->bio);
+}
+
+/** Read application data.
+ *
+ *  Any handshake messages are processed (and replied to) transparently.
+ *
+ *  @return
+ *	- <0 on error
+ *	- 0 for "no application data is available"
+ *	- >0 for how much application data was read
+ */
+static ssize_t fr_bio_tls_read(fr_bio_t *bio, UNUSED void *packet_ctx, void *buffer, size_t size)
+{
+	int ret;
+	ssize_t rcode;
+	fr_bio_tls_t *my = talloc_get_type_abort(bio, fr_bio_tls_t);
+
+	my->next_error = 0;
+
+	if (size > INT_MAX) size = INT_MAX;
+
+	ret = SSL_read(my->ssl, buffer, (int) size);
+	if (ret <= 0) {
+		/*
+		 *	The handshake may have finished, but there's no application data yet.
+		 */
+		if ((rcode = fr_bio_tls_established(my)) < 0) return rcode;
+
+		rcode = fr_bio_tls_error(my, ret);
+		if (rcode == fr_bio_error(IO_WOULD_BLOCK)) return 0;
+
+		return rcode;
+	}
+
+	if ((rcode = fr_bio_tls_established(my)) < 0) return rcode;
+
+	return ret;
+}
+
+/** Write application data.
+ *
+ *  OpenSSL requires that a write which blocked is retried with the same data.  We therefore only return
+ *  the amount of data which has been fully written to the next bio.  If the write blocked, we return 0, and
+ *  the caller tries again with the same buffer.
+ *
+ *  @return
+ *	- <0 on error
+ *	- 0 for "nothing was written, try again later"
+ *	- >0 for how much application data was written.
+ */
+static ssize_t fr_bio_tls_write(fr_bio_t *bio, UNUSED void *packet_ctx, void const *buffer, size_t size)
+{
+	int ret;
+	ssize_t rcode;
+	fr_bio_tls_t *my = talloc_get_type_abort(bio, fr_bio_tls_t);
+
+	/*
+	 *	The next bio doesn't buffer anything, and OpenSSL can only flush by being called again with
+	 *	the same data.
+	 */
+	if (!buffer) return 0;
+
+	my->next_error = 0;
+
+	if (size > INT_MAX) size = INT_MAX;
+
+	ret = SSL_write(my->ssl, buffer, (int) size);
+	if (ret <= 0) {
+		rcode = fr_bio_tls_error(my, ret);
+		if (rcode == fr_bio_error(IO_WOULD_BLOCK)) return 0;
+
+		return rcode;
+	}
+
+	return ret;
+}
+
+/** Send a close_notify to the other end.
+ *
+ *  We don't wait for the other end to reply.
+ */
+static int fr_bio_tls_shutdown(fr_bio_t *bio)
+{
+	fr_bio_tls_t *my = talloc_get_type_abort(bio, fr_bio_tls_t);
+
+	if (my->info.established) (void) SSL_shutdown(my->ssl);
+	ERR_clear_error();
+
+	my->bio.read = fr_bio_eof_read;
+	my->bio.write = fr_bio_null_write;
+
+	return 0;
+}
+
+static int fr_bio_tls_destructor(fr_bio_tls_t *my)
+{
+	fr_assert(!fr_bio_prev(&my->bio));
+	fr_assert(!fr_bio_next(&my->bio));
+
+	SSL_free(my->ssl);	/* and the BIO we gave it */
+
+	return 0;
+}
+
+/** Allocate a TLS bio.
+ *
+ *  The SSL structure should be initialised, and have its role (client or server) set.  The bio takes
+ *  ownership of the SSL structure, even if this function fails.
+ *
+ *  @param ctx		the talloc ctx
+ *  @param cb		callbacks.  "activate" is called when the handshake has completed.
+ *  @param ssl		the TLS session
+ *  @param next		the next bio, usually an FD bio
+ *  @return
+ *	- NULL on error
+ *	- !NULL the bio
+ */
+fr_bio_t *fr_bio_tls_alloc(TALLOC_CTX *ctx, fr_bio_cb_funcs_t *cb, SSL *ssl, fr_bio_t *next)
+{
+	int ret;
+	BIO *b;
+	fr_bio_tls_t *my;
+
+	fr_atexit_global_once_ret(&ret, _fr_bio_tls_meth_init, _fr_bio_tls_meth_free, NULL);
+	if (ret < 0) {
+	fail:
+		SSL_free(ssl);
+		return NULL;
+	}
+
+	my = talloc_zero(ctx, fr_bio_tls_t);
+	if (!my) goto fail;
+
+	b = BIO_new(fr_bio_tls_meth);
+	if (!b) {
+		talloc_free(my);
+		goto fail;
+	}
+	BIO_set_data(b, my);
+	BIO_set_init(b, 1);
+
+	my->ssl = ssl;
+	SSL_set_bio(ssl, b, b);
+
+	/*
+	 *	Writes return as soon as one record has been written, so that we can tell the caller what was
+	 *	written.  And the record buffers are freed when they are empty, so that idle connections
+	 *	don't hold on to them.
+	 */
+	SSL_set_mode(ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_RELEASE_BUFFERS);
+
+	/*
+	 *	Read as much data as possible with each call to the next bio, instead of reading the record
+	 *	header, and then the record.
+	 */
+	SSL_set_read_ahead(ssl, 1);
+
+	if (cb) my->cb = *cb;
+	my->bio.read = fr_bio_tls_read;
+	my->bio.write = fr_bio_tls_write;
+
+	if (!my->cb.shutdown) my->cb.shutdown = fr_bio_tls_shutdown;
+
+	fr_bio_chain(&my->bio, next);
+
+	talloc_set_destructor(my, fr_bio_tls_destructor);
+	return (fr_bio_t *) my;
+}
+
+/** Get information about the TLS session
+ *
+ */
+fr_bio_tls_info_t const *fr_bio_tls_info(fr_bio_t *bio)
+{
+	fr_bio_tls_t *my = talloc_get_type_abort(bio, fr_bio_tls_t);
+
+	return &my->info;
+}
+
+/** Get the underlying TLS session
+ *
+ *  e.g. to check the client certificate.  The caller MUST NOT free it.
+ */
+SSL *fr_bio_tls_ssl(fr_bio_t *bio)
+{
+	fr_bio_tls_t *my = talloc_get_type_abort(bio, fr_bio_tls_t);
+
+	return my->ssl;
+}
+#endif
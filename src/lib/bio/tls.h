@@ -0,0 +1,57 @@
+#pragma once
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file lib/bio/tls.h
+ * @brief Binary IO abstractions for TLS
+ *
+ *  The TLS bio should be inserted before an FD bio.  Reads from it
+ *  return application data, and writes to it take application data.
+ *  The handshake is done transparently, as data is read from the
+ *  connection.
+ *
+ *  The caller creates the SSL structure, and decides whether it is a
+ *  client or server by calling SSL_set_connect_state() or
+ *  SSL_set_accept_state().  The bio takes ownership of the SSL
+ *  structure, and frees it when the bio is freed.
+ *
+ *  The "activate" callback is run when the handshake has completed.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSIDH(lib_bio_tls_h, "$Id$")
+
+#include <freeradius-devel/bio/base.h>
+
+#ifdef WITH_TLS
+#include <openssl/ssl.h>
+
+/** Information about the TLS session.
+ *
+ */
+typedef struct {
+	bool		established;	//!< the handshake has completed
+	bool		resumed;	//!< the session was resumed from a ticket, or the session cache
+} fr_bio_tls_info_t;
+
+fr_bio_t	*fr_bio_tls_alloc(TALLOC_CTX *ctx, fr_bio_cb_funcs_t *cb, SSL *ssl, fr_bio_t *next) CC_HINT(nonnull(1,3,4));
+
+fr_bio_tls_info_t const *fr_bio_tls_info(fr_bio_t *bio) CC_HINT(nonnull);
+
+SSL		*fr_bio_tls_ssl(fr_bio_t *bio) CC_HINT(nonnull);
+#endif
@@ -348,6 +348,16 @@ typedef void (*fr_io_network_get_t)(void *instance, int *ipproto, bool *dynamic_
 
 typedef char const *(*fr_io_name_t)(fr_listen_t *li);
 
+/** Print transport specific statistics for a socket
+ *
+ * Called from radmin, via "stats network N socket M".  Each line
+ * should be "name<TAB>value".
+ *
+ * @param[in] li	the listener for this socket
+ * @param[in] fp	where the statistics are printed
+ */
+typedef void (*fr_io_stats_print_t)(fr_listen_t const *li, FILE *fp);
+
 
 #ifdef __cplusplus
 }
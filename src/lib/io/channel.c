@@ -44,11 +44,6 @@ RCSID("$Id$")
 #define MPRINT(...)
 #endif
 
-/*
- *	We disable this until we fix all of the signaling issues...
- */
-#define ENABLE_SKIPS (0)
-
 typedef enum {
 	TO_RESPONDER = 0,
 	TO_REQUESTOR = 1
@@ -62,10 +57,6 @@ static fr_table_num_sorted_t const channel_direction[] = {
 size_t channel_direction_len = NUM_ELEMENTS(channel_direction);
 #endif
 
-#if 0
-#define SIGNAL_INTERVAL (1000000)	//!< The minimum interval between responder signals.
-#endif
-
 /** Size of the atomic queues
  *
  * The queue reader MUST service the queue occasionally,
@@ -89,9 +80,6 @@ typedef enum fr_channel_signal_t {
 	/*
 	 *	The preceding MUST be in the same order as fr_channel_event_t
 	 */
-
-	FR_CHANNEL_SIGNAL_DATA_DONE_RESPONDER,
-	FR_CHANNEL_SIGNAL_RESPONDER_SLEEPING,
 } fr_channel_signal_t;
 
 typedef struct {
@@ -105,6 +93,14 @@ typedef struct {
  * Consists of a kqueue descriptor, and an atomic queue.
  * The atomic queue is there to get bulk data through, because it's more efficient
  * than pushing 1M+ events per second through a kqueue.
+ *
+ * The writer only signals the reader when the reader may be asleep.
+ * When the reader finds the queue empty, it sets `must_signal`, and
+ * then checks the queue again.  The writer pushes a message, and then
+ * checks `must_signal`.  Either the reader sees the new message, or
+ * the writer sees the flag, clears it, and sends one signal.  So
+ * under load, there is one signal per batch of messages the reader
+ * drains, instead of one signal per message.
  */
 typedef struct {
 	fr_channel_direction_t	direction;	//!< Use for debug messages.
@@ -118,17 +114,14 @@ typedef struct {
 	fr_channel_recv_callback_t recv;	//!< callback for receiving messages
 	void			*recv_uctx;	//!< context for receiving messages
 
-	bool			must_signal;	//!< we need to signal the other end
-
-
 	uint64_t		sequence;	//!< Sequence number for this channel.
 	uint64_t		ack;		//!< Sequence number of the other end.
 	uint64_t		their_view_of_my_sequence;	//!< Should be clear.
 
-	uint64_t		sequence_at_last_signal;	//!< When we last signaled.
-
 	fr_atomic_queue_t	*aq;		//!< The queue of messages - visible only to this channel.
 
+	atomic_bool		must_signal;	//!< The reader has drained the queue, and may be asleep.
+
 	atomic_bool		active;		//!< Whether the channel is active.
 
 	fr_channel_stats_t	stats;		//!< channel statistics
@@ -156,8 +149,6 @@ fr_table_num_sorted_t const channel_signals[] = {
 	{ L("data-to-requestor"),	FR_CHANNEL_DATA_READY_REQUESTOR		},
 	{ L("open"),			FR_CHANNEL_OPEN				},
 	{ L("close"),			FR_CHANNEL_CLOSE			},
-	{ L("data-done-responder"),	FR_CHANNEL_SIGNAL_DATA_DONE_RESPONDER	},
-	{ L("responder-sleeping"),	FR_CHANNEL_SIGNAL_RESPONDER_SLEEPING	},
 };
 size_t channel_signals_len = NUM_ELEMENTS(channel_signals);
 
@@ -239,11 +230,13 @@ fr_channel_t *fr_channel_create(TALLOC_CTX *ctx, fr_control_t *requestor, fr_con
 	ch->end[TO_RESPONDER].stats.last_read_other = now;
 	ch->end[TO_RESPONDER].stats.last_sent_signal = now;
 	atomic_store(&ch->end[TO_RESPONDER].active, true);
+	atomic_store(&ch->end[TO_RESPONDER].must_signal, true);
 
 	ch->end[TO_REQUESTOR].stats.last_write = now;
 	ch->end[TO_REQUESTOR].stats.last_read_other = now;
 	ch->end[TO_REQUESTOR].stats.last_sent_signal = now;
 	atomic_store(&ch->end[TO_REQUESTOR].active, true);
+	atomic_store(&ch->end[TO_REQUESTOR].must_signal, true);
 
 	return ch;
 }
@@ -275,7 +268,6 @@ static int fr_channel_data_ready(fr_channel_t *ch, fr_time_t when, fr_channel_en
 
 	end->stats.last_sent_signal = when;
 	end->stats.signals++;
-	end->must_signal = false;
 
 	cc.signal = which;
 	cc.ack = end->ack;
@@ -291,6 +283,77 @@ static int fr_channel_data_ready(fr_channel_t *ch, fr_time_t when, fr_channel_en
 #define IALPHA (8)
 #define RTT(_old, _new) fr_time_delta_wrap((fr_time_delta_unwrap(_new) + (fr_time_delta_unwrap(_old) * (IALPHA - 1))) / IALPHA)
 
+/** Signal the reader of a queue, but only if it may be asleep
+ *
+ * Called by the writer after pushing a message onto end->aq.
+ *
+ * @param[in] ch	the channel.
+ * @param[in] when	the data was ready.
+ * @param[in] end	of the channel that the message was written to.
+ * @param[in] which	signal to send.
+ * @return
+ *	- <0 on error
+ *	- 0 on success
+ */
+static inline int fr_channel_data_ready_maybe(fr_channel_t *ch, fr_time_t when, fr_channel_end_t *end,
+					      fr_channel_signal_t which)
+{
+	/*
+	 *	Order the push before the load of the flag.  This
+	 *	pairs with the fence in fr_channel_queue_drained().
+	 */
+	atomic_thread_fence(memory_order_seq_cst);
+
+	/*
+	 *	The reader is still draining the queue, it will see
+	 *	the message without being woken up.
+	 */
+	if (!atomic_load_explicit(&end->must_signal, memory_order_relaxed)) {
+		end->stats.suppressed++;
+		MPRINT("SUPPRESSES signal\n");
+		return 0;
+	}
+
+	atomic_store_explicit(&end->must_signal, false, memory_order_relaxed);
+
+	/*
+	 *	The signal wasn't sent, so the reader may still be
+	 *	asleep.  Set the flag again, so that the next message
+	 *	we push tries to wake it up.
+	 */
+	if (fr_channel_data_ready(ch, when, end, which) < 0) {
+		atomic_store_explicit(&end->must_signal, true, memory_order_relaxed);
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Tell the writer of a queue that we've drained it
+ *
+ * Called by the reader when end->aq is empty.  We then check the
+ * queue again, to catch any message which was pushed before the
+ * writer could see the flag.
+ *
+ * If that message is found, the flag stays set, and the writer may
+ * send us one signal we don't need.  That's better than clearing it,
+ * and missing a wakeup if our caller stops reading.
+ *
+ * @param[in] end	of the channel we're reading from.
+ * @param[out] p_cd	where to write the message, if there is one.
+ * @return
+ *	- true if a message was found.
+ *	- false if the queue is empty.
+ */
+static inline bool fr_channel_queue_drained(fr_channel_end_t *end, fr_channel_data_t **p_cd)
+{
+	atomic_store_explicit(&end->must_signal, true, memory_order_relaxed);
+
+	atomic_thread_fence(memory_order_seq_cst);
+
+	return fr_atomic_queue_pop(end->aq, (void **) p_cd);
+}
+
 /** Send a request message into the channel
  *
  * The message should be initialized, other than "sequence" and "ack".
@@ -357,44 +420,16 @@ int fr_channel_send_request(fr_channel_t *ch, fr_channel_data_t *cd)
 
 	MPRINT("REQUESTOR requests %"PRIu64", num_outstanding %"PRIu64"\n", requestor->stats.packets, requestor->stats.outstanding);
 
-#if ENABLE_SKIPS
-	/*
-	 *	We just sent the first packet.  There can't possibly be a reply, so don't bother looking.
-	 */
-	if (requestor->stats.outstanding == 1) {
-
-		/*
-		 *	There is at least one old packet which is
-		 *	outstanding, look for a reply.
-		 */
-	} else if (requestor->stats.outstanding > 1) {
-		bool has_reply;
-
-		has_reply = fr_channel_recv_reply(ch);
-
-		if (has_reply) while (fr_channel_recv_reply(ch));
-
-		/*
-		 *	There's no reply yet, so we still have packets outstanding.
-		 *	Or, there is a reply, and there are more packets outstanding.
-		 *	Skip the signal.
-		 */
-		if (!requestor->must_signal && (!has_reply || (has_reply && (requestor->stats.outstanding > 1)))) {
-			MPRINT("REQUESTOR SKIPS signal\n");
-			return 0;
-		}
-	}
-#endif
-
 	/*
-	 *	Tell the other end that there is new data ready.
+	 *	Tell the other end that there is new data ready, if
+	 *	it's not already reading the queue.
 	 *
 	 *	Ignore errors on signalling.  The responder already has
 	 *	the packet in its inbound queue, so at some point, it
-	 *	will pick up the message.
+	 *	will pick up the message.  If it doesn't, the next
+	 *	message we send will signal it again.
 	 */
-	MPRINT("REQUESTOR SIGNALS\n");
-	(void) fr_channel_data_ready(ch, when, requestor, FR_CHANNEL_SIGNAL_DATA_TO_RESPONDER);
+	(void) fr_channel_data_ready_maybe(ch, when, requestor, FR_CHANNEL_SIGNAL_DATA_TO_RESPONDER);
 	return 0;
 }
 
@@ -419,7 +454,8 @@ bool fr_channel_recv_reply(fr_channel_t *ch)
 	/*
 	 *	It's OK for the queue to be empty.
 	 */
-	if (!fr_atomic_queue_pop(aq, (void **) &cd)) return false;
+	if (!fr_atomic_queue_pop(aq, (void **) &cd) &&
+	    !fr_channel_queue_drained(&ch->end[TO_REQUESTOR], &cd)) return false;
 
 	/*
 	 *	We want an exponential moving average for round trip
@@ -481,7 +517,8 @@ bool fr_channel_recv_request(fr_channel_t *ch)
 	/*
 	 *	It's OK for the queue to be empty.
 	 */
-	if (!fr_atomic_queue_pop(aq, (void **) &cd)) return false;
+	if (!fr_atomic_queue_pop(aq, (void **) &cd) &&
+	    !fr_channel_queue_drained(&ch->end[TO_RESPONDER], &cd)) return false;
 
 	fr_assert(cd->live.sequence > responder->ack);
 	fr_assert(cd->live.sequence >= responder->sequence); /* must have more requests than replies */
@@ -563,51 +600,10 @@ int fr_channel_send_reply(fr_channel_t *ch, fr_channel_data_t *cd)
 	while (fr_channel_recv_request(ch));
 
 	/*
-	 *	No packets outstanding, we HAVE to signal the requestor
-	 *	thread.
-	 */
-	if (responder->stats.outstanding == 0) {
-		(void) fr_channel_data_ready(ch, when, responder, FR_CHANNEL_SIGNAL_DATA_DONE_RESPONDER);
-		return 0;
-	}
-
-	MPRINT("\twhen - last_read_other = %"PRIu64" - %"PRIu64" = %"PRIu64"\n", when, responder->stats.last_read_other, when - responder->stats.last_read_other);
-	MPRINT("\twhen - last signal = %"PRIu64" - %"PRIu64" = %"PRIu64"\n", when, responder->stats.last_sent_signal, when - responder->stats.last_sent_signal);
-	MPRINT("\tsequence - ack = %"PRIu64" - %"PRIu64" = %"PRIu64"\n", responder->sequence, responder->their_view_of_my_sequence, responder->sequence - responder->their_view_of_my_sequence);
-
-#ifdef __APPLE__
-	/*
-	 *	If we've sent them a signal since the last ACK, they
-	 *	will receive it, and process the packets.  So we don't
-	 *	need to signal them again.
-	 *
-	 *	But... this doesn't appear to work on the Linux
-	 *	libkqueue implementation.
-	 */
-	if (responder->sequence_at_last_signal > responder->their_view_of_my_sequence) return 0;
-#endif
-
-	/*
-	 *	If we've received a new packet in the last while, OR
-	 *	we've sent a signal in the last while, then we don't
-	 *	need to send a new signal.  But we DO send a signal if
-	 *	we haven't seen an ACK for a few packets.
-	 *
-	 *	FIXME: make these limits configurable, or include
-	 *	predictions about packet processing time?
+	 *	Tell the requestor that there is a reply, if it's not
+	 *	already reading the queue.
 	 */
-	fr_assert(responder->their_view_of_my_sequence <= responder->sequence);
-#if 0
-	if (((responder->sequence - their_view_of_my_sequence) <= 1000) &&
-	    ((when - responder->stats.last_read_other < SIGNAL_INTERVAL) ||
-	     ((when - responder->stats.last_sent_signal) < SIGNAL_INTERVAL))) {
-		MPRINT("\tRESPONDER SKIPS signal\n");
-		return 0;
-	}
-#endif
-
-	MPRINT("\tRESPONDER SIGNALS num_outstanding %"PRIu64"\n", responder->stats.outstanding);
-	(void) fr_channel_data_ready(ch, when, responder, FR_CHANNEL_SIGNAL_DATA_TO_REQUESTOR);
+	(void) fr_channel_data_ready_maybe(ch, when, responder, FR_CHANNEL_SIGNAL_DATA_TO_REQUESTOR);
 	return 0;
 }
 
@@ -638,6 +634,10 @@ int fr_channel_null_reply(fr_channel_t *ch)
  * This function should be called from the responders idle loop.
  * i.e. only when it has nothing else to do.
  *
+ * The responder already marks the channel when it drains the queue,
+ * so this is only needed if it stops reading before the queue is
+ * empty.  The requestor will then signal on the next request.
+ *
  * @param[in] ch	the channel to signal we're no longer listening on.
  * @return
  *	- <0 on error
@@ -645,27 +645,10 @@ int fr_channel_null_reply(fr_channel_t *ch)
  */
 int fr_channel_responder_sleeping(fr_channel_t *ch)
 {
-	fr_channel_end_t *responder;
-	fr_channel_control_t cc;
-
-	responder = &(ch->end[TO_REQUESTOR]);
-
-	/*
-	 *	We don't have any outstanding requests to process for
-	 *	this channel, don't signal the network thread that
-	 *	we're sleeping.  It already knows.
-	 */
-	if (responder->stats.outstanding == 0) return 0;
-
-	responder->stats.signals++;
+	MPRINT("\tRESPONDER SLEEPING num_outstanding %"PRIu64"\n", ch->end[TO_REQUESTOR].stats.outstanding);
 
-	cc.signal = FR_CHANNEL_SIGNAL_RESPONDER_SLEEPING;
-	cc.ack = responder->ack;
-	cc.ch = ch;
-
-	MPRINT("\tRESPONDER SLEEPING num_outstanding %"PRIu64", packets in %"PRIu64", packets out %"PRIu64"\n", responder->stats.outstanding,
-	       ch->end[TO_RESPONDER].stats.packets, responder->stats.packets);
-	return fr_control_message_send(responder->control, responder->rb, FR_CONTROL_ID_CHANNEL, &cc, sizeof(cc));
+	atomic_store(&ch->end[TO_RESPONDER].must_signal, true);
+	return 0;
 }
 
 
@@ -677,98 +660,38 @@ int fr_channel_responder_sleeping(fr_channel_t *ch)
  * @param[in] data_size		The size of the control message.
  * @return
  *	- FR_CHANNEL_ERROR on error
- *	- FR_CHANNEL_NOOP, on do nothing
  *	- FR_CHANNEL_DATA_READY on data ready
  *	- FR_CHANNEL_OPEN when a channel has been opened and sent to us
  *	- FR_CHANNEL_CLOSE when a channel should be closed
  */
-fr_channel_event_t fr_channel_service_message(fr_time_t when, fr_channel_t **p_channel, void const *data, size_t data_size)
+fr_channel_event_t fr_channel_service_message(UNUSED fr_time_t when, fr_channel_t **p_channel, void const *data, size_t data_size)
 {
-	int rcode;
-#if ENABLE_SKIPS
-	uint64_t ack;
-#endif
 	fr_channel_control_t cc;
-	fr_channel_signal_t cs;
-	fr_channel_event_t ce = FR_CHANNEL_ERROR;
-	fr_channel_end_t *requestor;
-	fr_channel_t *ch;
 
 	fr_assert(data_size == sizeof(cc));
 	memcpy(&cc, data, data_size);
 
-	cs = cc.signal;
-#if ENABLE_SKIPS
-	ack = cc.ack;
-#endif
-	*p_channel = ch = cc.ch;
+	*p_channel = cc.ch;
 
-	switch (cs) {
+	switch (cc.signal) {
 	/*
 	 *	These all have the same numbers as the channel
 	 *	events, and have no extra processing.  We just
 	 *	return them as-is.
+	 *
+	 *	The writer only signals when we've drained the queue,
+	 *	so there's nothing to re-signal here.
 	 */
 	case FR_CHANNEL_SIGNAL_ERROR:
 	case FR_CHANNEL_SIGNAL_DATA_TO_RESPONDER:
 	case FR_CHANNEL_SIGNAL_DATA_TO_REQUESTOR:
 	case FR_CHANNEL_SIGNAL_OPEN:
 	case FR_CHANNEL_SIGNAL_CLOSE:
-		MPRINT("channel got %d\n", cs);
-		return (fr_channel_event_t) cs;
-
-	/*
-	 *	Only sent by the responder.  Both of these
-	 *	situations are largely the same, except for
-	 *	return codes.
-	 */
-	case FR_CHANNEL_SIGNAL_DATA_DONE_RESPONDER:
-		MPRINT("channel got data_done_responder\n");
-		ce = FR_CHANNEL_DATA_READY_REQUESTOR;
-		ch->end[TO_RESPONDER].must_signal = true;
-		break;
-
-	case FR_CHANNEL_SIGNAL_RESPONDER_SLEEPING:
-		MPRINT("channel got responder_sleeping\n");
-		ce = FR_CHANNEL_NOOP;
-		ch->end[TO_RESPONDER].must_signal = true;
-		break;
+		MPRINT("channel got %d\n", cc.signal);
+		return (fr_channel_event_t) cc.signal;
 	}
 
-	/*
-	 *	Compare their ACK to the last sequence we
-	 *	sent.  If it's different, we signal the responder
-	 *	to wake up.
-	 */
-	requestor = &ch->end[TO_RESPONDER];
-#if ENABLE_SKIPS
-	if (!requestor->must_signal && (ack == requestor->sequence)) {
-		MPRINT("REQUESTOR SKIPS signal AFTER CE %d num_outstanding %"PRIu64"\n", cs, requestor->stats.outstanding);
-		MPRINT("REQUESTOR has ack %"PRIu64", my seq %"PRIu64" my_view %"PRIu64"\n", ack, requestor->sequence, requestor->their_view_of_my_sequence);
-		return ce;
-	}
-
-	/*
-	 *	The responder is sleeping or done.  There are more
-	 *	packets available, so we signal it to wake up again.
-	 */
-	fr_assert(ack <= requestor->sequence);
-#endif
-
-	/*
-	 *	We're signaling it again...
-	 */
-	requestor->stats.resignals++;
-
-	/*
-	 *	The responder hasn't seen our last few packets.  Signal
-	 *	that there is data ready.
-	 */
-	MPRINT("REQUESTOR SIGNALS AFTER CE %d\n", cs);
-	rcode = fr_channel_data_ready(ch, when, requestor, FR_CHANNEL_SIGNAL_DATA_TO_RESPONDER);
-	if (rcode < 0) return FR_CHANNEL_ERROR;
-
-	return ce;
+	return FR_CHANNEL_ERROR;
 }
 
 
@@ -964,7 +887,7 @@ void fr_channel_stats_log(fr_channel_t const *ch, fr_log_t const *log, char cons
 {
 	fr_log(log, L_INFO, file, line, "requestor\n");
 	fr_log(log, L_INFO, file, line, "\tsignals sent = %" PRIu64 "\n", ch->end[TO_RESPONDER].stats.signals);
-	fr_log(log, L_INFO, file, line, "\tsignals re-sent = %" PRIu64 "\n", ch->end[TO_RESPONDER].stats.resignals);
+	fr_log(log, L_INFO, file, line, "\tsignals suppressed = %" PRIu64 "\n", ch->end[TO_RESPONDER].stats.suppressed);
 	fr_log(log, L_INFO, file, line, "\tkevents checked = %" PRIu64 "\n", ch->end[TO_RESPONDER].stats.kevents);
 	fr_log(log, L_INFO, file, line, "\toutstanding = %" PRIu64 "\n", ch->end[TO_RESPONDER].stats.outstanding);
 	fr_log(log, L_INFO, file, line, "\tpackets processed = %" PRIu64 "\n", ch->end[TO_RESPONDER].stats.packets);
@@ -975,6 +898,7 @@ void fr_channel_stats_log(fr_channel_t const *ch, fr_log_t const *log, char cons
 
 	fr_log(log, L_INFO, file, line, "responder\n");
 	fr_log(log, L_INFO, file, line, "\tsignals sent = %" PRIu64"\n", ch->end[TO_REQUESTOR].stats.signals);
+	fr_log(log, L_INFO, file, line, "\tsignals suppressed = %" PRIu64 "\n", ch->end[TO_REQUESTOR].stats.suppressed);
 	fr_log(log, L_INFO, file, line, "\tkevents checked = %" PRIu64 "\n", ch->end[TO_REQUESTOR].stats.kevents);
 	fr_log(log, L_INFO, file, line, "\tpackets processed = %" PRIu64 "\n", ch->end[TO_REQUESTOR].stats.packets);
 	fr_log(log, L_INFO, file, line, "\tmessage interval (RTT) = %" PRIu64 "\n", fr_time_delta_unwrap(ch->end[TO_REQUESTOR].stats.message_interval));
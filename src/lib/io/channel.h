@@ -81,7 +81,7 @@ typedef enum fr_channel_event_t {
 typedef struct {
 	uint64_t       		outstanding; 	//!< Number of outstanding requests with no reply.
 	uint64_t		signals;	//!< Number of kevent signals we've sent.
-	uint64_t		resignals;	//!< Number of signals resent.
+	uint64_t		suppressed;	//!< Number of signals we didn't send, as the other end was awake.
 
 	uint64_t		packets;	//!< Number of actual data packets.
 
@@ -73,6 +73,8 @@ struct fr_load_s {
 	fr_time_t		step_start;		//!< when the current step started
 	fr_time_t		step_end;		//!< when the current step will end
 	int			step_received;
+	int			step_backlog;		//!< backlog when the current step started
+	bool			step_gated;		//!< whether the current step was gated
 
 	uint32_t		pps;
 	fr_time_delta_t		delta;			//!< between packets
@@ -101,6 +103,8 @@ fr_load_t *fr_load_generator_create(TALLOC_CTX *ctx, fr_event_list_t *el, fr_loa
 	l->callback = callback;
 	l->uctx = uctx;
 
+	fr_histogram_init(&l->stats.latency);
+
 	return l;
 }
 
@@ -126,6 +130,16 @@ static void fr_load_generator_send(fr_load_t *l, fr_time_t now, int count)
 	}
 }
 
+/** The replies we're waiting for aren't coming, stop anyways
+ *
+ */
+static void load_drain_timer(UNUSED fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	fr_load_t *l = uctx;
+
+	l->stats.end = now;
+}
+
 static void load_timer(fr_event_list_t *el, fr_time_t now, void *uctx)
 {
 	fr_load_t *l = uctx;
@@ -143,9 +157,25 @@ static void load_timer(fr_event_list_t *el, fr_time_t now, void *uctx)
 	 *	If we're done this step, go to the next one.
 	 */
 	if (fr_time_gteq(l->next, l->step_end)) {
+		/*
+		 *	The step was sustained if we never had to gate,
+		 *	and the backlog didn't grow by more than a
+		 *	burst, plus 10ms worth of packets.  Otherwise
+		 *	the server isn't keeping up with the offered
+		 *	load, and anything higher doesn't count.
+		 */
+		if (!l->step_gated &&
+		    ((l->stats.backlog - l->step_backlog) <= (int) (l->config->parallel + (l->pps / 100)))) {
+			if (!l->stats.saturated) l->stats.sustained_pps = l->pps;
+		} else {
+			l->stats.saturated = true;
+		}
+
 		l->step_start = l->next;
 		l->step_end = fr_time_add(l->next, l->config->duration);
 		l->step_received = l->stats.received;
+		l->step_backlog = l->stats.backlog;
+		l->step_gated = false;
 		l->pps += l->config->step;
 		l->stats.pps = l->pps;
 		l->stats.skipped = 0;
@@ -157,6 +187,26 @@ static void load_timer(fr_event_list_t *el, fr_time_t now, void *uctx)
 		 */
 		if (l->config->max_pps && (l->pps > l->config->max_pps)) {
 			l->state = FR_LOAD_STATE_DRAINING;
+
+			/*
+			 *	All of the replies are already in, so
+			 *	there won't be another one to say that
+			 *	we're done.  The caller has to check
+			 *	stats.end instead.
+			 */
+			if (l->stats.backlog == 0) {
+				l->stats.end = now;
+				return;
+			}
+
+			/*
+			 *	An overloaded server may drop packets,
+			 *	so we wait at most one more step for
+			 *	the replies.
+			 */
+			if (fr_event_timer_in(l, el, &l->ev, l->config->duration, load_drain_timer, l) < 0) {
+				l->stats.end = now;
+			}
 			return;
 		}
 	}
@@ -196,6 +246,7 @@ static void load_timer(fr_event_list_t *el, fr_time_t now, void *uctx)
 		 */
 		l->state = FR_LOAD_STATE_GATED;
 		l->stats.blocked = true;
+		l->step_gated = true;
 		count = 0;
 		l->stats.skipped += l->count;
 	}
@@ -230,6 +281,7 @@ static void load_timer(fr_event_list_t *el, fr_time_t now, void *uctx)
 int fr_load_generator_start(fr_load_t *l)
 {
 	l->stats.start = fr_time();
+	l->stats.end = fr_time_wrap(0);
 	l->step_start = l->stats.start;
 	l->step_end = fr_time_add(l->step_start, l->config->duration);
 
@@ -278,6 +330,8 @@ fr_load_reply_t fr_load_generator_have_reply(fr_load_t *l, fr_time_t request_tim
 
 	l->stats.received++;
 
+	fr_histogram_record(&l->stats.latency, fr_time_delta_unwrap(t));
+
 	/*
 	 *	t is in nanoseconds.
 	 */
@@ -331,6 +385,12 @@ fr_load_reply_t fr_load_generator_have_reply(fr_load_t *l, fr_time_t request_tim
 	 */
 	if (l->stats.received < l->stats.sent) return FR_LOAD_CONTINUE;
 
+	/*
+	 *	We've already given up on the replies.
+	 */
+	if (fr_time_neq(l->stats.end, fr_time_wrap(0))) return FR_LOAD_CONTINUE;
+
+	if (l->ev) (void) fr_event_timer_delete(&l->ev);
 	l->stats.end = now;
 	return FR_LOAD_DONE;
 }
@@ -344,7 +404,7 @@ size_t fr_load_generator_stats_sprint(fr_load_t *l, fr_time_t now, char *buffer,
 
 	if (!l->header) {
 		l->header = true;
-		return snprintf(buffer, buflen, "\"time\",\"last_packet\",\"rtt\",\"rttvar\",\"pps\",\"pps_accepted\",\"sent\",\"received\",\"backlog\",\"max_backlog\",\"<usec\",\"us\",\"10us\",\"100us\",\"ms\",\"10ms\",\"100ms\",\"s\",\"blocked\"\n");
+		return snprintf(buffer, buflen, "\"time\",\"last_packet\",\"rtt\",\"rttvar\",\"pps\",\"pps_accepted\",\"sent\",\"received\",\"backlog\",\"max_backlog\",\"<usec\",\"us\",\"10us\",\"100us\",\"ms\",\"10ms\",\"100ms\",\"s\",\"blocked\",\"p50_us\",\"p90_us\",\"p99_us\",\"p999_us\"\n");
 	}
 
 
@@ -373,7 +433,8 @@ size_t fr_load_generator_stats_sprint(fr_load_t *l, fr_time_t now, char *buffer,
 			"%d,%d,"
 			"%d,%d,"
 			"%d,%d,%d,%d,%d,%d,%d,%d,"
-			"%d\n",
+			"%d,"
+			"%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
 			now_f, last_send_f,
 			fr_time_delta_unwrap(l->stats.rtt), fr_time_delta_unwrap(l->stats.rttvar),
 			l->stats.pps, l->stats.pps_accepted,
@@ -381,7 +442,11 @@ size_t fr_load_generator_stats_sprint(fr_load_t *l, fr_time_t now, char *buffer,
 			l->stats.backlog, l->stats.max_backlog,
 			l->stats.times[0], l->stats.times[1], l->stats.times[2], l->stats.times[3],
 			l->stats.times[4], l->stats.times[5], l->stats.times[6], l->stats.times[7],
-			l->stats.blocked);
+			l->stats.blocked,
+			fr_histogram_percentile(&l->stats.latency, 50) / 1000,
+			fr_histogram_percentile(&l->stats.latency, 90) / 1000,
+			fr_histogram_percentile(&l->stats.latency, 99) / 1000,
+			fr_histogram_percentile(&l->stats.latency, 99.9) / 1000);
 }
 
 fr_load_stats_t const * fr_load_generator_stats(fr_load_t const *l)
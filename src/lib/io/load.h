@@ -26,6 +26,7 @@
 RCSIDH(load_h, "$Id$")
 
 #include <freeradius-devel/util/event.h>
+#include <freeradius-devel/util/histogram.h>
 #include <freeradius-devel/util/talloc.h>
 
 /** Load generation configuration.
@@ -80,7 +81,7 @@ typedef struct {
 
 typedef struct {
 	fr_time_t	start;		//! when the test started
-	fr_time_t	end;		//!< when the test ended, due to last reply received
+	fr_time_t	end;		//!< when the test ended, due to last reply received, or giving up on the rest
 	fr_time_t	last_send;	//!< last packet we sent
 	fr_time_delta_t rtt;		//!< smoothed round trip time
 	fr_time_delta_t	rttvar;		//!< RTT variation
@@ -91,8 +92,11 @@ typedef struct {
 	int		skipped;	//!< we skipped sending this number of packets
 	int		backlog;	//!< current backlog
 	int		max_backlog;	//!< maximum backlog we saw during the test
+	int		sustained_pps;	//!< highest step rate which was sent without the backlog growing
+	bool		saturated;	//!< at least one step couldn't be sustained
 	bool		blocked;	//!< whether or not we're blocked
 	int		times[8];	//!< response time in microseconds to tens of seconds
+	fr_histogram_t	latency;	//!< response times in nanoseconds, for percentiles
 } fr_load_stats_t;
 
 typedef struct fr_load_s fr_load_t;
@@ -2066,6 +2066,8 @@ static int cmd_stats_socket(FILE *fp, FILE *fp_err, void *ctx, fr_cmd_info_t con
 	fprintf(fp, "count.dup\t%" PRIu64 "\n", s->stats.dup);
 	fprintf(fp, "count.dropped\t%" PRIu64 "\n", s->stats.dropped);
 
+	if (s->listen->app_io->stats_print) s->listen->app_io->stats_print(s->listen, fp);
+
 	return 0;
 }
 
@@ -35,6 +35,8 @@ RCSID("$Id$")
 #include <freeradius-devel/server/trigger.h>
 
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
 /*
  *	Other OS's have sem_init, OS X doesn't.
@@ -875,3 +877,48 @@ fr_network_t *fr_schedule_directory_add(fr_schedule_t *sc, fr_listen_t *li)
 
 	return nr;
 }
+
+/** Return the CPU time used so far by the worker threads
+ *
+ * In single-threaded mode the worker runs in the main thread, so the
+ * CPU time of the calling thread is returned.  It then includes the
+ * time spent on the network side, too.
+ *
+ * @param[in] sc the scheduler
+ * @return
+ *	- 0 if the CPU time can't be measured on this platform.
+ *	- the total CPU time of all running workers.
+ */
+fr_time_delta_t fr_schedule_worker_cpu_time(fr_schedule_t *sc)
+{
+#ifdef _POSIX_THREAD_CPUTIME
+	struct timespec		ts;
+	fr_schedule_worker_t	*sw;
+	int64_t			total = 0;
+
+	(void) talloc_get_type_abort(sc, fr_schedule_t);
+
+	if (sc->el) {
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) < 0) return fr_time_delta_wrap(0);
+
+		return fr_time_delta_from_timespec(&ts);
+	}
+
+	for (sw = fr_dlist_head(&sc->workers);
+	     sw != NULL;
+	     sw = fr_dlist_next(&sc->workers, sw)) {
+		clockid_t clock;
+
+		if (sw->status != FR_CHILD_RUNNING) continue;
+
+		if ((pthread_getcpuclockid(sw->pthread_id, &clock) != 0) ||
+		    (clock_gettime(clock, &ts) < 0)) continue;
+
+		total += fr_time_delta_unwrap(fr_time_delta_from_timespec(&ts));
+	}
+
+	return fr_time_delta_wrap(total);
+#else
+	return fr_time_delta_wrap(0);
+#endif
+}
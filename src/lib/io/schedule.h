@@ -82,6 +82,8 @@ int			fr_schedule_destroy(fr_schedule_t **sc);
 
 fr_network_t		*fr_schedule_listen_add(fr_schedule_t *sc, fr_listen_t *li) CC_HINT(nonnull);
 fr_network_t		*fr_schedule_directory_add(fr_schedule_t *sc, fr_listen_t *li) CC_HINT(nonnull);
+
+fr_time_delta_t		fr_schedule_worker_cpu_time(fr_schedule_t *sc) CC_HINT(nonnull);
 #ifdef __cplusplus
 }
 #endif
@@ -56,6 +56,7 @@ RCSID("$Id$")
 #include <freeradius-devel/io/message.h>
 #include <freeradius-devel/io/time_tracking.h>
 #include <freeradius-devel/io/worker.h>
+#include <freeradius-devel/server/metrics.h>
 #include <freeradius-devel/unlang/base.h>
 #include <freeradius-devel/unlang/call.h>
 #include <freeradius-devel/unlang/interpret.h>
@@ -711,6 +712,17 @@ static void worker_send_reply(fr_worker_t *worker, request_t *request, bool send
 	fr_time_elapsed_update(&worker->cpu_time, now, fr_time_add(now, reply->reply.processing_time));
 	fr_time_elapsed_update(&worker->wall_clock, reply->reply.request_time, now);
 
+	if (fr_metrics_active() && request->async->listen->server_cs) {
+		CONF_SECTION const	*server_cs = request->async->listen->server_cs;
+		fr_metrics_entry_t	*entry;
+
+		entry = fr_metrics_entry(FR_METRICS_VIRTUAL_SERVER, server_cs, cf_section_name2(server_cs), NULL);
+		if (entry) {
+			fr_metrics_record(entry, fr_time_sub(now, reply->reply.request_time));
+			if (request->master_state == REQUEST_STOP_PROCESSING) fr_metrics_failed(entry);
+		}
+	}
+
 	RDEBUG("Finished request");
 
 	/*
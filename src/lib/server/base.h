@@ -46,6 +46,7 @@ RCSIDH(base_h, "$Id$")
 #include <freeradius-devel/server/map_proc_priv.h>
 #include <freeradius-devel/server/map_proc.h>
 #include <freeradius-devel/server/map.h>
+#include <freeradius-devel/server/metrics.h>
 #include <freeradius-devel/server/module.h>
 #include <freeradius-devel/server/packet.h>
 #include <freeradius-devel/server/pair.h>
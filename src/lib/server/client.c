@@ -566,8 +566,12 @@ fr_client_list_t *client_list_parse_section(CONF_SECTION *section, int proto, TL
 		/*
 		 *	TLS clients CANNOT use non-TLS listeners.
 		 *	non-TLS clients CANNOT use TLS listeners.
+		 *
+		 *	Global clients aren't parsed for a particular
+		 *	listener, so the listener checks them when it
+		 *	finds them.
 		 */
-		if (tls_required != c->tls_required) {
+		if (proto && (tls_required != c->tls_required)) {
 			cf_log_err(cs, "Client does not have the same TLS configuration as the listener");
 			goto error;
 		}
@@ -98,6 +98,8 @@ int	fr_exec_value_box_list_to_argv(TALLOC_CTX *ctx,
 
 char	**fr_exec_pair_to_env(request_t *request, fr_pair_list_t *env_pairs, bool env_escape);
 
+int	fr_exec_spawn_set(bool spawn);
+
 int	fr_exec_fork_nowait(fr_event_list_t *el,
 			    char **argv_in, char **env_in,
 			    bool env_inherit, bool debug);
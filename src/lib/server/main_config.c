@@ -176,6 +176,8 @@ static const conf_parser_t thread_config[] = {
 
 	{ FR_CONF_OFFSET_TYPE_FLAGS("stats_interval", FR_TYPE_TIME_DELTA | CONF_FLAG_HIDDEN, 0, main_config_t, stats_interval), },
 
+	{ FR_CONF_OFFSET("regex_cache_size", main_config_t, regex_cache_size), .dflt = "256" },
+
 #ifdef WITH_TLS
 	{ FR_CONF_OFFSET_TYPE_FLAGS("openssl_async_pool_init", FR_TYPE_SIZE, 0, main_config_t, openssl_async_pool_init), .dflt = "64" },
 	{ FR_CONF_OFFSET_TYPE_FLAGS("openssl_async_pool_max", FR_TYPE_SIZE, 0, main_config_t, openssl_async_pool_max), .dflt = "1024" },
@@ -194,16 +196,29 @@ static const conf_parser_t migrate_config[] = {
 	CONF_PARSER_TERMINATOR
 };
 
-#ifndef NDEBUG
 /*
- *	Migration configuration.
+ *	Interpreter profiling.
+ */
+static const conf_parser_t profile_config[] = {
+	{ FR_CONF_OFFSET("enable", main_config_t, profile), .dflt = "no" },
+	{ FR_CONF_OFFSET("slow_request", main_config_t, profile_slow_request), .dflt = "1.0" },
+	{ FR_CONF_OFFSET("sample", main_config_t, profile_sample), .dflt = "10" },
+	{ FR_CONF_OFFSET("traces", main_config_t, profile_traces), .dflt = "16" },
+	CONF_PARSER_TERMINATOR
+};
+
+/*
+ *	Interpreter configuration.
  */
 static const conf_parser_t interpret_config[] = {
+#ifndef NDEBUG
 	{ FR_CONF_OFFSET_FLAGS("countup_instructions", CONF_FLAG_HIDDEN, main_config_t, ins_countup) },
 	{ FR_CONF_OFFSET_FLAGS("max_instructions", CONF_FLAG_HIDDEN, main_config_t, ins_max) },
+#endif
+	{ FR_CONF_OFFSET("flatten", main_config_t, unlang_flatten) },
+	{ FR_CONF_POINTER("profile", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) profile_config },
 	CONF_PARSER_TERMINATOR
 };
-#endif
 
 static const conf_parser_t server_config[] = {
 	/*
@@ -236,9 +251,7 @@ static const conf_parser_t server_config[] = {
 
 	{ FR_CONF_POINTER("migrate", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) migrate_config, .name2 = CF_IDENT_ANY },
 
-#ifndef NDEBUG
 	{ FR_CONF_POINTER("interpret", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) interpret_config, .name2 = CF_IDENT_ANY },
-#endif
 
 	CONF_PARSER_TERMINATOR
 };
@@ -1503,6 +1516,7 @@ void main_config_hup(main_config_t *config)
 static fr_table_num_ordered_t config_arg_table[] = {
 	{ L("rewrite_update"),		 offsetof(main_config_t, rewrite_update) },
 	{ L("forbid_update"),		 offsetof(main_config_t, forbid_update) },
+	{ L("flatten"),			 offsetof(main_config_t, unlang_flatten) },
 };
 static size_t config_arg_table_len = NUM_ELEMENTS(config_arg_table);
 
@@ -150,12 +150,23 @@ struct main_config_s {
 	uint32_t	max_networks;			//!< for the scheduler
 	uint32_t	max_workers;			//!< for the scheduler
 	fr_time_delta_t	stats_interval;			//!< for the scheduler
+	uint32_t	regex_cache_size;		//!< Runtime expressions each thread keeps compiled.
 
 #ifndef NDEBUG
 	uint32_t	ins_max;			//!< max instruction count
 	bool		ins_countup;			//!< count up to "max"
 #endif
 
+	bool		unlang_flatten;			//!< lay out compiled sections contiguously.
+
+	/*
+	 *	Interpreter profiling
+	 */
+	bool		profile;			//!< time module calls, and trace slow requests.
+	fr_time_delta_t	profile_slow_request;		//!< keep traces of requests which take longer than this.
+	uint32_t	profile_sample;			//!< trace one in every N requests.
+	uint32_t	profile_traces;			//!< how many slow request traces to keep.
+
 	/*
 	 *	Migration tools
 	 */
@@ -0,0 +1,453 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file src/lib/server/metrics.c
+ * @brief Per-thread latency metrics, merged and exported on demand.
+ *
+ * Every thread which records metrics gets its own registry of entries.
+ * Only the owning thread ever writes to an entry, so recording a sample
+ * is a handful of relaxed loads and stores, with no locks and no shared
+ * cache lines.
+ *
+ * Entries are published to other threads via a singly linked list whose
+ * head is updated with release semantics.  Entries are never removed
+ * from the list while the thread is running, so a reader only needs to
+ * hold the global mutex to stop the registry being freed from under it.
+ *
+ * When a thread exits, its entries are moved to a list of retired
+ * entries, so that counters don't go backwards.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/command.h>
+#include <freeradius-devel/server/log.h>
+#include <freeradius-devel/server/metrics.h>
+#include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/rb.h>
+
+#include <pthread.h>
+
+/** The metrics for a single thread
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;			//!< In the global list of registries.
+	fr_hash_table_t		*ht;			//!< Lookup of entries by type and key.  Owner only.
+	fr_metrics_entry_t	* _Atomic head;		//!< Entries published to readers.
+} fr_metrics_thread_t;
+
+/** Merged metrics from all threads, keyed by their labels
+ *
+ */
+typedef struct {
+	fr_rb_node_t		node;			//!< In the tree of merged entries.
+	fr_metrics_type_t	type;
+	char const		*name;
+	char const		*sub;
+	uint64_t		failed;
+	fr_histogram_t		latency;
+} fr_metrics_merged_t;
+
+bool fr_metrics_enabled = false;
+
+static pthread_mutex_t		metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+static fr_dlist_head_t		metrics_threads;	//!< Registries of running threads.
+static bool			metrics_threads_init = false;
+static fr_metrics_entry_t	*metrics_retired;	//!< Entries from threads which have exited.
+static TALLOC_CTX		*metrics_retired_ctx;
+
+static _Thread_local fr_metrics_thread_t	*metrics_thread;
+
+/** Labels and help text for each type of metric
+ *
+ */
+static struct {
+	char const	*family;			//!< Metric family name.
+	char const	*name_label;			//!< Label for entry->name.
+	char const	*sub_label;			//!< Label for entry->sub.
+	char const	*help;
+} const metrics_type[FR_METRICS_MAX] = {
+	[FR_METRICS_VIRTUAL_SERVER] = {
+		.family = "freeradius_virtual_server",
+		.name_label = "server",
+		.help = "Time from a request being received to its reply being sent."
+	},
+	[FR_METRICS_SECTION] = {
+		.family = "freeradius_section",
+		.name_label = "server",
+		.sub_label = "section",
+		.help = "Time taken to run a processing section."
+	},
+	[FR_METRICS_MODULE] = {
+		.family = "freeradius_module",
+		.name_label = "module",
+		.sub_label = "method",
+		.help = "Time taken by a module call, including any time spent yielded."
+	},
+	[FR_METRICS_TRUNK] = {
+		.family = "freeradius_trunk",
+		.name_label = "trunk",
+		.help = "Time from a request being enqueued on a trunk to it completing."
+	},
+	[FR_METRICS_OFFLOAD] = {
+		.family = "freeradius_offload",
+		.name_label = "pool",
+		.help = "Time from a blocking call being submitted to an offload pool to it completing."
+	},
+};
+
+static uint32_t metrics_entry_hash(void const *data)
+{
+	fr_metrics_entry_t const *entry = data;
+	uint32_t hash;
+
+	hash = fr_hash(&entry->type, sizeof(entry->type));
+	return fr_hash_update(&entry->key, sizeof(entry->key), hash);
+}
+
+static int8_t metrics_entry_cmp(void const *one, void const *two)
+{
+	fr_metrics_entry_t const *a = one, *b = two;
+
+	CMP_RETURN(a, b, type);
+	return CMP(a->key, b->key);
+}
+
+static int8_t metrics_merged_cmp(void const *one, void const *two)
+{
+	fr_metrics_merged_t const *a = one, *b = two;
+	int ret;
+
+	CMP_RETURN(a, b, type);
+
+	ret = strcmp(a->name, b->name);
+	if (ret != 0) return CMP(ret, 0);
+
+	if (!a->sub || !b->sub) return CMP(a->sub, b->sub);
+
+	ret = strcmp(a->sub, b->sub);
+	return CMP(ret, 0);
+}
+
+/** Move a thread's entries to the retired list when it exits
+ *
+ */
+static int _metrics_thread_free(void *uctx)
+{
+	fr_metrics_thread_t	*mt = uctx;
+	fr_metrics_entry_t	*entry, *next;
+
+	pthread_mutex_lock(&metrics_mutex);
+	fr_dlist_remove(&metrics_threads, mt);
+
+	if (!metrics_retired_ctx) metrics_retired_ctx = talloc_new(NULL);
+
+	for (entry = atomic_load_explicit(&mt->head, memory_order_acquire); entry; entry = next) {
+		next = entry->next;
+
+		talloc_steal(metrics_retired_ctx, entry);
+		entry->key = NULL;
+		entry->next = metrics_retired;
+		metrics_retired = entry;
+	}
+	pthread_mutex_unlock(&metrics_mutex);
+
+	talloc_free(mt);
+	metrics_thread = NULL;
+
+	return 0;
+}
+
+/** Free the retired entries at exit
+ *
+ */
+static int _metrics_retired_free(UNUSED void *uctx)
+{
+	pthread_mutex_lock(&metrics_mutex);
+	TALLOC_FREE(metrics_retired_ctx);
+	metrics_retired = NULL;
+	pthread_mutex_unlock(&metrics_mutex);
+
+	return 0;
+}
+
+static int cmd_stats_metrics(FILE *fp, UNUSED FILE *fp_err, UNUSED void *ctx, UNUSED fr_cmd_info_t const *info)
+{
+	return fr_metrics_print(fp);
+}
+
+static fr_cmd_table_t cmd_metrics_table[] = {
+	{
+		.parent = "stats",
+		.name = "metrics",
+		.func = cmd_stats_metrics,
+		.help = "Show latency metrics for virtual servers, sections, modules and trunks.",
+		.read_only = true
+	},
+
+	CMD_TABLE_END
+};
+
+/** Enable metrics collection
+ *
+ * Called by anything which wants to read the metrics, so that we
+ * don't spend time collecting them if nothing is going to read them.
+ * Must be called before any threads are started.
+ */
+void fr_metrics_enable(void)
+{
+	if (fr_metrics_enabled) return;
+
+	fr_atexit_global(_metrics_retired_free, NULL);
+	fr_metrics_enabled = true;
+
+	if (fr_command_register_hook(NULL, NULL, NULL, cmd_metrics_table) < 0) {
+		PWARN("Failed registering radmin commands for metrics");
+	}
+}
+
+/** Find or create the metrics entry for something in this thread
+ *
+ * The returned entry remains valid for the lifetime of the calling thread,
+ * and should be cached by the caller where possible.
+ *
+ * @param[in] type	of entry.
+ * @param[in] key	uniquely identifying the thing being measured,
+ *			e.g. a module instance, or a CONF_SECTION.
+ * @param[in] name	First label for the entry.
+ * @param[in] sub	Second label for the entry.  May be NULL.
+ * @return
+ *	- The entry.
+ *	- NULL on error.
+ */
+fr_metrics_entry_t *fr_metrics_entry(fr_metrics_type_t type, void const *key, char const *name, char const *sub)
+{
+	fr_metrics_thread_t	*mt = metrics_thread;
+	fr_metrics_entry_t	*entry, find = { .type = type, .key = key };
+
+	if (unlikely(!mt)) {
+		mt = talloc_zero(NULL, fr_metrics_thread_t);
+		if (!mt) return NULL;
+
+		mt->ht = fr_hash_table_alloc(mt, metrics_entry_hash, metrics_entry_cmp, NULL);
+		if (!mt->ht) {
+			talloc_free(mt);
+			return NULL;
+		}
+		atomic_init(&mt->head, NULL);
+
+		pthread_mutex_lock(&metrics_mutex);
+		if (!metrics_threads_init) {
+			fr_dlist_init(&metrics_threads, fr_metrics_thread_t, entry);
+			metrics_threads_init = true;
+		}
+		fr_dlist_insert_tail(&metrics_threads, mt);
+		pthread_mutex_unlock(&metrics_mutex);
+
+		fr_atexit_thread_local(metrics_thread, _metrics_thread_free, mt);
+	}
+
+	entry = fr_hash_table_find(mt->ht, &find);
+	if (entry) return entry;
+
+	MEM(entry = talloc_zero(mt, fr_metrics_entry_t));
+	entry->type = type;
+	entry->key = key;
+	entry->name = talloc_strdup(entry, name);
+	if (sub) entry->sub = talloc_strdup(entry, sub);
+	atomic_init(&entry->failed, 0);
+	fr_histogram_init(&entry->latency);
+
+	if (!fr_hash_table_insert(mt->ht, entry)) {
+		talloc_free(entry);
+		return NULL;
+	}
+
+	/*
+	 *	Entry must be fully initialised before readers
+	 *	can see it.
+	 */
+	entry->next = atomic_load_explicit(&mt->head, memory_order_relaxed);
+	atomic_store_explicit(&mt->head, entry, memory_order_release);
+
+	return entry;
+}
+
+static void metrics_merge_list(fr_rb_tree_t *tree, TALLOC_CTX *ctx, fr_metrics_entry_t *entry)
+{
+	for (; entry; entry = entry->next) {
+		fr_metrics_merged_t	*merged, find = { .type = entry->type, .name = entry->name, .sub = entry->sub };
+
+		merged = fr_rb_find(tree, &find);
+		if (!merged) {
+			MEM(merged = talloc_zero(ctx, fr_metrics_merged_t));
+			merged->type = entry->type;
+			merged->name = entry->name;
+			merged->sub = entry->sub;
+			fr_histogram_init(&merged->latency);
+			fr_rb_insert(tree, merged);
+		}
+
+		merged->failed += atomic_load_explicit(&entry->failed, memory_order_relaxed);
+		fr_histogram_merge(&merged->latency, &entry->latency);
+	}
+}
+
+/** Print a label value, escaped as per the OpenMetrics spec
+ *
+ */
+static void metrics_label_print(FILE *fp, char const *label, char const *value)
+{
+	char const *p;
+
+	fprintf(fp, "%s=\"", label);
+	for (p = value; *p; p++) {
+		switch (*p) {
+		case '\\':
+			fputs("\\\\", fp);
+			break;
+
+		case '"':
+			fputs("\\\"", fp);
+			break;
+
+		case '\n':
+			fputs("\\n", fp);
+			break;
+
+		default:
+			fputc(*p, fp);
+			break;
+		}
+	}
+	fputc('"', fp);
+}
+
+static void metrics_labels_print(FILE *fp, fr_metrics_merged_t const *merged, char const *quantile)
+{
+	fputc('{', fp);
+	metrics_label_print(fp, metrics_type[merged->type].name_label, merged->name);
+	if (merged->sub && metrics_type[merged->type].sub_label) {
+		fputc(',', fp);
+		metrics_label_print(fp, metrics_type[merged->type].sub_label, merged->sub);
+	}
+	if (quantile) fprintf(fp, ",quantile=\"%s\"", quantile);
+	fputc('}', fp);
+}
+
+/** Merge the metrics from all threads, and print them in OpenMetrics text format
+ *
+ * Latencies are exported as summaries, with quantiles computed from the
+ * merged histograms.  Failures are exported as counters.
+ *
+ * @param[in] fp	to print to.
+ * @return
+ *	- 0 on success.
+ *	- -1 on error.
+ */
+int fr_metrics_print(FILE *fp)
+{
+	static struct {
+		char const	*label;
+		double		percentile;
+	} const quantiles[] = {
+		{ "0.5",	50 },
+		{ "0.9",	90 },
+		{ "0.99",	99 },
+		{ "0.999",	99.9 },
+	};
+
+	TALLOC_CTX		*ctx;
+	fr_rb_tree_t		*tree;
+	fr_metrics_type_t	type;
+	size_t			i;
+
+	ctx = talloc_new(NULL);
+	if (!ctx) return -1;
+
+	tree = fr_rb_inline_alloc(ctx, fr_metrics_merged_t, node, metrics_merged_cmp, NULL);
+	if (!tree) {
+		talloc_free(ctx);
+		return -1;
+	}
+
+	/*
+	 *	The labels of the merged entries point into the
+	 *	per-thread entries, so we hold the mutex until
+	 *	we're done printing.
+	 */
+	pthread_mutex_lock(&metrics_mutex);
+	if (metrics_threads_init) {
+		fr_dlist_foreach(&metrics_threads, fr_metrics_thread_t, mt) {
+			metrics_merge_list(tree, ctx, atomic_load_explicit(&mt->head, memory_order_acquire));
+		}
+	}
+	metrics_merge_list(tree, ctx, metrics_retired);
+
+	for (type = 0; type < FR_METRICS_MAX; type++) {
+		char const *family = metrics_type[type].family;
+
+		fprintf(fp, "# TYPE %s_latency_seconds summary\n", family);
+		fprintf(fp, "# UNIT %s_latency_seconds seconds\n", family);
+		fprintf(fp, "# HELP %s_latency_seconds %s\n", family, metrics_type[type].help);
+
+		fr_rb_inorder_foreach(tree, fr_metrics_merged_t, m) {
+			if (m->type != type) continue;
+
+			for (i = 0; i < NUM_ELEMENTS(quantiles); i++) {
+				fprintf(fp, "%s_latency_seconds", family);
+				metrics_labels_print(fp, m, quantiles[i].label);
+				fprintf(fp, " %.9f\n",
+					(double) fr_histogram_percentile(&m->latency, quantiles[i].percentile) / NSEC);
+			}
+
+			fprintf(fp, "%s_latency_seconds_count", family);
+			metrics_labels_print(fp, m, NULL);
+			fprintf(fp, " %" PRIu64 "\n", fr_histogram_count(&m->latency));
+
+			fprintf(fp, "%s_latency_seconds_sum", family);
+			metrics_labels_print(fp, m, NULL);
+			fprintf(fp, " %.9f\n", (double) fr_histogram_sum(&m->latency) / NSEC);
+		}
+		endforeach
+
+		fprintf(fp, "# TYPE %s_failures counter\n", family);
+		fprintf(fp, "# HELP %s_failures Calls which failed, timed out, or were cancelled.\n", family);
+
+		fr_rb_inorder_foreach(tree, fr_metrics_merged_t, m) {
+			if (m->type != type) continue;
+
+			fprintf(fp, "%s_failures_total", family);
+			metrics_labels_print(fp, m, NULL);
+			fprintf(fp, " %" PRIu64 "\n", m->failed);
+		}
+		endforeach
+	}
+	pthread_mutex_unlock(&metrics_mutex);
+
+	fprintf(fp, "# EOF\n");
+
+	talloc_free(ctx);
+
+	return 0;
+}
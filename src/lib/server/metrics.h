@@ -0,0 +1,112 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file lib/server/metrics.h
+ * @brief Per-thread latency metrics, merged and exported on demand.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(metrics_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/util/histogram.h>
+#include <freeradius-devel/util/time.h>
+
+#include <stdio.h>
+
+/** What a set of metrics is keyed by
+ *
+ */
+typedef enum {
+	FR_METRICS_VIRTUAL_SERVER = 0,			//!< Request latency, by virtual server.
+	FR_METRICS_SECTION,				//!< Processing section latency, e.g. "recv Access-Request".
+	FR_METRICS_MODULE,				//!< Module call latency, by module instance and method.
+	FR_METRICS_TRUNK,				//!< Trunk request latency, by trunk.
+	FR_METRICS_OFFLOAD,				//!< Blocking call latency, by offload pool.
+	FR_METRICS_MAX
+} fr_metrics_type_t;
+
+typedef struct fr_metrics_entry_s fr_metrics_entry_t;
+
+/** Counters and latency histogram for one thing we measure, in one thread
+ *
+ * Entries are only ever written by the thread which created them.  Other
+ * threads may read them at any time.
+ */
+struct fr_metrics_entry_s {
+	fr_metrics_type_t	type;			//!< What kind of entry this is.
+	void const		*key;			//!< Identifies the thing being measured.
+	char const		*name;			//!< First label, e.g. server or module name.
+	char const		*sub;			//!< Second label, e.g. section name.  May be NULL.
+
+	atomic_uint_fast64_t	failed;			//!< Calls which failed, timed out, or were cancelled.
+	fr_histogram_t		latency;		//!< Latency of calls, in nanoseconds.
+
+	fr_metrics_entry_t	*next;			//!< Next entry published by this thread.
+};
+
+extern bool fr_metrics_enabled;
+
+/** Whether we're collecting metrics
+ *
+ * Metrics are only collected if something will read them, i.e. if a
+ * metrics listener is configured.  Callers should check this before
+ * doing any work, so that metrics cost nothing when they're disabled.
+ */
+static inline bool fr_metrics_active(void)
+{
+	return fr_metrics_enabled;
+}
+
+/** Record the latency of a single call
+ *
+ * @param[in] entry	to record the latency in.
+ * @param[in] latency	of the call.
+ */
+static inline void fr_metrics_record(fr_metrics_entry_t *entry, fr_time_delta_t latency)
+{
+	int64_t ns = fr_time_delta_unwrap(latency);
+
+	fr_histogram_record(&entry->latency, (ns > 0) ? (uint64_t) ns : 0);
+}
+
+/** Record a call as failed
+ *
+ * @param[in] entry	to record the failure in.
+ */
+static inline void fr_metrics_failed(fr_metrics_entry_t *entry)
+{
+	atomic_store_explicit(&entry->failed, atomic_load_explicit(&entry->failed, memory_order_relaxed) + 1,
+			      memory_order_relaxed);
+}
+
+void			fr_metrics_enable(void);
+
+fr_metrics_entry_t	*fr_metrics_entry(fr_metrics_type_t type, void const *key,
+					  char const *name, char const *sub) CC_HINT(nonnull(2,3));
+
+int			fr_metrics_print(FILE *fp) CC_HINT(nonnull);
+
+#ifdef __cplusplus
+}
+#endif
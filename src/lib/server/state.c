@@ -52,10 +52,12 @@ RCSID("$Id$")
 
 #include <freeradius-devel/io/listen.h>
 
+#include <freeradius-devel/util/btree.h>
 #include <freeradius-devel/util/debug.h>
 #include <freeradius-devel/util/dlist.h>
 #include <freeradius-devel/util/md5.h>
 #include <freeradius-devel/util/misc.h>
+#include <freeradius-devel/util/nbo.h>
 #include <freeradius-devel/util/rand.h>
 
 /** Holds a state value, and associated fr_pair_ts and data
@@ -63,7 +65,6 @@ RCSID("$Id$")
  */
 typedef struct {
 	uint64_t		id;				//!< State number within state heap.
-	fr_rb_node_t		node;				//!< Entry in the state rbtree.
 	union {
 		/** Server ID components
 		 *
@@ -148,7 +149,7 @@ struct fr_state_tree_s {
 								//!< timeout.
 	uint32_t		max_sessions;			//!< Maximum number of sessions we track.
 	uint32_t		used_sessions;			//!< How many sessions are currently in progress.
-	fr_rb_tree_t		*tree;				//!< rbtree used to lookup state value.
+	fr_btree_t		*tree;				//!< B-tree used to lookup state value.
 	fr_dlist_head_t		to_expire;			//!< Linked list of entries to free.
 
 	fr_time_delta_t		timeout;			//!< How long to wait before cleaning up state entries.
@@ -180,6 +181,16 @@ static int8_t state_entry_cmp(void const *one, void const *two)
 	return CMP(ret, 0);
 }
 
+/** Use the first eight bytes of the state value as the key, in the same order as memcmp
+ *
+ */
+static uint64_t state_entry_key(void const *one)
+{
+	fr_state_entry_t const *a = one;
+
+	return fr_nbo_to_uint64(a->state);
+}
+
 /** Free the state tree
  *
  */
@@ -198,7 +209,7 @@ static int _state_tree_free(fr_state_tree_t *state)
 	}
 
 	/*
-	 *	Free the rbtree
+	 *	Free the tree
 	 */
 	talloc_free(state->tree);
 
@@ -249,11 +260,11 @@ fr_state_tree_t *fr_state_tree_init(TALLOC_CTX *ctx, fr_dict_attr_t const *da, b
 
 	/*
 	 *	We need to do controlled freeing of the
-	 *	rbtree, so that all the state entries
+	 *	tree, so that all the state entries
 	 *	are freed before it's destroyed.  Hence
 	 *	it being parented from the NULL ctx.
 	 */
-	state->tree = fr_rb_inline_talloc_alloc(NULL, fr_state_entry_t, node, state_entry_cmp, NULL);
+	state->tree = fr_btree_keyed_talloc_alloc(NULL, fr_state_entry_t, state_entry_cmp, state_entry_key, NULL);
 	if (!state->tree) {
 		talloc_free(state);
 		return NULL;
@@ -280,7 +291,7 @@ void state_entry_unlink(fr_state_tree_t *state, fr_state_entry_t *entry)
 	(void) talloc_get_type_abort(entry, fr_state_entry_t);
 
 	fr_dlist_remove(&state->to_expire, entry);
-	fr_rb_delete(state->tree, entry);
+	fr_btree_delete(state->tree, entry);
 
 	DEBUG4("State ID %" PRIu64 " unlinked", entry->id);
 }
@@ -345,11 +356,11 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *r
 	fr_dlist_head_t		to_free;
 
 	/*
-	 *	Shouldn't be in any lists if it's being reused
+	 *	Shouldn't be in any lists if it's being reused.
+	 *	Entries are always in both the tree and the
+	 *	expiry list, or neither.
 	 */
-	fr_assert(!old ||
-		  (!fr_dlist_entry_in_list(&old->expire_entry) &&
-		   !fr_rb_node_inline_in_tree(&old->node)));
+	fr_assert(!old || !fr_dlist_entry_in_list(&old->expire_entry));
 
 	fr_dlist_init(&to_free, fr_state_entry_t, free_entry);
 
@@ -541,7 +552,7 @@ static fr_state_entry_t *state_entry_create(fr_state_tree_t *state, request_t *r
 	 */
 	*((uint32_t *)(&entry->state_comp.context_id)) ^= state->context_id;
 
-	if (!fr_rb_insert(state->tree, entry)) {
+	if (!fr_btree_insert(state->tree, entry)) {
 		RERROR("Failed inserting state entry - Insertion into state tree failed");
 		fr_pair_delete_by_da(reply_list, state->da);
 		talloc_free(entry);
@@ -591,7 +602,7 @@ static fr_state_entry_t *state_entry_find_and_unlink(fr_state_tree_t *state, fr_
 	 */
 	my_entry.state_comp.context_id ^= state->context_id;
 
-	entry = fr_rb_remove(state->tree, &my_entry);
+	entry = fr_btree_remove(state->tree, &my_entry);
 	if (entry) {
 		(void) talloc_get_type_abort(entry, fr_state_entry_t);
 		fr_dlist_remove(&state->to_expire, entry);
@@ -940,5 +951,5 @@ uint64_t fr_state_entries_timeout(fr_state_tree_t *state)
  */
 uint64_t fr_state_entries_tracked(fr_state_tree_t *state)
 {
-	return fr_rb_num_elements(state->tree);
+	return fr_btree_num_elements(state->tree);
 }
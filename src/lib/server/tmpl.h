@@ -477,6 +477,20 @@ typedef struct {
  */
 FR_DLIST_FUNCS(tmpl_request_list, tmpl_request_t, entry)
 
+/** How the pairs referenced by an attribute tmpl should be found
+ *
+ * Worked out whenever the attribute references change, so that evaluating
+ * the tmpl doesn't have to re-examine them.
+ */
+typedef enum {
+	TMPL_ATTR_PLAN_CURSOR = 0,			//!< Use a #tmpl_dcursor_ctx_t.  Always correct.
+	TMPL_ATTR_PLAN_FIRST,				//!< Only the first instance at every level,
+							///< so there is at most one match.
+	TMPL_ATTR_PLAN_FIRST_IN_LIST			//!< As above, but the reference is to an
+							///< attribute directly inside a pair list,
+							///< e.g. `&request.User-Name`.
+} tmpl_attr_plan_t;
+
 /** How many additional headers to allocate in a pool for a tmpl_t
  *
  */
@@ -554,6 +568,7 @@ struct tmpl_s {
 								///< with a '&'.
 			FR_DLIST_HEAD(tmpl_request_list)	rr;	//!< Request to search or insert in.
 			FR_DLIST_HEAD(tmpl_attr_list)		ar;	//!< Head of the attribute reference list.
+			tmpl_attr_plan_t			plan;	//!< How to find the referenced pairs.
 		} attribute;
 
 		/*
@@ -656,6 +671,18 @@ static inline FR_DLIST_HEAD(tmpl_request_list) const *tmpl_request(tmpl_t const
 	return &vpt->data.attribute.rr;
 }
 
+/** How the pairs referenced by a tmpl should be found
+ *
+ * @hidecallergraph
+ */
+static inline tmpl_attr_plan_t tmpl_attr_plan(tmpl_t const *vpt)
+{
+	tmpl_assert_type(tmpl_is_attr(vpt) ||
+			 tmpl_is_attr_unresolved(vpt));
+
+	return vpt->data.attribute.plan;
+}
+
 /** The number of request references contained within a tmpl
  *
  */
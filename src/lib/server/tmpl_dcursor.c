@@ -278,6 +278,19 @@ static int tmpl_dcursor_remove(UNUSED fr_dlist_head_t *list, void *to_remove, vo
 }
 #endif
 
+/** Record that no pairs matched the tmpl
+ *
+ */
+static void tmpl_dcursor_not_found(int *err, tmpl_t const *vpt)
+{
+	*err = -1;
+	if (tmpl_is_list(vpt)) {
+		fr_strerror_printf("List \"%s\" is empty", vpt->name);
+	} else {
+		fr_strerror_printf("No matching \"%s\" pairs found", tmpl_attr_tail_da(vpt)->name);
+	}
+}
+
 /** Initialise a #fr_dcursor_t at the specified point in a pair tree
  *
  * This makes iterating over the one or more #fr_pair_t specified by a #tmpl_t
@@ -350,14 +363,7 @@ fr_pair_t *tmpl_dcursor_init_relative(int *err, TALLOC_CTX *ctx, tmpl_dcursor_ct
 	vp = fr_dcursor_iter_mod_init(cursor, fr_pair_list_to_dlist(cc->list), _tmpl_cursor_next, NULL, cc, tmpl_dcursor_insert, tmpl_dcursor_remove, cc);
 #endif
 	if (!vp) {
-		if (err) {
-			*err = -1;
-			if (tmpl_is_list(vpt)) {
-				fr_strerror_printf("List \"%s\" is empty", vpt->name);
-			} else {
-				fr_strerror_printf("No matching \"%s\" pairs found", tmpl_attr_tail_da(vpt)->name);
-			}
-		}
+		if (err) tmpl_dcursor_not_found(err, vpt);
 		return NULL;
 	}
 
@@ -413,6 +419,104 @@ fr_pair_t *_tmpl_dcursor_init(int *err, TALLOC_CTX *ctx, tmpl_dcursor_ctx_t *cc,
 	return tmpl_dcursor_init_relative(err, ctx, cc, cursor, request, list, vpt, build, uctx);
 }
 
+/** Find the first child of a structural pair which matches a da
+ *
+ */
+static inline CC_HINT(always_inline) fr_pair_t *tmpl_dcursor_child_first(fr_pair_t const *parent,
+									 fr_dict_attr_t const *da)
+{
+	fr_pair_t *child = NULL;
+
+	while ((child = fr_pair_list_next(&parent->vp_group, child))) {
+		if (fr_dict_attr_cmp(da, child->da) == 0) break;
+	}
+
+	return child;
+}
+
+/** Return the first #fr_pair_t specified by a #tmpl_t
+ *
+ * Most attribute references, e.g. `&User-Name` or `&reply.Foo.Bar`,
+ * are to the first instance of an attribute at every level.  Those
+ * have at most one match, so we walk straight down the pair tree
+ * instead of setting up, and tearing down, a cursor.
+ *
+ * Which of those applies is worked out when the tmpl is created,
+ * see #tmpl_attr_plan_t.  Any other reference falls back to
+ * #tmpl_dcursor_init.
+ *
+ * @param[out] err		May be NULL if no error code is required.
+ *				Will be set to:
+ *				- 0 on success.
+ *				- -1 if no matching #fr_pair_t could be found.
+ *				- -3 if context could not be found (no parent #request_t available).
+ * @param[in] request		The current #request_t.
+ * @param[in] vpt		specifying the #fr_pair_t to find.
+ * @return
+ *	- First #fr_pair_t specified by the #tmpl_t.
+ *	- NULL if no matching #fr_pair_t found, and NULL on error.
+ */
+fr_pair_t *tmpl_dcursor_first(int *err, request_t *request, tmpl_t const *vpt)
+{
+	tmpl_attr_t const	*ar = NULL;
+	fr_pair_t		*vp;
+
+	TMPL_VERIFY(vpt);
+	fr_assert(tmpl_is_attr(vpt));
+
+	switch (tmpl_attr_plan(vpt)) {
+	case TMPL_ATTR_PLAN_CURSOR:
+	{
+		fr_dcursor_t		cursor;
+		tmpl_dcursor_ctx_t	cc;
+
+		vp = tmpl_dcursor_init(err, NULL, &cc, &cursor, request, vpt);
+		tmpl_dcursor_clear(&cc);
+
+		return vp;
+	}
+
+	case TMPL_ATTR_PLAN_FIRST_IN_LIST:
+		if (err) *err = 0;
+
+		if (tmpl_request_ptr(&request, tmpl_request(vpt)) < 0) {
+			if (err) *err = -3;
+			return NULL;
+		}
+
+		/*
+		 *	The list, then the attribute in it.
+		 */
+		vp = tmpl_dcursor_child_first(request->pair_root,
+					      tmpl_attr_list_head(tmpl_attr(vpt))->ar_da);
+		if (vp) vp = tmpl_dcursor_child_first(vp, tmpl_attr_list_tail(tmpl_attr(vpt))->ar_da);
+		if (!vp && err) tmpl_dcursor_not_found(err, vpt);
+
+		return vp;
+
+	case TMPL_ATTR_PLAN_FIRST:
+		break;
+	}
+
+	if (err) *err = 0;
+
+	if (tmpl_request_ptr(&request, tmpl_request(vpt)) < 0) {
+		if (err) *err = -3;
+		return NULL;
+	}
+	vp = request->pair_root;
+
+	while ((ar = tmpl_attr_list_next(tmpl_attr(vpt), ar))) {
+		vp = tmpl_dcursor_child_first(vp, ar->ar_da);
+		if (!vp) {
+			if (err) tmpl_dcursor_not_found(err, vpt);
+			return NULL;
+		}
+	}
+
+	return vp;
+}
+
 /** Clear any temporary state allocations
  *
  */
@@ -185,6 +185,43 @@ int _tmpl_setup_and_cursor_build_init(fr_pair_t **vp_out, tmpl_dcursor_vars_t *v
 #define tmpl_setup_and_cursor_build_init(_vp_out, _ref) \
 	if (_tmpl_setup_and_cursor_build_init(_vp_out, &vars, request, _ref)) return
 
+/** Initialise a tmpl using the _attr_str string, and find the first pair without a cursor
+ *
+ * @param[out] vp_out		where to write the returned pair.
+ * @param[in,out] vars		test variables
+ * @param[in] request		the current request.
+ * @param[in] ref		Attribute reference string.
+ */
+static inline CC_HINT(always_inline)
+int _tmpl_setup_and_first(fr_pair_t **vp_out, tmpl_dcursor_vars_t *vars, request_t *request, char const *ref)
+{
+	tmpl_afrom_attr_substr(autofree, NULL, &vars->vpt, &FR_SBUFF_IN(ref, strlen(ref)), NULL, &(tmpl_rules_t){
+			.attr = {
+				.dict_def = test_dict,
+				.list_def = request_attr_request,
+			}});
+	TEST_CHECK(vars->vpt!= NULL);
+	TEST_MSG("Failed creating tmpl from %s: %s", ref, fr_strerror());
+	if (!vars->vpt) {
+		*vp_out = NULL;
+		return -1;
+	}
+
+	*vp_out = tmpl_dcursor_first(&vars->err, request, vars->vpt);
+	return 0;
+}
+
+#define tmpl_setup_and_first(_vp_out, _ref) \
+	if (_tmpl_setup_and_first(_vp_out, &vars, request, _ref)) return
+
+/*
+ *	How "first" tests end
+ */
+#define first_test_end \
+	debug_attr_list(&request->request_pairs, 0); \
+	TEST_CHECK_RET(talloc_free(vars.vpt), 0); \
+	TEST_CHECK_RET(talloc_free(request), 0)
+
 /*
  *	How every test ends
  */
@@ -801,6 +838,108 @@ static void test_level_3_build_invalid2(void)
 	test_end;
 }
 
+/*
+ *	Two instances of attribute at the top level - find the first without a cursor
+ */
+static void test_first_level_1(void)
+{
+	common_vars;
+	pair_defs(1);
+	pair_defs(2);
+
+	pair_populate(1);
+	pair_populate(2);
+	tmpl_setup_and_first(test_vp_p(), "&Test-Int32-0");
+	TEST_CHECK_PAIR(test_vp(), int32_vp1);
+	TEST_CHECK_RET(vars.err, 0);
+	TEST_CHECK_RET(tmpl_attr_plan(vars.vpt), TMPL_ATTR_PLAN_FIRST_IN_LIST);
+
+	first_test_end;
+}
+
+/*
+ *	Two instances of three level TLV - find the first leaf without a cursor
+ */
+static void test_first_level_3(void)
+{
+	common_vars;
+	pair_defs(1);
+	pair_defs(2);
+
+	pair_populate(1);
+	pair_populate(2);
+	tmpl_setup_and_first(test_vp_p(), "&Test-Nested-Top-TLV-0.Child-TLV[0].Leaf-Int32");
+	TEST_CHECK_PAIR(test_vp(), leaf_int32_vp1);
+	TEST_CHECK_RET(vars.err, 0);
+	TEST_CHECK_RET(tmpl_attr_plan(vars.vpt), TMPL_ATTR_PLAN_FIRST);
+
+	first_test_end;
+}
+
+/*
+ *	Group attribute without the requested child - find the first without a cursor
+ */
+static void test_first_missing(void)
+{
+	common_vars;
+	pair_defs(1);
+
+	pair_populate(1);
+	tmpl_setup_and_first(test_vp_p(), "&Test-Group-0.Test-Int32-0");
+	TEST_CHECK_PAIR(test_vp(), NULL);
+	TEST_CHECK_RET(vars.err, -1);
+	TEST_CHECK_RET(tmpl_attr_plan(vars.vpt), TMPL_ATTR_PLAN_FIRST);
+
+	first_test_end;
+}
+
+/*
+ *	Two instances of attribute at the top level - choose second, which needs a cursor
+ */
+static void test_first_index(void)
+{
+	common_vars;
+	pair_defs(1);
+	pair_defs(2);
+
+	pair_populate(1);
+	pair_populate(2);
+	tmpl_setup_and_first(test_vp_p(), "&Test-Int32-0[1]");
+	TEST_CHECK_PAIR(test_vp(), int32_vp2);
+	TEST_CHECK_RET(vars.err, 0);
+	TEST_CHECK_RET(tmpl_attr_plan(vars.vpt), TMPL_ATTR_PLAN_CURSOR);
+
+	first_test_end;
+}
+
+/*
+ *	Changing the index after the tmpl was created changes how the pair is found
+ */
+static void test_first_plan_update(void)
+{
+	common_vars;
+	pair_defs(1);
+	pair_defs(2);
+
+	pair_populate(1);
+	pair_populate(2);
+	tmpl_setup_and_first(test_vp_p(), "&Test-Int32-0");
+	TEST_CHECK_PAIR(test_vp(), int32_vp1);
+	TEST_CHECK_RET(tmpl_attr_plan(vars.vpt), TMPL_ATTR_PLAN_FIRST_IN_LIST);
+
+	tmpl_attr_set_leaf_num(vars.vpt, 1);
+	TEST_CHECK_RET(tmpl_attr_plan(vars.vpt), TMPL_ATTR_PLAN_CURSOR);
+	TEST_CHECK_PAIR(tmpl_dcursor_first(&vars.err, request, vars.vpt), int32_vp2);
+	TEST_CHECK_RET(vars.err, 0);
+
+	tmpl_attr_set_leaf_num(vars.vpt, 0);
+	TEST_CHECK_RET(tmpl_attr_plan(vars.vpt), TMPL_ATTR_PLAN_FIRST_IN_LIST);
+	TEST_CHECK_PAIR(tmpl_dcursor_first(&vars.err, request, vars.vpt), int32_vp1);
+	TEST_CHECK_RET(vars.err, 0);
+
+	first_test_end;
+}
+
 TEST_LIST = {
 	{ "test_level_1_one",		test_level_1_one },
 	{ "test_level_1_one_second",	test_level_1_one_second },
@@ -839,6 +978,12 @@ TEST_LIST = {
 	{ "test_level_3_build_invalid1",	test_level_3_build_invalid1 },
 	{ "test_level_3_build_invalid2",	test_level_3_build_invalid2 },
 
+	{ "test_first_level_1",			test_first_level_1 },
+	{ "test_first_level_3",			test_first_level_3 },
+	{ "test_first_missing",			test_first_missing },
+	{ "test_first_index",			test_first_index },
+	{ "test_first_plan_update",		test_first_plan_update },
+
 	{ NULL }
 };
 
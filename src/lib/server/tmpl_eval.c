@@ -886,15 +886,12 @@ done:
  */
 int tmpl_find_vp(fr_pair_t **out, request_t *request, tmpl_t const *vpt)
 {
-	fr_dcursor_t		cursor;
-	tmpl_dcursor_ctx_t	cc;
 	fr_pair_t		*vp;
 	int			err;
 
 	TMPL_VERIFY(vpt);
 
-	vp = tmpl_dcursor_init(&err, request, &cc, &cursor, request, vpt);
-	tmpl_dcursor_clear(&cc);
+	vp = tmpl_dcursor_first(&err, request, vpt);
 
 	if (out) *out = vp;
 
@@ -915,8 +912,6 @@ int tmpl_find_vp(fr_pair_t **out, request_t *request, tmpl_t const *vpt)
  */
 int tmpl_find_or_add_vp(fr_pair_t **out, request_t *request, tmpl_t const *vpt)
 {
-	fr_dcursor_t		cursor;
-	tmpl_dcursor_ctx_t	cc;
 	fr_pair_t		*vp;
 	int			err;
 
@@ -925,8 +920,7 @@ int tmpl_find_or_add_vp(fr_pair_t **out, request_t *request, tmpl_t const *vpt)
 
 	*out = NULL;
 
-	vp = tmpl_dcursor_init(&err, NULL, &cc, &cursor, request, vpt);
-	tmpl_dcursor_clear(&cc);
+	vp = tmpl_dcursor_first(&err, request, vpt);
 
 	switch (err) {
 	case 0:
@@ -1077,8 +1071,21 @@ int tmpl_eval_pair(TALLOC_CTX *ctx, fr_value_box_list_t *out, request_t *request
 	 *
 	 *	This allows users to manipulate virtual attributes as if
 	 *	they were real ones.
+	 *
+	 *	Only counts and [*] need a cursor, everything else
+	 *	refers to a single pair.
 	 */
-	vp = tmpl_dcursor_init(NULL, NULL, &cc, &cursor, request, vpt);
+	switch (tmpl_attr_tail_num(vpt)) {
+	case NUM_COUNT:
+	case NUM_ALL:
+		vp = tmpl_dcursor_init(NULL, NULL, &cc, &cursor, request, vpt);
+		break;
+
+	default:
+		cc.pool = NULL;		/* so tmpl_dcursor_clear() is a noop */
+		vp = tmpl_dcursor_first(NULL, request, vpt);
+		break;
+	}
 
 	/*
 	 *	We didn't find the VP in a list, check to see if it's
@@ -984,6 +984,38 @@ static tmpl_attr_t *tmpl_attr_add(tmpl_t *vpt, tmpl_attr_type_t type)
 	return ar;
 }
 
+/** Work out how the pairs referenced by an attribute tmpl should be found
+ *
+ * A reference with no indexes other than [0], no conditions, and only
+ * known attributes can have at most one match.  Those can be found by
+ * walking straight down the pair tree, without a cursor.
+ */
+static tmpl_attr_plan_t tmpl_attr_plan_compute(tmpl_t const *vpt)
+{
+	tmpl_attr_t const *ar = NULL;
+
+	if (tmpl_attr_list_num_elements(tmpl_attr(vpt)) == 0) return TMPL_ATTR_PLAN_CURSOR;
+
+	while ((ar = tmpl_attr_list_next(tmpl_attr(vpt), ar))) {
+		if (!ar_is_normal(ar) || ar_is_raw(ar) || ar_filter_is_cond(ar)) return TMPL_ATTR_PLAN_CURSOR;
+		if ((ar->ar_num != NUM_UNSPEC) && (ar->ar_num != 0)) return TMPL_ATTR_PLAN_CURSOR;
+	}
+
+	if ((tmpl_attr_list_num_elements(tmpl_attr(vpt)) == 2) &&
+	    tmpl_attr_is_list_attr(tmpl_attr_list_head(tmpl_attr(vpt)))) return TMPL_ATTR_PLAN_FIRST_IN_LIST;
+
+	return TMPL_ATTR_PLAN_FIRST;
+}
+
+/** Record how the pairs referenced by an attribute tmpl should be found
+ *
+ * Must be called whenever the attribute references are changed.
+ */
+static inline CC_HINT(always_inline) void tmpl_attr_plan_set(tmpl_t *vpt)
+{
+	vpt->data.attribute.plan = tmpl_attr_plan_compute(vpt);
+}
+
 /** Create a #tmpl_t from a #fr_value_box_t
  *
  * @param[in,out] ctx	to allocate #tmpl_t in.
@@ -1068,6 +1100,7 @@ int tmpl_attr_copy(tmpl_t *dst, tmpl_t const *src)
 	tmpl_request_list_talloc_reverse_free(&dst->data.attribute.rr);
 	tmpl_request_ref_list_copy(dst, &dst->data.attribute.rr, &src->data.attribute.rr);
 
+	tmpl_attr_plan_set(dst);
 	TMPL_ATTR_VERIFY(dst);
 
 	return 0;
@@ -1101,6 +1134,7 @@ int tmpl_attr_set_da(tmpl_t *vpt, fr_dict_attr_t const *da)
 	}
 	ref->ar_parent = fr_dict_root(fr_dict_by_da(da));	/* Parent is the root of the dictionary */
 
+	tmpl_attr_plan_set(vpt);
 	TMPL_ATTR_VERIFY(vpt);
 
 	return 0;
@@ -1156,6 +1190,7 @@ int tmpl_attr_set_leaf_da(tmpl_t *vpt, fr_dict_attr_t const *da)
 	 */
 	ref->ar_parent = fr_dict_root(fr_dict_by_da(da));	/* Parent is the root of the dictionary */
 
+	tmpl_attr_plan_set(vpt);
 	TMPL_ATTR_VERIFY(vpt);
 
 	return 0;
@@ -1175,6 +1210,7 @@ void tmpl_attr_set_leaf_num(tmpl_t *vpt, int16_t num)
 
 	ar->ar_num = num;
 
+	tmpl_attr_plan_set(vpt);
 	TMPL_ATTR_VERIFY(vpt);
 }
 
@@ -1192,6 +1228,7 @@ void tmpl_attr_rewrite_leaf_num(tmpl_t *vpt, int16_t from, int16_t to)
 	ref = tmpl_attr_list_tail(tmpl_attr(vpt));
 	if (ref->ar_num == from) ref->ar_num = to;
 
+	tmpl_attr_plan_set(vpt);
 	TMPL_ATTR_VERIFY(vpt);
 }
 
@@ -1206,6 +1243,7 @@ void tmpl_attr_rewrite_num(tmpl_t *vpt, int16_t from, int16_t to)
 
 	while ((ref = tmpl_attr_list_next(tmpl_attr(vpt), ref))) if (ref->ar_num == from) ref->ar_num = to;
 
+	tmpl_attr_plan_set(vpt);
 	TMPL_ATTR_VERIFY(vpt);
 }
 
@@ -1231,6 +1269,7 @@ void tmpl_attr_set_list(tmpl_t *vpt, fr_dict_attr_t const *list)
 	tmpl_attr_t *ref = tmpl_attr_list_head(tmpl_attr(vpt));
 	if (tmpl_attr_is_list_attr(ref)) ref->da = list;
 
+	tmpl_attr_plan_set(vpt);
 	TMPL_ATTR_VERIFY(vpt);
 }
 
@@ -2333,6 +2372,7 @@ ssize_t tmpl_afrom_attr_substr(TALLOC_CTX *ctx, tmpl_attr_error_t *err,
 		goto error;
 	}
 
+	tmpl_attr_plan_set(vpt);
 	TMPL_VERIFY(vpt);	/* Because we want to ensure we produced something sane */
 
 	*out = vpt;
@@ -3964,6 +4004,7 @@ static inline CC_HINT(always_inline) int tmpl_attr_resolve(tmpl_t *vpt, tmpl_res
 	}
 
 	RESOLVED_SET(&vpt->type);
+	tmpl_attr_plan_set(vpt);
 	TMPL_VERIFY(vpt);
 
 	return 0;
@@ -4250,6 +4291,7 @@ static void attr_to_raw(tmpl_t *vpt, tmpl_attr_t *ref)
 		break;
 	}
 
+	tmpl_attr_plan_set(vpt);
 	TMPL_ATTR_VERIFY(vpt);
 }
 
@@ -4348,6 +4390,8 @@ int tmpl_attr_unknown_add(tmpl_t *vpt)
 		}
 	}
 
+	tmpl_attr_plan_set(vpt);
+
 	return 0;
 }
 
@@ -4940,6 +4984,15 @@ void tmpl_attr_verify(char const *file, int line, tmpl_t const *vpt)
 			break;
 		}
 	}
+
+	/*
+	 *	A stale plan may find the wrong pair.  The
+	 *	cursor is always correct, so that's allowed.
+	 */
+	fr_fatal_assert_msg((vpt->data.attribute.plan == TMPL_ATTR_PLAN_CURSOR) ||
+			    (vpt->data.attribute.plan == tmpl_attr_plan_compute(vpt)),
+			    "CONSISTENCY CHECK FAILED %s[%u]: attr ref plan %u is stale, should be %u",
+			    file, line, vpt->data.attribute.plan, tmpl_attr_plan_compute(vpt));
 }
 
 /** Verify fields of a tmpl_t make sense
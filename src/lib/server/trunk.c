@@ -37,6 +37,7 @@ typedef struct fr_trunk_s fr_trunk_t;
 #include <freeradius-devel/server/trunk.h>
 
 #include <freeradius-devel/server/connection.h>
+#include <freeradius-devel/server/metrics.h>
 #include <freeradius-devel/server/trigger.h>
 #include <freeradius-devel/util/misc.h>
 #include <freeradius-devel/util/syserror.h>
@@ -110,6 +111,9 @@ struct fr_trunk_request_s {
 
 	fr_time_t		last_freed;		//!< Last time this request was freed.
 
+	fr_time_t		enqueued;		//!< When the request was enqueued.  Only set
+							///< if metrics are enabled.
+
 	bool			bound_to_conn;		//!< Fail the request if there's an attempt to
 							///< re-enqueue it.
 
@@ -193,6 +197,8 @@ struct fr_trunk_s {
 
 	char const		*log_prefix;		//!< What to prepend to messages.
 
+	fr_metrics_entry_t	*metrics;		//!< Request latency for this trunk.
+
 	fr_event_list_t		*el;			//!< Event list used by this trunk and the connection.
 
 	fr_trunk_conf_t		conf;			//!< Trunk common configuration.
@@ -1271,6 +1277,29 @@ static void trunk_request_enter_sent(fr_trunk_request_t *treq)
 	trunk_connection_event_update(tconn);
 }
 
+/** Record how long a request spent in the trunk
+ *
+ * @param[in] treq	which has completed, failed, or been cancelled.
+ * @param[in] failed	whether the request failed.
+ */
+static inline CC_HINT(always_inline) void trunk_request_metrics(fr_trunk_request_t *treq, bool failed)
+{
+	fr_trunk_t *trunk = treq->pub.trunk;
+
+	if (likely(!fr_time_ispos(treq->enqueued))) return;
+
+	if (unlikely(!trunk->metrics)) {
+		trunk->metrics = fr_metrics_entry(FR_METRICS_TRUNK, trunk,
+						  trunk->log_prefix ? trunk->log_prefix : "trunk", NULL);
+		if (!trunk->metrics) return;
+	}
+
+	fr_metrics_record(trunk->metrics, fr_time_sub(fr_time(), treq->enqueued));
+	if (failed) fr_metrics_failed(trunk->metrics);
+
+	treq->enqueued = fr_time_wrap(0);
+}
+
 /** Transition a request to the cancel state, placing it in a connection's cancellation list
  *
  * If a request_cancel_send callback is provided, that callback will
@@ -1322,6 +1351,8 @@ static void trunk_request_enter_cancel(fr_trunk_request_t *treq, fr_trunk_cancel
 	fr_dlist_insert_tail(&tconn->cancel, treq);
 	treq->cancel_reason = reason;
 
+	if (reason == FR_TRUNK_CANCEL_REASON_SIGNAL) trunk_request_metrics(treq, true);
+
 	DO_REQUEST_CANCEL(treq, reason);
 
 	/*
@@ -1474,6 +1505,7 @@ static void trunk_request_enter_complete(fr_trunk_request_t *treq)
 	}
 
 	REQUEST_STATE_TRANSITION(FR_TRUNK_REQUEST_STATE_COMPLETE);
+	trunk_request_metrics(treq, false);
 	DO_REQUEST_COMPLETE(treq);
 	fr_trunk_request_free(&treq);	/* Free the request */
 }
@@ -1505,6 +1537,7 @@ static void trunk_request_enter_failed(fr_trunk_request_t *treq)
 	}
 
 	REQUEST_STATE_TRANSITION(FR_TRUNK_REQUEST_STATE_FAILED);
+	trunk_request_metrics(treq, true);
 	DO_REQUEST_FAIL(treq, prev);
 	fr_trunk_request_free(&treq);	/* Free the request */
 }
@@ -2509,6 +2542,7 @@ fr_trunk_enqueue_t fr_trunk_request_enqueue(fr_trunk_request_t **treq_out, fr_tr
 		}
 		treq->pub.preq = preq;
 		treq->pub.rctx = rctx;
+		if (fr_metrics_active()) treq->enqueued = fr_time();
 		if (trunk->conf.always_writable) {
 			fr_connection_signals_pause(tconn->pub.conn);
 			trunk_request_enter_pending(treq, tconn, true);
@@ -2527,6 +2561,7 @@ fr_trunk_enqueue_t fr_trunk_request_enqueue(fr_trunk_request_t **treq_out, fr_tr
 		}
 		treq->pub.preq = preq;
 		treq->pub.rctx = rctx;
+		if (fr_metrics_active()) treq->enqueued = fr_time();
 		trunk_request_enter_backlog(treq, true);
 		break;
 
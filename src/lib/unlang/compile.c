@@ -53,6 +53,22 @@ RCSID("$Id$")
 
 static unsigned int unlang_number = 1;
 
+/*
+ *	Whether sections are laid out contiguously, in the order
+ *	their instructions are executed.
+ */
+static bool unlang_flatten = false;
+
+/*
+ *	How much of the section's pool to reserve for each
+ *	configuration item when flattening.  Most instructions need
+ *	a lot less than this, but conditions and edits hold
+ *	compiled xlats and maps.  Anything which doesn't fit is
+ *	allocated as normal.
+ */
+#define UNLANG_FLATTEN_ITEM_HEADERS	(8)
+#define UNLANG_FLATTEN_ITEM_LEN		(512)
+
 /*
  *	For simplicity, this is just array[unlang_number].  Once we
  *	call unlang_thread_instantiate(), the "unlang_number" above MUST
@@ -689,6 +705,28 @@ int unlang_fixup_update(map_t *map, void *ctx)
 }
 
 
+/** Count the configuration items which may be compiled into instructions
+ *
+ */
+static unsigned int compile_count_items(CONF_SECTION *cs)
+{
+	CONF_ITEM	*ci = NULL;
+	unsigned int	count = 1;
+
+	while ((ci = cf_item_next(cs, ci))) {
+		if (cf_item_is_data(ci)) continue;
+
+		if (cf_item_is_section(ci)) {
+			count += compile_count_items(cf_item_to_section(ci));
+			continue;
+		}
+
+		count++;
+	}
+
+	return count;
+}
+
 static unlang_group_t *group_allocate(unlang_t *parent, CONF_SECTION *cs, unlang_ext_t const *ext)
 {
 	unlang_group_t	*g;
@@ -698,11 +736,32 @@ static unlang_group_t *group_allocate(unlang_t *parent, CONF_SECTION *cs, unlang
 	ctx = parent;
 	if (!ctx) ctx = cs;
 
+	/*
+	 *	When flattening, the top level group holds a pool big
+	 *	enough for the whole section.  Nested groups are
+	 *	carved out of it as they're compiled, which is the
+	 *	order they're executed in, so following "next" and
+	 *	"children" mostly walks forwards through one block of
+	 *	memory.
+	 */
+	if (unlang_flatten) {
+		if (!parent) {
+			unsigned int items = compile_count_items(cs);
+
+			g = (unlang_group_t *)_talloc_zero_pooled_object(ctx, ext->len, ext->type_name,
+									 ext->pool_headers + (items * UNLANG_FLATTEN_ITEM_HEADERS),
+									 ext->pool_len + (items * UNLANG_FLATTEN_ITEM_LEN));
+		} else {
+			g = (unlang_group_t *)_talloc_zero(ctx, ext->len, ext->type_name);
+		}
+
 	/*
 	 *	All the groups have a common header
 	 */
-	g = (unlang_group_t *)_talloc_zero_pooled_object(ctx, ext->len, ext->type_name,
-							 ext->pool_headers, ext->pool_len);
+	} else {
+		g = (unlang_group_t *)_talloc_zero_pooled_object(ctx, ext->len, ext->type_name,
+								 ext->pool_headers, ext->pool_len);
+	}
 	if (!g) return NULL;
 
 	g->children = NULL;
@@ -2407,6 +2466,23 @@ static unlang_t *compile_children(unlang_group_t *g, unlang_compile_t *unlang_ct
 		}
 	}
 
+	/*
+	 *	Resolve where a taken "if" or "elsif" continues from,
+	 *	so that the interpreter doesn't have to walk over the
+	 *	rest of the "elsif" / "else" chain at run time.
+	 */
+	for (single = g->children; single; single = single->next) {
+		unlang_t *skip;
+
+		if ((single->type != UNLANG_TYPE_IF) && (single->type != UNLANG_TYPE_ELSIF)) continue;
+
+		for (skip = single->next;
+		     skip && ((skip->type == UNLANG_TYPE_ELSIF) || (skip->type == UNLANG_TYPE_ELSE));
+		     skip = skip->next);
+
+		unlang_group_to_cond(unlang_generic_to_group(single))->skip = skip;
+	}
+
 	/*
 	 *	Set the default actions, if they haven't already been
 	 *	set by an "actions" section above.
@@ -3783,6 +3859,17 @@ static unlang_t *compile_load_balance_subsection(unlang_t *parent, unlang_compil
 		if (strcmp(cf_section_name1(cf_item_to_section(cf_parent(cs))), "modules") == 0) name2 = NULL;
 	}
 
+	/*
+	 *	"adaptive" chooses children by their latency and
+	 *	load, instead of by a key.
+	 */
+	if (name2 && (cf_section_name2_quote(cs) == T_BARE_WORD) && (strcmp(name2, "adaptive") == 0)) {
+		gext = unlang_group_to_load_balance(g);
+		gext->adaptive = true;
+		unlang_load_balance_adaptive_register();
+		name2 = NULL;
+	}
+
 	if (name2) {
 		fr_token_t type;
 		ssize_t slen;
@@ -4554,6 +4641,14 @@ static unlang_t *compile_module(unlang_t *parent, unlang_compile_t *unlang_ctx,
 	MEM(single = talloc_zero(parent, unlang_module_t));
 	single->instance = inst;
 	single->method = method;
+	if (!unlang_ctx->section_name1 || (unlang_ctx->section_name1 == CF_IDENT_ANY)) {
+		single->method_name = "*";
+	} else if (!unlang_ctx->section_name2 || (unlang_ctx->section_name2 == CF_IDENT_ANY)) {
+		single->method_name = talloc_typed_strdup(single, unlang_ctx->section_name1);
+	} else {
+		single->method_name = talloc_typed_asprintf(single, "%s %s",
+							    unlang_ctx->section_name1, unlang_ctx->section_name2);
+	}
 	c = unlang_module_to_generic(single);
 	c->parent = parent;
 	c->next = NULL;
@@ -4667,6 +4762,13 @@ static unlang_t *compile_item(unlang_t *parent, unlang_compile_t *unlang_ctx, CO
 			if (!c) return NULL;
 			if (c == UNLANG_IGNORE) return UNLANG_IGNORE;
 
+			/*
+			 *	Virtual modules such as "load-balance foo { ... }"
+			 *	are compiled by a nested call to compile_item(),
+			 *	which has already numbered them.
+			 */
+			if (c->number) return c;
+
 			c->number = unlang_number++;
 
 			/*
@@ -4952,6 +5054,18 @@ void unlang_compile_init(TALLOC_CTX *ctx)
 	unlang_instruction_tree = fr_rb_alloc(ctx, instruction_cmp, NULL);
 }
 
+/** Lay out compiled sections contiguously
+ *
+ * Must be called before any sections are compiled.
+ *
+ * @param[in] flatten	Whether each compiled section should be allocated
+ *			from a single pool, in execution order.
+ */
+void unlang_compile_flatten(bool flatten)
+{
+	unlang_flatten = flatten;
+}
+
 
 /** Create thread-specific data structures for unlang
  *
@@ -5012,7 +5126,7 @@ void *unlang_thread_instance(unlang_t const *instruction)
 }
 
 #ifdef WITH_PERF
-void unlang_frame_perf_init(unlang_stack_frame_t *frame)
+void _unlang_frame_perf_init(unlang_stack_t *stack, unlang_stack_frame_t *frame)
 {
 	unlang_thread_t *t;
 	fr_time_t now;
@@ -5029,10 +5143,13 @@ void unlang_frame_perf_init(unlang_stack_frame_t *frame)
 	now = fr_time();
 
 	fr_time_tracking_start(NULL, &frame->tracking, now);
-	fr_time_tracking_yield(&frame->tracking, fr_time());
+	fr_time_tracking_yield(&frame->tracking, now);
+
+	frame->profile = NULL;
+	if (stack->trace) unlang_profile_frame_start(stack, frame);
 }
 
-void unlang_frame_perf_yield(unlang_stack_frame_t *frame)
+void _unlang_frame_perf_yield(unlang_stack_frame_t *frame)
 {
 	unlang_t const *instruction = frame->instruction;
 	unlang_thread_t *t;
@@ -5046,7 +5163,7 @@ void unlang_frame_perf_yield(unlang_stack_frame_t *frame)
 	fr_time_tracking_yield(&frame->tracking, fr_time());
 }
 
-void unlang_frame_perf_resume(unlang_stack_frame_t *frame)
+void _unlang_frame_perf_resume(unlang_stack_frame_t *frame)
 {
 	unlang_t const *instruction = frame->instruction;
 	unlang_thread_t *t;
@@ -5062,7 +5179,7 @@ void unlang_frame_perf_resume(unlang_stack_frame_t *frame)
 	fr_time_tracking_resume(&frame->tracking, fr_time());
 }
 
-void unlang_frame_perf_cleanup(unlang_stack_frame_t *frame)
+void _unlang_frame_perf_cleanup(unlang_stack_frame_t *frame)
 {
 	unlang_t const *instruction = frame->instruction;
 	unlang_thread_t *t;
@@ -5071,6 +5188,11 @@ void unlang_frame_perf_cleanup(unlang_stack_frame_t *frame)
 
 	fr_assert(instruction->number <= unlang_number);
 
+	/*
+	 *	Already cleaned up, e.g. by "catch".
+	 */
+	if (frame->tracking.state == FR_TIME_TRACKING_STOPPED) return;
+
 	t = &unlang_thread_array[instruction->number];
 
 	if (frame->tracking.state == FR_TIME_TRACKING_YIELDED) {
@@ -5083,6 +5205,8 @@ void unlang_frame_perf_cleanup(unlang_stack_frame_t *frame)
 	fr_time_tracking_end(NULL, &frame->tracking, fr_time());
 	t->tracking.running_total = fr_time_delta_add(t->tracking.running_total, frame->tracking.running_total);
 	t->tracking.waiting_total = fr_time_delta_add(t->tracking.waiting_total, frame->tracking.waiting_total);
+
+	if ((instruction->type == UNLANG_TYPE_MODULE) || frame->profile) unlang_profile_frame_end(t, frame);
 }
 
 
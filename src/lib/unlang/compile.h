@@ -40,6 +40,8 @@ typedef struct {
 
 void		unlang_compile_init(TALLOC_CTX *ctx);
 
+void		unlang_compile_flatten(bool flatten);
+
 int		unlang_compile(CONF_SECTION *cs, rlm_components_t component, tmpl_rules_t const *rules, void **instruction);
 
 bool		unlang_compile_is_keyword(const char *name);
@@ -34,6 +34,30 @@ typedef struct {
 								///< of the execution.
 } unlang_frame_state_cond_t;
 
+/** Skip over the else / elsif blocks, as this "if" condition was taken
+ *
+ * The compiler resolves where the chain ends, so we don't need to
+ * walk it here.
+ */
+static unlang_action_t unlang_if_taken(rlm_rcode_t *p_result, request_t *request, unlang_stack_frame_t *frame)
+{
+	unlang_cond_t	*gext = unlang_group_to_cond(unlang_generic_to_group(frame->instruction));
+
+	/*
+	 *	If we weren't going to run the next sibling, we still
+	 *	don't.
+	 */
+	if (frame->next) {
+		fr_assert(frame->next == frame->instruction->next);
+		frame->next = gext->skip;
+	}
+
+	/*
+	 *	We took the "if".  Go recurse into its' children.
+	 */
+	return unlang_group(p_result, request, frame);
+}
+
 static unlang_action_t unlang_if_resume(rlm_rcode_t *p_result, request_t *request, unlang_stack_frame_t *frame)
 {
 	unlang_frame_state_cond_t	*state = talloc_get_type_abort(frame->state, unlang_frame_state_cond_t);
@@ -55,20 +79,7 @@ static unlang_action_t unlang_if_resume(rlm_rcode_t *p_result, request_t *reques
 		return UNLANG_ACTION_EXECUTE_NEXT;
 	}
 
-	/*
-	 *	Tell the main interpreter to skip over the else /
-	 *	elsif blocks, as this "if" condition was taken.
-	 */
-	while (frame->next &&
-	       ((frame->next->type == UNLANG_TYPE_ELSE) ||
-		(frame->next->type == UNLANG_TYPE_ELSIF))) {
-		frame->next = frame->next->next;
-	}
-
-	/*
-	 *	We took the "if".  Go recurse into its' children.
-	 */
-	return unlang_group(p_result, request, frame);
+	return unlang_if_taken(p_result, request, frame);
 }
 
 static unlang_action_t unlang_if(rlm_rcode_t *p_result, request_t *request, unlang_stack_frame_t *frame)
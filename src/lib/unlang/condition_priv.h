@@ -33,6 +33,7 @@ typedef struct {
 	xlat_exp_head_t	*head;
 	bool		is_truthy;
 	bool		value;
+	unlang_t const	*skip;		//!< First instruction after the "elsif" / "else" chain.
 } unlang_cond_t;
 
 /** Cast a group structure to the cond keyword extension
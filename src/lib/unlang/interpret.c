@@ -183,6 +183,13 @@ int unlang_interpret_push(request_t *request, unlang_t const *instruction,
 
 	stack->depth++;
 
+#ifdef WITH_PERF
+	/*
+	 *	The request is starting, decide whether we trace it.
+	 */
+	if (unlikely(unlang_profile_enabled) && (stack->depth == 1)) unlang_profile_request_start(request, stack);
+#endif
+
 	/*
 	 *	Initialize the next stack frame.
 	 */
@@ -948,7 +955,12 @@ CC_HINT(hot) rlm_rcode_t unlang_interpret(request_t *request)
 	 *	This usually means the request is complete in its
 	 *	entirety.
 	 */
-	if (stack->depth == 0) unlang_interpret_request_done(request);
+	if (stack->depth == 0) {
+#ifdef WITH_PERF
+		if (stack->trace) unlang_profile_request_done(request, stack);
+#endif
+		unlang_interpret_request_done(request);
+	}
 
 	return rcode;
 }
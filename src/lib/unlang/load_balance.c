@@ -20,21 +20,243 @@
  * @file unlang/load_balance.c
  * @brief Implementation of the unlang "load-balance" keyword.
  *
+ * "adaptive" sections choose a child using the "power of two
+ * choices".  Two children are picked at random, and the one with the
+ * lowest cost is used.  The cost is the smoothed latency of the child,
+ * multiplied by the number of requests it has outstanding.
+ *
+ * A child which has failed is avoided for a short time.  After that
+ * its weight is ramped up slowly, so that a recovering child isn't
+ * immediately sent its full share of requests.
+ *
+ * The stats are kept per thread, using the thread-specific instance
+ * data of the instruction.  Only the owning thread ever writes to
+ * them, and radmin reads them with relaxed loads.
+ *
  * @copyright 2006-2019 The FreeRADIUS server project
  */
+#include <freeradius-devel/server/command.h>
+#include <freeradius-devel/util/dlist.h>
 #include <freeradius-devel/util/hash.h>
 #include <freeradius-devel/util/rand.h>
 
 #include "load_balance_priv.h"
 #include "module_priv.h"
 
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
 #define unlang_redundant_load_balance unlang_load_balance
 
+#define LOAD_BALANCE_EWMA_SHIFT		(3)				//!< New samples are weighted 1/8.
+#define LOAD_BALANCE_HOLDOFF		fr_time_delta_from_sec(1)	//!< Don't use a failed child for this long.
+#define LOAD_BALANCE_SLOW_START		fr_time_delta_from_sec(10)	//!< Then ramp its weight up over this long.
+#define LOAD_BALANCE_MIN_WEIGHT		(0.1)
+
+/** Stats for one child of an adaptive section, in one thread
+ *
+ */
+struct unlang_load_balance_child_s {
+	atomic_uint_fast64_t		ewma;		//!< Smoothed latency, in nanoseconds.
+	atomic_uint_fast64_t		active;		//!< Requests currently being run by the child.
+	atomic_uint_fast64_t		used;		//!< Number of times the child was chosen.
+	atomic_uint_fast64_t		failed;		//!< Number of times the child failed.
+	atomic_int_fast64_t		failed_at;	//!< When the child last failed.  0 if it never has.
+};
+
+/** Thread-specific data for a load-balance section
+ *
+ */
+typedef struct {
+	fr_dlist_t			entry;		//!< In the global list of adaptive sections.
+	unlang_t const			*instruction;	//!< The section.
+	unsigned int			thread_id;	//!< Which thread the stats are for.
+	int				num_children;
+	unlang_load_balance_child_t	*child;		//!< Array of stats, in the same order as the children.
+} unlang_thread_load_balance_t;
+
+static pthread_mutex_t		load_balance_mutex = PTHREAD_MUTEX_INITIALIZER;
+static fr_dlist_head_t		load_balance_threads;
+static bool			load_balance_threads_init = false;
+static unsigned int		load_balance_thread_count = 0;
+
+static _Thread_local unsigned int load_balance_thread_id = 0;
+
+static inline uint64_t load_balance_load(atomic_uint_fast64_t const *counter)
+{
+	return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static inline void load_balance_store(atomic_uint_fast64_t *counter, uint64_t value)
+{
+	atomic_store_explicit(counter, value, memory_order_relaxed);
+}
+
+/** Calculate the weight of a child
+ *
+ * @param[in] lbc	to calculate the weight of.
+ * @param[in] now	the current time.
+ * @return
+ *	- 0 if the child has just failed, and should not be used.
+ *	- LOAD_BALANCE_MIN_WEIGHT..1 while the child is recovering.
+ *	- 1 if the child is healthy.
+ */
+static double load_balance_weight(unlang_load_balance_child_t const *lbc, fr_time_t now)
+{
+	int64_t		failed_at = atomic_load_explicit(&lbc->failed_at, memory_order_relaxed);
+	fr_time_delta_t	since;
+
+	if (!failed_at) return 1.0;
+
+	since = fr_time_sub(now, fr_time_wrap(failed_at));
+	if (fr_time_delta_lt(since, LOAD_BALANCE_HOLDOFF)) return 0;
+
+	since = fr_time_delta_sub(since, LOAD_BALANCE_HOLDOFF);
+	if (fr_time_delta_gteq(since, LOAD_BALANCE_SLOW_START)) return 1.0;
+
+	return LOAD_BALANCE_MIN_WEIGHT + ((1.0 - LOAD_BALANCE_MIN_WEIGHT) *
+					  fr_time_delta_unwrap(since) / fr_time_delta_unwrap(LOAD_BALANCE_SLOW_START));
+}
+
+/** Calculate the cost of sending a request to a child
+ *
+ * Lower is better.  Children with no weight cost more than any other.
+ */
+static double load_balance_cost(unlang_load_balance_child_t const *lbc, fr_time_t now)
+{
+	double weight = load_balance_weight(lbc, now);
+
+	if (weight <= 0) return HUGE_VAL;
+
+	return (((double) load_balance_load(&lbc->ewma) + 1) *
+		((double) load_balance_load(&lbc->active) + 1)) / weight;
+}
+
+/** Choose a child using the "power of two choices"
+ *
+ * @param[in] t		thread-specific stats for the section.
+ * @return the index of the child to use.
+ */
+static int load_balance_adaptive_choose(unlang_thread_load_balance_t *t)
+{
+	fr_time_t	now = fr_time();
+	int		a, b, i;
+	double		cost_a, cost_b;
+
+	if (t->num_children == 1) return 0;
+
+	a = fr_rand() % t->num_children;
+	b = fr_rand() % (t->num_children - 1);
+	if (b >= a) b++;
+
+	cost_a = load_balance_cost(&t->child[a], now);
+	cost_b = load_balance_cost(&t->child[b], now);
+	if (cost_b < cost_a) {
+		a = b;
+		cost_a = cost_b;
+	}
+
+	if (cost_a < HUGE_VAL) return a;
+
+	/*
+	 *	Both choices have just failed.  Use the cheapest
+	 *	child which hasn't, or the original choice if
+	 *	they've all failed.
+	 */
+	for (i = 0; i < t->num_children; i++) {
+		cost_b = load_balance_cost(&t->child[i], now);
+		if (cost_b < cost_a) {
+			a = i;
+			cost_a = cost_b;
+		}
+	}
+
+	return a;
+}
+
+/** Record that a child of an adaptive section is being run
+ *
+ */
+static void load_balance_child_start(unlang_frame_state_redundant_t *redundant, unlang_thread_load_balance_t *t,
+				     unlang_group_t *g, unlang_t const *child)
+{
+	unlang_t const	*c;
+	int		i = 0;
+
+	for (c = g->children; c && (c != child); c = c->next) i++;
+	if (!c || (i >= t->num_children)) return;
+
+	redundant->stats = &t->child[i];
+	redundant->started = fr_time();
+
+	load_balance_store(&redundant->stats->used, load_balance_load(&redundant->stats->used) + 1);
+	load_balance_store(&redundant->stats->active, load_balance_load(&redundant->stats->active) + 1);
+}
+
+/** Update the stats of a child of an adaptive section which has finished
+ *
+ * @param[in] redundant	frame state of the section.
+ * @param[in] rcode	the child returned.
+ */
+static void load_balance_child_done(unlang_frame_state_redundant_t *redundant, rlm_rcode_t rcode)
+{
+	unlang_load_balance_child_t	*lbc = redundant->stats;
+	fr_time_t			now;
+	int64_t				sample, ewma;
+
+	if (!lbc) return;
+	redundant->stats = NULL;
+
+	now = fr_time();
+	sample = fr_time_delta_unwrap(fr_time_sub(now, redundant->started));
+	if (sample < 0) sample = 0;
+
+	ewma = (int64_t) load_balance_load(&lbc->ewma);
+	if (!ewma) {
+		ewma = sample;
+	} else {
+		ewma += (sample - ewma) / (1 << LOAD_BALANCE_EWMA_SHIFT);
+	}
+	load_balance_store(&lbc->ewma, (uint64_t) ewma);
+	load_balance_store(&lbc->active, load_balance_load(&lbc->active) - 1);
+
+	if (rcode == RLM_MODULE_FAIL) {
+		load_balance_store(&lbc->failed, load_balance_load(&lbc->failed) + 1);
+		atomic_store_explicit(&lbc->failed_at, fr_time_unwrap(now), memory_order_relaxed);
+	}
+}
+
+/** Stop tracking a child when the request is cancelled
+ *
+ */
+static void unlang_load_balance_signal(UNUSED request_t *request, unlang_stack_frame_t *frame, fr_signal_t action)
+{
+	unlang_frame_state_redundant_t	*redundant = talloc_get_type_abort(frame->state, unlang_frame_state_redundant_t);
+
+	if ((action != FR_SIGNAL_CANCEL) || !redundant->stats) return;
+
+	load_balance_store(&redundant->stats->active, load_balance_load(&redundant->stats->active) - 1);
+	redundant->stats = NULL;
+}
+
+static unlang_action_t unlang_load_balance_done(rlm_rcode_t *p_result, UNUSED request_t *request,
+						unlang_stack_frame_t *frame)
+{
+	unlang_frame_state_redundant_t	*redundant = talloc_get_type_abort(frame->state, unlang_frame_state_redundant_t);
+
+	load_balance_child_done(redundant, *p_result);
+
+	/* DON'T change p_result, as it is taken from the child */
+	return UNLANG_ACTION_CALCULATE_RESULT;
+}
+
 static unlang_action_t unlang_load_balance_next(rlm_rcode_t *p_result, request_t *request,
 						unlang_stack_frame_t *frame)
 {
 	unlang_frame_state_redundant_t	*redundant = talloc_get_type_abort(frame->state, unlang_frame_state_redundant_t);
 	unlang_group_t			*g = unlang_generic_to_group(frame->instruction);
+	unlang_thread_load_balance_t	*t = unlang_thread_instance(frame->instruction);
 
 #ifdef STATIC_ANALYZER
 	if (!redundant->found) {
@@ -49,6 +271,8 @@ static unlang_action_t unlang_load_balance_next(rlm_rcode_t *p_result, request_t
 		redundant->child = redundant->found;
 
 	} else {
+		load_balance_child_done(redundant, *p_result);
+
 		/*
 		 *	child is NULL on the first pass.  But if it's
 		 *	back to the found one, then we're done.
@@ -85,6 +309,7 @@ static unlang_action_t unlang_load_balance_next(rlm_rcode_t *p_result, request_t
 		*p_result = RLM_MODULE_FAIL;
 		return UNLANG_ACTION_STOP_PROCESSING;
 	}
+	if (t && t->child) load_balance_child_start(redundant, t, g, redundant->child);
 
 	/*
 	 *	Now that we've pushed this child, make the next call
@@ -109,6 +334,7 @@ static unlang_action_t unlang_load_balance(rlm_rcode_t *p_result, request_t *req
 	unlang_frame_state_redundant_t	*redundant;
 	unlang_group_t			*g = unlang_generic_to_group(frame->instruction);
 	unlang_load_balance_t		*gext = NULL;
+	unlang_thread_load_balance_t	*t = NULL;
 
 	uint32_t count = 0;
 
@@ -124,7 +350,17 @@ static unlang_action_t unlang_load_balance(rlm_rcode_t *p_result, request_t *req
 	redundant = talloc_get_type_abort(frame->state,
 					  unlang_frame_state_redundant_t);
 
-	if (gext && gext->vpt) {
+	if (gext && gext->adaptive) {
+		t = unlang_thread_instance(frame->instruction);
+		if (!t || !t->child) goto randomly_choose;
+
+		count = load_balance_adaptive_choose(t);
+
+		for (redundant->found = g->children; count > 0; count--) redundant->found = redundant->found->next;
+
+		RDEBUG3("load-balance chose %s", redundant->found->debug_name);
+
+	} else if (gext && gext->vpt) {
 		uint32_t hash, start;
 		ssize_t slen;
 		char const *p = NULL;
@@ -231,6 +467,15 @@ static unlang_action_t unlang_load_balance(rlm_rcode_t *p_result, request_t *req
 			*p_result = RLM_MODULE_FAIL;
 			return UNLANG_ACTION_STOP_PROCESSING;
 		}
+
+		/*
+		 *	Adaptive sections need to know when the child
+		 *	has finished.
+		 */
+		if (t && t->child) {
+			load_balance_child_start(redundant, t, g, redundant->found);
+			frame_repeat(frame, unlang_load_balance_done);
+		}
 		return UNLANG_ACTION_PUSHED_CHILD;
 	}
 
@@ -245,23 +490,151 @@ static unlang_action_t unlang_load_balance(rlm_rcode_t *p_result, request_t *req
 	return unlang_load_balance_next(p_result, request, frame);
 }
 
+/** Remove a thread's stats from the global list when the thread exits
+ *
+ */
+static int _load_balance_thread_free(unlang_thread_load_balance_t *t)
+{
+	pthread_mutex_lock(&load_balance_mutex);
+	fr_dlist_remove(&load_balance_threads, t);
+	pthread_mutex_unlock(&load_balance_mutex);
+
+	return 0;
+}
+
+/** Allocate the per-child stats for adaptive sections
+ *
+ */
+static int unlang_load_balance_thread_instantiate(unlang_t const *instruction, void *thread_inst)
+{
+	unlang_group_t			*g = unlang_generic_to_group(instruction);
+	unlang_load_balance_t		*gext = unlang_group_to_load_balance(g);
+	unlang_thread_load_balance_t	*t = talloc_get_type_abort(thread_inst, unlang_thread_load_balance_t);
+	int				i;
+
+	if (!gext->adaptive || !g->num_children) return 0;
+
+	t->instruction = instruction;
+	t->num_children = g->num_children;
+	MEM(t->child = talloc_zero_array(t, unlang_load_balance_child_t, t->num_children));
+
+	for (i = 0; i < t->num_children; i++) {
+		atomic_init(&t->child[i].ewma, 0);
+		atomic_init(&t->child[i].active, 0);
+		atomic_init(&t->child[i].used, 0);
+		atomic_init(&t->child[i].failed, 0);
+		atomic_init(&t->child[i].failed_at, 0);
+	}
+
+	pthread_mutex_lock(&load_balance_mutex);
+	if (!load_balance_threads_init) {
+		fr_dlist_init(&load_balance_threads, unlang_thread_load_balance_t, entry);
+		load_balance_threads_init = true;
+	}
+	if (!load_balance_thread_id) load_balance_thread_id = ++load_balance_thread_count;
+	t->thread_id = load_balance_thread_id;
+	fr_dlist_insert_tail(&load_balance_threads, t);
+	pthread_mutex_unlock(&load_balance_mutex);
+
+	talloc_set_destructor(t, _load_balance_thread_free);
+
+	return 0;
+}
+
+static int cmd_show_load_balance(FILE *fp, UNUSED FILE *fp_err, UNUSED void *ctx, UNUSED fr_cmd_info_t const *info)
+{
+	unlang_thread_load_balance_t	*t;
+	fr_time_t			now = fr_time();
+
+	pthread_mutex_lock(&load_balance_mutex);
+	if (!load_balance_threads_init) {
+		pthread_mutex_unlock(&load_balance_mutex);
+		return 0;
+	}
+
+	for (t = fr_dlist_head(&load_balance_threads);
+	     t != NULL;
+	     t = fr_dlist_next(&load_balance_threads, t)) {
+		unlang_group_t const	*g = unlang_generic_to_group(t->instruction);
+		unlang_t const		*child;
+		int			i;
+
+		fprintf(fp, "%s\tthread %u\n", t->instruction->debug_name, t->thread_id);
+
+		for (child = g->children, i = 0;
+		     child && (i < t->num_children);
+		     child = child->next, i++) {
+			unlang_load_balance_child_t const *lbc = &t->child[i];
+
+			fprintf(fp, "\t%s\tweight %.2f\tlatency %" PRIu64 "us\tactive %" PRIu64
+				"\tused %" PRIu64 "\tfailed %" PRIu64 "\n",
+				child->debug_name, load_balance_weight(lbc, now),
+				load_balance_load(&lbc->ewma) / 1000,
+				load_balance_load(&lbc->active),
+				load_balance_load(&lbc->used),
+				load_balance_load(&lbc->failed));
+		}
+	}
+	pthread_mutex_unlock(&load_balance_mutex);
+
+	return 0;
+}
+
+static fr_cmd_table_t cmd_load_balance_table[] = {
+	{
+		.parent = "show",
+		.name = "load-balance",
+		.func = cmd_show_load_balance,
+		.help = "Show the weight, latency and load of the children of adaptive load-balance sections.",
+		.read_only = true
+	},
+
+	CMD_TABLE_END
+};
+
+/** Register the radmin commands for adaptive load-balance sections
+ *
+ * Called when the first adaptive section is compiled.
+ */
+void unlang_load_balance_adaptive_register(void)
+{
+	static bool registered = false;
+
+	if (registered) return;
+	registered = true;
+
+	if (fr_command_register_hook(NULL, NULL, NULL, cmd_load_balance_table) < 0) {
+		PWARN("Failed registering radmin commands for load-balance");
+	}
+}
+
 void unlang_load_balance_init(void)
 {
 	unlang_register(UNLANG_TYPE_LOAD_BALANCE,
 			   &(unlang_op_t){
 				.name = "load-balance group",
 				.interpret = unlang_load_balance,
+				.signal = unlang_load_balance_signal,
 				.debug_braces = true,
 			        .frame_state_size = sizeof(unlang_frame_state_redundant_t),
 				.frame_state_type = "unlang_frame_state_redundant_t",
+
+				.thread_instantiate = unlang_load_balance_thread_instantiate,
+				.thread_inst_size = sizeof(unlang_thread_load_balance_t),
+				.thread_inst_type = "unlang_thread_load_balance_t",
 			   });
 
 	unlang_register(UNLANG_TYPE_REDUNDANT_LOAD_BALANCE,
 			   &(unlang_op_t){
 				.name = "redundant-load-balance group",
 				.interpret = unlang_redundant_load_balance,
+				.signal = unlang_load_balance_signal,
 				.debug_braces = true,
 			        .frame_state_size = sizeof(unlang_frame_state_redundant_t),
 				.frame_state_type = "unlang_frame_state_redundant_t",
+
+				.thread_instantiate = unlang_load_balance_thread_instantiate,
+				.thread_inst_size = sizeof(unlang_thread_load_balance_t),
+				.thread_inst_type = "unlang_thread_load_balance_t",
 			   });
 }
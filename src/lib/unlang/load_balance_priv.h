@@ -32,16 +32,24 @@ extern "C" {
 typedef struct {
 	unlang_group_t	group;
 	tmpl_t		*vpt;
+	bool		adaptive;		//!< Choose children by their latency and load.
 } unlang_load_balance_t;
 
+typedef struct unlang_load_balance_child_s unlang_load_balance_child_t;
+
 /** State of a redundant operation
  *
  */
 typedef struct {
-	unlang_t 		*child;
-	unlang_t		*found;
+	unlang_t 			*child;
+	unlang_t			*found;
+
+	unlang_load_balance_child_t	*stats;		//!< Adaptive stats of the child being run, if any.
+	fr_time_t			started;	//!< When the child was pushed.
 } unlang_frame_state_redundant_t;
 
+void	unlang_load_balance_adaptive_register(void);
+
 /** Cast a group structure to the load_balance keyword extension
  *
  */
@@ -26,6 +26,7 @@
 
 RCSID("$Id$")
 
+#include <freeradius-devel/server/metrics.h>
 #include <freeradius-devel/server/modpriv.h>
 #include <freeradius-devel/server/request_data.h>
 #include <freeradius-devel/server/rcode.h>
@@ -548,6 +549,15 @@ unlang_action_t unlang_module_yield_to_section(rlm_rcode_t *p_result,
 	 */
 	(void) unlang_module_yield(request, resume, signal, sigmask, rctx);
 
+	if (fr_metrics_active()) {
+		unlang_stack_t			*stack = request->stack;
+		unlang_frame_state_module_t	*state = talloc_get_type_abort(stack->frame[stack->depth].state,
+									       unlang_frame_state_module_t);
+
+		state->section = subcs;
+		state->section_started = fr_time();
+	}
+
 	if (unlang_interpret_push_section(request, subcs,
 					  default_rcode, UNLANG_SUB_FRAME) < 0) return UNLANG_ACTION_STOP_PROCESSING;
 
@@ -612,6 +622,62 @@ static inline CC_HINT(always_inline) void safe_unlock(module_instance_t *mi)
 	if ((mi->module->flags & MODULE_TYPE_THREAD_UNSAFE) != 0) pthread_mutex_unlock(&mi->mutex);
 }
 
+/** Record the latency of a module call
+ *
+ * Noop unless metrics were enabled when the module was called.
+ *
+ * Entries are keyed by call site, and labelled with the module and
+ * method name.  Call sites which share a module and method are merged
+ * when the metrics are read.
+ */
+static inline CC_HINT(always_inline) void unlang_module_metrics(unlang_frame_state_module_t *state,
+								 unlang_module_t const *mc, bool failed)
+{
+	fr_metrics_entry_t	*entry;
+
+	if (likely(!fr_time_ispos(state->started))) return;
+
+	entry = fr_metrics_entry(FR_METRICS_MODULE, mc, mc->instance->name,
+				 mc->method_name ? mc->method_name : "*");
+	if (!entry) return;
+
+	fr_metrics_record(entry, fr_time_sub(fr_time(), state->started));
+	if (failed) fr_metrics_failed(entry);
+
+	state->started = fr_time_wrap(0);
+}
+
+/** Record the latency of a section a module yielded to
+ *
+ */
+static void unlang_module_section_metrics(request_t *request, unlang_frame_state_module_t *state, rlm_rcode_t rcode)
+{
+	fr_metrics_entry_t	*entry;
+	CONF_SECTION		*server_cs;
+	char const		*name2;
+	char			buffer[256];
+
+	server_cs = cf_section_find_parent(state->section, "server", CF_IDENT_ANY);
+	name2 = cf_section_name2(state->section);
+
+	if (name2) {
+		snprintf(buffer, sizeof(buffer), "%s %s", cf_section_name1(state->section), name2);
+	} else {
+		strlcpy(buffer, cf_section_name1(state->section), sizeof(buffer));
+	}
+
+	entry = fr_metrics_entry(FR_METRICS_SECTION, state->section,
+				 server_cs ? cf_section_name2(server_cs) : request->name, buffer);
+	if (entry) {
+		fr_metrics_record(entry, fr_time_sub(fr_time(), state->section_started));
+		if ((rcode == RLM_MODULE_FAIL) || (request->master_state == REQUEST_STOP_PROCESSING)) {
+			fr_metrics_failed(entry);
+		}
+	}
+
+	state->section = NULL;
+}
+
 /** Send a signal (usually stop) to a request
  *
  * This is typically called via an "async" action, i.e. an action
@@ -649,6 +715,7 @@ static void unlang_module_signal(request_t *request, unlang_stack_frame_t *frame
 	if (action == FR_SIGNAL_CANCEL) {
 		state->thread->active_callers--;
 		state->signal = NULL;
+		unlang_module_metrics(state, mc, true);
 	}
 }
 
@@ -674,6 +741,8 @@ static unlang_action_t unlang_module_done(rlm_rcode_t *p_result, request_t *requ
 	*p_result = rcode;
 	request->module = state->previous_module;
 
+	unlang_module_metrics(state, unlang_generic_to_module(frame->instruction), (rcode == RLM_MODULE_FAIL));
+
 	return UNLANG_ACTION_CALCULATE_RESULT;
 }
 
@@ -711,6 +780,8 @@ static unlang_action_t unlang_module_resume(rlm_rcode_t *p_result, request_t *re
 	 */
 	state->rcode = *p_result < RLM_MODULE_NUMCODES ? *p_result : RLM_MODULE_NOOP;
 
+	if (state->section) unlang_module_section_metrics(request, state, state->rcode);
+
 	fr_assert(state->resume != NULL);
 
 	resume = state->resume;
@@ -950,7 +1021,8 @@ static unlang_action_t unlang_module(rlm_rcode_t *p_result, request_t *request,
 	 *	If we're doing retries, remember when we started
 	 *	running the module.
 	 */
-	if (fr_time_delta_ispos(frame->instruction->actions.retry.irt)) now = fr_time();
+	if (fr_time_delta_ispos(frame->instruction->actions.retry.irt) || fr_metrics_active()) now = fr_time();
+	if (fr_metrics_active()) state->started = now;
 
 	request->module = mc->instance->name;
 	safe_lock(mc->instance);	/* Noop unless instance->mutex set */
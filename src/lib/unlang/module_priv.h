@@ -36,6 +36,7 @@ typedef struct {
 	unlang_t			self;			//!< Common fields in all #unlang_t tree nodes.
 	module_instance_t		*instance;		//!< Global instance of the module we're calling.
 	module_method_t			method;			//!< The entry point into the module.
+	char const			*method_name;		//!< Name of the method, for profiling.
 	call_env_t const		*call_env;		//!< The per call parsed call environment.
 } unlang_module_t;
 
@@ -84,6 +85,16 @@ typedef struct {
 
 	/** @} */
 
+	/** @name Metrics
+	 * @{
+	 */
+	fr_time_t			started;	//!< When the module was called.  Only set
+							///< if metrics are enabled.
+	CONF_SECTION			*section;	//!< Section the module yielded to.
+	fr_time_t			section_started;	//!< When the section was pushed.
+
+	/** @} */
+
 } unlang_frame_state_module_t;
 
 static inline unlang_module_t *unlang_generic_to_module(unlang_t const *p)
@@ -0,0 +1,545 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file unlang/offload.c
+ * @brief Run blocking library calls in helper threads, without blocking the worker.
+ *
+ * Some libraries (PAM, Kerberos, libwbclient, ...) only have
+ * synchronous APIs.  Calling them from a worker blocks its event
+ * loop, and every other request the worker is processing, for as long
+ * as the backend takes to respond.
+ *
+ * Instead, a module submits the blocking call to an offload pool, and
+ * yields the request.  A helper thread from the pool runs the call,
+ * and hands the result back to the worker which submitted it.  The
+ * worker is woken up with a user event, and the request is resumed.
+ *
+ * Each pool has a fixed number of helper threads, and a bounded
+ * queue.  When the queue is full, calls fail immediately, rather than
+ * piling up behind a backend which has stopped responding.
+ *
+ * If the request is cancelled while the call is queued, the call is
+ * removed from the queue.  If the call is running, it can't be
+ * interrupted, so it's marked as cancelled, and the helper thread
+ * frees it when it completes.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/command.h>
+#include <freeradius-devel/server/metrics.h>
+#include <freeradius-devel/unlang/interpret.h>
+#include <freeradius-devel/unlang/module.h>
+#include <freeradius-devel/unlang/offload.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <pthread.h>
+#include <signal.h>
+
+typedef enum {
+	OFFLOAD_QUEUED = 0,				//!< Waiting for a helper thread.
+	OFFLOAD_RUNNING,				//!< Being run by a helper thread.
+	OFFLOAD_DONE,					//!< In the worker's list of completed calls.
+	OFFLOAD_DELIVERED				//!< The request has been marked runnable.
+} unlang_offload_state_t;
+
+typedef struct unlang_offload_thread_s unlang_offload_thread_t;
+
+/** A blocking call, and the request waiting for it
+ *
+ * Jobs aren't allocated in the request, as they may outlive it.
+ */
+typedef struct {
+	fr_dlist_t		entry;			//!< In the pool queue, or the worker's list of completed calls.
+
+	unlang_offload_pool_t	*pool;			//!< The call was submitted to.
+	unlang_offload_thread_t	*thread;		//!< The worker the result is returned to.
+	request_t		*request;		//!< Waiting for the result.
+
+	unlang_offload_func_t	func;			//!< Blocking call.
+	module_method_t		resume;			//!< Called in the worker, once the call has completed.
+	void			*uctx;			//!< Passed to func and resume.
+
+	unlang_offload_state_t	state;			//!< Protected by the pool mutex.
+	bool			cancelled;		//!< The request went away while the call was running.
+
+	fr_time_t		submitted;
+	fr_time_t		started;
+	fr_time_t		finished;
+} unlang_offload_job_t;
+
+/** Per-worker state for receiving completed calls
+ *
+ */
+struct unlang_offload_thread_s {
+	fr_event_list_t		*el;			//!< The worker's event list.
+	fr_event_user_t		*ev;			//!< Triggered when a call completes.
+
+	pthread_mutex_t		mutex;			//!< Protects the list of completed calls.
+	fr_dlist_head_t		done;			//!< Completed calls, waiting to be delivered.
+};
+
+struct unlang_offload_pool_s {
+	fr_dlist_t		entry;			//!< In the global list of pools.
+	char const		*name;			//!< Used in logging, and metrics.
+	unlang_offload_pool_config_t	config;
+
+	pthread_mutex_t		mutex;			//!< Protects everything below.
+	pthread_cond_t		cond;			//!< Signalled when a call is queued, or the pool is stopping.
+	fr_dlist_head_t		queue;			//!< Calls waiting for a helper thread.
+	bool			stopping;		//!< Helper threads should exit.
+
+	pthread_t		*threads;
+	uint32_t		num_threads;		//!< Which have been started.
+
+	uint32_t		running;		//!< Calls currently being run.
+	uint32_t		queued_max;		//!< High water mark of the queue.
+	uint64_t		submitted;		//!< Calls submitted to the pool.
+	uint64_t		completed;		//!< Calls which have been run.
+	uint64_t		rejected;		//!< Calls which failed because the queue was full.
+	uint64_t		cancelled;		//!< Calls whose request went away.
+	uint64_t		wait_ns;		//!< Total time calls spent in the queue.
+	uint64_t		run_ns;			//!< Total time calls spent running.
+};
+
+static pthread_mutex_t		offload_mutex = PTHREAD_MUTEX_INITIALIZER;
+static fr_dlist_head_t		offload_pools;
+static bool			offload_pools_init;
+
+static _Thread_local unlang_offload_thread_t *offload_thread;
+
+conf_parser_t const unlang_offload_pool_config[] = {
+	{ FR_CONF_OFFSET("threads", unlang_offload_pool_config_t, threads), .dflt = "4" },
+	{ FR_CONF_OFFSET("max_queued", unlang_offload_pool_config_t, max_queued), .dflt = "1024" },
+	CONF_PARSER_TERMINATOR
+};
+
+/** Pull calls from the queue, and run them
+ *
+ */
+static void *offload_thread_main(void *arg)
+{
+	unlang_offload_pool_t	*pool = talloc_get_type_abort(arg, unlang_offload_pool_t);
+	unlang_offload_job_t	*job;
+	unlang_offload_thread_t	*thread;
+	sigset_t		sigset;
+
+	/*
+	 *	Signals are handled by the main thread.
+	 */
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		while (!pool->stopping && (fr_dlist_num_elements(&pool->queue) == 0)) {
+			pthread_cond_wait(&pool->cond, &pool->mutex);
+		}
+		if (pool->stopping) break;
+
+		job = fr_dlist_pop_head(&pool->queue);
+		job->state = OFFLOAD_RUNNING;
+		job->started = fr_time();
+		pool->running++;
+		pthread_mutex_unlock(&pool->mutex);
+
+		job->func(job->uctx);
+
+		pthread_mutex_lock(&pool->mutex);
+		job->finished = fr_time();
+		pool->running--;
+		pool->completed++;
+		pool->wait_ns += fr_time_delta_unwrap(fr_time_sub(job->started, job->submitted));
+		pool->run_ns += fr_time_delta_unwrap(fr_time_sub(job->finished, job->started));
+
+		/*
+		 *	Nothing is waiting for the result.  The job
+		 *	was detached from the request when it was
+		 *	cancelled, so we're the only ones who can
+		 *	free it.
+		 */
+		if (job->cancelled) {
+			talloc_free(job);
+			continue;
+		}
+
+		/*
+		 *	Hand the result back to the worker.  The
+		 *	trigger is done with the worker's mutex held,
+		 *	so that the worker can't free the event out
+		 *	from under us.
+		 */
+		job->state = OFFLOAD_DONE;
+		thread = job->thread;
+
+		pthread_mutex_lock(&thread->mutex);
+		fr_dlist_insert_tail(&thread->done, job);
+		if (fr_event_user_trigger(thread->el, thread->ev) < 0) {
+			PERROR("%s - Failed waking worker", pool->name);
+		}
+		pthread_mutex_unlock(&thread->mutex);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+/** Deliver completed calls to the requests waiting for them
+ *
+ */
+static void offload_done(UNUSED fr_event_list_t *el, void *uctx)
+{
+	unlang_offload_thread_t	*thread = talloc_get_type_abort(uctx, unlang_offload_thread_t);
+	unlang_offload_job_t	*job;
+	fr_dlist_head_t		done;
+
+	fr_dlist_init(&done, unlang_offload_job_t, entry);
+
+	pthread_mutex_lock(&thread->mutex);
+	fr_dlist_move(&done, &thread->done);
+	pthread_mutex_unlock(&thread->mutex);
+
+	while ((job = fr_dlist_pop_head(&done))) {
+		/*
+		 *	The helper threads don't touch the job after
+		 *	it's been put into the done list, so we don't
+		 *	need the pool mutex here.
+		 */
+		job->state = OFFLOAD_DELIVERED;
+
+		if (fr_metrics_active()) {
+			fr_metrics_entry_t *entry;
+
+			entry = fr_metrics_entry(FR_METRICS_OFFLOAD, job->pool, job->pool->name, NULL);
+			if (entry) fr_metrics_record(entry, fr_time_sub(job->finished, job->submitted));
+		}
+
+		unlang_interpret_mark_runnable(job->request);
+	}
+}
+
+static int _offload_thread_free(unlang_offload_thread_t *thread)
+{
+	unlang_offload_job_t *job;
+
+	/*
+	 *	Wait for any helper thread which is in the middle of
+	 *	triggering the event.
+	 */
+	pthread_mutex_lock(&thread->mutex);
+	while ((job = fr_dlist_pop_head(&thread->done))) talloc_free(job);
+	pthread_mutex_unlock(&thread->mutex);
+
+	pthread_mutex_destroy(&thread->mutex);
+
+	if (offload_thread == thread) offload_thread = NULL;
+
+	return 0;
+}
+
+/** Return the state for receiving completed calls in this worker
+ *
+ */
+static unlang_offload_thread_t *offload_thread_get(fr_event_list_t *el)
+{
+	unlang_offload_thread_t *thread = offload_thread;
+
+	if (likely(thread && (thread->el == el))) return thread;
+
+	MEM(thread = talloc_zero(el, unlang_offload_thread_t));
+	thread->el = el;
+	pthread_mutex_init(&thread->mutex, NULL);
+	fr_dlist_init(&thread->done, unlang_offload_job_t, entry);
+	talloc_set_destructor(thread, _offload_thread_free);
+
+	if (fr_event_user_insert(thread, el, &thread->ev, false, offload_done, thread) < 0) {
+		talloc_free(thread);
+		return NULL;
+	}
+
+	offload_thread = thread;
+
+	return thread;
+}
+
+/** Stop delivering the result of a call to a request
+ *
+ */
+static void offload_signal(module_ctx_t const *mctx, request_t *request, UNUSED fr_signal_t action)
+{
+	unlang_offload_job_t	*job = talloc_get_type_abort(mctx->rctx, unlang_offload_job_t);
+	unlang_offload_pool_t	*pool = job->pool;
+
+	RDEBUG2("Cancelling call to %s", pool->name);
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->cancelled++;
+
+	switch (job->state) {
+	case OFFLOAD_QUEUED:
+		fr_dlist_remove(&pool->queue, job);
+		break;
+
+	/*
+	 *	We can't stop the call, so leave it to the helper
+	 *	thread to clean up.
+	 */
+	case OFFLOAD_RUNNING:
+		job->cancelled = true;
+		job->request = NULL;
+		pthread_mutex_unlock(&pool->mutex);
+		goto done;
+
+	case OFFLOAD_DONE:
+		pthread_mutex_lock(&job->thread->mutex);
+		fr_dlist_remove(&job->thread->done, job);
+		pthread_mutex_unlock(&job->thread->mutex);
+		break;
+
+	case OFFLOAD_DELIVERED:
+		break;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	talloc_free(job);
+
+done:
+	if (fr_metrics_active()) {
+		fr_metrics_entry_t *entry;
+
+		entry = fr_metrics_entry(FR_METRICS_OFFLOAD, pool, pool->name, NULL);
+		if (entry) fr_metrics_failed(entry);
+	}
+}
+
+/** Call the module's resume function, now that the blocking call has completed
+ *
+ */
+static unlang_action_t offload_resume(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	unlang_offload_job_t	*job = talloc_get_type_abort(mctx->rctx, unlang_offload_job_t);
+	module_method_t		resume = job->resume;
+	void			*uctx = job->uctx;
+
+	fr_assert(job->state == OFFLOAD_DELIVERED);
+
+	/*
+	 *	From here on, the module owns uctx.
+	 */
+	talloc_steal(request, uctx);
+	talloc_free(job);
+
+	return resume(p_result, MODULE_CTX(mctx->inst, mctx->thread, mctx->env_data, uctx), request);
+}
+
+/** Run a blocking call in a helper thread, and yield the request until it completes
+ *
+ * @param[out] p_result	set to RLM_MODULE_FAIL if the call couldn't be submitted.
+ * @param[in] request	the current request.
+ * @param[in] pool	to run the call in.
+ * @param[in] func	the blocking call.  See #unlang_offload_func_t for what it may,
+ *			and may not, do.
+ * @param[in] resume	called when func has completed, with mctx->rctx set to uctx.
+ * @param[in] uctx	talloced from a NULL ctx.  The pool takes ownership of uctx,
+ *			until resume is called.  After that, uctx is parented by the
+ *			request.  If the request is cancelled, uctx is freed.
+ * @return
+ *	- UNLANG_ACTION_YIELD if the call was submitted.
+ *	- UNLANG_ACTION_CALCULATE_RESULT if the queue was full.
+ */
+unlang_action_t unlang_offload_yield(rlm_rcode_t *p_result, request_t *request,
+				     unlang_offload_pool_t *pool, unlang_offload_func_t func,
+				     module_method_t resume, void *uctx)
+{
+	unlang_offload_thread_t	*thread;
+	unlang_offload_job_t	*job;
+
+	thread = offload_thread_get(unlang_interpret_event_list(request));
+	if (!thread) {
+		RPERROR("%s - Failed setting up offload", pool->name);
+		talloc_free(uctx);
+		RETURN_MODULE_FAIL;
+	}
+
+	MEM(job = talloc_zero(NULL, unlang_offload_job_t));
+	*job = (unlang_offload_job_t) {
+		.pool = pool,
+		.thread = thread,
+		.request = request,
+		.func = func,
+		.resume = resume,
+		.uctx = uctx,
+		.state = OFFLOAD_QUEUED,
+		.submitted = fr_time()
+	};
+	talloc_steal(job, uctx);
+
+	pthread_mutex_lock(&pool->mutex);
+	if (fr_dlist_num_elements(&pool->queue) >= pool->config.max_queued) {
+		pool->rejected++;
+		pthread_mutex_unlock(&pool->mutex);
+
+		REDEBUG("%s - Too many blocking calls waiting (%u), failing the request",
+			pool->name, pool->config.max_queued);
+		talloc_free(job);
+		RETURN_MODULE_FAIL;
+	}
+
+	fr_dlist_insert_tail(&pool->queue, job);
+	pool->submitted++;
+	if (fr_dlist_num_elements(&pool->queue) > pool->queued_max) pool->queued_max = fr_dlist_num_elements(&pool->queue);
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	return unlang_module_yield(request, offload_resume, offload_signal, ~FR_SIGNAL_CANCEL, job);
+}
+
+static int cmd_show_offload(FILE *fp, UNUSED FILE *fp_err, UNUSED void *ctx, UNUSED fr_cmd_info_t const *info)
+{
+	unlang_offload_pool_t *pool;
+
+	pthread_mutex_lock(&offload_mutex);
+	if (!offload_pools_init) {
+		pthread_mutex_unlock(&offload_mutex);
+		return 0;
+	}
+
+	for (pool = fr_dlist_head(&offload_pools);
+	     pool != NULL;
+	     pool = fr_dlist_next(&offload_pools, pool)) {
+		pthread_mutex_lock(&pool->mutex);
+		fprintf(fp, "%s\tthreads %u\trunning %u\tqueued %u\tmax queued %u\tsubmitted %" PRIu64
+			"\trejected %" PRIu64 "\tcancelled %" PRIu64 "\tavg wait %" PRIu64 "us\tavg run %" PRIu64 "us\n",
+			pool->name, pool->num_threads, pool->running, fr_dlist_num_elements(&pool->queue),
+			pool->queued_max, pool->submitted, pool->rejected, pool->cancelled,
+			pool->completed ? (pool->wait_ns / pool->completed) / 1000 : 0,
+			pool->completed ? (pool->run_ns / pool->completed) / 1000 : 0);
+		pthread_mutex_unlock(&pool->mutex);
+	}
+	pthread_mutex_unlock(&offload_mutex);
+
+	return 0;
+}
+
+static fr_cmd_table_t cmd_offload_table[] = {
+	{
+		.parent = "show",
+		.name = "offload",
+		.func = cmd_show_offload,
+		.help = "Show the queue depth and latency of offload pools for blocking calls.",
+		.read_only = true
+	},
+
+	CMD_TABLE_END
+};
+
+static int _offload_pool_free(unlang_offload_pool_t *pool)
+{
+	unlang_offload_job_t	*job;
+	uint32_t		i;
+
+	pthread_mutex_lock(&offload_mutex);
+	fr_dlist_remove(&offload_pools, pool);
+	pthread_mutex_unlock(&offload_mutex);
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->num_threads; i++) pthread_join(pool->threads[i], NULL);
+
+	/*
+	 *	All of the workers should have exited, and cancelled
+	 *	their requests, before the module is freed.
+	 */
+	while ((job = fr_dlist_pop_head(&pool->queue))) talloc_free(job);
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->mutex);
+
+	return 0;
+}
+
+/** Allocate an offload pool, and start its helper threads
+ *
+ * Pools are usually allocated in a module's instantiate callback,
+ * and freed with the module instance.
+ *
+ * @param[in] ctx	to allocate the pool in.
+ * @param[in] name	of the pool, usually the module instance name.
+ * @param[in] config	for the pool.
+ * @return
+ *	- The new pool.
+ *	- NULL on error.
+ */
+unlang_offload_pool_t *unlang_offload_pool_alloc(TALLOC_CTX *ctx, char const *name,
+						 unlang_offload_pool_config_t const *config)
+{
+	static bool		registered = false;
+	unlang_offload_pool_t	*pool;
+	uint32_t		i;
+	int			ret;
+
+	MEM(pool = talloc_zero(ctx, unlang_offload_pool_t));
+	pool->name = talloc_strdup(pool, name);
+	pool->config = *config;
+
+	FR_INTEGER_BOUND_CHECK("threads", pool->config.threads, >=, 1);
+	FR_INTEGER_BOUND_CHECK("threads", pool->config.threads, <=, 1024);
+	FR_INTEGER_BOUND_CHECK("max_queued", pool->config.max_queued, >=, 1);
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	fr_dlist_init(&pool->queue, unlang_offload_job_t, entry);
+	fr_dlist_entry_init(&pool->entry);
+
+	pthread_mutex_lock(&offload_mutex);
+	if (!offload_pools_init) {
+		fr_dlist_init(&offload_pools, unlang_offload_pool_t, entry);
+		offload_pools_init = true;
+	}
+	fr_dlist_insert_tail(&offload_pools, pool);
+	pthread_mutex_unlock(&offload_mutex);
+
+	talloc_set_destructor(pool, _offload_pool_free);
+
+	MEM(pool->threads = talloc_zero_array(pool, pthread_t, pool->config.threads));
+	for (i = 0; i < pool->config.threads; i++) {
+		ret = pthread_create(&pool->threads[i], NULL, offload_thread_main, pool);
+		if (ret != 0) {
+			fr_strerror_printf("Failed creating offload thread: %s", fr_syserror(ret));
+			talloc_free(pool);
+			return NULL;
+		}
+		pool->num_threads++;
+	}
+
+	if (!registered) {
+		registered = true;
+
+		if (fr_command_register_hook(NULL, NULL, NULL, cmd_offload_table) < 0) {
+			PWARN("Failed registering radmin commands for offload pools");
+		}
+	}
+
+	return pool;
+}
@@ -0,0 +1,71 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file unlang/offload.h
+ * @brief Run blocking library calls in helper threads, without blocking the worker.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(unlang_offload_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/server/cf_parse.h>
+#include <freeradius-devel/server/module.h>
+#include <freeradius-devel/server/rcode.h>
+
+typedef struct unlang_offload_pool_s unlang_offload_pool_t;
+
+/** Configuration for an offload pool
+ *
+ */
+typedef struct {
+	uint32_t		threads;		//!< Number of helper threads.
+	uint32_t		max_queued;		//!< Maximum number of calls waiting for a helper thread.
+} unlang_offload_pool_config_t;
+
+extern conf_parser_t const unlang_offload_pool_config[];
+
+/** A blocking call, run in a helper thread
+ *
+ * The function MUST NOT access the request, or anything allocated
+ * in the request's talloc context.  The request may be cancelled,
+ * and freed, while the function is still running.  Everything the
+ * function needs should be copied into uctx before the call is
+ * submitted, and the results written back to uctx.
+ *
+ * Anything the function allocates should be allocated in uctx.
+ *
+ * @param[in] uctx	passed to unlang_offload_yield().
+ */
+typedef void (*unlang_offload_func_t)(void *uctx);
+
+unlang_offload_pool_t	*unlang_offload_pool_alloc(TALLOC_CTX *ctx, char const *name,
+						   unlang_offload_pool_config_t const *config) CC_HINT(nonnull);
+
+unlang_action_t		unlang_offload_yield(rlm_rcode_t *p_result, request_t *request,
+					     unlang_offload_pool_t *pool, unlang_offload_func_t func,
+					     module_method_t resume, void *uctx) CC_HINT(nonnull);
+
+#ifdef __cplusplus
+}
+#endif
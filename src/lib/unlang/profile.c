@@ -0,0 +1,640 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file unlang/profile.c
+ * @brief Per-module call timing, and slow request traces.
+ *
+ * When profiling is enabled, every stack frame is time tracked.  The
+ * time a frame spends running its own code is its "cpu" time.  The time
+ * from the frame being pushed to it being popped is its "wall" time,
+ * which includes child frames, and any time spent yielded.
+ *
+ * The times for module calls are totalled per module instance and
+ * method, in each thread.  Only the owning thread ever writes to the
+ * totals, and other threads read them with relaxed loads.
+ *
+ * One in every "sample" requests is traced.  Each frame of a traced
+ * request is recorded, in the order they were pushed, with their depth
+ * and timings.  If the request takes longer than "slow_request", the
+ * trace is kept in a ring buffer, which can be printed with radmin.
+ * Otherwise it's discarded.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/command.h>
+#include <freeradius-devel/unlang/profile.h>
+#include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/rb.h>
+
+#include "unlang_priv.h"
+#include "module_priv.h"
+
+#include <pthread.h>
+
+#ifdef WITH_PERF
+/** Maximum number of frames recorded for a traced request
+ *
+ */
+#define UNLANG_PROFILE_TRACE_FRAMES	(128)
+
+/** Totals for one module method, in one thread
+ *
+ */
+struct unlang_profile_module_s {
+	fr_rb_node_t		node;			//!< Entry in the thread's lookup tree.  Owner only.
+
+	module_instance_t const	*mi;			//!< Module instance being called.
+	module_method_t		method;			//!< Method being called.
+	char const		*method_name;		//!< Printable name of the method.
+
+	atomic_uint_fast64_t	calls;			//!< Number of calls.
+	atomic_uint_fast64_t	wall;			//!< Total wall time of calls, in nanoseconds.
+	atomic_uint_fast64_t	wall_max;		//!< Longest wall time of any call.
+	atomic_uint_fast64_t	cpu;			//!< Total time spent running the module's own code.
+
+	unlang_profile_module_t	*next;			//!< Next entry published by this thread.
+};
+
+/** One frame of a traced request
+ *
+ */
+struct unlang_profile_frame_s {
+	unlang_t const		*instruction;		//!< What the frame was executing.
+	int			depth;			//!< Depth of the frame in the stack.
+	bool			done;			//!< Whether the frame completed.
+	fr_time_delta_t		offset;			//!< When the frame was pushed, relative to the
+							///< start of the request.
+	fr_time_delta_t		wall;			//!< From the frame being pushed to being popped.
+	fr_time_delta_t		cpu;			//!< Time spent running the frame's own code.
+};
+
+/** A traced request
+ *
+ */
+struct unlang_profile_trace_s {
+	char const		*name;			//!< Of the request.
+	uint64_t		number;			//!< Of the request.
+	fr_time_t		started;		//!< When the first frame was pushed.
+	fr_time_delta_t		elapsed;		//!< How long the request took.
+
+	int			max_depth;		//!< Deepest frame we recorded.
+	unsigned int		num_frames;		//!< Number of frames recorded.
+	unsigned int		dropped;		//!< Frames which didn't fit in the trace.
+	unlang_profile_frame_t	frame[UNLANG_PROFILE_TRACE_FRAMES];
+};
+
+/** The module totals for a single thread
+ *
+ */
+typedef struct {
+	fr_dlist_t		entry;			//!< In the global list of threads.
+	fr_rb_tree_t		*tree;			//!< Lookup of entries by module and method.  Owner only.
+	unlang_profile_module_t	* _Atomic head;		//!< Entries published to readers.
+} unlang_profile_thread_t;
+
+/** Module totals merged from all threads
+ *
+ */
+typedef struct {
+	fr_rb_node_t		node;
+	char const		*module;
+	char const		*method;
+	uint64_t		calls;
+	uint64_t		wall;
+	uint64_t		wall_max;
+	uint64_t		cpu;
+} unlang_profile_merged_t;
+
+bool unlang_profile_enabled = false;
+
+static unlang_profile_config_t	profile_config;
+
+static pthread_mutex_t		profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+static fr_dlist_head_t		profile_threads;	//!< Totals of running threads.
+static bool			profile_threads_init = false;
+static unlang_profile_module_t	*profile_retired;	//!< Totals from threads which have exited.
+static TALLOC_CTX		*profile_retired_ctx;
+
+static unlang_profile_trace_t	**profile_traces;	//!< Ring buffer of slow request traces.
+static uint32_t			profile_traces_next;	//!< Next slot to write to.
+
+static _Thread_local unlang_profile_thread_t	*profile_thread;
+static _Thread_local uint32_t			profile_sample_count;
+
+static int8_t profile_module_cmp(void const *one, void const *two)
+{
+	unlang_profile_module_t const *a = one, *b = two;
+	int8_t ret;
+
+	ret = CMP(a->mi, b->mi);
+	if (ret != 0) return ret;
+
+	return CMP((uintptr_t) a->method, (uintptr_t) b->method);
+}
+
+static int8_t profile_merged_cmp(void const *one, void const *two)
+{
+	unlang_profile_merged_t const *a = one, *b = two;
+	int ret;
+
+	ret = strcmp(a->module, b->module);
+	if (ret != 0) return CMP(ret, 0);
+
+	ret = strcmp(a->method, b->method);
+	return CMP(ret, 0);
+}
+
+static inline void profile_add(atomic_uint_fast64_t *counter, uint64_t value)
+{
+	atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+			      memory_order_relaxed);
+}
+
+static inline uint64_t profile_ns(fr_time_delta_t delta)
+{
+	int64_t ns = fr_time_delta_unwrap(delta);
+
+	return (ns > 0) ? (uint64_t) ns : 0;
+}
+
+/** Move a thread's totals to the retired list when it exits
+ *
+ */
+static int _profile_thread_free(void *uctx)
+{
+	unlang_profile_thread_t	*pt = uctx;
+	unlang_profile_module_t	*pm, *next;
+
+	pthread_mutex_lock(&profile_mutex);
+	fr_dlist_remove(&profile_threads, pt);
+
+	if (!profile_retired_ctx) profile_retired_ctx = talloc_new(NULL);
+
+	for (pm = atomic_load_explicit(&pt->head, memory_order_acquire); pm; pm = next) {
+		next = pm->next;
+
+		talloc_steal(profile_retired_ctx, pm);
+		pm->next = profile_retired;
+		profile_retired = pm;
+	}
+	pthread_mutex_unlock(&profile_mutex);
+
+	talloc_free(pt);
+	profile_thread = NULL;
+
+	return 0;
+}
+
+/** Free the traces and retired totals at exit
+ *
+ */
+static int _profile_free(UNUSED void *uctx)
+{
+	pthread_mutex_lock(&profile_mutex);
+	TALLOC_FREE(profile_retired_ctx);
+	profile_retired = NULL;
+	TALLOC_FREE(profile_traces);
+	unlang_profile_enabled = false;
+	pthread_mutex_unlock(&profile_mutex);
+
+	return 0;
+}
+
+/** Find or create the totals for a module method in this thread
+ *
+ */
+static unlang_profile_module_t *profile_module_find(unlang_module_t const *mc)
+{
+	unlang_profile_thread_t	*pt = profile_thread;
+	unlang_profile_module_t	*pm, find = { .mi = mc->instance, .method = mc->method };
+
+	if (unlikely(!pt)) {
+		pt = talloc_zero(NULL, unlang_profile_thread_t);
+		if (!pt) return NULL;
+
+		pt->tree = fr_rb_inline_alloc(pt, unlang_profile_module_t, node, profile_module_cmp, NULL);
+		if (!pt->tree) {
+			talloc_free(pt);
+			return NULL;
+		}
+		atomic_init(&pt->head, NULL);
+
+		pthread_mutex_lock(&profile_mutex);
+		if (!profile_threads_init) {
+			fr_dlist_init(&profile_threads, unlang_profile_thread_t, entry);
+			profile_threads_init = true;
+		}
+		fr_dlist_insert_tail(&profile_threads, pt);
+		pthread_mutex_unlock(&profile_mutex);
+
+		fr_atexit_thread_local(profile_thread, _profile_thread_free, pt);
+	}
+
+	pm = fr_rb_find(pt->tree, &find);
+	if (pm) return pm;
+
+	MEM(pm = talloc_zero(pt, unlang_profile_module_t));
+	pm->mi = mc->instance;
+	pm->method = mc->method;
+	pm->method_name = talloc_strdup(pm, mc->method_name ? mc->method_name : "*");
+	atomic_init(&pm->calls, 0);
+	atomic_init(&pm->wall, 0);
+	atomic_init(&pm->wall_max, 0);
+	atomic_init(&pm->cpu, 0);
+
+	if (!fr_rb_insert(pt->tree, pm)) {
+		talloc_free(pm);
+		return NULL;
+	}
+
+	/*
+	 *	Entry must be fully initialised before readers
+	 *	can see it.
+	 */
+	pm->next = atomic_load_explicit(&pt->head, memory_order_relaxed);
+	atomic_store_explicit(&pt->head, pm, memory_order_release);
+
+	return pm;
+}
+
+/** Free a trace if the request is freed before it completes
+ *
+ */
+static int _profile_stack_free(unlang_stack_t *stack)
+{
+	TALLOC_FREE(stack->trace);
+	return 0;
+}
+
+/** Decide whether to trace a request which is starting
+ *
+ * @param[in] request	which is starting.
+ * @param[in] stack	of the request.
+ */
+void unlang_profile_request_start(UNUSED request_t *request, unlang_stack_t *stack)
+{
+	unlang_profile_trace_t *trace;
+
+	if (!profile_traces || stack->trace) return;
+
+	if (++profile_sample_count < profile_config.sample) return;
+	profile_sample_count = 0;
+
+	trace = talloc_zero(NULL, unlang_profile_trace_t);
+	if (!trace) return;
+
+	trace->started = fr_time();
+	stack->trace = trace;
+	talloc_set_destructor(stack, _profile_stack_free);
+}
+
+/** Record a frame of a traced request
+ *
+ * @param[in] stack	of the request.
+ * @param[in] frame	which has just been pushed.
+ */
+void unlang_profile_frame_start(unlang_stack_t *stack, unlang_stack_frame_t *frame)
+{
+	unlang_profile_trace_t	*trace = stack->trace;
+	unlang_profile_frame_t	*pf;
+
+	if (trace->num_frames >= NUM_ELEMENTS(trace->frame)) {
+		trace->dropped++;
+		return;
+	}
+
+	pf = &trace->frame[trace->num_frames++];
+	pf->instruction = frame->instruction;
+	pf->depth = frame - stack->frame;
+	pf->offset = fr_time_sub(frame->tracking.started, trace->started);
+
+	if (pf->depth > trace->max_depth) trace->max_depth = pf->depth;
+
+	frame->profile = pf;
+}
+
+/** Record the timings of a frame which has finished
+ *
+ * @param[in] t		thread specific data for the instruction.
+ * @param[in] frame	which has finished.  Its time tracking must have ended.
+ */
+void unlang_profile_frame_end(unlang_thread_t *t, unlang_stack_frame_t *frame)
+{
+	unlang_profile_module_t	*pm;
+	fr_time_delta_t		wall = fr_time_sub(frame->tracking.ended, frame->tracking.started);
+	uint64_t		ns;
+
+	if (frame->profile) {
+		frame->profile->wall = wall;
+		frame->profile->cpu = frame->tracking.running_total;
+		frame->profile->done = true;
+		frame->profile = NULL;
+	}
+
+	if (frame->instruction->type != UNLANG_TYPE_MODULE) return;
+
+	pm = t->profile;
+	if (unlikely(!pm)) {
+		pm = profile_module_find(unlang_generic_to_module(frame->instruction));
+		if (!pm) return;
+
+		t->profile = pm;
+	}
+
+	ns = profile_ns(wall);
+
+	profile_add(&pm->calls, 1);
+	profile_add(&pm->wall, ns);
+	profile_add(&pm->cpu, profile_ns(frame->tracking.running_total));
+	if (ns > atomic_load_explicit(&pm->wall_max, memory_order_relaxed)) {
+		atomic_store_explicit(&pm->wall_max, ns, memory_order_relaxed);
+	}
+}
+
+/** Keep the trace of a request if it was slow, and discard it otherwise
+ *
+ * @param[in] request	which is done.
+ * @param[in] stack	of the request.
+ */
+void unlang_profile_request_done(request_t *request, unlang_stack_t *stack)
+{
+	unlang_profile_trace_t	*trace = stack->trace;
+	int			i;
+
+	stack->trace = NULL;
+	talloc_set_destructor(stack, NULL);
+
+	/*
+	 *	Frames which didn't complete mustn't write
+	 *	to the trace after we've handed it off.
+	 */
+	for (i = 0; i <= trace->max_depth; i++) stack->frame[i].profile = NULL;
+
+	trace->elapsed = fr_time_sub(fr_time(), trace->started);
+	if (fr_time_delta_lt(trace->elapsed, profile_config.slow_request)) {
+		talloc_free(trace);
+		return;
+	}
+
+	trace->number = request->number;
+	trace->name = talloc_strdup(trace, request->name);
+
+	pthread_mutex_lock(&profile_mutex);
+	if (!profile_traces) {
+		pthread_mutex_unlock(&profile_mutex);
+		talloc_free(trace);
+		return;
+	}
+
+	talloc_free(profile_traces[profile_traces_next]);
+	profile_traces[profile_traces_next] = talloc_steal(profile_traces, trace);
+	profile_traces_next = (profile_traces_next + 1) % profile_config.max_traces;
+	pthread_mutex_unlock(&profile_mutex);
+}
+
+static void profile_merge_list(fr_rb_tree_t *tree, TALLOC_CTX *ctx, unlang_profile_module_t *pm)
+{
+	for (; pm; pm = pm->next) {
+		unlang_profile_merged_t	*merged, find = { .module = pm->mi->name, .method = pm->method_name };
+		uint64_t		wall_max;
+
+		merged = fr_rb_find(tree, &find);
+		if (!merged) {
+			MEM(merged = talloc_zero(ctx, unlang_profile_merged_t));
+			merged->module = pm->mi->name;
+			merged->method = pm->method_name;
+			fr_rb_insert(tree, merged);
+		}
+
+		merged->calls += atomic_load_explicit(&pm->calls, memory_order_relaxed);
+		merged->wall += atomic_load_explicit(&pm->wall, memory_order_relaxed);
+		merged->cpu += atomic_load_explicit(&pm->cpu, memory_order_relaxed);
+
+		wall_max = atomic_load_explicit(&pm->wall_max, memory_order_relaxed);
+		if (wall_max > merged->wall_max) merged->wall_max = wall_max;
+	}
+}
+
+/** Print the time spent in each module method, merged over all threads
+ *
+ * @param[in] fp	to print to.
+ * @return
+ *	- 0 on success.
+ *	- -1 on error.
+ */
+int unlang_profile_modules_print(FILE *fp)
+{
+	TALLOC_CTX	*ctx;
+	fr_rb_tree_t	*tree;
+
+	ctx = talloc_new(NULL);
+	if (!ctx) return -1;
+
+	tree = fr_rb_inline_alloc(ctx, unlang_profile_merged_t, node, profile_merged_cmp, NULL);
+	if (!tree) {
+		talloc_free(ctx);
+		return -1;
+	}
+
+	fprintf(fp, "%-24s %-32s %12s %12s %12s %12s\n",
+		"module", "method", "calls", "wall_avg_us", "wall_max_us", "cpu_avg_us");
+
+	/*
+	 *	The names in the merged entries point into the
+	 *	per-thread entries, so we hold the mutex until
+	 *	we're done printing.
+	 */
+	pthread_mutex_lock(&profile_mutex);
+	if (profile_threads_init) {
+		fr_dlist_foreach(&profile_threads, unlang_profile_thread_t, pt) {
+			profile_merge_list(tree, ctx, atomic_load_explicit(&pt->head, memory_order_acquire));
+		}
+	}
+	profile_merge_list(tree, ctx, profile_retired);
+
+	fr_rb_inorder_foreach(tree, unlang_profile_merged_t, m) {
+		if (!m->calls) continue;
+
+		fprintf(fp, "%-24s %-32s %12" PRIu64 " %12.3f %12.3f %12.3f\n",
+			m->module, m->method, m->calls,
+			((double) m->wall / m->calls) / 1000,
+			(double) m->wall_max / 1000,
+			((double) m->cpu / m->calls) / 1000);
+	}
+	endforeach
+	pthread_mutex_unlock(&profile_mutex);
+
+	talloc_free(ctx);
+
+	return 0;
+}
+
+static void profile_trace_print(FILE *fp, unlang_profile_trace_t const *trace)
+{
+	unsigned int	i;
+	time_t		when = fr_time_to_sec(trace->started);
+	char		buffer[64];
+	struct tm	tm;
+
+	strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", localtime_r(&when, &tm));
+
+	fprintf(fp, "request %s (%" PRIu64 ") started %s took %.6fs\n",
+		trace->name, trace->number, buffer, fr_time_delta_unwrap(trace->elapsed) / (double) NSEC);
+
+	for (i = 0; i < trace->num_frames; i++) {
+		unlang_profile_frame_t const *pf = &trace->frame[i];
+
+		fprintf(fp, "\t+%.6fs %*s%s", fr_time_delta_unwrap(pf->offset) / (double) NSEC,
+			pf->depth * 2, "", pf->instruction->debug_name);
+
+		if (!pf->done) {
+			fprintf(fp, " (not completed)\n");
+			continue;
+		}
+
+		fprintf(fp, " wall=%.6fs cpu=%.6fs\n",
+			fr_time_delta_unwrap(pf->wall) / (double) NSEC,
+			fr_time_delta_unwrap(pf->cpu) / (double) NSEC);
+	}
+
+	if (trace->dropped) fprintf(fp, "\t... %u more frames not recorded\n", trace->dropped);
+}
+
+/** Print the slow request traces, oldest first
+ *
+ * @param[in] fp	to print to.
+ * @return
+ *	- 0 on success.
+ *	- -1 on error.
+ */
+int unlang_profile_traces_print(FILE *fp)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&profile_mutex);
+	if (!profile_traces) {
+		pthread_mutex_unlock(&profile_mutex);
+		return 0;
+	}
+
+	for (i = 0; i < profile_config.max_traces; i++) {
+		unlang_profile_trace_t const *trace;
+
+		trace = profile_traces[(profile_traces_next + i) % profile_config.max_traces];
+		if (!trace) continue;
+
+		profile_trace_print(fp, trace);
+	}
+	pthread_mutex_unlock(&profile_mutex);
+
+	return 0;
+}
+
+static int cmd_stats_unlang_modules(FILE *fp, UNUSED FILE *fp_err, UNUSED void *ctx, UNUSED fr_cmd_info_t const *info)
+{
+	return unlang_profile_modules_print(fp);
+}
+
+static int cmd_stats_unlang_traces(FILE *fp, UNUSED FILE *fp_err, UNUSED void *ctx, UNUSED fr_cmd_info_t const *info)
+{
+	return unlang_profile_traces_print(fp);
+}
+
+static fr_cmd_table_t cmd_profile_table[] = {
+	{
+		.parent = "stats",
+		.name = "unlang",
+		.help = "Interpreter profiling.",
+		.read_only = true
+	},
+
+	{
+		.parent = "stats unlang",
+		.name = "modules",
+		.func = cmd_stats_unlang_modules,
+		.help = "Show the time spent in each module method.",
+		.read_only = true
+	},
+
+	{
+		.parent = "stats unlang",
+		.name = "traces",
+		.func = cmd_stats_unlang_traces,
+		.help = "Show the frames of recent slow requests, with their timings.",
+		.read_only = true
+	},
+
+	CMD_TABLE_END
+};
+
+/** Enable interpreter profiling
+ *
+ * Must be called before any requests are processed.
+ *
+ * @param[in] config	for profiling.
+ * @return
+ *	- 0 on success.
+ *	- -1 on error.
+ */
+int unlang_profile_enable(unlang_profile_config_t const *config)
+{
+	if (unlang_profile_enabled) return 0;
+
+	profile_config = *config;
+	if (!profile_config.sample) profile_config.sample = 1;
+
+	if (profile_config.max_traces) {
+		profile_traces = talloc_zero_array(NULL, unlang_profile_trace_t *, profile_config.max_traces);
+		if (!profile_traces) {
+			fr_strerror_const("Out of memory");
+			return -1;
+		}
+		talloc_set_name_const(profile_traces, "unlang_profile_traces");
+	}
+
+	fr_atexit_global(_profile_free, NULL);
+
+	if (fr_command_register_hook(NULL, NULL, NULL, cmd_profile_table) < 0) {
+		PWARN("Failed registering radmin commands for interpreter profiling");
+	}
+
+	unlang_profile_enabled = true;
+
+	return 0;
+}
+#else
+int unlang_profile_enable(UNUSED unlang_profile_config_t const *config)
+{
+	fr_strerror_const("Interpreter profiling is not available, as the server was built without WITH_PERF");
+	return -1;
+}
+
+int unlang_profile_modules_print(UNUSED FILE *fp)
+{
+	return 0;
+}
+
+int unlang_profile_traces_print(UNUSED FILE *fp)
+{
+	return 0;
+}
+#endif
@@ -0,0 +1,53 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file unlang/profile.h
+ * @brief Per-module call timing, and slow request traces.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(unlang_profile_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/util/time.h>
+
+#include <stdio.h>
+
+/** Configuration for interpreter profiling
+ *
+ */
+typedef struct {
+	fr_time_delta_t		slow_request;		//!< Keep traces of requests which take longer than this.
+	uint32_t		sample;			//!< Trace one in every N requests.
+	uint32_t		max_traces;		//!< How many slow request traces to keep.
+} unlang_profile_config_t;
+
+int		unlang_profile_enable(unlang_profile_config_t const *config) CC_HINT(nonnull);
+
+int		unlang_profile_modules_print(FILE *fp) CC_HINT(nonnull);
+
+int		unlang_profile_traces_print(FILE *fp) CC_HINT(nonnull);
+
+#ifdef __cplusplus
+}
+#endif
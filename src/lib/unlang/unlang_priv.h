@@ -108,6 +108,12 @@ typedef enum {
 typedef struct unlang_s unlang_t;
 typedef struct unlang_stack_frame_s unlang_stack_frame_t;
 
+#ifdef WITH_PERF
+typedef struct unlang_profile_module_s unlang_profile_module_t;
+typedef struct unlang_profile_frame_s unlang_profile_frame_t;
+typedef struct unlang_profile_trace_s unlang_profile_trace_t;
+#endif
+
 /** A node in a graph of #unlang_op_t (s) that we execute
  *
  * The interpreter acts like a turing machine, with #unlang_t nodes forming the tape
@@ -245,23 +251,12 @@ typedef struct {
 	uint64_t		running;			//!< currently running this instruction
 	uint64_t		yielded;			//!< currently yielded
 	fr_time_tracking_t	tracking;			//!< tracking cpu time
+	unlang_profile_module_t	*profile;			//!< per-module totals, if this is a module call.
 #endif
 } unlang_thread_t;
 
 void	*unlang_thread_instance(unlang_t const *instruction);
 
-#ifdef WITH_PERF
-void		unlang_frame_perf_init(unlang_stack_frame_t *frame);
-void		unlang_frame_perf_yield(unlang_stack_frame_t *frame);
-void		unlang_frame_perf_resume(unlang_stack_frame_t *frame);
-void		unlang_frame_perf_cleanup(unlang_stack_frame_t *frame);
-#else
-#define		unlang_frame_perf_init(_x)
-#define		unlang_frame_perf_yield(_x)
-#define		unlang_frame_perf_resume(_x)
-#define		unlang_frame_perf_cleanup(_x)
-#endif
-
 void	unlang_frame_signal(request_t *request, fr_signal_t action, int limit);
 
 typedef struct {
@@ -313,6 +308,8 @@ struct unlang_stack_frame_s {
 	uint8_t			uflags;				//!< Unwind markers
 #ifdef WITH_PERF
 	fr_time_tracking_t	tracking;			//!< track this instance of this instruction
+	unlang_profile_frame_t	*profile;			//!< where to record this frame, if the request
+								///< is being traced.
 #endif
 };
 
@@ -327,9 +324,41 @@ typedef struct {
 	int			depth;				//!< Current depth we're executing at.
 	uint8_t			unwind;				//!< Unwind to this frame if it exists.
 								///< This is used for break and return.
+#ifdef WITH_PERF
+	unlang_profile_trace_t	*trace;				//!< Frame timings, if this request was sampled.
+#endif
 	unlang_stack_frame_t	frame[UNLANG_STACK_MAX];	//!< The stack...
 } unlang_stack_t;
 
+#ifdef WITH_PERF
+extern bool	unlang_profile_enabled;
+
+void		_unlang_frame_perf_init(unlang_stack_t *stack, unlang_stack_frame_t *frame);
+void		_unlang_frame_perf_yield(unlang_stack_frame_t *frame);
+void		_unlang_frame_perf_resume(unlang_stack_frame_t *frame);
+void		_unlang_frame_perf_cleanup(unlang_stack_frame_t *frame);
+
+void		unlang_profile_request_start(request_t *request, unlang_stack_t *stack);
+void		unlang_profile_frame_start(unlang_stack_t *stack, unlang_stack_frame_t *frame);
+void		unlang_profile_frame_end(unlang_thread_t *t, unlang_stack_frame_t *frame);
+void		unlang_profile_request_done(request_t *request, unlang_stack_t *stack);
+
+/*
+ *	Profiling is enabled at startup, before any requests are
+ *	processed, so a frame is either tracked for its whole life,
+ *	or not at all.  When it's disabled, the cost is one branch.
+ */
+#define		unlang_frame_perf_init(_stack, _frame)	do { if (unlikely(unlang_profile_enabled)) _unlang_frame_perf_init(_stack, _frame); } while (0)
+#define		unlang_frame_perf_yield(_frame)		do { if (unlikely(unlang_profile_enabled)) _unlang_frame_perf_yield(_frame); } while (0)
+#define		unlang_frame_perf_resume(_frame)	do { if (unlikely(unlang_profile_enabled)) _unlang_frame_perf_resume(_frame); } while (0)
+#define		unlang_frame_perf_cleanup(_frame)	do { if (unlikely(unlang_profile_enabled)) _unlang_frame_perf_cleanup(_frame); } while (0)
+#else
+#define		unlang_frame_perf_init(_stack, _frame)
+#define		unlang_frame_perf_yield(_frame)
+#define		unlang_frame_perf_resume(_frame)
+#define		unlang_frame_perf_cleanup(_frame)
+#endif
+
 /** Different operations the interpreter can execute
  */
 extern unlang_op_t unlang_ops[];
@@ -411,7 +440,7 @@ static inline void frame_state_init(unlang_stack_t *stack, unlang_stack_frame_t
 	unlang_op_t	*op;
 	char const	*name;
 
-	unlang_frame_perf_init(frame);
+	unlang_frame_perf_init(stack, frame);
 
 	op = &unlang_ops[instruction->type];
 	name = op->frame_state_type ? op->frame_state_type : __location__;
@@ -1635,16 +1635,13 @@ static xlat_action_t xlat_attr_exists(TALLOC_CTX *ctx, fr_dcursor_t *out,
 {
 	fr_pair_t		*vp;
 	fr_value_box_t		*dst;
-	fr_dcursor_t		cursor;
-	tmpl_dcursor_ctx_t	cc;
 
 	MEM(dst = fr_value_box_alloc(ctx, FR_TYPE_BOOL, attr_expr_bool_enum));
 
-	vp = tmpl_dcursor_init(NULL, NULL, &cc, &cursor, request, vpt);
+	vp = tmpl_dcursor_first(NULL, request, vpt);
 	dst->vb_bool = (vp != NULL);
 
 	if (do_free) talloc_const_free(vpt);
-	tmpl_dcursor_clear(&cc);
 	fr_dcursor_append(out, dst);
 	return XLAT_ACTION_DONE;
 }
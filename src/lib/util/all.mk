@@ -1,11 +1,15 @@
 SUBMAKEFILES := \
 	base_16_32_64_tests.mk \
+	btree_tests.mk \
 	dbuff_tests.mk \
 	dcursor_tests.mk \
 	dcursor_typed_tests.mk \
 	dlist_tests.mk \
 	edit_tests.mk \
+	event_tests.mk \
+	hash_tests.mk \
 	heap_tests.mk \
+	histogram_tests.mk \
 	hmac_tests.mk \
 	libfreeradius-util.mk \
 	lst_tests.mk \
@@ -15,6 +19,7 @@ SUBMAKEFILES := \
 	pair_nested_tests.mk \
 	pair_tests.mk \
 	rb_tests.mk \
+	regex_tests.mk \
 	sbuff_tests.mk \
 	size_tests.mk \
 	slab_tests.mk \
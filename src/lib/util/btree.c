@@ -0,0 +1,837 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** In-memory B-tree, with wide nodes
+ *
+ * A classic B-tree of minimum degree 8, following the single pass
+ * insert and delete algorithms from "Introduction to Algorithms"
+ * (Cormen et al).  Full nodes are split on the way down during
+ * insertion, and nodes with the minimum number of elements are
+ * topped up from a sibling, or merged, on the way down during
+ * deletion, so no operation ever has to walk back up the tree.
+ *
+ * Each element is stored exactly once, in either a leaf or an
+ * internal node.  A B+tree would duplicate keys in the internal
+ * nodes, but we only have pointers to the caller's data, and the
+ * copies would dangle when the data was removed and freed.
+ *
+ * Comparing against an element means dereferencing a pointer to
+ * the caller's data, which is a cache miss for every comparison in
+ * a large tree, and throws away the advantage of the wide nodes.
+ * Trees with a #fr_btree_key_t callback store a 64bit key next to
+ * each pointer, and only call the comparator when the keys are
+ * equal, so most searches never touch the elements at all.
+ *
+ * @file src/lib/util/btree.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/btree.h>
+
+/*
+ *	With 8 byte pointers, each item is 16 bytes, so a leaf
+ *	fills four cache lines, and an internal node six.
+ */
+#define BTREE_MIN_DEGREE	(8)
+#define BTREE_MAX_ITEMS		((2 * BTREE_MIN_DEGREE) - 1)	//!< 15
+#define BTREE_MIN_ITEMS		(BTREE_MIN_DEGREE - 1)		//!< 7
+
+typedef struct {
+	uint64_t		key;				//!< From data_key, or 0.
+	void			*data;				//!< The caller's element.
+} fr_btree_item_t;
+
+struct fr_btree_node_s {
+	uint16_t		num;				//!< Number of elements in the node.
+	bool			leaf;				//!< Node has no children.
+	fr_btree_item_t		items[BTREE_MAX_ITEMS];		//!< Elements, in order.
+};
+
+/** An internal node
+ *
+ * children[i] holds the elements less than items[i], and
+ * children[num] the elements greater than items[num - 1].
+ */
+typedef struct {
+	fr_btree_node_t		node;
+	fr_btree_node_t		*children[BTREE_MAX_ITEMS + 1];
+} fr_btree_inode_t;
+
+struct fr_btree_s {
+	fr_btree_node_t		*root;				//!< Root of the tree, always allocated.
+	uint32_t		num_elements;			//!< How many elements are in the tree.
+
+	char const		*type;				//!< Talloc type to check elements against.
+	fr_cmp_t		data_cmp;			//!< Callback to compare node data.
+	fr_btree_key_t		data_key;			//!< Optional callback to produce a key for node data.
+	fr_free_t		data_free;			//!< Callback to free node data.
+};
+
+#define CHILDREN(_node) (((fr_btree_inode_t *) (_node))->children)
+#define CHILDREN_CONST(_node) (((fr_btree_inode_t const *) (_node))->children)
+
+static inline CC_HINT(always_inline) uint64_t item_key(fr_btree_t const *tree, void const *data)
+{
+	return tree->data_key ? tree->data_key(data) : 0;
+}
+
+/** Compare data against an item, by key first, then with the comparator
+ *
+ */
+static inline CC_HINT(always_inline) int8_t item_cmp(fr_btree_t const *tree, uint64_t key, void const *data,
+						     fr_btree_item_t const *item)
+{
+	if (key != item->key) return (key < item->key) ? -1 : +1;
+
+	return tree->data_cmp(data, item->data);
+}
+
+static fr_btree_node_t *node_alloc(fr_btree_t *tree, bool leaf)
+{
+	fr_btree_node_t *node;
+
+	if (leaf) {
+		node = talloc_zero(tree, fr_btree_node_t);
+	} else {
+		node = (fr_btree_node_t *) talloc_zero(tree, fr_btree_inode_t);
+	}
+	if (unlikely(!node)) return NULL;
+
+	node->leaf = leaf;
+
+	return node;
+}
+
+/** Binary search a node
+ *
+ * @param[out] idx	of the matching element, or the child to descend into.
+ * @param[in] tree	being searched.
+ * @param[in] node	to search.
+ * @param[in] key	of data.
+ * @param[in] data	to search for.
+ * @return
+ *	- true if items[idx] matches data.
+ *	- false if data isn't in this node.
+ */
+static inline CC_HINT(always_inline) bool node_search(unsigned int *idx, fr_btree_t const *tree,
+						      fr_btree_node_t const *node, uint64_t key, void const *data)
+{
+	unsigned int lo = 0, hi = node->num;
+
+	/*
+	 *	Count the keys below ours without branching, which
+	 *	is cheaper than a binary search over so few items,
+	 *	then narrow the range to the items with equal keys.
+	 */
+	if (tree->data_key) {
+		unsigned int i;
+
+		for (i = 0; i < hi; i++) lo += (node->items[i].key < key);
+		for (i = lo; (i < hi) && (node->items[i].key == key); i++);
+		hi = i;
+	}
+
+	while (lo < hi) {
+		unsigned int	mid = (lo + hi) / 2;
+		int8_t		ret = item_cmp(tree, key, data, &node->items[mid]);
+
+		if (ret == 0) {
+			*idx = mid;
+			return true;
+		}
+
+		if (ret < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	*idx = lo;
+	return false;
+}
+
+static void node_free_data(fr_btree_t *tree, fr_btree_node_t *node)
+{
+	unsigned int i;
+
+	for (i = 0; i < node->num; i++) tree->data_free(node->items[i].data);
+
+	if (node->leaf) return;
+
+	for (i = 0; i <= node->num; i++) node_free_data(tree, CHILDREN(node)[i]);
+}
+
+static int _tree_free(fr_btree_t *tree)
+{
+	if (tree->data_free) node_free_data(tree, tree->root);
+
+	return 0;
+}
+
+/** Allocate a new B-tree
+ *
+ * @param[in] ctx		to allocate the tree in.
+ * @param[in] type		Talloc type of elements, may be NULL.
+ * @param[in] data_cmp		Callback to compare elements.
+ * @param[in] data_key		Optional callback to produce a key for elements.
+ * @param[in] data_free		Optional callback to free elements.
+ * @return
+ *	- A new B-tree on success.
+ *	- NULL on failure.
+ */
+fr_btree_t *_fr_btree_alloc(TALLOC_CTX *ctx, char const *type,
+			    fr_cmp_t data_cmp, fr_btree_key_t data_key, fr_free_t data_free)
+{
+	fr_btree_t *tree;
+
+	tree = talloc(ctx, fr_btree_t);
+	if (unlikely(!tree)) return NULL;
+
+	*tree = (fr_btree_t) {
+		.type = type,
+		.data_cmp = data_cmp,
+		.data_key = data_key,
+		.data_free = data_free
+	};
+
+	tree->root = node_alloc(tree, true);
+	if (unlikely(!tree->root)) {
+		talloc_free(tree);
+		return NULL;
+	}
+	talloc_set_destructor(tree, _tree_free);
+
+	return tree;
+}
+
+/** Find an element in the tree
+ *
+ * @param[in] tree	to search in.
+ * @param[in] data	to find.
+ * @return
+ *	- The element matching data.
+ *	- NULL if there's no match.
+ */
+void *fr_btree_find(fr_btree_t const *tree, void const *data)
+{
+	fr_btree_node_t	*node = tree->root;
+	uint64_t	key = item_key(tree, data);
+	unsigned int	idx;
+
+	for (;;) {
+		if (node_search(&idx, tree, node, key, data)) return node->items[idx].data;
+		if (node->leaf) return NULL;
+
+		node = CHILDREN(node)[idx];
+	}
+}
+
+/** Split the full child at idx of parent
+ *
+ * The middle element moves up into the parent.
+ */
+static int node_split_child(fr_btree_t *tree, fr_btree_node_t *parent, unsigned int idx)
+{
+	fr_btree_node_t	*child = CHILDREN(parent)[idx];
+	fr_btree_node_t	*sibling;
+
+	fr_assert(child->num == BTREE_MAX_ITEMS);
+	fr_assert(parent->num < BTREE_MAX_ITEMS);
+
+	sibling = node_alloc(tree, child->leaf);
+	if (unlikely(!sibling)) return -1;
+
+	/*
+	 *	The top half of the child goes to the new sibling.
+	 */
+	sibling->num = BTREE_MIN_ITEMS;
+	memcpy(sibling->items, child->items + BTREE_MIN_DEGREE, sizeof(sibling->items[0]) * BTREE_MIN_ITEMS);
+	if (!child->leaf) {
+		memcpy(CHILDREN(sibling), CHILDREN(child) + BTREE_MIN_DEGREE,
+		       sizeof(CHILDREN(sibling)[0]) * BTREE_MIN_DEGREE);
+	}
+	child->num = BTREE_MIN_ITEMS;
+
+	/*
+	 *	The middle element goes to the parent.
+	 */
+	memmove(CHILDREN(parent) + idx + 2, CHILDREN(parent) + idx + 1,
+		sizeof(CHILDREN(parent)[0]) * (parent->num - idx));
+	CHILDREN(parent)[idx + 1] = sibling;
+
+	memmove(parent->items + idx + 1, parent->items + idx, sizeof(parent->items[0]) * (parent->num - idx));
+	parent->items[idx] = child->items[BTREE_MIN_ITEMS];
+	parent->num++;
+
+	return 0;
+}
+
+/** Insert an element, or find the one it conflicts with
+ *
+ * @return
+ *	- 1 if an existing element was found.
+ *	- 0 if the element was inserted.
+ *	- -1 on allocation failure.
+ */
+static int insert_item(fr_btree_item_t **existing, fr_btree_t *tree, void const *data)
+{
+	fr_btree_node_t	*node;
+	uint64_t	key = item_key(tree, data);
+	unsigned int	idx;
+
+#ifndef TALLOC_GET_TYPE_ABORT_NOOP
+	if (tree->type) (void)_talloc_get_type_abort(data, tree->type, __location__);
+#endif
+
+	/*
+	 *	Split a full root first, which is the only way the
+	 *	tree grows taller.
+	 */
+	if (tree->root->num == BTREE_MAX_ITEMS) {
+		fr_btree_node_t *root;
+
+		root = node_alloc(tree, false);
+		if (unlikely(!root)) return -1;
+
+		CHILDREN(root)[0] = tree->root;
+		if (node_split_child(tree, root, 0) < 0) {
+			talloc_free(root);
+			return -1;
+		}
+		tree->root = root;
+	}
+
+	node = tree->root;
+	for (;;) {
+		fr_btree_node_t *child;
+
+		if (node_search(&idx, tree, node, key, data)) {
+			if (existing) *existing = &node->items[idx];
+			return 1;
+		}
+
+		if (node->leaf) break;
+
+		/*
+		 *	Make sure there's room in the child, so that
+		 *	it can take an element from its own child.
+		 */
+		child = CHILDREN(node)[idx];
+		if (child->num == BTREE_MAX_ITEMS) {
+			int8_t ret;
+
+			if (node_split_child(tree, node, idx) < 0) return -1;
+
+			ret = item_cmp(tree, key, data, &node->items[idx]);
+			if (ret == 0) {
+				if (existing) *existing = &node->items[idx];
+				return 1;
+			}
+			if (ret > 0) idx++;
+		}
+		node = CHILDREN(node)[idx];
+	}
+
+	memmove(node->items + idx + 1, node->items + idx, sizeof(node->items[0]) * (node->num - idx));
+	node->items[idx] = (fr_btree_item_t){ .key = key, .data = UNCONST(void *, data) };
+	node->num++;
+	tree->num_elements++;
+
+	return 0;
+}
+
+/** Attempt to find current data in the tree, if it does not exist insert it
+ *
+ * @param[out] found	Pre-existing data we found.
+ * @param[in] tree	to search/insert into.
+ * @param[in] data	to find.
+ * @return
+ *	- 1 if existing data was found, found will be populated.
+ *	- 0 if no existing data was found.
+ *	- -1 on insert error.
+ */
+int fr_btree_find_or_insert(void **found, fr_btree_t *tree, void const *data)
+{
+	fr_btree_item_t	*existing;
+	int		ret;
+
+	ret = insert_item(&existing, tree, data);
+	if (found) *found = (ret == 1) ? existing->data : NULL;
+
+	return ret;
+}
+
+/** Insert data into a tree
+ *
+ * @param[in] tree	to insert data into.
+ * @param[in] data 	to insert.
+ * @return
+ *	- true if data was inserted.
+ *	- false if data already existed and was not inserted.
+ */
+bool fr_btree_insert(fr_btree_t *tree, void const *data)
+{
+	return (insert_item(NULL, tree, data) == 0);
+}
+
+/** Replace old data with new data, OR insert if there is no old
+ *
+ * @param[out] old	data that was replaced.  If this argument
+ *			is not NULL, then the old data will not
+ *			be freed, even if a free function is
+ *			configured.
+ * @param[in] tree	to insert data into.
+ * @param[in] data 	to replace.
+ * @return
+ *      - 1 if data was replaced.
+ *	- 0 if data was inserted.
+ *      - -1 if we failed to replace data
+ */
+int fr_btree_replace(void **old, fr_btree_t *tree, void const *data)
+{
+	fr_btree_item_t	*existing;
+	void		*prev;
+
+	switch (insert_item(&existing, tree, data)) {
+	case 0:
+		if (old) *old = NULL;
+		return 0;
+
+	case 1:
+		break;
+
+	default:
+		if (old) *old = NULL;
+		return -1;
+	}
+
+	prev = existing->data;
+	existing->data = UNCONST(void *, data);
+
+	if (old) {
+		*old = prev;
+	} else if (tree->data_free) {
+		tree->data_free(prev);
+	}
+
+	return 1;
+}
+
+/** Move an element from the left sibling of child idx, through the parent
+ *
+ */
+static void node_rotate_right(fr_btree_node_t *parent, unsigned int idx)
+{
+	fr_btree_node_t	*child = CHILDREN(parent)[idx];
+	fr_btree_node_t	*left = CHILDREN(parent)[idx - 1];
+
+	memmove(child->items + 1, child->items, sizeof(child->items[0]) * child->num);
+	child->items[0] = parent->items[idx - 1];
+	if (!child->leaf) {
+		memmove(CHILDREN(child) + 1, CHILDREN(child), sizeof(CHILDREN(child)[0]) * (child->num + 1));
+		CHILDREN(child)[0] = CHILDREN(left)[left->num];
+	}
+	child->num++;
+
+	parent->items[idx - 1] = left->items[left->num - 1];
+	left->num--;
+}
+
+/** Move an element from the right sibling of child idx, through the parent
+ *
+ */
+static void node_rotate_left(fr_btree_node_t *parent, unsigned int idx)
+{
+	fr_btree_node_t	*child = CHILDREN(parent)[idx];
+	fr_btree_node_t	*right = CHILDREN(parent)[idx + 1];
+
+	child->items[child->num] = parent->items[idx];
+	if (!child->leaf) CHILDREN(child)[child->num + 1] = CHILDREN(right)[0];
+	child->num++;
+
+	parent->items[idx] = right->items[0];
+	memmove(right->items, right->items + 1, sizeof(right->items[0]) * (right->num - 1));
+	if (!right->leaf) {
+		memmove(CHILDREN(right), CHILDREN(right) + 1, sizeof(CHILDREN(right)[0]) * right->num);
+	}
+	right->num--;
+}
+
+/** Merge child idx + 1 and parent->items[idx] into child idx
+ *
+ * Both children must have the minimum number of elements.
+ */
+static void node_merge(fr_btree_node_t *parent, unsigned int idx)
+{
+	fr_btree_node_t	*child = CHILDREN(parent)[idx];
+	fr_btree_node_t	*right = CHILDREN(parent)[idx + 1];
+
+	fr_assert(child->num + right->num < BTREE_MAX_ITEMS);
+
+	child->items[child->num] = parent->items[idx];
+	memcpy(child->items + child->num + 1, right->items, sizeof(right->items[0]) * right->num);
+	if (!child->leaf) {
+		memcpy(CHILDREN(child) + child->num + 1, CHILDREN(right), sizeof(CHILDREN(right)[0]) * (right->num + 1));
+	}
+	child->num += right->num + 1;
+
+	memmove(parent->items + idx, parent->items + idx + 1, sizeof(parent->items[0]) * (parent->num - idx - 1));
+	memmove(CHILDREN(parent) + idx + 1, CHILDREN(parent) + idx + 2,
+		sizeof(CHILDREN(parent)[0]) * (parent->num - idx - 1));
+	parent->num--;
+
+	talloc_free(right);
+}
+
+/** Make sure child idx has more than the minimum number of elements
+ *
+ * @return the child to descend into, which may have changed if
+ *	the child was merged with its left sibling.
+ */
+static unsigned int node_fill_child(fr_btree_node_t *parent, unsigned int idx)
+{
+	if (CHILDREN(parent)[idx]->num > BTREE_MIN_ITEMS) return idx;
+
+	if ((idx > 0) && (CHILDREN(parent)[idx - 1]->num > BTREE_MIN_ITEMS)) {
+		node_rotate_right(parent, idx);
+		return idx;
+	}
+
+	if ((idx < parent->num) && (CHILDREN(parent)[idx + 1]->num > BTREE_MIN_ITEMS)) {
+		node_rotate_left(parent, idx);
+		return idx;
+	}
+
+	if (idx < parent->num) {
+		node_merge(parent, idx);
+		return idx;
+	}
+
+	node_merge(parent, idx - 1);
+	return idx - 1;
+}
+
+/** Remove data from the subtree rooted at node
+ *
+ * node must have more than the minimum number of elements,
+ * unless it's the root.
+ */
+static void *node_remove(fr_btree_node_t *node, fr_btree_t *tree, uint64_t key, void const *data)
+{
+	for (;;) {
+		unsigned int	idx;
+		void		*found;
+
+		if (!node_search(&idx, tree, node, key, data)) {
+			if (node->leaf) return NULL;
+
+			idx = node_fill_child(node, idx);
+			node = CHILDREN(node)[idx];
+			continue;
+		}
+
+		found = node->items[idx].data;
+
+		/*
+		 *	Easy, just remove it.
+		 */
+		if (node->leaf) {
+			memmove(node->items + idx, node->items + idx + 1, sizeof(node->items[0]) * (node->num - idx - 1));
+			node->num--;
+			return found;
+		}
+
+		/*
+		 *	Replace the element with its predecessor or
+		 *	successor, from whichever child can spare one,
+		 *	then remove that from the child.
+		 */
+		if (CHILDREN(node)[idx]->num > BTREE_MIN_ITEMS) {
+			fr_btree_node_t *pred = CHILDREN(node)[idx];
+
+			while (!pred->leaf) pred = CHILDREN(pred)[pred->num];
+			node->items[idx] = pred->items[pred->num - 1];
+
+			(void) node_remove(CHILDREN(node)[idx], tree, node->items[idx].key, node->items[idx].data);
+			return found;
+		}
+
+		if (CHILDREN(node)[idx + 1]->num > BTREE_MIN_ITEMS) {
+			fr_btree_node_t *succ = CHILDREN(node)[idx + 1];
+
+			while (!succ->leaf) succ = CHILDREN(succ)[0];
+			node->items[idx] = succ->items[0];
+
+			(void) node_remove(CHILDREN(node)[idx + 1], tree, node->items[idx].key, node->items[idx].data);
+			return found;
+		}
+
+		/*
+		 *	Neither child can spare one, merge them, with
+		 *	the element in the middle, and carry on down.
+		 */
+		node_merge(node, idx);
+		node = CHILDREN(node)[idx];
+	}
+}
+
+/** Remove an entry from the tree, without freeing the data
+ *
+ * @param[in] tree	to remove data from.
+ * @param[in] data 	to remove.
+ * @return
+ *      - The user data we removed.
+ *	- NULL if we couldn't find any matching data.
+ */
+void *fr_btree_remove(fr_btree_t *tree, void const *data)
+{
+	fr_btree_node_t	*root = tree->root;
+	void		*found;
+
+	found = node_remove(root, tree, item_key(tree, data), data);
+
+	/*
+	 *	The last element of the root was merged down into
+	 *	its only child, so the tree is now one level shorter.
+	 */
+	if (!root->leaf && (root->num == 0)) {
+		tree->root = CHILDREN(root)[0];
+		talloc_free(root);
+	}
+
+	if (found) tree->num_elements--;
+
+	return found;
+}
+
+/** Remove node and free data (if a free function was specified)
+ *
+ * @param[in] tree	to remove data from.
+ * @param[in] data 	to remove/free.
+ * @return
+ *	- true if we removed data.
+ *      - false if we couldn't find any matching data.
+ */
+bool fr_btree_delete(fr_btree_t *tree, void const *data)
+{
+	void *found;
+
+	found = fr_btree_remove(tree, data);
+	if (!found) return false;
+
+	if (tree->data_free) tree->data_free(found);
+
+	return true;
+}
+
+/** Return how many elements there are in a tree
+ *
+ * @param[in] tree	to return the element count for.
+ */
+uint32_t fr_btree_num_elements(fr_btree_t const *tree)
+{
+	return tree->num_elements;
+}
+
+/** Return the smallest element in the tree
+ *
+ */
+void *fr_btree_first(fr_btree_t const *tree)
+{
+	fr_btree_node_t *node = tree->root;
+
+	if (!node->num) return NULL;
+
+	while (!node->leaf) node = CHILDREN(node)[0];
+
+	return node->items[0].data;
+}
+
+/** Return the largest element in the tree
+ *
+ */
+void *fr_btree_last(fr_btree_t const *tree)
+{
+	fr_btree_node_t *node = tree->root;
+
+	if (!node->num) return NULL;
+
+	while (!node->leaf) node = CHILDREN(node)[node->num];
+
+	return node->items[node->num - 1].data;
+}
+
+/** Push the path to the smallest element under node onto the iterator's stack
+ *
+ */
+static inline CC_HINT(always_inline) void iter_push_leftmost(fr_btree_iter_inorder_t *iter, fr_btree_node_t *node)
+{
+	for (;;) {
+		fr_assert(iter->depth < FR_BTREE_MAX_DEPTH);
+
+		iter->stack[iter->depth].node = node;
+		iter->stack[iter->depth].idx = 0;
+		iter->depth++;
+
+		if (node->leaf) return;
+		node = CHILDREN(node)[0];
+	}
+}
+
+/** Initialise an in-order iterator
+ *
+ * @param[out] iter	to initialise.
+ * @param[in] tree	to iterate over.
+ * @return
+ *	- The first element.
+ *	- NULL if the tree is empty.
+ */
+void *fr_btree_iter_init_inorder(fr_btree_iter_inorder_t *iter, fr_btree_t const *tree)
+{
+	iter->tree = tree;
+	iter->depth = 0;
+
+	if (!tree->root->num) return NULL;
+
+	iter_push_leftmost(iter, tree->root);
+
+	return fr_btree_iter_next_inorder(iter);
+}
+
+/** Return the next element
+ *
+ * @param[in] iter	previously initialised with #fr_btree_iter_init_inorder
+ * @return
+ *	- The next element.
+ *	- NULL if there are no more elements.
+ */
+void *fr_btree_iter_next_inorder(fr_btree_iter_inorder_t *iter)
+{
+	while (iter->depth > 0) {
+		fr_btree_node_t	*node = iter->stack[iter->depth - 1].node;
+		unsigned int	idx = iter->stack[iter->depth - 1].idx;
+
+		if (idx >= node->num) {
+			iter->depth--;
+			continue;
+		}
+
+		/*
+		 *	Everything to the left of this element has
+		 *	been returned, so return it, and move on to
+		 *	the subtree to the right.
+		 */
+		iter->stack[iter->depth - 1].idx++;
+		if (!node->leaf) iter_push_leftmost(iter, CHILDREN(node)[idx + 1]);
+
+		return node->items[idx].data;
+	}
+
+	return NULL;
+}
+
+/** Copy all elements out of a tree, in order
+ *
+ * @param[in] ctx	to allocate array in.
+ * @param[out] out	array of elements.
+ * @param[in] tree	to flatten.
+ * @return
+ *	- 0 on success.
+ *      - -1 on failure.
+ */
+int fr_btree_flatten_inorder(TALLOC_CTX *ctx, void **out[], fr_btree_t const *tree)
+{
+	uint32_t		num = fr_btree_num_elements(tree), i;
+	fr_btree_iter_inorder_t	iter;
+	void			*item, **list;
+
+	if (unlikely(!(list = talloc_array(ctx, void *, num)))) return -1;
+
+	for (item = fr_btree_iter_init_inorder(&iter, tree), i = 0;
+	     item;
+	     item = fr_btree_iter_next_inorder(&iter), i++) list[i] = item;
+
+	*out = list;
+
+	return 0;
+}
+
+/** Check the structure of a subtree
+ *
+ * @return the number of elements in the subtree.
+ */
+static uint32_t node_verify(fr_btree_t const *tree, fr_btree_node_t const *node, bool root,
+			    unsigned int depth, unsigned int *leaf_depth)
+{
+	uint32_t	count = node->num;
+	unsigned int	i;
+
+	fr_assert_msg(depth < FR_BTREE_MAX_DEPTH, "CONSISTENCY CHECK FAILED: tree is too deep");
+	fr_assert_msg(node->num <= BTREE_MAX_ITEMS, "CONSISTENCY CHECK FAILED: node has too many elements");
+	fr_assert_msg(root || (node->num >= BTREE_MIN_ITEMS),
+		      "CONSISTENCY CHECK FAILED: node has too few elements");
+
+	for (i = 0; i < node->num; i++) {
+		fr_assert_msg(node->items[i].key == item_key(tree, node->items[i].data),
+			      "CONSISTENCY CHECK FAILED: element key changed");
+		if (i == 0) continue;
+
+		fr_assert_msg(item_cmp(tree, node->items[i - 1].key, node->items[i - 1].data, &node->items[i]) < 0,
+			      "CONSISTENCY CHECK FAILED: elements out of order");
+	}
+
+	if (node->leaf) {
+		if (*leaf_depth == 0) *leaf_depth = depth;
+		fr_assert_msg(*leaf_depth == depth, "CONSISTENCY CHECK FAILED: leaves at different depths");
+		return count;
+	}
+
+	for (i = 0; i <= node->num; i++) {
+		fr_btree_node_t const *child = CHILDREN_CONST(node)[i];
+
+		if (i > 0) {
+			fr_assert_msg(item_cmp(tree, node->items[i - 1].key, node->items[i - 1].data,
+					       &child->items[0]) < 0,
+				      "CONSISTENCY CHECK FAILED: child overlaps the element to its left");
+		}
+		if (i < node->num) {
+			fr_assert_msg(item_cmp(tree, child->items[child->num - 1].key, child->items[child->num - 1].data,
+					       &node->items[i]) < 0,
+				      "CONSISTENCY CHECK FAILED: child overlaps the element to its right");
+		}
+
+		count += node_verify(tree, child, false, depth + 1, leaf_depth);
+	}
+
+	return count;
+}
+
+/** Check the tree is sane
+ *
+ */
+void fr_btree_verify(fr_btree_t const *tree)
+{
+	unsigned int	leaf_depth = 0;
+	uint32_t	count;
+
+	(void)talloc_get_type_abort_const(tree, fr_btree_t);
+
+	count = node_verify(tree, tree->root, true, 1, &leaf_depth);
+	fr_assert_msg(count == tree->num_elements, "CONSISTENCY CHECK FAILED: element count mismatch");
+}
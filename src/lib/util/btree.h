@@ -0,0 +1,181 @@
+#pragma once
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** In-memory B-tree, with wide nodes
+ *
+ * A drop in alternative to #fr_rb_tree_t for lookup heavy structures.
+ * Each node holds up to 15 elements, so a tree of a million elements
+ * is 5-7 levels deep, instead of 20-40, and most of the comparisons
+ * for a lookup are done within one or two cache lines.
+ *
+ * Elements aren't linked into the tree, so there's no equivalent of
+ * the inline #fr_rb_node_t, and inserting an element doesn't
+ * usually allocate memory.
+ *
+ * Trees should be given a #fr_btree_key_t callback wherever the
+ * elements have a natural integer prefix.  Without one, every
+ * comparison dereferences an element, and lookups in large trees
+ * are no faster than with #fr_rb_tree_t.
+ *
+ * @file src/lib/util/btree.h
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(fr_btree_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/util/misc.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Maximum depth of a tree
+ *
+ * Every node other than the root has at least 8 children, so
+ * this is enough for more elements than we can address.
+ */
+#define FR_BTREE_MAX_DEPTH	(16)
+
+typedef struct fr_btree_s fr_btree_t;
+typedef struct fr_btree_node_s fr_btree_node_t;
+
+/** Produce a 64bit key for an element
+ *
+ * The key must order elements the same way as the tree's comparator,
+ * i.e. if key(a) < key(b) then cmp(a, b) < 0.  Elements with equal
+ * keys are ordered by the comparator, so the key only needs to
+ * capture the leading fields of the comparison.
+ */
+typedef uint64_t (*fr_btree_key_t)(void const *data);
+
+/** Creates a B-tree that verifies elements are of a specific talloc type
+ *
+ * @param[in] _ctx		to tie tree lifetime to.
+ *				If ctx is freed, tree will free any nodes, calling the
+ *				free function if set.
+ * @param[in] _type		of item being stored in the tree, e.g. fr_value_box_t.
+ * @param[in] _data_cmp		Callback to compare the key used for searching.
+ * @param[in] _data_free	Optional function used to free data if tree nodes are
+ *				deleted or replaced.
+ * @return
+ *	- A new B-tree on success.
+ *	- NULL on failure.
+ */
+#define		fr_btree_talloc_alloc(_ctx, _type, _data_cmp, _data_free) \
+		_fr_btree_alloc(_ctx, #_type, _data_cmp, NULL, _data_free)
+
+/** Creates a B-tree, with keys, that verifies elements are of a specific talloc type
+ *
+ * @param[in] _ctx		to tie tree lifetime to.
+ *				If ctx is freed, tree will free any nodes, calling the
+ *				free function if set.
+ * @param[in] _type		of item being stored in the tree, e.g. fr_value_box_t.
+ * @param[in] _data_cmp		Callback to compare the key used for searching.
+ * @param[in] _data_key		Callback to produce a key consistent with _data_cmp.
+ * @param[in] _data_free	Optional function used to free data if tree nodes are
+ *				deleted or replaced.
+ * @return
+ *	- A new B-tree on success.
+ *	- NULL on failure.
+ */
+#define		fr_btree_keyed_talloc_alloc(_ctx, _type, _data_cmp, _data_key, _data_free) \
+		_fr_btree_alloc(_ctx, #_type, _data_cmp, _data_key, _data_free)
+
+/** Creates a B-tree
+ *
+ * @param[in] _ctx		to tie tree lifetime to.
+ *				If ctx is freed, tree will free any nodes, calling the
+ *				free function if set.
+ * @param[in] _data_cmp		Callback to compare the key used for searching.
+ * @param[in] _data_free	Optional function used to free data if tree nodes are
+ *				deleted or replaced.
+ * @return
+ *	- A new B-tree on success.
+ *	- NULL on failure.
+ */
+#define		fr_btree_alloc(_ctx, _data_cmp, _data_free) \
+		_fr_btree_alloc(_ctx, NULL, _data_cmp, NULL, _data_free)
+
+/** Creates a B-tree, with keys
+ *
+ * @param[in] _ctx		to tie tree lifetime to.
+ *				If ctx is freed, tree will free any nodes, calling the
+ *				free function if set.
+ * @param[in] _data_cmp		Callback to compare the key used for searching.
+ * @param[in] _data_key		Callback to produce a key consistent with _data_cmp.
+ * @param[in] _data_free	Optional function used to free data if tree nodes are
+ *				deleted or replaced.
+ * @return
+ *	- A new B-tree on success.
+ *	- NULL on failure.
+ */
+#define		fr_btree_keyed_alloc(_ctx, _data_cmp, _data_key, _data_free) \
+		_fr_btree_alloc(_ctx, NULL, _data_cmp, _data_key, _data_free)
+
+fr_btree_t	*_fr_btree_alloc(TALLOC_CTX *ctx, char const *type,
+				 fr_cmp_t data_cmp, fr_btree_key_t data_key, fr_free_t data_free) CC_HINT(nonnull(3));
+
+void		*fr_btree_find(fr_btree_t const *tree, void const *data) CC_HINT(nonnull);
+
+int		fr_btree_find_or_insert(void **found, fr_btree_t *tree, void const *data) CC_HINT(nonnull(2,3));
+
+bool		fr_btree_insert(fr_btree_t *tree, void const *data) CC_HINT(nonnull);
+
+int		fr_btree_replace(void **old, fr_btree_t *tree, void const *data) CC_HINT(nonnull(2,3));
+
+void		*fr_btree_remove(fr_btree_t *tree, void const *data) CC_HINT(nonnull);
+
+bool		fr_btree_delete(fr_btree_t *tree, void const *data) CC_HINT(nonnull);
+
+uint32_t	fr_btree_num_elements(fr_btree_t const *tree) CC_HINT(nonnull);
+
+void		*fr_btree_first(fr_btree_t const *tree) CC_HINT(nonnull);
+
+void		*fr_btree_last(fr_btree_t const *tree) CC_HINT(nonnull);
+
+/** Iterator structure for in-order traversal of a B-tree
+ *
+ * @note If the tree is modified the iterator should be considered invalidated.
+ */
+typedef struct {
+	fr_btree_t const	*tree;				//!< Tree being iterated over.
+	unsigned int		depth;				//!< Number of entries in the stack.
+	struct {
+		fr_btree_node_t	*node;				//!< Node being iterated over.
+		unsigned int	idx;				//!< Next element to return from the node.
+	} stack[FR_BTREE_MAX_DEPTH];
+} fr_btree_iter_inorder_t;
+
+void		*fr_btree_iter_init_inorder(fr_btree_iter_inorder_t *iter, fr_btree_t const *tree) CC_HINT(nonnull);
+
+void		*fr_btree_iter_next_inorder(fr_btree_iter_inorder_t *iter) CC_HINT(nonnull);
+
+#define fr_btree_inorder_foreach(_tree, _type, _iter) \
+{ \
+	fr_btree_iter_inorder_t _state; \
+	for (_type *_iter = fr_btree_iter_init_inorder(&_state, _tree); _iter; _iter = fr_btree_iter_next_inorder(&_state))
+
+int		fr_btree_flatten_inorder(TALLOC_CTX *ctx, void **out[], fr_btree_t const *tree);
+
+void		fr_btree_verify(fr_btree_t const *tree) CC_HINT(nonnull);
+
+#ifdef __cplusplus
+}
+#endif
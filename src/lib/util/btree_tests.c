@@ -0,0 +1,378 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for B-trees
+ *
+ * @file src/lib/util/btree_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/btree.h>
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/rb.h>
+#include <freeradius-devel/util/time.h>
+
+#define MAXSIZE		(1024 * 8)
+
+#define BENCH_ENTRIES	(1024 * 256)
+#define BENCH_LOOKUPS	(1024 * 1024 * 4)
+
+typedef struct {
+	uint32_t	num;
+	bool		in_tree;
+	fr_rb_node_t	node;		//!< Only used by the rb tree benchmark.
+} btree_test_node_t;
+
+static int8_t btree_test_cmp(void const *one, void const *two)
+{
+	btree_test_node_t const *a = one, *b = two;
+	return CMP(a->num, b->num);
+}
+
+/*
+ *	Deliberately coarse, so the comparator is still needed
+ *	to tell apart the elements with equal keys.
+ */
+static uint64_t btree_test_key(void const *one)
+{
+	btree_test_node_t const *a = one;
+	return a->num >> 4;
+}
+
+static uint64_t btree_bench_key(void const *one)
+{
+	btree_test_node_t const *a = one;
+	return a->num;
+}
+
+static fr_btree_t *btree_test_alloc(bool keyed, fr_free_t data_free)
+{
+	return fr_btree_keyed_alloc(NULL, btree_test_cmp, keyed ? btree_test_key : NULL, data_free);
+}
+
+static int btree_qsort_cmp(void const *one, void const *two)
+{
+	btree_test_node_t const *a = one, *b = two;
+	return CMP(a->num, b->num);
+}
+
+/** Allocate test nodes with unique values, in random order
+ *
+ */
+static btree_test_node_t *nodes_alloc(TALLOC_CTX *ctx, size_t num)
+{
+	btree_test_node_t	*nodes;
+	size_t			i;
+
+	nodes = talloc_zero_array(ctx, btree_test_node_t, num);
+	for (i = 0; i < num; i++) nodes[i].num = i * 2;
+
+	for (i = num - 1; i > 0; i--) {
+		size_t		j = fr_rand() % (i + 1);
+		uint32_t	tmp = nodes[i].num;
+
+		nodes[i].num = nodes[j].num;
+		nodes[j].num = tmp;
+	}
+
+	return nodes;
+}
+
+static void btree_test_insert_find(bool keyed)
+{
+	fr_btree_t		*t;
+	btree_test_node_t	*nodes, miss;
+	size_t			i;
+
+	TEST_CASE("insert and find");
+	t = btree_test_alloc(keyed, NULL);
+	TEST_CHECK(t != NULL);
+
+	nodes = nodes_alloc(t, MAXSIZE);
+	for (i = 0; i < MAXSIZE; i++) {
+		TEST_CHECK(fr_btree_insert(t, &nodes[i]));
+		TEST_MSG("Failed inserting %u", nodes[i].num);
+	}
+	fr_btree_verify(t);
+	TEST_CHECK(fr_btree_num_elements(t) == MAXSIZE);
+
+	for (i = 0; i < MAXSIZE; i++) {
+		TEST_CHECK(fr_btree_find(t, &nodes[i]) == &nodes[i]);
+		TEST_MSG("Failed finding %u", nodes[i].num);
+
+		miss.num = nodes[i].num + 1;
+		TEST_CHECK(fr_btree_find(t, &miss) == NULL);
+		TEST_MSG("Found %u which was never inserted", miss.num);
+	}
+
+	TEST_CASE("duplicates are rejected");
+	for (i = 0; i < MAXSIZE; i++) {
+		btree_test_node_t	dup = { .num = nodes[i].num };
+		void			*found;
+
+		TEST_CHECK(!fr_btree_insert(t, &dup));
+		TEST_CHECK(fr_btree_find_or_insert(&found, t, &dup) == 1);
+		TEST_CHECK(found == &nodes[i]);
+	}
+	TEST_CHECK(fr_btree_num_elements(t) == MAXSIZE);
+
+	talloc_free(t);
+}
+
+static void btree_test_remove(bool keyed)
+{
+	fr_btree_t		*t;
+	btree_test_node_t	*nodes;
+	size_t			i, count = 0;
+
+	TEST_CASE("random insert and remove");
+	t = btree_test_alloc(keyed, NULL);
+	nodes = nodes_alloc(t, MAXSIZE);
+
+	for (i = 0; i < (MAXSIZE * 16); i++) {
+		btree_test_node_t *p = &nodes[fr_rand() % MAXSIZE];
+
+		if (p->in_tree) {
+			TEST_CHECK(fr_btree_remove(t, p) == p);
+			TEST_CHECK(fr_btree_remove(t, p) == NULL);
+			p->in_tree = false;
+			count--;
+		} else {
+			TEST_CHECK(fr_btree_insert(t, p));
+			p->in_tree = true;
+			count++;
+		}
+		TEST_CHECK(fr_btree_num_elements(t) == count);
+
+		if ((i % 1024) == 0) fr_btree_verify(t);
+	}
+	fr_btree_verify(t);
+
+	for (i = 0; i < MAXSIZE; i++) {
+		TEST_CHECK((fr_btree_find(t, &nodes[i]) != NULL) == nodes[i].in_tree);
+		TEST_MSG("Tree and node disagree on whether %u is present", nodes[i].num);
+	}
+
+	TEST_CASE("remove everything");
+	for (i = 0; i < MAXSIZE; i++) {
+		if (!nodes[i].in_tree) continue;
+
+		TEST_CHECK(fr_btree_delete(t, &nodes[i]));
+		nodes[i].in_tree = false;
+	}
+	fr_btree_verify(t);
+	TEST_CHECK(fr_btree_num_elements(t) == 0);
+	TEST_CHECK(fr_btree_first(t) == NULL);
+	TEST_CHECK(fr_btree_last(t) == NULL);
+
+	talloc_free(t);
+}
+
+static void btree_test_unkeyed(void)
+{
+	btree_test_insert_find(false);
+	btree_test_remove(false);
+}
+
+static void btree_test_keyed(void)
+{
+	btree_test_insert_find(true);
+	btree_test_remove(true);
+}
+
+static void btree_test_replace(void)
+{
+	fr_btree_t		*t;
+	btree_test_node_t	a = { .num = 1 }, b = { .num = 1 }, c = { .num = 2 };
+	void			*old;
+
+	TEST_CASE("replace");
+	t = btree_test_alloc(true, NULL);
+
+	TEST_CHECK(fr_btree_replace(&old, t, &a) == 0);
+	TEST_CHECK(old == NULL);
+
+	TEST_CHECK(fr_btree_replace(&old, t, &b) == 1);
+	TEST_CHECK(old == &a);
+	TEST_CHECK(fr_btree_find(t, &a) == &b);
+
+	TEST_CHECK(fr_btree_replace(&old, t, &c) == 0);
+	TEST_CHECK(fr_btree_num_elements(t) == 2);
+
+	talloc_free(t);
+}
+
+static void btree_test_iter_inorder(void)
+{
+	fr_btree_t		*t;
+	btree_test_node_t	*nodes, *sorted, *p;
+	void			**flat;
+	size_t			n, i;
+	fr_btree_iter_inorder_t	iter;
+
+	TEST_CASE("in-order iterator");
+	t = btree_test_alloc(true, NULL);
+
+	n = (fr_rand() % MAXSIZE) + 1;
+	nodes = nodes_alloc(t, n);
+	sorted = talloc_memdup(t, nodes, sizeof(*nodes) * n);
+	qsort(sorted, n, sizeof(*sorted), btree_qsort_cmp);
+
+	for (i = 0; i < n; i++) fr_btree_insert(t, &nodes[i]);
+
+	for (p = fr_btree_iter_init_inorder(&iter, t), i = 0;
+	     p;
+	     p = fr_btree_iter_next_inorder(&iter), i++) {
+		TEST_MSG("Checking sorted[%zu] s = %u vs n = %u", i, sorted[i].num, p->num);
+		TEST_CHECK(sorted[i].num == p->num);
+	}
+	TEST_CHECK(i == n);
+
+	TEST_CHECK(((btree_test_node_t *)fr_btree_first(t))->num == sorted[0].num);
+	TEST_CHECK(((btree_test_node_t *)fr_btree_last(t))->num == sorted[n - 1].num);
+
+	TEST_CASE("flatten");
+	TEST_CHECK(fr_btree_flatten_inorder(t, &flat, t) == 0);
+	for (i = 0; i < n; i++) TEST_CHECK(((btree_test_node_t *)flat[i])->num == sorted[i].num);
+
+	talloc_free(t);
+}
+
+static unsigned int btree_test_freed;
+
+static void btree_test_free(UNUSED void *data)
+{
+	btree_test_freed++;
+}
+
+static void btree_test_free_data(void)
+{
+	fr_btree_t		*t;
+	btree_test_node_t	*nodes;
+	size_t			i;
+
+	TEST_CASE("free callback is called for deleted and remaining elements");
+	t = btree_test_alloc(false, btree_test_free);
+	nodes = nodes_alloc(NULL, MAXSIZE);
+	btree_test_freed = 0;
+
+	for (i = 0; i < MAXSIZE; i++) fr_btree_insert(t, &nodes[i]);
+	for (i = 0; i < MAXSIZE / 2; i++) fr_btree_delete(t, &nodes[i]);
+	TEST_CHECK(btree_test_freed == MAXSIZE / 2);
+
+	talloc_free(t);
+	TEST_CHECK(btree_test_freed == MAXSIZE);
+	TEST_MSG("Expected %u frees, got %u", MAXSIZE, btree_test_freed);
+
+	talloc_free(nodes);
+}
+
+/*
+ *	Benchmarks, comparing the B-tree with the red-black tree,
+ *	for a tree much larger than the L1 and L2 caches.
+ */
+typedef struct {
+	uint64_t	insert;
+	uint64_t	find;
+	uint64_t	remove;
+} btree_bench_t;
+
+static void btree_bench_btree(btree_bench_t *out, btree_test_node_t *nodes, bool keyed)
+{
+	fr_btree_t	*t;
+	fr_time_t	start;
+	size_t		i;
+
+	t = fr_btree_keyed_alloc(NULL, btree_test_cmp, keyed ? btree_bench_key : NULL, NULL);
+
+	start = fr_time();
+	for (i = 0; i < BENCH_ENTRIES; i++) fr_btree_insert(t, &nodes[i]);
+	out->insert = fr_time_delta_unwrap(fr_time_sub(fr_time(), start));
+
+	start = fr_time();
+	for (i = 0; i < BENCH_LOOKUPS; i++) {
+		if (unlikely(!fr_btree_find(t, &nodes[(i * 7919) % BENCH_ENTRIES]))) TEST_CHECK(false);
+	}
+	out->find = fr_time_delta_unwrap(fr_time_sub(fr_time(), start));
+
+	start = fr_time();
+	for (i = 0; i < BENCH_ENTRIES; i++) fr_btree_remove(t, &nodes[(i * 7919) % BENCH_ENTRIES]);
+	out->remove = fr_time_delta_unwrap(fr_time_sub(fr_time(), start));
+
+	TEST_CHECK(fr_btree_num_elements(t) == 0);
+	talloc_free(t);
+}
+
+static void btree_bench_rb(btree_bench_t *out, btree_test_node_t *nodes)
+{
+	fr_rb_tree_t	*t;
+	fr_time_t	start;
+	size_t		i;
+
+	t = fr_rb_inline_alloc(NULL, btree_test_node_t, node, btree_test_cmp, NULL);
+
+	start = fr_time();
+	for (i = 0; i < BENCH_ENTRIES; i++) fr_rb_insert(t, &nodes[i]);
+	out->insert = fr_time_delta_unwrap(fr_time_sub(fr_time(), start));
+
+	start = fr_time();
+	for (i = 0; i < BENCH_LOOKUPS; i++) {
+		if (unlikely(!fr_rb_find(t, &nodes[(i * 7919) % BENCH_ENTRIES]))) TEST_CHECK(false);
+	}
+	out->find = fr_time_delta_unwrap(fr_time_sub(fr_time(), start));
+
+	start = fr_time();
+	for (i = 0; i < BENCH_ENTRIES; i++) fr_rb_remove(t, &nodes[(i * 7919) % BENCH_ENTRIES]);
+	out->remove = fr_time_delta_unwrap(fr_time_sub(fr_time(), start));
+
+	TEST_CHECK(fr_rb_num_elements(t) == 0);
+	talloc_free(t);
+}
+
+static void btree_bench(void)
+{
+	btree_test_node_t	*nodes;
+	btree_bench_t		btree, keyed, rb;
+
+	nodes = nodes_alloc(NULL, BENCH_ENTRIES);
+
+	btree_bench_btree(&btree, nodes, false);
+	btree_bench_btree(&keyed, nodes, true);
+	btree_bench_rb(&rb, nodes);
+
+	TEST_MSG_ALWAYS("%u entries, %u lookups\n", BENCH_ENTRIES, BENCH_LOOKUPS);
+	TEST_MSG_ALWAYS("fr_btree:        insert %"PRIu64" ns, find %"PRIu64" ns, remove %"PRIu64" ns\n",
+			btree.insert / BENCH_ENTRIES, btree.find / BENCH_LOOKUPS, btree.remove / BENCH_ENTRIES);
+	TEST_MSG_ALWAYS("fr_btree, keyed: insert %"PRIu64" ns, find %"PRIu64" ns, remove %"PRIu64" ns\n",
+			keyed.insert / BENCH_ENTRIES, keyed.find / BENCH_LOOKUPS, keyed.remove / BENCH_ENTRIES);
+	TEST_MSG_ALWAYS("fr_rb:           insert %"PRIu64" ns, find %"PRIu64" ns, remove %"PRIu64" ns\n",
+			rb.insert / BENCH_ENTRIES, rb.find / BENCH_LOOKUPS, rb.remove / BENCH_ENTRIES);
+
+	talloc_free(nodes);
+}
+
+TEST_LIST = {
+	{ "btree_test_unkeyed",		btree_test_unkeyed },
+	{ "btree_test_keyed",		btree_test_keyed },
+	{ "btree_test_replace",		btree_test_replace },
+	{ "btree_test_iter_inorder",	btree_test_iter_inorder },
+	{ "btree_test_free_data",	btree_test_free_data },
+	{ "btree_bench",		btree_bench },
+
+	{ NULL }
+};
@@ -0,0 +1,8 @@
+TARGET      	:= btree_tests$(E)
+SOURCES     	:= btree_tests.c
+
+TGT_LDLIBS  	:= $(LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS 	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS 	:= libfreeradius-util$(L)
+
+TGT_INSTALLDIR	:=
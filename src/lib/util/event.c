@@ -33,6 +33,7 @@ RCSID("$Id$")
 #include <freeradius-devel/util/event.h>
 #include <freeradius-devel/util/lst.h>
 #include <freeradius-devel/util/log.h>
+#include <freeradius-devel/util/math.h>
 #include <freeradius-devel/util/rb.h>
 #include <freeradius-devel/util/strerror.h>
 #include <freeradius-devel/util/syserror.h>
@@ -56,6 +57,23 @@ DIAG_ON(DIAG_UNKNOWN_PRAGMAS)
 
 #define FR_EV_BATCH_FDS (256)
 
+/** Timer wheel geometry
+ *
+ * The wheel has EVENT_WHEEL_LEVELS levels of EVENT_WHEEL_SLOTS slots.  Each
+ * slot in level 0 covers one tick, and each slot in level n covers
+ * EVENT_WHEEL_SLOTS slots of level n - 1.  With a granularity of ~1ms the
+ * wheel covers ~4.6 hours.  Timers further out than that go into the lst.
+ */
+#define EVENT_WHEEL_BITS	(6)
+#define EVENT_WHEEL_SLOTS	(1 << EVENT_WHEEL_BITS)
+#define EVENT_WHEEL_MASK	(EVENT_WHEEL_SLOTS - 1)
+#define EVENT_WHEEL_LEVELS	(4)
+
+/** Default timer wheel granularity, as a power of two nanoseconds (~1ms)
+ *
+ */
+#define EVENT_WHEEL_DEFAULT_SHIFT (20)
+
 DIAG_OFF(unused-macros)
 #define fr_time() static_assert(0, "Use el->time for event loop timing")
 DIAG_ON(unused-macros)
@@ -113,6 +131,10 @@ struct fr_event_timer {
 	fr_lst_index_t		lst_id;	     	  	//!< Where to store opaque lst data.
 	fr_dlist_t		entry;			//!< List of deferred timer events.
 
+	fr_dlist_head_t		*wheel_slot;		//!< Timer wheel slot we're in, or NULL if we're
+							///< in the lst, or the deferred list.
+	fr_dlist_t		wheel_entry;		//!< Entry in the timer wheel slot.
+
 	fr_event_list_t		*el;			//!< Event list containing this timer.
 
 #ifndef NDEBUG
@@ -405,11 +427,29 @@ typedef struct {
 	void			*uctx;			//!< Context for the callback.
 } fr_event_post_t;
 
+/** Hierarchical timer wheel for coarse timers
+ *
+ * Most timers are timeouts which are cancelled long before they fire.
+ * Inserting and removing them from the wheel is O(1).  Timers are moved
+ * from the wheel to the lst during the tick before they're due, so they
+ * still fire at exactly the time requested.
+ */
+typedef struct {
+	uint8_t			shift;			//!< log2 of the tick length in nanoseconds.
+							///< Zero if the wheel is disabled.
+	uint64_t		tick;			//!< All timers due at or before this tick are in the lst.
+	uint64_t		num;			//!< Number of timers in the wheel.
+	uint64_t		occupied[EVENT_WHEEL_LEVELS];	//!< Bitmap of non-empty slots in each level.
+	fr_dlist_head_t		slot[EVENT_WHEEL_LEVELS][EVENT_WHEEL_SLOTS];
+} fr_event_wheel_t;
+
 /** Stores all information relating to an event list
  *
  */
 struct fr_event_list {
 	fr_lst_t		*times;			//!< of timer events to be executed.
+	fr_event_wheel_t	wheel;			//!< of coarse timer events, which are moved to
+							///< the lst shortly before they're due.
 	fr_rb_tree_t		*fds;			//!< Tree used to track FDs with filters in kqueue.
 
 	int			will_exit;		//!< Will exit on next call to fr_event_corral.
@@ -607,7 +647,7 @@ uint64_t fr_event_list_num_timers(fr_event_list_t *el)
 {
 	if (unlikely(!el)) return -1;
 
-	return fr_lst_num_elements(el->times);
+	return fr_lst_num_elements(el->times) + el->wheel.num;
 }
 
 /** Return the kq associated with an event list.
@@ -1378,6 +1418,234 @@ int fr_event_fd_unarmour(fr_event_list_t *el, int fd, fr_event_filter_t filter,
 }
 #endif
 
+/** Convert a time to a timer wheel tick
+ *
+ */
+static inline CC_HINT(always_inline) uint64_t event_wheel_tick(fr_event_wheel_t const *wheel, fr_time_t when)
+{
+	int64_t ns = fr_time_unwrap(when);
+
+	return (ns > 0) ? ((uint64_t) ns) >> wheel->shift : 0;
+}
+
+/** Insert a timer into the timer wheel, or the lst
+ *
+ * Timers which are due in the current tick, or which are beyond the range
+ * of the wheel, go into the lst.  Everything else goes into the wheel, at
+ * the level of the highest bit which differs between the timer's tick,
+ * and the current tick.  This means the timer is never inserted into
+ * the slot the wheel is currently processing.
+ *
+ * @param[in] el	containing the timers.
+ * @param[in] ev	to insert.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static inline CC_HINT(always_inline) int event_timer_insert(fr_event_list_t *el, fr_event_timer_t *ev)
+{
+	fr_event_wheel_t	*wheel = &el->wheel;
+	uint64_t		tick;
+	unsigned int		level, idx;
+
+	if (!wheel->shift) goto lst;
+
+	tick = event_wheel_tick(wheel, ev->when);
+	if (tick <= wheel->tick) goto lst;
+
+	level = (fr_high_bit_pos(tick ^ wheel->tick) - 1) / EVENT_WHEEL_BITS;
+	if (level >= EVENT_WHEEL_LEVELS) goto lst;
+
+	idx = (tick >> (level * EVENT_WHEEL_BITS)) & EVENT_WHEEL_MASK;
+
+	ev->wheel_slot = &wheel->slot[level][idx];
+	fr_dlist_insert_tail(ev->wheel_slot, ev);
+	wheel->occupied[level] |= ((uint64_t) 1) << idx;
+	wheel->num++;
+
+	return 0;
+
+lst:
+	return fr_lst_insert(el->times, ev);
+}
+
+/** Remove a timer from the timer wheel
+ *
+ */
+static inline CC_HINT(always_inline) void event_wheel_remove(fr_event_wheel_t *wheel, fr_event_timer_t *ev)
+{
+	fr_dlist_head_t	*slot = ev->wheel_slot;
+	size_t		n;
+
+	(void) fr_dlist_remove(slot, ev);
+	ev->wheel_slot = NULL;
+	wheel->num--;
+
+	if (!fr_dlist_empty(slot)) return;
+
+	n = slot - &wheel->slot[0][0];
+	wheel->occupied[n / EVENT_WHEEL_SLOTS] &= ~(((uint64_t) 1) << (n % EVENT_WHEEL_SLOTS));
+}
+
+/** Remove a timer from the timer wheel, or the lst
+ *
+ */
+static inline CC_HINT(always_inline) int event_timer_extract(fr_event_list_t *el, fr_event_timer_t *ev)
+{
+	if (ev->wheel_slot) {
+		event_wheel_remove(&el->wheel, ev);
+		return 0;
+	}
+
+	return fr_lst_extract(el->times, ev);
+}
+
+/** Re-insert all of the timers in a wheel slot
+ *
+ * They'll either go into a lower level of the wheel, or into the lst.
+ */
+static void event_wheel_cascade(fr_event_list_t *el, unsigned int level, unsigned int idx)
+{
+	fr_event_wheel_t	*wheel = &el->wheel;
+	fr_dlist_head_t		*slot = &wheel->slot[level][idx];
+	fr_event_timer_t	*ev;
+
+	if (!(wheel->occupied[level] & (((uint64_t) 1) << idx))) return;
+	wheel->occupied[level] &= ~(((uint64_t) 1) << idx);
+
+	while ((ev = fr_dlist_pop_head(slot)) != NULL) {
+		ev->wheel_slot = NULL;
+		wheel->num--;
+
+		if (unlikely(event_timer_insert(el, ev) < 0)) {
+			talloc_free(ev);
+			fr_assert_msg(0, "failed inserting lst event: %s", fr_strerror());	/* Die in debug builds */
+		}
+	}
+}
+
+/** Return the rotation of a 64bit bitmap
+ *
+ */
+static inline CC_HINT(always_inline) uint64_t event_wheel_rotr(uint64_t bits, unsigned int n)
+{
+	n &= 63;
+	return n ? (bits >> n) | (bits << (64 - n)) : bits;
+}
+
+/** Return the next tick at which the timer wheel has work to do
+ *
+ * For level 0 this is the tick of the next timer.  For the higher levels
+ * it's the start of the next non-empty slot, where that slot's timers are
+ * cascaded into the lower levels.
+ *
+ * @param[in] wheel	to check.
+ * @return the next tick, or UINT64_MAX if the wheel is empty.
+ */
+static uint64_t event_wheel_next(fr_event_wheel_t const *wheel)
+{
+	uint64_t	next = UINT64_MAX;
+	unsigned int	level;
+
+	for (level = 0; level < EVENT_WHEEL_LEVELS; level++) {
+		uint64_t	group, start;
+		unsigned int	cur;
+
+		if (!wheel->occupied[level]) continue;
+
+		group = wheel->tick >> (level * EVENT_WHEEL_BITS);
+		cur = group & EVENT_WHEEL_MASK;
+
+		start = (group + fr_low_bit_pos(event_wheel_rotr(wheel->occupied[level], cur + 1)))
+			<< (level * EVENT_WHEEL_BITS);
+		if (start < next) next = start;
+	}
+
+	return next;
+}
+
+/** Return when the timer wheel next needs to be advanced
+ *
+ * Timers are moved to the lst one tick before they're due, so we wake
+ * up one tick earlier than the wheel's next tick.
+ */
+static inline CC_HINT(always_inline) fr_time_t event_wheel_when(fr_event_wheel_t const *wheel)
+{
+	return fr_time_wrap((int64_t) ((event_wheel_next(wheel) - 1) << wheel->shift));
+}
+
+/** Move any timers which are due before the end of the next tick, from the wheel to the lst
+ *
+ * Ticks where there's nothing to do are skipped.  This is safe as every
+ * non-empty slot covers ticks later than the one we skip to, so the
+ * slots of the timers in the wheel don't change.
+ *
+ * @param[in] el	containing the timers.
+ * @param[in] now	the current time.
+ */
+static inline CC_HINT(always_inline) void event_wheel_advance(fr_event_list_t *el, fr_time_t now)
+{
+	fr_event_wheel_t	*wheel = &el->wheel;
+	uint64_t		target;
+
+	if (!wheel->shift) return;
+
+	target = event_wheel_tick(wheel, now) + 1;
+
+	while (wheel->tick < target) {
+		uint64_t	next;
+		unsigned int	level;
+
+		if (!wheel->num) {
+			wheel->tick = target;
+			break;
+		}
+
+		next = event_wheel_next(wheel);
+		if (next > target) {
+			wheel->tick = target;
+			break;
+		}
+		wheel->tick = next;
+
+		/*
+		 *	Cascade from the top down, so that timers
+		 *	end up in the right slot of the levels below.
+		 */
+		for (level = EVENT_WHEEL_LEVELS - 1; level > 0; level--) {
+			if (wheel->tick & ((((uint64_t) 1) << (level * EVENT_WHEEL_BITS)) - 1)) continue;
+
+			event_wheel_cascade(el, level, (wheel->tick >> (level * EVENT_WHEEL_BITS)) & EVENT_WHEEL_MASK);
+		}
+		event_wheel_cascade(el, 0, wheel->tick & EVENT_WHEEL_MASK);
+	}
+}
+
+/** Move every timer from the timer wheel into the lst
+ *
+ */
+static void event_wheel_flush(fr_event_list_t *el)
+{
+	fr_event_wheel_t	*wheel = &el->wheel;
+	unsigned int		level, idx;
+	fr_event_timer_t	*ev;
+
+	for (level = 0; level < EVENT_WHEEL_LEVELS; level++) {
+		for (idx = 0; idx < EVENT_WHEEL_SLOTS; idx++) {
+			while ((ev = fr_dlist_pop_head(&wheel->slot[level][idx])) != NULL) {
+				ev->wheel_slot = NULL;
+				wheel->num--;
+
+				if (unlikely(fr_lst_insert(el->times, ev) < 0)) {
+					talloc_free(ev);
+					fr_assert_msg(0, "failed inserting lst event: %s", fr_strerror());	/* Die in debug builds */
+				}
+			}
+		}
+		wheel->occupied[level] = 0;
+	}
+}
+
 /** Remove an event from the event loop
  *
  * @param[in] ev	to free.
@@ -1393,7 +1661,7 @@ static int _event_timer_free(fr_event_timer_t *ev)
 	if (fr_dlist_entry_in_list(&ev->entry)) {
 		(void) fr_dlist_remove(&el->ev_to_add, ev);
 	} else {
-		int		ret = fr_lst_extract(el->times, ev);
+		int		ret = event_timer_extract(el, ev);
 		char const	*err_file;
 		int		err_line;
 
@@ -1516,7 +1784,7 @@ int _fr_event_timer_at(NDEBUG_LOCATION_ARGS
 			char const	*err_file;
 			int		err_line;
 
-			ret = fr_lst_extract(el->times, ev);
+			ret = event_timer_extract(el, ev);
 
 #ifndef NDEBUG
 			err_file = ev->file;
@@ -1554,7 +1822,7 @@ int _fr_event_timer_at(NDEBUG_LOCATION_ARGS
 		 *	multiple times.
 		 */
 		if (!fr_dlist_entry_in_list(&ev->entry)) fr_dlist_insert_head(&el->ev_to_add, ev);
-	} else if (unlikely(fr_lst_insert(el->times, ev) < 0)) {
+	} else if (unlikely(event_timer_insert(el, ev) < 0)) {
 		fr_strerror_const_push("Failed inserting event");
 		talloc_set_destructor(ev, NULL);
 		*ev_p = NULL;
@@ -2360,14 +2628,11 @@ int fr_event_timer_run(fr_event_list_t *el, fr_time_t *when)
 
 	if (unlikely(!el)) return 0;
 
-	if (fr_lst_num_elements(el->times) == 0) {
-		*when = fr_time_wrap(0);
-		return 0;
-	}
+	event_wheel_advance(el, *when);
 
 	ev = fr_lst_peek(el->times);
 	if (!ev) {
-		*when = fr_time_wrap(0);
+		*when = el->wheel.num ? event_wheel_when(&el->wheel) : fr_time_wrap(0);
 		return 0;
 	}
 
@@ -2376,6 +2641,11 @@ int fr_event_timer_run(fr_event_list_t *el, fr_time_t *when)
 	 */
 	if (fr_time_gt(ev->when, *when)) {
 		*when = ev->when;
+		if (el->wheel.num) {
+			fr_time_t wheel_when = event_wheel_when(&el->wheel);
+
+			if (fr_time_lt(wheel_when, *when)) *when = wheel_when;
+		}
 		return 0;
 	}
 
@@ -2411,6 +2681,7 @@ int fr_event_corral(fr_event_list_t *el, fr_time_t now, bool wait)
 	int			num_fd_events;
 	bool			timer_event_ready = false;
 	fr_event_timer_t	*ev;
+	fr_time_t		next = fr_time_wrap(0);
 
 	el->num_fd_events = 0;
 
@@ -2429,18 +2700,31 @@ int fr_event_corral(fr_event_list_t *el, fr_time_t now, bool wait)
 	wake = &when;
 	el->now = now;
 
+	/*
+	 *	Move any timers which are nearly due from the timer
+	 *	wheel to the lst.
+	 */
+	event_wheel_advance(el, el->now);
+
 	/*
 	 *	See when we have to wake up.  Either now, if the timer
 	 *	events are in the past.  Or, we wait for a future
-	 *	timer event.
+	 *	timer event, or for the timer wheel to need advancing.
 	 */
 	ev = fr_lst_peek(el->times);
-	if (ev) {
-		if (fr_time_lteq(ev->when, el->now)) {
+	if (ev) next = ev->when;
+	if (el->wheel.num) {
+		fr_time_t wheel_when = event_wheel_when(&el->wheel);
+
+		if (!ev || fr_time_lt(wheel_when, next)) next = wheel_when;
+	}
+
+	if (ev || el->wheel.num) {
+		if (fr_time_lteq(next, el->now)) {
 			timer_event_ready = true;
 
 		} else if (wait) {
-			when = fr_time_sub(ev->when, el->now);
+			when = fr_time_sub(next, el->now);
 
 		} /* else we're not waiting, leave "when == 0" */
 
@@ -2683,7 +2967,7 @@ void fr_event_service(fr_event_list_t *el)
 	 *	Run all of the timer events.  Note that these can add
 	 *	new timers!
 	 */
-	if (fr_lst_num_elements(el->times) > 0) {
+	if ((fr_lst_num_elements(el->times) > 0) || el->wheel.num) {
 		el->in_handler = true;
 
 		do {
@@ -2709,7 +2993,7 @@ void fr_event_service(fr_event_list_t *el)
 	 */
 	while ((ev = fr_dlist_head(&el->ev_to_add)) != NULL) {
 		(void)fr_dlist_remove(&el->ev_to_add, ev);
-		if (unlikely(fr_lst_insert(el->times, ev) < 0)) {
+		if (unlikely(event_timer_insert(el, ev) < 0)) {
 			talloc_free(ev);
 			fr_assert_msg(0, "failed inserting lst event: %s", fr_strerror());	/* Die in debug builds */
 		}
@@ -2787,6 +3071,7 @@ static int _event_list_free(fr_event_list_t *el)
 {
 	fr_event_timer_t const *ev;
 
+	event_wheel_flush(el);
 	while ((ev = fr_lst_peek(el->times)) != NULL) fr_event_timer_delete(&ev);
 
 	fr_event_list_reap_signal(el, fr_time_delta_wrap(0), SIGKILL);
@@ -2926,6 +3211,18 @@ fr_event_list_t *fr_event_list_alloc(TALLOC_CTX *ctx, fr_event_status_cb_t statu
 		goto error;
 	}
 
+	{
+		unsigned int level, idx;
+
+		for (level = 0; level < EVENT_WHEEL_LEVELS; level++) {
+			for (idx = 0; idx < EVENT_WHEEL_SLOTS; idx++) {
+				fr_dlist_talloc_init(&el->wheel.slot[level][idx], fr_event_timer_t, wheel_entry);
+			}
+		}
+	}
+	el->wheel.shift = EVENT_WHEEL_DEFAULT_SHIFT;
+	el->wheel.tick = event_wheel_tick(&el->wheel, el->time());
+
 	el->kq = kqueue();
 	if (el->kq < 0) {
 		fr_strerror_printf("Failed allocating kqueue: %s", fr_syserror(errno));
@@ -2963,6 +3260,50 @@ fr_event_list_t *fr_event_list_alloc(TALLOC_CTX *ctx, fr_event_status_cb_t statu
 void fr_event_list_set_time_func(fr_event_list_t *el, fr_event_time_source_t func)
 {
 	el->time = func;
+
+	/*
+	 *	The new time source may be behind the old one, so
+	 *	start the wheel again from the new current time.
+	 */
+	event_wheel_flush(el);
+	if (el->wheel.shift) el->wheel.tick = event_wheel_tick(&el->wheel, el->time());
+}
+
+/** Set the granularity of the timer wheel
+ *
+ * Timers which are due further in the future than the granularity are
+ * kept in a timer wheel, where they can be inserted and deleted in O(1).
+ * They're moved to the lst, which orders timers precisely, shortly before
+ * they're due.  Timers still fire at exactly the time they were set for.
+ *
+ * @param[in] el		to set the granularity for.
+ * @param[in] granularity	of the timer wheel.  Rounded up to a power of
+ *				two nanoseconds.  Zero disables the wheel, so
+ *				that all timers are kept in the lst.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_event_list_set_timer_granularity(fr_event_list_t *el, fr_time_delta_t granularity)
+{
+	int64_t ns = fr_time_delta_unwrap(granularity);
+
+	if (unlikely(ns < 0)) {
+		fr_strerror_const("Timer granularity must not be negative");
+		return -1;
+	}
+
+	if (unlikely(ns > fr_time_delta_unwrap(fr_time_delta_from_sec(60)))) {
+		fr_strerror_const("Timer granularity must be less than 60 seconds");
+		return -1;
+	}
+
+	event_wheel_flush(el);
+
+	el->wheel.shift = (ns <= 1) ? ns : fr_high_bit_pos(ns - 1);
+	if (el->wheel.shift) el->wheel.tick = event_wheel_tick(&el->wheel, el->time());
+
+	return 0;
 }
 
 /** Return whether the event loop has any active events
@@ -2970,7 +3311,7 @@ void fr_event_list_set_time_func(fr_event_list_t *el, fr_event_time_source_t fun
  */
 bool fr_event_list_empty(fr_event_list_t *el)
 {
-	return !fr_lst_num_elements(el->times) && !fr_rb_num_elements(el->fds);
+	return !fr_lst_num_elements(el->times) && !el->wheel.num && !fr_rb_num_elements(el->fds);
 }
 
 #ifdef WITH_EVENT_DEBUG
@@ -3010,6 +3351,39 @@ static int8_t event_timer_location_cmp(void const *one, void const *two)
 }
 
 
+/** Record which decade a timer is due in, and where it was allocated
+ *
+ */
+static int event_report_count(fr_rb_tree_t **locations, size_t *array, fr_event_timer_t const *ev, fr_time_t now)
+{
+	fr_time_delta_t	diff = fr_time_sub(ev->when, now);
+	size_t		i;
+
+	for (i = 0; i < NUM_ELEMENTS(decades); i++) {
+		if ((fr_time_delta_cmp(diff, decades[i]) <= 0) || (i == NUM_ELEMENTS(decades) - 1)) {
+			fr_event_counter_t find = { .file = ev->file, .line = ev->line };
+			fr_event_counter_t *counter;
+
+			counter = fr_rb_find(locations[i], &find);
+			if (!counter) {
+				counter = talloc(locations[i], fr_event_counter_t);
+				if (!counter) return -1;
+				counter->file = ev->file;
+				counter->line = ev->line;
+				counter->count = 1;
+				fr_rb_insert(locations[i], counter);
+			} else {
+				counter->count++;
+			}
+
+			array[i]++;
+			break;
+		}
+	}
+
+	return 0;
+}
+
 /** Print out information about the number of events in the event loop
  *
  */
@@ -3017,7 +3391,7 @@ void fr_event_report(fr_event_list_t *el, fr_time_t now, void *uctx)
 {
 	fr_lst_iter_t		iter;
 	fr_event_timer_t const	*ev;
-	size_t			i;
+	size_t			i, level;
 
 	size_t			array[NUM_ELEMENTS(decades)] = { 0 };
 	fr_rb_tree_t		*locations[NUM_ELEMENTS(decades)];
@@ -3044,27 +3418,13 @@ void fr_event_report(fr_event_list_t *el, fr_time_t now, void *uctx)
 	for (ev = fr_lst_iter_init(el->times, &iter);
 	     ev != NULL;
 	     ev = fr_lst_iter_next(el->times, &iter)) {
-		fr_time_delta_t diff = fr_time_sub(ev->when, now);
-
-		for (i = 0; i < NUM_ELEMENTS(decades); i++) {
-			if ((fr_time_delta_cmp(diff, decades[i]) <= 0) || (i == NUM_ELEMENTS(decades) - 1)) {
-				fr_event_counter_t find = { .file = ev->file, .line = ev->line };
-				fr_event_counter_t *counter;
-
-				counter = fr_rb_find(locations[i], &find);
-				if (!counter) {
-					counter = talloc(locations[i], fr_event_counter_t);
-					if (!counter) goto oom;
-					counter->file = ev->file;
-					counter->line = ev->line;
-					counter->count = 1;
-					fr_rb_insert(locations[i], counter);
-				} else {
-					counter->count++;
-				}
+		if (event_report_count(locations, array, ev, now) < 0) goto oom;
+	}
 
-				array[i]++;
-				break;
+	for (level = 0; level < EVENT_WHEEL_LEVELS; level++) {
+		for (i = 0; i < EVENT_WHEEL_SLOTS; i++) {
+			fr_dlist_foreach(&el->wheel.slot[level][i], fr_event_timer_t const, wheel_ev) {
+				if (event_report_count(locations, array, wheel_ev, now) < 0) goto oom;
 			}
 		}
 	}
@@ -3110,6 +3470,7 @@ void fr_event_timer_dump(fr_event_list_t *el)
 	fr_lst_iter_t		iter;
 	fr_event_timer_t 	*ev;
 	fr_time_t		now;
+	unsigned int		level, i;
 
 	now = el->time();
 
@@ -3123,6 +3484,17 @@ void fr_event_timer_dump(fr_event_list_t *el)
 			    ev->file, ev->line, ev, fr_time_unwrap(ev->when),
 			    fr_time_gt(now, ev->when) ? '<' : '>', ev->callback);
 	}
+
+	for (level = 0; level < EVENT_WHEEL_LEVELS; level++) {
+		for (i = 0; i < EVENT_WHEEL_SLOTS; i++) {
+			fr_dlist_foreach(&el->wheel.slot[level][i], fr_event_timer_t, wheel_ev) {
+				(void)talloc_get_type_abort(wheel_ev, fr_event_timer_t);
+				EVENT_DEBUG("%s[%u]: %p time=%" PRId64 " (wheel %u), callback=%p",
+					    wheel_ev->file, wheel_ev->line, wheel_ev, fr_time_unwrap(wheel_ev->when),
+					    level, wheel_ev->callback);
+			}
+		}
+	}
 }
 #endif
 #endif
@@ -0,0 +1,330 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for event list timers, and the timer wheel
+ *
+ * @file src/lib/util/event_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/event.h>
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/time.h>
+
+typedef struct {
+	fr_event_timer_t const	*ev;
+	fr_time_t		when;		//!< When the timer should fire.
+	fr_time_t		fired;		//!< When the timer did fire.
+	unsigned int		count;		//!< How many times it fired.
+} timer_thing;
+
+/*
+ *	Fake time source, so that the tests don't depend on
+ *	how fast the machine is.
+ */
+static fr_time_t	test_now;
+static fr_time_t	test_last_fired;
+
+static fr_time_t test_time(void)
+{
+	return test_now;
+}
+
+static void test_timer_cb(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	timer_thing	*thing = uctx;
+
+	TEST_CHECK(fr_time_gteq(test_now, test_last_fired));
+	TEST_MSG("timers fired out of order");
+
+	thing->fired = test_now;
+	thing->count++;
+	test_last_fired = test_now;
+}
+
+static fr_event_list_t *test_event_list(fr_time_delta_t granularity)
+{
+	fr_event_list_t *el;
+
+	test_now = fr_time_wrap(NSEC);
+	test_last_fired = fr_time_wrap(0);
+
+	el = fr_event_list_alloc(NULL, NULL, NULL);
+	TEST_CHECK(el != NULL);
+	fr_event_list_set_time_func(el, test_time);
+	TEST_CHECK(fr_event_list_set_timer_granularity(el, granularity) == 0);
+
+	return el;
+}
+
+/** Run timers until there are none left, jumping the clock to each wakeup time
+ *
+ */
+static void test_run_all(fr_event_list_t *el)
+{
+	fr_time_t when;
+
+	for (;;) {
+		when = test_now;
+		while (fr_event_timer_run(el, &when) == 1) when = test_now;
+
+		if (fr_time_eq(when, fr_time_wrap(0))) break;
+
+		/*
+		 *	The next wakeup must always be in the future,
+		 *	otherwise we'd busy loop.
+		 */
+		TEST_CHECK(fr_time_gt(when, test_now));
+		if (!fr_time_gt(when, test_now)) break;
+
+		test_now = when;
+	}
+}
+
+static void populate_timers(fr_event_list_t *el, timer_thing *things, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		fr_time_delta_t delta;
+
+		/*
+		 *	Mix of sub-tick, near, and far timers, so that
+		 *	every level of the wheel, and the lst, are used.
+		 */
+		switch (i % 4) {
+		case 0:
+			delta = fr_time_delta_wrap(fr_rand() % 1000000);	/* < 1ms */
+			break;
+
+		case 1:
+			delta = fr_time_delta_wrap((fr_rand() % 1000) * 1000000);	/* < 1s */
+			break;
+
+		case 2:
+			delta = fr_time_delta_wrap((int64_t)(fr_rand() % 3600) * NSEC);	/* < 1h */
+			break;
+
+		default:
+			delta = fr_time_delta_wrap((int64_t)(fr_rand() % 86400) * NSEC);	/* < 1d, beyond the wheel */
+			break;
+		}
+
+		things[i] = (timer_thing) { .when = fr_time_add(test_now, delta) };
+		TEST_CHECK(fr_event_timer_at(el, el, &things[i].ev, things[i].when, test_timer_cb, &things[i]) == 0);
+	}
+}
+
+static void event_timer_order(fr_time_delta_t granularity)
+{
+	fr_event_list_t	*el;
+	timer_thing	*things;
+	unsigned int	i, count = 10000;
+
+	el = test_event_list(granularity);
+	things = talloc_zero_array(NULL, timer_thing, count);
+
+	populate_timers(el, things, count);
+	TEST_CHECK(fr_event_list_num_timers(el) == count);
+
+	test_run_all(el);
+
+	TEST_CHECK(fr_event_list_num_timers(el) == 0);
+	for (i = 0; i < count; i++) {
+		TEST_CHECK(things[i].count == 1);
+		TEST_MSG("timer %u fired %u times", i, things[i].count);
+
+		TEST_CHECK(fr_time_eq(things[i].fired, things[i].when));
+		TEST_MSG("timer %u expected %"PRId64" fired %"PRId64, i,
+			 fr_time_unwrap(things[i].when), fr_time_unwrap(things[i].fired));
+	}
+
+	talloc_free(things);
+	talloc_free(el);
+}
+
+static void event_timer_order_wheel(void)
+{
+	event_timer_order(fr_time_delta_from_msec(1));
+}
+
+static void event_timer_order_lst(void)
+{
+	event_timer_order(fr_time_delta_wrap(0));
+}
+
+static void event_timer_cancel(void)
+{
+	fr_event_list_t	*el;
+	timer_thing	*things;
+	unsigned int	i, count = 10000;
+
+	el = test_event_list(fr_time_delta_from_msec(1));
+	things = talloc_zero_array(NULL, timer_thing, count);
+
+	populate_timers(el, things, count);
+
+	for (i = 0; i < count; i += 2) TEST_CHECK(fr_event_timer_delete(&things[i].ev) == 0);
+	TEST_CHECK(fr_event_list_num_timers(el) == count / 2);
+
+	test_run_all(el);
+
+	TEST_CHECK(fr_event_list_empty(el));
+	for (i = 0; i < count; i++) {
+		TEST_CHECK(things[i].count == (i & 0x01));
+		TEST_MSG("timer %u fired %u times", i, things[i].count);
+	}
+
+	talloc_free(things);
+	talloc_free(el);
+}
+
+static void event_timer_rearm(void)
+{
+	fr_event_list_t	*el;
+	timer_thing	thing = {};
+	fr_time_t	when;
+
+	el = test_event_list(fr_time_delta_from_msec(1));
+
+	/*
+	 *	Wheel -> lst -> wheel, at different levels.
+	 */
+	when = fr_time_add(test_now, fr_time_delta_from_sec(5));
+	TEST_CHECK(fr_event_timer_at(el, el, &thing.ev, when, test_timer_cb, &thing) == 0);
+
+	when = fr_time_add(test_now, fr_time_delta_wrap(10));
+	TEST_CHECK(fr_event_timer_at(el, el, &thing.ev, when, test_timer_cb, &thing) == 0);
+
+	when = fr_time_add(test_now, fr_time_delta_from_sec(3 * 3600));
+	TEST_CHECK(fr_event_timer_at(el, el, &thing.ev, when, test_timer_cb, &thing) == 0);
+
+	when = fr_time_add(test_now, fr_time_delta_from_msec(2));
+	TEST_CHECK(fr_event_timer_at(el, el, &thing.ev, when, test_timer_cb, &thing) == 0);
+	thing.when = when;
+
+	TEST_CHECK(fr_event_list_num_timers(el) == 1);
+
+	test_run_all(el);
+
+	TEST_CHECK(thing.count == 1);
+	TEST_CHECK(fr_time_eq(thing.fired, thing.when));
+	TEST_CHECK(thing.ev == NULL);
+
+	talloc_free(el);
+}
+
+/** Change the granularity while timers are armed
+ *
+ */
+static void event_timer_granularity_change(void)
+{
+	fr_event_list_t	*el;
+	timer_thing	*things;
+	unsigned int	i, count = 1000;
+
+	el = test_event_list(fr_time_delta_from_msec(1));
+	things = talloc_zero_array(NULL, timer_thing, count);
+
+	populate_timers(el, things, count);
+	TEST_CHECK(fr_event_list_set_timer_granularity(el, fr_time_delta_from_msec(100)) == 0);
+	TEST_CHECK(fr_event_list_num_timers(el) == count);
+
+	test_run_all(el);
+
+	for (i = 0; i < count; i++) {
+		TEST_CHECK(things[i].count == 1);
+		TEST_CHECK(fr_time_eq(things[i].fired, things[i].when));
+	}
+
+	talloc_free(things);
+	talloc_free(el);
+}
+
+/** Arm, then cancel a large number of timers, as happens with request timeouts
+ *
+ */
+static void event_timer_churn(fr_time_delta_t granularity, unsigned int count)
+{
+	fr_event_list_t		*el;
+	timer_thing		*things;
+	fr_time_delta_t		*deltas;
+	unsigned int		i;
+	fr_time_t		start_insert, end_insert, start_rearm, end_rearm, start_delete, end_delete;
+
+	el = test_event_list(granularity);
+	things = talloc_zero_array(NULL, timer_thing, count);
+	deltas = talloc_array(NULL, fr_time_delta_t, count);
+
+	/*
+	 *	Request timeouts are typically 1-30s out.
+	 */
+	for (i = 0; i < count; i++) deltas[i] = fr_time_delta_wrap(NSEC + ((int64_t)fr_rand() % (29 * (int64_t)NSEC)));
+
+	start_insert = fr_time();
+	for (i = 0; i < count; i++) {
+		(void) fr_event_timer_in(el, el, &things[i].ev, deltas[i], test_timer_cb, &things[i]);
+	}
+	end_insert = fr_time();
+
+	start_rearm = fr_time();
+	for (i = 0; i < count; i++) {
+		(void) fr_event_timer_in(el, el, &things[i].ev, deltas[count - i - 1], test_timer_cb, &things[i]);
+	}
+	end_rearm = fr_time();
+
+	start_delete = fr_time();
+	for (i = 0; i < count; i++) (void) fr_event_timer_delete(&things[i].ev);
+	end_delete = fr_time();
+
+	TEST_CHECK(fr_event_list_num_timers(el) == 0);
+
+	TEST_MSG_ALWAYS("\ntimers: %u, granularity: %"PRId64" ns\n", count, fr_time_delta_unwrap(granularity));
+	TEST_MSG_ALWAYS("insert: %"PRIu64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_insert, start_insert)) / 1000);
+	TEST_MSG_ALWAYS("rearm: %"PRIu64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_rearm, start_rearm)) / 1000);
+	TEST_MSG_ALWAYS("delete: %"PRIu64" μs\n", fr_time_delta_unwrap(fr_time_sub(end_delete, start_delete)) / 1000);
+
+	talloc_free(deltas);
+	talloc_free(things);
+	talloc_free(el);
+}
+
+static void event_timer_churn_wheel(void)
+{
+	event_timer_churn(fr_time_delta_from_msec(1), 1000000);
+}
+
+static void event_timer_churn_lst(void)
+{
+	event_timer_churn(fr_time_delta_wrap(0), 1000000);
+}
+
+TEST_LIST = {
+	{ "event_timer_order_wheel",		event_timer_order_wheel },
+	{ "event_timer_order_lst",		event_timer_order_lst },
+	{ "event_timer_cancel",			event_timer_cancel },
+	{ "event_timer_rearm",			event_timer_rearm },
+	{ "event_timer_granularity_change",	event_timer_granularity_change },
+
+	/*
+	 *	Benchmarks
+	 */
+	{ "event_timer_churn_wheel",		event_timer_churn_wheel },
+	{ "event_timer_churn_lst",		event_timer_churn_lst },
+	{ NULL }
+};
@@ -26,6 +26,13 @@
  * rather than being able to move 1/2 of the entries in the chain with
  * one update.
  *
+ * Tables allocated with fr_hash_table_open_alloc() instead use open
+ * addressing, in the style of "Swiss tables".  Each slot has a one
+ * byte control value holding 7 bits of the key, and lookups compare
+ * a group of 16 control bytes at once (with SSE2 where available).
+ * Entries aren't allocated individually, and a lookup usually touches
+ * one group of control bytes and one slot.
+ *
  * @file src/lib/util/hash.c
  *
  * @copyright 2005,2006 The FreeRADIUS server project
@@ -34,6 +41,10 @@ RCSID("$Id$")
 
 #include <freeradius-devel/util/hash.h>
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 /*
  *	A reasonable number of buckets to start off with.
  *	Should be a power of two.
@@ -47,6 +58,14 @@ struct fr_hash_entry_s {
 	void 			*data;
 };
 
+/** A slot in an open addressing table
+ *
+ */
+typedef struct {
+	uint32_t		key;		//!< Full hash of the data, so we don't need to rehash on grow.
+	void			*data;
+} fr_hash_slot_t;
+
 struct fr_hash_table_s {
 	uint32_t		num_elements;	//!< Number of elements in the hash table.
 	uint32_t		num_buckets;	//!< Number of buckets (how long the array is) - power of 2 */
@@ -61,6 +80,11 @@ struct fr_hash_table_s {
 
 	fr_hash_entry_t		null;
 	fr_hash_entry_t		**buckets;	//!< Array of hash buckets.
+
+	bool			open;		//!< Use open addressing, instead of chained buckets.
+	uint32_t		num_deleted;	//!< Open addressing slots marked as deleted.
+	int8_t			*ctrl;		//!< Open addressing control bytes, one per slot.
+	fr_hash_slot_t		*slots;		//!< Open addressing slots.
 };
 
 #ifdef TESTING
@@ -251,11 +275,261 @@ static void list_delete(fr_hash_table_t *ht,
 	*last = node->next;
 }
 
+/*
+ *	Open addressing.
+ *
+ *	Slots are arranged in groups of OPEN_GROUP_SIZE.  The high
+ *	bits of the key select the first group to probe, and the low
+ *	7 bits are stored in the control byte of the slot, so most
+ *	mismatches are rejected without touching the slot, or calling
+ *	the comparison function.
+ *
+ *	Groups are probed in triangular order, which visits every
+ *	group when the number of groups is a power of two.  A probe
+ *	stops at the first group with an empty slot.
+ */
+#define OPEN_GROUP_SIZE		(16)
+#define OPEN_MIN_SLOTS		(OPEN_GROUP_SIZE * 2)
+
+#define CTRL_EMPTY		((int8_t) -128)	//!< 0x80, slot has never been used.
+#define CTRL_DELETED		((int8_t) -2)	//!< 0xfe, slot was used, and the data removed.
+
+#define OPEN_H1(_key)		((_key) >> 7)
+#define OPEN_H2(_key)		((int8_t) ((_key) & 0x7f))
+
+/*
+ *	Grow when 7/8 of the slots are full or deleted.
+ */
+#define OPEN_MAX_LOAD(_slots)	(((_slots) >> 3) * 7)
+
+#ifdef __SSE2__
+/** Return a bitmask of the slots in a group whose control byte is h2
+ *
+ */
+static inline CC_HINT(always_inline) uint32_t group_match(int8_t const *ctrl, int8_t h2)
+{
+	__m128i group = _mm_loadu_si128((__m128i const *) ctrl);
+
+	return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), group));
+}
+
+/** Return a bitmask of the empty and deleted slots in a group
+ *
+ * Only empty and deleted slots have the high bit set.
+ */
+static inline CC_HINT(always_inline) uint32_t group_match_free(int8_t const *ctrl)
+{
+	return (uint32_t) _mm_movemask_epi8(_mm_loadu_si128((__m128i const *) ctrl));
+}
+#else
+static inline CC_HINT(always_inline) uint32_t group_match(int8_t const *ctrl, int8_t h2)
+{
+	uint32_t	mask = 0;
+	int		i;
+
+	for (i = 0; i < OPEN_GROUP_SIZE; i++) mask |= (uint32_t) (ctrl[i] == h2) << i;
+
+	return mask;
+}
+
+static inline CC_HINT(always_inline) uint32_t group_match_free(int8_t const *ctrl)
+{
+	uint32_t	mask = 0;
+	int		i;
+
+	for (i = 0; i < OPEN_GROUP_SIZE; i++) mask |= (uint32_t) (ctrl[i] < 0) << i;
+
+	return mask;
+}
+#endif
+
+static inline CC_HINT(always_inline) uint32_t group_match_empty(int8_t const *ctrl)
+{
+	return group_match(ctrl, CTRL_EMPTY);
+}
+
+/** Find the slot holding data, or -1
+ *
+ */
+static inline CC_HINT(always_inline) int64_t open_find(fr_hash_table_t *ht, uint32_t key, void const *data)
+{
+	uint32_t	group = OPEN_H1(key) & ht->mask;
+	uint32_t	step = 0;
+	int8_t		h2 = OPEN_H2(key);
+
+	for (;;) {
+		int8_t const	*ctrl = ht->ctrl + (group * OPEN_GROUP_SIZE);
+		uint32_t	match = group_match(ctrl, h2);
+
+		while (match) {
+			uint32_t	idx = (group * OPEN_GROUP_SIZE) + __builtin_ctz(match);
+			fr_hash_slot_t	*slot = &ht->slots[idx];
+
+			if ((slot->key == key) && (!ht->cmp || (ht->cmp(data, slot->data) == 0))) return idx;
+
+			match &= match - 1;
+		}
+
+		if (group_match_empty(ctrl)) return -1;
+
+		/*
+		 *	Every group has been probed.  Can only
+		 *	happen if there are no empty slots.
+		 */
+		if (++step > ht->mask) return -1;
+		group = (group + step) & ht->mask;
+	}
+}
+
+/** Find the first empty or deleted slot for a key
+ *
+ * There's always one, as the table is grown before it fills.
+ */
+static uint32_t open_find_free(fr_hash_table_t *ht, uint32_t key)
+{
+	uint32_t	group = OPEN_H1(key) & ht->mask;
+	uint32_t	step = 0;
+
+	for (;;) {
+		uint32_t match = group_match_free(ht->ctrl + (group * OPEN_GROUP_SIZE));
+
+		if (match) return (group * OPEN_GROUP_SIZE) + __builtin_ctz(match);
+
+		step++;
+		fr_assert(step <= ht->mask);
+		group = (group + step) & ht->mask;
+	}
+}
+
+/** Allocate the slots for an open addressing table
+ *
+ */
+static int open_slots_alloc(fr_hash_table_t *ht, uint32_t num_slots)
+{
+	int8_t		*ctrl;
+	fr_hash_slot_t	*slots;
+
+	ctrl = talloc_array(ht, int8_t, num_slots);
+	if (unlikely(!ctrl)) return -1;
+
+	slots = talloc_array(ht, fr_hash_slot_t, num_slots);
+	if (unlikely(!slots)) {
+		talloc_free(ctrl);
+		return -1;
+	}
+	memset(ctrl, CTRL_EMPTY, num_slots);
+
+	ht->ctrl = ctrl;
+	ht->slots = slots;
+	ht->num_buckets = num_slots;
+	ht->mask = (num_slots / OPEN_GROUP_SIZE) - 1;
+	ht->next_grow = OPEN_MAX_LOAD(num_slots);
+	ht->num_deleted = 0;
+
+	return 0;
+}
+
+/** Resize an open addressing table, dropping any deleted slots
+ *
+ * If most of the used slots are deleted, the table is rebuilt at the
+ * same size.
+ */
+static int open_resize(fr_hash_table_t *ht)
+{
+	int8_t		*old_ctrl = ht->ctrl;
+	fr_hash_slot_t	*old_slots = ht->slots;
+	uint32_t	old_num = ht->num_buckets, i;
+	uint32_t	num_slots = old_num;
+
+	if (ht->num_elements >= (ht->next_grow >> 1)) num_slots *= 2;
+
+	if (open_slots_alloc(ht, num_slots) < 0) return -1;
+
+	for (i = 0; i < old_num; i++) {
+		uint32_t idx;
+
+		if (old_ctrl[i] < 0) continue;
+
+		idx = open_find_free(ht, old_slots[i].key);
+		ht->ctrl[idx] = old_ctrl[i];
+		ht->slots[idx] = old_slots[i];
+	}
+
+	talloc_free(old_ctrl);
+	talloc_free(old_slots);
+
+#ifdef TESTING
+	grow = 1;
+	fprintf(stderr, "GROW TO %d\n", ht->num_buckets);
+#endif
+
+	return 0;
+}
+
+static bool open_insert(fr_hash_table_t *ht, uint32_t key, void const *data)
+{
+	uint32_t idx;
+
+	if (open_find(ht, key, data) >= 0) return false;
+
+	idx = open_find_free(ht, key);
+
+	/*
+	 *	Re-using a deleted slot doesn't change the load.
+	 */
+	if (ht->ctrl[idx] == CTRL_DELETED) {
+		ht->num_deleted--;
+
+	} else if ((ht->num_elements + ht->num_deleted + 1) > ht->next_grow) {
+		if (open_resize(ht) < 0) return false;
+		idx = open_find_free(ht, key);
+	}
+
+	ht->ctrl[idx] = OPEN_H2(key);
+	ht->slots[idx] = (fr_hash_slot_t){ .key = key, .data = UNCONST(void *, data) };
+	ht->num_elements++;
+
+	return true;
+}
+
+static void *open_remove(fr_hash_table_t *ht, uint32_t key, void const *data)
+{
+	int64_t	idx;
+	void	*old;
+
+	idx = open_find(ht, key, data);
+	if (idx < 0) return NULL;
+
+	old = ht->slots[idx].data;
+
+	/*
+	 *	If the group still has an empty slot, no probe
+	 *	continued past it, and the slot can be marked empty.
+	 *	Otherwise, probes for other keys may have passed
+	 *	through this slot, and it has to be left as a
+	 *	tombstone.
+	 */
+	if (group_match_empty(ht->ctrl + (idx & ~(OPEN_GROUP_SIZE - 1)))) {
+		ht->ctrl[idx] = CTRL_EMPTY;
+	} else {
+		ht->ctrl[idx] = CTRL_DELETED;
+		ht->num_deleted++;
+	}
+	ht->num_elements--;
+
+	return old;
+}
+
 static int _fr_hash_table_free(fr_hash_table_t *ht)
 {
 	uint32_t i;
 	fr_hash_entry_t *node, *next;
 
+	if (ht->free && ht->open) {
+		for (i = 0; i < ht->num_buckets; i++) if (ht->ctrl[i] >= 0) ht->free(ht->slots[i].data);
+		return 0;
+	}
+
 	if (ht->free) {
 		for (i = 0; i < ht->num_buckets; i++) {
 			if (ht->buckets[i]) for (node = ht->buckets[i];
@@ -275,10 +549,13 @@ static int _fr_hash_table_free(fr_hash_table_t *ht)
 /*
  *	Create the table.
  *
- *	Memory usage in bytes is (20/3) * number of entries.
+ *	Memory usage in bytes is (20/3) * number of entries for
+ *	chained tables.  Open addressing tables use 13 bytes per
+ *	slot, and are between 7/16 and 7/8 full.
  */
 fr_hash_table_t *_fr_hash_table_alloc(TALLOC_CTX *ctx,
 				      char const *type,
+				      bool open,
 				      fr_hash_t hash_func,
 				      fr_cmp_t cmp_func,
 				      fr_free_t free_func)
@@ -289,6 +566,23 @@ fr_hash_table_t *_fr_hash_table_alloc(TALLOC_CTX *ctx,
 	if (!ht) return NULL;
 	talloc_set_destructor(ht, _fr_hash_table_free);
 
+	if (open) {
+		*ht = (fr_hash_table_t){
+			.type = type,
+			.free = free_func,
+			.hash = hash_func,
+			.cmp = cmp_func,
+			.open = true
+		};
+
+		if (unlikely(open_slots_alloc(ht, OPEN_MIN_SLOTS) < 0)) {
+			talloc_free(ht);
+			return NULL;
+		}
+
+		return ht;
+	}
+
 	*ht = (fr_hash_table_t){
 		.type = type,
 		.free = free_func,
@@ -429,6 +723,12 @@ void *fr_hash_table_find(fr_hash_table_t *ht, void const *data)
 {
 	fr_hash_entry_t *node;
 
+	if (ht->open) {
+		int64_t idx = open_find(ht, ht->hash(data), data);
+
+		return (idx < 0) ? NULL : ht->slots[idx].data;
+	}
+
 	node = hash_table_find(ht, ht->hash(data), data);
 	if (!node) return NULL;
 
@@ -448,6 +748,12 @@ void *fr_hash_table_find_by_key(fr_hash_table_t *ht, uint32_t key, void const *d
 {
 	fr_hash_entry_t *node;
 
+	if (ht->open) {
+		int64_t idx = open_find(ht, key, data);
+
+		return (idx < 0) ? NULL : ht->slots[idx].data;
+	}
+
 	node = hash_table_find(ht, key, data);
 	if (!node) return NULL;
 
@@ -475,6 +781,8 @@ bool fr_hash_table_insert(fr_hash_table_t *ht, void const *data)
 #endif
 
 	key = ht->hash(data);
+	if (ht->open) return open_insert(ht, key, data);
+
 	entry = key & ht->mask;
 	reversed = reverse(key);
 
@@ -526,6 +834,24 @@ int fr_hash_table_replace(void **old, fr_hash_table_t *ht, void const *data)
 {
 	fr_hash_entry_t *node;
 
+	if (ht->open) {
+		int64_t idx = open_find(ht, ht->hash(data), data);
+
+		if (idx < 0) {
+			if (old) *old = NULL;
+			return fr_hash_table_insert(ht, data) ? 1 : -1;
+		}
+
+		if (old) {
+			*old = ht->slots[idx].data;
+		} else if (ht->free) {
+			ht->free(ht->slots[idx].data);
+		}
+		ht->slots[idx].data = UNCONST(void *, data);
+
+		return 0;
+	}
+
 	node = hash_table_find(ht, ht->hash(data), data);
 	if (!node) {
 		if (old) *old = NULL;
@@ -561,6 +887,8 @@ void *fr_hash_table_remove(fr_hash_table_t *ht, void const *data)
 	fr_hash_entry_t		*node;
 
 	key = ht->hash(data);
+	if (ht->open) return open_remove(ht, key, data);
+
 	entry = key & ht->mask;
 	reversed = reverse(key);
 
@@ -622,6 +950,19 @@ void *fr_hash_table_iter_next(fr_hash_table_t *ht, fr_hash_iter_t *iter)
 	fr_hash_entry_t *node;
 	uint32_t	i;
 
+	/*
+	 *	Open addressing tables are walked from the last
+	 *	slot to the first, iter->bucket is one past the
+	 *	next slot to check.
+	 */
+	if (ht->open) {
+		while (iter->bucket > 0) {
+			i = --iter->bucket;
+			if (ht->ctrl[i] >= 0) return ht->slots[i].data;
+		}
+		return NULL;
+	}
+
 	/*
 	 *	Return the next element in the bucket
 	 */
@@ -714,6 +1055,8 @@ void fr_hash_table_fill(fr_hash_table_t *ht)
 {
 	int i;
 
+	if (ht->open) return;	/* Lookups never modify open addressing tables */
+
 	for (i = ht->num_buckets - 1; i >= 0; i--) if (!ht->buckets[i]) fr_hash_table_fixup(ht, i);
 }
 
@@ -728,6 +1071,12 @@ int fr_hash_table_info(fr_hash_table_t *ht)
 
 	if (!ht) return 0;
 
+	if (ht->open) {
+		printf("HASH TABLE %p\tslots: %d\tdeleted: %d\n", ht, ht->num_buckets, ht->num_deleted);
+		printf("\tnum entries %d\n\n", ht->num_elements);
+		return 0;
+	}
+
 	uninitialized = collisions = 0;
 	memset(array, 0, sizeof(array));
 
@@ -883,6 +1232,74 @@ uint32_t fr_hash_case_string(char const *p)
 	return hash;
 }
 
+#define XXH_PRIME64_1 (0x9e3779b185ebca87ULL)
+#define XXH_PRIME64_2 (0xc2b2ae3d27d4eb4fULL)
+#define XXH_PRIME64_3 (0x165667b19e3779f9ULL)
+#define XXH_PRIME64_4 (0x85ebca77c2b2ae63ULL)
+#define XXH_PRIME64_5 (0x27d4eb2f165667c5ULL)
+
+#define ROTL64(_x, _r) (((_x) << (_r)) | ((_x) >> (64 - (_r))))
+
+/** Hash data a word at a time
+ *
+ * fr_hash() mixes in one octet per multiply, which is slow for
+ * anything longer than a few octets.  This reads 8 octets at a time,
+ * using the single lane rounds and finalisation from XXH64.
+ *
+ * The result depends on the byte order of the host, so it must only
+ * be used for in-memory structures such as hash tables.  Use fr_hash()
+ * for anything which is written to disk, or sent over the network.
+ *
+ * @param[in] data	to hash.
+ * @param[in] size	of the data.
+ * @return a 32bit hash of the data.
+ */
+uint32_t fr_hash_fast(void const *data, size_t size)
+{
+	uint8_t const	*p = data;
+	uint8_t const	*end = p + size;
+	uint64_t	hash = XXH_PRIME64_5 + size;
+
+	while ((end - p) >= 8) {
+		uint64_t word;
+
+		memcpy(&word, p, sizeof(word));
+		word *= XXH_PRIME64_2;
+		word = ROTL64(word, 31);
+		word *= XXH_PRIME64_1;
+
+		hash ^= word;
+		hash = (ROTL64(hash, 27) * XXH_PRIME64_1) + XXH_PRIME64_4;
+		p += 8;
+	}
+
+	if ((end - p) >= 4) {
+		uint32_t word;
+
+		memcpy(&word, p, sizeof(word));
+		hash ^= (uint64_t) word * XXH_PRIME64_1;
+		hash = (ROTL64(hash, 23) * XXH_PRIME64_2) + XXH_PRIME64_3;
+		p += 4;
+	}
+
+	while (p < end) {
+		hash ^= (uint64_t) (*p++) * XXH_PRIME64_5;
+		hash = ROTL64(hash, 11) * XXH_PRIME64_1;
+	}
+
+	/*
+	 *	Avalanche, so that all the input bits affect the
+	 *	low bits, which are the ones used to pick buckets.
+	 */
+	hash ^= hash >> 33;
+	hash *= XXH_PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= XXH_PRIME64_3;
+	hash ^= hash >> 32;
+
+	return (uint32_t) hash;
+}
+
 /** Check hash table is sane
  *
  */
@@ -892,9 +1309,28 @@ void fr_hash_table_verify(fr_hash_table_t *ht)
 	void		*ptr;
 
 	(void)talloc_get_type_abort(ht, fr_hash_table_t);
-	(void)talloc_get_type_abort(ht->buckets, fr_hash_entry_t *);
 
-	fr_assert(talloc_array_length(ht->buckets) == ht->num_buckets);
+	if (ht->open) {
+		uint32_t i, used = 0, deleted = 0;
+
+		fr_assert(talloc_array_length(ht->ctrl) == ht->num_buckets);
+		fr_assert(talloc_array_length(ht->slots) == ht->num_buckets);
+
+		for (i = 0; i < ht->num_buckets; i++) {
+			if (ht->ctrl[i] == CTRL_DELETED) {
+				deleted++;
+			} else if (ht->ctrl[i] >= 0) {
+				fr_assert(ht->ctrl[i] == OPEN_H2(ht->slots[i].key));
+				used++;
+			}
+		}
+		fr_assert(used == ht->num_elements);
+		fr_assert(deleted == ht->num_deleted);
+	} else {
+		(void)talloc_get_type_abort(ht->buckets, fr_hash_entry_t *);
+
+		fr_assert(talloc_array_length(ht->buckets) == ht->num_buckets);
+	}
 
 	/*
 	 *	Check talloc headers on all data
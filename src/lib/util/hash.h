@@ -52,20 +52,40 @@ uint32_t fr_hash_update(void const *data, size_t size, uint32_t hash);
 uint32_t fr_hash_string(char const *p);
 uint32_t fr_hash_case_string(char const *p);
 
+/*
+ *	Faster for anything more than a few bytes, but the result
+ *	depends on the host byte order.  Only use for in-memory
+ *	structures.
+ */
+uint32_t fr_hash_fast(void const *data, size_t size);
+
 typedef struct fr_hash_table_s fr_hash_table_t;
 typedef int (*fr_hash_table_walk_t)(void *data, void *uctx);
 
 #define		fr_hash_table_alloc(_ctx, _hash_node, _cmp_node, _free_node) \
-		_fr_hash_table_alloc(_ctx, NULL, _hash_node, _cmp_node, _free_node)
+		_fr_hash_table_alloc(_ctx, NULL, false, _hash_node, _cmp_node, _free_node)
 
 #define		fr_hash_table_talloc_alloc(_ctx, _type, _hash_node, _cmp_node, _free_node) \
-		_fr_hash_table_alloc(_ctx, #_type, _hash_node, _cmp_node, _free_node)
+		_fr_hash_table_alloc(_ctx, #_type, false, _hash_node, _cmp_node, _free_node)
+
+/*
+ *	Open addressing tables have the same API, but store entries
+ *	in a flat array of slots, probed a group at a time.  They're
+ *	faster for lookups, and lookups don't modify the table, so
+ *	fr_hash_table_fill() isn't needed.
+ */
+#define		fr_hash_table_open_alloc(_ctx, _hash_node, _cmp_node, _free_node) \
+		_fr_hash_table_alloc(_ctx, NULL, true, _hash_node, _cmp_node, _free_node)
+
+#define		fr_hash_table_talloc_open_alloc(_ctx, _type, _hash_node, _cmp_node, _free_node) \
+		_fr_hash_table_alloc(_ctx, #_type, true, _hash_node, _cmp_node, _free_node)
 
 fr_hash_table_t *_fr_hash_table_alloc(TALLOC_CTX *ctx,
 				      char const *type,
+				      bool open,
 				      fr_hash_t hash_node,
 				      fr_cmp_t cmp_node,
-				      fr_free_t free_node) CC_HINT(nonnull(3,4));
+				      fr_free_t free_node) CC_HINT(nonnull(4,5));
 
 void		*fr_hash_table_find(fr_hash_table_t *ht, void const *data) CC_HINT(nonnull);
 
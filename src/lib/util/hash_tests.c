@@ -0,0 +1,354 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for hash tables
+ *
+ * @file src/lib/util/hash_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/time.h>
+
+#define NUM_ENTRIES	(1024 * 32)
+#define BENCH_ENTRIES	(1024 * 64)
+#define BENCH_LOOKUPS	(1024 * 1024 * 4)
+
+typedef struct {
+	uint32_t	num;
+	char		name[32];
+	bool		freed;
+} hash_test_entry_t;
+
+static uint32_t hash_test_num(void const *data)
+{
+	hash_test_entry_t const *a = data;
+
+	return fr_hash(&a->num, sizeof(a->num));
+}
+
+/*
+ *	Every entry collides, so everything is down to the
+ *	comparison function.
+ */
+static uint32_t hash_test_collide(UNUSED void const *data)
+{
+	return 42;
+}
+
+static int8_t hash_test_cmp(void const *one, void const *two)
+{
+	hash_test_entry_t const *a = one, *b = two;
+
+	return CMP(a->num, b->num);
+}
+
+static uint32_t hash_test_name(void const *data)
+{
+	hash_test_entry_t const *a = data;
+
+	return fr_hash(a->name, strlen(a->name));
+}
+
+static uint32_t hash_test_name_fast(void const *data)
+{
+	hash_test_entry_t const *a = data;
+
+	return fr_hash_fast(a->name, strlen(a->name));
+}
+
+static int8_t hash_test_name_cmp(void const *one, void const *two)
+{
+	hash_test_entry_t const *a = one, *b = two;
+
+	return CMP(strcmp(a->name, b->name), 0);
+}
+
+static void hash_test_free(void *data)
+{
+	hash_test_entry_t *a = data;
+
+	a->freed = true;
+}
+
+static hash_test_entry_t *entries_alloc(size_t num)
+{
+	hash_test_entry_t	*entries;
+	size_t			i;
+
+	entries = talloc_zero_array(NULL, hash_test_entry_t, num);
+	for (i = 0; i < num; i++) {
+		entries[i].num = i;
+		snprintf(entries[i].name, sizeof(entries[i].name), "user-%08x@example.org", (unsigned int) i);
+	}
+
+	return entries;
+}
+
+static void hash_test_insert_find(bool open, fr_hash_t hash, size_t num)
+{
+	fr_hash_table_t		*ht;
+	hash_test_entry_t	*entries, find = {};
+	size_t			i;
+
+	entries = entries_alloc(num);
+
+	ht = _fr_hash_table_alloc(NULL, NULL, open, hash, hash_test_cmp, NULL);
+	TEST_CHECK(ht != NULL);
+
+	for (i = 0; i < num; i++) TEST_CHECK(fr_hash_table_insert(ht, &entries[i]));
+	TEST_CHECK(fr_hash_table_num_elements(ht) == num);
+
+	TEST_CASE("Duplicates are rejected");
+	for (i = 0; i < num; i++) TEST_CHECK(!fr_hash_table_insert(ht, &entries[i]));
+	TEST_CHECK(fr_hash_table_num_elements(ht) == num);
+
+	TEST_CASE("All entries are found");
+	for (i = 0; i < num; i++) {
+		find.num = i;
+		TEST_CHECK(fr_hash_table_find(ht, &find) == &entries[i]);
+		TEST_MSG("Failed finding %zu", i);
+	}
+
+	find.num = num;
+	TEST_CHECK(fr_hash_table_find(ht, &find) == NULL);
+
+	fr_hash_table_verify(ht);
+
+	talloc_free(ht);
+	talloc_free(entries);
+}
+
+static void hash_test_chained(void)
+{
+	hash_test_insert_find(false, hash_test_num, NUM_ENTRIES);
+}
+
+static void hash_test_open(void)
+{
+	hash_test_insert_find(true, hash_test_num, NUM_ENTRIES);
+}
+
+static void hash_test_open_collide(void)
+{
+	hash_test_insert_find(true, hash_test_collide, 256);
+}
+
+static void hash_test_open_remove(void)
+{
+	fr_hash_table_t		*ht;
+	hash_test_entry_t	*entries;
+	size_t			i;
+	int			round;
+
+	entries = entries_alloc(NUM_ENTRIES);
+
+	ht = fr_hash_table_open_alloc(NULL, hash_test_num, hash_test_cmp, hash_test_free);
+	TEST_CHECK(ht != NULL);
+
+	for (i = 0; i < NUM_ENTRIES; i++) TEST_CHECK(fr_hash_table_insert(ht, &entries[i]));
+
+	/*
+	 *	Repeatedly remove and re-add half the entries, so
+	 *	that deleted slots are reused, and the table is
+	 *	rebuilt.
+	 */
+	for (round = 0; round < 8; round++) {
+		TEST_CASE("Remove every other entry");
+		for (i = 0; i < NUM_ENTRIES; i += 2) TEST_CHECK(fr_hash_table_remove(ht, &entries[i]) == &entries[i]);
+		TEST_CHECK(fr_hash_table_num_elements(ht) == (NUM_ENTRIES / 2));
+
+		for (i = 0; i < NUM_ENTRIES; i++) {
+			TEST_CHECK((fr_hash_table_find(ht, &entries[i]) == NULL) == ((i % 2) == 0));
+			TEST_MSG("Wrong result for %zu", i);
+		}
+		fr_hash_table_verify(ht);
+
+		TEST_CASE("Add them back");
+		for (i = 0; i < NUM_ENTRIES; i += 2) TEST_CHECK(fr_hash_table_insert(ht, &entries[i]));
+		TEST_CHECK(fr_hash_table_num_elements(ht) == NUM_ENTRIES);
+		fr_hash_table_verify(ht);
+	}
+
+	TEST_CASE("Delete calls the free function");
+	TEST_CHECK(fr_hash_table_delete(ht, &entries[1]));
+	TEST_CHECK(entries[1].freed);
+	TEST_CHECK(!fr_hash_table_delete(ht, &entries[1]));
+
+	TEST_CASE("Freeing the table frees the data");
+	talloc_free(ht);
+	for (i = 0; i < NUM_ENTRIES; i++) TEST_CHECK(entries[i].freed);
+
+	talloc_free(entries);
+}
+
+static void hash_test_open_replace(void)
+{
+	fr_hash_table_t		*ht;
+	hash_test_entry_t	*entries, other = { .num = 7 };
+	void			*old;
+
+	entries = entries_alloc(16);
+
+	ht = fr_hash_table_open_alloc(NULL, hash_test_num, hash_test_cmp, NULL);
+	TEST_CHECK(ht != NULL);
+
+	TEST_CHECK(fr_hash_table_replace(&old, ht, &entries[7]) == 1);
+	TEST_CHECK(old == NULL);
+
+	TEST_CHECK(fr_hash_table_replace(&old, ht, &other) == 0);
+	TEST_CHECK(old == &entries[7]);
+	TEST_CHECK(fr_hash_table_find(ht, &entries[7]) == &other);
+	TEST_CHECK(fr_hash_table_num_elements(ht) == 1);
+
+	talloc_free(ht);
+	talloc_free(entries);
+}
+
+static void hash_test_open_iter(void)
+{
+	fr_hash_table_t		*ht;
+	hash_test_entry_t	*entries, *p;
+	fr_hash_iter_t		iter;
+	void			**flat;
+	size_t			i, count = 0;
+
+	entries = entries_alloc(NUM_ENTRIES);
+
+	ht = fr_hash_table_open_alloc(NULL, hash_test_num, hash_test_cmp, NULL);
+	TEST_CHECK(ht != NULL);
+
+	for (i = 0; i < NUM_ENTRIES; i++) TEST_CHECK(fr_hash_table_insert(ht, &entries[i]));
+	for (i = 0; i < NUM_ENTRIES; i += 3) TEST_CHECK(fr_hash_table_remove(ht, &entries[i]) != NULL);
+
+	for (p = fr_hash_table_iter_init(ht, &iter);
+	     p;
+	     p = fr_hash_table_iter_next(ht, &iter)) {
+		TEST_CHECK(!p->freed);
+		TEST_CHECK((p->num % 3) != 0);
+		p->freed = true;	/* Mark as seen */
+		count++;
+	}
+	TEST_CHECK(count == fr_hash_table_num_elements(ht));
+
+	TEST_CHECK(fr_hash_table_flatten(ht, &flat, ht) == 0);
+	TEST_CHECK(talloc_array_length(flat) == count);
+
+	talloc_free(ht);
+	talloc_free(entries);
+}
+
+static void hash_test_fast(void)
+{
+	uint8_t		buff[64 + 8];
+	uint8_t		data[64];
+	uint32_t	seen[65];
+	size_t		len, off, i, j;
+
+	for (i = 0; i < sizeof(data); i++) data[i] = fr_rand();
+
+	TEST_CASE("Hash doesn't depend on alignment");
+	for (len = 0; len <= sizeof(data); len++) {
+		seen[len] = fr_hash_fast(data, len);
+
+		for (off = 1; off < 8; off++) {
+			memcpy(buff + off, data, len);
+			TEST_CHECK(fr_hash_fast(buff + off, len) == seen[len]);
+			TEST_MSG("Mismatch for length %zu offset %zu", len, off);
+		}
+	}
+
+	TEST_CASE("Prefixes hash differently");
+	for (i = 0; i < NUM_ELEMENTS(seen); i++) {
+		for (j = i + 1; j < NUM_ELEMENTS(seen); j++) {
+			TEST_CHECK(seen[i] != seen[j]);
+			TEST_MSG("Collision between lengths %zu and %zu", i, j);
+		}
+	}
+
+	TEST_CASE("Single bit changes change the hash");
+	for (i = 0; i < 128; i++) {
+		uint32_t a, b;
+
+		memcpy(buff, data, 16);
+		a = fr_hash_fast(buff, 16);
+		buff[i / 8] ^= 1 << (i % 8);
+		b = fr_hash_fast(buff, 16);
+
+		TEST_CHECK(a != b);
+		TEST_MSG("Flipping bit %zu didn't change the hash", i);
+	}
+}
+
+static uint64_t hash_bench_lookups(bool open, fr_hash_t hash, hash_test_entry_t *entries)
+{
+	fr_hash_table_t	*ht;
+	fr_time_t	start;
+	uint64_t	elapsed;
+	size_t		i;
+
+	ht = _fr_hash_table_alloc(NULL, NULL, open, hash, hash_test_name_cmp, NULL);
+	for (i = 0; i < BENCH_ENTRIES; i++) fr_hash_table_insert(ht, &entries[i]);
+	fr_hash_table_fill(ht);
+
+	start = fr_time();
+	for (i = 0; i < BENCH_LOOKUPS; i++) {
+		hash_test_entry_t *found;
+
+		found = fr_hash_table_find(ht, &entries[(i * 7919) % BENCH_ENTRIES]);
+		if (unlikely(!found)) TEST_CHECK(found != NULL);
+	}
+	elapsed = fr_time_delta_unwrap(fr_time_sub(fr_time(), start));
+
+	talloc_free(ht);
+
+	return elapsed;
+}
+
+static void hash_bench(void)
+{
+	hash_test_entry_t	*entries;
+	uint64_t		chained, chained_fast, open;
+
+	entries = entries_alloc(BENCH_ENTRIES);
+
+	chained = hash_bench_lookups(false, hash_test_name, entries);
+	chained_fast = hash_bench_lookups(false, hash_test_name_fast, entries);
+	open = hash_bench_lookups(true, hash_test_name_fast, entries);
+
+	TEST_MSG_ALWAYS("%u entries, %u lookups of 24 byte names\n", BENCH_ENTRIES, BENCH_LOOKUPS);
+	TEST_MSG_ALWAYS("chained, fr_hash:      %"PRIu64" ns/lookup\n", chained / BENCH_LOOKUPS);
+	TEST_MSG_ALWAYS("chained, fr_hash_fast: %"PRIu64" ns/lookup\n", chained_fast / BENCH_LOOKUPS);
+	TEST_MSG_ALWAYS("open, fr_hash_fast:    %"PRIu64" ns/lookup\n", open / BENCH_LOOKUPS);
+
+	talloc_free(entries);
+}
+
+TEST_LIST = {
+	{ "hash_test_chained",		hash_test_chained },
+	{ "hash_test_open",		hash_test_open },
+	{ "hash_test_open_collide",	hash_test_open_collide },
+	{ "hash_test_open_remove",	hash_test_open_remove },
+	{ "hash_test_open_replace",	hash_test_open_replace },
+	{ "hash_test_open_iter",	hash_test_open_iter },
+	{ "hash_test_fast",		hash_test_fast },
+	{ "hash_bench",			hash_bench },
+
+	{ NULL }
+};
@@ -0,0 +1,288 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Log-linear latency histograms
+ *
+ * Samples are bucketed by their highest set bit, and then linearly
+ * within each power of two.  This gives a constant relative error
+ * across the whole range of values, with a fixed, small, number of
+ * buckets, which is what we want for latencies that span nanoseconds
+ * to seconds.
+ *
+ * @file src/lib/util/histogram.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/histogram.h>
+
+#include <string.h>
+#include <inttypes.h>
+
+/** Return the smallest value which maps to a bucket
+ *
+ * @param[in] idx	of the bucket.
+ * @return the lower bound of the bucket.
+ */
+uint64_t fr_histogram_bucket_low(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < FR_HISTOGRAM_SUB_COUNT) return idx;
+	if (idx >= FR_HISTOGRAM_NUM_BUCKETS) idx = FR_HISTOGRAM_NUM_BUCKETS - 1;
+
+	idx -= FR_HISTOGRAM_SUB_COUNT;
+	shift = (idx / FR_HISTOGRAM_SUB_HALF) + 1;
+
+	return ((uint64_t) ((idx % FR_HISTOGRAM_SUB_HALF) + FR_HISTOGRAM_SUB_HALF)) << shift;
+}
+
+/** Return the largest value which maps to a bucket
+ *
+ * @param[in] idx	of the bucket.
+ * @return the upper bound of the bucket.
+ */
+uint64_t fr_histogram_bucket_high(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < FR_HISTOGRAM_SUB_COUNT) return idx;
+	if (idx >= FR_HISTOGRAM_NUM_BUCKETS) idx = FR_HISTOGRAM_NUM_BUCKETS - 1;
+
+	idx -= FR_HISTOGRAM_SUB_COUNT;
+	shift = (idx / FR_HISTOGRAM_SUB_HALF) + 1;
+
+	return ((((uint64_t) ((idx % FR_HISTOGRAM_SUB_HALF) + FR_HISTOGRAM_SUB_HALF + 1)) << shift) - 1);
+}
+
+/** Reset a histogram
+ *
+ * @param[in] hist	to reset.
+ */
+void fr_histogram_init(fr_histogram_t *hist)
+{
+	unsigned int i;
+
+	atomic_init(&hist->count, 0);
+	atomic_init(&hist->sum, 0);
+	atomic_init(&hist->min, 0);
+	atomic_init(&hist->max, 0);
+
+	for (i = 0; i < FR_HISTOGRAM_NUM_BUCKETS; i++) atomic_init(&hist->bucket[i], 0);
+}
+
+/** Add the contents of one histogram to another
+ *
+ * The source histogram may be concurrently written by its owner.  The
+ * destination must be owned by the caller.
+ *
+ * @param[in] dst	to add samples to.
+ * @param[in] src	to read samples from.
+ */
+void fr_histogram_merge(fr_histogram_t *dst, fr_histogram_t const *src)
+{
+	unsigned int	i;
+	uint64_t	src_count, dst_count, value;
+
+	src_count = atomic_load_explicit(&src->count, memory_order_relaxed);
+	if (!src_count) return;
+
+	dst_count = atomic_load_explicit(&dst->count, memory_order_relaxed);
+
+	value = atomic_load_explicit(&src->min, memory_order_relaxed);
+	if (!dst_count || (value < atomic_load_explicit(&dst->min, memory_order_relaxed))) {
+		atomic_store_explicit(&dst->min, value, memory_order_relaxed);
+	}
+
+	value = atomic_load_explicit(&src->max, memory_order_relaxed);
+	if (value > atomic_load_explicit(&dst->max, memory_order_relaxed)) {
+		atomic_store_explicit(&dst->max, value, memory_order_relaxed);
+	}
+
+	/*
+	 *	Recompute the count from the buckets, so that the
+	 *	snapshot is self-consistent even if the owner
+	 *	recorded more samples while we were copying.
+	 */
+	src_count = 0;
+	for (i = 0; i < FR_HISTOGRAM_NUM_BUCKETS; i++) {
+		value = atomic_load_explicit(&src->bucket[i], memory_order_relaxed);
+		if (!value) continue;
+
+		src_count += value;
+		atomic_store_explicit(&dst->bucket[i],
+				      atomic_load_explicit(&dst->bucket[i], memory_order_relaxed) + value,
+				      memory_order_relaxed);
+	}
+
+	atomic_store_explicit(&dst->sum, atomic_load_explicit(&dst->sum, memory_order_relaxed) +
+			      atomic_load_explicit(&src->sum, memory_order_relaxed), memory_order_relaxed);
+	atomic_store_explicit(&dst->count, dst_count + src_count, memory_order_relaxed);
+}
+
+/** Produce a histogram of the samples recorded between two snapshots
+ *
+ * Both snapshots must be of the same histogram, with prev taken before
+ * now, e.g. by fr_histogram_merge() into an empty histogram.  The min
+ * and max of the result are only as accurate as the bucket boundaries.
+ *
+ * @param[out] out	where the difference is written.
+ * @param[in] now	the later snapshot.
+ * @param[in] prev	the earlier snapshot.
+ */
+void fr_histogram_sub(fr_histogram_t *out, fr_histogram_t const *now, fr_histogram_t const *prev)
+{
+	unsigned int	i;
+	uint64_t	count = 0, value;
+
+	fr_histogram_init(out);
+
+	for (i = 0; i < FR_HISTOGRAM_NUM_BUCKETS; i++) {
+		value = atomic_load_explicit(&now->bucket[i], memory_order_relaxed) -
+			atomic_load_explicit(&prev->bucket[i], memory_order_relaxed);
+		if (!value) continue;
+
+		atomic_store_explicit(&out->bucket[i], value, memory_order_relaxed);
+		if (!count) atomic_store_explicit(&out->min, fr_histogram_bucket_low(i), memory_order_relaxed);
+		atomic_store_explicit(&out->max, fr_histogram_bucket_high(i), memory_order_relaxed);
+		count += value;
+	}
+
+	atomic_store_explicit(&out->count, count, memory_order_relaxed);
+	atomic_store_explicit(&out->sum, atomic_load_explicit(&now->sum, memory_order_relaxed) -
+			      atomic_load_explicit(&prev->sum, memory_order_relaxed), memory_order_relaxed);
+}
+
+/** Return the number of samples in a histogram
+ *
+ */
+uint64_t fr_histogram_count(fr_histogram_t const *hist)
+{
+	return atomic_load_explicit(&hist->count, memory_order_relaxed);
+}
+
+/** Return the sum of all samples in a histogram
+ *
+ */
+uint64_t fr_histogram_sum(fr_histogram_t const *hist)
+{
+	return atomic_load_explicit(&hist->sum, memory_order_relaxed);
+}
+
+/** Return the smallest sample recorded in a histogram
+ *
+ */
+uint64_t fr_histogram_min(fr_histogram_t const *hist)
+{
+	return atomic_load_explicit(&hist->min, memory_order_relaxed);
+}
+
+/** Return the largest sample recorded in a histogram
+ *
+ */
+uint64_t fr_histogram_max(fr_histogram_t const *hist)
+{
+	return atomic_load_explicit(&hist->max, memory_order_relaxed);
+}
+
+/** Return the number of samples which are less than or equal to a value
+ *
+ * The answer is exact only at bucket boundaries.  Samples in the bucket
+ * containing value are counted if the upper bound of that bucket is
+ * less than or equal to value.
+ *
+ * @param[in] hist	to examine.
+ * @param[in] value	to compare samples against.
+ * @return the number of samples <= value.
+ */
+uint64_t fr_histogram_count_below(fr_histogram_t const *hist, uint64_t value)
+{
+	unsigned int	i;
+	uint64_t	total = 0;
+
+	for (i = 0; i < FR_HISTOGRAM_NUM_BUCKETS; i++) {
+		if (fr_histogram_bucket_high(i) > value) break;
+
+		total += atomic_load_explicit(&hist->bucket[i], memory_order_relaxed);
+	}
+
+	return total;
+}
+
+/** Return the value below which a given percentage of samples fall
+ *
+ * As with HDR histograms, the value returned is the highest value
+ * which is equivalent to the sample at that rank, i.e. the upper
+ * bound of its bucket, clamped to the largest value recorded.
+ *
+ * @param[in] hist		to examine.
+ * @param[in] percentile	0.0 to 100.0.
+ * @return
+ *	- 0 if the histogram is empty.
+ *	- the value at the given percentile.
+ */
+uint64_t fr_histogram_percentile(fr_histogram_t const *hist, double percentile)
+{
+	unsigned int	i;
+	uint64_t	count, rank, total = 0, max;
+
+	count = atomic_load_explicit(&hist->count, memory_order_relaxed);
+	if (!count) return 0;
+
+	if (percentile < 0) percentile = 0;
+	if (percentile > 100) percentile = 100;
+
+	rank = (uint64_t) ((percentile / 100.0) * count + 0.5);
+	if (rank < 1) rank = 1;
+
+	max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+
+	for (i = 0; i < FR_HISTOGRAM_NUM_BUCKETS; i++) {
+		total += atomic_load_explicit(&hist->bucket[i], memory_order_relaxed);
+		if (total >= rank) {
+			uint64_t high = fr_histogram_bucket_high(i);
+
+			return (high < max) ? high : max;
+		}
+	}
+
+	return max;
+}
+
+/** Print a summary of a histogram
+ *
+ * Output is in the same "name value" format as the other radmin statistics.
+ *
+ * @param[in] fp	to print to.
+ * @param[in] hist	to print.
+ * @param[in] prefix	for each line.
+ */
+void fr_histogram_fprint(FILE *fp, fr_histogram_t const *hist, char const *prefix)
+{
+	if (!prefix) prefix = "histogram";
+
+	fprintf(fp, "%s.count\t\t\t%" PRIu64 "\n", prefix, fr_histogram_count(hist));
+	if (!fr_histogram_count(hist)) return;
+
+	fprintf(fp, "%s.min\t\t\t%" PRIu64 "\n", prefix, fr_histogram_min(hist));
+	fprintf(fp, "%s.mean\t\t\t%" PRIu64 "\n", prefix, fr_histogram_sum(hist) / fr_histogram_count(hist));
+	fprintf(fp, "%s.p50\t\t\t%" PRIu64 "\n", prefix, fr_histogram_percentile(hist, 50));
+	fprintf(fp, "%s.p90\t\t\t%" PRIu64 "\n", prefix, fr_histogram_percentile(hist, 90));
+	fprintf(fp, "%s.p99\t\t\t%" PRIu64 "\n", prefix, fr_histogram_percentile(hist, 99));
+	fprintf(fp, "%s.p999\t\t\t%" PRIu64 "\n", prefix, fr_histogram_percentile(hist, 99.9));
+	fprintf(fp, "%s.max\t\t\t%" PRIu64 "\n", prefix, fr_histogram_max(hist));
+}
@@ -0,0 +1,167 @@
+#pragma once
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Log-linear latency histograms
+ *
+ * @file src/lib/util/histogram.h
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSIDH(histogram_h, "$Id$")
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <freeradius-devel/build.h>
+#include <freeradius-devel/util/math.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+/** Number of bits of precision kept for each power of two
+ *
+ * Values below 2^FR_HISTOGRAM_SUB_BITS are recorded exactly.  Above
+ * that, every power of two is split into 2^(FR_HISTOGRAM_SUB_BITS - 1)
+ * linear sub-buckets, which bounds the relative error of any reported
+ * value to 1 / 2^(FR_HISTOGRAM_SUB_BITS - 1), i.e. ~3%.
+ */
+#define FR_HISTOGRAM_SUB_BITS		(6)
+#define FR_HISTOGRAM_SUB_COUNT		(1 << FR_HISTOGRAM_SUB_BITS)
+#define FR_HISTOGRAM_SUB_HALF		(FR_HISTOGRAM_SUB_COUNT >> 1)
+
+/** Largest value (as a power of two) which can be recorded
+ *
+ * Larger values are clamped into the last bucket.  For nanosecond
+ * latencies 2^40 is a little over 18 minutes.
+ */
+#define FR_HISTOGRAM_MAX_BITS		(40)
+#define FR_HISTOGRAM_MAX_VALUE		((UINT64_C(1) << FR_HISTOGRAM_MAX_BITS) - 1)
+
+#define FR_HISTOGRAM_NUM_BUCKETS	(FR_HISTOGRAM_SUB_COUNT + \
+					 ((FR_HISTOGRAM_MAX_BITS - FR_HISTOGRAM_SUB_BITS) * FR_HISTOGRAM_SUB_HALF))
+
+/** A log-linear (HDR style) histogram
+ *
+ * A histogram has exactly one writer, typically the thread which owns it.
+ * All fields are atomics so that another thread can read (or merge) the
+ * histogram while it is being written, without taking a lock.  Writers
+ * use relaxed operations, so the counters of a concurrent snapshot may
+ * be off by the handful of samples which were in flight.
+ */
+typedef struct {
+	atomic_uint_fast64_t	count;				//!< Number of samples recorded.
+	atomic_uint_fast64_t	sum;				//!< Sum of all samples.
+	atomic_uint_fast64_t	min;				//!< Smallest sample.
+	atomic_uint_fast64_t	max;				//!< Largest sample.
+	atomic_uint_fast64_t	bucket[FR_HISTOGRAM_NUM_BUCKETS];	//!< Per-bucket counts.
+} fr_histogram_t;
+
+/** Map a value to the bucket which holds it
+ *
+ * @param[in] value	to map.
+ * @return the bucket index.
+ */
+static inline CC_HINT(always_inline) unsigned int fr_histogram_bucket(uint64_t value)
+{
+	unsigned int	shift;
+
+	if (value > FR_HISTOGRAM_MAX_VALUE) value = FR_HISTOGRAM_MAX_VALUE;
+
+	if (value < FR_HISTOGRAM_SUB_COUNT) return value;
+
+	/*
+	 *	Keep the top FR_HISTOGRAM_SUB_BITS bits of the value.
+	 *	The highest of those is always set, so only the lower
+	 *	bits select the sub-bucket within this power of two.
+	 */
+	shift = fr_high_bit_pos(value) - FR_HISTOGRAM_SUB_BITS;
+
+	return FR_HISTOGRAM_SUB_COUNT + ((shift - 1) * FR_HISTOGRAM_SUB_HALF) +
+	       ((value >> shift) - FR_HISTOGRAM_SUB_HALF);
+}
+
+/** Increment a counter which has only one writer
+ *
+ * A relaxed load and store is enough, and avoids a locked
+ * read-modify-write.  Readers in other threads may see a value which
+ * is slightly out of date, but never a torn one.
+ *
+ * @param[in] counter	to increment.
+ */
+static inline CC_HINT(always_inline) void fr_histogram_counter_inc(atomic_uint_fast64_t *counter)
+{
+	atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+/** Record a single sample
+ *
+ * Must only be called by the thread which owns the histogram.
+ *
+ * @param[in] hist	to record the sample in.
+ * @param[in] value	to record, usually a latency in nanoseconds.
+ */
+static inline CC_HINT(always_inline) void fr_histogram_record(fr_histogram_t *hist, uint64_t value)
+{
+	uint64_t	count = atomic_load_explicit(&hist->count, memory_order_relaxed);
+
+	if (!count || (value < atomic_load_explicit(&hist->min, memory_order_relaxed))) {
+		atomic_store_explicit(&hist->min, value, memory_order_relaxed);
+	}
+	if (value > atomic_load_explicit(&hist->max, memory_order_relaxed)) {
+		atomic_store_explicit(&hist->max, value, memory_order_relaxed);
+	}
+
+	fr_histogram_counter_inc(&hist->bucket[fr_histogram_bucket(value)]);
+	atomic_store_explicit(&hist->sum, atomic_load_explicit(&hist->sum, memory_order_relaxed) + value,
+			      memory_order_relaxed);
+	atomic_store_explicit(&hist->count, count + 1, memory_order_relaxed);
+}
+
+uint64_t	fr_histogram_bucket_low(unsigned int idx);
+
+uint64_t	fr_histogram_bucket_high(unsigned int idx);
+
+void		fr_histogram_init(fr_histogram_t *hist) CC_HINT(nonnull);
+
+void		fr_histogram_merge(fr_histogram_t *dst, fr_histogram_t const *src) CC_HINT(nonnull);
+
+void		fr_histogram_sub(fr_histogram_t *out, fr_histogram_t const *now, fr_histogram_t const *prev) CC_HINT(nonnull);
+
+uint64_t	fr_histogram_count(fr_histogram_t const *hist) CC_HINT(nonnull);
+
+uint64_t	fr_histogram_sum(fr_histogram_t const *hist) CC_HINT(nonnull);
+
+uint64_t	fr_histogram_min(fr_histogram_t const *hist) CC_HINT(nonnull);
+
+uint64_t	fr_histogram_max(fr_histogram_t const *hist) CC_HINT(nonnull);
+
+uint64_t	fr_histogram_count_below(fr_histogram_t const *hist, uint64_t value) CC_HINT(nonnull);
+
+uint64_t	fr_histogram_percentile(fr_histogram_t const *hist, double percentile) CC_HINT(nonnull);
+
+void		fr_histogram_fprint(FILE *fp, fr_histogram_t const *hist, char const *prefix) CC_HINT(nonnull(1,2));
+
+#ifdef __cplusplus
+}
+#endif
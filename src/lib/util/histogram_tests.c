@@ -0,0 +1,211 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for log-linear histograms
+ *
+ * @file src/lib/util/histogram_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/histogram.h>
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+/*
+ *	Every value must land in a bucket whose bounds contain it,
+ *	and bucket indexes must never decrease as values increase.
+ */
+static void histogram_bucket_bounds(void)
+{
+	uint64_t	value;
+	unsigned int	idx, last = 0;
+
+	for (value = 0; value < (1 << 20); value++) {
+		idx = fr_histogram_bucket(value);
+
+		TEST_CHECK(idx < FR_HISTOGRAM_NUM_BUCKETS);
+		TEST_CHECK(idx >= last);
+		TEST_CHECK(fr_histogram_bucket_low(idx) <= value);
+		TEST_CHECK(fr_histogram_bucket_high(idx) >= value);
+		TEST_MSG("value %" PRIu64 " idx %u low %" PRIu64 " high %" PRIu64, value, idx,
+			 fr_histogram_bucket_low(idx), fr_histogram_bucket_high(idx));
+		last = idx;
+	}
+
+	/*
+	 *	Adjacent buckets must tile the value space.
+	 */
+	for (idx = 1; idx < FR_HISTOGRAM_NUM_BUCKETS; idx++) {
+		TEST_CHECK(fr_histogram_bucket_low(idx) == fr_histogram_bucket_high(idx - 1) + 1);
+		TEST_MSG("idx %u", idx);
+	}
+
+	TEST_CHECK(fr_histogram_bucket(FR_HISTOGRAM_MAX_VALUE) == FR_HISTOGRAM_NUM_BUCKETS - 1);
+	TEST_CHECK(fr_histogram_bucket(UINT64_MAX) == FR_HISTOGRAM_NUM_BUCKETS - 1);
+	TEST_CHECK(fr_histogram_bucket_high(FR_HISTOGRAM_NUM_BUCKETS - 1) == FR_HISTOGRAM_MAX_VALUE);
+}
+
+/*
+ *	The width of any bucket must be within our advertised
+ *	relative error of its lower bound.
+ */
+static void histogram_relative_error(void)
+{
+	unsigned int idx;
+
+	for (idx = FR_HISTOGRAM_SUB_COUNT; idx < FR_HISTOGRAM_NUM_BUCKETS; idx++) {
+		uint64_t low = fr_histogram_bucket_low(idx);
+		uint64_t high = fr_histogram_bucket_high(idx);
+
+		TEST_CHECK(((high - low) * FR_HISTOGRAM_SUB_HALF) <= low);
+		TEST_MSG("idx %u low %" PRIu64 " high %" PRIu64, idx, low, high);
+	}
+}
+
+static void histogram_percentiles(void)
+{
+	fr_histogram_t	*hist;
+	uint64_t	i, p;
+
+	hist = malloc(sizeof(*hist));
+	fr_histogram_init(hist);
+
+	TEST_CHECK(fr_histogram_percentile(hist, 50) == 0);
+
+	/*
+	 *	1us .. 100ms in 1us steps
+	 */
+	for (i = 1; i <= 100000; i++) fr_histogram_record(hist, i * 1000);
+
+	TEST_CHECK(fr_histogram_count(hist) == 100000);
+	TEST_CHECK(fr_histogram_min(hist) == 1000);
+	TEST_CHECK(fr_histogram_max(hist) == 100000000);
+	TEST_CHECK(fr_histogram_sum(hist) == (uint64_t) 1000 * 100000 * 100001 / 2);
+
+	p = fr_histogram_percentile(hist, 50);
+	TEST_CHECK((p >= 50000000) && (p <= 50000000 + (50000000 / FR_HISTOGRAM_SUB_HALF)));
+	TEST_MSG("p50 %" PRIu64, p);
+
+	p = fr_histogram_percentile(hist, 99);
+	TEST_CHECK((p >= 99000000) && (p <= 99000000 + (99000000 / FR_HISTOGRAM_SUB_HALF)));
+	TEST_MSG("p99 %" PRIu64, p);
+
+	p = fr_histogram_percentile(hist, 99.9);
+	TEST_CHECK((p >= 99900000) && (p <= 100000000));
+	TEST_MSG("p999 %" PRIu64, p);
+
+	TEST_CHECK(fr_histogram_percentile(hist, 100) == 100000000);
+	TEST_CHECK(fr_histogram_percentile(hist, 0) <= 1000 + (1000 / FR_HISTOGRAM_SUB_HALF));
+
+	free(hist);
+}
+
+static void histogram_merge(void)
+{
+	fr_histogram_t	*a, *b, *c;
+	uint64_t	i;
+
+	a = malloc(sizeof(*a));
+	b = malloc(sizeof(*b));
+	c = malloc(sizeof(*c));
+	fr_histogram_init(a);
+	fr_histogram_init(b);
+	fr_histogram_init(c);
+
+	for (i = 1; i <= 1000; i++) {
+		fr_histogram_record((i & 1) ? a : b, i * 7);
+		fr_histogram_record(c, i * 7);
+	}
+
+	fr_histogram_merge(a, b);
+
+	TEST_CHECK(fr_histogram_count(a) == fr_histogram_count(c));
+	TEST_CHECK(fr_histogram_sum(a) == fr_histogram_sum(c));
+	TEST_CHECK(fr_histogram_min(a) == fr_histogram_min(c));
+	TEST_CHECK(fr_histogram_max(a) == fr_histogram_max(c));
+
+	for (i = 0; i < FR_HISTOGRAM_NUM_BUCKETS; i++) {
+		TEST_CHECK(atomic_load(&a->bucket[i]) == atomic_load(&c->bucket[i]));
+		TEST_MSG("bucket %" PRIu64, i);
+	}
+
+	TEST_CHECK(fr_histogram_count_below(a, 63) == 9);
+
+	/*
+	 *	Merging an empty histogram is a noop
+	 */
+	fr_histogram_init(b);
+	fr_histogram_merge(a, b);
+	TEST_CHECK(fr_histogram_count(a) == 1000);
+
+	free(a);
+	free(b);
+	free(c);
+}
+
+static void histogram_sub(void)
+{
+	fr_histogram_t	*live, *prev, *now, *delta;
+	uint64_t	i;
+
+	live = malloc(sizeof(*live));
+	prev = malloc(sizeof(*prev));
+	now = malloc(sizeof(*now));
+	delta = malloc(sizeof(*delta));
+	fr_histogram_init(live);
+	fr_histogram_init(prev);
+	fr_histogram_init(now);
+
+	for (i = 1; i <= 100; i++) fr_histogram_record(live, i);
+	fr_histogram_merge(prev, live);
+
+	for (i = 1000; i < 2000; i++) fr_histogram_record(live, i);
+	fr_histogram_merge(now, live);
+
+	fr_histogram_sub(delta, now, prev);
+
+	TEST_CHECK(fr_histogram_count(delta) == 1000);
+	TEST_CHECK(fr_histogram_sum(delta) == fr_histogram_sum(live) - 5050);
+	TEST_CHECK(fr_histogram_min(delta) <= 1000);
+	TEST_CHECK(fr_histogram_min(delta) > 100);
+	TEST_CHECK(fr_histogram_max(delta) >= 1999);
+	TEST_CHECK(fr_histogram_count_below(delta, 1000) == 0);
+
+	/*
+	 *	No new samples, no difference
+	 */
+	fr_histogram_sub(delta, now, now);
+	TEST_CHECK(fr_histogram_count(delta) == 0);
+	TEST_CHECK(fr_histogram_sum(delta) == 0);
+
+	free(live);
+	free(prev);
+	free(now);
+	free(delta);
+}
+
+TEST_LIST = {
+	{ "histogram_bucket_bounds",	histogram_bucket_bounds },
+	{ "histogram_relative_error",	histogram_relative_error },
+	{ "histogram_percentiles",	histogram_percentiles },
+	{ "histogram_merge",		histogram_merge },
+	{ "histogram_sub",		histogram_sub },
+
+	{ NULL }
+};
@@ -1362,6 +1362,63 @@ int8_t fr_ipaddr_cmp(fr_ipaddr_t const *a, fr_ipaddr_t const *b)
 	}
 }
 
+/** Produce a 64bit key which orders ip addresses the same way as #fr_ipaddr_cmp
+ *
+ * If fr_ipaddr_key(a) < fr_ipaddr_key(b) then fr_ipaddr_cmp(a, b) < 0.
+ * Addresses with equal keys may still differ, and must be compared
+ * with #fr_ipaddr_cmp.
+ *
+ * The key holds the address family, the prefix, and for IPv4 the
+ * whole address.  For IPv6 it holds the scope_id and the first four
+ * bytes of the address, which is enough to separate most sites, but
+ * not the hosts within them.
+ *
+ * @param[in] ipaddr	to produce a key for.
+ * @return the key.
+ */
+uint64_t fr_ipaddr_key(fr_ipaddr_t const *ipaddr)
+{
+	uint64_t	key;
+	uint8_t const	*addr;
+	size_t		len, i;
+
+	if (ipaddr->af < 0) return 0;
+	if (ipaddr->af > UINT8_MAX) return (uint64_t)UINT8_MAX << 56;
+
+	key = ((uint64_t)ipaddr->af << 56) | ((uint64_t)ipaddr->prefix << 48);
+
+	len = ((ipaddr->prefix + 7) & -8) >> 3;
+	switch (ipaddr->af) {
+	case AF_INET:
+		addr = (uint8_t const *)&ipaddr->addr.v4;
+		if (len > 4) len = 4;
+
+		for (i = 0; i < len; i++) key |= (uint64_t)addr[i] << (40 - (i * 8));
+		return key;
+
+#ifdef HAVE_STRUCT_SOCKADDR_IN6
+	case AF_INET6:
+		/*
+		 *	The scope_id is compared before the address,
+		 *	so the address can only follow it in the key
+		 *	if the whole scope_id fits.
+		 */
+		if (ipaddr->scope_id >= UINT16_MAX) return key | ((uint64_t)UINT16_MAX << 32);
+
+		key |= (uint64_t)ipaddr->scope_id << 32;
+
+		addr = (uint8_t const *)&ipaddr->addr.v6;
+		if (len > 4) len = 4;
+
+		for (i = 0; i < len; i++) key |= (uint64_t)addr[i] << (24 - (i * 8));
+		return key;
+#endif
+
+	default:
+		return key;
+	}
+}
+
 /** Convert our internal ip address representation to a sockaddr
  *
  * @param[out] sa	where to write out the sockaddr,
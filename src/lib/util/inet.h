@@ -153,6 +153,8 @@ int	fr_interface_to_ethernet(char const *interface, fr_ethernet_t *ethernet);
  */
 int8_t	fr_ipaddr_cmp(fr_ipaddr_t const *a, fr_ipaddr_t const *b);
 
+uint64_t	fr_ipaddr_key(fr_ipaddr_t const *ipaddr);
+
 /*
  *	Sockaddr conversion functions
  */
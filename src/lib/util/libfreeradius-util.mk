@@ -15,6 +15,7 @@ SOURCES		:= \
 		   base16.c \
 		   base32.c \
 		   base64.c \
+		   btree.c \
 		   calc.c \
 		   cap.c \
 		   chap.c \
@@ -42,6 +43,7 @@ SOURCES		:= \
 		   getaddrinfo.c \
 		   hash.c \
 		   heap.c \
+		   histogram.c \
 		   hmac_md5.c \
 		   hmac_sha1.c \
 		   htrie.c \
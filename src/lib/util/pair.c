@@ -508,6 +508,21 @@ fr_pair_t *fr_pair_copy(TALLOC_CTX *ctx, fr_pair_t const *vp)
 	return n;
 }
 
+/** Give a pair, and any children, their own copies of shared buffers
+ *
+ */
+static int pair_unshare(fr_pair_t *vp)
+{
+	if (fr_type_is_structural(vp->vp_type)) {
+		fr_pair_list_foreach(&vp->vp_group, child) {
+			if (unlikely(pair_unshare(child) < 0)) return -1;
+		}
+		return 0;
+	}
+
+	return fr_value_box_unshare(vp, &vp->data);
+}
+
 /** Steal one VP
  *
  * @param[in] ctx to move fr_pair_t into
@@ -517,6 +532,12 @@ int fr_pair_steal(TALLOC_CTX *ctx, fr_pair_t *vp)
 {
 	fr_pair_t *nvp;
 
+	/*
+	 *	The new ctx may outlive the packet the value
+	 *	was decoded from.
+	 */
+	if (unlikely(pair_unshare(vp) < 0)) return -1;
+
 	nvp = talloc_steal(ctx, vp);
 	if (unlikely(!nvp)) {
 		fr_strerror_printf("Failed moving pair %pV to new ctx", vp);
@@ -3200,6 +3221,7 @@ void fr_pair_verify(char const *file, int line, fr_pair_list_t const *list, fr_p
 		TALLOC_CTX *parent;
 
 		if (!vp->vp_octets) break;	/* We might be in the middle of initialisation */
+		if (vp->data.shared) break;	/* Buffer belongs to the packet */
 
 		if (!talloc_get_type(vp->vp_ptr, uint8_t)) {
 			fr_fatal_assert_fail("CONSISTENCY CHECK FAILED %s[%u]: fr_pair_t \"%s\" data buffer type should be "
@@ -1315,6 +1315,51 @@ static void test_fr_pair_value_memdup_buffer_shallow(void)
 	talloc_free(copy_test_octets);
 }
 
+static void test_fr_pair_value_memdup_shared(void)
+{
+	fr_pair_t	*vp;
+	uint8_t		packet[NUM_ELEMENTS(test_octets)];
+
+	memcpy(packet, test_octets, sizeof(packet));
+
+	TEST_CASE("Allocate a new attribute fr_pair_afrom_da");
+	TEST_CHECK((vp = fr_pair_afrom_da(autofree, fr_dict_attr_test_octets)) != NULL);
+	if (!vp) return;
+
+	TEST_CASE("Reference a buffer which isn't talloced using fr_value_box_memdup_shared()");
+	fr_value_box_memdup_shared(&vp->data, vp->da, packet, sizeof(packet), true);
+	TEST_CHECK(vp->data.shared);
+	TEST_CHECK(vp->vp_octets == packet);
+	TEST_CHECK(vp->vp_length == sizeof(packet));
+
+	TEST_CASE("Validating PAIR_VERIFY()");
+	PAIR_VERIFY(vp);
+
+	TEST_CASE("Stealing the pair gives it its own copy of the buffer");
+	TEST_CHECK(fr_pair_steal(autofree, vp) == 0);
+	TEST_CHECK(!vp->data.shared);
+	TEST_CHECK(vp->vp_octets != packet);
+	TEST_CHECK(memcmp(vp->vp_octets, test_octets, sizeof(packet)) == 0);
+	TEST_CHECK(talloc_parent(vp->vp_octets) == vp);
+
+	TEST_CASE("Appending to a shared buffer copies it first");
+	fr_value_box_clear(&vp->data);
+	fr_value_box_memdup_shared(&vp->data, vp->da, packet, sizeof(packet), true);
+	TEST_CHECK(fr_pair_value_mem_append(vp, test_octets, NUM_ELEMENTS(test_octets), true) == 0);
+	TEST_CHECK(!vp->data.shared);
+	TEST_CHECK(vp->vp_length == (2 * sizeof(packet)));
+	TEST_CHECK(memcmp(packet, test_octets, sizeof(packet)) == 0);
+
+	TEST_CASE("Replacing a shared value doesn't free the buffer");
+	fr_value_box_clear(&vp->data);
+	fr_value_box_memdup_shared(&vp->data, vp->da, packet, sizeof(packet), true);
+	TEST_CHECK(fr_pair_value_memdup(vp, test_octets, NUM_ELEMENTS(test_octets), false) == 0);
+	TEST_CHECK(!vp->data.shared);
+	TEST_CHECK(vp->vp_octets != packet);
+
+	talloc_free(vp);
+}
+
 static void test_fr_pair_value_mem_append(void)
 {
 	fr_pair_t *vp;
@@ -1482,6 +1527,7 @@ TEST_LIST = {
 	{ "fr_pair_value_memdup_buffer",          test_fr_pair_value_memdup_buffer },
 	{ "fr_pair_value_memdup_shallow",         test_fr_pair_value_memdup_shallow },
 	{ "fr_pair_value_memdup_buffer_shallow",  test_fr_pair_value_memdup_buffer_shallow },
+	{ "fr_pair_value_memdup_shared",          test_fr_pair_value_memdup_shared },
 	{ "fr_pair_value_mem_append",             test_fr_pair_value_mem_append },
 	{ "fr_pair_value_mem_append_buffer",      test_fr_pair_value_mem_append_buffer },
 
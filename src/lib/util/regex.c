@@ -27,6 +27,13 @@ RCSID("$Id$")
 
 #include <freeradius-devel/util/regex.h>
 #include <freeradius-devel/util/atexit.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
+
+/** Maximum number of runtime expressions each thread keeps compiled
+ *
+ */
+static uint32_t regex_cache_size = REGEX_CACHE_SIZE_DEFAULT;
 
 #if defined(HAVE_REGEX_PCRE) || (defined(HAVE_REGEX_PCRE2) && defined(PCRE2_CONFIG_JIT))
 #ifndef FR_PCRE_JIT_STACK_MIN
@@ -64,8 +71,29 @@ typedef struct {
 	pcre2_jit_stack		*jit_stack;	//!< Jit stack for executing jit'd patterns.
 	bool			do_jit;		//!< Whether we have runtime JIT support.
 #endif
+
+	fr_hash_table_t		*cache;		//!< Runtime expressions, by pattern and flags.
+	fr_dlist_head_t		cache_lru;	//!< Runtime expressions, least recently used first.
+	fr_regex_cache_stats_t	cache_stats;	//!< How well the cache is doing.
 } fr_pcre2_tls_t;
 
+/** A compiled runtime expression, shared by all regex_t produced from the same pattern and flags
+ *
+ */
+struct fr_regex_cache_entry_s {
+	fr_dlist_t		entry;		//!< Entry in the LRU list.
+
+	uint8_t const		*pattern;	//!< Uncompiled expression.
+	size_t			len;		//!< Length of the pattern.
+	uint32_t		cflags;		//!< Flags the pattern was compiled with.
+
+	pcre2_code		*compiled;	//!< Compiled expression.
+	bool			jitd;		//!< Whether the expression has been JIT compiled.
+
+	uint32_t		refs;		//!< Number of regex_t using the compiled expression.
+	bool			evicted;	//!< No longer in the cache, freed when refs drops to zero.
+};
+
 /** Thread local storage for pcre2
  *
  */
@@ -97,6 +125,21 @@ static void _pcre2_talloc_free(void *to_free, UNUSED void *uctx)
  */
 static int _pcre2_tls_free(fr_pcre2_tls_t *tls)
 {
+	fr_regex_cache_entry_t *entry;
+
+	/*
+	 *	Expressions which are still in use are freed
+	 *	when the last regex_t using them is freed.
+	 */
+	if (tls->cache) {
+		while ((entry = fr_dlist_pop_head(&tls->cache_lru))) {
+			if (!entry->refs) continue;
+
+			entry->evicted = true;
+			talloc_steal(NULL, entry);
+		}
+	}
+
 	if (tls->gcontext) pcre2_general_context_free(tls->gcontext);
 	if (tls->ccontext) pcre2_compile_context_free(tls->ccontext);
 	if (tls->mcontext) pcre2_match_context_free(tls->mcontext);
@@ -112,6 +155,34 @@ static int _pcre2_tls_free_on_exit(void *arg)
 	return talloc_free(arg);
 }
 
+static uint32_t regex_cache_entry_hash(void const *data)
+{
+	fr_regex_cache_entry_t const *entry = data;
+
+	return fr_hash_update(&entry->cflags, sizeof(entry->cflags), fr_hash(entry->pattern, entry->len));
+}
+
+static int8_t regex_cache_entry_cmp(void const *one, void const *two)
+{
+	fr_regex_cache_entry_t const *a = one, *b = two;
+	int8_t ret;
+
+	ret = CMP(a->cflags, b->cflags);
+	if (ret != 0) return ret;
+
+	ret = CMP(a->len, b->len);
+	if (ret != 0) return ret;
+
+	return CMP(memcmp(a->pattern, b->pattern, a->len), 0);
+}
+
+static int _regex_cache_entry_free(fr_regex_cache_entry_t *entry)
+{
+	if (entry->compiled) pcre2_code_free(entry->compiled);
+
+	return 0;
+}
+
 /** Thread local init for pcre2
  *
  */
@@ -158,6 +229,13 @@ static int fr_pcre2_tls_init(void)
 	}
 #endif
 
+	tls->cache = fr_hash_table_alloc(tls, regex_cache_entry_hash, regex_cache_entry_cmp, NULL);
+	if (!tls->cache) {
+		fr_strerror_const("Failed allocating expression cache");
+		goto error;
+	}
+	fr_dlist_talloc_init(&tls->cache_lru, fr_regex_cache_entry_t, entry);
+
 	/*
 	 *	Free on thread exit
 	 */
@@ -175,11 +253,124 @@ static int fr_pcre2_tls_init(void)
  */
 static int _regex_free(regex_t *preg)
 {
+	fr_regex_cache_entry_t *entry = preg->cache_entry;
+
+	if (entry) {
+		if ((--entry->refs == 0) && entry->evicted) talloc_free(entry);
+		return 0;
+	}
+
 	if (preg->compiled) pcre2_code_free(preg->compiled);
 
 	return 0;
 }
 
+/** Find or compile a runtime expression in the thread's expression cache
+ *
+ * Expressions are JIT compiled the second time they're used, so
+ * patterns which are only ever seen once don't pay for the JIT.
+ *
+ * @param[in] ctx		to allocate the regex_t in.
+ * @param[out] out		Where to write the regex_t.
+ * @param[in] pattern		to compile.
+ * @param[in] len		of pattern.
+ * @param[in] cflags		to pass to pcre2_compile.
+ * @return
+ *	- >= 1 on success.
+ *	- <= 0 on error. Negative value is offset of parse error.
+ */
+static ssize_t regex_cache_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_t len, uint32_t cflags)
+{
+	fr_pcre2_tls_t		*tls = fr_pcre2_tls;
+	fr_regex_cache_entry_t	*entry;
+	regex_t			*preg;
+
+	entry = fr_hash_table_find(tls->cache, &(fr_regex_cache_entry_t){ .pattern = (uint8_t const *)pattern,
+									   .len = len, .cflags = cflags });
+	if (entry) {
+		tls->cache_stats.hits++;
+		fr_dlist_remove(&tls->cache_lru, entry);
+		fr_dlist_insert_tail(&tls->cache_lru, entry);
+
+#ifdef PCRE2_CONFIG_JIT
+		/*
+		 *	It's been seen before, so it's probably
+		 *	worth the cost of the JIT.  If the JIT
+		 *	fails, the interpreter still works.
+		 */
+		if (!entry->jitd && tls->do_jit &&
+		    (pcre2_jit_compile(entry->compiled, PCRE2_JIT_COMPLETE) == 0)) entry->jitd = true;
+#endif
+	} else {
+		int		ret;
+		PCRE2_SIZE	offset;
+
+		tls->cache_stats.misses++;
+
+		entry = talloc_zero(tls, fr_regex_cache_entry_t);
+		if (!entry) {
+			fr_strerror_const("Out of memory");
+			return 0;
+		}
+		talloc_set_destructor(entry, _regex_cache_entry_free);
+
+		entry->compiled = pcre2_compile((PCRE2_SPTR8)pattern, len, cflags, &ret, &offset, tls->ccontext);
+		if (!entry->compiled) {
+			PCRE2_UCHAR errbuff[128];
+
+			pcre2_get_error_message(ret, errbuff, sizeof(errbuff));
+			fr_strerror_printf("%s", (char *)errbuff);
+			talloc_free(entry);
+
+			return -(ssize_t)offset;
+		}
+
+		entry->pattern = talloc_memdup(entry, pattern, len);
+		entry->len = len;
+		entry->cflags = cflags;
+		if (!entry->pattern || !fr_hash_table_insert(tls->cache, entry)) {
+			fr_strerror_const("Failed inserting expression into cache");
+			talloc_free(entry);
+			return 0;
+		}
+		fr_dlist_insert_tail(&tls->cache_lru, entry);
+
+		/*
+		 *	Evict the least recently used expressions.
+		 *	Ones which are still in use are freed when
+		 *	their last user is done with them.
+		 */
+		while (fr_dlist_num_elements(&tls->cache_lru) > regex_cache_size) {
+			fr_regex_cache_entry_t *lru = fr_dlist_pop_head(&tls->cache_lru);
+
+			fr_hash_table_remove(tls->cache, lru);
+			tls->cache_stats.evictions++;
+
+			if (lru->refs) {
+				lru->evicted = true;
+				continue;
+			}
+			talloc_free(lru);
+		}
+	}
+
+	preg = talloc_zero(ctx, regex_t);
+	if (!preg) {
+		fr_strerror_const("Out of memory");
+		return 0;
+	}
+	talloc_set_destructor(preg, _regex_free);
+
+	preg->compiled = entry->compiled;
+	preg->jitd = entry->jitd;
+	preg->cache_entry = entry;
+	entry->refs++;
+
+	*out = preg;
+
+	return len;
+}
+
 /** Wrapper around pcre2_compile
  *
  * Allows the rest of the code to do compilations using one function signature.
@@ -195,7 +386,8 @@ static int _regex_free(regex_t *preg)
  *				data.
  * @param[in] runtime		If false run the pattern through the PCRE JIT (if available)
  *				to convert it to machine code. This trades startup time (longer)
- *				for runtime performance (better).
+ *				for runtime performance (better).  If true, the compiled
+ *				expression is shared via the thread's expression cache.
  * @return
  *	- >= 1 on success.
  *	- <= 0 on error. Negative value is offset of parse error.
@@ -237,6 +429,12 @@ ssize_t regex_compile(TALLOC_CTX *ctx, regex_t **out, char const *pattern, size_
 
 	if (!subcaptures) cflags |= PCRE2_NO_AUTO_CAPTURE;
 
+	/*
+	 *	Runtime expressions are often built from the same
+	 *	pattern over and over, so keep them around.
+	 */
+	if (runtime && regex_cache_size) return regex_cache_compile(ctx, out, pattern, len, cflags);
+
 	preg = talloc_zero(ctx, regex_t);
 	talloc_set_destructor(preg, _regex_free);
 
@@ -1339,6 +1537,36 @@ ssize_t regex_flags_print(fr_sbuff_t *sbuff, fr_regex_flags_t const *flags)
 
 	FR_SBUFF_SET_RETURN(sbuff, &our_sbuff);
 }
+
+/** Set the maximum number of runtime expressions each thread keeps compiled
+ *
+ * Only affects threads which compile expressions after the call.
+ *
+ * @param[in] size	Maximum number of expressions.  0 disables the cache.
+ */
+void regex_cache_size_set(uint32_t size)
+{
+	regex_cache_size = size;
+}
+
+/** Return statistics for this thread's cache of runtime expressions
+ *
+ * Only libpcre2 caches runtime expressions, with other libraries
+ * all statistics are zero.
+ *
+ * @param[out] stats	Where to write the statistics.
+ */
+void regex_cache_stats(fr_regex_cache_stats_t *stats)
+{
+	*stats = (fr_regex_cache_stats_t){};
+
+#ifdef HAVE_REGEX_PCRE2
+	if (!fr_pcre2_tls) return;
+
+	*stats = fr_pcre2_tls->cache_stats;
+	stats->entries = fr_dlist_num_elements(&fr_pcre2_tls->cache_lru);
+#endif
+}
 #endif
 
 /** Compare two boxes using an operator
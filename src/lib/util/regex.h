@@ -62,6 +62,8 @@ typedef struct {
 #endif
 } fr_regmatch_t;
 
+typedef struct fr_regex_cache_entry_s fr_regex_cache_entry_t;
+
 typedef struct {
 	pcre2_code		*compiled;	//!< Compiled regular expression.
 	uint32_t		subcaptures;	//!< Number of subcaptures contained within the expression.
@@ -69,6 +71,9 @@ typedef struct {
 	bool			precompiled;	//!< Whether this regex was precompiled,
 						///< or compiled for one off evaluation.
 	bool			jitd;		//!< Whether JIT data is available.
+
+	fr_regex_cache_entry_t	*cache_entry;	//!< Owner of compiled, if this expression came
+						///< from the runtime expression cache.
 } regex_t;
 /*
  *######################################
@@ -169,6 +174,18 @@ typedef struct {
 
 #define REGEX_FLAG_BUFF_SIZE	7
 
+/** Statistics for the per-thread cache of runtime expressions
+ *
+ */
+typedef struct {
+	uint64_t	hits;			//!< Expressions found in the cache.
+	uint64_t	misses;			//!< Expressions which had to be compiled.
+	uint64_t	evictions;		//!< Expressions removed to keep the cache within its size limit.
+	uint32_t	entries;		//!< Expressions currently in the cache.
+} fr_regex_cache_stats_t;
+
+#define REGEX_CACHE_SIZE_DEFAULT	256
+
 ssize_t		regex_flags_parse(int *err, fr_regex_flags_t *out, fr_sbuff_t *in,
 				  fr_sbuff_term_t const *terminals, bool err_on_dup);
 
@@ -188,6 +205,10 @@ fr_regmatch_t	*regex_match_data_alloc(TALLOC_CTX *ctx, uint32_t count);
 
 int		fr_regex_cmp_op(fr_token_t op, fr_value_box_t const *a, fr_value_box_t const *b) CC_HINT(nonnull);
 
+void		regex_cache_size_set(uint32_t size);
+
+void		regex_cache_stats(fr_regex_cache_stats_t *stats) CC_HINT(nonnull);
+
 #  ifdef __cplusplus
 }
 #  endif
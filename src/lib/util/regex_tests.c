@@ -0,0 +1,157 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the runtime regular expression cache
+ *
+ * @file src/lib/util/regex_tests.c
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/regex.h>
+
+#define PATTERN(_str)	_str, sizeof(_str) - 1
+
+#ifdef HAVE_REGEX_PCRE2
+static void test_cache_hit(void)
+{
+	regex_t			*a = NULL, *b = NULL;
+	fr_regex_cache_stats_t	before, after;
+
+	regex_cache_size_set(REGEX_CACHE_SIZE_DEFAULT);
+
+	TEST_CHECK(regex_compile(NULL, &a, PATTERN("^cache_hit[0-9]+$"), NULL, false, true) > 0);
+	regex_cache_stats(&before);
+
+	TEST_CASE("Second compilation of the same pattern is a hit");
+	TEST_CHECK(regex_compile(NULL, &b, PATTERN("^cache_hit[0-9]+$"), NULL, false, true) > 0);
+	regex_cache_stats(&after);
+	TEST_CHECK_RET(after.hits - before.hits, 1);
+	TEST_CHECK_RET(after.misses - before.misses, 0);
+
+	TEST_CASE("Both expressions share the compiled pattern");
+	TEST_CHECK(a && b && (a != b) && (a->compiled == b->compiled));
+
+	TEST_CASE("Freeing one leaves the other usable");
+	talloc_free(a);
+	TEST_CHECK_RET(regex_exec(b, PATTERN("cache_hit42"), NULL), 1);
+	TEST_CHECK_RET(regex_exec(b, PATTERN("cache_miss"), NULL), 0);
+	talloc_free(b);
+}
+
+static void test_cache_flags(void)
+{
+	regex_t			*a = NULL, *b = NULL;
+	fr_regex_flags_t	flags = { .ignore_case = 1 };
+	fr_regex_cache_stats_t	before, after;
+
+	regex_cache_size_set(REGEX_CACHE_SIZE_DEFAULT);
+
+	TEST_CHECK(regex_compile(NULL, &a, PATTERN("^flags$"), NULL, false, true) > 0);
+	regex_cache_stats(&before);
+
+	TEST_CASE("Same pattern with different flags is a miss");
+	TEST_CHECK(regex_compile(NULL, &b, PATTERN("^flags$"), &flags, false, true) > 0);
+	regex_cache_stats(&after);
+	TEST_CHECK_RET(after.misses - before.misses, 1);
+	TEST_CHECK(a && b && (a->compiled != b->compiled));
+
+	TEST_CHECK_RET(regex_exec(a, PATTERN("FLAGS"), NULL), 0);
+	TEST_CHECK_RET(regex_exec(b, PATTERN("FLAGS"), NULL), 1);
+
+	talloc_free(a);
+	talloc_free(b);
+}
+
+static void test_cache_eviction(void)
+{
+	regex_t			*a = NULL, *b = NULL, *c = NULL;
+	fr_regex_cache_stats_t	before, after;
+
+	regex_cache_size_set(2);
+	regex_cache_stats(&before);
+
+	TEST_CHECK(regex_compile(NULL, &a, PATTERN("^evict_a$"), NULL, false, true) > 0);
+	TEST_CHECK(regex_compile(NULL, &b, PATTERN("^evict_b$"), NULL, false, true) > 0);
+	TEST_CHECK(regex_compile(NULL, &c, PATTERN("^evict_c$"), NULL, false, true) > 0);
+
+	TEST_CASE("Cache stays within its size limit");
+	regex_cache_stats(&after);
+	TEST_CHECK(after.entries <= 2);
+	TEST_CHECK(after.evictions > before.evictions);
+
+	TEST_CASE("Evicted expressions which are in use still work");
+	TEST_CHECK_RET(regex_exec(a, PATTERN("evict_a"), NULL), 1);
+
+	talloc_free(a);
+	talloc_free(b);
+	talloc_free(c);
+
+	regex_cache_size_set(REGEX_CACHE_SIZE_DEFAULT);
+}
+
+static void test_cache_disabled(void)
+{
+	regex_t			*a = NULL, *b = NULL;
+	fr_regex_cache_stats_t	before, after;
+
+	regex_cache_size_set(0);
+	regex_cache_stats(&before);
+
+	TEST_CHECK(regex_compile(NULL, &a, PATTERN("^disabled$"), NULL, false, true) > 0);
+	TEST_CHECK(regex_compile(NULL, &b, PATTERN("^disabled$"), NULL, false, true) > 0);
+
+	TEST_CASE("A size of zero disables the cache");
+	regex_cache_stats(&after);
+	TEST_CHECK_RET(after.hits - before.hits, 0);
+	TEST_CHECK_RET(after.misses - before.misses, 0);
+	TEST_CHECK(a && b && (a->compiled != b->compiled));
+
+	talloc_free(a);
+	talloc_free(b);
+
+	regex_cache_size_set(REGEX_CACHE_SIZE_DEFAULT);
+}
+
+static void test_precompiled_not_cached(void)
+{
+	regex_t			*a = NULL;
+	fr_regex_cache_stats_t	before, after;
+
+	regex_cache_stats(&before);
+
+	TEST_CASE("Expressions compiled at startup don't use the cache");
+	TEST_CHECK(regex_compile(NULL, &a, PATTERN("^startup$"), NULL, false, false) > 0);
+	regex_cache_stats(&after);
+	TEST_CHECK_RET(after.misses - before.misses, 0);
+	TEST_CHECK(a && !a->cache_entry);
+
+	talloc_free(a);
+}
+#endif
+
+TEST_LIST = {
+#ifdef HAVE_REGEX_PCRE2
+	{ "cache_hit",			test_cache_hit },
+	{ "cache_flags",		test_cache_flags },
+	{ "cache_eviction",		test_cache_eviction },
+	{ "cache_disabled",		test_cache_disabled },
+	{ "precompiled_not_cached",	test_precompiled_not_cached },
+#endif
+
+	{ NULL }
+};
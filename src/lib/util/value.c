@@ -623,6 +623,7 @@ static inline void fr_value_box_copy_meta(fr_value_box_t *dst, fr_value_box_t co
 	dst->tainted = src->tainted;
 	dst->safe_for = src->safe_for;
 	dst->secret = src->secret;
+	dst->shared = false;
 	fr_value_box_list_entry_init(dst);
 }
 
@@ -3631,6 +3632,10 @@ void fr_value_box_clear_value(fr_value_box_t *data)
 	switch (data->type) {
 	case FR_TYPE_OCTETS:
 	case FR_TYPE_STRING:
+		if (data->shared) {
+			data->shared = false;
+			break;
+		}
 		if (data->secret) memset_explicit(data->datum.ptr, 0, data->vb_length);
 		talloc_free(data->datum.ptr);
 		break;
@@ -3788,12 +3793,62 @@ void fr_value_box_copy_shallow(TALLOC_CTX *ctx, fr_value_box_t *dst, fr_value_bo
 
 	case FR_TYPE_STRING:
 	case FR_TYPE_OCTETS:
+		/*
+		 *	Shared buffers aren't talloced, so we
+		 *	can't add a reference to them.
+		 */
+		if (src->shared) {
+			dst->datum.ptr = src->datum.ptr;
+			fr_value_box_copy_meta(dst, src);
+			dst->shared = true;
+			break;
+		}
 		dst->datum.ptr = ctx ? talloc_reference(ctx, src->datum.ptr) : src->datum.ptr;
 		fr_value_box_copy_meta(dst, src);
 		break;
 	}
 }
 
+/** Give a box its own copy of a shared buffer
+ *
+ * Must be called before a shared buffer is modified, or before the
+ * box is moved somewhere which may outlive the owner of the buffer.
+ *
+ * @param[in] ctx	to allocate the new buffer in.
+ * @param[in] vb	to unshare.  Boxes which aren't shared are left alone.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_value_box_unshare(TALLOC_CTX *ctx, fr_value_box_t *vb)
+{
+	uint8_t *bin;
+
+	if (!vb->shared) return 0;
+
+	fr_assert(vb->type == FR_TYPE_OCTETS);
+
+	if (vb->vb_length) {
+		bin = talloc_memdup(ctx, vb->vb_octets, vb->vb_length);
+		if (!bin) {
+			fr_strerror_const("Failed allocating octets buffer");
+			return -1;
+		}
+		talloc_set_type(bin, uint8_t);
+	} else {
+		bin = talloc_array(ctx, uint8_t, 0);
+		if (!bin) {
+			fr_strerror_const("Failed allocating octets buffer");
+			return -1;
+		}
+	}
+
+	vb->vb_octets = bin;
+	vb->shared = false;
+
+	return 0;
+}
+
 /** Copy value data verbatim moving any buffers to the specified context
  *
  * @param[in] ctx 	to allocate any new buffers in.
@@ -3807,6 +3862,17 @@ int fr_value_box_steal(TALLOC_CTX *ctx, fr_value_box_t *dst, fr_value_box_t *src
 {
 	if (!fr_cond_assert(src->type != FR_TYPE_NULL)) return -1;
 
+	/*
+	 *	Shared buffers can't be stolen, so they're copied.
+	 */
+	if (src->shared) {
+		if (fr_value_box_copy(ctx, dst, src) < 0) return -1;
+
+		src->shared = false;
+		memset(&src->datum, 0, sizeof(src->datum));
+		return 0;
+	}
+
 	switch (src->type) {
 	default:
 		return fr_value_box_copy(ctx, dst, src);
@@ -4357,6 +4423,8 @@ int fr_value_box_mem_realloc(TALLOC_CTX *ctx, uint8_t **out, fr_value_box_t *dst
 
 	fr_assert(dst->type == FR_TYPE_OCTETS);
 
+	if (unlikely(fr_value_box_unshare(ctx, dst) < 0)) return -1;
+
 	memcpy(&cbin, &dst->vb_octets, sizeof(cbin));
 
 	clen = talloc_array_length(dst->vb_octets);
@@ -4486,6 +4554,30 @@ void fr_value_box_memdup_shallow(fr_value_box_t *dst, fr_dict_attr_t const *enum
 	dst->vb_length = len;
 }
 
+/** Assign a buffer owned by something else to a box, without copying it
+ *
+ * Used when decoding, so that octets values can reference the packet
+ * they were decoded from.  The caller must ensure that the buffer
+ * outlives the box, or that #fr_value_box_unshare is called first.
+ *
+ * The buffer is never freed by the box.  If the value is modified, a
+ * copy is made first.
+ *
+ * @param[in] dst 	to assign buffer to.
+ * @param[in] enumv	Aliases for values.
+ * @param[in] src	buffer, which does not need to be talloced.
+ * @param[in] len	of buffer.
+ * @param[in] tainted	Whether the value came from a trusted source.
+ */
+void fr_value_box_memdup_shared(fr_value_box_t *dst, fr_dict_attr_t const *enumv,
+				uint8_t const *src, size_t len, bool tainted)
+{
+	fr_value_box_init(dst, FR_TYPE_OCTETS, enumv, tainted);
+	dst->vb_octets = src;
+	dst->vb_length = len;
+	dst->shared = true;
+}
+
 /** Assign a talloced buffer to a box, but don't copy it
  *
  * Adds a reference to the src buffer so that it cannot be freed until the ctx is freed.
@@ -4533,6 +4625,8 @@ int fr_value_box_mem_append(TALLOC_CTX *ctx, fr_value_box_t *dst, uint8_t const
 
 	if (!fr_cond_assert(dst->datum.ptr)) return -1;
 
+	if (unlikely(fr_value_box_unshare(ctx, dst) < 0)) return -1;
+
 	if (talloc_reference_count(dst->datum.ptr) > 0) {
 		fr_strerror_printf("%s: Boxed value has too many references", __FUNCTION__);
 		return -1;
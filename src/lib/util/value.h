@@ -172,6 +172,10 @@ struct value_box_s {
 	unsigned int   				secret : 1;		//!< Same as #fr_dict_attr_flags_t secret
 	unsigned int				immutable : 1;		//!< once set, the value cannot be changed
 	unsigned int				talloced : 1;		//!< Talloced, not stack or text allocated.
+	unsigned int				shared : 1;		//!< The octets buffer belongs to something else,
+									///< usually the packet it was decoded from.
+									///< It is never freed by the box, and is copied
+									///< before it's modified.
 	fr_value_box_safe_for_t	_CONST		safe_for;		//!< A unique value to indicate if that value box is safe
 									///< for consumption by a particular module for a particular
 									///< purpose.  e.g. LDAP, SQL, etc.
@@ -689,6 +693,9 @@ void		fr_value_box_copy_shallow(TALLOC_CTX *ctx, fr_value_box_t *dst,
 int		fr_value_box_steal(TALLOC_CTX *ctx, fr_value_box_t *dst, fr_value_box_t *src)
 		CC_HINT(nonnull(2,3));
 
+int		fr_value_box_unshare(TALLOC_CTX *ctx, fr_value_box_t *vb)
+		CC_HINT(nonnull(2));
+
 /** Copy an existing box, allocating a new box to hold its contents
  *
  * @param[in] ctx	to allocate new box in.
@@ -1172,6 +1179,10 @@ void		fr_value_box_memdup_buffer_shallow(TALLOC_CTX *ctx, fr_value_box_t *dst, f
 						   uint8_t const *src, bool tainted)
 		CC_HINT(nonnull(2,4));
 
+void		fr_value_box_memdup_shared(fr_value_box_t *dst, fr_dict_attr_t const *enumv,
+					   uint8_t const *src, size_t len, bool tainted)
+		CC_HINT(nonnull(1,3));
+
 int		fr_value_box_mem_append(TALLOC_CTX *ctx, fr_value_box_t *dst,
 				       uint8_t const *src, size_t len, bool tainted)
 		CC_HINT(nonnull(2,3));
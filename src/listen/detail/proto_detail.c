@@ -22,6 +22,7 @@
  * @copyright 2017 Arran Cudbard-Bell (a.cudbardb@freeradius.org)
  * @copyright 2016 Alan DeKok (aland@freeradius.org)
  */
+#include <freeradius-devel/internal/detail.h>
 #include <freeradius-devel/io/application.h>
 #include <freeradius-devel/io/listen.h>
 #include <freeradius-devel/io/schedule.h>
@@ -188,6 +189,60 @@ static int transport_parse(TALLOC_CTX *ctx, void *out, UNUSED void *parent,
 	return 0;
 }
 
+/** Decode a binary detail record
+ *
+ *  The record has already been framed and checked by the reader, so
+ *  all we need to do is to fill in the request.
+ */
+static int mod_decode_binary(proto_detail_t const *inst, request_t *request, uint8_t *const data, size_t data_len)
+{
+	fr_detail_binary_t	hdr;
+	fr_pair_t		*vp;
+	ssize_t			slen;
+
+	slen = fr_detail_binary_decode(request->request_ctx, &request->request_pairs, NULL, &hdr, data, data_len);
+	if (slen < 0) {
+		RPEDEBUG("Failed decoding binary detail record");
+		return -1;
+	}
+
+	request->dict = fr_dict_by_protocol_num(hdr.protocol);
+	if (!request->dict) {
+		REDEBUG("Invalid protocol %u", hdr.protocol);
+		return -1;
+	}
+	request->packet->code = inst->code;
+
+	request->packet->socket.fd = -1;
+	request->packet->socket.inet.src_ipaddr = hdr.src_ipaddr;
+	request->packet->socket.inet.dst_ipaddr = hdr.dst_ipaddr;
+	request->packet->socket.inet.src_port = hdr.src_port;
+	request->packet->socket.inet.dst_port = hdr.dst_port;
+
+	if (request->packet->socket.inet.src_ipaddr.af == AF_UNSPEC) {
+		request->packet->socket.inet.src_ipaddr.af = AF_INET;
+		request->packet->socket.inet.src_ipaddr.addr.v4.s_addr = htonl(INADDR_NONE);
+	}
+	if (request->packet->socket.inet.dst_ipaddr.af == AF_UNSPEC) {
+		request->packet->socket.inet.dst_ipaddr = request->packet->socket.inet.src_ipaddr;
+	}
+
+	request->reply->socket.inet.src_ipaddr = request->packet->socket.inet.dst_ipaddr;
+	request->reply->socket.inet.dst_ipaddr = request->packet->socket.inet.src_ipaddr;
+
+	/*
+	 *	The original time at which we received the packet.  We
+	 *	need this to properly calculate Acct-Delay-Time.
+	 */
+	vp = fr_pair_afrom_da(request->request_ctx, attr_packet_original_timestamp);
+	if (vp) {
+		vp->vp_date = hdr.timestamp;
+		fr_pair_append(&request->request_pairs, vp);
+	}
+
+	return inst->app_io->decode(inst->app_io_instance, request, data, data_len);
+}
+
 /** Decode the packet, and set the request->process function
  *
  */
@@ -204,6 +259,8 @@ static int mod_decode(void const *instance, request_t *request, uint8_t *const d
 
 	RHEXDUMP3(data, data_len, "proto_detail decode packet");
 
+	if (fr_detail_binary_is(data, data_len)) return mod_decode_binary(inst, request, data, data_len);
+
 	request->dict = inst->dict;
 	request->packet->code = inst->code;
 
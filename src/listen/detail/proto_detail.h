@@ -90,6 +90,7 @@ struct proto_detail_work_s {
 
 	fr_retry_config_t		retry_config;		//!< retry config with irt, mrt, etc.
 	uint16_t			max_outstanding;	//!< number of packets to run in parallel
+	uint32_t			read_buffer_size;	//!< how much of the file we read at a time
 
 	bool				track_progress;		//!< do we track progress by writing?
 	bool				retransmit;		//!< are we retransmitting on error?
@@ -103,6 +104,7 @@ struct proto_detail_work_s {
 };
 
 typedef struct proto_detail_work_thread_s proto_detail_work_thread_t;
+typedef struct fr_detail_entry_s fr_detail_entry_t;
 
 struct proto_detail_work_thread_s {
 	char const			*name;			//!< debug name for printing
@@ -134,6 +136,20 @@ struct proto_detail_work_thread_s {
 	size_t				last_search;		//!< where we last searched in the buffer
 								//!< MUST be offset, as the buffers can change.
 
+	uint8_t				*read_buffer;		//!< read-ahead buffer for the file
+	size_t				read_buffer_len;	//!< how much data is in the read-ahead buffer
+	off_t				read_buffer_offset;	//!< file offset of the start of the read-ahead buffer
+
+	uint8_t const			*map;			//!< mmap()d binary detail file, or NULL for text files
+	size_t				map_size;		//!< how much of the file is mapped
+
+	fr_detail_entry_t		**window;		//!< entries which haven't been committed, indexed by ID
+	int				commit_id;		//!< ID of the oldest entry which hasn't been committed
+	off_t				commit_offset;		//!< every entry before this offset has been processed
+	uint64_t			committed;		//!< number of entries committed
+	uint32_t			max_window;		//!< largest number of entries in the window
+	fr_time_t			start;			//!< when we opened the file
+
 	off_t				file_size;		//!< size of the file
 	off_t				header_offset;		//!< offset of the current header we're reading
 	off_t				read_offset;		//!< where we're reading from in filename_work
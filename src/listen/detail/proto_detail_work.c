@@ -26,12 +26,14 @@
 #include <freeradius-devel/server/protocol.h>
 #include <freeradius-devel/server/pair.h>
 #include <freeradius-devel/server/main_loop.h>
+#include <freeradius-devel/internal/detail.h>
 #include <freeradius-devel/io/application.h>
 #include <freeradius-devel/io/listen.h>
 #include <freeradius-devel/util/syserror.h>
 #include "proto_detail.h"
 
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #ifndef NDEBUG
@@ -49,12 +51,14 @@
 #define MPRINT(_x, ...)
 #endif
 
-typedef struct {
+struct fr_detail_entry_s {
 	proto_detail_work_thread_t	*parent;		//!< talloc_parent is SLOW!
 	fr_time_t			timestamp;		//!< when we read the entry.
 	off_t				done_offset;		//!< where we're tracking the status
+	off_t				end_offset;		//!< where the next entry starts
 
 	int				id;			//!< for retransmission counters
+	bool				complete;		//!< processing is finished, but not committed
 
 	uint8_t				*packet;		//!< for retransmissions
 	size_t				packet_len;		//!< for retransmissions
@@ -62,7 +66,7 @@ typedef struct {
 	fr_retry_t			retry;			//!< our retry timers
 	fr_event_timer_t const		*ev;			//!< retransmission timer
 	fr_dlist_t			entry;			//!< for the retransmission list
-} fr_detail_entry_t;
+};
 
 static conf_parser_t limit_config[] = {
 	{ FR_CONF_OFFSET("initial_rtx_time", proto_detail_work_t, retry_config.irt), .dflt = STRINGIFY(2) },
@@ -88,6 +92,8 @@ static const conf_parser_t file_listen_config[] = {
 
 	{ FR_CONF_OFFSET("retransmit", proto_detail_work_t, retransmit ), .dflt = "yes" },
 
+	{ FR_CONF_OFFSET("read_buffer_size", proto_detail_work_t, read_buffer_size ), .dflt = "1048576" },
+
 	{ FR_CONF_POINTER("limit", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) limit_config },
 	CONF_PARSER_TERMINATOR
 };
@@ -141,6 +147,161 @@ static fr_event_update_t resume_read[] = {
 	{ 0 }
 };
 
+/** Read from the file at thread->read_offset
+ *
+ *  This has the same semantics as read(), but the data comes from
+ *  a large read-ahead buffer.  So we make one pread() for many
+ *  entries, instead of one read() per entry.
+ */
+static ssize_t work_read(proto_detail_work_t const *inst, proto_detail_work_thread_t *thread, uint8_t *out, size_t room)
+{
+	size_t total = 0;
+
+	while (total < room) {
+		size_t	used, len;
+		ssize_t	rcode;
+
+		if ((thread->read_offset < thread->read_buffer_offset) ||
+		    (thread->read_offset >= (thread->read_buffer_offset + (off_t) thread->read_buffer_len))) {
+			rcode = pread(thread->fd, thread->read_buffer, inst->read_buffer_size, thread->read_offset);
+			if (rcode < 0) {
+				if (errno == EINTR) continue;
+				if (total > 0) break;
+				return -1;
+			}
+
+			thread->read_buffer_offset = thread->read_offset;
+			thread->read_buffer_len = rcode;
+			if (rcode == 0) break;
+		}
+
+		used = thread->read_offset - thread->read_buffer_offset;
+		len = thread->read_buffer_len - used;
+		if (len > (room - total)) len = room - total;
+
+		memcpy(out + total, thread->read_buffer + used, len);
+		total += len;
+		thread->read_offset += len;
+	}
+
+	return total;
+}
+
+/** Read the next record from a binary detail file
+ *
+ *  Binary files are mmap()d, and each record says how long it is.
+ *  So there's no need to search for the end of the record, or to
+ *  keep partial records in the "leftover" buffer.
+ */
+static ssize_t work_read_binary(proto_detail_work_t const *inst, proto_detail_work_thread_t *thread,
+				void **packet_ctx, fr_time_t *recv_time_p, uint8_t *buffer, size_t buffer_len)
+{
+	fr_detail_entry_t	*track;
+	fr_detail_binary_t	hdr;
+	uint8_t const		*record;
+	ssize_t			record_len;
+
+	for (;;) {
+		size_t available;
+
+		thread->header_offset = thread->read_offset;
+
+		if ((size_t) thread->read_offset >= thread->map_size) break;
+
+		record = thread->map + thread->read_offset;
+		available = thread->map_size - thread->read_offset;
+
+		record_len = fr_detail_binary_record_len(record, available);
+		if (record_len < 0) {
+			PERROR("proto_detail (%s): Malformed record found at offset %zu of file %s",
+			       thread->name, (size_t) thread->read_offset, thread->filename_work);
+			return -1;
+		}
+
+		/*
+		 *	The writer died part way through a record.
+		 *	There's nothing more we can do.
+		 */
+		if ((record_len == 0) || ((size_t) record_len > available)) {
+			WARN("proto_detail (%s): Ignoring truncated record at offset %zu of file %s",
+			     thread->name, (size_t) thread->read_offset, thread->filename_work);
+			thread->read_offset = thread->map_size;
+			break;
+		}
+
+		thread->read_offset += record_len;
+
+		if ((record[FR_DETAIL_BINARY_FLAGS_OFFSET] & FR_DETAIL_BINARY_FLAG_DONE) != 0) continue;
+
+		if (((size_t) record_len > buffer_len) || ((size_t) record_len > inst->parent->max_packet_size)) {
+			DEBUG("Ignoring 'too large' entry at offset %zu of %s",
+			      (size_t) thread->header_offset, thread->filename_work);
+			continue;
+		}
+
+		if (fr_detail_binary_decode_header(&hdr, record, record_len) < 0) {
+			PERROR("proto_detail (%s): Ignoring entry at offset %zu of file %s",
+			       thread->name, (size_t) thread->header_offset, thread->filename_work);
+			continue;
+		}
+
+		goto found;
+	}
+
+	/*
+	 *	Nothing more to read.  If there's nothing outstanding,
+	 *	then nothing will call mod_write(), so we have to tell
+	 *	the network side to close the file.
+	 */
+	thread->eof = true;
+	thread->closing = true;
+	(void) lseek(thread->fd, thread->read_offset, SEEK_SET);
+
+	if (!thread->outstanding) {
+		DEBUG("%s - No more entries to read", thread->name);
+		return -1;
+	}
+
+	return 0;
+
+found:
+	memcpy(buffer, record, record_len);
+
+	track = talloc_zero(thread, fr_detail_entry_t);
+	track->parent = thread;
+	track->timestamp = fr_time();
+	track->id = thread->count++;
+
+	track->done_offset = thread->header_offset + FR_DETAIL_BINARY_FLAGS_OFFSET;
+	track->end_offset = thread->read_offset;
+	if (inst->retransmit) {
+		track->packet = talloc_memdup(track, buffer, record_len);
+		track->packet_len = record_len;
+	}
+
+	fr_assert(thread->window[track->id % inst->max_outstanding] == NULL);
+	thread->window[track->id % inst->max_outstanding] = track;
+
+	*packet_ctx = track;
+	*recv_time_p = track->timestamp;
+
+	/*
+	 *	Keep the file offset in sync with what we've read, so
+	 *	that the FD is only readable when there's more data.
+	 */
+	(void) lseek(thread->fd, thread->read_offset, SEEK_SET);
+
+	thread->outstanding++;
+	if (thread->outstanding > thread->max_window) thread->max_window = thread->outstanding;
+
+	if (!thread->paused && (thread->outstanding >= inst->max_outstanding)) {
+		(void) fr_event_filter_update(thread->el, thread->fd, FR_EVENT_FILTER_IO, pause_read);
+		thread->paused = true;
+	}
+
+	return record_len;
+}
+
 static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time_p, uint8_t *buffer, size_t buffer_len, size_t *leftover)
 {
 	proto_detail_work_t const	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_detail_work_t);
@@ -208,6 +369,8 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 		return 0;
 	}
 
+	if (thread->map) return work_read_binary(inst, thread, packet_ctx, recv_time_p, buffer, buffer_len);
+
 	/*
 	 *	If we've cached leftover data from the ring buffer,
 	 *	copy it back.
@@ -221,11 +384,6 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 		thread->leftover = 0;
 	}
 
-	/*
-	 *	Seek to the current read offset.
-	 */
-	(void) lseek(thread->fd, thread->read_offset, SEEK_SET);
-
 	/*
 	 *	There will be "leftover" bytes left over in the buffer
 	 *	from any previous read.  At the start of the file,
@@ -243,7 +401,7 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 
 		room = buffer_len - *leftover;
 
-		data_size = read(thread->fd, partial, room);
+		data_size = work_read(inst, thread, partial, room);
 		if (data_size < 0) {
 			ERROR("proto_detail (%s): Failed reading file %s: %s",
 			      thread->name, thread->filename_work, fr_syserror(errno));
@@ -253,9 +411,11 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 		MPRINT("GOT %zd bytes", data_size);
 
 		/*
-		 *	Remember the read offset, and whether we got EOF.
+		 *	Keep the file offset in sync with what we've
+		 *	read, so that the FD is only readable when
+		 *	there's more data.
 		 */
-		thread->read_offset = lseek(thread->fd, 0, SEEK_CUR);
+		(void) lseek(thread->fd, thread->read_offset, SEEK_SET);
 
 		/*
 		 *	Only set EOF if there's no more data in the buffer to manage.
@@ -488,16 +648,21 @@ redo:
 	track->id = thread->count++;
 
 	track->done_offset = done_offset;
+	track->end_offset = thread->header_offset + packet_len;
 	if (inst->retransmit) {
 		track->packet = talloc_memdup(track, buffer, packet_len);
 		track->packet_len = packet_len;
 	}
 
 	/*
-	 *	We've read one more packet.
+	 *	We've read one more packet.  It stays in the window
+	 *	until it, and every entry before it, is complete.
 	 */
 	thread->header_offset += packet_len;
 
+	fr_assert(thread->window[track->id % inst->max_outstanding] == NULL);
+	thread->window[track->id % inst->max_outstanding] = track;
+
 	*packet_ctx = track;
 	*recv_time_p = track->timestamp;
 
@@ -512,6 +677,7 @@ done:
 	}
 
 	thread->outstanding++;
+	if (thread->outstanding > thread->max_window) thread->max_window = thread->outstanding;
 
 	/*
 	 *	Pause reading until such time as we need more packets.
@@ -567,6 +733,62 @@ static void work_retransmit(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, vo
 #endif
 }
 
+/** Commit all of the completed entries at the start of the window
+ *
+ *  Entries can finish in any order, but we only mark them "Done" in
+ *  the order in which they were read.  So the file always contains a
+ *  run of "Done" entries, followed by entries which still need to be
+ *  processed, exactly as when "max_outstanding = 1".  If the server
+ *  stops, nothing after the first unfinished entry is skipped when
+ *  the file is read again.
+ */
+static void work_commit(proto_detail_work_t const *inst, proto_detail_work_thread_t *thread)
+{
+	fr_detail_entry_t **slot, *track;
+
+	while (thread->outstanding > 0) {
+		slot = &thread->window[thread->commit_id % inst->max_outstanding];
+		track = *slot;
+		if (!track || !track->complete) break;
+
+		fr_assert(track->id == thread->commit_id);
+
+		/*
+		 *	pwrite() doesn't change the file offset, which
+		 *	the reader depends on.
+		 */
+		if (inst->track_progress && (track->done_offset > 0)) {
+			ssize_t rcode;
+
+			/*
+			 *	Binary records have a flag octet, text
+			 *	records have their "Timestamp" over-written.
+			 */
+			if (thread->map) {
+				uint8_t flags = thread->map[track->done_offset] | FR_DETAIL_BINARY_FLAG_DONE;
+
+				rcode = pwrite(thread->fd, &flags, 1, track->done_offset);
+			} else {
+				rcode = pwrite(thread->fd, "Done", 4, track->done_offset);
+			}
+
+			if (rcode < 0) ERROR("%s - Failed marking entry as done: %s", thread->name, fr_syserror(errno));
+		}
+
+		thread->commit_offset = track->end_offset;
+		thread->commit_id++;
+		thread->committed++;
+		thread->outstanding--;
+
+		*slot = NULL;
+
+		/*
+		 *	@todo - add a used / free pool for these
+		 */
+		talloc_free(track);
+	}
+}
+
 static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t request_time,
 			 uint8_t *buffer, size_t buffer_len, UNUSED size_t written)
 {
@@ -579,63 +801,53 @@ static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t req
 	fr_assert(thread->outstanding > 0);
 	fr_assert(thread->fd >= 0);
 
-	if (!buffer[0]) {
-		if (!inst->retransmit) goto mark_done;
-
-		if (fr_time_eq(track->retry.start, fr_time_wrap(0))) {
-			fr_retry_init(&track->retry, fr_time(), &inst->retry_config);
-		} else {
-			fr_retry_state_t state;
+	if (buffer[0]) goto complete;
 
-			state = fr_retry_next(&track->retry, fr_time());
-			if (state == FR_RETRY_MRC) {
-				DEBUG("%s - packet %d failed after %u retransmissions",
-				      thread->name, track->id, track->retry.count);
-				goto fail;
+	if (!inst->retransmit) goto complete;
 
-			}
+	if (fr_time_eq(track->retry.start, fr_time_wrap(0))) {
+		fr_retry_init(&track->retry, fr_time(), &inst->retry_config);
+	} else {
+		fr_retry_state_t state;
 
-			if (state == FR_RETRY_MRD) {
-				DEBUG("%s - packet %d failed after %u seconds",
-				      thread->name, track->id,
-				      (unsigned int) fr_time_delta_to_sec(inst->retry_config.mrd));
-				goto fail;
-			}
+		state = fr_retry_next(&track->retry, fr_time());
+		if (state == FR_RETRY_MRC) {
+			DEBUG("%s - packet %d failed after %u retransmissions",
+			      thread->name, track->id, track->retry.count);
+			goto complete;
 		}
 
-		DEBUG("%s - packet %d failed during processing.  Will retransmit in %.6fs",
-		      thread->name, track->id, fr_time_delta_unwrap(track->retry.rt) / (double)NSEC);
-
-		if (fr_event_timer_at(thread, thread->el, &track->ev,
-				      track->retry.next, work_retransmit, track) < 0) {
-			ERROR("%s - Failed inserting retransmission timeout", thread->name);
-		fail:
-			if (inst->track_progress && (track->done_offset > 0)) goto mark_done;
-			goto free_track;
+		if (state == FR_RETRY_MRD) {
+			DEBUG("%s - packet %d failed after %u seconds",
+			      thread->name, track->id,
+			      (unsigned int) fr_time_delta_to_sec(inst->retry_config.mrd));
+			goto complete;
 		}
+	}
 
-		if (!thread->paused && (thread->outstanding >= inst->max_outstanding)) {
-			(void) fr_event_filter_update(thread->el, thread->fd, FR_EVENT_FILTER_IO, pause_read);
-			thread->paused = true;
-		}
+	DEBUG("%s - packet %d failed during processing.  Will retransmit in %.6fs",
+	      thread->name, track->id, fr_time_delta_unwrap(track->retry.rt) / (double)NSEC);
 
-		return 1;
+	if (fr_event_timer_at(thread, thread->el, &track->ev,
+			      track->retry.next, work_retransmit, track) < 0) {
+		ERROR("%s - Failed inserting retransmission timeout", thread->name);
+		goto complete;
+	}
 
-	} else if (inst->track_progress && (track->done_offset > 0)) {
-	mark_done:
-		/*
-		 *	Seek to the entry, mark it as done, and then seek to
-		 *	the point in the file where we were reading from.
-		 */
-		(void) lseek(thread->fd, track->done_offset, SEEK_SET);
-		if (write(thread->fd, "Done", 4) < 0) {
-			ERROR("%s - Failed marking entry as done: %s", thread->name, fr_syserror(errno));
-		}
-		(void) lseek(thread->fd, thread->read_offset, SEEK_SET);
+	if (!thread->paused && (thread->outstanding >= inst->max_outstanding)) {
+		(void) fr_event_filter_update(thread->el, thread->fd, FR_EVENT_FILTER_IO, pause_read);
+		thread->paused = true;
 	}
 
-free_track:
-	thread->outstanding--;
+	return 1;
+
+complete:
+	/*
+	 *	The entry is finished, successfully or not.  Commit
+	 *	it, and any later entries which finished before it.
+	 */
+	track->complete = true;
+	work_commit(inst, thread);
 
 	/*
 	 *	If we need to read some more packet, let's do so.
@@ -652,11 +864,6 @@ free_track:
 		(void) lseek(thread->fd, 0, SEEK_SET);
 	}
 
-	/*
-	 *	@todo - add a used / free pool for these
-	 */
-	talloc_free(track);
-
 	/*
 	 *	Close the socket if we're at EOF, and there are no
 	 *	outstanding replies to deal with.
@@ -670,6 +877,27 @@ free_track:
 	return buffer_len;
 }
 
+/** Print replay statistics for a detail file
+ *
+ */
+static void mod_stats_print(fr_listen_t const *li, FILE *fp)
+{
+	proto_detail_work_t const	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_detail_work_t);
+	proto_detail_work_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_detail_work_thread_t);
+	double				elapsed;
+
+	elapsed = fr_time_delta_unwrap(fr_time_sub(fr_time(), thread->start)) / (double) NSEC;
+
+	fprintf(fp, "detail.entries.read\t%d\n", thread->count);
+	fprintf(fp, "detail.entries.committed\t%" PRIu64 "\n", thread->committed);
+	fprintf(fp, "detail.entries.rate\t%.1f\n", (elapsed > 0) ? thread->committed / elapsed : 0);
+	fprintf(fp, "detail.window.size\t%u\n", inst->max_outstanding);
+	fprintf(fp, "detail.window.used\t%u\n", thread->outstanding);
+	fprintf(fp, "detail.window.max\t%u\n", thread->max_window);
+	fprintf(fp, "detail.offset.commit\t%" PRIu64 "\n", (uint64_t) thread->commit_offset);
+	fprintf(fp, "detail.offset.read\t%" PRIu64 "\n", (uint64_t) thread->read_offset);
+}
+
 /** Open a detail listener
  *
  */
@@ -677,6 +905,7 @@ static int mod_open(fr_listen_t *li)
 {
 	proto_detail_work_t const	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_detail_work_t);
 	proto_detail_work_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_detail_work_thread_t);
+	uint8_t				magic[FR_DETAIL_BINARY_MAGIC_LEN];
 
 	fr_dlist_init(&thread->list, fr_detail_entry_t, entry);
 
@@ -716,6 +945,41 @@ static int mod_open(fr_listen_t *li)
 	fr_assert(thread->filename_work != NULL);
 	thread->name = talloc_typed_asprintf(thread, "detail_work reading file %s", thread->filename_work);
 
+	/*
+	 *	Binary detail files are mapped into memory, and read
+	 *	directly from there.  Text files are read through the
+	 *	read-ahead buffer.
+	 */
+	if ((pread(thread->fd, magic, sizeof(magic), 0) == sizeof(magic)) &&
+	    fr_detail_binary_is(magic, sizeof(magic))) {
+		struct stat	buf;
+		void		*map;
+
+		if (fstat(thread->fd, &buf) < 0) {
+			cf_log_err(inst->cs, "Failed examining %s: %s", thread->filename_work, fr_syserror(errno));
+			return -1;
+		}
+
+		map = mmap(NULL, buf.st_size, PROT_READ, MAP_SHARED, thread->fd, 0);
+		if (map == MAP_FAILED) {
+			cf_log_err(inst->cs, "Failed mapping %s: %s", thread->filename_work, fr_syserror(errno));
+			return -1;
+		}
+
+#ifdef MADV_SEQUENTIAL
+		(void) madvise(map, buf.st_size, MADV_SEQUENTIAL);
+#endif
+
+		thread->map = map;
+		thread->map_size = buf.st_size;
+		thread->file_size = buf.st_size;
+	} else {
+		MEM(thread->read_buffer = talloc_array(thread, uint8_t, inst->read_buffer_size));
+	}
+
+	MEM(thread->window = talloc_zero_array(thread, fr_detail_entry_t *, inst->max_outstanding));
+	thread->start = fr_time();
+
 	/*
 	 *	Linux doesn't like us adding write callbacks for FDs
 	 *	which reference files.  Since the callback is only
@@ -749,6 +1013,14 @@ static int mod_close_internal(proto_detail_work_thread_t *thread)
 
 	DEBUG("Closing %sdetail worker file %s", thread->outstanding == 0 ? "and deleting " : "", thread->name);
 
+	if (thread->committed) {
+		double elapsed = fr_time_delta_unwrap(fr_time_sub(fr_time(), thread->start)) / (double) NSEC;
+
+		DEBUG("%s - processed %" PRIu64 " entries in %.3fs (%.1f/s), at most %u at a time",
+		      thread->name, thread->committed, elapsed,
+		      (elapsed > 0) ? thread->committed / elapsed : 0, thread->max_window);
+	}
+
 #ifdef NOTE_REVOKE
 	fr_event_fd_delete(thread->el, thread->fd, FR_EVENT_FILTER_VNODE);
 #endif
@@ -756,6 +1028,11 @@ static int mod_close_internal(proto_detail_work_thread_t *thread)
 
 	if (thread->outstanding == 0) unlink(thread->filename_work);
 
+	if (thread->map) {
+		(void) munmap(UNCONST(void *, thread->map), thread->map_size);
+		thread->map = NULL;
+	}
+
 	close(thread->fd);
 	thread->fd = -1;
 
@@ -900,6 +1177,9 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 
 	FR_INTEGER_BOUND_CHECK("limit.max_outstanding", inst->max_outstanding, >=, 1);
 
+	FR_INTEGER_BOUND_CHECK("read_buffer_size", inst->read_buffer_size, >=, 65536);
+	FR_INTEGER_BOUND_CHECK("read_buffer_size", inst->read_buffer_size, <=, 64 * 1024 * 1024);
+
 	return 0;
 }
 
@@ -928,4 +1208,5 @@ fr_app_io_t proto_detail_work = {
 	.write			= mod_write,
 	.event_list_set		= mod_event_list_set,
 	.get_name		= mod_name,
+	.stats_print		= mod_stats_print,
 };
@@ -176,13 +176,17 @@ static int mod_decode(void const *instance, request_t *request, uint8_t *const d
 
 /*
  *	We don't need to encode any of the replies.  We just go "yeah, it's fine".
+ *
+ *	The master I/O code treats a one byte reply as "do not respond",
+ *	and never calls the transport write for it.  So the reply is the
+ *	packet code in network byte order, which is always longer than that.
  */
 static ssize_t mod_encode(UNUSED void const *instance, request_t *request, uint8_t *buffer, size_t buffer_len)
 {
-	if (buffer_len < 1) return -1;
+	if (buffer_len < sizeof(uint32_t)) return -1;
 
-	*buffer = request->reply->code;
-	return 1;
+	fr_nbo_from_uint32(buffer, request->reply->code);
+	return sizeof(uint32_t);
 }
 
 /** Open listen sockets/connect to external event source
@@ -200,6 +204,7 @@ static int mod_open(void *instance, fr_schedule_t *sc, UNUSED CONF_SECTION *conf
 
 	inst->io.app = &proto_load;
 	inst->io.app_instance = instance;
+	inst->sc = sc;
 
 	/*
 	 *	io.app_io should already be set
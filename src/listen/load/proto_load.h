@@ -27,6 +27,7 @@ RCSIDH(proto_load_h, "$Id$")
 
 #include <freeradius-devel/server/module_rlm.h>
 #include <freeradius-devel/io/master.h>
+#include <freeradius-devel/io/schedule.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,6 +48,8 @@ typedef struct {
 	uint32_t			max_packet_size;		//!< for message ring buffer
 	uint32_t			num_messages;			//!< for message ring buffer
 	uint32_t			priority;			//!< for packet processing, larger == higher
+
+	fr_schedule_t			*sc;				//!< the scheduler, for the CPU time of the workers
 } proto_load_t;
 
 #include <pthread.h>
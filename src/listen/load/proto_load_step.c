@@ -24,12 +24,14 @@
  */
 #include <netdb.h>
 #include <fcntl.h>
+#include <dlfcn.h>
 #include <freeradius-devel/server/protocol.h>
 #include <freeradius-devel/radius/radius.h>
 #include <freeradius-devel/io/application.h>
 #include <freeradius-devel/io/listen.h>
 #include <freeradius-devel/io/schedule.h>
 #include <freeradius-devel/io/load.h>
+#include <freeradius-devel/server/main_loop.h>
 
 #include "proto_load.h"
 
@@ -55,6 +57,11 @@ typedef struct {
 	int				fd;			//!< for CSV files
 	fr_event_timer_t const		*ev;			//!< for writing statistics
 
+	fr_time_t			start;			//!< when load generation started
+	fr_time_delta_t			cpu_time;		//!< worker CPU time when load generation started
+	uint64_t			(*malloc_count)(void);	//!< allocation counter, if one has been preloaded
+	uint64_t			allocs;			//!< allocations when load generation started
+
 	fr_listen_t			*parent;		//!< master IO handler
 } proto_load_step_thread_t;
 
@@ -74,12 +81,16 @@ struct proto_load_step_s {
 	fr_load_config_t		load;			//!< load configuration
 	bool				repeat;			//!, do we repeat the load generation
 	char const     			*csv;			//!< where to write CSV stats
+	char const			*summary;		//!< where to write a JSON summary when done
+	bool				exit_when_done;		//!< exit the server when load generation is done
 };
 
 
 static const conf_parser_t load_listen_config[] = {
 	{ FR_CONF_OFFSET_FLAGS("filename", CONF_FLAG_FILE_INPUT | CONF_FLAG_REQUIRED | CONF_FLAG_NOT_EMPTY, proto_load_step_t, filename) },
 	{ FR_CONF_OFFSET("csv", proto_load_step_t, csv) },
+	{ FR_CONF_OFFSET("summary", proto_load_step_t, summary) },
+	{ FR_CONF_OFFSET("exit_when_done", proto_load_step_t, exit_when_done) },
 
 	{ FR_CONF_OFFSET("max_attributes", proto_load_step_t, max_attributes), .dflt = STRINGIFY(RADIUS_MAX_ATTRIBUTES) } ,
 
@@ -154,6 +165,123 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 }
 
 
+/** Write a JSON summary of the whole load test
+ *
+ *  This is intended for comparing builds, so everything is normalised
+ *  per request.  "pps" is the highest step rate which the server kept
+ *  up with, and "saturated" says whether a higher step was tried and
+ *  failed.  If it wasn't, "pps" is only a lower bound.  Any "sent"
+ *  packets which weren't "received" were dropped by the server.
+ *
+ *  CPU time is that of the worker threads, so it doesn't include the
+ *  cost of generating the load.  In single-threaded mode, everything
+ *  runs in one thread and is counted.  Allocations are only counted
+ *  when a library providing "fr_perf_malloc_count" has been preloaded,
+ *  as is done by the performance tests.
+ */
+static void write_summary(proto_load_step_thread_t *thread, fr_time_t now)
+{
+	fr_load_stats_t const	*stats = fr_load_generator_stats(thread->l);
+	fr_time_delta_t		cpu_time;
+	double			duration, sending;
+	char			allocs[32] = "null";
+	char			cpu[32] = "null";
+	char			buffer[1024];
+	int			fd;
+	ssize_t			len;
+
+	duration = fr_time_delta_unwrap(fr_time_sub(now, thread->start)) / (double)NSEC;
+	sending = fr_time_delta_unwrap(fr_time_sub(stats->last_send, stats->start)) / (double)NSEC;
+
+	cpu_time = fr_schedule_worker_cpu_time(thread->inst->parent->sc);
+	if (fr_time_delta_ispos(cpu_time) && stats->received) {
+		snprintf(cpu, sizeof(cpu), "%.2f",
+			 fr_time_delta_unwrap(fr_time_delta_sub(cpu_time, thread->cpu_time)) / 1000.0 / stats->received);
+	}
+
+	if (thread->malloc_count && stats->received) {
+		snprintf(allocs, sizeof(allocs), "%.1f",
+			 (thread->malloc_count() - thread->allocs) / (double)stats->received);
+	}
+
+	len = snprintf(buffer, sizeof(buffer),
+		       "{\"sent\":%d,\"received\":%d,\"duration\":%f,\"pps\":%d,\"saturated\":%s,"
+		       "\"offered_pps\":%.1f,\"max_backlog\":%d,"
+		       "\"latency_us\":{\"p50\":%" PRIu64 ",\"p90\":%" PRIu64 ",\"p99\":%" PRIu64
+		       ",\"p999\":%" PRIu64 ",\"max\":%" PRIu64 "},"
+		       "\"cpu_us_per_request\":%s,\"allocations_per_request\":%s}\n",
+		       stats->sent, stats->received, duration,
+		       stats->sustained_pps, stats->saturated ? "true" : "false",
+		       sending > 0 ? stats->sent / sending : 0, stats->max_backlog,
+		       fr_histogram_percentile(&stats->latency, 50) / 1000,
+		       fr_histogram_percentile(&stats->latency, 90) / 1000,
+		       fr_histogram_percentile(&stats->latency, 99) / 1000,
+		       fr_histogram_percentile(&stats->latency, 99.9) / 1000,
+		       fr_histogram_max(&stats->latency) / 1000,
+		       cpu, allocs);
+
+	fd = open(thread->inst->summary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		ERROR("Failed opening %s - %s", thread->inst->summary, fr_syserror(errno));
+		return;
+	}
+
+	if (write(fd, buffer, len) < 0) {
+		ERROR("Failed writing to %s - %s", thread->inst->summary, fr_syserror(errno));
+	}
+	close(fd);
+}
+
+/** The load test has finished
+ *
+ */
+static void load_done(proto_load_step_thread_t *thread)
+{
+	fr_time_t now = fr_time();
+
+	/*
+	 *	Make sure the last line of the CSV file covers the
+	 *	whole test.
+	 */
+	if (thread->ev) (void) fr_event_timer_delete(&thread->ev);
+
+	if (thread->fd >= 0) {
+		char buffer[1024];
+		size_t len;
+
+		len = fr_load_generator_stats_sprint(thread->l, now, buffer, sizeof(buffer));
+		if (write(thread->fd, buffer, len) < 0) {
+			DEBUG("Failed writing to %s - %s", thread->inst->csv, fr_syserror(errno));
+		}
+	}
+
+	if (thread->inst->summary) write_summary(thread, now);
+
+	if (thread->inst->exit_when_done) {
+		INFO("Load generation is done, process will now exit");
+
+		/*
+		 *	The same way proto_detail exits when it's done.
+		 */
+		main_loop_signal_raise(RADIUS_SIGNAL_SELF_TERM);
+	}
+}
+
+/** Either stop, or go around again
+ *
+ */
+static void load_finished(proto_load_step_thread_t *thread)
+{
+	if (!thread->inst->repeat) {
+		thread->done = true;
+		load_done(thread);
+		return;
+	}
+
+	(void) fr_load_generator_stop(thread->l); /* ensure l->ev is gone */
+	(void) fr_load_generator_start(thread->l);
+}
+
 static ssize_t mod_write(fr_listen_t *li, UNUSED void *packet_ctx, fr_time_t request_time,
 			 UNUSED uint8_t *buffer, size_t buffer_len, UNUSED size_t written)
 {
@@ -173,14 +301,7 @@ static ssize_t mod_write(fr_listen_t *li, UNUSED void *packet_ctx, fr_time_t req
 	 *	server.
 	 */
 	state = fr_load_generator_have_reply(thread->l, request_time);
-	if (state == FR_LOAD_DONE) {
-		if (!thread->inst->repeat) {
-			thread->done = true;
-		} else {
-			(void) fr_load_generator_stop(thread->l); /* ensure l->ev is gone */
-			(void) fr_load_generator_start(thread->l);
-		}
-	}
+	if (state == FR_LOAD_DONE) load_finished(thread);
 
 	return buffer_len;
 }
@@ -242,6 +363,17 @@ static void write_stats(fr_event_list_t *el, fr_time_t now, void *uctx)
 
 	(void) fr_event_timer_in(thread, el, &thread->ev, fr_time_delta_from_sec(1), write_stats, thread);
 
+	/*
+	 *	The last step ended with no packets outstanding, so
+	 *	there's no reply to tell us that we're done.
+	 */
+	if (!thread->done && fr_time_neq(fr_load_generator_stats(thread->l)->end, fr_time_wrap(0))) {
+		load_finished(thread);
+		return;
+	}
+
+	if (thread->fd < 0) return;
+
 	len = fr_load_generator_stats_sprint(thread->l, now, buffer, sizeof(buffer));
 	if (write(thread->fd, buffer, len) < 0) {
 		DEBUG("Failed writing to %s - %s", thread->inst->csv, fr_syserror(errno));
@@ -314,11 +446,27 @@ static void mod_event_list_set(fr_listen_t *li, fr_event_list_t *el, void *nr)
 	thread->inst = inst;
 	thread->load = inst->load;
 
+	thread->fd = -1;
+
 	thread->l = fr_load_generator_create(thread, el, &thread->load, mod_generate, li);
 	if (!thread->l) return;
 
+	/*
+	 *	Baselines for the summary.
+	 */
+	thread->malloc_count = (uint64_t (*)(void)) dlsym(RTLD_DEFAULT, "fr_perf_malloc_count");
+	if (thread->malloc_count) thread->allocs = thread->malloc_count();
+	thread->cpu_time = fr_schedule_worker_cpu_time(inst->parent->sc);
+	thread->start = fr_time();
+
 	(void) fr_load_generator_start(thread->l);
 
+	/*
+	 *	The timer also checks if the test is done, so it runs
+	 *	even if there's no CSV file.
+	 */
+	(void) fr_event_timer_in(thread, thread->el, &thread->ev, fr_time_delta_from_sec(1), write_stats, thread);
+
 	if (!inst->csv) return;
 
 	thread->fd = open(inst->csv, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
@@ -327,8 +475,6 @@ static void mod_event_list_set(fr_listen_t *li, fr_event_list_t *el, void *nr)
 		return;
 	}
 
-	(void) fr_event_timer_in(thread, thread->el, &thread->ev, fr_time_delta_from_sec(1), write_stats, thread);
-
 	len = fr_load_generator_stats_sprint(thread->l, fr_time(), buffer, sizeof(buffer));
 	if (write(thread->fd, buffer, len) < 0) {
 		DEBUG("Failed writing to %s - %s", thread->inst->csv, fr_syserror(errno));
@@ -0,0 +1,9 @@
+TARGETNAME	:= proto_metrics
+
+ifneq "$(TARGETNAME)" ""
+TARGET		:= $(TARGETNAME)$(L)
+endif
+
+SOURCES		:= proto_metrics.c
+
+TGT_PREREQS	:= $(LIBFREERADIUS_SERVER) libfreeradius-io$(L)
@@ -0,0 +1,594 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file proto_metrics_tcp.c
+ * @brief Metrics handler for TCP.
+ *
+ * Speaks just enough HTTP/1.0 for a metrics scraper.  Each connection
+ * gets one response, which is generated and written entirely from the
+ * network thread, after which the connection is closed.  Nothing is
+ * ever passed to a worker.
+ *
+ * The network thread never blocks on a slow scraper.  Whatever doesn't
+ * fit in the socket buffer is kept, and written when the socket becomes
+ * writable again.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#include <freeradius-devel/io/application.h>
+#include <freeradius-devel/io/listen.h>
+#include <freeradius-devel/io/schedule.h>
+#include <freeradius-devel/server/protocol.h>
+#include <freeradius-devel/util/syserror.h>
+#include <freeradius-devel/util/trie.h>
+
+#include <netdb.h>
+
+#include "proto_metrics.h"
+
+extern fr_app_io_t proto_metrics_tcp;
+
+/** The part of a response which hasn't been written yet
+ *
+ */
+typedef struct {
+	int				fd;			//!< dup() of the connection socket, so that
+								///< we can have our own write callback without
+								///< replacing the network thread's read callback.
+	bool				registered;		//!< Whether fd is in the event list.
+	fr_event_list_t			*el;			//!< The event list fd is registered with.
+	fr_event_timer_t const		*ev;			//!< write_timeout.
+
+	uint8_t				*data;			//!< The complete response.
+	size_t				written;		//!< How much of it has been written.
+} proto_metrics_tcp_pending_t;
+
+typedef struct {
+	char const			*name;			//!< socket name
+	int				sockfd;
+
+	fr_event_list_t			*el;			//!< for writing the rest of the response.
+	proto_metrics_tcp_pending_t	*pending;		//!< unsent part of the response.
+
+	fr_io_address_t			*connection;		//!< for connected sockets.
+
+	fr_stats_t			stats;			//!< statistics for this socket
+
+	fr_client_t			radclient;		//!< for faking out clients
+} proto_metrics_tcp_thread_t;
+
+typedef struct {
+	CONF_SECTION			*cs;			//!< our configuration
+
+	fr_ipaddr_t			ipaddr;			//!< IP address to listen on.
+
+	char const			*interface;		//!< Interface to bind to.
+	char const			*port_name;		//!< Name of the port for getservent().
+
+	uint16_t			port;			//!< Port to listen on.
+
+	uint32_t			max_packet_size;	//!< for message ring buffer.
+
+	fr_time_delta_t			write_timeout;		//!< How long we wait for the scraper
+								///< to read the response.
+
+	fr_ipaddr_t			*allow;			//!< Networks which may read the metrics.
+} proto_metrics_tcp_t;
+
+static const conf_parser_t networks_config[] = {
+	{ FR_CONF_OFFSET_TYPE_FLAGS("allow", FR_TYPE_COMBO_IP_PREFIX, CONF_FLAG_MULTI, proto_metrics_tcp_t, allow) },
+
+	CONF_PARSER_TERMINATOR
+};
+
+static const conf_parser_t tcp_listen_config[] = {
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipaddr", FR_TYPE_COMBO_IP_ADDR, 0, proto_metrics_tcp_t, ipaddr) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipv4addr", FR_TYPE_IPV4_ADDR, 0, proto_metrics_tcp_t, ipaddr) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipv6addr", FR_TYPE_IPV6_ADDR, 0, proto_metrics_tcp_t, ipaddr) },
+
+	{ FR_CONF_OFFSET("interface", proto_metrics_tcp_t, interface) },
+	{ FR_CONF_OFFSET("port_name", proto_metrics_tcp_t, port_name) },
+
+	{ FR_CONF_OFFSET("port", proto_metrics_tcp_t, port) },
+
+	{ FR_CONF_OFFSET("max_packet_size", proto_metrics_tcp_t, max_packet_size), .dflt = "4096" } ,
+
+	{ FR_CONF_OFFSET("write_timeout", proto_metrics_tcp_t, write_timeout), .dflt = "1.0" } ,
+
+	{ FR_CONF_POINTER("networks", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) networks_config },
+
+	CONF_PARSER_TERMINATOR
+};
+
+/** Finish with the connection
+ *
+ * Shutting down the socket wakes up the network thread's read callback,
+ * which then sees EOF, and closes the connection.
+ */
+static void metrics_pending_done(proto_metrics_tcp_thread_t *thread)
+{
+	(void) shutdown(thread->sockfd, SHUT_RDWR);
+	TALLOC_FREE(thread->pending);
+}
+
+/** Remove the write callback before closing the socket it's registered on
+ *
+ */
+static int _metrics_pending_free(proto_metrics_tcp_pending_t *pending)
+{
+	if (pending->fd < 0) return 0;
+
+	if (pending->registered) (void) fr_event_fd_delete(pending->el, pending->fd, FR_EVENT_FILTER_IO);
+	close(pending->fd);
+
+	return 0;
+}
+
+/** Write as much of the response as the socket will take
+ *
+ * @return
+ *	- 1 if the response has been completely written.
+ *	- 0 if the socket would block.
+ *	- -1 on error.
+ */
+static int metrics_pending_write(proto_metrics_tcp_thread_t *thread)
+{
+	proto_metrics_tcp_pending_t	*pending = thread->pending;
+	size_t				len = talloc_array_length(pending->data);
+	ssize_t				slen;
+
+	while (pending->written < len) {
+		slen = write(thread->sockfd, pending->data + pending->written, len - pending->written);
+		if (slen < 0) {
+			switch (errno) {
+#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
+			case EWOULDBLOCK:
+#endif
+			case EAGAIN:
+				return 0;
+
+			case EINTR:
+				continue;
+
+			default:
+				DEBUG2("proto_metrics_tcp - Failed writing response to %s: %s",
+				       thread->name, fr_syserror(errno));
+				return -1;
+			}
+		}
+
+		pending->written += slen;
+	}
+
+	thread->stats.total_responses++;
+	return 1;
+}
+
+static void metrics_write_ready(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	proto_metrics_tcp_thread_t	*thread = talloc_get_type_abort(uctx, proto_metrics_tcp_thread_t);
+
+	if (metrics_pending_write(thread) == 0) return;
+
+	metrics_pending_done(thread);
+}
+
+static void metrics_write_error(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, int fd_errno, void *uctx)
+{
+	proto_metrics_tcp_thread_t	*thread = talloc_get_type_abort(uctx, proto_metrics_tcp_thread_t);
+
+	DEBUG2("proto_metrics_tcp - Failed writing response to %s: %s", thread->name, fr_syserror(fd_errno));
+	metrics_pending_done(thread);
+}
+
+static void metrics_write_timeout(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	proto_metrics_tcp_thread_t	*thread = talloc_get_type_abort(uctx, proto_metrics_tcp_thread_t);
+
+	DEBUG2("proto_metrics_tcp - Timed out writing response to %s", thread->name);
+	metrics_pending_done(thread);
+}
+
+/** Write an HTTP response, then tell the caller to close the connection
+ *
+ * If the scraper isn't reading fast enough, the rest of the response is
+ * written from the event loop, and the connection is closed once it's
+ * all gone, or after write_timeout.
+ *
+ * @return
+ *	- 0 if the connection should stay open until the response is written.
+ *	- -1 if the connection should be closed.
+ */
+static ssize_t metrics_respond(proto_metrics_tcp_t const *inst, proto_metrics_tcp_thread_t *thread,
+			       char const *status, char const *content_type, char const *body, size_t body_len)
+{
+	proto_metrics_tcp_pending_t	*pending;
+	char				header[256];
+	int				len;
+
+	len = snprintf(header, sizeof(header),
+		       "HTTP/1.0 %s\r\n"
+		       "Content-Type: %s\r\n"
+		       "Content-Length: %zu\r\n"
+		       "Connection: close\r\n"
+		       "\r\n", status, content_type, body_len);
+
+	MEM(pending = talloc_zero(thread, proto_metrics_tcp_pending_t));
+	pending->fd = -1;
+	talloc_set_destructor(pending, _metrics_pending_free);
+
+	MEM(pending->data = talloc_array(pending, uint8_t, len + body_len));
+	memcpy(pending->data, header, len);
+	if (body_len) memcpy(pending->data + len, body, body_len);
+
+	thread->pending = pending;
+
+	switch (metrics_pending_write(thread)) {
+	case 0:
+		break;
+
+	default:
+		TALLOC_FREE(thread->pending);
+		return -1;
+	}
+
+	if (!thread->el) {
+		DEBUG2("proto_metrics_tcp - No event list to finish writing the response to %s", thread->name);
+	error:
+		TALLOC_FREE(thread->pending);
+		return -1;
+	}
+
+	pending->fd = dup(thread->sockfd);
+	if (pending->fd < 0) {
+		DEBUG2("proto_metrics_tcp - Failed duplicating socket for %s: %s", thread->name, fr_syserror(errno));
+		goto error;
+	}
+
+	/*
+	 *	Parented by the event list, so that it's still there
+	 *	when our destructor removes it.
+	 */
+	if (fr_event_fd_insert(NULL, thread->el, pending->fd,
+			       NULL, metrics_write_ready, metrics_write_error, thread) < 0) {
+		PERROR("proto_metrics_tcp - Failed adding write callback for %s", thread->name);
+		goto error;
+	}
+	pending->el = thread->el;
+	pending->registered = true;
+
+	if (fr_event_timer_in(pending, thread->el, &pending->ev, inst->write_timeout,
+			      metrics_write_timeout, thread) < 0) {
+		PERROR("proto_metrics_tcp - Failed adding write timeout for %s", thread->name);
+		goto error;
+	}
+
+	return 0;
+}
+
+static ssize_t mod_read(fr_listen_t *li, UNUSED void **packet_ctx, UNUSED fr_time_t *recv_time_p, uint8_t *buffer, size_t buffer_len, size_t *leftover)
+{
+	proto_metrics_tcp_t const      	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_metrics_tcp_t);
+	proto_metrics_tcp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_metrics_tcp_thread_t);
+	ssize_t				data_size;
+	size_t				in_buffer;
+	char				*p, *end, *path;
+	char				*body = NULL;
+	size_t				body_len = 0;
+	FILE				*fp;
+
+	/*
+	 *	We're still writing the response.  Anything else the
+	 *	scraper sends is ignored, but we still have to notice
+	 *	when the socket is closed.
+	 */
+	if (thread->pending) *leftover = 0;
+
+	/*
+	 *	Leave room for a trailing NUL.
+	 */
+	data_size = read(thread->sockfd, buffer + *leftover, buffer_len - *leftover - 1);
+	if (data_size < 0) {
+		switch (errno) {
+#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
+		case EWOULDBLOCK:
+#endif
+		case EAGAIN:
+			return 0;
+
+		default:
+			break;
+		}
+
+		DEBUG2("proto_metrics_tcp got read error (%zd) - %s", data_size, fr_syserror(errno));
+		return data_size;
+	}
+
+	if (!data_size) {
+		DEBUG2("proto_metrics_tcp - other side closed the socket.");
+		return -1;
+	}
+
+	if (thread->pending) return 0;
+
+	in_buffer = data_size + *leftover;
+	buffer[in_buffer] = '\0';
+
+	/*
+	 *	Wait for the end of the request headers.  If they
+	 *	don't fit in the buffer, it's not a scraper.
+	 */
+	if (!strstr((char *) buffer, "\r\n\r\n") && !strstr((char *) buffer, "\n\n")) {
+		if (in_buffer >= (buffer_len - 1)) {
+			DEBUG2("proto_metrics_tcp - request from %s is too large", thread->name);
+			return -1;
+		}
+
+		*leftover = in_buffer;
+		return 0;
+	}
+	*leftover = 0;
+	thread->stats.total_requests++;
+
+	/*
+	 *	Request-Line = Method SP Request-URI SP HTTP-Version
+	 */
+	p = (char *) buffer;
+	end = strpbrk(p, "\r\n");
+	*end = '\0';
+
+	if (strncmp(p, "GET ", 4) != 0) {
+		thread->stats.total_malformed_requests++;
+		return metrics_respond(inst, thread, "405 Method Not Allowed", "text/plain", NULL, 0);
+	}
+
+	path = p + 4;
+	p = strchr(path, ' ');
+	if (p) *p = '\0';
+
+	p = strchr(path, '?');
+	if (p) *p = '\0';
+
+	DEBUG3("proto_metrics_tcp - Received GET %s from %s", path, thread->name);
+
+	if ((strcmp(path, "/metrics") != 0) && (strcmp(path, "/") != 0)) {
+		return metrics_respond(inst, thread, "404 Not Found", "text/plain", NULL, 0);
+	}
+
+	fp = open_memstream(&body, &body_len);
+	if (!fp) {
+		ERROR("proto_metrics_tcp - Failed allocating memory for response: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	if (fr_metrics_print(fp) < 0) {
+		fclose(fp);
+		free(body);
+		return metrics_respond(inst, thread, "500 Internal Server Error", "text/plain", NULL, 0);
+	}
+	fclose(fp);
+
+	data_size = metrics_respond(inst, thread, "200 OK",
+				    "application/openmetrics-text; version=1.0.0; charset=utf-8", body, body_len);
+	free(body);
+
+	return data_size;
+}
+
+/** We never send replies from the workers
+ *
+ */
+static ssize_t mod_write(UNUSED fr_listen_t *li, UNUSED void *packet_ctx, UNUSED fr_time_t request_time,
+			 UNUSED uint8_t *buffer, size_t buffer_len, UNUSED size_t written)
+{
+	return buffer_len;
+}
+
+static void mod_event_list_set(fr_listen_t *li, fr_event_list_t *el, UNUSED void *nr)
+{
+	proto_metrics_tcp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_metrics_tcp_thread_t);
+
+	thread->el = el;
+}
+
+static int mod_connection_set(fr_listen_t *li, fr_io_address_t *connection)
+{
+	proto_metrics_tcp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_metrics_tcp_thread_t);
+
+	thread->connection = connection;
+	return 0;
+}
+
+static void mod_network_get(UNUSED void *instance, int *ipproto, bool *dynamic_clients, fr_trie_t const **trie)
+{
+	*ipproto = IPPROTO_TCP;
+	*dynamic_clients = false;
+	*trie = NULL;
+}
+
+/** Open a TCP listener for metrics
+ *
+ */
+static int mod_open(fr_listen_t *li)
+{
+	proto_metrics_tcp_t const      	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_metrics_tcp_t);
+	proto_metrics_tcp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_metrics_tcp_thread_t);
+
+	int				sockfd;
+	fr_ipaddr_t			ipaddr = inst->ipaddr;
+	uint16_t			port = inst->port;
+	CONF_SECTION			*server_cs;
+
+	fr_assert(!thread->connection);
+
+	li->fd = sockfd = fr_socket_server_tcp(&inst->ipaddr, &port, inst->port_name, true);
+	if (sockfd < 0) {
+		PERROR("Failed opening TCP socket");
+	error:
+		return -1;
+	}
+
+	(void) fr_nonblock(sockfd);
+
+	if (fr_socket_bind(sockfd, inst->interface, &ipaddr, &port) < 0) {
+		close(sockfd);
+		PERROR("Failed binding socket");
+		goto error;
+	}
+
+	if (listen(sockfd, 8) < 0) {
+		close(sockfd);
+		PERROR("Failed listening on socket");
+		goto error;
+	}
+
+	thread->sockfd = sockfd;
+
+	fr_assert((cf_parent(inst->cs) != NULL) && (cf_parent(cf_parent(inst->cs)) != NULL));	/* listen { ... } */
+	server_cs = cf_item_to_section(cf_parent(cf_parent(inst->cs)));
+
+	thread->name = fr_app_io_socket_name(thread, &proto_metrics_tcp,
+					     NULL, 0,
+					     &inst->ipaddr, inst->port,
+					     inst->interface);
+
+	/*
+	 *	Set up the fake client
+	 */
+	thread->radclient.longname = thread->name;
+	thread->radclient.shortname = thread->name;
+	thread->radclient.ipaddr = inst->ipaddr;
+	thread->radclient.src_ipaddr = inst->ipaddr;
+	thread->radclient.use_connected = true;
+
+	thread->radclient.server_cs = server_cs;
+	thread->radclient.server = cf_section_name2(server_cs);
+
+	return 0;
+}
+
+/** Set the file descriptor for this socket.
+ */
+static int mod_fd_set(fr_listen_t *li, int fd)
+{
+	proto_metrics_tcp_t const	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_metrics_tcp_t);
+	proto_metrics_tcp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_metrics_tcp_thread_t);
+
+	thread->sockfd = fd;
+
+	thread->name = fr_app_io_socket_name(thread, &proto_metrics_tcp,
+					     &thread->connection->socket.inet.src_ipaddr, thread->connection->socket.inet.src_port,
+					     &inst->ipaddr, inst->port,
+					     inst->interface);
+
+	return 0;
+}
+
+static char const *mod_name(fr_listen_t *li)
+{
+	proto_metrics_tcp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_metrics_tcp_thread_t);
+
+	return thread->name;
+}
+
+static int mod_bootstrap(module_inst_ctx_t const *mctx)
+{
+	proto_metrics_tcp_t	*inst = talloc_get_type_abort(mctx->inst->data, proto_metrics_tcp_t);
+	CONF_SECTION		*conf = mctx->inst->conf;
+
+	inst->cs = conf;
+
+	/*
+	 *	Complain if no "ipaddr" is set.
+	 */
+	if (inst->ipaddr.af == AF_UNSPEC) {
+		cf_log_err(conf, "No 'ipaddr' was specified in the 'tcp' section");
+		return -1;
+	}
+
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 1024);
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65536);
+
+	FR_TIME_DELTA_BOUND_CHECK("write_timeout", inst->write_timeout, >=, fr_time_delta_from_msec(10));
+	FR_TIME_DELTA_BOUND_CHECK("write_timeout", inst->write_timeout, <=, fr_time_delta_from_sec(10));
+
+	if (!inst->port) {
+		struct servent *s;
+
+		if (!inst->port_name) {
+			cf_log_err(conf, "No 'port' was specified in the 'tcp' section");
+			return -1;
+		}
+
+		s = getservbyname(inst->port_name, "tcp");
+		if (!s) {
+			cf_log_err(conf, "Unknown value for 'port_name = %s", inst->port_name);
+			return -1;
+		}
+
+		inst->port = ntohl(s->s_port);
+	}
+
+	return 0;
+}
+
+/** Only allow scrapers from the configured networks
+ *
+ */
+static fr_client_t *mod_client_find(fr_listen_t *li, fr_ipaddr_t const *ipaddr, UNUSED int ipproto)
+{
+	proto_metrics_tcp_t const	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_metrics_tcp_t);
+	proto_metrics_tcp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_metrics_tcp_thread_t);
+	size_t				i, num;
+
+	num = talloc_array_length(inst->allow);
+	if (!num) return &thread->radclient;
+
+	for (i = 0; i < num; i++) {
+		fr_ipaddr_t masked = *ipaddr;
+
+		if (masked.af != inst->allow[i].af) continue;
+
+		fr_ipaddr_mask(&masked, inst->allow[i].prefix);
+		if (fr_ipaddr_cmp(&masked, &inst->allow[i]) == 0) return &thread->radclient;
+	}
+
+	return NULL;
+}
+
+fr_app_io_t proto_metrics_tcp = {
+	.common = {
+		.magic			= MODULE_MAGIC_INIT,
+		.name			= "metrics_tcp",
+		.config			= tcp_listen_config,
+		.inst_size		= sizeof(proto_metrics_tcp_t),
+		.thread_inst_size	= sizeof(proto_metrics_tcp_thread_t),
+		.bootstrap		= mod_bootstrap,
+	},
+	.default_message_size	= 4096,
+
+	.open			= mod_open,
+	.read			= mod_read,
+	.write			= mod_write,
+	.fd_set			= mod_fd_set,
+	.event_list_set		= mod_event_list_set,
+	.connection_set		= mod_connection_set,
+	.network_get		= mod_network_get,
+	.client_find		= mod_client_find,
+	.get_name      		= mod_name,
+};
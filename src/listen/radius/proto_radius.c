@@ -80,6 +80,12 @@ static conf_parser_t const proto_radius_config[] = {
 	 */
 	{ FR_CONF_OFFSET("tunnel_password_zeros", proto_radius_t, tunnel_password_zeros) } ,
 
+	/*
+	 *	Decode "octets" attributes without copying them
+	 *	out of the packet.
+	 */
+	{ FR_CONF_OFFSET("shared_decode", proto_radius_t, shared_decode), .dflt = "no" } ,
+
 	{ FR_CONF_POINTER("limit", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) limit_config },
 	{ FR_CONF_POINTER("priority", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) priority_config },
 
@@ -197,13 +203,15 @@ static int transport_parse(TALLOC_CTX *ctx, void *out, UNUSED void *parent, CONF
 /** Decode the packet
  *
  */
-static int mod_decode(UNUSED void const *instance, request_t *request, uint8_t *const data, size_t data_len)
+static int mod_decode(void const *instance, request_t *request, uint8_t *const data, size_t data_len)
 {
+	proto_radius_t const	*inst = talloc_get_type_abort_const(instance, proto_radius_t);
 	fr_io_track_t const	*track = talloc_get_type_abort_const(request->async->packet_ctx, fr_io_track_t);
 	fr_io_address_t const  	*address = track->address;
 	fr_client_t const	*client;
 	fr_radius_ctx_t		common_ctx;
 	fr_radius_decode_ctx_t	decode_ctx;
+	uint8_t			*packet;
 
 	fr_assert(data[0] < FR_RADIUS_CODE_MAX);
 
@@ -228,6 +236,7 @@ static int mod_decode(UNUSED void const *instance, request_t *request, uint8_t *
 		.end = data + data_len,
 		.verify = client->active,
 		.require_message_authenticator = client->message_authenticator,
+		.shared = inst->shared_decode,
 	};
 
 	/*
@@ -246,9 +255,19 @@ static int mod_decode(UNUSED void const *instance, request_t *request, uint8_t *
 	/*
 	 *	!client->active means a fake packet defining a dynamic client - so there will
 	 *	be no secret defined yet - so can't verify.
+	 *
+	 *	The message buffer is reused as soon as we return.  So
+	 *	shared values reference our copy of the packet, which
+	 *	lives as long as the request.
 	 */
+	packet = data;
+	if (decode_ctx.shared) {
+		packet = request->packet->data;
+		decode_ctx.end = packet + data_len;
+	}
+
 	if (fr_radius_decode(request->request_ctx, &request->request_pairs,
-			     data, data_len, &decode_ctx) < 0) {
+			     packet, data_len, &decode_ctx) < 0) {
 		talloc_free(decode_ctx.tmp_ctx);
 		RPEDEBUG("Failed reading packet");
 		return -1;
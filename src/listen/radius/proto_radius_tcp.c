@@ -635,18 +635,26 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 static fr_client_t *mod_client_find(fr_listen_t *li, fr_ipaddr_t const *ipaddr, int ipproto)
 {
 	proto_radius_tcp_t const	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_radius_tcp_t);
+	fr_client_t			*client;
 
 	/*
 	 *	Prefer local clients.
 	 */
 	if (inst->clients) {
-		fr_client_t *client;
-
 		client = client_find(inst->clients, ipaddr, ipproto);
 		if (client) return client;
 	}
 
-	return client_find(NULL, ipaddr, ipproto);
+	client = client_find(NULL, ipaddr, ipproto);
+
+#ifdef WITH_TLS
+	/*
+	 *	TLS clients CANNOT use non-TLS listeners.
+	 */
+	if (client && client->tls_required) return NULL;
+#endif
+
+	return client;
 }
 
 fr_app_io_t proto_radius_tcp = {
@@ -0,0 +1,837 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file proto_radius_tls.c
+ * @brief RADIUS handler for TLS (RadSec, RFC 6614).
+ *
+ * Each connection is a chain of bios.  The TLS bio does the
+ * handshake, and encrypts / decrypts data.  The FD bio reads from,
+ * and writes to the socket.  RADIUS packets are framed here, exactly
+ * as in proto_radius_tcp.
+ *
+ * @copyright 2024 The FreeRADIUS server project.
+ */
+#include <netdb.h>
+#include <freeradius-devel/server/protocol.h>
+#include <freeradius-devel/util/trie.h>
+#include <freeradius-devel/radius/radius.h>
+#include <freeradius-devel/io/application.h>
+#include <freeradius-devel/io/listen.h>
+#include <freeradius-devel/io/schedule.h>
+#include <freeradius-devel/tls/base.h>
+#include <freeradius-devel/tls/log.h>
+#include "proto_radius.h"
+
+#include <freeradius-devel/bio/fd.h>
+#include <freeradius-devel/bio/tls.h>
+
+extern fr_app_io_t proto_radius_tls;
+
+typedef struct {
+	char const			*name;			//!< socket name
+	int				sockfd;
+
+	fr_io_address_t			*connection;		//!< for connected sockets.
+
+	fr_bio_t			*fd_bio;		//!< reads from, and writes to the socket.
+	fr_bio_t			*tls_bio;		//!< the top of the bio chain.
+
+	fr_stats_t			stats;			//!< statistics for this socket
+} proto_radius_tls_thread_t;
+
+/** The SSL_CTX is shared by all network threads
+ *
+ */
+typedef struct {
+	SSL_CTX				*ssl_ctx;
+} proto_radius_tls_ctx_t;
+
+typedef struct {
+	CONF_SECTION			*cs;			//!< our configuration
+
+	fr_ipaddr_t			ipaddr;			//!< IP address to listen on.
+
+	char const			*interface;		//!< Interface to bind to.
+	char const			*port_name;		//!< Name of the port for getservent().
+
+	uint32_t			recv_buff;		//!< How big the kernel's receive buffer should be.
+
+	uint32_t			max_packet_size;	//!< for message ring buffer.
+	uint32_t			max_attributes;		//!< Limit maximum decodable attributes.
+
+	uint16_t			port;			//!< Port to listen on.
+
+	bool				recv_buff_is_set;	//!< Whether we were provided with a recv_buff
+	bool				dynamic_clients;	//!< whether we have dynamic clients
+	bool				dedup_authenticator;	//!< dedup using the request authenticator
+	bool				require_client_cert;	//!< client must present a certificate
+
+	uint32_t			session_cache_size;	//!< maximum number of cached sessions
+
+	fr_tls_conf_t			*tls_conf;		//!< from the "tls" subsection
+	proto_radius_tls_ctx_t		*ctx;			//!< for new sessions
+
+	fr_client_list_t			*clients;		//!< local clients
+
+	fr_trie_t			*trie;			//!< for parsed networks
+	fr_ipaddr_t			*allow;			//!< allowed networks for dynamic clients
+	fr_ipaddr_t			*deny;			//!< denied networks for dynamic clients
+} proto_radius_tls_t;
+
+
+static const conf_parser_t networks_config[] = {
+	{ FR_CONF_OFFSET_TYPE_FLAGS("allow", FR_TYPE_COMBO_IP_PREFIX , CONF_FLAG_MULTI, proto_radius_tls_t, allow) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("deny", FR_TYPE_COMBO_IP_PREFIX , CONF_FLAG_MULTI, proto_radius_tls_t, deny) },
+
+	CONF_PARSER_TERMINATOR
+};
+
+
+static const conf_parser_t tls_listen_config[] = {
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipaddr", FR_TYPE_COMBO_IP_ADDR, 0, proto_radius_tls_t, ipaddr) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipv4addr", FR_TYPE_IPV4_ADDR, 0, proto_radius_tls_t, ipaddr) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipv6addr", FR_TYPE_IPV6_ADDR, 0, proto_radius_tls_t, ipaddr) },
+
+	{ FR_CONF_OFFSET("interface", proto_radius_tls_t, interface) },
+	{ FR_CONF_OFFSET("port_name", proto_radius_tls_t, port_name) },
+
+	{ FR_CONF_OFFSET("port", proto_radius_tls_t, port) },
+	{ FR_CONF_OFFSET_IS_SET("recv_buff", FR_TYPE_UINT32, 0, proto_radius_tls_t, recv_buff) },
+
+	{ FR_CONF_OFFSET("dynamic_clients", proto_radius_tls_t, dynamic_clients) } ,
+	{ FR_CONF_OFFSET("accept_conflicting_packets", proto_radius_tls_t, dedup_authenticator) } ,
+	{ FR_CONF_OFFSET("require_client_cert", proto_radius_tls_t, require_client_cert), .dflt = "yes" } ,
+	{ FR_CONF_OFFSET("session_cache_size", proto_radius_tls_t, session_cache_size), .dflt = "65536" } ,
+	{ FR_CONF_POINTER("networks", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) networks_config },
+
+	{ FR_CONF_OFFSET("max_packet_size", proto_radius_tls_t, max_packet_size), .dflt = "4096" } ,
+       	{ FR_CONF_OFFSET("max_attributes", proto_radius_tls_t, max_attributes), .dflt = STRINGIFY(RADIUS_MAX_ATTRIBUTES) } ,
+
+	CONF_PARSER_TERMINATOR
+};
+
+
+static ssize_t mod_read(fr_listen_t *li, UNUSED void **packet_ctx, fr_time_t *recv_time_p, uint8_t *buffer, size_t buffer_len, size_t *leftover)
+{
+	proto_radius_tls_t const       	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_radius_tls_t);
+	proto_radius_tls_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_radius_tls_thread_t);
+	ssize_t				data_size;
+	size_t				packet_len, in_buffer;
+	decode_fail_t			reason;
+
+	in_buffer = *leftover;
+
+	/*
+	 *	Read as much application data as will fit into the buffer.  OpenSSL may have already read
+	 *	(and decrypted) more than one packet from the socket.  The socket won't become readable again
+	 *	for that data, so we can't leave it inside of OpenSSL.
+	 *
+	 *	The caller will then call us again for each packet which is left over in the buffer.
+	 */
+	while (in_buffer < buffer_len) {
+		data_size = fr_bio_read(thread->tls_bio, NULL, buffer + in_buffer, buffer_len - in_buffer);
+		if (data_size == 0) break;
+
+		/*
+		 *	Note that we return ERROR for all bad packets, as
+		 *	there's no point in reading RADIUS packets from a TLS
+		 *	connection which isn't sending us RADIUS packets.
+		 */
+		if (data_size < 0) {
+			if (data_size == fr_bio_error(EOF)) {
+				DEBUG2("proto_radius_tls - other side closed the connection.");
+			} else {
+				PDEBUG2("proto_radius_tls got read error (%zd)", data_size);
+			}
+			return -1;
+		}
+
+		in_buffer += data_size;
+	}
+
+	/*
+	 *	Not enough for one packet.  Tell the caller that we need to read more.
+	 */
+	if (in_buffer < RADIUS_HEADER_LENGTH) {
+		*leftover = in_buffer;
+		return 0;
+	}
+
+	/*
+	 *	We MUST always start with a known RADIUS packet.
+	 */
+	if ((buffer[0] == 0) || (buffer[0] >= FR_RADIUS_CODE_MAX)) {
+		DEBUG("proto_radius_tls got invalid packet code %d", buffer[0]);
+		thread->stats.total_unknown_types++;
+		return -1;
+	}
+
+	/*
+	 *	Figure out how large the RADIUS packet is.
+	 */
+	packet_len = fr_nbo_to_uint16(buffer + 2);
+
+	/*
+	 *	We don't have a complete RADIUS packet.  Tell the
+	 *	caller that we need to read more.
+	 */
+	if (in_buffer < packet_len) {
+		*leftover = in_buffer;
+		return 0;
+	}
+
+	/*
+	 *	We've read at least one packet.  Tell the caller that
+	 *	there's more data available, and return only one packet.
+	 */
+	*leftover = in_buffer - packet_len;
+
+	/*
+	 *      If it's not a RADIUS packet, ignore it.
+	 */
+	if (!fr_radius_ok(buffer, &packet_len, inst->max_attributes, false, &reason)) {
+		DEBUG2("proto_radius_tls got a packet which isn't RADIUS");
+		thread->stats.total_malformed_requests++;
+		return -1;
+	}
+
+	*recv_time_p = fr_time();
+	thread->stats.total_requests++;
+
+	/*
+	 *	Print out what we received.
+	 */
+	DEBUG2("proto_radius_tls - Received %s ID %d length %d %s",
+	       fr_radius_packet_names[buffer[0]], buffer[1],
+	       (int) packet_len, thread->name);
+
+	return packet_len;
+}
+
+
+static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t request_time,
+			 uint8_t *buffer, size_t buffer_len, size_t written)
+{
+	proto_radius_tls_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_radius_tls_thread_t);
+	fr_io_track_t			*track = talloc_get_type_abort(packet_ctx, fr_io_track_t);
+	ssize_t				data_size;
+
+	if (!written) thread->stats.total_responses++;
+
+	/*
+	 *	This handles the race condition where we get a DUP,
+	 *	but the original packet replies before we're run.
+	 *	See proto_radius_tcp for details.
+	 */
+	if (track->reply_len) {
+		return buffer_len;
+	}
+
+	/*
+	 *	We only write RADIUS packets.
+	 */
+	fr_assert(buffer_len >= 20);
+	fr_assert(written < buffer_len);
+
+	/*
+	 *	The TLS bio returns 0 if the socket is blocked.  In
+	 *	that case, OpenSSL requires us to write the same data
+	 *	again, which the caller does when the socket becomes
+	 *	writable.
+	 */
+	data_size = fr_bio_write(thread->tls_bio, NULL, buffer + written, buffer_len - written);
+	if (data_size < 0) {
+		PDEBUG2("proto_radius_tls got write error (%zd)", data_size);
+		return -1;
+	}
+
+	/*
+	 *	Returning zero means "close the socket", so we have to
+	 *	say "try again later".
+	 */
+	if (!data_size && !written) {
+		errno = EWOULDBLOCK;
+		return -1;
+	}
+
+	/*
+	 *	Add in previously written data to the response.
+	 */
+	return data_size + written;
+}
+
+
+/** Run when the TLS handshake has completed
+ *
+ */
+static int mod_established(fr_bio_t *bio)
+{
+	proto_radius_tls_thread_t	*thread = talloc_get_type_abort(bio->uctx, proto_radius_tls_thread_t);
+	fr_bio_tls_info_t const		*info = fr_bio_tls_info(bio);
+
+	DEBUG2("proto_radius_tls - TLS session established (%s, %s) %s",
+	       SSL_get_version(fr_bio_tls_ssl(bio)), info->resumed ? "resumed" : "full handshake",
+	       thread->name);
+
+	return 0;
+}
+
+
+static int mod_connection_set(fr_listen_t *li, fr_io_address_t *connection)
+{
+	proto_radius_tls_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_radius_tls_thread_t);
+
+	thread->connection = connection;
+	return 0;
+}
+
+
+static void mod_network_get(void *instance, int *ipproto, bool *dynamic_clients, fr_trie_t const **trie)
+{
+	proto_radius_tls_t *inst = talloc_get_type_abort(instance, proto_radius_tls_t);
+
+	*ipproto = IPPROTO_TCP;
+	*dynamic_clients = inst->dynamic_clients;
+	*trie = inst->trie;
+}
+
+
+/** Open a TLS listener for RADIUS
+ *
+ */
+static int mod_open(fr_listen_t *li)
+{
+	proto_radius_tls_t const       	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_radius_tls_t);
+	proto_radius_tls_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_radius_tls_thread_t);
+
+	int				sockfd;
+	fr_ipaddr_t			ipaddr = inst->ipaddr;
+	uint16_t			port = inst->port;
+
+	fr_assert(!thread->connection);
+
+	li->fd = sockfd = fr_socket_server_tcp(&inst->ipaddr, &port, inst->port_name, true);
+	if (sockfd < 0) {
+		PERROR("Failed opening TCP socket");
+	error:
+		return -1;
+	}
+
+	(void) fr_nonblock(sockfd);
+
+	if (fr_socket_bind(sockfd, inst->interface, &ipaddr, &port) < 0) {
+		close(sockfd);
+		PERROR("Failed binding socket");
+		goto error;
+	}
+
+	/*
+	 *	RadSec clients may all reconnect at once, e.g. after a
+	 *	restart.  Don't drop their SYNs.
+	 */
+	if (listen(sockfd, SOMAXCONN) < 0) {
+		close(sockfd);
+		PERROR("Failed listening on socket");
+		goto error;
+	}
+
+	thread->sockfd = sockfd;
+
+	fr_assert((cf_parent(inst->cs) != NULL) && (cf_parent(cf_parent(inst->cs)) != NULL));	/* listen { ... } */
+
+	thread->name = fr_app_io_socket_name(thread, &proto_radius_tls,
+					     NULL, 0,
+					     &inst->ipaddr, inst->port,
+					     inst->interface);
+
+	return 0;
+}
+
+
+/** Set the file descriptor for this socket.
+ *
+ *  This is called for each new connection, and sets up the bio chain.
+ */
+static int mod_fd_set(fr_listen_t *li, int fd)
+{
+	proto_radius_tls_t const  *inst = talloc_get_type_abort_const(li->app_io_instance, proto_radius_tls_t);
+	proto_radius_tls_thread_t *thread = talloc_get_type_abort(li->thread_instance, proto_radius_tls_thread_t);
+	SSL			*ssl;
+	fr_bio_cb_funcs_t	cb = {
+					.activate = mod_established,
+				};
+
+	thread->name = fr_app_io_socket_name(thread, &proto_radius_tls,
+					     &thread->connection->socket.inet.src_ipaddr, thread->connection->socket.inet.src_port,
+					     &inst->ipaddr, inst->port,
+					     inst->interface);
+
+	ssl = SSL_new(inst->ctx->ssl_ctx);
+	if (!ssl) {
+		fr_tls_log(NULL, "Failed creating TLS session for %s", thread->name);
+		return -1;
+	}
+
+	SSL_set_accept_state(ssl);
+	if (inst->require_client_cert) {
+		SSL_set_verify(ssl, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT | SSL_VERIFY_CLIENT_ONCE, NULL);
+	}
+
+	/*
+	 *	The FD bio doesn't own the socket until the end, so
+	 *	that the caller can close it if we fail.
+	 */
+	MEM(thread->fd_bio = fr_bio_fd_alloc(thread, NULL, NULL, 0));
+
+	thread->tls_bio = fr_bio_tls_alloc(thread, &cb, ssl, thread->fd_bio);
+	if (!thread->tls_bio) {
+		ERROR("Failed allocating TLS bio for %s", thread->name);
+		TALLOC_FREE(thread->fd_bio);
+		return -1;
+	}
+	thread->tls_bio->uctx = thread;
+
+	if (fr_bio_fd_accepted(thread->fd_bio, fd) < 0) {
+		PERROR("Failed initializing connection %s", thread->name);
+		(void) fr_bio_free(thread->tls_bio);
+		thread->tls_bio = thread->fd_bio = NULL;
+		return -1;
+	}
+
+	thread->sockfd = fd;
+
+	return 0;
+}
+
+/** Close the connection, or the listening socket
+ *
+ */
+static int mod_close(fr_listen_t *li)
+{
+	proto_radius_tls_thread_t *thread = talloc_get_type_abort(li->thread_instance, proto_radius_tls_thread_t);
+
+	if (!thread->tls_bio) {
+		close(li->fd);
+		return 0;
+	}
+
+	/*
+	 *	Send a close_notify, and then close the socket.
+	 */
+	(void) fr_bio_shutdown(thread->tls_bio);
+	(void) fr_bio_free(thread->tls_bio);
+	thread->tls_bio = thread->fd_bio = NULL;
+
+	return 0;
+}
+
+static int mod_track_compare(void const *instance, UNUSED void *thread_instance, UNUSED fr_client_t *client,
+			     void const *one, void const *two)
+{
+	int ret;
+	proto_radius_tls_t const *inst = talloc_get_type_abort_const(instance, proto_radius_tls_t);
+
+	uint8_t const *a = one;
+	uint8_t const *b = two;
+
+	/*
+	 *	Do a better job of deduping input packet.
+	 */
+	if (inst->dedup_authenticator) {
+		ret = memcmp(a + 4, b + 4, RADIUS_AUTH_VECTOR_LENGTH);
+		if (ret != 0) return ret;
+	}
+
+	/*
+	 *	The tree is ordered by IDs, which are (hopefully)
+	 *	pseudo-randomly distributed.
+	 */
+	ret = (a[1] < b[1]) - (a[1] > b[1]);
+	if (ret != 0) return ret;
+
+	/*
+	 *	Then ordered by code, which is usually the same.
+	 */
+	return (a[0] < b[0]) - (a[0] > b[0]);
+}
+
+
+static char const *mod_name(fr_listen_t *li)
+{
+	proto_radius_tls_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_radius_tls_thread_t);
+
+	return thread->name;
+}
+
+
+static int mod_bootstrap(module_inst_ctx_t const *mctx)
+{
+	proto_radius_tls_t	*inst = talloc_get_type_abort(mctx->inst->data, proto_radius_tls_t);
+	CONF_SECTION		*conf = mctx->inst->conf;
+	size_t			i, num;
+	CONF_ITEM		*ci;
+	CONF_SECTION		*server_cs, *tls_cs;
+
+	inst->cs = conf;
+
+	/*
+	 *	The TLS configuration can be in a "tls" subsection,
+	 *	or mixed in with the listener configuration.
+	 */
+	tls_cs = cf_section_find(conf, "tls", NULL);
+	if (!tls_cs) tls_cs = conf;
+
+	inst->tls_conf = fr_tls_conf_parse_server(tls_cs);
+	if (!inst->tls_conf) {
+		cf_log_err(tls_cs, "Failed parsing TLS configuration");
+		return -1;
+	}
+
+	/*
+	 *	Complain if no "ipaddr" is set.
+	 */
+	if (inst->ipaddr.af == AF_UNSPEC) {
+		cf_log_err(conf, "No 'ipaddr' was specified in the 'tls' section");
+		return -1;
+	}
+
+	if (inst->recv_buff_is_set) {
+		FR_INTEGER_BOUND_CHECK("recv_buff", inst->recv_buff, >=, 32);
+		FR_INTEGER_BOUND_CHECK("recv_buff", inst->recv_buff, <=, INT_MAX);
+	}
+
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 20);
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65536);
+
+	if (!inst->port) {
+		struct servent *s;
+
+		if (!inst->port_name) {
+			cf_log_err(conf, "No 'port' was specified in the 'tls' section");
+			return -1;
+		}
+
+		s = getservbyname(inst->port_name, "tcp");
+		if (!s) {
+			cf_log_err(conf, "Unknown value for 'port_name = %s", inst->port_name);
+			return -1;
+		}
+
+		inst->port = ntohl(s->s_port);
+	}
+
+	/*
+	 *	Parse and create the trie for dynamic clients, even if
+	 *	there's no dynamic clients.
+	 *
+	 *	@todo - we could use this for source IP filtering?
+	 *	e.g. allow clients from a /16, but not from a /24
+	 *	within that /16.
+	 */
+	num = talloc_array_length(inst->allow);
+	if (!num) {
+		if (inst->dynamic_clients) {
+			cf_log_err(conf, "The 'allow' subsection MUST contain at least one 'network' entry when 'dynamic_clients = true'.");
+			return -1;
+		}
+	} else {
+		MEM(inst->trie = fr_trie_alloc(inst, NULL, NULL));
+
+		for (i = 0; i < num; i++) {
+			fr_ipaddr_t *network;
+
+			/*
+			 *	Can't add v4 networks to a v6 socket, or vice versa.
+			 */
+			if (inst->allow[i].af != inst->ipaddr.af) {
+				cf_log_err(conf, "Address family in entry %zd - 'allow = %pV' does not match 'ipaddr'",
+					   i + 1, fr_box_ipaddr(inst->allow[i]));
+				return -1;
+			}
+
+			/*
+			 *	Duplicates are bad.
+			 */
+			network = fr_trie_match_by_key(inst->trie,
+						&inst->allow[i].addr, inst->allow[i].prefix);
+			if (network) {
+				cf_log_err(conf, "Cannot add duplicate entry 'allow = %pV'",
+					   fr_box_ipaddr(inst->allow[i]));
+				return -1;
+			}
+
+			/*
+			 *	Look for overlapping entries.
+			 *	i.e. the networks MUST be disjoint.
+			 *
+			 *	Note that this catches 192.168.1/24
+			 *	followed by 192.168/16, but NOT the
+			 *	other way around.  The best fix is
+			 *	likely to add a flag to
+			 *	fr_trie_alloc() saying "we can only
+			 *	have terminal fr_trie_user_t nodes"
+			 */
+			network = fr_trie_lookup_by_key(inst->trie,
+						 &inst->allow[i].addr, inst->allow[i].prefix);
+			if (network && (network->prefix <= inst->allow[i].prefix)) {
+				cf_log_err(conf, "Cannot add overlapping entry 'allow = %pV'",
+					   fr_box_ipaddr(inst->allow[i]));
+				cf_log_err(conf, "Entry is completely enclosed inside of a previously defined network");
+				return -1;
+			}
+
+			/*
+			 *	Insert the network into the trie.
+			 *	Lookups will return the fr_ipaddr_t of
+			 *	the network.
+			 */
+			if (fr_trie_insert_by_key(inst->trie,
+					   &inst->allow[i].addr, inst->allow[i].prefix,
+					   &inst->allow[i]) < 0) {
+				cf_log_err(conf, "Failed adding 'allow = %pV' to tracking table",
+					   fr_box_ipaddr(inst->allow[i]));
+				return -1;
+			}
+		}
+
+		/*
+		 *	And now check denied networks.
+		 */
+		num = talloc_array_length(inst->deny);
+		if (!num) return 0;
+
+		/*
+		 *	Since the default is to deny, you can only add
+		 *	a "deny" inside of a previous "allow".
+		 */
+		for (i = 0; i < num; i++) {
+			fr_ipaddr_t	*network;
+
+			/*
+			 *	Can't add v4 networks to a v6 socket, or vice versa.
+			 */
+			if (inst->deny[i].af != inst->ipaddr.af) {
+				cf_log_err(conf, "Address family in entry %zd - 'deny = %pV' does not match 'ipaddr'",
+					   i + 1, fr_box_ipaddr(inst->deny[i]));
+				return -1;
+			}
+
+			/*
+			 *	Duplicates are bad.
+			 */
+			network = fr_trie_match_by_key(inst->trie,
+						&inst->deny[i].addr, inst->deny[i].prefix);
+			if (network) {
+				cf_log_err(conf, "Cannot add duplicate entry 'deny = %pV'", fr_box_ipaddr(inst->deny[i]));
+				return -1;
+			}
+
+			/*
+			 *	A "deny" can only be within a previous "allow".
+			 */
+			network = fr_trie_lookup_by_key(inst->trie,
+						&inst->deny[i].addr, inst->deny[i].prefix);
+			if (!network) {
+				cf_log_err(conf, "The network in entry %zd - 'deny = %pV' is not contained "
+					   "within a previous 'allow'", i + 1, fr_box_ipaddr(inst->deny[i]));
+				return -1;
+			}
+
+			/*
+			 *	We hack the AF in "deny" rules.  If
+			 *	the lookup gets AF_UNSPEC, then we're
+			 *	adding a "deny" inside of a "deny".
+			 */
+			if (network->af != inst->ipaddr.af) {
+				cf_log_err(conf, "The network in entry %zd - 'deny = %pV' overlaps with "
+					   "another 'deny' rule", i + 1, fr_box_ipaddr(inst->deny[i]));
+				return -1;
+			}
+
+			/*
+			 *	Insert the network into the trie.
+			 *	Lookups will return the fr_ipaddr_t of
+			 *	the network.
+			 */
+			if (fr_trie_insert_by_key(inst->trie,
+					   &inst->deny[i].addr, inst->deny[i].prefix,
+					   &inst->deny[i]) < 0) {
+				cf_log_err(conf, "Failed adding 'deny = %pV' to tracking table",
+					   fr_box_ipaddr(inst->deny[i]));
+				return -1;
+			}
+
+			/*
+			 *	Hack it to make it a deny rule.
+			 */
+			inst->deny[i].af = AF_UNSPEC;
+		}
+	}
+
+	ci = cf_parent(inst->cs); /* listen { ... } */
+	fr_assert(ci != NULL);
+	ci = cf_parent(ci);
+	fr_assert(ci != NULL);
+
+	server_cs = cf_item_to_section(ci);
+
+	/*
+	 *	Look up local clients, if they exist.
+	 */
+	if (cf_section_find_next(server_cs, NULL, "client", CF_IDENT_ANY)) {
+		inst->clients = client_list_parse_section(server_cs, IPPROTO_TCP, true);
+		if (!inst->clients) {
+			cf_log_err(conf, "Failed creating local clients");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int _proto_radius_tls_ctx_free(proto_radius_tls_ctx_t *ctx)
+{
+	if (ctx->ssl_ctx) SSL_CTX_free(ctx->ssl_ctx);
+
+	return 0;
+}
+
+/** Log alerts
+ *
+ * fr_tls_session_info_cb() records alerts in the request, and there
+ * isn't one during the handshake.
+ */
+static void mod_info_cb(UNUSED SSL const *ssl, int where, int ret)
+{
+	if (!(where & SSL_CB_ALERT) || ((ret & 0xff) == SSL_AD_CLOSE_NOTIFY)) return;
+
+	DEBUG2("proto_radius_tls - %s %s TLS alert (%i) - %s",
+	       (where & SSL_CB_READ) ? "Client sent" : "Sending client",
+	       SSL_alert_type_string_long(ret), ret & 0xff, SSL_alert_desc_string_long(ret));
+}
+
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	proto_radius_tls_t	*inst = talloc_get_type_abort(mctx->inst->data, proto_radius_tls_t);
+	CONF_SECTION		*server_cs;
+	char const		*server;
+	size_t			len;
+	SSL_CTX			*ssl_ctx;
+
+	MEM(inst->ctx = talloc_zero(inst, proto_radius_tls_ctx_t));
+	talloc_set_destructor(inst->ctx, _proto_radius_tls_ctx_free);
+
+	/*
+	 *	One SSL_CTX is shared by all network threads, so that
+	 *	sessions can be resumed no matter which thread the
+	 *	client connects to.
+	 */
+	inst->ctx->ssl_ctx = ssl_ctx = fr_tls_ctx_alloc(inst->tls_conf, false);
+	if (!ssl_ctx) {
+		cf_log_perr(inst->cs, "Failed creating TLS context");
+		return -1;
+	}
+
+	/*
+	 *	The handshake is done in the network thread, where
+	 *	there's no request in which to run the "load session"
+	 *	and "store session" sections of the TLS virtual
+	 *	server.  Use OpenSSL's internal session cache instead.
+	 *	Session tickets (stateless resumption) are unaffected.
+	 */
+	if (inst->tls_conf->cache.mode & FR_TLS_CACHE_STATEFUL) {
+		SSL_CTX_sess_set_new_cb(ssl_ctx, NULL);
+		SSL_CTX_sess_set_get_cb(ssl_ctx, NULL);
+		SSL_CTX_sess_set_remove_cb(ssl_ctx, NULL);
+		SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_SERVER);
+		SSL_CTX_sess_set_cache_size(ssl_ctx, inst->session_cache_size);
+	}
+
+	/*
+	 *	The callbacks which fr_tls_ctx_alloc() sets for
+	 *	resumption and logging all expect an fr_tls_session_t,
+	 *	or a request, in the SSL ex_data, and we don't have
+	 *	either.  There's no session-state list to put in the
+	 *	tickets, so OpenSSL's defaults do everything we need.
+	 */
+	SSL_CTX_set_not_resumable_session_callback(ssl_ctx, NULL);
+	SSL_CTX_set_info_callback(ssl_ctx, mod_info_cb);
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	SSL_CTX_set_session_ticket_cb(ssl_ctx, NULL, NULL, NULL);
+#endif
+
+	/*
+	 *	Sessions can only be resumed by the same virtual server.
+	 */
+	server_cs = cf_item_to_section(cf_parent(cf_parent(inst->cs)));
+	server = cf_section_name2(server_cs);
+	if (!server) server = "radsec";
+
+	len = strlen(server);
+	if (len > SSL_MAX_SID_CTX_LENGTH) len = SSL_MAX_SID_CTX_LENGTH;
+
+	SSL_CTX_set_session_id_context(ssl_ctx, (unsigned char const *) server, (unsigned int) len);
+
+	return 0;
+}
+
+static fr_client_t *mod_client_find(fr_listen_t *li, fr_ipaddr_t const *ipaddr, int ipproto)
+{
+	proto_radius_tls_t const	*inst = talloc_get_type_abort_const(li->app_io_instance, proto_radius_tls_t);
+	fr_client_t			*client;
+
+	/*
+	 *	Prefer local clients.
+	 */
+	if (inst->clients) {
+		client = client_find(inst->clients, ipaddr, ipproto);
+		if (client) return client;
+	}
+
+	/*
+	 *	non-TLS clients CANNOT use TLS listeners.
+	 */
+	client = client_find(NULL, ipaddr, ipproto);
+	if (client && !client->tls_required) return NULL;
+
+	return client;
+}
+
+fr_app_io_t proto_radius_tls = {
+	.common = {
+		.magic			= MODULE_MAGIC_INIT,
+		.name			= "radius_tls",
+		.config			= tls_listen_config,
+		.inst_size		= sizeof(proto_radius_tls_t),
+		.thread_inst_size	= sizeof(proto_radius_tls_thread_t),
+		.bootstrap		= mod_bootstrap,
+		.instantiate		= mod_instantiate,
+	},
+	.default_message_size	= 4096,
+
+	.open			= mod_open,
+	.read			= mod_read,
+	.write			= mod_write,
+	.close			= mod_close,
+	.fd_set			= mod_fd_set,
+	.track_compare		= mod_track_compare,
+	.connection_set		= mod_connection_set,
+	.network_get		= mod_network_get,
+	.client_find		= mod_client_find,
+	.get_name		= mod_name,
+};
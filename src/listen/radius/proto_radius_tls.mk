@@ -0,0 +1,13 @@
+TARGETNAME	:=
+
+ifneq "$(OPENSSL_LIBS)" ""
+TARGETNAME	:= proto_radius_tls
+endif
+
+ifneq "$(TARGETNAME)" ""
+TARGET		:= $(TARGETNAME)$(L)
+endif
+
+SOURCES		:= proto_radius_tls.c
+
+TGT_PREREQS	:= libfreeradius-radius$(L) libfreeradius-bio$(L) libfreeradius-tls$(L)
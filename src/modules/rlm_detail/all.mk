@@ -4,3 +4,4 @@ TARGET		:= $(TARGETNAME)$(L)
 SOURCES		:= $(TARGETNAME).c
 
 LOG_ID_LIB	= 11
+TGT_PREREQS	:= libfreeradius-internal$(L)
@@ -25,6 +25,8 @@ RCSID("$Id$")
 
 #define LOG_PREFIX mctx->inst->name
 
+#include <freeradius-devel/internal/detail.h>
+#include <freeradius-devel/io/listen.h>
 #include <freeradius-devel/server/base.h>
 #include <freeradius-devel/server/cf_util.h>
 #include <freeradius-devel/server/exfile.h>
@@ -46,6 +48,17 @@ RCSID("$Id$")
 
 #define DIRLEN	8192		//!< Maximum path length.
 
+typedef enum {
+	DETAIL_FORMAT_TEXT = 0,		//!< The traditional text format.
+	DETAIL_FORMAT_BINARY		//!< Length prefixed, checksummed records.
+} rlm_detail_format_t;
+
+static fr_table_num_sorted_t const detail_format_table[] = {
+	{ L("binary"),	DETAIL_FORMAT_BINARY },
+	{ L("text"),	DETAIL_FORMAT_TEXT }
+};
+static size_t detail_format_table_len = NUM_ELEMENTS(detail_format_table);
+
 /** Instance configuration for rlm_detail
  *
  * Holds the configuration and preparsed data for a instance of rlm_detail.
@@ -56,6 +69,8 @@ typedef struct {
 	gid_t		group;		//!< Resolved group.
 	bool		group_is_set;	//!< Whether group was set.
 
+	rlm_detail_format_t format;	//!< Text or binary records.
+
 	tmpl_t		*header;	//!< Header format.
 	bool		locking;	//!< Whether the file should be locked.
 
@@ -75,6 +90,10 @@ int detail_group_parse(UNUSED TALLOC_CTX *ctx, void *out, void *parent,
 
 static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET_FLAGS("filename", CONF_FLAG_FILE_OUTPUT | CONF_FLAG_XLAT, rlm_detail_t, filename), .dflt = "%A/%{Net.Src.IP}/detail" },
+	{ FR_CONF_OFFSET("format", rlm_detail_t, format),
+			 .func = cf_table_parse_int,
+			 .uctx = &(cf_table_parse_ctx_t){ .table = detail_format_table, .len = &detail_format_table_len },
+			 .dflt = "text" },
 	{ FR_CONF_OFFSET_FLAGS("header", CONF_FLAG_XLAT, rlm_detail_t, header), .dflt = "%t", .quote = T_DOUBLE_QUOTED_STRING },
 	{ FR_CONF_OFFSET("permissions", rlm_detail_t, perm), .dflt = "0600" },
 	{ FR_CONF_OFFSET_IS_SET("group", FR_TYPE_VOID, 0, rlm_detail_t, group), .func = detail_group_parse },
@@ -390,6 +409,104 @@ static int detail_write(FILE *out, rlm_detail_t const *inst, request_t *request,
 	return 0;
 }
 
+typedef struct {
+	rlm_detail_t const	*inst;
+	bool			compat;
+} detail_binary_filter_t;
+
+/** Skip attributes which shouldn't be written to binary detail records
+ *
+ * The source and destination addresses are carried in the record
+ * header, so Net.* is never written as attributes.
+ */
+static void *detail_binary_filter(fr_dlist_head_t *list, void *current, void *uctx)
+{
+	detail_binary_filter_t const	*filter = uctx;
+	fr_pair_t			*c = current;
+
+	while ((c = fr_dlist_next(list, c))) {
+		PAIR_VERIFY(c);
+
+		if (c->da == attr_net) continue;
+		if (filter->inst->ht && fr_hash_table_find(filter->inst->ht, c->da)) continue;
+		if (filter->compat && (c->da == attr_user_password)) continue;
+		break;
+	}
+
+	return c;
+}
+
+/** Write a single binary detail record to a file descriptor
+ *
+ * The whole record is built in memory, and written with one write(),
+ * so readers never see a partial record unless the write fails.
+ *
+ * @param[in] fd	Where to write entry.
+ * @param[in] inst	Instance of rlm_detail.
+ * @param[in] request	The current request.
+ * @param[in] packet	associated with the request (request, reply...).
+ * @param[in] list	of pairs to write.
+ * @param[in] compat	Write out entry in compatibility mode.
+ */
+static int detail_write_binary(int fd, rlm_detail_t const *inst, request_t *request,
+			       fr_radius_packet_t *packet, fr_pair_list_t *list, bool compat)
+{
+	fr_dbuff_t		*dbuff;
+	fr_dcursor_t		cursor;
+	fr_detail_binary_t	hdr;
+	detail_binary_filter_t	filter = { .inst = inst, .compat = compat };
+	ssize_t			slen;
+	uint8_t const		*p, *end;
+
+	if (fr_pair_list_empty(list)) {
+		RWDEBUG("Skipping empty packet");
+		return 0;
+	}
+
+	hdr = (fr_detail_binary_t) {
+		.timestamp = fr_time_to_unix_time(request->packet->timestamp),
+		.protocol = fr_dict_root(request->dict)->attr,
+		.code = packet->code,
+		.client_id = request->client ? fr_hash_string(request->client->shortname) : 0,
+		.src_ipaddr = request->packet->socket.inet.src_ipaddr,
+		.dst_ipaddr = request->packet->socket.inet.dst_ipaddr,
+		.src_port = request->packet->socket.inet.src_port,
+		.dst_port = request->packet->socket.inet.dst_port,
+	};
+
+	if (request->async && request->async->listen && request->async->listen->name) {
+		hdr.listener_id = fr_hash_string(request->async->listen->name);
+	}
+
+	FR_DBUFF_TALLOC_THREAD_LOCAL(&dbuff, 4096, 1024 * 1024);
+
+	fr_pair_dcursor_iter_init(&cursor, list, detail_binary_filter, &filter);
+	slen = fr_detail_binary_encode(dbuff, &hdr, &cursor);
+	if (slen <= 0) {
+		RPERROR("Failed encoding binary detail record");
+		return -1;
+	}
+
+	p = fr_dbuff_start(dbuff);
+	end = p + slen;
+
+	while (p < end) {
+		ssize_t rcode;
+
+		rcode = write(fd, p, end - p);
+		if (rcode < 0) {
+			if (errno == EINTR) continue;
+
+			RERROR("Failed writing to detail file: %s", fr_syserror(errno));
+			return -1;
+		}
+
+		p += rcode;
+	}
+
+	return 0;
+}
+
 /*
  *	Do detail, compatible with old accounting
  */
@@ -430,6 +547,17 @@ static unlang_action_t CC_HINT(nonnull) detail_do(rlm_rcode_t *p_result, module_
 		}
 	}
 
+	/*
+	 *	Binary records are written directly to the file
+	 *	descriptor, there's no need for stdio buffering.
+	 */
+	if (inst->format == DETAIL_FORMAT_BINARY) {
+		if (detail_write_binary(outfd, inst, request, packet, list, compat) < 0) goto fail;
+
+		exfile_close(inst->ef, outfd);
+		RETURN_MODULE_OK;
+	}
+
 	dupfd = dup(outfd);
 	if (dupfd < 0) {
 		RERROR("Failed to dup() file descriptor for detail file");
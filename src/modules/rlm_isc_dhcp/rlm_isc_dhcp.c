@@ -767,7 +767,7 @@ static uint32_t host_ether_hash(void const *data)
 {
 	isc_host_ether_t const *self = data;
 
-	return fr_hash(self->ether, sizeof(self->ether));
+	return fr_hash_fast(self->ether, sizeof(self->ether));
 }
 
 static int8_t host_ether_cmp(void const *one, void const *two)
@@ -789,7 +789,7 @@ static uint32_t host_uid_hash(void const *data)
 {
 	isc_host_uid_t const *self = data;
 
-	return fr_hash(self->client->vb_octets, self->client->vb_length);
+	return fr_hash_fast(self->client->vb_octets, self->client->vb_length);
 }
 
 static int8_t host_uid_cmp(void const *one, void const *two)
@@ -1475,7 +1475,7 @@ static int parse_host(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *info
 	 *	thousands of "host" entries in the parent->child list.
 	 */
 	if (!parent->hosts_by_ether) {
-		parent->hosts_by_ether = fr_hash_table_alloc(parent, host_ether_hash, host_ether_cmp, NULL);
+		parent->hosts_by_ether = fr_hash_table_open_alloc(parent, host_ether_hash, host_ether_cmp, NULL);
 		if (!parent->hosts_by_ether) {
 			return -1;
 		}
@@ -1492,7 +1492,7 @@ static int parse_host(rlm_isc_dhcp_tokenizer_t *state, rlm_isc_dhcp_info_t *info
 	 */
 	if (my_uid) {
 		if (!parent->hosts_by_uid) {
-			parent->hosts_by_uid = fr_hash_table_alloc(parent, host_uid_hash, host_uid_cmp, NULL);
+			parent->hosts_by_uid = fr_hash_table_open_alloc(parent, host_uid_hash, host_uid_cmp, NULL);
 			if (!parent->hosts_by_uid) {
 				return -1;
 			}
@@ -2183,10 +2183,10 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	fr_pair_list_init(&info->options);
 	info->last = &(info->child);
 
-	inst->hosts_by_ether = fr_hash_table_alloc(inst, host_ether_hash, host_ether_cmp, NULL);
+	inst->hosts_by_ether = fr_hash_table_open_alloc(inst, host_ether_hash, host_ether_cmp, NULL);
 	if (!inst->hosts_by_ether) return -1;
 
-	inst->hosts_by_uid = fr_hash_table_alloc(inst, host_uid_hash, host_uid_cmp, NULL);
+	inst->hosts_by_uid = fr_hash_table_open_alloc(inst, host_uid_hash, host_uid_cmp, NULL);
 	if (!inst->hosts_by_uid) return -1;
 
 	ret = read_file(inst, info, inst->filename);
@@ -32,6 +32,7 @@ USES_APPLE_DEPRECATED_API
 #ifdef KRB5_IS_THREAD_SAFE
 #  include <freeradius-devel/server/pool.h>
 #endif
+#include <freeradius-devel/unlang/offload.h>
 
 typedef struct {
 	krb5_context	context;
@@ -54,6 +55,9 @@ typedef struct {
 	rlm_krb5_handle_t	*conn;
 #endif
 
+	unlang_offload_pool_config_t	offload_config;
+	unlang_offload_pool_t	*offload;	//!< Helper threads which call libkrb5.
+
 	char const		*name;		//!< This module's instance name.
 	char const		*keytabname;	//!< The keytab to resolve the service in.
 	char const		*service_princ;	//!< The service name provided by the
@@ -33,9 +33,29 @@ RCSID("$Id$")
 #include <freeradius-devel/util/debug.h>
 #include "krb5.h"
 
+/** A kerberos authentication, run in an offload thread
+ *
+ * Talking to the KDC blocks, so the libkrb5 calls are made from a
+ * helper thread.  Everything they need is copied here, and the
+ * results are written back, to be logged when the request resumes.
+ */
+typedef struct {
+	rlm_krb5_t const	*inst;		//!< Module instance.
+
+	char const		*username;	//!< Copy of User-Name.
+	char const		*password;	//!< Copy of User-Password.
+
+	bool			no_connection;	//!< Couldn't get a handle from the pool.
+	bool			parse_failed;	//!< User-Name couldn't be parsed as a principal.
+	char			*princ_name;	//!< Unparsed client principal.
+	krb5_error_code		ret;		//!< Result of the last libkrb5 call.
+	char			*error;		//!< Error message for ret, or NULL.
+} rlm_krb5_job_t;
+
 static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET("keytab", rlm_krb5_t, keytabname) },
 	{ FR_CONF_OFFSET("service_principal", rlm_krb5_t, service_princ) },
+	{ FR_CONF_OFFSET_SUBSECTION("offload", 0, rlm_krb5_t, offload_config, unlang_offload_pool_config) },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -61,6 +81,12 @@ static int mod_detach(module_detach_ctx_t const *mctx)
 {
 	rlm_krb5_t *inst = talloc_get_type_abort(mctx->inst->data, rlm_krb5_t);
 
+	/*
+	 *	The offload threads use the handles and options
+	 *	freed below, so they must be stopped first.
+	 */
+	TALLOC_FREE(inst->offload);
+
 #ifndef HEIMDAL_KRB5
 	talloc_free(inst->vic_options);
 
@@ -227,85 +253,102 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 #else
 	inst->conn = krb5_mod_conn_create(inst, inst, fr_time_delta_wrap(0));
 	if (!inst->conn) return -1;
+
+	/*
+	 *	There's only one handle, and libkrb5 isn't thread
+	 *	safe, so only one thread may call it.
+	 */
+	if (inst->offload_config.threads != 1) {
+		WARN("libkrb5 is not threadsafe, forcing offload.threads = 1");
+		inst->offload_config.threads = 1;
+	}
 #endif
+
+	inst->offload = unlang_offload_pool_alloc(inst, mctx->inst->name, &inst->offload_config);
+	if (!inst->offload) {
+		cf_log_perr(mctx->inst->conf, "Failed starting kerberos threads");
+		return -1;
+	}
+
 	return 0;
 }
 
+/** Record the error from a libkrb5 call, so it can be logged when the request resumes
+ *
+ * @param[in] job	being processed.
+ * @param[in] context	Kerberos context the call was made with.
+ * @param[in] ret	code from kerberos.
+ */
+static void krb5_job_error(rlm_krb5_job_t *job, KRB5_UNUSED krb5_context context, krb5_error_code ret)
+{
+	char const *msg = rlm_krb5_error(job->inst, context, ret);
+
+	job->ret = ret;
+	if (msg) job->error = talloc_strdup(job, msg);
+}
+
 /** Common function for transforming a User-Name string into a principal.
  *
  * @param[out] client Where to write the client principal.
- * @param[in] inst of rlm_krb5.
- * @param[in] request Current request.
+ * @param[in] job being processed.
  * @param[in] context Kerberos context.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
  */
-static rlm_rcode_t krb5_parse_user(krb5_principal *client, KRB5_UNUSED rlm_krb5_t const *inst, request_t *request,
-				   krb5_context context)
+static int krb5_parse_user(krb5_principal *client, rlm_krb5_job_t *job, krb5_context context)
 {
 	krb5_error_code ret;
 	char *princ_name;
-	fr_pair_t *username;
-
-	username = fr_pair_find_by_da(&request->request_pairs, NULL, attr_user_name);
-
-	/*
-	 *	We can only authenticate user requests which HAVE
-	 *	a User-Name attribute.
-	 */
-	if (!username) {
-		REDEBUG("Attribute \"User-Name\" is required for authentication");
-		return RLM_MODULE_FAIL;
-	}
 
-	ret = krb5_parse_name(context, username->vp_strvalue, client);
+	ret = krb5_parse_name(context, job->username, client);
 	if (ret) {
-		REDEBUG("Failed parsing username as principal: %s", rlm_krb5_error(inst, context, ret));
-
-		return RLM_MODULE_FAIL;
+		krb5_job_error(job, context, ret);
+		job->parse_failed = true;
+		return -1;
 	}
 
-	krb5_unparse_name(context, *client, &princ_name);
-	RDEBUG2("Using client principal \"%s\"", princ_name);
+	if (krb5_unparse_name(context, *client, &princ_name) == 0) {
+		job->princ_name = talloc_strdup(job, princ_name);
 #ifdef HEIMDAL_KRB5
-	free(princ_name);
+		free(princ_name);
 #else
-	krb5_free_unparsed_name(context, princ_name);
+		krb5_free_unparsed_name(context, princ_name);
 #endif
-	return RLM_MODULE_OK;
+	}
+	return 0;
 }
 
 /** Log error message and return appropriate rcode
  *
  * Translate kerberos error codes into return codes.
- * @param inst of rlm_krb5.
  * @param request Current request.
- * @param ret code from kerberos.
- * @param conn used in the last operation.
+ * @param job which failed.
  */
-static rlm_rcode_t krb5_process_error(rlm_krb5_t const *inst, request_t *request, rlm_krb5_handle_t *conn, int ret)
+static rlm_rcode_t krb5_process_error(request_t *request, rlm_krb5_job_t const *job)
 {
-	fr_assert(ret != 0);
+	char const *error = job->error ? job->error : "Unknown error";
 
-	if (!fr_cond_assert(inst)) return RLM_MODULE_FAIL;
-	if (!fr_cond_assert(conn)) return RLM_MODULE_FAIL;	/* Silences warnings */
+	fr_assert(job->ret != 0);
 
-	switch (ret) {
+	switch (job->ret) {
 	case KRB5_LIBOS_BADPWDMATCH:
 	case KRB5KRB_AP_ERR_BAD_INTEGRITY:
-		REDEBUG("Provided password was incorrect (%i): %s", ret, rlm_krb5_error(inst, conn->context, ret));
+		REDEBUG("Provided password was incorrect (%i): %s", job->ret, error);
 		return RLM_MODULE_REJECT;
 
 	case KRB5KDC_ERR_KEY_EXP:
 	case KRB5KDC_ERR_CLIENT_REVOKED:
 	case KRB5KDC_ERR_SERVICE_REVOKED:
-		REDEBUG("Account has been locked out (%i): %s", ret, rlm_krb5_error(inst, conn->context, ret));
+		REDEBUG("Account has been locked out (%i): %s", job->ret, error);
 		return RLM_MODULE_DISALLOW;
 
 	case KRB5KDC_ERR_C_PRINCIPAL_UNKNOWN:
-		RDEBUG2("User not found (%i): %s", ret, rlm_krb5_error(inst, conn->context, ret));
+		RDEBUG2("User not found (%i): %s", job->ret, error);
 		return RLM_MODULE_NOTFOUND;
 
 	default:
-		REDEBUG("Error verifying credentials (%i): %s", ret, rlm_krb5_error(inst, conn->context, ret));
+		REDEBUG("Error verifying credentials (%i): %s", job->ret, error);
 		return RLM_MODULE_FAIL;
 	}
 }
@@ -314,56 +357,35 @@ static rlm_rcode_t krb5_process_error(rlm_krb5_t const *inst, request_t *request
 
 /*
  *	Validate user/pass (Heimdal)
+ *
+ *	Runs in an offload thread, so it MUST NOT access the request.
  */
-static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+static void krb5_auth(void *uctx)
 {
-	rlm_krb5_t const	*inst = talloc_get_type_abort_const(mctx->inst->data, rlm_krb5_t);
-	rlm_rcode_t		rcode;
+	rlm_krb5_job_t		*job = talloc_get_type_abort(uctx, rlm_krb5_job_t);
+	rlm_krb5_t const	*inst = job->inst;
 	krb5_error_code		ret;
 	rlm_krb5_handle_t	*conn;
 	krb5_principal		client = NULL;
-	fr_pair_t		*password;
-
-	password = fr_pair_find_by_da(&request->request_pairs, NULL, attr_user_password);
-
-	if (!password) {
-		REDEBUG("Attribute \"User-Password\" is required for authentication");
-		RETURN_MODULE_INVALID;
-	}
-
-	/*
-	 *	Make sure the supplied password isn't empty
-	 */
-	if (password->vp_length == 0) {
-		REDEBUG("User-Password must not be empty");
-		RETURN_MODULE_INVALID;
-	}
-
-	/*
-	 *	Log the password
-	 */
-	if (RDEBUG_ENABLED3) {
-		RDEBUG("Login attempt with password \"%pV\"", &password->data);
-	} else {
-		RDEBUG2("Login attempt with password");
-	}
 
 #  ifdef KRB5_IS_THREAD_SAFE
-	conn = fr_pool_connection_get(inst->pool, request);
-	if (!conn) RETURN_MODULE_FAIL;
+	conn = fr_pool_connection_get(inst->pool, NULL);
+	if (!conn) {
+		job->no_connection = true;
+		return;
+	}
 #  else
 	conn = inst->conn;
 #  endif
 
-	rcode = krb5_parse_user(&client, inst, request, conn->context);
-	if (rcode != RLM_MODULE_OK) goto cleanup;
+	if (krb5_parse_user(&client, job, conn->context) < 0) goto cleanup;
 
 	/*
 	 *	Verify the user, using the options we set in instantiate
 	 */
-	ret = krb5_verify_user_opt(conn->context, client, password->vp_strvalue, &conn->options);
+	ret = krb5_verify_user_opt(conn->context, client, job->password, &conn->options);
 	if (ret) {
-		rcode = krb5_process_error(inst, request, conn, ret);
+		krb5_job_error(job, conn->context, ret);
 		goto cleanup;
 	}
 
@@ -396,55 +418,34 @@ cleanup:
 	}
 
 #  ifdef KRB5_IS_THREAD_SAFE
-	fr_pool_connection_release(inst->pool, request, conn);
+	fr_pool_connection_release(inst->pool, NULL, conn);
 #  endif
-	RETURN_MODULE_RCODE(rcode);
 }
 
 #else  /* HEIMDAL_KRB5 */
 
 /*
  *  Validate userid/passwd (MIT)
+ *
+ *  Runs in an offload thread, so it MUST NOT access the request.
  */
-static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+static void krb5_auth(void *uctx)
 {
-	rlm_krb5_t const	*inst = talloc_get_type_abort_const(mctx->inst->data, rlm_krb5_t);
-	rlm_rcode_t		rcode;
+	rlm_krb5_job_t		*job = talloc_get_type_abort(uctx, rlm_krb5_job_t);
+	rlm_krb5_t const	*inst = job->inst;
 	krb5_error_code		ret;
 
 	rlm_krb5_handle_t	*conn;
 
 	krb5_principal		client = NULL;	/* actually a pointer value */
 	krb5_creds		init_creds;
-	fr_pair_t		*password;
-
-	password = fr_pair_find_by_da(&request->request_pairs, NULL, attr_user_password);
-
-	if (!password) {
-		REDEBUG("Attribute \"User-Password\" is required for authentication");
-		RETURN_MODULE_INVALID;
-	}
-
-	/*
-	 *	Make sure the supplied password isn't empty
-	 */
-	if (password->vp_length == 0) {
-		REDEBUG("User-Password must not be empty");
-		RETURN_MODULE_INVALID;
-	}
-
-	/*
-	 *	Log the password
-	 */
-	if (RDEBUG_ENABLED3) {
-		RDEBUG("Login attempt with password \"%pV\"", &password->data);
-	} else {
-		RDEBUG2("Login attempt with password");
-	}
 
 #  ifdef KRB5_IS_THREAD_SAFE
-	conn = fr_pool_connection_get(inst->pool, request);
-	if (!conn) RETURN_MODULE_FAIL;
+	conn = fr_pool_connection_get(inst->pool, NULL);
+	if (!conn) {
+		job->no_connection = true;
+		return;
+	}
 #  else
 	conn = inst->conn;
 #  endif
@@ -455,49 +456,125 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 	memset(&init_creds, 0, sizeof(init_creds));
 
 	/*
-	 *	Check we have all the required VPs, and convert the username
-	 *	into a principal.
+	 *	Convert the username into a principal.
 	 */
-	rcode = krb5_parse_user(&client, inst, request, conn->context);
-	if (rcode != RLM_MODULE_OK) goto cleanup;
+	if (krb5_parse_user(&client, job, conn->context) < 0) goto cleanup;
 
 	/*
 	 * 	Retrieve the TGT from the TGS/KDC and check we can decrypt it.
 	 */
-	RDEBUG2("Retrieving and decrypting TGT");
-	ret = krb5_get_init_creds_password(conn->context, &init_creds, client, UNCONST(char *, password->vp_strvalue),
+	ret = krb5_get_init_creds_password(conn->context, &init_creds, client, UNCONST(char *, job->password),
 					   NULL, NULL, 0, NULL, inst->gic_options);
 	if (ret) {
-		rcode = krb5_process_error(inst, request, conn, ret);
+		krb5_job_error(job, conn->context, ret);
 		goto cleanup;
 	}
 
-	RDEBUG2("Attempting to authenticate against service principal");
+	/*
+	 *	Authenticate against the service principal
+	 */
 	ret = krb5_verify_init_creds(conn->context, &init_creds, inst->server, conn->keytab, NULL, inst->vic_options);
-	if (ret) rcode = krb5_process_error(inst, request, conn, ret);
+	if (ret) krb5_job_error(job, conn->context, ret);
 
 cleanup:
 	if (client) krb5_free_principal(conn->context, client);
 	krb5_free_cred_contents(conn->context, &init_creds);
 
 #  ifdef KRB5_IS_THREAD_SAFE
-	fr_pool_connection_release(inst->pool, request, conn);
+	fr_pool_connection_release(inst->pool, NULL, conn);
 #  endif
-	RETURN_MODULE_RCODE(rcode);
 }
 
 #endif /* MIT_KRB5 */
 
+/** Log the result of the kerberos authentication, and return the rcode
+ *
+ */
+static unlang_action_t CC_HINT(nonnull) mod_authenticate_resume(rlm_rcode_t *p_result, module_ctx_t const *mctx,
+								request_t *request)
+{
+	rlm_krb5_job_t		*job = talloc_get_type_abort(mctx->rctx, rlm_krb5_job_t);
+	rlm_rcode_t		rcode = RLM_MODULE_OK;
+
+	if (job->no_connection) {
+		rcode = RLM_MODULE_FAIL;
+		goto finish;
+	}
+
+	if (job->parse_failed) {
+		REDEBUG("Failed parsing username as principal: %s", job->error ? job->error : "Unknown error");
+		rcode = RLM_MODULE_FAIL;
+		goto finish;
+	}
+
+	if (job->princ_name) RDEBUG2("Using client principal \"%s\"", job->princ_name);
+
+	if (job->ret) rcode = krb5_process_error(request, job);
+
+finish:
+	talloc_free(job);
+
+	RETURN_MODULE_RCODE(rcode);
+}
+
+static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_krb5_t const	*inst = talloc_get_type_abort_const(mctx->inst->data, rlm_krb5_t);
+	rlm_krb5_job_t		*job;
+	fr_pair_t		*username, *password;
+
+	username = fr_pair_find_by_da(&request->request_pairs, NULL, attr_user_name);
+
+	/*
+	 *	We can only authenticate user requests which HAVE
+	 *	a User-Name attribute.
+	 */
+	if (!username) {
+		REDEBUG("Attribute \"User-Name\" is required for authentication");
+		RETURN_MODULE_FAIL;
+	}
+
+	password = fr_pair_find_by_da(&request->request_pairs, NULL, attr_user_password);
+
+	if (!password) {
+		REDEBUG("Attribute \"User-Password\" is required for authentication");
+		RETURN_MODULE_INVALID;
+	}
+
+	/*
+	 *	Make sure the supplied password isn't empty
+	 */
+	if (password->vp_length == 0) {
+		REDEBUG("User-Password must not be empty");
+		RETURN_MODULE_INVALID;
+	}
+
+	/*
+	 *	Log the password
+	 */
+	if (RDEBUG_ENABLED3) {
+		RDEBUG("Login attempt with password \"%pV\"", &password->data);
+	} else {
+		RDEBUG2("Login attempt with password");
+	}
+
+	/*
+	 *	The libkrb5 calls are done in a helper thread, which
+	 *	may still be running after the request has been freed.
+	 */
+	MEM(job = talloc_zero(NULL, rlm_krb5_job_t));
+	job->inst = inst;
+	job->username = talloc_strdup(job, username->vp_strvalue);
+	job->password = talloc_strdup(job, password->vp_strvalue);
+
+	return unlang_offload_yield(p_result, request, inst->offload, krb5_auth, mod_authenticate_resume, job);
+}
+
 extern module_rlm_t rlm_krb5;
 module_rlm_t rlm_krb5 = {
 	.common = {
 		.magic		= MODULE_MAGIC_INIT,
 		.name		= "krb5",
-#ifdef KRB5_IS_THREAD_SAFE
-		.flags		= MODULE_TYPE_THREAD_SAFE,
-#else
-		.flags		= MODULE_TYPE_THREAD_UNSAFE,
-#endif
 		.inst_size	= sizeof(rlm_krb5_t),
 		.config		= module_config,
 		.instantiate	= mod_instantiate,
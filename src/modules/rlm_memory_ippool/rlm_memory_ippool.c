@@ -0,0 +1,1929 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_memory_ippool.c
+ * @brief IP Allocation module with an in-memory backend.
+ *
+ * Pools are held entirely in the memory of the server process, so
+ * allocations never leave the worker thread which asked for them.
+ *
+ * Each pool contains:
+ * - A bitmap of addresses which have never been leased.  These are
+ *   handed out first.
+ * - A heap of leases, ordered by expiry time.  When the bitmap is
+ *   exhausted, the lease which expired the longest time ago is re-used.
+ * - Hash tables mapping addresses and owners to leases.
+ *
+ * Every pool has its own mutex, so workers allocating from different
+ * pools never contend.
+ *
+ * Every change to a lease is appended to a journal before the
+ * result is returned to the caller.  When the journal grows past
+ * a configured size, the pools are copied into a snapshot buffer,
+ * and the journal is moved aside and replaced with an empty one.
+ * Both happen with the pools locked.  The snapshot is then written
+ * to disk without any locks held, and the old journal is removed.
+ * On startup the snapshot is loaded, and the old journal (if it's
+ * still there), and then the journal, are replayed on top of it.
+ *
+ * The allocate, update, release and bulk release semantics are the
+ * same as rlm_redis_ippool, so the two modules can be swapped without
+ * changing the virtual server configuration.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/server/module_rlm.h>
+
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/heap.h>
+#include <freeradius-devel/util/math.h>
+#include <freeradius-devel/util/nbo.h>
+#include <freeradius-devel/util/syserror.h>
+#include <freeradius-devel/util/uint128.h>
+
+#include <freeradius-devel/unlang/call_env.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "../rlm_redis_ippool/redis_ippool.h"
+
+#define IPPOOL_MAX_ADDRESSES		(1 << 24)	//!< Per pool, to bound the size of the bitmap.
+
+#define IPPOOL_JOURNAL_MAGIC		"FRij"
+#define IPPOOL_SNAPSHOT_MAGIC		"FRis"
+#define IPPOOL_FILE_HDR_LEN		8		//!< Magic + generation.
+#define IPPOOL_RECORD_HDR_LEN		48		//!< Fixed portion of a lease record.
+
+#define IPPOOL_RECORD_FLAG_BOUND	0x01		//!< The owner still holds the lease.
+
+typedef struct ippool_pool_s ippool_pool_t;
+
+/** A contiguous range of addresses within a pool
+ *
+ */
+typedef struct {
+	uint128_t		start;		//!< First address, in host byte order.
+	uint32_t		num;		//!< Number of addresses (or prefixes) in the range.
+	uint32_t		base;		//!< Index of the first address in the pool.
+	uint8_t			shift;		//!< Distance between addresses, as a power of two.
+} ippool_range_t;
+
+/** A lease on an address
+ *
+ * Leases are created the first time an address is allocated, and
+ * are never freed.  An address which has been released or which
+ * has expired stays in the heap, and is re-used in expiry order.
+ */
+typedef struct {
+	fr_heap_index_t		heap_id;	//!< Where we are in the expiry heap.
+	uint32_t		index;		//!< Of the address in the pool.
+	fr_unix_time_t		expires;	//!< When the lease expires.
+	uint64_t		counter;	//!< How many times this address has been bound.
+
+	char const		*owner;		//!< Last owner of the lease.
+	size_t			owner_len;
+	char const		*gateway;	//!< Gateway of the last owner.
+	size_t			gateway_len;
+
+	bool			bound;		//!< Whether the owner map points at this lease.
+} ippool_lease_t;
+
+/** An in-memory pool
+ *
+ */
+struct ippool_pool_s {
+	char const		*name;		//!< Of the pool.
+	size_t			name_len;
+
+	int			af;		//!< Address family of all addresses in the pool.
+	uint8_t			prefix;		//!< Prefix length of the allocated addresses.
+	char const		*range_id;	//!< Returned in range_attr, may be NULL.
+
+	ippool_range_t		*ranges;	//!< Sorted by start address.
+	uint32_t		num_ranges;
+	uint32_t		num_addresses;	//!< Total across all ranges.
+
+	pthread_mutex_t		mutex;		//!< Protects everything below.
+
+	uint64_t		*free;		//!< Bitmap of addresses which have never been leased.
+	uint32_t		free_hint;	//!< Word to start looking for free addresses in.
+	uint32_t		num_free;
+
+	fr_heap_t		*expiry;	//!< Leases ordered by expiry.
+	fr_hash_table_t		*by_index;	//!< Leases by address index.
+	fr_hash_table_t		*by_owner;	//!< Bound leases by owner.
+};
+
+/** rlm_memory_ippool module instance
+ *
+ */
+typedef struct {
+	char const		*journal;	//!< Path to the journal, NULL if leases aren't persisted.
+	size_t			snapshot_size;	//!< Journal size which triggers a snapshot.
+	bool			fsync;		//!< fsync() the journal after every write.
+
+	bool			copy_on_update; //!< Copy the address provided by ip_address to the
+						//!< allocated_address_attr if updates are successful.
+
+	ippool_pool_t		**pools;	//!< In configuration order.  Snapshots lock in this order.
+	uint32_t		num_pools;
+	fr_hash_table_t		*pools_by_name;	//!< Read only after instantiation.
+
+	char const		*snapshot_file;	//!< "<journal>.snapshot".
+	char const		*journal_old;	//!< "<journal>.old", the journal being merged into a snapshot.
+
+	pthread_mutex_t		journal_mutex;	//!< Serialises journal writes.  Always taken after a pool mutex.
+	pthread_mutex_t		snapshot_mutex;	//!< Only one snapshot at a time.
+	int			journal_fd;
+	size_t			journal_len;	//!< Current size of the journal.
+	uint32_t		generation;	//!< Of the current journal.
+	bool			snapshot_retry;	//!< The last snapshot wasn't written, try again.
+						///< Protected by journal_mutex.
+
+	uint8_t			*snapshot;	//!< Encoded snapshot which hasn't been written yet.
+						///< Protected by snapshot_mutex.
+} rlm_memory_ippool_t;
+
+static conf_parser_t module_config[] = {
+	{ FR_CONF_OFFSET_FLAGS("journal", CONF_FLAG_FILE_OUTPUT, rlm_memory_ippool_t, journal) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("snapshot_size", FR_TYPE_SIZE, 0, rlm_memory_ippool_t, snapshot_size), .dflt = "16M" },
+	{ FR_CONF_OFFSET("fsync", rlm_memory_ippool_t, fsync), .dflt = "no" },
+
+	{ FR_CONF_OFFSET("copy_on_update", rlm_memory_ippool_t, copy_on_update), .dflt = "yes", .quote = T_BARE_WORD },
+
+	CONF_PARSER_TERMINATOR
+};
+
+/** Call environment used when calling memory_ippool allocate method.
+ *
+ */
+typedef struct {
+	fr_value_box_t	pool_name;			//!< Name of the pool we're allocating IP addresses from.
+
+	fr_value_box_t	offer_time;			//!< How long we should reserve a lease for during
+							///< the pre-allocation stage (typically responding
+							///< to DHCP discover).
+
+	fr_value_box_t	lease_time;			//!< How long an IP address should be allocated for.
+
+	fr_value_box_t	owner;				//!< Unique lease owner identifier.  Could be mac-address
+							///< or a combination of User-Name and something
+							///< unique to the device.
+
+	fr_value_box_t	gateway_id;			//!< Gateway identifier, usually NAS-Identifier or
+							///< Option 82 gateway.  Used for bulk lease cleanups.
+
+	fr_value_box_t	requested_address;		//!< Attribute to read the IP for renewal from.
+
+	tmpl_t		*allocated_address_attr;	//!< Attribute to populate with allocated IP.
+
+	tmpl_t		*range_attr;			//!< Attribute to write the range ID to.
+
+	tmpl_t		*expiry_attr;			//!< Time at which the lease will expire.
+} memory_ippool_alloc_call_env_t;
+
+/** Call environment used when calling memory_ippool update method.
+ *
+ */
+typedef struct {
+	fr_value_box_t	pool_name;			//!< Name of the pool we're allocating IP addresses from.
+
+	fr_value_box_t	lease_time;			//!< How long an IP address should be allocated for.
+
+	fr_value_box_t	owner;				//!< Unique lease owner identifier.
+
+	fr_value_box_t	gateway_id;			//!< Gateway identifier, used for bulk lease cleanups.
+
+	fr_value_box_t	requested_address;		//!< Attribute to read the IP for renewal from.
+
+	tmpl_t		*allocated_address_attr;	//!< Attribute to populate with allocated IP.
+
+	tmpl_t		*range_attr;			//!< Attribute to write the range ID to.
+
+	tmpl_t		*expiry_attr;			//!< Time at which the lease will expire.
+} memory_ippool_update_call_env_t;
+
+/** Call environment used when calling memory_ippool release method.
+ *
+ */
+typedef struct {
+	fr_value_box_t	pool_name;			//!< Name of the pool we're allocating IP addresses from.
+
+	fr_value_box_t	owner;				//!< Unique lease owner identifier.
+
+	fr_value_box_t	gateway_id;			//!< Gateway identifier, used for bulk lease cleanups.
+
+	fr_value_box_t	requested_address;		//!< Attribute to read the IP for renewal from.
+} memory_ippool_release_call_env_t;
+
+/** Call environment used when calling memory_ippool bulk release method.
+ *
+ */
+typedef struct {
+	fr_value_box_t	pool_name;			//!< Name of the pool we're allocating IP addresses from.
+
+	fr_value_box_t	gateway_id;			//!< Gateway identifier, used for bulk lease cleanups.
+} memory_ippool_bulk_release_call_env_t;
+
+static const call_env_method_t memory_ippool_alloc_method_env = {
+	FR_CALL_ENV_METHOD_OUT(memory_ippool_alloc_call_env_t),
+	.env = (call_env_parser_t[]){
+		{ FR_CALL_ENV_OFFSET("pool_name", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT,
+				     memory_ippool_alloc_call_env_t, pool_name) },
+		{ FR_CALL_ENV_OFFSET("owner", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT,
+				     memory_ippool_alloc_call_env_t, owner) },
+		{ FR_CALL_ENV_OFFSET("gateway", FR_TYPE_STRING, CALL_ENV_FLAG_NULLABLE | CALL_ENV_FLAG_CONCAT,
+				      memory_ippool_alloc_call_env_t, gateway_id ), .pair.dflt = "", .pair.dflt_quote = T_SINGLE_QUOTED_STRING },
+		{ FR_CALL_ENV_OFFSET("offer_time", FR_TYPE_UINT32, CALL_ENV_FLAG_NONE, memory_ippool_alloc_call_env_t, offer_time ) },
+		{ FR_CALL_ENV_OFFSET("lease_time", FR_TYPE_UINT32, CALL_ENV_FLAG_REQUIRED, memory_ippool_alloc_call_env_t, lease_time) },
+		{ FR_CALL_ENV_OFFSET("requested_address", FR_TYPE_COMBO_IP_ADDR, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_NULLABLE, memory_ippool_alloc_call_env_t, requested_address ),
+				     .pair.dflt = "%{%{Requested-IP-Address} || %{Net.Src.IP}}", .pair.dflt_quote = T_DOUBLE_QUOTED_STRING },
+		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("allocated_address_attr", FR_TYPE_VOID, CALL_ENV_FLAG_ATTRIBUTE | CALL_ENV_FLAG_REQUIRED, memory_ippool_alloc_call_env_t, allocated_address_attr) },
+		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("range_attr", FR_TYPE_VOID, CALL_ENV_FLAG_ATTRIBUTE | CALL_ENV_FLAG_REQUIRED, memory_ippool_alloc_call_env_t, range_attr),
+					       .pair.dflt = "&reply.IP-Pool.Range", .pair.dflt_quote = T_BARE_WORD },
+		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("expiry_attr", FR_TYPE_VOID, CALL_ENV_FLAG_ATTRIBUTE, memory_ippool_alloc_call_env_t, expiry_attr) },
+		CALL_ENV_TERMINATOR
+	}
+};
+
+static const call_env_method_t memory_ippool_update_method_env = {
+	FR_CALL_ENV_METHOD_OUT(memory_ippool_update_call_env_t),
+	.env = (call_env_parser_t[]) {
+		{ FR_CALL_ENV_OFFSET("pool_name", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT, memory_ippool_update_call_env_t, pool_name) },
+		{ FR_CALL_ENV_OFFSET("owner", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT, memory_ippool_update_call_env_t, owner) },
+		{ FR_CALL_ENV_OFFSET("gateway", FR_TYPE_STRING, CALL_ENV_FLAG_NULLABLE | CALL_ENV_FLAG_CONCAT, memory_ippool_update_call_env_t, gateway_id),
+				     .pair.dflt = "", .pair.dflt_quote = T_SINGLE_QUOTED_STRING },
+		{ FR_CALL_ENV_OFFSET("lease_time", FR_TYPE_UINT32, CALL_ENV_FLAG_REQUIRED,  memory_ippool_update_call_env_t, lease_time) },
+		{ FR_CALL_ENV_OFFSET("requested_address", FR_TYPE_COMBO_IP_ADDR, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_NULLABLE, memory_ippool_update_call_env_t, requested_address),
+				     .pair.dflt = "%{%{Requested-IP-Address} || %{Net.Src.IP}}", .pair.dflt_quote = T_DOUBLE_QUOTED_STRING },
+		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("allocated_address_attr", FR_TYPE_VOID, CALL_ENV_FLAG_ATTRIBUTE | CALL_ENV_FLAG_REQUIRED, memory_ippool_update_call_env_t, allocated_address_attr) },
+		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("range_attr", FR_TYPE_VOID, CALL_ENV_FLAG_ATTRIBUTE | CALL_ENV_FLAG_REQUIRED, memory_ippool_update_call_env_t, range_attr),
+					       .pair.dflt = "&reply.IP-Pool.Range", .pair.dflt_quote = T_BARE_WORD },
+		{ FR_CALL_ENV_PARSE_ONLY_OFFSET("expiry_attr", FR_TYPE_VOID, CALL_ENV_FLAG_ATTRIBUTE, memory_ippool_update_call_env_t, expiry_attr) },
+		CALL_ENV_TERMINATOR
+	}
+};
+
+static const call_env_method_t memory_ippool_release_method_env = {
+	FR_CALL_ENV_METHOD_OUT(memory_ippool_release_call_env_t),
+	.env = (call_env_parser_t[]) {
+		{ FR_CALL_ENV_OFFSET("pool_name", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT, memory_ippool_release_call_env_t, pool_name) },
+		{ FR_CALL_ENV_OFFSET("owner", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT, memory_ippool_release_call_env_t, owner) },
+		{ FR_CALL_ENV_OFFSET("gateway", FR_TYPE_STRING, CALL_ENV_FLAG_NULLABLE | CALL_ENV_FLAG_CONCAT, memory_ippool_release_call_env_t, gateway_id),
+				     .pair.dflt = "", .pair.dflt_quote = T_SINGLE_QUOTED_STRING },
+		{ FR_CALL_ENV_OFFSET("requested_address", FR_TYPE_COMBO_IP_ADDR, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_NULLABLE, memory_ippool_release_call_env_t, requested_address),
+				     .pair.dflt = "%{%{Requested-IP-Address} || %{Net.Src.IP}}", .pair.dflt_quote = T_DOUBLE_QUOTED_STRING },
+		CALL_ENV_TERMINATOR
+	}
+};
+
+static const call_env_method_t memory_ippool_bulk_release_method_env = {
+	FR_CALL_ENV_METHOD_OUT(memory_ippool_bulk_release_call_env_t),
+	.env = (call_env_parser_t[]) {
+		{ FR_CALL_ENV_OFFSET("pool_name", FR_TYPE_STRING, CALL_ENV_FLAG_REQUIRED | CALL_ENV_FLAG_CONCAT, memory_ippool_bulk_release_call_env_t, pool_name) },
+		{ FR_CALL_ENV_OFFSET("gateway", FR_TYPE_STRING, CALL_ENV_FLAG_NULLABLE | CALL_ENV_FLAG_CONCAT, memory_ippool_bulk_release_call_env_t, gateway_id),
+				     .pair.dflt = "", .pair.dflt_quote = T_SINGLE_QUOTED_STRING },
+		CALL_ENV_TERMINATOR
+	}
+};
+
+/*
+ *	Conversions between addresses and 128bit integers in host byte order.
+ */
+static inline uint128_t ipaddr_to_uint128(fr_ipaddr_t const *ipaddr)
+{
+	uint128_t ip;
+
+	if (ipaddr->af == AF_INET) return uint128_new(0, ntohl(ipaddr->addr.v4.s_addr));
+
+	/* Don't be tempted to cast */
+	memcpy(&ip, ipaddr->addr.v6.s6_addr, sizeof(ip));
+	return ntohlll(ip);
+}
+
+static inline void uint128_to_ipaddr(fr_ipaddr_t *ipaddr, int af, uint8_t prefix, uint128_t ip)
+{
+	*ipaddr = (fr_ipaddr_t){ .af = af, .prefix = prefix };
+
+	if (af == AF_INET) {
+		ipaddr->addr.v4.s_addr = htonl((uint32_t)uint128_to_64(ip));
+		return;
+	}
+
+	ip = htonlll(ip);
+	memcpy(ipaddr->addr.v6.s6_addr, &ip, sizeof(ipaddr->addr.v6.s6_addr));
+}
+
+/** Parse a range in the same format as rlm_redis_ippool_tool
+ *
+ * Accepts @verbatim <start>-<end> @endverbatim, a subnet, or a single address.
+ * For IPv4 subnets the broadcast address is excluded.
+ *
+ * @param[in] ci	To log errors against.
+ * @param[out] start_out Where to write the start address.
+ * @param[out] end_out	Where to write the end address.
+ * @param[in] ip_str	Unparsed IP string.
+ * @param[in] prefix	length of prefixes we'll be allocating.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int ippool_range_parse(CONF_ITEM *ci, fr_ipaddr_t *start_out, fr_ipaddr_t *end_out,
+			      char const *ip_str, uint8_t prefix)
+{
+	fr_ipaddr_t	start, end;
+	uint128_t	ip, mask;
+	uint8_t		shift;
+	char const	*p;
+
+	p = strchr(ip_str, '-');
+	if (p) {
+		if (fr_inet_pton(&start, ip_str, p - ip_str, AF_UNSPEC, false, true) < 0) {
+			cf_log_perr(ci, "Failed parsing start address");
+			return -1;
+		}
+
+		if (fr_inet_pton(&end, p + 1, -1, AF_UNSPEC, false, true) < 0) {
+			cf_log_perr(ci, "Failed parsing end address");
+			return -1;
+		}
+
+		if (start.af != end.af) {
+			cf_log_err(ci, "Start and end address must be of the same address family");
+			return -1;
+		}
+
+		if (!prefix) prefix = IPADDR_LEN(start.af);
+		if (prefix > IPADDR_LEN(start.af)) {
+			cf_log_err(ci, "prefix_len must be less than or equal to address length (%u)",
+				   IPADDR_LEN(start.af));
+			return -1;
+		}
+
+		if (uint128_gt(ipaddr_to_uint128(&start), ipaddr_to_uint128(&end))) {
+			cf_log_err(ci, "End address must be greater than or equal to start address");
+			return -1;
+		}
+
+		/*
+		 *	Mask start and end so we can do prefix ranges too
+		 */
+		fr_ipaddr_mask(&start, prefix);
+		fr_ipaddr_mask(&end, prefix);
+		start.prefix = end.prefix = prefix;
+
+		*start_out = start;
+		*end_out = end;
+		return 0;
+	}
+
+	if (fr_inet_pton(&start, ip_str, -1, AF_UNSPEC, false, false) < 0) {
+		cf_log_perr(ci, "Failed parsing \"%s\" as IPv4/v6 subnet", ip_str);
+		return -1;
+	}
+
+	if (!prefix) prefix = IPADDR_LEN(start.af);
+	if (prefix < start.prefix) {
+		cf_log_err(ci, "prefix_len must be greater than or equal to /<mask> (%u)", start.prefix);
+		return -1;
+	}
+	if (prefix > IPADDR_LEN(start.af)) {
+		cf_log_err(ci, "prefix_len must be less than or equal to address length (%u)", IPADDR_LEN(start.af));
+		return -1;
+	}
+
+	end = start;
+
+	/*
+	 *	Generate a mask that covers the prefix bits, and
+	 *	sets them high.  Excluding the broadcast address
+	 *	only makes sense for IPv4 host addresses.
+	 */
+	if (prefix > start.prefix) {
+		ip = ipaddr_to_uint128(&start);
+		shift = IPADDR_LEN(start.af) - prefix;
+		mask = uint128_gen_mask(prefix - start.prefix);
+		ip = uint128_bor(ip, uint128_lshift(mask, shift));
+		if ((start.af == AF_INET) && (prefix == 32) && (start.prefix < 31)) ip = uint128_sub(ip, uint128_new(0, 1));
+		uint128_to_ipaddr(&end, start.af, prefix, ip);
+	}
+	start.prefix = end.prefix = prefix;
+
+	*start_out = start;
+	*end_out = end;
+	return 0;
+}
+
+static uint32_t pool_hash(void const *data)
+{
+	ippool_pool_t const *pool = data;
+
+	return fr_hash(pool->name, pool->name_len);
+}
+
+static int8_t pool_cmp(void const *one, void const *two)
+{
+	ippool_pool_t const *a = one, *b = two;
+	int ret;
+
+	ret = CMP(a->name_len, b->name_len);
+	if (ret != 0) return ret;
+
+	return CMP(memcmp(a->name, b->name, a->name_len), 0);
+}
+
+static uint32_t lease_index_hash(void const *data)
+{
+	ippool_lease_t const *lease = data;
+
+	return fr_hash(&lease->index, sizeof(lease->index));
+}
+
+static int8_t lease_index_cmp(void const *one, void const *two)
+{
+	ippool_lease_t const *a = one, *b = two;
+
+	return CMP(a->index, b->index);
+}
+
+static uint32_t lease_owner_hash(void const *data)
+{
+	ippool_lease_t const *lease = data;
+
+	return fr_hash(lease->owner, lease->owner_len);
+}
+
+static int8_t lease_owner_cmp(void const *one, void const *two)
+{
+	ippool_lease_t const *a = one, *b = two;
+	int ret;
+
+	ret = CMP(a->owner_len, b->owner_len);
+	if (ret != 0) return ret;
+
+	return CMP(memcmp(a->owner, b->owner, a->owner_len), 0);
+}
+
+static int8_t lease_expiry_cmp(void const *one, void const *two)
+{
+	ippool_lease_t const *a = one, *b = two;
+
+	return fr_unix_time_cmp(a->expires, b->expires);
+}
+
+/** Convert an address to its index in the pool
+ *
+ * @return
+ *	- true if the address is a member of the pool.
+ *	- false if it isn't.
+ */
+static bool pool_address_index(uint32_t *out, ippool_pool_t const *pool, fr_ipaddr_t const *ipaddr)
+{
+	fr_ipaddr_t	masked;
+	uint128_t	ip;
+	uint32_t	i;
+
+	if (ipaddr->af != pool->af) return false;
+
+	masked = *ipaddr;
+	fr_ipaddr_mask(&masked, pool->prefix);
+	ip = ipaddr_to_uint128(&masked);
+
+	for (i = 0; i < pool->num_ranges; i++) {
+		ippool_range_t const	*range = &pool->ranges[i];
+		uint128_t		offset, last;
+
+		if (uint128_gt(range->start, ip)) continue;
+
+		offset = uint128_sub(ip, range->start);
+		offset = uint128_rshift(offset, range->shift);
+		last = uint128_new(0, (range->num - 1));
+		if (uint128_gt(offset, last)) continue;
+
+		*out = range->base + (uint32_t)uint128_to_64(offset);
+		return true;
+	}
+
+	return false;
+}
+
+/** Convert an index in the pool back to an address
+ *
+ */
+static void pool_index_address(fr_ipaddr_t *out, ippool_pool_t const *pool, uint32_t index)
+{
+	uint32_t i;
+
+	for (i = pool->num_ranges; i > 0; i--) {
+		ippool_range_t const	*range = &pool->ranges[i - 1];
+		uint128_t		offset;
+
+		if (index < range->base) continue;
+
+		offset = uint128_new(0, (index - range->base));
+		offset = uint128_lshift(offset, range->shift);
+		uint128_to_ipaddr(out, pool->af, pool->prefix, uint128_add(range->start, offset));
+		return;
+	}
+
+	fr_assert(0);
+}
+
+/** Find the next address which has never been leased
+ *
+ * @return
+ *	- true, and the index of the address in out.
+ *	- false if there are no free addresses.
+ */
+static bool pool_free_pop(uint32_t *out, ippool_pool_t *pool)
+{
+	uint32_t	words = ROUND_UP_DIV(pool->num_addresses, 64);
+	uint32_t	i, word;
+
+	if (!pool->num_free) return false;
+
+	for (i = 0; i < words; i++) {
+		word = (pool->free_hint + i) % words;
+		if (!pool->free[word]) continue;
+
+		*out = (word * 64) + (fr_low_bit_pos(pool->free[word]) - 1);
+		pool->free[word] &= pool->free[word] - 1;
+		pool->free_hint = word;
+		pool->num_free--;
+		return true;
+	}
+
+	fr_assert(0);
+	return false;
+}
+
+static inline void pool_free_clear(ippool_pool_t *pool, uint32_t index)
+{
+	uint64_t bit = ((uint64_t)1) << (index % 64);
+
+	if (!(pool->free[index / 64] & bit)) return;
+
+	pool->free[index / 64] &= ~bit;
+	pool->num_free--;
+}
+
+/** Find the lease for an address, creating it if the address was never leased
+ *
+ */
+static ippool_lease_t *pool_lease_get(ippool_pool_t *pool, uint32_t index)
+{
+	ippool_lease_t	*lease;
+
+	lease = fr_hash_table_find(pool->by_index, &(ippool_lease_t){ .index = index });
+	if (lease) return lease;
+
+	MEM(lease = talloc_zero(pool, ippool_lease_t));
+	lease->index = index;
+
+	pool_free_clear(pool, index);
+
+	if (!fr_hash_table_insert(pool->by_index, lease) ||
+	    (fr_heap_insert(&pool->expiry, lease) < 0)) {
+		talloc_free(lease);
+		return NULL;
+	}
+
+	return lease;
+}
+
+/** Remove the mapping between a lease and its owner
+ *
+ */
+static inline void lease_unbind(ippool_pool_t *pool, ippool_lease_t *lease)
+{
+	if (!lease->bound) return;
+
+	fr_hash_table_remove(pool->by_owner, lease);
+	lease->bound = false;
+}
+
+static inline bool lease_str_eq(char const *a, size_t a_len, char const *b, size_t b_len)
+{
+	return (a_len == b_len) && ((a_len == 0) || (memcmp(a, b, a_len) == 0));
+}
+
+/** Set the owner of a lease, and when it expires
+ *
+ * @param[in] pool		the lease belongs to.
+ * @param[in] lease		to update.
+ * @param[in] owner		of the lease.
+ * @param[in] owner_len		length of the owner.
+ * @param[in] gateway		of the owner.
+ * @param[in] gateway_len	length of the gateway.
+ * @param[in] expires		when the lease expires.
+ * @param[in] bind		whether the owner should be mapped to the lease.
+ *				Leases loaded from the journal which had been
+ *				released are not bound.
+ */
+static void lease_set(ippool_pool_t *pool, ippool_lease_t *lease,
+		      char const *owner, size_t owner_len, char const *gateway, size_t gateway_len,
+		      fr_unix_time_t expires, bool bind)
+{
+	ippool_lease_t *old;
+
+	if (!lease_str_eq(lease->owner, lease->owner_len, owner, owner_len)) {
+		lease_unbind(pool, lease);
+
+		talloc_const_free(lease->owner);
+		MEM(lease->owner = talloc_bstrndup(lease, owner, owner_len));
+		lease->owner_len = owner_len;
+	}
+
+	if (!bind) {
+		lease_unbind(pool, lease);
+	} else if (!lease->bound) {
+		/*
+		 *	The owner may have been bound to a
+		 *	different address.
+		 */
+		old = fr_hash_table_find(pool->by_owner, lease);
+		if (old) lease_unbind(pool, old);
+
+		if (fr_hash_table_insert(pool->by_owner, lease)) lease->bound = true;
+	}
+
+	if (!lease_str_eq(lease->gateway, lease->gateway_len, gateway, gateway_len)) {
+		talloc_const_free(lease->gateway);
+		MEM(lease->gateway = talloc_bstrndup(lease, gateway, gateway_len));
+		lease->gateway_len = gateway_len;
+	}
+
+	fr_heap_extract(&pool->expiry, lease);
+	lease->expires = expires;
+	fr_heap_insert(&pool->expiry, lease);
+}
+
+/** Release a lease, making it the next candidate for re-use
+ *
+ */
+static void lease_release(ippool_pool_t *pool, ippool_lease_t *lease, fr_unix_time_t now)
+{
+	lease_unbind(pool, lease);
+
+	fr_heap_extract(&pool->expiry, lease);
+	lease->expires = now;
+	fr_heap_insert(&pool->expiry, lease);
+}
+
+static inline size_t lease_record_len(ippool_pool_t const *pool, ippool_lease_t const *lease)
+{
+	return IPPOOL_RECORD_HDR_LEN + pool->name_len + lease->owner_len + lease->gateway_len;
+}
+
+/** Encode a lease as a journal record
+ *
+ * @param[out] record	to write to.  Must be at least #lease_record_len bytes.
+ * @param[in] pool	the lease belongs to.
+ * @param[in] lease	to encode.
+ * @return the length of the record.
+ */
+static size_t lease_record_encode(uint8_t *record, ippool_pool_t const *pool, ippool_lease_t const *lease)
+{
+	fr_ipaddr_t	ipaddr;
+	size_t		len = lease_record_len(pool, lease);
+	uint8_t		*p;
+
+	pool_index_address(&ipaddr, pool, lease->index);
+
+	p = record + 4;
+	*p++ = lease->bound ? IPPOOL_RECORD_FLAG_BOUND : 0;
+	*p++ = (ipaddr.af == AF_INET6) ? 6 : 4;
+	*p++ = ipaddr.prefix;
+	*p++ = 0;
+	fr_nbo_from_uint16(p, pool->name_len);		p += 2;
+	fr_nbo_from_uint16(p, lease->owner_len);	p += 2;
+	fr_nbo_from_uint16(p, lease->gateway_len);	p += 2;
+	fr_nbo_from_uint16(p, 0);			p += 2;
+	fr_nbo_from_uint64(p, fr_unix_time_unwrap(lease->expires));	p += 8;
+	fr_nbo_from_uint64(p, lease->counter);		p += 8;
+	memset(p, 0, 16);
+	if (ipaddr.af == AF_INET) {
+		memcpy(p, &ipaddr.addr.v4.s_addr, 4);
+	} else {
+		memcpy(p, ipaddr.addr.v6.s6_addr, 16);
+	}
+	p += 16;
+
+	memcpy(p, pool->name, pool->name_len);		p += pool->name_len;
+	if (lease->owner_len) memcpy(p, lease->owner, lease->owner_len);
+	p += lease->owner_len;
+	if (lease->gateway_len) memcpy(p, lease->gateway, lease->gateway_len);
+
+	fr_nbo_from_uint32(record, fr_hash(record + 4, len - 4));
+
+	return len;
+}
+
+/** Apply a journal or snapshot record to the pools
+ *
+ * @return
+ *	- >0 the length of the record.
+ *	- 0 if more data is needed.
+ *	- <0 if the record is corrupt.
+ */
+static ssize_t lease_record_apply(rlm_memory_ippool_t *inst, uint8_t const *data, size_t data_len)
+{
+	uint8_t const	*p = data;
+	uint16_t	pool_len, owner_len, gateway_len;
+	size_t		len;
+	fr_ipaddr_t	ipaddr;
+	ippool_pool_t	*pool;
+	ippool_lease_t	*lease;
+	uint32_t	index;
+	uint8_t		flags;
+
+	if (data_len < IPPOOL_RECORD_HDR_LEN) return 0;
+
+	pool_len = fr_nbo_to_uint16(p + 8);
+	owner_len = fr_nbo_to_uint16(p + 10);
+	gateway_len = fr_nbo_to_uint16(p + 12);
+
+	len = IPPOOL_RECORD_HDR_LEN + pool_len + owner_len + gateway_len;
+	if (data_len < len) return 0;
+
+	if (fr_nbo_to_uint32(p) != fr_hash(p + 4, len - 4)) return -1;
+
+	flags = p[4];
+	ipaddr = (fr_ipaddr_t){ .prefix = p[6] };
+	switch (p[5]) {
+	case 4:
+		ipaddr.af = AF_INET;
+		memcpy(&ipaddr.addr.v4.s_addr, p + 32, 4);
+		break;
+
+	case 6:
+		ipaddr.af = AF_INET6;
+		memcpy(ipaddr.addr.v6.s6_addr, p + 32, 16);
+		break;
+
+	default:
+		return -1;
+	}
+
+	pool = fr_hash_table_find(inst->pools_by_name,
+				  &(ippool_pool_t){ .name = (char const *)p + IPPOOL_RECORD_HDR_LEN, .name_len = pool_len });
+	if (!pool) {
+		DEBUG2("Ignoring lease for unknown pool \"%pV\"",
+		       fr_box_strvalue_len((char const *)p + IPPOOL_RECORD_HDR_LEN, pool_len));
+		return len;
+	}
+
+	if (!pool_address_index(&index, pool, &ipaddr)) {
+		DEBUG2("Ignoring lease for %pV, which is no longer a member of pool \"%s\"",
+		       fr_box_ipaddr(ipaddr), pool->name);
+		return len;
+	}
+
+	lease = pool_lease_get(pool, index);
+	if (!lease) return -1;
+
+	p += IPPOOL_RECORD_HDR_LEN + pool_len;
+	lease_set(pool, lease, (char const *)p, owner_len, (char const *)p + owner_len, gateway_len,
+		  fr_unix_time_wrap(fr_nbo_to_uint64(data + 16)), (flags & IPPOOL_RECORD_FLAG_BOUND) != 0);
+	lease->counter = fr_nbo_to_uint64(data + 24);
+
+	return len;
+}
+
+/** Append the current state of a lease to the journal
+ *
+ * Must be called with the pool mutex held.
+ *
+ * The journal is opened with O_APPEND, so after a short write has
+ * been truncated away, or the journal has been replaced, the next
+ * record still goes at the end.
+ */
+static int journal_write(rlm_memory_ippool_t *inst, request_t *request, ippool_pool_t const *pool,
+			 ippool_lease_t const *lease)
+{
+	uint8_t		*record;
+	size_t		len;
+	ssize_t		slen;
+	int		ret = 0;
+
+	if (!inst->journal) return 0;
+
+	MEM(record = talloc_array(request, uint8_t, lease_record_len(pool, lease)));
+	len = lease_record_encode(record, pool, lease);
+
+	pthread_mutex_lock(&inst->journal_mutex);
+	slen = write(inst->journal_fd, record, len);
+	if (slen < 0) {
+		REDEBUG("Failed writing to journal %s: %s", inst->journal, fr_syserror(errno));
+		ret = -1;
+	} else if ((size_t)slen != len) {
+		/*
+		 *	Don't leave a partial record at the end of
+		 *	the journal, or subsequent records can't be read.
+		 */
+		REDEBUG("Short write to journal %s", inst->journal);
+		if (ftruncate(inst->journal_fd, inst->journal_len) < 0) {
+			REDEBUG("Failed truncating journal %s: %s", inst->journal, fr_syserror(errno));
+		}
+		ret = -1;
+	} else {
+		inst->journal_len += len;
+		if (inst->fsync && (fsync(inst->journal_fd) < 0)) {
+			REDEBUG("Failed syncing journal %s: %s", inst->journal, fr_syserror(errno));
+			ret = -1;
+		}
+	}
+	pthread_mutex_unlock(&inst->journal_mutex);
+
+	talloc_free(record);
+
+	return ret;
+}
+
+static int file_header_write(int fd, char const *magic, uint32_t generation)
+{
+	uint8_t hdr[IPPOOL_FILE_HDR_LEN];
+
+	memcpy(hdr, magic, 4);
+	fr_nbo_from_uint32(hdr + 4, generation);
+
+	return (write(fd, hdr, sizeof(hdr)) == sizeof(hdr)) ? 0 : -1;
+}
+
+/** Copy every lease into a snapshot buffer
+ *
+ * Must be called with all of the pool mutexes held, or before
+ * any workers have started.
+ */
+static uint8_t *snapshot_encode(TALLOC_CTX *ctx, rlm_memory_ippool_t const *inst, uint32_t generation)
+{
+	size_t		len = IPPOOL_FILE_HDR_LEN;
+	uint8_t		*data, *p;
+	uint32_t	i;
+
+	for (i = 0; i < inst->num_pools; i++) {
+		ippool_pool_t const	*pool = inst->pools[i];
+		ippool_lease_t		*lease;
+		fr_hash_iter_t		iter;
+
+		for (lease = fr_hash_table_iter_init(pool->by_index, &iter);
+		     lease;
+		     lease = fr_hash_table_iter_next(pool->by_index, &iter)) len += lease_record_len(pool, lease);
+	}
+
+	MEM(data = talloc_array(ctx, uint8_t, len));
+	memcpy(data, IPPOOL_SNAPSHOT_MAGIC, 4);
+	fr_nbo_from_uint32(data + 4, generation);
+	p = data + IPPOOL_FILE_HDR_LEN;
+
+	for (i = 0; i < inst->num_pools; i++) {
+		ippool_pool_t const	*pool = inst->pools[i];
+		ippool_lease_t		*lease;
+		fr_hash_iter_t		iter;
+
+		for (lease = fr_hash_table_iter_init(pool->by_index, &iter);
+		     lease;
+		     lease = fr_hash_table_iter_next(pool->by_index, &iter)) p += lease_record_encode(p, pool, lease);
+	}
+
+	return data;
+}
+
+/** Write an encoded snapshot to disk
+ *
+ * Does not need any locks.
+ */
+static int snapshot_file_write(rlm_memory_ippool_t const *inst, uint8_t const *data)
+{
+	char		*tmp;
+	size_t		len = talloc_array_length(data), done = 0;
+	ssize_t		slen;
+	int		fd, ret = -1;
+
+	tmp = talloc_asprintf(NULL, "%s.tmp", inst->snapshot_file);
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		ERROR("Failed opening snapshot %s: %s", tmp, fr_syserror(errno));
+		goto finish;
+	}
+
+	while (done < len) {
+		slen = write(fd, data + done, len - done);
+		if (slen < 0) {
+			if (errno == EINTR) continue;
+		write_error:
+			ERROR("Failed writing snapshot %s: %s", tmp, fr_syserror(errno));
+			close(fd);
+			unlink(tmp);
+			goto finish;
+		}
+		done += slen;
+	}
+
+	if (fsync(fd) < 0) goto write_error;
+	close(fd);
+
+	if (rename(tmp, inst->snapshot_file) < 0) {
+		ERROR("Failed renaming %s to %s: %s", tmp, inst->snapshot_file, fr_syserror(errno));
+		unlink(tmp);
+		goto finish;
+	}
+
+	ret = 0;
+
+finish:
+	talloc_free(tmp);
+
+	return ret;
+}
+
+/** Open a new, empty, journal
+ *
+ * @return
+ *	- The new journal fd.
+ *	- -1 on error.
+ */
+static int journal_create(rlm_memory_ippool_t const *inst, uint32_t generation)
+{
+	int fd;
+
+	fd = open(inst->journal, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		ERROR("Failed opening journal %s: %s", inst->journal, fr_syserror(errno));
+		return -1;
+	}
+
+	if (file_header_write(fd, IPPOOL_JOURNAL_MAGIC, generation) < 0) {
+		ERROR("Failed writing journal %s: %s", inst->journal, fr_syserror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/** Move the journal aside, and start a new one
+ *
+ * Must be called with the journal mutex held.
+ *
+ * The records in the old journal are all in the snapshot we're about
+ * to write.  Until that snapshot is on disk, the old journal is needed
+ * to rebuild the leases, so it's kept as "<journal>.old".
+ */
+static int journal_rotate(rlm_memory_ippool_t *inst, uint32_t generation)
+{
+	int fd;
+
+	if (rename(inst->journal, inst->journal_old) < 0) {
+		ERROR("Failed renaming %s to %s: %s", inst->journal, inst->journal_old, fr_syserror(errno));
+		return -1;
+	}
+
+	fd = journal_create(inst, generation);
+	if (fd < 0) {
+		if (rename(inst->journal_old, inst->journal) < 0) {
+			ERROR("Failed renaming %s to %s: %s", inst->journal_old, inst->journal, fr_syserror(errno));
+		}
+		return -1;
+	}
+
+	close(inst->journal_fd);
+	inst->journal_fd = fd;
+	inst->journal_len = IPPOOL_FILE_HDR_LEN;
+	inst->generation = generation;
+
+	return 0;
+}
+
+/** Write a snapshot of every pool, and start a new journal
+ *
+ * The pools are only locked while they're copied into a buffer, and
+ * the journal is swapped.  The snapshot is written after the locks
+ * have been released, so allocations carry on while we wait for the
+ * disk.
+ *
+ * The snapshot carries a generation number, which is also written to
+ * the start of the new journal.  The old journal has the previous
+ * generation, which is how we know whether it was merged into the
+ * snapshot, if the server stops before we get to remove it.
+ *
+ * If the snapshot can't be written, the buffer is kept, and written
+ * on the next call.  It has to be that buffer, and not a new one, as
+ * the current journal only makes sense on top of it.
+ */
+static int snapshot_write(rlm_memory_ippool_t *inst)
+{
+	uint32_t	i;
+
+	/*
+	 *	Someone else is already writing a snapshot.
+	 */
+	if (pthread_mutex_trylock(&inst->snapshot_mutex) != 0) return 0;
+
+	if (!inst->snapshot) {
+		uint8_t *data;
+
+		/*
+		 *	Lock order is always pool(s), then journal.
+		 */
+		for (i = 0; i < inst->num_pools; i++) pthread_mutex_lock(&inst->pools[i]->mutex);
+		pthread_mutex_lock(&inst->journal_mutex);
+
+		if (inst->journal_len < inst->snapshot_size) {
+			data = NULL;
+		} else {
+			data = snapshot_encode(inst, inst, inst->generation + 1);
+			if (journal_rotate(inst, inst->generation + 1) < 0) TALLOC_FREE(data);
+		}
+
+		pthread_mutex_unlock(&inst->journal_mutex);
+		for (i = inst->num_pools; i > 0; i--) pthread_mutex_unlock(&inst->pools[i - 1]->mutex);
+
+		if (!data) {
+			pthread_mutex_unlock(&inst->snapshot_mutex);
+			return 0;
+		}
+
+		inst->snapshot = data;
+	}
+
+	if (snapshot_file_write(inst, inst->snapshot) < 0) {
+		pthread_mutex_lock(&inst->journal_mutex);
+		inst->snapshot_retry = true;
+		pthread_mutex_unlock(&inst->journal_mutex);
+
+		pthread_mutex_unlock(&inst->snapshot_mutex);
+		return -1;
+	}
+
+	DEBUG2("Wrote snapshot %s, generation %u", inst->snapshot_file, fr_nbo_to_uint32(inst->snapshot + 4));
+	TALLOC_FREE(inst->snapshot);
+
+	pthread_mutex_lock(&inst->journal_mutex);
+	inst->snapshot_retry = false;
+	pthread_mutex_unlock(&inst->journal_mutex);
+
+	if ((unlink(inst->journal_old) < 0) && (errno != ENOENT)) {
+		ERROR("Failed removing %s: %s", inst->journal_old, fr_syserror(errno));
+	}
+
+	pthread_mutex_unlock(&inst->snapshot_mutex);
+
+	return 0;
+}
+
+/** Snapshot the pools if the journal has grown too large
+ *
+ * Must be called with no pool mutexes held.
+ */
+static inline void snapshot_check(rlm_memory_ippool_t *inst)
+{
+	size_t	len;
+	bool	retry;
+
+	if (!inst->journal) return;
+
+	pthread_mutex_lock(&inst->journal_mutex);
+	len = inst->journal_len;
+	retry = inst->snapshot_retry;
+	pthread_mutex_unlock(&inst->journal_mutex);
+
+	if (retry || (len >= inst->snapshot_size)) (void) snapshot_write(inst);
+}
+
+/** Load the records from a snapshot or journal file
+ *
+ * @param[in] inst		Module instance.
+ * @param[out] generation	The generation of the file.
+ * @param[out] valid_len	Length of the file, up to the end of the last valid record.
+ * @param[in] filename		To read.
+ * @param[in] magic		We expect at the start of the file.
+ * @param[in] expected		If not NULL, only apply records if the generation matches.
+ * @return
+ *	- 1 if the file doesn't exist.
+ *	- 0 on success.
+ *	- -1 on error.
+ */
+static int records_load(rlm_memory_ippool_t *inst, uint32_t *generation, size_t *valid_len,
+			char const *filename, char const *magic, uint32_t const *expected)
+{
+	uint8_t		*data = NULL;
+	size_t		len = 0, used = 0;
+	ssize_t		slen;
+	int		fd;
+
+	*valid_len = 0;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		if (errno == ENOENT) return 1;
+
+		ERROR("Failed opening %s: %s", filename, fr_syserror(errno));
+		return -1;
+	}
+
+	/*
+	 *	Read the whole file, the records are small, and
+	 *	we only do this once.
+	 */
+	for (;;) {
+		if ((len - used) < 65536) {
+			len += 65536;
+			MEM(data = talloc_realloc(NULL, data, uint8_t, len));
+		}
+
+		slen = read(fd, data + used, len - used);
+		if (slen < 0) {
+			if (errno == EINTR) continue;
+
+			ERROR("Failed reading %s: %s", filename, fr_syserror(errno));
+			close(fd);
+			talloc_free(data);
+			return -1;
+		}
+		if (slen == 0) break;
+
+		used += slen;
+	}
+	close(fd);
+
+	if (used == 0) {
+		talloc_free(data);
+		return 1;
+	}
+
+	if ((used < IPPOOL_FILE_HDR_LEN) || (memcmp(data, magic, 4) != 0)) {
+		ERROR("%s has an invalid header", filename);
+		talloc_free(data);
+		return -1;
+	}
+
+	*generation = fr_nbo_to_uint32(data + 4);
+	*valid_len = IPPOOL_FILE_HDR_LEN;
+
+	if (expected && (*generation != *expected)) {
+		DEBUG("Ignoring %s from generation %u, expected generation %u",
+		      filename, *generation, *expected);
+		talloc_free(data);
+		return 0;
+	}
+
+	while (*valid_len < used) {
+		slen = lease_record_apply(inst, data + *valid_len, used - *valid_len);
+		if (slen <= 0) {
+			WARN("%s has a %s record at offset %zu, ignoring the rest of the file",
+			     filename, (slen == 0) ? "truncated" : "corrupt", *valid_len);
+			break;
+		}
+		*valid_len += slen;
+	}
+
+	talloc_free(data);
+
+	return 0;
+}
+
+/** Restore leases from the snapshot and journal, and open the journal for writing
+ *
+ * If the server stopped part way through a snapshot, the old journal
+ * is still there.  If it has the same generation as the snapshot, the
+ * new snapshot was never written, so the old journal is replayed, then
+ * the current one.  Otherwise the new snapshot was written, and the
+ * old journal is already part of it.
+ *
+ * Either way, a new snapshot is then written before the old journal is
+ * removed.
+ */
+static int journal_open(rlm_memory_ippool_t *inst)
+{
+	uint32_t	snapshot_generation = 0, old_generation = 0, journal_generation = 0;
+	uint32_t	expected;
+	size_t		valid_len = 0;
+	uint8_t		*data;
+	int		ret, old_ret;
+
+	ret = records_load(inst, &snapshot_generation, &valid_len, inst->snapshot_file, IPPOOL_SNAPSHOT_MAGIC, NULL);
+	if (ret < 0) return -1;
+
+	expected = snapshot_generation;
+	old_ret = records_load(inst, &old_generation, &valid_len, inst->journal_old, IPPOOL_JOURNAL_MAGIC, &expected);
+	if (old_ret < 0) return -1;
+	if ((old_ret == 0) && (old_generation == snapshot_generation)) expected = snapshot_generation + 1;
+
+	ret = records_load(inst, &journal_generation, &valid_len, inst->journal, IPPOOL_JOURNAL_MAGIC, &expected);
+	if (ret < 0) return -1;
+
+	/*
+	 *	Nothing to tidy up, append to the existing journal.
+	 *
+	 *	New, stale, or damaged journal.  Drop anything we
+	 *	didn't apply, so new records are appended after the
+	 *	last good one.
+	 */
+	if (old_ret == 1) {
+		inst->generation = expected;
+		if ((ret == 1) || (journal_generation != expected)) valid_len = 0;
+
+		inst->journal_fd = open(inst->journal, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+		if (inst->journal_fd < 0) {
+			ERROR("Failed opening journal %s: %s", inst->journal, fr_syserror(errno));
+			return -1;
+		}
+
+		if (ftruncate(inst->journal_fd, valid_len) < 0) {
+			ERROR("Failed truncating journal %s: %s", inst->journal, fr_syserror(errno));
+			return -1;
+		}
+
+		if ((valid_len == 0) &&
+		    (file_header_write(inst->journal_fd, IPPOOL_JOURNAL_MAGIC, inst->generation) < 0)) {
+			ERROR("Failed writing journal %s: %s", inst->journal, fr_syserror(errno));
+			return -1;
+		}
+
+		inst->journal_len = valid_len ? valid_len : IPPOOL_FILE_HDR_LEN;
+		return 0;
+	}
+
+	/*
+	 *	Everything we've loaded goes into a new snapshot,
+	 *	with a generation newer than any of the files.  Until
+	 *	it's been renamed into place, the files on disk are
+	 *	left alone.
+	 */
+	inst->generation = expected + 1;
+	data = snapshot_encode(NULL, inst, inst->generation);
+	ret = snapshot_file_write(inst, data);
+	talloc_free(data);
+	if (ret < 0) return -1;
+
+	inst->journal_fd = journal_create(inst, inst->generation);
+	if (inst->journal_fd < 0) return -1;
+	inst->journal_len = IPPOOL_FILE_HDR_LEN;
+
+	if (unlink(inst->journal_old) < 0) {
+		ERROR("Failed removing %s: %s", inst->journal_old, fr_syserror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+static void ippool_action_print(request_t *request, ippool_action_t action,
+				fr_log_lvl_t lvl,
+				fr_value_box_t const *pool_name,
+				fr_value_box_t const *ip,
+				fr_value_box_t const *owner,
+				fr_value_box_t  const *gateway_id,
+				uint32_t expires)
+{
+	switch (action) {
+	case POOL_ACTION_ALLOCATE:
+		RDEBUGX(lvl, "Allocating lease from pool \"%pV\", to %pV, on %pV, expires in %us",
+			pool_name, owner, gateway_id, expires);
+		break;
+
+	case POOL_ACTION_UPDATE:
+		RDEBUGX(lvl, "Updating %pV in pool \"%pV\", device %pV, gateway %pV, expires in %us",
+			ip, pool_name, owner, gateway_id, expires);
+		break;
+
+	case POOL_ACTION_RELEASE:
+		RDEBUGX(lvl, "Releasing %pV leased by %pV to pool \"%pV\"", ip, owner, pool_name);
+		break;
+
+	case POOL_ACTION_BULK_RELEASE:
+		RDEBUGX(lvl, "Releasing leases in pool \"%pV\" for gateway %pV", pool_name, gateway_id);
+		break;
+	}
+}
+
+/** Write the results of an allocation or update to the request
+ *
+ */
+static int ippool_result_to_request(request_t *request, ippool_pool_t const *pool, ippool_lease_t const *lease,
+				    tmpl_t *allocated_address_attr, tmpl_t *range_attr,
+				    tmpl_t *expiry_attr, uint32_t lease_time)
+{
+	tmpl_t	rhs;
+	map_t	map = { .op = T_OP_SET, .rhs = &rhs };
+
+	if (allocated_address_attr) {
+		fr_ipaddr_t ipaddr;
+
+		pool_index_address(&ipaddr, pool, lease->index);
+
+		tmpl_init_shallow(&rhs, TMPL_TYPE_DATA, T_BARE_WORD, "", 0, NULL);
+		fr_value_box_ipaddr(&rhs.data.literal, NULL, &ipaddr, false);
+
+		map.lhs = allocated_address_attr;
+		if (map_to_request(request, &map, map_to_vp, NULL) < 0) return -1;
+	}
+
+	if (pool->range_id) {
+		tmpl_init_shallow(&rhs, TMPL_TYPE_DATA, T_DOUBLE_QUOTED_STRING, "", 0, NULL);
+		fr_value_box_strdup_shallow(&rhs.data.literal, NULL, pool->range_id, false);
+
+		map.lhs = range_attr;
+		if (map_to_request(request, &map, map_to_vp, NULL) < 0) return -1;
+	}
+
+	if (expiry_attr) {
+		tmpl_init_shallow(&rhs, TMPL_TYPE_DATA, T_DOUBLE_QUOTED_STRING, "", 0, NULL);
+		fr_value_box(&rhs.data.literal, lease_time, false);
+
+		map.lhs = expiry_attr;
+		if (map_to_request(request, &map, map_to_vp, NULL) < 0) return -1;
+	}
+
+	return 0;
+}
+
+#define FIND_POOL \
+	if (env->pool_name.vb_length > IPPOOL_MAX_KEY_PREFIX_SIZE) { \
+		REDEBUG("Pool name too long.  Expected %u bytes, got %zu bytes", \
+			IPPOOL_MAX_KEY_PREFIX_SIZE, env->pool_name.vb_length); \
+		RETURN_MODULE_FAIL; \
+	} \
+	if (env->pool_name.vb_length == 0) { \
+		RDEBUG2("Empty pool name.  Doing nothing"); \
+		RETURN_MODULE_NOOP; \
+	} \
+	pool = fr_hash_table_find(inst->pools_by_name, \
+				  &(ippool_pool_t){ .name = env->pool_name.vb_strvalue, \
+						    .name_len = env->pool_name.vb_length }); \
+	if (!pool) { \
+		REDEBUG("No pool named \"%pV\"", &env->pool_name); \
+		RETURN_MODULE_NOTFOUND; \
+	}
+
+static unlang_action_t CC_HINT(nonnull) mod_alloc(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_memory_ippool_t		*inst = talloc_get_type_abort(mctx->inst->data, rlm_memory_ippool_t);
+	memory_ippool_alloc_call_env_t	*env = talloc_get_type_abort(mctx->env_data, memory_ippool_alloc_call_env_t);
+	ippool_pool_t			*pool;
+	ippool_lease_t			*lease;
+	uint32_t			lease_time, index;
+	fr_unix_time_t			now;
+	ippool_rcode_t			ret = IPPOOL_RCODE_SUCCESS;
+
+	FIND_POOL
+
+	/*
+	 *	If offer_time is defined, it will be FR_TYPE_UINT32.
+	 *	Fall back to lease_time otherwise.
+	 */
+	lease_time = (env->offer_time.type == FR_TYPE_UINT32) ?
+			env->offer_time.vb_uint32 : env->lease_time.vb_uint32;
+	ippool_action_print(request, POOL_ACTION_ALLOCATE, L_DBG_LVL_2, &env->pool_name, NULL,
+			    &env->owner, &env->gateway_id, lease_time);
+
+	now = fr_time_to_unix_time(fr_time());
+
+	pthread_mutex_lock(&pool->mutex);
+
+	/*
+	 *	Re-use the owner's existing lease if it hasn't
+	 *	expired, then addresses which have never been
+	 *	leased, then the lease which expired the longest
+	 *	time ago.
+	 */
+	lease = fr_hash_table_find(pool->by_owner, &(ippool_lease_t){ .owner = env->owner.vb_strvalue,
+								     .owner_len = env->owner.vb_length });
+	if (!lease || fr_unix_time_lteq(lease->expires, now)) {
+		if (pool_free_pop(&index, pool)) {
+			lease = pool_lease_get(pool, index);
+		} else {
+			lease = fr_heap_peek(pool->expiry);
+			if (lease && fr_unix_time_gt(lease->expires, now)) lease = NULL;
+		}
+	}
+
+	if (!lease) {
+		ret = IPPOOL_RCODE_POOL_EMPTY;
+		goto finish;
+	}
+
+	lease_set(pool, lease, env->owner.vb_strvalue, env->owner.vb_length,
+		  env->gateway_id.vb_strvalue, env->gateway_id.vb_length,
+		  fr_unix_time_add(now, fr_time_delta_from_sec(lease_time)), true);
+	lease->counter++;
+
+	if ((journal_write(inst, request, pool, lease) < 0) ||
+	    (ippool_result_to_request(request, pool, lease, env->allocated_address_attr,
+				      env->range_attr, env->expiry_attr, lease_time) < 0)) ret = IPPOOL_RCODE_FAIL;
+
+finish:
+	pthread_mutex_unlock(&pool->mutex);
+
+	snapshot_check(inst);
+
+	switch (ret) {
+	case IPPOOL_RCODE_SUCCESS:
+		RDEBUG2("IP address lease allocated");
+		RETURN_MODULE_UPDATED;
+
+	case IPPOOL_RCODE_POOL_EMPTY:
+		RWDEBUG("Pool contains no free addresses");
+		RETURN_MODULE_NOTFOUND;
+
+	default:
+		RETURN_MODULE_FAIL;
+	}
+}
+
+static unlang_action_t CC_HINT(nonnull) mod_update(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_memory_ippool_t		*inst = talloc_get_type_abort(mctx->inst->data, rlm_memory_ippool_t);
+	memory_ippool_update_call_env_t	*env = talloc_get_type_abort(mctx->env_data, memory_ippool_update_call_env_t);
+	ippool_pool_t			*pool;
+	ippool_lease_t			*lease;
+	uint32_t			index;
+	fr_unix_time_t			now;
+	ippool_rcode_t			ret = IPPOOL_RCODE_SUCCESS;
+
+	FIND_POOL
+
+	ippool_action_print(request, POOL_ACTION_UPDATE, L_DBG_LVL_2, &env->pool_name,
+			    &env->requested_address, &env->owner, &env->gateway_id, env->lease_time.vb_uint32);
+
+	if (!pool_address_index(&index, pool, &env->requested_address.vb_ip)) {
+		ret = IPPOOL_RCODE_NOT_FOUND;
+		goto done;
+	}
+
+	now = fr_time_to_unix_time(fr_time());
+
+	pthread_mutex_lock(&pool->mutex);
+	lease = fr_hash_table_find(pool->by_index, &(ippool_lease_t){ .index = index });
+	if (!lease || !lease->bound || fr_unix_time_lteq(lease->expires, now)) {
+		ret = IPPOOL_RCODE_EXPIRED;
+		goto finish;
+	}
+
+	if (!lease_str_eq(lease->owner, lease->owner_len, env->owner.vb_strvalue, env->owner.vb_length)) {
+		ret = IPPOOL_RCODE_DEVICE_MISMATCH;
+		goto finish;
+	}
+
+	lease_set(pool, lease, env->owner.vb_strvalue, env->owner.vb_length,
+		  env->gateway_id.vb_strvalue, env->gateway_id.vb_length,
+		  fr_unix_time_add(now, fr_time_delta_from_sec(env->lease_time.vb_uint32)), true);
+
+	if ((journal_write(inst, request, pool, lease) < 0) ||
+	    (ippool_result_to_request(request, pool, lease,
+				      inst->copy_on_update ? env->allocated_address_attr : NULL,
+				      env->range_attr, env->expiry_attr, env->lease_time.vb_uint32) < 0)) {
+		ret = IPPOOL_RCODE_FAIL;
+	}
+
+finish:
+	pthread_mutex_unlock(&pool->mutex);
+
+	snapshot_check(inst);
+
+done:
+	switch (ret) {
+	case IPPOOL_RCODE_SUCCESS:
+		RDEBUG2("Requested IP address' \"%pV\" lease updated", &env->requested_address);
+		RETURN_MODULE_UPDATED;
+
+	/*
+	 *	It's useful to be able to identify the 'not found' case
+	 *	as we can relay to a server where the IP address might
+	 *	be found.  This extremely useful for migrations.
+	 */
+	case IPPOOL_RCODE_NOT_FOUND:
+		REDEBUG("Requested IP address \"%pV\" is not a member of the specified pool",
+			&env->requested_address);
+		RETURN_MODULE_NOTFOUND;
+
+	case IPPOOL_RCODE_EXPIRED:
+		REDEBUG("Requested IP address' \"%pV\" lease already expired at time of renewal",
+			&env->requested_address);
+		RETURN_MODULE_INVALID;
+
+	case IPPOOL_RCODE_DEVICE_MISMATCH:
+		REDEBUG("Requested IP address' \"%pV\" lease allocated to another device",
+			&env->requested_address);
+		RETURN_MODULE_INVALID;
+
+	default:
+		RETURN_MODULE_FAIL;
+	}
+}
+
+static unlang_action_t CC_HINT(nonnull) mod_release(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
+{
+	rlm_memory_ippool_t		*inst = talloc_get_type_abort(mctx->inst->data, rlm_memory_ippool_t);
+	memory_ippool_release_call_env_t *env = talloc_get_type_abort(mctx->env_data, memory_ippool_release_call_env_t);
+	ippool_pool_t			*pool;
+	ippool_lease_t			*lease;
+	uint32_t			index;
+	ippool_rcode_t			ret = IPPOOL_RCODE_SUCCESS;
+
+	FIND_POOL
+
+	ippool_action_print(request, POOL_ACTION_RELEASE, L_DBG_LVL_2, &env->pool_name,
+			    &env->requested_address, &env->owner, &env->gateway_id, 0);
+
+	if (!pool_address_index(&index, pool, &env->requested_address.vb_ip)) {
+		ret = IPPOOL_RCODE_NOT_FOUND;
+		goto done;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	lease = fr_hash_table_find(pool->by_index, &(ippool_lease_t){ .index = index });
+	if (!lease) {
+		ret = IPPOOL_RCODE_NOT_FOUND;
+		goto finish;
+	}
+
+	if (!lease->bound ||
+	    !lease_str_eq(lease->owner, lease->owner_len, env->owner.vb_strvalue, env->owner.vb_length)) {
+		ret = IPPOOL_RCODE_DEVICE_MISMATCH;
+		goto finish;
+	}
+
+	lease_release(pool, lease, fr_time_to_unix_time(fr_time()));
+	if (journal_write(inst, request, pool, lease) < 0) ret = IPPOOL_RCODE_FAIL;
+
+finish:
+	pthread_mutex_unlock(&pool->mutex);
+
+	snapshot_check(inst);
+
+done:
+	switch (ret) {
+	case IPPOOL_RCODE_SUCCESS:
+		RDEBUG2("IP address \"%pV\" released", &env->requested_address);
+		RETURN_MODULE_UPDATED;
+
+	/*
+	 *	It's useful to be able to identify the 'not found' case
+	 *	as we can relay to a server where the IP address might
+	 *	be found.  This extremely useful for migrations.
+	 */
+	case IPPOOL_RCODE_NOT_FOUND:
+		REDEBUG("Requested IP address \"%pV\" is not a member of the specified pool",
+			&env->requested_address);
+		RETURN_MODULE_NOTFOUND;
+
+	case IPPOOL_RCODE_DEVICE_MISMATCH:
+		REDEBUG("Requested IP address' \"%pV\" lease allocated to another device",
+			&env->requested_address);
+		RETURN_MODULE_INVALID;
+
+	default:
+		RETURN_MODULE_FAIL;
+	}
+}
+
+static unlang_action_t CC_HINT(nonnull) mod_bulk_release(rlm_rcode_t *p_result, module_ctx_t const *mctx,
+							 request_t *request)
+{
+	rlm_memory_ippool_t			*inst = talloc_get_type_abort(mctx->inst->data, rlm_memory_ippool_t);
+	memory_ippool_bulk_release_call_env_t	*env = talloc_get_type_abort(mctx->env_data,
+									     memory_ippool_bulk_release_call_env_t);
+	ippool_pool_t				*pool;
+	ippool_lease_t				*lease;
+	fr_heap_iter_t				iter;
+	fr_unix_time_t				now;
+	unsigned int				i, released = 0;
+	ippool_lease_t				**leases;
+	bool					failed = false;
+
+	FIND_POOL
+
+	ippool_action_print(request, POOL_ACTION_BULK_RELEASE, L_DBG_LVL_2, &env->pool_name,
+			    NULL, NULL, &env->gateway_id, 0);
+
+	if (env->gateway_id.vb_length == 0) {
+		RDEBUG2("Empty gateway.  Doing nothing");
+		RETURN_MODULE_NOOP;
+	}
+
+	now = fr_time_to_unix_time(fr_time());
+
+	pthread_mutex_lock(&pool->mutex);
+
+	/*
+	 *	Releasing a lease re-orders the heap, so collect
+	 *	the leases first.
+	 */
+	MEM(leases = talloc_array(request, ippool_lease_t *, fr_heap_num_elements(pool->expiry)));
+	for (lease = fr_heap_iter_init(pool->expiry, &iter);
+	     lease;
+	     lease = fr_heap_iter_next(pool->expiry, &iter)) {
+		if (!lease->bound ||
+		    !lease_str_eq(lease->gateway, lease->gateway_len,
+				  env->gateway_id.vb_strvalue, env->gateway_id.vb_length)) continue;
+
+		leases[released++] = lease;
+	}
+
+	for (i = 0; i < released; i++) {
+		lease_release(pool, leases[i], now);
+		if (journal_write(inst, request, pool, leases[i]) < 0) failed = true;
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+	talloc_free(leases);
+
+	snapshot_check(inst);
+
+	if (failed) RETURN_MODULE_FAIL;
+
+	if (!released) {
+		RDEBUG2("No leases found for gateway %pV", &env->gateway_id);
+		RETURN_MODULE_NOTFOUND;
+	}
+
+	RDEBUG2("Released %u lease(s)", released);
+	RETURN_MODULE_UPDATED;
+}
+
+static int _pool_free(ippool_pool_t *pool)
+{
+	pthread_mutex_destroy(&pool->mutex);
+
+	return 0;
+}
+
+/** Parse a pool section, and allocate the structures to track its leases
+ *
+ @verbatim
+ pool <name> {
+	range = <start>-<end> | <subnet> | <address>
+	...
+	prefix_len = <length>
+	range_id = <string>
+ }
+ @endverbatim
+ */
+static ippool_pool_t *pool_alloc(TALLOC_CTX *ctx, CONF_SECTION *cs)
+{
+	ippool_pool_t	*pool;
+	CONF_PAIR	*cp;
+	uint64_t	total = 0;
+	uint8_t		prefix = 0;
+	int		ret;
+
+	MEM(pool = talloc_zero(ctx, ippool_pool_t));
+	pool->name = cf_section_name2(cs);
+	if (!pool->name) {
+		cf_log_err(cs, "Pools must have a name");
+	error:
+		talloc_free(pool);
+		return NULL;
+	}
+	pool->name_len = strlen(pool->name);
+
+	cp = cf_pair_find(cs, "prefix_len");
+	if (cp) {
+		unsigned long	value;
+		char		*end;
+
+		value = strtoul(cf_pair_value(cp), &end, 10);
+		if (*end || (value == 0) || (value > 128)) {
+			cf_log_err(cp, "Invalid prefix_len \"%s\"", cf_pair_value(cp));
+			goto error;
+		}
+		prefix = value;
+	}
+
+	cp = cf_pair_find(cs, "range_id");
+	if (cp) pool->range_id = cf_pair_value(cp);
+
+	for (cp = cf_pair_find(cs, "range");
+	     cp;
+	     cp = cf_pair_find_next(cs, cp, "range")) {
+		fr_ipaddr_t	start, end;
+		ippool_range_t	*range;
+		uint128_t	num, max;
+
+		if (ippool_range_parse(cf_pair_to_item(cp), &start, &end, cf_pair_value(cp), prefix) < 0) goto error;
+
+		if (!pool->af) {
+			pool->af = start.af;
+			pool->prefix = start.prefix;
+		} else if ((pool->af != start.af) || (pool->prefix != start.prefix)) {
+			cf_log_err(cp, "All ranges in a pool must be the same address family and prefix length");
+			goto error;
+		}
+
+		MEM(pool->ranges = talloc_realloc(pool, pool->ranges, ippool_range_t, pool->num_ranges + 1));
+		range = &pool->ranges[pool->num_ranges++];
+
+		range->start = ipaddr_to_uint128(&start);
+		range->shift = IPADDR_LEN(start.af) - start.prefix;
+		num = uint128_sub(ipaddr_to_uint128(&end), range->start);
+		num = uint128_rshift(num, range->shift);
+		max = uint128_new(0, (IPPOOL_MAX_ADDRESSES - 1));
+
+		if (uint128_gt(num, max) ||
+		    ((total + uint128_to_64(num) + 1) > IPPOOL_MAX_ADDRESSES)) {
+			cf_log_err(cp, "Pool \"%s\" contains too many addresses, the maximum is %u",
+				   pool->name, IPPOOL_MAX_ADDRESSES);
+			goto error;
+		}
+		range->num = uint128_to_64(num) + 1;
+		range->base = total;
+		total += range->num;
+	}
+
+	if (!pool->num_ranges) {
+		cf_log_err(cs, "Pool \"%s\" must contain at least one 'range'", pool->name);
+		goto error;
+	}
+
+	pool->num_addresses = pool->num_free = total;
+
+	/*
+	 *	All addresses start off free.
+	 */
+	MEM(pool->free = talloc_array(pool, uint64_t, ROUND_UP_DIV(total, 64)));
+	memset(pool->free, 0xff, talloc_array_length(pool->free) * sizeof(uint64_t));
+	if (total % 64) pool->free[(total / 64)] = (((uint64_t)1) << (total % 64)) - 1;
+
+	pool->expiry = fr_heap_talloc_alloc(pool, lease_expiry_cmp, ippool_lease_t, heap_id, 0);
+	pool->by_index = fr_hash_table_alloc(pool, lease_index_hash, lease_index_cmp, NULL);
+	pool->by_owner = fr_hash_table_alloc(pool, lease_owner_hash, lease_owner_cmp, NULL);
+	if (!pool->expiry || !pool->by_index || !pool->by_owner) {
+		cf_log_err(cs, "Failed allocating structures for pool \"%s\"", pool->name);
+		goto error;
+	}
+
+	if ((ret = pthread_mutex_init(&pool->mutex, NULL)) != 0) {
+		cf_log_err(cs, "Failed initializing mutex: %s", fr_syserror(ret));
+		goto error;
+	}
+	talloc_set_destructor(pool, _pool_free);
+
+	cf_log_debug(cs, "Pool \"%s\" contains %u addresses in %u range(s)",
+		     pool->name, pool->num_addresses, pool->num_ranges);
+
+	return pool;
+}
+
+static int mod_detach(module_detach_ctx_t const *mctx)
+{
+	rlm_memory_ippool_t *inst = talloc_get_type_abort(mctx->inst->data, rlm_memory_ippool_t);
+
+	if (inst->journal_fd >= 0) close(inst->journal_fd);
+	TALLOC_FREE(inst->snapshot);
+
+	pthread_mutex_destroy(&inst->journal_mutex);
+	pthread_mutex_destroy(&inst->snapshot_mutex);
+
+	return 0;
+}
+
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	rlm_memory_ippool_t	*inst = talloc_get_type_abort(mctx->inst->data, rlm_memory_ippool_t);
+	CONF_SECTION		*conf = mctx->inst->conf;
+	CONF_SECTION		*cs;
+	int			ret;
+
+	inst->journal_fd = -1;
+
+	if ((ret = pthread_mutex_init(&inst->journal_mutex, NULL)) != 0) {
+		ERROR("Failed initializing mutex: %s", fr_syserror(ret));
+		return -1;
+	}
+
+	if ((ret = pthread_mutex_init(&inst->snapshot_mutex, NULL)) != 0) {
+		ERROR("Failed initializing mutex: %s", fr_syserror(ret));
+		return -1;
+	}
+
+	inst->pools_by_name = fr_hash_table_alloc(inst, pool_hash, pool_cmp, NULL);
+	if (!inst->pools_by_name) {
+		ERROR("Failed to create pool table");
+		return -1;
+	}
+
+	for (cs = cf_section_find(conf, "pool", CF_IDENT_ANY);
+	     cs;
+	     cs = cf_section_find_next(conf, cs, "pool", CF_IDENT_ANY)) {
+		ippool_pool_t *pool;
+
+		pool = pool_alloc(inst, cs);
+		if (!pool) return -1;
+
+		if (!fr_hash_table_insert(inst->pools_by_name, pool)) {
+			cf_log_err(cs, "Duplicate pool \"%s\"", pool->name);
+			return -1;
+		}
+
+		MEM(inst->pools = talloc_realloc(inst, inst->pools, ippool_pool_t *, inst->num_pools + 1));
+		inst->pools[inst->num_pools++] = pool;
+	}
+
+	if (!inst->num_pools) {
+		cf_log_err(conf, "At least one 'pool' section must be defined");
+		return -1;
+	}
+
+	if (!inst->journal) {
+		WARN("No journal configured, leases will be lost when the server restarts");
+		return 0;
+	}
+
+	inst->snapshot_file = talloc_asprintf(inst, "%s.snapshot", inst->journal);
+	inst->journal_old = talloc_asprintf(inst, "%s.old", inst->journal);
+
+	return journal_open(inst);
+}
+
+extern module_rlm_t rlm_memory_ippool;
+module_rlm_t rlm_memory_ippool = {
+	.common = {
+		.magic		= MODULE_MAGIC_INIT,
+		.name		= "memory_ippool",
+		.flags		= MODULE_TYPE_THREAD_SAFE,
+		.inst_size	= sizeof(rlm_memory_ippool_t),
+		.config		= module_config,
+		.instantiate	= mod_instantiate,
+		.detach		= mod_detach
+	},
+	.method_names = (module_method_name_t[]){
+		/*
+		 *	RADIUS specific
+		 */
+		{ .name1 = "recv",		.name2 = "access-request",	.method = mod_alloc,
+		  .method_env = &memory_ippool_alloc_method_env },
+		{ .name1 = "accounting",	.name2 = "start",		.method = mod_update,
+		  .method_env = &memory_ippool_update_method_env },
+		{ .name1 = "accounting",	.name2 = "alive",		.method = mod_update,
+		  .method_env = &memory_ippool_update_method_env },
+		{ .name1 = "accounting",	.name2 = "stop",		.method = mod_release,
+		  .method_env = &memory_ippool_release_method_env },
+		{ .name1 = "accounting",	.name2 = "accounting-on",	.method = mod_bulk_release,
+		  .method_env = &memory_ippool_bulk_release_method_env },
+		{ .name1 = "accounting",	.name2 = "accounting-off",	.method = mod_bulk_release,
+		  .method_env = &memory_ippool_bulk_release_method_env },
+
+		/*
+		 *	DHCPv4
+		 */
+		{ .name1 = "recv",		.name2 = "discover",		.method = mod_alloc,
+		  .method_env = &memory_ippool_alloc_method_env },
+		{ .name1 = "recv",		.name2 = "release",		.method = mod_release,
+		  .method_env = &memory_ippool_release_method_env },
+		{ .name1 = "send",		.name2 = "ack",			.method = mod_update,
+		  .method_env = &memory_ippool_update_method_env },
+
+		/*
+		 *	DHCPv6
+		 */
+		{ .name1 = "recv",		.name2 = "solicit",		.method = mod_alloc,
+		  .method_env = &memory_ippool_alloc_method_env },
+
+		/*
+		 *	Generic
+		 */
+		{ .name1 = "recv",		.name2 = CF_IDENT_ANY,		.method = mod_update,
+		  .method_env = &memory_ippool_update_method_env },
+		{ .name1 = "send",		.name2 = CF_IDENT_ANY,		.method = mod_alloc,
+		  .method_env = &memory_ippool_alloc_method_env },
+
+		/*
+		 *	Named methods matching module operations
+		 */
+		{ .name1 = "allocate",		.name2 = CF_IDENT_ANY,		.method = mod_alloc,
+		  .method_env = &memory_ippool_alloc_method_env },
+		{ .name1 = "update",		.name2 = CF_IDENT_ANY,		.method = mod_update,
+		  .method_env = &memory_ippool_update_method_env },
+		{ .name1 = "renew",		.name2 = CF_IDENT_ANY,		.method = mod_update,
+		  .method_env = &memory_ippool_update_method_env },
+		{ .name1 = "release",		.name2 = CF_IDENT_ANY,		.method = mod_release,
+		  .method_env = &memory_ippool_release_method_env },
+		{ .name1 = "bulk-release",	.name2 = CF_IDENT_ANY,		.method = mod_bulk_release,
+		  .method_env = &memory_ippool_bulk_release_method_env },
+
+		MODULE_NAME_TERMINATOR
+	}
+};
@@ -0,0 +1,610 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file ntlm_helper.c
+ * @brief Persistent ntlm_auth helpers, speaking the ntlm-server-1 protocol
+ *
+ * Running ntlm_auth once per authentication means a fork and exec of
+ * a large binary for every MS-CHAP request.  Instead, each worker
+ * thread keeps a small number of long running
+ * `ntlm_auth --helper-protocol=ntlm-server-1` processes, and writes
+ * authentication requests to their stdin.
+ *
+ * The helpers answer requests in the order they were written, so a
+ * helper can have several requests outstanding.  Responses are read
+ * from the event loop, and matched to the oldest outstanding request.
+ *
+ * Helpers which exit, or which stop responding, are restarted.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#define LOG_PREFIX pool->name
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/server/exec.h>
+#include <freeradius-devel/unlang/interpret.h>
+#include <freeradius-devel/util/base16.h>
+#include <freeradius-devel/util/base64.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "mschap.h"
+#include "ntlm_helper.h"
+
+#define NTLM_HELPER_MAX_ARGV		(64)
+#define NTLM_HELPER_RESTART_DELAY	fr_time_delta_from_sec(1)
+
+/** One ntlm_auth coprocess
+ *
+ */
+struct mschap_ntlm_helper_s {
+	mschap_ntlm_helper_pool_t	*pool;			//!< Pool this helper belongs to.
+	unsigned int			id;			//!< Index of the helper in the pool.
+
+	pid_t				pid;			//!< PID of the helper, or -1.
+	int				stdin_fd;		//!< We write requests to this.
+	int				stdout_fd;		//!< We read responses from this.
+	bool				running;		//!< The helper has been started, and hasn't failed.
+
+	fr_event_pid_t const		*ev_pid;		//!< Notifies us if the helper exits.
+	fr_event_timer_t const		*ev_restart;		//!< Restarts a failed helper.
+
+	fr_dlist_head_t			outstanding;		//!< Requests written, and not yet answered,
+								///< oldest first.
+
+	size_t				used;			//!< How much of buff contains data.
+	char				buff[4096];		//!< Partial lines read from the helper.
+};
+
+/** The ntlm_auth helpers for one worker thread
+ *
+ */
+struct mschap_ntlm_helper_pool_s {
+	char const			*name;			//!< Module instance name, for logging.
+	fr_event_list_t			*el;			//!< Event list of the worker.
+	char				**argv;			//!< Program and arguments.
+
+	uint32_t			num;			//!< Number of helpers.
+	mschap_ntlm_helper_t		**helpers;		//!< Array of helpers.
+};
+
+static int helper_start(mschap_ntlm_helper_t *helper);
+
+/** Close the helper's pipes, and make sure the process is reaped
+ *
+ */
+static void helper_stop(mschap_ntlm_helper_t *helper, int signal)
+{
+	mschap_ntlm_helper_pool_t	*pool = helper->pool;
+
+	helper->running = false;
+	helper->used = 0;
+
+	if (helper->stdout_fd >= 0) {
+		if (fr_event_fd_delete(pool->el, helper->stdout_fd, FR_EVENT_FILTER_IO) < 0) {
+			PERROR("Failed removing ntlm_auth helper %u handler", helper->id);
+		}
+		close(helper->stdout_fd);
+		helper->stdout_fd = -1;
+	}
+
+	if (helper->stdin_fd >= 0) {
+		close(helper->stdin_fd);
+		helper->stdin_fd = -1;
+	}
+
+	/*
+	 *	Remove the EV_PROC event, the reaper below
+	 *	takes over.
+	 */
+	if (helper->ev_pid) talloc_const_free(helper->ev_pid);
+
+	if (helper->pid > 0) {
+		if (signal > 0) kill(helper->pid, signal);
+
+		if (unlikely(fr_event_pid_reap(pool->el, helper->pid, NULL, NULL) < 0)) {
+			int status;
+
+			PERROR("Failed setting up async PID reaper, PID %u may now be a zombie", helper->pid);
+			(void) waitpid(helper->pid, &status, WNOHANG);
+		}
+		helper->pid = -1;
+	}
+}
+
+/** Restart a helper after it failed
+ *
+ */
+static void _helper_restart(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	mschap_ntlm_helper_t		*helper = talloc_get_type_abort(uctx, mschap_ntlm_helper_t);
+	mschap_ntlm_helper_pool_t	*pool = helper->pool;
+
+	if (helper_start(helper) < 0) {
+		if (fr_event_timer_in(helper, pool->el, &helper->ev_restart,
+				      NTLM_HELPER_RESTART_DELAY, _helper_restart, helper) < 0) {
+			PERROR("Failed scheduling restart of ntlm_auth helper %u", helper->id);
+		}
+	}
+}
+
+/** Fail every request outstanding on the helper, and schedule a restart
+ *
+ * Requests which are still waiting are resumed, with the reason the
+ * helper failed as their error.
+ */
+static void helper_fail(mschap_ntlm_helper_t *helper, char const *why)
+{
+	mschap_ntlm_helper_pool_t	*pool = helper->pool;
+	mschap_ntlm_helper_request_t	*hreq;
+
+	if (!helper->running) return;
+
+	ERROR("ntlm_auth helper %u failed: %s", helper->id, why);
+
+	helper_stop(helper, SIGTERM);
+
+	while ((hreq = fr_dlist_pop_head(&helper->outstanding))) {
+		hreq->helper = NULL;
+
+		if (!hreq->request) {
+			talloc_free(hreq);
+			continue;
+		}
+
+		hreq->authenticated = false;
+		hreq->have_key = false;
+		talloc_free(hreq->error);
+		MEM(hreq->error = talloc_strdup(hreq, why));
+
+		unlang_interpret_mark_runnable(hreq->request);
+	}
+
+	if (fr_event_timer_in(helper, pool->el, &helper->ev_restart,
+			      NTLM_HELPER_RESTART_DELAY, _helper_restart, helper) < 0) {
+		PERROR("Failed scheduling restart of ntlm_auth helper %u", helper->id);
+	}
+}
+
+/** The helper exited
+ *
+ */
+static void _helper_exited(UNUSED fr_event_list_t *el, pid_t pid, int status, void *uctx)
+{
+	mschap_ntlm_helper_t		*helper = talloc_get_type_abort(uctx, mschap_ntlm_helper_t);
+	mschap_ntlm_helper_pool_t	*pool = helper->pool;
+
+	fr_assert(helper->pid == pid);
+
+	/*
+	 *	Already reaped, and the event has been freed.
+	 */
+	helper->pid = -1;
+	helper->ev_pid = NULL;
+
+	if (WIFEXITED(status)) {
+		DEBUG2("ntlm_auth helper %u (pid %u) exited with status %d", helper->id, pid, WEXITSTATUS(status));
+	} else if (WIFSIGNALED(status)) {
+		DEBUG2("ntlm_auth helper %u (pid %u) killed by signal %d", helper->id, pid, WTERMSIG(status));
+	}
+
+	helper_fail(helper, "ntlm_auth helper exited");
+}
+
+/** Process one line of a response
+ *
+ */
+static void helper_line(mschap_ntlm_helper_t *helper, char *line)
+{
+	mschap_ntlm_helper_pool_t	*pool = helper->pool;
+	mschap_ntlm_helper_request_t	*hreq;
+	char const			*p;
+
+	hreq = fr_dlist_head(&helper->outstanding);
+	if (!hreq) {
+		WARN("Ignoring unexpected output from ntlm_auth helper %u: %s", helper->id, line);
+		return;
+	}
+
+	/*
+	 *	End of the response
+	 */
+	if (strcmp(line, ".") == 0) {
+		fr_dlist_remove(&helper->outstanding, hreq);
+		hreq->helper = NULL;
+
+		if (!hreq->request) {
+			talloc_free(hreq);
+			return;
+		}
+
+		unlang_interpret_mark_runnable(hreq->request);
+		return;
+	}
+
+	if (strcmp(line, "Authenticated: Yes") == 0) {
+		hreq->authenticated = true;
+		return;
+	}
+
+	if (strcmp(line, "Authenticated: No") == 0) {
+		hreq->authenticated = false;
+		return;
+	}
+
+	if (strncmp(line, "User-Session-Key: ", 18) == 0) {
+		p = line + 18;
+
+		if (fr_base16_decode(NULL, &FR_DBUFF_TMP(hreq->nthashhash, sizeof(hreq->nthashhash)),
+				     &FR_SBUFF_IN(p, strlen(p)), false) == sizeof(hreq->nthashhash)) {
+			hreq->have_key = true;
+		}
+		return;
+	}
+
+	if (strncmp(line, "Authentication-Error: ", 22) == 0) {
+		p = line + 22;
+		goto error;
+	}
+
+	if (strncmp(line, "Error: ", 7) == 0) {
+		p = line + 7;
+
+	error:
+		talloc_free(hreq->error);
+		MEM(hreq->error = talloc_strdup(hreq, p));
+		return;
+	}
+
+	/*
+	 *	Other keys (LANMAN-Session-Key etc.) aren't used.
+	 */
+}
+
+/** Read responses from the helper
+ *
+ */
+static void _helper_read(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	mschap_ntlm_helper_t	*helper = talloc_get_type_abort(uctx, mschap_ntlm_helper_t);
+	ssize_t			slen;
+	char			*start, *nl, *end;
+
+	slen = read(helper->stdout_fd, helper->buff + helper->used, sizeof(helper->buff) - helper->used);
+	if (slen == 0) {
+		helper_fail(helper, "ntlm_auth helper closed its output");
+		return;
+	}
+
+	if (slen < 0) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) return;
+
+		helper_fail(helper, fr_syserror(errno));
+		return;
+	}
+
+	helper->used += slen;
+	start = helper->buff;
+	end = helper->buff + helper->used;
+
+	while ((nl = memchr(start, '\n', end - start))) {
+		*nl = '\0';
+		helper_line(helper, start);
+		start = nl + 1;
+	}
+
+	/*
+	 *	Keep any partial line for the next read.
+	 */
+	helper->used = end - start;
+	if (helper->used == sizeof(helper->buff)) {
+		helper_fail(helper, "Response line from ntlm_auth helper is too long");
+		return;
+	}
+	if (helper->used && (start != helper->buff)) memmove(helper->buff, start, helper->used);
+}
+
+static void _helper_error(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, int fd_errno, void *uctx)
+{
+	mschap_ntlm_helper_t *helper = talloc_get_type_abort(uctx, mschap_ntlm_helper_t);
+
+	helper_fail(helper, fd_errno ? fr_syserror(fd_errno) : "ntlm_auth helper closed its output");
+}
+
+/** Start a helper process
+ *
+ */
+static int helper_start(mschap_ntlm_helper_t *helper)
+{
+	mschap_ntlm_helper_pool_t	*pool = helper->pool;
+
+	if (fr_exec_fork_wait(&helper->pid, &helper->stdin_fd, &helper->stdout_fd, NULL,
+			      pool->argv, NULL, true, false) < 0) {
+		PERROR("Failed starting ntlm_auth helper %u", helper->id);
+		helper->pid = -1;
+		return -1;
+	}
+
+	if (fr_event_fd_insert(helper, pool->el, helper->stdout_fd,
+			       _helper_read, NULL, _helper_error, helper) < 0) {
+		PERROR("Failed adding ntlm_auth helper %u handler", helper->id);
+	error:
+		close(helper->stdout_fd);
+		helper->stdout_fd = -1;
+		helper_stop(helper, SIGKILL);
+		return -1;
+	}
+
+	if (fr_event_pid_wait(helper, pool->el, &helper->ev_pid, helper->pid, _helper_exited, helper) < 0) {
+		PERROR("Failed watching ntlm_auth helper %u", helper->id);
+		(void) fr_event_fd_delete(pool->el, helper->stdout_fd, FR_EVENT_FILTER_IO);
+		goto error;
+	}
+
+	/*
+	 *	The helper exited immediately, and _helper_exited
+	 *	has already been called.
+	 */
+	if (helper->pid < 0) {
+		helper_stop(helper, 0);
+		return -1;
+	}
+
+	helper->running = true;
+	helper->used = 0;
+
+	DEBUG2("Started ntlm_auth helper %u (pid %u)", helper->id, helper->pid);
+
+	return 0;
+}
+
+static int _helper_free(mschap_ntlm_helper_t *helper)
+{
+	mschap_ntlm_helper_request_t *hreq;
+
+	if (helper->ev_restart) fr_event_timer_delete(&helper->ev_restart);
+
+	helper_stop(helper, SIGTERM);
+
+	while ((hreq = fr_dlist_pop_head(&helper->outstanding))) {
+		hreq->helper = NULL;
+		if (!hreq->request) {
+			talloc_free(hreq);
+			continue;
+		}
+		MEM(hreq->error = talloc_strdup(hreq, "ntlm_auth helper shutting down"));
+		unlang_interpret_mark_runnable(hreq->request);
+	}
+
+	return 0;
+}
+
+/** Start the ntlm_auth helpers for a worker thread
+ *
+ * @param[in] ctx		to allocate the pool in.  The helpers are
+ *				stopped when it's freed.
+ * @param[in] el		Event list of the worker thread.
+ * @param[in] name		Module instance name, for logging.
+ * @param[in] program		to run, including arguments.
+ * @param[in] processes		How many helpers to start.
+ * @return
+ *	- The new pool.
+ *	- NULL on error.
+ */
+mschap_ntlm_helper_pool_t *mschap_ntlm_helper_pool_alloc(TALLOC_CTX *ctx, fr_event_list_t *el,
+							 char const *name, char const *program,
+							 uint32_t processes)
+{
+	mschap_ntlm_helper_pool_t	*pool;
+	char const			*argv[NTLM_HELPER_MAX_ARGV];
+	char				argv_buf[4096];
+	int				argc, i;
+	uint32_t			j;
+
+	MEM(pool = talloc_zero(ctx, mschap_ntlm_helper_pool_t));
+	pool->name = name;
+	pool->el = el;
+	pool->num = processes;
+
+	/*
+	 *	Split the program into arguments.  There's no
+	 *	request, so nothing is expanded.
+	 */
+	argc = rad_expand_xlat(NULL, program, NTLM_HELPER_MAX_ARGV, argv, false, sizeof(argv_buf), argv_buf);
+	if (argc <= 0) {
+		PERROR("Invalid ntlm_auth helper program '%s'", program);
+		talloc_free(pool);
+		return NULL;
+	}
+
+	MEM(pool->argv = talloc_zero_array(pool, char *, argc + 1));
+	for (i = 0; i < argc; i++) MEM(pool->argv[i] = talloc_strdup(pool->argv, argv[i]));
+
+	MEM(pool->helpers = talloc_zero_array(pool, mschap_ntlm_helper_t *, processes));
+	for (j = 0; j < processes; j++) {
+		mschap_ntlm_helper_t *helper;
+
+		MEM(helper = talloc_zero(pool->helpers, mschap_ntlm_helper_t));
+		helper->pool = pool;
+		helper->id = j;
+		helper->pid = -1;
+		helper->stdin_fd = -1;
+		helper->stdout_fd = -1;
+		fr_dlist_talloc_init(&helper->outstanding, mschap_ntlm_helper_request_t, entry);
+		talloc_set_destructor(helper, _helper_free);
+		pool->helpers[j] = helper;
+
+		/*
+		 *	A helper which can't be started now will be
+		 *	retried, ntlm_auth may depend on winbindd
+		 *	which isn't running yet.
+		 */
+		if (helper_start(helper) < 0) {
+			if (fr_event_timer_in(helper, el, &helper->ev_restart,
+					      NTLM_HELPER_RESTART_DELAY, _helper_restart, helper) < 0) {
+				PERROR("Failed scheduling restart of ntlm_auth helper %u", helper->id);
+				talloc_free(pool);
+				return NULL;
+			}
+		}
+	}
+
+	return pool;
+}
+
+/** Encode an ntlm-server-1 request
+ *
+ * Username and domain are base64 encoded, so they can contain any
+ * character, including the newlines used to delimit keys.
+ */
+static fr_slen_t helper_request_encode(fr_sbuff_t *out, char const *username, char const *domain,
+				       uint8_t const challenge[static 8], uint8_t const response[static 24])
+{
+	fr_sbuff_t our_out = FR_SBUFF(out);
+
+	FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "Username:: ");
+	FR_SBUFF_RETURN(fr_base64_encode, &our_out, &FR_DBUFF_TMP((uint8_t const *) username, strlen(username)), true);
+	FR_SBUFF_IN_CHAR_RETURN(&our_out, '\n');
+
+	if (domain) {
+		FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "NT-Domain:: ");
+		FR_SBUFF_RETURN(fr_base64_encode, &our_out, &FR_DBUFF_TMP((uint8_t const *) domain, strlen(domain)), true);
+		FR_SBUFF_IN_CHAR_RETURN(&our_out, '\n');
+	}
+
+	FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "LANMAN-Challenge: ");
+	FR_SBUFF_RETURN(fr_base16_encode, &our_out, &FR_DBUFF_TMP(challenge, 8));
+	FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "\nNT-Response: ");
+	FR_SBUFF_RETURN(fr_base16_encode, &our_out, &FR_DBUFF_TMP(response, 24));
+	FR_SBUFF_IN_STRCPY_LITERAL_RETURN(&our_out, "\nRequest-User-Session-Key: Yes\n.\n");
+
+	FR_SBUFF_SET_RETURN(out, &our_out);
+}
+
+/** Send an authentication to the least loaded helper
+ *
+ * The caller should yield, and will be marked runnable when the helper
+ * responds, or fails.
+ *
+ * @param[in] pool		of helpers for this thread.
+ * @param[in] request		The current request.
+ * @param[in] username		to authenticate.
+ * @param[in] domain		of the user, may be NULL.
+ * @param[in] challenge		MS-CHAPv1 challenge, or the MS-CHAPv2 challenge hash.
+ * @param[in] response		NT-Response from the client.
+ * @return
+ *	- The outstanding request.
+ *	- NULL on error.
+ */
+mschap_ntlm_helper_request_t *mschap_ntlm_helper_send(mschap_ntlm_helper_pool_t *pool, request_t *request,
+						      char const *username, char const *domain,
+						      uint8_t const challenge[static 8],
+						      uint8_t const response[static 24])
+{
+	mschap_ntlm_helper_t		*helper = NULL;
+	mschap_ntlm_helper_request_t	*hreq;
+	char				buff[1024];
+	fr_sbuff_t			sbuff = FR_SBUFF_OUT(buff, sizeof(buff));
+	fr_slen_t			len;
+	ssize_t				slen;
+	uint32_t			i;
+
+	for (i = 0; i < pool->num; i++) {
+		if (!pool->helpers[i]->running) continue;
+
+		if (!helper ||
+		    (fr_dlist_num_elements(&pool->helpers[i]->outstanding) < fr_dlist_num_elements(&helper->outstanding))) {
+			helper = pool->helpers[i];
+		}
+	}
+
+	if (!helper) {
+		REDEBUG("No ntlm_auth helpers are running");
+		return NULL;
+	}
+
+	len = helper_request_encode(&sbuff, username, domain, challenge, response);
+	if (len <= 0) {
+		REDEBUG("Username or domain too long for ntlm_auth helper");
+		return NULL;
+	}
+
+	/*
+	 *	Requests are much smaller than PIPE_BUF, so the write
+	 *	is atomic.  Either it all goes, or none of it does.
+	 */
+	slen = write(helper->stdin_fd, buff, (size_t) len);
+	if (slen < 0) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+			REDEBUG("ntlm_auth helper %u is not accepting requests", helper->id);
+			return NULL;
+		}
+
+		REDEBUG("Failed writing to ntlm_auth helper %u: %s", helper->id, fr_syserror(errno));
+		helper_fail(helper, "Failed writing to ntlm_auth helper");
+		return NULL;
+	}
+
+	if (slen != len) {
+		REDEBUG("Short write to ntlm_auth helper %u", helper->id);
+		helper_fail(helper, "Short write to ntlm_auth helper");
+		return NULL;
+	}
+
+	RDEBUG2("Sent authentication to ntlm_auth helper %u (pid %u)", helper->id, helper->pid);
+
+	MEM(hreq = talloc_zero(NULL, mschap_ntlm_helper_request_t));
+	hreq->helper = helper;
+	hreq->request = request;
+	fr_dlist_insert_tail(&helper->outstanding, hreq);
+
+	return hreq;
+}
+
+/** The request was cancelled
+ *
+ * If the helper hasn't answered yet, the request is left in place so
+ * that the answer is matched correctly, and freed when it arrives.
+ */
+void mschap_ntlm_helper_cancel(mschap_ntlm_helper_request_t *hreq)
+{
+	if (hreq->helper) {
+		hreq->request = NULL;
+		return;
+	}
+
+	talloc_free(hreq);
+}
+
+/** The helper didn't answer in time
+ *
+ * Anything else queued on the helper would wait at least as long, so
+ * the helper is killed, every request outstanding on it is failed,
+ * and it's restarted.
+ */
+void mschap_ntlm_helper_kill(mschap_ntlm_helper_request_t *hreq)
+{
+	if (!hreq->helper) return;
+
+	helper_fail(hreq->helper, "ntlm_auth helper timed out");
+}
@@ -0,0 +1,41 @@
+#pragma once
+/* @copyright 2026 The FreeRADIUS server project */
+RCSIDH(ntlm_helper_h, "$Id$")
+
+#include <freeradius-devel/server/request.h>
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/event.h>
+
+typedef struct mschap_ntlm_helper_pool_s mschap_ntlm_helper_pool_t;
+typedef struct mschap_ntlm_helper_s mschap_ntlm_helper_t;
+
+/** An authentication sent to an ntlm_auth helper
+ *
+ * Owned by the helper while it's outstanding, so that the helper's
+ * responses can always be matched to the requests in the order they
+ * were written.  Once the response has been read, it's owned by the
+ * request, and the caller is responsible for freeing it.
+ */
+typedef struct {
+	fr_dlist_t		entry;					//!< Entry in the helper's list of outstanding requests.
+	mschap_ntlm_helper_t	*helper;				//!< Helper processing the request, NULL once done.
+	request_t		*request;				//!< Request to resume, NULL if it was cancelled.
+
+	bool			authenticated;				//!< Helper said "Authenticated: Yes".
+	bool			have_key;				//!< nthashhash was set from User-Session-Key.
+	uint8_t			nthashhash[NT_DIGEST_LENGTH];		//!< Hash of the NT hash.
+	char			*error;					//!< Authentication-Error, or why the helper failed.
+} mschap_ntlm_helper_request_t;
+
+mschap_ntlm_helper_pool_t	*mschap_ntlm_helper_pool_alloc(TALLOC_CTX *ctx, fr_event_list_t *el,
+							       char const *name, char const *program,
+							       uint32_t processes);
+
+mschap_ntlm_helper_request_t	*mschap_ntlm_helper_send(mschap_ntlm_helper_pool_t *pool, request_t *request,
+							 char const *username, char const *domain,
+							 uint8_t const challenge[static 8],
+							 uint8_t const response[static 24]);
+
+void				mschap_ntlm_helper_cancel(mschap_ntlm_helper_request_t *hreq);
+
+void				mschap_ntlm_helper_kill(mschap_ntlm_helper_request_t *hreq);
@@ -51,6 +51,7 @@ RCSID("$Id$")
 #include "rlm_mschap.h"
 #include "mschap.h"
 #include "smbdes.h"
+#include "ntlm_helper.h"
 
 #ifdef WITH_AUTH_WINBIND
 #include "auth_wbclient.h"
@@ -89,6 +90,12 @@ static const conf_parser_t passchange_config[] = {
 	CONF_PARSER_TERMINATOR
 };
 
+static const conf_parser_t ntlm_helper_config[] = {
+	{ FR_CONF_OFFSET("program", rlm_mschap_t, ntlm_helper) },
+	{ FR_CONF_OFFSET("processes", rlm_mschap_t, ntlm_helper_processes), .dflt = "2" },
+	CONF_PARSER_TERMINATOR
+};
+
 static const conf_parser_t winbind_config[] = {
 	{ FR_CONF_OFFSET("username", rlm_mschap_t, wb_username) },
 #ifdef WITH_AUTH_WINBIND
@@ -109,6 +116,7 @@ static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET("with_ntdomain_hack", rlm_mschap_t, with_ntdomain_hack), .dflt = "yes" },
 	{ FR_CONF_OFFSET_FLAGS("ntlm_auth", CONF_FLAG_XLAT, rlm_mschap_t, ntlm_auth) },
 	{ FR_CONF_OFFSET("ntlm_auth_timeout", rlm_mschap_t, ntlm_auth_timeout) },
+	{ FR_CONF_POINTER("ntlm_auth_helper", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) ntlm_helper_config },
 
 	{ FR_CONF_POINTER("passchange", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) passchange_config },
 	{ FR_CONF_OFFSET("allow_retry", rlm_mschap_t, allow_retry), .dflt = "yes" },
@@ -189,6 +197,12 @@ static const call_env_method_t mschap_auth_method_env = {
 				{ FR_CALL_ENV_OFFSET("domain", FR_TYPE_STRING, CALL_ENV_FLAG_NULLABLE, mschap_auth_call_env_t, wb_domain) },
 				CALL_ENV_TERMINATOR
 			}))},
+		{ FR_CALL_ENV_SUBSECTION("ntlm_auth_helper", NULL, CALL_ENV_FLAG_NONE,
+			((call_env_parser_t[]) {
+				{ FR_CALL_ENV_OFFSET("username", FR_TYPE_STRING, CALL_ENV_FLAG_NONE, mschap_auth_call_env_t, ntlm_helper_username) },
+				{ FR_CALL_ENV_OFFSET("domain", FR_TYPE_STRING, CALL_ENV_FLAG_NULLABLE, mschap_auth_call_env_t, ntlm_helper_domain) },
+				CALL_ENV_TERMINATOR
+			}))},
 		CALL_ENV_TERMINATOR
 	}
 };
@@ -1196,6 +1210,107 @@ ntlm_auth_err:
 	return -1;
 }
 
+/** Translate an error from ntlm_auth into an MS-CHAP error code
+ *
+ * @param[in] request	The current request.
+ * @param[in] buffer	Output from ntlm_auth, or the Authentication-Error
+ *			from an ntlm_auth helper.
+ * @return
+ *	- -1 authentication failed.
+ *	- -2 the domain controller couldn't be contacted.
+ *	- -647 account locked out.
+ *	- -648 password expired.
+ *	- -691 account disabled.
+ */
+static int ntlm_auth_error(request_t *request, char *buffer)
+{
+	char	*p;
+	int	result;
+
+	/*
+	 *	Do checks for numbers, which are
+	 *	language neutral.  They're also
+	 *	faster.
+	 */
+	p = strcasestr(buffer, "0xC0000");
+	if (p) {
+		result = 0;
+
+		p += 7;
+		if (strcmp(p, "224") == 0) {
+			result = -648;
+
+		} else if (strcmp(p, "234") == 0) {
+			result = -647;
+
+		} else if (strcmp(p, "072") == 0) {
+			result = -691;
+
+		} else if (strcasecmp(p, "05E") == 0) {
+			result = -2;
+		}
+
+		if (result != 0) {
+			REDEBUG2("%s", buffer);
+			return result;
+		}
+
+		/*
+		 *	Else fall through to more ridiculous checks.
+		 */
+	}
+
+	/*
+	 *	Look for variants of expire password.
+	 *
+	 *	The NT_STATUS names are what the ntlm_auth
+	 *	helper protocol returns.
+	 */
+	if (strcasestr(buffer, "0xC0000224") ||
+	    strcasestr(buffer, "NT_STATUS_PASSWORD_EXPIRED") ||
+	    strcasestr(buffer, "NT_STATUS_PASSWORD_MUST_CHANGE") ||
+	    strcasestr(buffer, "Password expired") ||
+	    strcasestr(buffer, "Password has expired") ||
+	    strcasestr(buffer, "Password must be changed") ||
+	    strcasestr(buffer, "Must change password")) {
+		return -648;
+	}
+
+	if (strcasestr(buffer, "0xC0000234") ||
+	    strcasestr(buffer, "NT_STATUS_ACCOUNT_LOCKED_OUT") ||
+	    strcasestr(buffer, "Account locked out")) {
+		REDEBUG2("%s", buffer);
+		return -647;
+	}
+
+	if (strcasestr(buffer, "0xC0000072") ||
+	    strcasestr(buffer, "NT_STATUS_ACCOUNT_DISABLED") ||
+	    strcasestr(buffer, "Account disabled")) {
+		REDEBUG2("%s", buffer);
+		return -691;
+	}
+
+	if (strcasestr(buffer, "0xC000005E") ||
+	    strcasestr(buffer, "NT_STATUS_NO_LOGON_SERVERS") ||
+	    strcasestr(buffer, "No logon servers")) {
+		REDEBUG2("%s", buffer);
+		return -2;
+	}
+
+	if (strcasestr(buffer, "could not obtain winbind separator") ||
+	    strcasestr(buffer, "Reading winbind reply failed")) {
+		REDEBUG2("%s", buffer);
+		return -2;
+	}
+
+	RDEBUG2("External script failed");
+	p = strchr(buffer, '\n');
+	if (p) *p = '\0';
+
+	REDEBUG("External script says: %s", buffer);
+	return -1;
+}
+
 /*
  *	Do the MS-CHAP stuff.
  *
@@ -1265,84 +1380,7 @@ static int CC_HINT(nonnull (1, 2, 4, 5, 6)) do_mschap(rlm_mschap_t const *inst,
 		 */
 		result = radius_exec_program_legacy(buffer, sizeof(buffer), request, inst->ntlm_auth, NULL,
 					     true, true, inst->ntlm_auth_timeout);
-		if (result != 0) {
-			char *p;
-
-			/*
-			 *	Do checks for numbers, which are
-			 *	language neutral.  They're also
-			 *	faster.
-			 */
-			p = strcasestr(buffer, "0xC0000");
-			if (p) {
-				result = 0;
-
-				p += 7;
-				if (strcmp(p, "224") == 0) {
-					result = -648;
-
-				} else if (strcmp(p, "234") == 0) {
-					result = -647;
-
-				} else if (strcmp(p, "072") == 0) {
-					result = -691;
-
-				} else if (strcasecmp(p, "05E") == 0) {
-					result = -2;
-				}
-
-				if (result != 0) {
-					REDEBUG2("%s", buffer);
-					return result;
-				}
-
-				/*
-				 *	Else fall through to more ridiculous checks.
-				 */
-			}
-
-			/*
-			 *	Look for variants of expire password.
-			 */
-			if (strcasestr(buffer, "0xC0000224") ||
-			    strcasestr(buffer, "Password expired") ||
-			    strcasestr(buffer, "Password has expired") ||
-			    strcasestr(buffer, "Password must be changed") ||
-			    strcasestr(buffer, "Must change password")) {
-				return -648;
-			}
-
-			if (strcasestr(buffer, "0xC0000234") ||
-			    strcasestr(buffer, "Account locked out")) {
-				REDEBUG2("%s", buffer);
-				return -647;
-			}
-
-			if (strcasestr(buffer, "0xC0000072") ||
-			    strcasestr(buffer, "Account disabled")) {
-				REDEBUG2("%s", buffer);
-				return -691;
-			}
-
-			if (strcasestr(buffer, "0xC000005E") ||
-			    strcasestr(buffer, "No logon servers")) {
-				REDEBUG2("%s", buffer);
-				return -2;
-			}
-
-			if (strcasestr(buffer, "could not obtain winbind separator") ||
-			    strcasestr(buffer, "Reading winbind reply failed")) {
-				REDEBUG2("%s", buffer);
-				return -2;
-			}
-
-			RDEBUG2("External script failed");
-			p = strchr(buffer, '\n');
-			if (p) *p = '\0';
-
-			REDEBUG("External script says: %s", buffer);
-			return -1;
-		}
+		if (result != 0) return ntlm_auth_error(request, buffer);
 
 		/*
 		 *	Parse the answer as an nthashhash.
@@ -1863,22 +1901,44 @@ static unlang_action_t CC_HINT(nonnull) mschap_process_cpw_request(rlm_rcode_t *
 	RETURN_MODULE_OK;
 }
 
-static CC_HINT(nonnull(1,2,3,4,5,8,9)) unlang_action_t mschap_process_response(rlm_rcode_t *p_result,
-									       int *mschap_version,
-									       uint8_t nthashhash[static NT_DIGEST_LENGTH],
-									       rlm_mschap_t const *inst,
-									       request_t *request,
-									       fr_pair_t *smb_ctrl,
-									       fr_pair_t *nt_password,
-									       fr_pair_t *challenge,
-									       fr_pair_t *response,
-									       MSCHAP_AUTH_METHOD method,
-									       mschap_auth_call_env_t *env_data)
+/** State for an MS-CHAP authentication
+ *
+ * Kept across the yield, when an ntlm_auth helper is used.
+ */
+typedef struct {
+	rlm_mschap_t const		*inst;
+	mschap_auth_call_env_t		*env_data;
+	MSCHAP_AUTH_METHOD		method;			//!< How we're going to authenticate.
+
+	int				mschap_version;		//!< 1 or 2.
+	fr_pair_t			*smb_ctrl;		//!< SMB-Account-Ctrl, may be NULL.
+	fr_pair_t			*challenge;		//!< The challenge from the request.
+	fr_pair_t			*response;		//!< The response from the request.
+
+	uint8_t				mschap_challenge[16];	//!< MS-CHAPv1 challenge, or the hash of the
+								///< MS-CHAPv2 challenges.
+	uint8_t const			*peer_challenge;	//!< MS-CHAPv2 peer challenge.
+	char const			*username_str;		//!< MS-CHAPv2 username, without the domain.
+	size_t				username_len;		//!< Length of username_str.
+
+	uint8_t				nthashhash[NT_DIGEST_LENGTH];	//!< Hash of the NT hash.
+
+	mschap_ntlm_helper_request_t	*hreq;			//!< Outstanding request to an ntlm_auth helper.
+} mschap_auth_ctx_t;
+
+typedef struct {
+	mschap_ntlm_helper_pool_t	*ntlm_helper;		//!< ntlm_auth helpers for this thread.
+} rlm_mschap_thread_t;
+
+static CC_HINT(nonnull) unlang_action_t mschap_process_response(rlm_rcode_t *p_result,
+								mschap_auth_ctx_t *auth_ctx,
+								request_t *request)
 {
-	int			offset;
-	rlm_rcode_t		mschap_result;
+	mschap_auth_call_env_t	*env_data = auth_ctx->env_data;
+	fr_pair_t		*challenge = auth_ctx->challenge;
+	fr_pair_t		*response = auth_ctx->response;
 
-	*mschap_version = 1;
+	auth_ctx->mschap_version = 1;
 
 	RDEBUG2("Processing MS-CHAPv1 response");
 
@@ -1907,42 +1967,30 @@ static CC_HINT(nonnull(1,2,3,4,5,8,9)) unlang_action_t mschap_process_response(r
 		RETURN_MODULE_FAIL;
 	}
 
-	offset = 26;
-
-	/*
-	 *	Do the MS-CHAP authentication.
-	 */
-	mschap_result = do_mschap(inst, request, nt_password, challenge->vp_octets,
-				  response->vp_octets + offset, nthashhash, method, env_data);
+	memcpy(auth_ctx->mschap_challenge, challenge->vp_octets, 8);
 
-	/*
-	 *	Check for errors, and add MSCHAP-Error if necessary.
-	 */
-	return mschap_error(p_result, inst, request, *response->vp_octets, mschap_result, *mschap_version, smb_ctrl, env_data);
+	RETURN_MODULE_OK;
 }
 
-static unlang_action_t CC_HINT(nonnull(1,2,3,4,5,8,9)) mschap_process_v2_response(rlm_rcode_t *p_result,
-										  int *mschap_version,
-									    	  uint8_t nthashhash[static NT_DIGEST_LENGTH],
-									    	  rlm_mschap_t const *inst,
-									    	  request_t *request,
-									    	  fr_pair_t *smb_ctrl,
-									   	  fr_pair_t *nt_password,
-									    	  fr_pair_t *challenge,
-									    	  fr_pair_t *response,
-									    	  MSCHAP_AUTH_METHOD method,
-										  mschap_auth_call_env_t *env_data)
+static unlang_action_t CC_HINT(nonnull) mschap_process_v2_response(rlm_rcode_t *p_result,
+								   mschap_auth_ctx_t *auth_ctx,
+								   fr_pair_t *nt_password,
+								   request_t *request)
 {
-		uint8_t		mschap_challenge[16];
-		fr_pair_t	*user_name, *name_vp, *response_name, *peer_challenge_attr;
-		uint8_t const	*peer_challenge;
-		char const	*username_str;
-		size_t		username_len;
-		int		mschap_result;
-		rlm_rcode_t	rcode;
-		char		msch2resp[42];
+		rlm_mschap_t const	*inst = auth_ctx->inst;
+		mschap_auth_call_env_t	*env_data = auth_ctx->env_data;
+		fr_pair_t		*challenge = auth_ctx->challenge;
+		fr_pair_t		*response = auth_ctx->response;
+		fr_pair_t		*user_name, *name_vp, *response_name, *peer_challenge_attr;
+		char const		*username_str;
+		size_t			username_len;
+#ifdef __APPLE__
+		rlm_rcode_t		rcode;
+#else
+		(void) nt_password;
+#endif
 
-		*mschap_version = 2;
+		auth_ctx->mschap_version = 2;
 
 		RDEBUG2("Processing MS-CHAPv2 response");
 
@@ -2015,12 +2063,12 @@ static unlang_action_t CC_HINT(nonnull(1,2,3,4,5,8,9)) mschap_process_v2_respons
 			if (rcode != RLM_MODULE_NOOP) RETURN_MODULE_RCODE(rcode);
 		}
 #endif
-		peer_challenge = response->vp_octets + 2;
+		auth_ctx->peer_challenge = response->vp_octets + 2;
 
 		peer_challenge_attr = fr_pair_find_by_da(&request->control_pairs, NULL, attr_ms_chap_peer_challenge);
 		if (peer_challenge_attr) {
 			RDEBUG2("Overriding peer challenge");
-			peer_challenge = peer_challenge_attr->vp_octets;
+			auth_ctx->peer_challenge = peer_challenge_attr->vp_octets;
 		}
 
 		/*
@@ -2032,23 +2080,48 @@ static unlang_action_t CC_HINT(nonnull(1,2,3,4,5,8,9)) mschap_process_v2_respons
 		 */
 		RDEBUG2("Creating challenge with username \"%pV\"",
 			fr_box_strvalue_len(username_str, username_len));
-		mschap_challenge_hash(mschap_challenge,		/* resulting challenge */
-				      peer_challenge,			/* peer challenge */
+		mschap_challenge_hash(auth_ctx->mschap_challenge,	/* resulting challenge */
+				      auth_ctx->peer_challenge,		/* peer challenge */
 				      challenge->vp_octets,		/* our challenge */
 				      username_str, username_len);	/* user name */
 
-		mschap_result = do_mschap(inst, request, nt_password, mschap_challenge,
-					  response->vp_octets + 26, nthashhash, method, env_data);
+		auth_ctx->username_str = username_str;
+		auth_ctx->username_len = username_len;
 
-		/*
-		 *	Check for errors, and add MSCHAP-Error if necessary.
-		 */
-		mschap_error(&rcode, inst, request, *response->vp_octets,
-			     mschap_result, *mschap_version, smb_ctrl, env_data);
-		if (rcode != RLM_MODULE_OK) RETURN_MODULE_RCODE(rcode);
+		RETURN_MODULE_OK;
+}
+
+/** Finish an MS-CHAP authentication, once we have the result
+ *
+ * Adds MS-CHAP-Error if the authentication failed, or the MS-CHAPv2
+ * success and MPPE attributes if it succeeded.
+ */
+static unlang_action_t CC_HINT(nonnull) mschap_auth_finish(rlm_rcode_t *p_result,
+							   mschap_auth_ctx_t *auth_ctx,
+							   request_t *request,
+							   int mschap_result)
+{
+	rlm_mschap_t const	*inst = auth_ctx->inst;
+	mschap_auth_call_env_t	*env_data = auth_ctx->env_data;
+	fr_pair_t		*response = auth_ctx->response;
+	rlm_rcode_t		rcode;
+
+	/*
+	 *	Check for errors, and add MSCHAP-Error if necessary.
+	 */
+	mschap_error(&rcode, inst, request, *response->vp_octets,
+		     mschap_result, auth_ctx->mschap_version, auth_ctx->smb_ctrl, env_data);
+	if (rcode != RLM_MODULE_OK) RETURN_MODULE_RCODE(rcode);
+
+	if (auth_ctx->mschap_version == 2) {
+		char const	*username_str = auth_ctx->username_str;
+		size_t		username_len = auth_ctx->username_len;
+		char		msch2resp[42];
 
 #ifdef WITH_AUTH_WINBIND
 		if (inst->wb_retry_with_normalised_username) {
+			fr_pair_t *response_name;
+
 			response_name = fr_pair_find_by_da(&request->request_pairs, NULL, attr_ms_chap_user_name);
 			if (response_name) {
 				if (strcmp(username_str, response_name->vp_strvalue)) {
@@ -2063,15 +2136,161 @@ static unlang_action_t CC_HINT(nonnull(1,2,3,4,5,8,9)) mschap_process_v2_respons
 
 		mschap_auth_response(username_str,		/* without the domain */
 				     username_len,		/* Length of username str */
-				     nthashhash,		/* nt-hash-hash */
+				     auth_ctx->nthashhash,	/* nt-hash-hash */
 				     response->vp_octets + 26,	/* peer response */
-				     peer_challenge,		/* peer challenge */
-				     challenge->vp_octets,	/* our challenge */
+				     auth_ctx->peer_challenge,	/* peer challenge */
+				     auth_ctx->challenge->vp_octets,	/* our challenge */
 				     msch2resp);		/* calculated MPPE key */
 		if (env_data->chap2_success) mschap_add_reply(request, *response->vp_octets,
 							      tmpl_attr_tail_da(env_data->chap2_success), msch2resp, 42);
+	}
 
-		RETURN_MODULE_OK;
+	/* now create MPPE attributes */
+	if (inst->use_mppe) {
+		fr_pair_t	*vp;
+		uint8_t		mppe_sendkey[34];
+		uint8_t		mppe_recvkey[34];
+
+		switch (auth_ctx->mschap_version) {
+		case 1:
+			RDEBUG2("Generating MS-CHAPv1 MPPE keys");
+			memset(mppe_sendkey, 0, 32);
+
+			/*
+			 *	According to RFC 2548 we
+			 *	should send NT hash.  But in
+			 *	practice it doesn't work.
+			 *	Instead, we should send nthashhash
+			 *
+			 *	This is an error in RFC 2548.
+			 */
+			/*
+			 *	do_mschap cares to zero nthashhash if NT hash
+			 *	is not available.
+			 */
+			memcpy(mppe_sendkey + 8, auth_ctx->nthashhash, NT_DIGEST_LENGTH);
+			mppe_add_reply(inst, request, tmpl_attr_tail_da(env_data->chap_mppe_keys), mppe_sendkey, 24);	//-V666
+			break;
+
+		case 2:
+			RDEBUG2("Generating MS-CHAPv2 MPPE keys");
+			mppe_chap2_gen_keys128(auth_ctx->nthashhash, response->vp_octets + 26, mppe_sendkey, mppe_recvkey);
+
+			mppe_add_reply(inst, request, tmpl_attr_tail_da(env_data->mppe_recv_key), mppe_recvkey, 16);
+			mppe_add_reply(inst, request, tmpl_attr_tail_da(env_data->mppe_send_key), mppe_sendkey, 16);
+			break;
+
+		default:
+			fr_assert(0);
+			break;
+		}
+
+		MEM(pair_update_reply(&vp, tmpl_attr_tail_da(env_data->mppe_encryption_policy)) >= 0);
+		vp->vp_uint32 = inst->require_encryption ? 2 : 1;
+
+		MEM(pair_update_reply(&vp, tmpl_attr_tail_da(env_data->mppe_encryption_types)) >= 0);
+		vp->vp_uint32 = inst->require_strong ? 4 : 6;
+	} /* else we weren't asked to use MPPE */
+
+	RETURN_MODULE_OK;
+}
+
+/** Process the response from an ntlm_auth helper
+ *
+ */
+static unlang_action_t CC_HINT(nonnull) mod_authenticate_resume(rlm_rcode_t *p_result, module_ctx_t const *mctx,
+								request_t *request)
+{
+	mschap_auth_ctx_t		*auth_ctx = talloc_get_type_abort(mctx->rctx, mschap_auth_ctx_t);
+	mschap_ntlm_helper_request_t	*hreq = auth_ctx->hreq;
+	int				mschap_result;
+
+	(void) unlang_module_timeout_delete(request, auth_ctx);
+
+	if (hreq->authenticated) {
+		if (hreq->have_key) {
+			memcpy(auth_ctx->nthashhash, hreq->nthashhash, NT_DIGEST_LENGTH);
+			mschap_result = 0;
+		} else {
+			REDEBUG("Invalid output from ntlm_auth helper: expecting 'User-Session-Key'");
+			mschap_result = -1;
+		}
+	} else if (hreq->error) {
+		mschap_result = ntlm_auth_error(request, hreq->error);
+	} else {
+		REDEBUG("ntlm_auth helper rejected the authentication");
+		mschap_result = -1;
+	}
+
+	talloc_free(hreq);
+	auth_ctx->hreq = NULL;
+
+	mschap_auth_finish(p_result, auth_ctx, request, mschap_result);
+	talloc_free(auth_ctx);
+
+	return UNLANG_ACTION_CALCULATE_RESULT;
+}
+
+/** The ntlm_auth helper didn't respond in time
+ *
+ */
+static void mod_authenticate_timeout(module_ctx_t const *mctx, request_t *request, UNUSED fr_time_t fired)
+{
+	mschap_auth_ctx_t *auth_ctx = talloc_get_type_abort(mctx->rctx, mschap_auth_ctx_t);
+
+	REDEBUG("Timeout waiting for ntlm_auth helper");
+
+	mschap_ntlm_helper_kill(auth_ctx->hreq);
+}
+
+static void mod_authenticate_signal(module_ctx_t const *mctx, request_t *request, UNUSED fr_signal_t action)
+{
+	mschap_auth_ctx_t *auth_ctx = talloc_get_type_abort(mctx->rctx, mschap_auth_ctx_t);
+
+	RDEBUG2("Request cancelled, abandoning ntlm_auth helper response");
+
+	mschap_ntlm_helper_cancel(auth_ctx->hreq);
+	auth_ctx->hreq = NULL;
+}
+
+/** Send the authentication to an ntlm_auth helper, and yield
+ *
+ */
+static unlang_action_t CC_HINT(nonnull) mschap_ntlm_helper_auth(rlm_rcode_t *p_result, module_ctx_t const *mctx,
+								mschap_auth_ctx_t *auth_ctx, request_t *request)
+{
+	rlm_mschap_t const	*inst = auth_ctx->inst;
+	rlm_mschap_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_mschap_thread_t);
+	mschap_auth_call_env_t	*env_data = auth_ctx->env_data;
+	mschap_auth_ctx_t	*rctx;
+
+	if (env_data->ntlm_helper_username.type != FR_TYPE_STRING) {
+		REDEBUG("No username for the ntlm_auth helper");
+		RETURN_MODULE_FAIL;
+	}
+
+	MEM(rctx = talloc_memdup(request, auth_ctx, sizeof(*auth_ctx)));
+	talloc_set_type(rctx, mschap_auth_ctx_t);
+
+	rctx->hreq = mschap_ntlm_helper_send(t->ntlm_helper, request,
+					     env_data->ntlm_helper_username.vb_strvalue,
+					     (env_data->ntlm_helper_domain.type == FR_TYPE_STRING) ?
+					     env_data->ntlm_helper_domain.vb_strvalue : NULL,
+					     rctx->mschap_challenge, rctx->response->vp_octets + 26);
+	if (!rctx->hreq) {
+		talloc_free(rctx);
+		RETURN_MODULE_FAIL;
+	}
+
+	if (unlang_module_timeout_add(request, mod_authenticate_timeout, rctx,
+				      fr_time_add(fr_time(), inst->ntlm_auth_timeout)) < 0) {
+		RPEDEBUG("Failed adding timeout for ntlm_auth helper");
+		mschap_ntlm_helper_cancel(rctx->hreq);
+		talloc_free(rctx);
+		RETURN_MODULE_FAIL;
+	}
+
+	return unlang_module_yield(request, mod_authenticate_resume, mod_authenticate_signal, ~FR_SIGNAL_CANCEL, rctx);
 }
 
 /*
@@ -2099,8 +2318,8 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 	fr_pair_t		*cpw = NULL;
 	fr_pair_t		*parent;
 	fr_pair_t		*nt_password = NULL, *smb_ctrl;
-	uint8_t			nthashhash[NT_DIGEST_LENGTH];
-	int			mschap_version = 0;
+	mschap_auth_ctx_t	auth_ctx;
+	int			mschap_result;
 
 	MSCHAP_AUTH_METHOD	method;
 	bool			ephemeral = false;
@@ -2218,24 +2437,24 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 	parent = fr_pair_parent(challenge);
 	fr_assert(parent != NULL);
 
+	auth_ctx = (mschap_auth_ctx_t) {
+		.inst = inst,
+		.env_data = env_data,
+		.method = method,
+		.smb_ctrl = smb_ctrl,
+		.challenge = challenge
+	};
+
 	/*
 	 *	We also require an MS-CHAP-Response.
 	 */
 	if ((response = fr_pair_find_by_da(&parent->vp_group, NULL, tmpl_attr_tail_da(env_data->chap_response)))) {
-		mschap_process_response(&rcode,
-					&mschap_version, nthashhash,
-					inst, request,
-					smb_ctrl, nt_password,
-					challenge, response,
-					method, env_data);
+		auth_ctx.response = response;
+		mschap_process_response(&rcode, &auth_ctx, request);
 		if (rcode != RLM_MODULE_OK) goto finish;
 	} else if ((response = fr_pair_find_by_da_nested(&parent->vp_group, NULL, tmpl_attr_tail_da(env_data->chap2_response)))) {
-		mschap_process_v2_response(&rcode,
-					   &mschap_version, nthashhash,
-					   inst, request,
-					   smb_ctrl, nt_password,
-					   challenge, response,
-					   method, env_data);
+		auth_ctx.response = response;
+		mschap_process_v2_response(&rcode, &auth_ctx, nt_password, request);
 		if (rcode != RLM_MODULE_OK) goto finish;
 	} else {		/* Neither CHAPv1 or CHAPv2 response: die */
 		REDEBUG("&control.Auth-Type = %s set for a request that does not contain &%s or &%s attributes",
@@ -2244,52 +2463,25 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 		goto finish;
 	}
 
-	/* now create MPPE attributes */
-	if (inst->use_mppe) {
-		fr_pair_t	*vp;
-		uint8_t		mppe_sendkey[34];
-		uint8_t		mppe_recvkey[34];
-
-		switch (mschap_version) {
-		case 1:
-			RDEBUG2("Generating MS-CHAPv1 MPPE keys");
-			memset(mppe_sendkey, 0, 32);
-
-			/*
-			 *	According to RFC 2548 we
-			 *	should send NT hash.  But in
-			 *	practice it doesn't work.
-			 *	Instead, we should send nthashhash
-			 *
-			 *	This is an error in RFC 2548.
-			 */
-			/*
-			 *	do_mschap cares to zero nthashhash if NT hash
-			 *	is not available.
-			 */
-			memcpy(mppe_sendkey + 8, nthashhash, NT_DIGEST_LENGTH);
-			mppe_add_reply(inst, request, tmpl_attr_tail_da(env_data->chap_mppe_keys), mppe_sendkey, 24);	//-V666
-			break;
-
-		case 2:
-			RDEBUG2("Generating MS-CHAPv2 MPPE keys");
-			mppe_chap2_gen_keys128(nthashhash, response->vp_octets + 26, mppe_sendkey, mppe_recvkey);
-
-			mppe_add_reply(inst, request, tmpl_attr_tail_da(env_data->mppe_recv_key), mppe_recvkey, 16);
-			mppe_add_reply(inst, request, tmpl_attr_tail_da(env_data->mppe_send_key), mppe_sendkey, 16);
-			break;
+	/*
+	 *	ntlm_auth is running as a persistent helper, send it
+	 *	the challenge and response instead of running it.
+	 */
+	if (inst->ntlm_helper &&
+	    ((method == AUTH_NTLMAUTH_EXEC) || ((method == AUTH_AUTO) && !nt_password))) {
+		if (ephemeral) TALLOC_FREE(nt_password);
 
-		default:
-			fr_assert(0);
-			break;
-		}
+		return mschap_ntlm_helper_auth(p_result, mctx, &auth_ctx, request);
+	}
 
-		MEM(pair_update_reply(&vp, tmpl_attr_tail_da(env_data->mppe_encryption_policy)) >= 0);
-		vp->vp_uint32 = inst->require_encryption ? 2 : 1;
+	/*
+	 *	Do the MS-CHAP authentication.
+	 */
+	mschap_result = do_mschap(inst, request, nt_password, auth_ctx.mschap_challenge,
+				  response->vp_octets + 26, auth_ctx.nthashhash, method, env_data);
+	if (ephemeral) TALLOC_FREE(nt_password);
 
-		MEM(pair_update_reply(&vp, tmpl_attr_tail_da(env_data->mppe_encryption_types)) >= 0);
-		vp->vp_uint32 = inst->require_strong ? 4 : 6;
-	} /* else we weren't asked to use MPPE */
+	return mschap_auth_finish(p_result, &auth_ctx, request, mschap_result);
 
 finish:
 	if (ephemeral) TALLOC_FREE(nt_password);
@@ -2337,6 +2529,24 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		inst->method = AUTH_NTLMAUTH_EXEC;
 	}
 
+	/*
+	 *	A persistent helper replaces running ntlm_auth for
+	 *	every authentication.
+	 */
+	if (inst->ntlm_helper) {
+		if (inst->ntlm_auth) {
+			cf_log_warn(conf, "Both 'ntlm_auth' and 'ntlm_auth_helper' are set, "
+				    "'ntlm_auth_helper' will be used for authentication");
+		}
+
+		if (inst->ntlm_helper_processes < 1) {
+			cf_log_err(conf, "'ntlm_auth_helper.processes' must be at least 1");
+			return -1;
+		}
+
+		inst->method = AUTH_NTLMAUTH_EXEC;
+	}
+
 	switch (inst->method) {
 	case AUTH_INTERNAL:
 		DEBUG("Using internal authentication");
@@ -2345,6 +2555,11 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		DEBUG("Using auto password or ntlm_auth");
 		break;
 	case AUTH_NTLMAUTH_EXEC:
+		if (inst->ntlm_helper) {
+			DEBUG("Authenticating with %u persistent 'ntlm_auth' helpers per thread",
+			      inst->ntlm_helper_processes);
+			break;
+		}
 		DEBUG("Authenticating by calling 'ntlm_auth'");
 		break;
 #ifdef WITH_AUTH_WINBIND
@@ -2413,6 +2628,38 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 	return 0;
 }
 
+/*
+ *	Start the ntlm_auth helpers for this thread
+ */
+static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_mschap_t const	*inst = talloc_get_type_abort_const(mctx->inst->data, rlm_mschap_t);
+	rlm_mschap_thread_t	*t = talloc_get_type_abort(mctx->thread, rlm_mschap_thread_t);
+
+	if (!inst->ntlm_helper) return 0;
+
+	t->ntlm_helper = mschap_ntlm_helper_pool_alloc(t, mctx->el, mctx->inst->name,
+						       inst->ntlm_helper, inst->ntlm_helper_processes);
+	if (!t->ntlm_helper) {
+		PERROR("Failed starting ntlm_auth helpers");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ *	Stop the ntlm_auth helpers for this thread
+ */
+static int mod_thread_detach(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_mschap_thread_t *t = talloc_get_type_abort(mctx->thread, rlm_mschap_thread_t);
+
+	TALLOC_FREE(t->ntlm_helper);
+
+	return 0;
+}
+
 /*
  *	Tidy up instance
  */
@@ -2441,7 +2688,12 @@ module_rlm_t rlm_mschap = {
 		.config		= module_config,
 		.bootstrap	= mod_bootstrap,
 		.instantiate	= mod_instantiate,
-		.detach		= mod_detach
+		.detach		= mod_detach,
+
+		.thread_inst_size	= sizeof(rlm_mschap_thread_t),
+		.thread_inst_type	= "rlm_mschap_thread_t",
+		.thread_instantiate	= mod_thread_instantiate,
+		.thread_detach		= mod_thread_detach
 	},
 	.method_names = (module_method_name_t[]){
 		{ .name1 = "recv",		.name2 = CF_IDENT_ANY,		.method = mod_authorize,
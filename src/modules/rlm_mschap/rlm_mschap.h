@@ -50,6 +50,8 @@ typedef struct {
 
 	char const		*ntlm_auth;
 	fr_time_delta_t		ntlm_auth_timeout;
+	char const		*ntlm_helper;		//!< ntlm_auth command run as a persistent helper.
+	uint32_t		ntlm_helper_processes;	//!< Number of helpers in each worker thread.
 	char const		*ntlm_cpw;
 	char const		*ntlm_cpw_username;
 	char const		*ntlm_cpw_domain;
@@ -83,4 +85,6 @@ typedef struct {
 	tmpl_t const	*chap2_cpw;
 	fr_value_box_t	wb_username;
 	fr_value_box_t	wb_domain;
+	fr_value_box_t	ntlm_helper_username;
+	fr_value_box_t	ntlm_helper_domain;
 } mschap_auth_call_env_t;
@@ -32,6 +32,7 @@ RCSID("$Id$")
 
 #include <freeradius-devel/server/base.h>
 #include <freeradius-devel/server/module_rlm.h>
+#include <freeradius-devel/unlang/offload.h>
 
 #include "config.h"
 
@@ -48,18 +49,43 @@ RCSID("$Id$")
 #endif
 
 typedef struct {
-	char const *pam_auth_name;
+	char const			*pam_auth_name;
+
+	unlang_offload_pool_config_t	offload_config;
+	unlang_offload_pool_t		*offload;	//!< Helper threads which call PAM.
 } rlm_pam_t;
 
+/** A PAM authentication, run in an offload thread
+ *
+ * PAM calls block, so they're run in a helper thread.  The helper
+ * thread can't access the request, so everything PAM needs is
+ * copied here, and any messages from PAM are saved, and logged when
+ * the request is resumed.
+ */
 typedef struct {
-	request_t		*request;	//!< The current request.
+	char const	*pam_auth;	//!< PAM service name.
 	char const	*username;	//!< Username to provide to PAM when prompted.
 	char const	*password;	//!< Password to provide to PAM when prompted.
 	bool		error;		//!< True if pam_conv failed.
+
+	int		ret;		//!< 0 on success, -1 on failure.
+	char		**msgs;		//!< Messages from PAM, logged on resume.
+	bool		*msg_error;	//!< Whether each message is an error.
 } rlm_pam_data_t;
 
+/*
+ *	Many PAM modules aren't thread-safe, so by default there's
+ *	only one thread calling PAM.
+ */
+static const conf_parser_t pam_offload_config[] = {
+	{ FR_CONF_OFFSET("threads", unlang_offload_pool_config_t, threads), .dflt = "1" },
+	{ FR_CONF_OFFSET("max_queued", unlang_offload_pool_config_t, max_queued), .dflt = "1024" },
+	CONF_PARSER_TERMINATOR
+};
+
 static const conf_parser_t module_config[] = {
 	{ FR_CONF_OFFSET("pam_auth", rlm_pam_t, pam_auth_name) },
+	{ FR_CONF_OFFSET_SUBSECTION("offload", 0, rlm_pam_t, offload_config, pam_offload_config) },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -91,9 +117,32 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 
 	if (!inst->pam_auth_name) inst->pam_auth_name = main_config->name;
 
+	inst->offload = unlang_offload_pool_alloc(inst, mctx->inst->name, &inst->offload_config);
+	if (!inst->offload) {
+		cf_log_perr(mctx->inst->conf, "Failed starting PAM threads");
+		return -1;
+	}
+
 	return 0;
 }
 
+/** Save a message from PAM, so that it can be logged in the worker
+ *
+ */
+static void CC_HINT(format (printf, 3, 4)) pam_msg_add(rlm_pam_data_t *pam_config, bool error, char const *fmt, ...)
+{
+	size_t	n = talloc_array_length(pam_config->msgs);
+	va_list	ap;
+
+	MEM(pam_config->msgs = talloc_realloc(pam_config, pam_config->msgs, char *, n + 1));
+	MEM(pam_config->msg_error = talloc_realloc(pam_config, pam_config->msg_error, bool, n + 1));
+
+	va_start(ap, fmt);
+	MEM(pam_config->msgs[n] = talloc_vasprintf(pam_config->msgs, fmt, ap));
+	va_end(ap);
+	pam_config->msg_error[n] = error;
+}
+
 /** Dialogue between RADIUS and PAM modules
  *
  * Uses PAM's appdata_ptr so it's thread safe, and doesn't
@@ -103,11 +152,8 @@ static int pam_conv(int num_msg, struct pam_message const **msg, struct pam_resp
 {
 	int		count;
 	struct		pam_response *reply;
-	request_t		*request;
 	rlm_pam_data_t	*pam_config = (rlm_pam_data_t *) appdata_ptr;
 
-	request = pam_config->request;
-
 #define COPY_STRING(s) ((s) ? talloc_strdup(reply, s) : NULL)
 	MEM(reply = talloc_zero_array(NULL, struct pam_response, num_msg));
 	for (count = 0; count < num_msg; count++) {
@@ -123,15 +169,15 @@ static int pam_conv(int num_msg, struct pam_message const **msg, struct pam_resp
 			break;
 
 		case PAM_TEXT_INFO:
-			RDEBUG2("%s", msg[count]->msg);
+			pam_msg_add(pam_config, false, "%s", msg[count]->msg);
 			break;
 
 		case PAM_ERROR_MSG:
 		default:
-			RERROR("PAM conversation failed");
+			pam_msg_add(pam_config, true, "PAM conversation failed");
 			/* Must be an error of some sort... */
 			for (count = 0; count < num_msg; count++) {
-				if (msg[count]->msg_style == PAM_ERROR_MSG) RERROR("%s", msg[count]->msg);
+				if (msg[count]->msg_style == PAM_ERROR_MSG) pam_msg_add(pam_config, true, "%s", msg[count]->msg);
 				if (reply[count].resp) {
 	  				/* could be a password, let's be sanitary */
 	  				memset(reply[count].resp, 0, strlen(reply[count].resp));
@@ -149,49 +195,41 @@ static int pam_conv(int num_msg, struct pam_message const **msg, struct pam_resp
 }
 
 /** Check the users password against the standard UNIX password table + PAM.
+ *
+ * Runs in an offload thread, so it MUST NOT access the request.
  *
  * @note For most flexibility, passing a pamauth type to this function
  *	 allows you to have multiple authentication types (i.e. multiple
  *	 files associated with radius in /etc/pam.d).
  *
- * @param request The current request.
- * @param username User to authenticate.
- * @param passwd Password to authenticate with,
- * @param pamauth Type of PAM authentication.
- * @return
- *	- 0 on success.
- *	- -1 on failure.
+ * @param[in] uctx	#rlm_pam_data_t for the authentication.
+ *			pam_config->ret is set to 0 on success, or -1 on failure.
  */
-static int do_pam(request_t *request, char const *username, char const *passwd, char const *pamauth)
+static void do_pam(void *uctx)
 {
-	pam_handle_t *handle = NULL;
-	int ret;
-	rlm_pam_data_t pam_config;
+	rlm_pam_data_t	*pam_config = talloc_get_type_abort(uctx, rlm_pam_data_t);
+	pam_handle_t	*handle = NULL;
+	int		ret;
 	struct pam_conv conv;
 
 	/*
 	 *  Initialize the structures
 	 */
 	conv.conv = pam_conv;
-	conv.appdata_ptr = &pam_config;
-	pam_config.request = request;
-	pam_config.username = username;
-	pam_config.password = passwd;
-	pam_config.error = false;
+	conv.appdata_ptr = pam_config;
+	pam_config->ret = -1;
 
-	RDEBUG2("Using pamauth string \"%s\" for pam.conf lookup", pamauth);
-
-	ret = pam_start(pamauth, username, &conv, &handle);
+	ret = pam_start(pam_config->pam_auth, pam_config->username, &conv, &handle);
 	if (ret != PAM_SUCCESS) {
-		RERROR("pam_start failed: %s", pam_strerror(handle, ret));
-		return -1;
+		pam_msg_add(pam_config, true, "pam_start failed: %s", pam_strerror(handle, ret));
+		return;
 	}
 
 	ret = pam_authenticate(handle, 0);
 	if (ret != PAM_SUCCESS) {
-		RERROR("pam_authenticate failed: %s", pam_strerror(handle, ret));
+		pam_msg_add(pam_config, true, "pam_authenticate failed: %s", pam_strerror(handle, ret));
 		pam_end(handle, ret);
-		return -1;
+		return;
 	}
 
 	/*
@@ -201,20 +239,45 @@ static int do_pam(request_t *request, char const *username, char const *passwd,
 #if !defined(__FreeBSD_version) || (__FreeBSD_version >= 400000)
 	ret = pam_acct_mgmt(handle, 0);
 	if (ret != PAM_SUCCESS) {
-		RERROR("pam_acct_mgmt failed: %s", pam_strerror(handle, ret));
+		pam_msg_add(pam_config, true, "pam_acct_mgmt failed: %s", pam_strerror(handle, ret));
 		pam_end(handle, ret);
-		return -1;
+		return;
 	}
 #endif
-	RDEBUG2("Authentication succeeded");
 	pam_end(handle, ret);
-	return 0;
+	pam_config->ret = 0;
+}
+
+/** Log the messages from PAM, and return the result of the authentication
+ *
+ */
+static unlang_action_t CC_HINT(nonnull) mod_authenticate_resume(rlm_rcode_t *p_result, module_ctx_t const *mctx,
+								request_t *request)
+{
+	rlm_pam_data_t	*pam_config = talloc_get_type_abort(mctx->rctx, rlm_pam_data_t);
+	size_t		i;
+	int		ret = pam_config->ret;
+
+	for (i = 0; i < talloc_array_length(pam_config->msgs); i++) {
+		if (pam_config->msg_error[i]) {
+			RERROR("%s", pam_config->msgs[i]);
+		} else {
+			RDEBUG2("%s", pam_config->msgs[i]);
+		}
+	}
+
+	talloc_free(pam_config);
+
+	if (ret < 0) RETURN_MODULE_REJECT;
+
+	RDEBUG2("Authentication succeeded");
+	RETURN_MODULE_OK;
 }
 
 static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result, module_ctx_t const *mctx, request_t *request)
 {
 	rlm_pam_t const		*data = talloc_get_type_abort_const(mctx->inst->data, rlm_pam_t);
-	int			ret;
+	rlm_pam_data_t		*pam_config;
 	fr_pair_t		*pair;
 
 	char const		*pam_auth_string = data->pam_auth_name;
@@ -261,10 +324,18 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 	pair = fr_pair_find_by_da(&request->control_pairs, NULL, attr_pam_auth);
 	if (pair) pam_auth_string = pair->vp_strvalue;
 
-	ret = do_pam(request, username->vp_strvalue, password->vp_strvalue, pam_auth_string);
-	if (ret < 0) RETURN_MODULE_REJECT;
+	RDEBUG2("Using pamauth string \"%s\" for pam.conf lookup", pam_auth_string);
 
-	RETURN_MODULE_OK;
+	/*
+	 *	The PAM calls are done in a helper thread, which may
+	 *	still be running after the request has been freed.
+	 */
+	MEM(pam_config = talloc_zero(NULL, rlm_pam_data_t));
+	pam_config->pam_auth = talloc_strdup(pam_config, pam_auth_string);
+	pam_config->username = talloc_strdup(pam_config, username->vp_strvalue);
+	pam_config->password = talloc_strdup(pam_config, password->vp_strvalue);
+
+	return unlang_offload_yield(p_result, request, data->offload, do_pam, mod_authenticate_resume, pam_config);
 }
 
 extern module_rlm_t rlm_pam;
@@ -272,7 +343,6 @@ module_rlm_t rlm_pam = {
 	.common = {
 		.magic		= MODULE_MAGIC_INIT,
 		.name		= "pam",
-		.flags		= MODULE_TYPE_THREAD_UNSAFE,	/* The PAM libraries are not thread-safe */
 		.inst_size	= sizeof(rlm_pam_t),
 		.config		= module_config,
 		.instantiate	= mod_instantiate
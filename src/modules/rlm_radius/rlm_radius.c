@@ -462,10 +462,11 @@ static int mod_bootstrap(module_inst_ctx_t const *mctx)
 	inst->name = mctx->inst->name;
 
 	/*
-	 *	These limits are specific to RADIUS, and cannot be over-ridden
+	 *	These limits are specific to RADIUS, and cannot be over-ridden.
+	 *
+	 *	The maximum depends on the transport, which checks it.
 	 */
 	FR_INTEGER_BOUND_CHECK("trunk.per_connection_max", inst->trunk_conf.max_req_per_conn, >=, 2);
-	FR_INTEGER_BOUND_CHECK("trunk.per_connection_max", inst->trunk_conf.max_req_per_conn, <=, 255);
 	FR_INTEGER_BOUND_CHECK("trunk.per_connection_target", inst->trunk_conf.target_req_per_conn, <=, inst->trunk_conf.max_req_per_conn / 2);
 
 	FR_TIME_DELTA_BOUND_CHECK("response_window", inst->zombie_period, >=, fr_time_delta_from_sec(1));
@@ -0,0 +1,2433 @@
+/*
+ *   This program is is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or (at
+ *   your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ * @file rlm_radius_tcp.c
+ * @brief RADIUS TCP and TLS (RadSec) transport
+ *
+ *  Packets are written to a stream, and replies are read back from it.
+ *  As per RFC 6613 Section 2.6, we never retransmit a packet over the
+ *  same connection.  The connection is reliable, so the home server
+ *  either answers, or the connection fails.
+ *
+ *  With "extended_id", a packet is identified by its ID AND its Request
+ *  Authenticator.  More than 256 packets can then be outstanding on one
+ *  connection.  Each packet also carries an extended ID in a
+ *  Proxy-State attribute, which the home server echoes back.  Replies
+ *  are found directly from the extended ID, and only that packet's
+ *  Response Authenticator has to be verified.
+ *
+ * @copyright 2024 Network RADIUS SAS
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/io/application.h>
+#include <freeradius-devel/io/listen.h>
+#include <freeradius-devel/io/pair.h>
+#include <freeradius-devel/missing.h>
+#include <freeradius-devel/server/connection.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/heap.h>
+
+#ifdef WITH_TLS
+#include <freeradius-devel/tls/base.h>
+#include <freeradius-devel/tls/log.h>
+#endif
+
+#include "rlm_radius.h"
+#include "track.h"
+
+#include <freeradius-devel/bio/fd.h>
+#ifdef WITH_TLS
+#include <freeradius-devel/bio/tls.h>
+#endif
+
+/*
+ *	RFC 7930 allows packets of up to 65535 octets over TCP.
+ */
+#define TCP_MAX_PACKET_SIZE	(65535)
+
+/** Static configuration for the module.
+ *
+ */
+typedef struct {
+	rlm_radius_t		*parent;		//!< rlm_radius instance.
+	CONF_SECTION		*config;
+
+	fr_ipaddr_t		dst_ipaddr;		//!< IP of the home server.
+	fr_ipaddr_t		src_ipaddr;		//!< IP we open our socket on.
+	uint16_t		dst_port;		//!< Port of the home server.
+	char const		*secret;		//!< Shared secret.
+
+	char const		*interface;		//!< Interface to bind to.
+
+	uint32_t		recv_buff;		//!< How big the kernel's receive buffer should be.
+	uint32_t		send_buff;		//!< How big the kernel's send buffer should be.
+
+	uint32_t		max_packet_size;	//!< Maximum packet size.
+
+	bool			recv_buff_is_set;	//!< Whether we were provided with a recv_buf
+	bool			send_buff_is_set;	//!< Whether we were provided with a send_buf
+
+	bool			extended_id;		//!< Identify packets by ID and Request Authenticator.
+
+	fr_trunk_conf_t		*trunk_conf;		//!< trunk configuration
+
+#ifdef WITH_TLS
+	fr_tls_conf_t		*tls_conf;		//!< from the "tls" subsection.  NULL for plain TCP.
+#endif
+} rlm_radius_tcp_t;
+
+typedef struct {
+	fr_event_list_t		*el;			//!< Event list.
+
+	rlm_radius_tcp_t const	*inst;			//!< our instance
+
+	fr_trunk_t		*trunk;			//!< trunk handler
+
+#ifdef WITH_TLS
+	SSL_CTX			*ssl_ctx;		//!< Thread local SSL_CTX.
+	SSL_SESSION		*session;		//!< From the last connection, for resumption.
+#endif
+} tcp_thread_t;
+
+typedef struct {
+	fr_trunk_request_t	*treq;
+	rlm_rcode_t		rcode;			//!< from the transport
+} tcp_result_t;
+
+typedef struct tcp_request_s tcp_request_t;
+
+/** Track the handle, which is tightly correlated with the FD
+ *
+ */
+typedef struct {
+	char const     		*name;			//!< From IP PORT to IP PORT.
+	char const		*module_name;		//!< the module that opened the connection
+
+	int			fd;			//!< File descriptor, owned by fd_bio.
+
+	fr_bio_fd_config_t	fd_config;		//!< How fd_bio was opened.
+	fr_bio_t		*fd_bio;		//!< Talks to the socket.
+	fr_bio_t		*bio;			//!< Top of the bio chain.  Either fd_bio, or a TLS bio.
+
+	rlm_radius_tcp_t const	*inst;			//!< Our module instance.
+	tcp_thread_t		*thread;
+
+	uint32_t		max_packet_size;	//!< Our max packet size. may be different from the parent.
+
+	uint8_t			*buffer;		//!< Receive buffer.
+	size_t			buflen;			//!< Receive buffer length.
+	size_t			used;			//!< How much of the receive buffer holds partial packets.
+
+	uint8_t			*send_buffer;		//!< Data we haven't yet been able to write.
+	size_t			send_len;		//!< How much data is in send_buffer.
+
+	fr_trunk_connection_event_t notify_on;		//!< What the trunk last asked to be notified about.
+
+	radius_track_t		*tt;			//!< RADIUS ID tracking structure.
+
+	fr_time_t		mrs_time;		//!< Most recent sent time which had a reply.
+	fr_time_t		last_reply;		//!< When we last received a reply.
+	fr_time_t		first_sent;		//!< first time we sent a packet since going idle
+	fr_time_t		last_sent;		//!< last time we sent a packet.
+	fr_time_t		last_idle;		//!< last time we had nothing to do
+
+	fr_event_timer_t const	*zombie_ev;		//!< Zombie timeout.
+
+	bool			status_checking;       	//!< whether we're doing status checks
+	tcp_request_t		*status_u;		//!< for sending status check packets
+	tcp_result_t		*status_r;		//!< for faking out status checks as real packets
+	request_t		*status_request;
+} tcp_handle_t;
+
+
+/** Connect request_t to local tracking structure
+ *
+ */
+struct tcp_request_s {
+	uint32_t		priority;		//!< copied from request->async->priority
+	fr_time_t		recv_time;		//!< copied from request->async->recv_time
+
+	uint32_t		num_replies;		//!< number of reply packets, sent is in retry.count
+
+	bool			require_ma;		//!< saved from the original packet.
+	bool			status_check;		//!< is this packet a status check?
+
+	fr_pair_list_t		extra;			//!< VPs for debugging, like Proxy-State.
+
+	uint8_t			code;			//!< Packet code.
+	uint8_t			id;			//!< Last ID assigned to this packet.
+	uint8_t			*packet;		//!< Packet we write to the network.
+	size_t			packet_len;		//!< Length of the packet.
+
+	radius_track_entry_t	*rr;			//!< ID tracking, resend count, etc.
+	fr_event_timer_t const	*ev;			//!< timer for the response, or the next status check
+	fr_retry_t		retry;			//!< timestamps, and status check timers
+};
+
+/** Passed to the reply matching function when using extended_id
+ *
+ */
+typedef struct {
+	tcp_handle_t		*h;
+	uint8_t			*packet;		//!< The reply we're trying to match.
+} tcp_match_t;
+
+static const conf_parser_t module_config[] = {
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipaddr", FR_TYPE_COMBO_IP_ADDR, 0, rlm_radius_tcp_t, dst_ipaddr), },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipv4addr", FR_TYPE_IPV4_ADDR, 0, rlm_radius_tcp_t, dst_ipaddr) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("ipv6addr", FR_TYPE_IPV6_ADDR, 0, rlm_radius_tcp_t, dst_ipaddr) },
+
+	{ FR_CONF_OFFSET("port", rlm_radius_tcp_t, dst_port) },
+
+	{ FR_CONF_OFFSET_FLAGS("secret", CONF_FLAG_REQUIRED, rlm_radius_tcp_t, secret) },
+
+	{ FR_CONF_OFFSET("interface", rlm_radius_tcp_t, interface) },
+
+	{ FR_CONF_OFFSET_IS_SET("recv_buff", FR_TYPE_UINT32, 0, rlm_radius_tcp_t, recv_buff) },
+	{ FR_CONF_OFFSET_IS_SET("send_buff", FR_TYPE_UINT32, 0, rlm_radius_tcp_t, send_buff) },
+
+	{ FR_CONF_OFFSET("max_packet_size", rlm_radius_tcp_t, max_packet_size), .dflt = "4096" },
+
+	{ FR_CONF_OFFSET("extended_id", rlm_radius_tcp_t, extended_id), .dflt = "no" },
+
+	{ FR_CONF_OFFSET_TYPE_FLAGS("src_ipaddr", FR_TYPE_COMBO_IP_ADDR, 0, rlm_radius_tcp_t, src_ipaddr) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("src_ipv4addr", FR_TYPE_IPV4_ADDR, 0, rlm_radius_tcp_t, src_ipaddr) },
+	{ FR_CONF_OFFSET_TYPE_FLAGS("src_ipv6addr", FR_TYPE_IPV6_ADDR, 0, rlm_radius_tcp_t, src_ipaddr) },
+
+	CONF_PARSER_TERMINATOR
+};
+
+static fr_dict_t const *dict_radius;
+
+extern fr_dict_autoload_t rlm_radius_tcp_dict[];
+fr_dict_autoload_t rlm_radius_tcp_dict[] = {
+	{ .out = &dict_radius, .proto = "radius" },
+	{ NULL }
+};
+
+static fr_dict_attr_t const *attr_acct_delay_time;
+static fr_dict_attr_t const *attr_error_cause;
+static fr_dict_attr_t const *attr_event_timestamp;
+static fr_dict_attr_t const *attr_extended_attribute_1;
+static fr_dict_attr_t const *attr_message_authenticator;
+static fr_dict_attr_t const *attr_nas_identifier;
+static fr_dict_attr_t const *attr_original_packet_code;
+static fr_dict_attr_t const *attr_proxy_state;
+static fr_dict_attr_t const *attr_user_password;
+static fr_dict_attr_t const *attr_packet_type;
+
+extern fr_dict_attr_autoload_t rlm_radius_tcp_dict_attr[];
+fr_dict_attr_autoload_t rlm_radius_tcp_dict_attr[] = {
+	{ .out = &attr_acct_delay_time, .name = "Acct-Delay-Time", .type = FR_TYPE_UINT32, .dict = &dict_radius},
+	{ .out = &attr_error_cause, .name = "Error-Cause", .type = FR_TYPE_UINT32, .dict = &dict_radius },
+	{ .out = &attr_event_timestamp, .name = "Event-Timestamp", .type = FR_TYPE_DATE, .dict = &dict_radius},
+	{ .out = &attr_extended_attribute_1, .name = "Extended-Attribute-1", .type = FR_TYPE_TLV, .dict = &dict_radius},
+	{ .out = &attr_message_authenticator, .name = "Message-Authenticator", .type = FR_TYPE_OCTETS, .dict = &dict_radius},
+	{ .out = &attr_nas_identifier, .name = "NAS-Identifier", .type = FR_TYPE_STRING, .dict = &dict_radius},
+	{ .out = &attr_original_packet_code, .name = "Extended-Attribute-1.Original-Packet-Code", .type = FR_TYPE_UINT32, .dict = &dict_radius},
+	{ .out = &attr_proxy_state, .name = "Proxy-State", .type = FR_TYPE_OCTETS, .dict = &dict_radius},
+	{ .out = &attr_user_password, .name = "User-Password", .type = FR_TYPE_STRING, .dict = &dict_radius},
+	{ .out = &attr_packet_type, .name = "Packet-Type", .type = FR_TYPE_UINT32, .dict = &dict_radius },
+	{ NULL }
+};
+
+/** Turn a reply code into a module rcode;
+ *
+ */
+static rlm_rcode_t radius_code_to_rcode[FR_RADIUS_CODE_MAX] = {
+	[FR_RADIUS_CODE_ACCESS_ACCEPT]		= RLM_MODULE_OK,
+	[FR_RADIUS_CODE_ACCESS_CHALLENGE]	= RLM_MODULE_UPDATED,
+	[FR_RADIUS_CODE_ACCESS_REJECT]		= RLM_MODULE_REJECT,
+
+	[FR_RADIUS_CODE_ACCOUNTING_RESPONSE]	= RLM_MODULE_OK,
+
+	[FR_RADIUS_CODE_COA_ACK]		= RLM_MODULE_OK,
+	[FR_RADIUS_CODE_COA_NAK]		= RLM_MODULE_REJECT,
+
+	[FR_RADIUS_CODE_DISCONNECT_ACK]	= RLM_MODULE_OK,
+	[FR_RADIUS_CODE_DISCONNECT_NAK]	= RLM_MODULE_REJECT,
+
+	[FR_RADIUS_CODE_PROTOCOL_ERROR]	= RLM_MODULE_HANDLED,
+};
+
+static void		thread_conn_notify(fr_trunk_connection_t *tconn, fr_connection_t *conn,
+					   fr_event_list_t *el,
+					   fr_trunk_connection_event_t notify_on, UNUSED void *uctx);
+
+#ifndef NDEBUG
+/** Log additional information about a tracking entry
+ *
+ * @param[in] te	Tracking entry we're logging information for.
+ * @param[in] log	destination.
+ * @param[in] log_type	Type of log message.
+ * @param[in] file	the logging request was made in.
+ * @param[in] line 	logging request was made on.
+ */
+static void tcp_tracking_entry_log(fr_log_t const *log, fr_log_type_t log_type, char const *file, int line,
+				   radius_track_entry_t *te)
+{
+	request_t			*request;
+
+	if (!te->request) return;	/* Free entry */
+
+	request = talloc_get_type_abort(te->request, request_t);
+
+	fr_log(log, log_type, file, line, "request %s, allocated %s:%u", request->name,
+	       request->alloc_file, request->alloc_line);
+
+	fr_trunk_request_state_log(log, log_type, file, line, talloc_get_type_abort(te->uctx, fr_trunk_request_t));
+}
+#endif
+
+/** Clear out any connection specific resources from a tcp request
+ *
+ */
+static void tcp_request_reset(tcp_request_t *u)
+{
+	TALLOC_FREE(u->packet);
+	fr_pair_list_init(&u->extra);	/* Freed with packet */
+
+	if (u->rr) radius_track_entry_release(&u->rr);
+}
+
+/** Reset a status_check packet, ready to reuse
+ *
+ */
+static void status_check_reset(tcp_handle_t *h, tcp_request_t *u)
+{
+	fr_assert(u->status_check == true);
+
+	h->status_checking = false;
+	u->num_replies = 0;	/* Reset */
+	u->retry.start = fr_time_wrap(0);
+
+	if (u->ev) (void) fr_event_timer_delete(&u->ev);
+
+	tcp_request_reset(u);
+}
+
+/*
+ *	Status-Server checks.  Manually build the packet, and
+ *	all of its associated glue.
+ */
+static void CC_HINT(nonnull) status_check_alloc(tcp_handle_t *h)
+{
+	tcp_request_t		*u;
+	request_t		*request;
+	rlm_radius_tcp_t const	*inst = h->inst;
+	map_t			*map = NULL;
+
+	fr_assert(!h->status_u && !h->status_r && !h->status_request);
+
+	u = talloc_zero(h, tcp_request_t);
+	fr_pair_list_init(&u->extra);
+
+	/*
+	 *	Status checks are prioritized over any other packet
+	 */
+	u->priority = ~(uint32_t) 0;
+	u->status_check = true;
+
+	/*
+	 *	Allocate outside of the free list.  See
+	 *	rlm_radius_udp.c for why.
+	 */
+	request = request_local_alloc_external(u, NULL);
+	request->async = talloc_zero(request, fr_async_t);
+	talloc_const_free(request->name);
+	request->name = talloc_strdup(request, h->module_name);
+
+	request->packet = fr_radius_packet_alloc(request, false);
+	request->reply = fr_radius_packet_alloc(request, false);
+
+	/*
+	 *	Create the VPs, and ignore any errors
+	 *	creating them.
+	 */
+	while ((map = map_list_next(&inst->parent->status_check_map, map))) {
+		/*
+		 *	Skip things which aren't attributes.
+		 */
+		if (!tmpl_is_attr(map->lhs)) continue;
+
+		/*
+		 *	Ignore internal attributes.
+		 */
+		if (tmpl_attr_tail_da(map->lhs)->flags.internal) continue;
+
+		/*
+		 *	Ignore signalling attributes.  They shouldn't exist.
+		 */
+		if ((tmpl_attr_tail_da(map->lhs) == attr_proxy_state) ||
+		    (tmpl_attr_tail_da(map->lhs) == attr_message_authenticator)) continue;
+
+		/*
+		 *	Allow passwords only in Access-Request packets.
+		 */
+		if ((inst->parent->status_check != FR_RADIUS_CODE_ACCESS_REQUEST) &&
+		    (tmpl_attr_tail_da(map->lhs) == attr_user_password)) continue;
+
+		(void) map_to_request(request, map, map_to_vp, NULL);
+	}
+
+	/*
+	 *	Ensure that there's a NAS-Identifier, if one wasn't
+	 *	already added.
+	 */
+	if (!fr_pair_find_by_da(&request->request_pairs, NULL, attr_nas_identifier)) {
+		fr_pair_t *vp;
+
+		MEM(pair_append_request(&vp, attr_nas_identifier) >= 0);
+		fr_pair_value_strdup(vp, "status check - are you alive?", false);
+	}
+
+	/*
+	 *	Always add an Event-Timestamp, which will be the time
+	 *	at which the packet is sent.
+	 */
+	if (!fr_pair_find_by_da(&request->request_pairs, NULL, attr_event_timestamp)) {
+		MEM(pair_append_request(NULL, attr_event_timestamp) >= 0);
+	}
+
+	u->code = inst->parent->status_check;
+	request->packet->code = u->code;
+
+	DEBUG3("%s - Status check packet type will be %s", h->module_name, fr_radius_packet_names[u->code]);
+	log_request_pair_list(L_DBG_LVL_3, request, NULL, &request->request_pairs, NULL);
+
+	MEM(h->status_r = talloc_zero(request, tcp_result_t));
+	h->status_u = u;
+	h->status_request = request;
+}
+
+/** Free a connection handle, closing associated resources
+ *
+ */
+static int _tcp_handle_free(tcp_handle_t *h)
+{
+	if (h->status_u) fr_event_timer_delete(&h->status_u->ev);
+
+	if (h->fd >= 0) fr_event_fd_delete(h->thread->el, h->fd, FR_EVENT_FILTER_IO);
+
+#ifdef WITH_TLS
+	/*
+	 *	Remember the session, so that the next connection
+	 *	can resume it.
+	 */
+	if (h->bio != h->fd_bio) {
+		SSL_SESSION *session = SSL_get1_session(fr_bio_tls_ssl(h->bio));
+
+		if (session && SSL_SESSION_is_resumable(session)) {
+			if (h->thread->session) SSL_SESSION_free(h->thread->session);
+			h->thread->session = session;
+
+		} else if (session) {
+			SSL_SESSION_free(session);
+		}
+	}
+#endif
+
+	/*
+	 *	The bios are children of the handle, but they have to
+	 *	be freed from the top of the chain down.  Which also
+	 *	sends a TLS close_notify, and closes the socket.
+	 */
+	if (h->bio) {
+		(void) fr_bio_shutdown(h->bio);
+		(void) fr_bio_free(h->bio);
+		h->bio = h->fd_bio = NULL;
+	}
+
+	h->fd = -1;
+
+	DEBUG("%s - Connection closed - %s", h->module_name, h->name);
+
+	return 0;
+}
+
+/** Set the connection name from the actual source IP and port
+ *
+ */
+static void conn_name_set(tcp_handle_t *h)
+{
+	fr_bio_fd_info_t const *info = fr_bio_fd_info(h->fd_bio);
+
+	talloc_const_free(h->name);
+	h->name = fr_asprintf(h, "proto %s local %pV port %u remote %pV port %u",
+			      (h->bio != h->fd_bio) ? "tls" : "tcp",
+			      fr_box_ipaddr(info->socket.inet.src_ipaddr), info->socket.inet.src_port,
+			      fr_box_ipaddr(h->inst->dst_ipaddr), h->inst->dst_port);
+}
+
+/** Connection errored
+ *
+ * We were signalled by the event loop that a fatal error occurred on this connection.
+ *
+ * @param[in] el	The event list signalling.
+ * @param[in] fd	that errored.
+ * @param[in] flags	El flags.
+ * @param[in] fd_errno	The nature of the error.
+ * @param[in] uctx	The connection.
+ */
+static void conn_error_connect(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, int fd_errno, void *uctx)
+{
+	fr_connection_t		*conn = talloc_get_type_abort(uctx, fr_connection_t);
+	tcp_handle_t		*h;
+
+	/*
+	 *	Connection must be in the connecting state when this fires
+	 */
+	fr_assert(conn->state == FR_CONNECTION_STATE_CONNECTING);
+
+	h = talloc_get_type_abort(conn->h, tcp_handle_t);
+
+	ERROR("%s - Connection %s failed: %s", h->module_name, h->name, fr_syserror(fd_errno));
+
+	fr_connection_signal_reconnect(conn, FR_CONNECTION_FAILED);
+}
+
+#ifdef WITH_TLS
+/** Drive the TLS handshake
+ *
+ *  SSL_read() does the handshake for us.  We wait for whichever of
+ *  read or write OpenSSL needs next.
+ */
+static void conn_tls_handshake(fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	fr_connection_t		*conn = talloc_get_type_abort(uctx, fr_connection_t);
+	tcp_handle_t		*h = talloc_get_type_abort(conn->h, tcp_handle_t);
+	fr_bio_tls_info_t const	*info;
+	ssize_t			slen;
+	SSL			*ssl = fr_bio_tls_ssl(h->bio);
+
+	slen = fr_bio_read(h->bio, NULL, h->buffer + h->used, h->buflen - h->used);
+	if (slen < 0) {
+		PERROR("%s - TLS handshake failed on connection %s", h->module_name, h->name);
+	fail:
+		fr_connection_signal_reconnect(conn, FR_CONNECTION_FAILED);
+		return;
+	}
+
+	/*
+	 *	Home servers shouldn't send replies to packets we
+	 *	haven't sent, but keep anything they do send.  It's
+	 *	checked when the first real reply arrives.
+	 */
+	h->used += slen;
+
+	info = fr_bio_tls_info(h->bio);
+	if (!info->established) {
+		if (fr_event_fd_insert(h, el, h->fd, conn_tls_handshake,
+				       SSL_want_write(ssl) ? conn_tls_handshake : NULL,
+				       conn_error_connect, conn) < 0) {
+			PERROR("%s - Failed inserting FD event", h->module_name);
+			goto fail;
+		}
+		return;
+	}
+
+	DEBUG("%s - TLS session established (%s, %s) - %s", h->module_name,
+	      SSL_get_version(ssl), info->resumed ? "resumed" : "full handshake", h->name);
+
+	DEBUG("%s - Connection open - %s", h->module_name, h->name);
+
+	fr_event_fd_delete(el, h->fd, FR_EVENT_FILTER_IO);
+	fr_connection_signal_connected(conn);
+}
+#endif
+
+/** Finish the non-blocking connect, as soon as the socket becomes writable
+ *
+ */
+static void conn_writable_connect(fr_event_list_t *el, int fd, int flags, void *uctx)
+{
+	fr_connection_t		*conn = talloc_get_type_abort(uctx, fr_connection_t);
+	tcp_handle_t		*h = talloc_get_type_abort(conn->h, tcp_handle_t);
+
+	if (fr_bio_fd_connect(h->fd_bio) < 0) {
+		ERROR("%s - Failed connecting %s: %s", h->module_name, h->name, fr_syserror(errno));
+		fr_connection_signal_reconnect(conn, FR_CONNECTION_FAILED);
+		return;
+	}
+
+	conn_name_set(h);
+
+#ifdef WITH_TLS
+	if (h->bio != h->fd_bio) {
+		conn_tls_handshake(el, fd, flags, uctx);
+		return;
+	}
+#else
+	(void) fd;
+	(void) flags;
+#endif
+
+	DEBUG("%s - Connection open - %s", h->module_name, h->name);
+
+	/*
+	 *	The trunk only asks for I/O events once there are
+	 *	requests for this connection.  Until then, we
+	 *	don't want to be told that the socket is writable.
+	 */
+	fr_event_fd_delete(el, h->fd, FR_EVENT_FILTER_IO);
+	fr_connection_signal_connected(conn);
+}
+
+/** Initialise a new outbound connection
+ *
+ * @param[out] h_out	Where to write the new file descriptor.
+ * @param[in] conn	to initialise.
+ * @param[in] uctx	A #tcp_thread_t
+ */
+static fr_connection_state_t conn_init(void **h_out, fr_connection_t *conn, void *uctx)
+{
+	tcp_handle_t		*h;
+	tcp_thread_t		*thread = talloc_get_type_abort(uctx, tcp_thread_t);
+	rlm_radius_tcp_t const	*inst = thread->inst;
+
+	MEM(h = talloc_zero(conn, tcp_handle_t));
+	h->thread = thread;
+	h->inst = inst;
+	h->module_name = inst->parent->name;
+	h->max_packet_size = inst->max_packet_size;
+	h->last_idle = fr_time();
+	h->fd = -1;
+
+	/*
+	 *	The home server can send us replies of any size, and
+	 *	there may be a partial reply at the end of the buffer.
+	 */
+	h->buflen = TCP_MAX_PACKET_SIZE + 1;
+	MEM(h->buffer = talloc_array(h, uint8_t, h->buflen));
+	MEM(h->send_buffer = talloc_array(h, uint8_t, h->max_packet_size));
+
+	MEM(h->tt = radius_track_alloc(h));
+	radius_track_use_authenticator(h->tt, inst->extended_id);
+
+	h->fd_config = (fr_bio_fd_config_t) {
+		.type = FR_BIO_FD_CONNECTED,
+		.socket_type = SOCK_STREAM,
+		.src_ipaddr = inst->src_ipaddr,
+		.dst_ipaddr = inst->dst_ipaddr,
+		.dst_port = inst->dst_port,
+		.interface = inst->interface,
+		.recv_buff = inst->recv_buff_is_set ? inst->recv_buff : 0,
+		.send_buff = inst->send_buff_is_set ? inst->send_buff : 0,
+		.async = true,
+	};
+
+	h->name = fr_asprintf(h, "proto %s remote %pV port %u",
+#ifdef WITH_TLS
+			      inst->tls_conf ? "tls" :
+#endif
+			      "tcp",
+			      fr_box_ipaddr(inst->dst_ipaddr), inst->dst_port);
+
+	/*
+	 *	Open the outgoing socket, and start connecting.
+	 */
+	h->fd_bio = fr_bio_fd_alloc(h, NULL, &h->fd_config, 0);
+	if (!h->fd_bio) {
+		PERROR("%s - Failed opening socket", h->module_name);
+	fail:
+		talloc_free(h);
+		return FR_CONNECTION_STATE_FAILED;
+	}
+	h->bio = h->fd_bio;
+	h->fd = fr_bio_fd_info(h->fd_bio)->socket.fd;
+
+	talloc_set_destructor(h, _tcp_handle_free);
+
+#ifdef WITH_TLS
+	if (inst->tls_conf) {
+		SSL	*ssl;
+		fr_bio_t *tls_bio;
+
+		ssl = SSL_new(thread->ssl_ctx);
+		if (!ssl) {
+			fr_tls_log(NULL, "%s - Failed creating TLS session", h->module_name);
+			goto fail;
+		}
+
+		SSL_set_connect_state(ssl);
+		SSL_set_verify(ssl, SSL_VERIFY_PEER, NULL);
+
+		/*
+		 *	Data which couldn't be written is copied to
+		 *	send_buffer, and written from there.
+		 */
+		SSL_set_mode(ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+		if (thread->session) (void) SSL_set_session(ssl, thread->session);
+
+		tls_bio = fr_bio_tls_alloc(h, NULL, ssl, h->fd_bio);
+		if (!tls_bio) {
+			ERROR("%s - Failed allocating TLS bio", h->module_name);
+			goto fail;
+		}
+		h->bio = tls_bio;
+	}
+#endif
+
+	/*
+	 *	Status checks are only used to see if a zombie
+	 *	connection is still alive.  A TCP connection is alive
+	 *	as soon as it's connected.
+	 */
+	if (inst->parent->status_check) status_check_alloc(h);
+
+	if (fr_event_fd_insert(h, conn->el, h->fd, NULL,
+			       conn_writable_connect, conn_error_connect, conn) < 0) {
+		PERROR("%s - Failed inserting FD event", h->module_name);
+		goto fail;
+	}
+
+	*h_out = h;
+
+	return FR_CONNECTION_STATE_CONNECTING;
+}
+
+/** Shutdown/close a file descriptor
+ *
+ */
+static void conn_close(UNUSED fr_event_list_t *el, void *handle, UNUSED void *uctx)
+{
+	tcp_handle_t *h = talloc_get_type_abort(handle, tcp_handle_t);
+
+	/*
+	 *	There's tracking entries still allocated
+	 *	this is bad, they should have all been
+	 *	released.
+	 */
+	if (h->tt && (h->tt->num_requests != 0)) {
+#ifndef NDEBUG
+		radius_track_state_log(&default_log, L_ERR, __FILE__, __LINE__, h->tt, tcp_tracking_entry_log);
+#endif
+		fr_assert_fail("%u tracking entries still allocated at conn close", h->tt->num_requests);
+	}
+
+	DEBUG4("Freeing rlm_radius_tcp handle %p", handle);
+
+	talloc_free(h);
+}
+
+/** Connection failed
+ *
+ * @param[in] handle   	of connection that failed.
+ * @param[in] state	the connection was in when it failed.
+ * @param[in] uctx	UNUSED.
+ */
+static fr_connection_state_t conn_failed(void *handle, fr_connection_state_t state, UNUSED void *uctx)
+{
+	switch (state) {
+	/*
+	 *	If the connection was connected when it failed,
+	 *	we need to handle any outstanding packets and
+	 *	timer events before reconnecting.
+	 */
+	case FR_CONNECTION_STATE_CONNECTED:
+	{
+		tcp_handle_t	*h = talloc_get_type_abort(handle, tcp_handle_t); /* h only available if connected */
+
+		/*
+		 *	Reset the Status-Server checks.
+		 */
+		if (h->status_u && h->status_u->ev) (void) fr_event_timer_delete(&h->status_u->ev);
+	}
+		break;
+
+	default:
+		break;
+	}
+
+	return FR_CONNECTION_STATE_INIT;
+}
+
+static fr_connection_t *thread_conn_alloc(fr_trunk_connection_t *tconn, fr_event_list_t *el,
+					  fr_connection_conf_t const *conf,
+					  char const *log_prefix, void *uctx)
+{
+	fr_connection_t		*conn;
+	tcp_thread_t		*thread = talloc_get_type_abort(uctx, tcp_thread_t);
+
+	conn = fr_connection_alloc(tconn, el,
+				   &(fr_connection_funcs_t){
+					.init = conn_init,
+					.close = conn_close,
+					.failed = conn_failed
+				   },
+				   conf,
+				   log_prefix,
+				   thread);
+	if (!conn) {
+		PERROR("%s - Failed allocating state handler for new connection", thread->inst->parent->name);
+		return NULL;
+	}
+
+	return conn;
+}
+
+/** Connection errored
+ *
+ * We were signalled by the event loop that a fatal error occurred on this connection.
+ *
+ * @param[in] el	The event list signalling.
+ * @param[in] fd	that errored.
+ * @param[in] flags	El flags.
+ * @param[in] fd_errno	The nature of the error.
+ * @param[in] uctx	The trunk connection handle (tconn).
+ */
+static void conn_error(UNUSED fr_event_list_t *el, UNUSED int fd, UNUSED int flags, int fd_errno, void *uctx)
+{
+	fr_trunk_connection_t	*tconn = talloc_get_type_abort(uctx, fr_trunk_connection_t);
+	fr_connection_t		*conn = tconn->conn;
+	tcp_handle_t		*h = talloc_get_type_abort(conn->h, tcp_handle_t);
+
+	ERROR("%s - Connection %s failed: %s", h->module_name, h->name, fr_syserror(fd_errno));
+
+	fr_connection_signal_reconnect(conn, FR_CONNECTION_FAILED);
+}
+
+/** Write out data left over from a previous write
+ *
+ * @return
+ *	- <0 on error.  The connection should be reconnected.
+ *	- 0 if there is still data to write.
+ *	- 1 if everything has been written.
+ */
+static int send_buffer_flush(tcp_handle_t *h)
+{
+	ssize_t slen;
+
+	if (!h->send_len) return 1;
+
+	slen = fr_bio_write(h->bio, NULL, h->send_buffer, h->send_len);
+	if (slen == fr_bio_error(IO_WOULD_BLOCK)) return 0;
+	if (slen < 0) {
+		PERROR("%s - Failed writing to connection %s", h->module_name, h->name);
+		return -1;
+	}
+
+	/*
+	 *	Keep the remaining data at the start of the buffer.
+	 *	The TLS bio accepts the same data at a new address.
+	 */
+	if ((size_t) slen < h->send_len) {
+		memmove(h->send_buffer, h->send_buffer + slen, h->send_len - slen);
+		h->send_len -= slen;
+		return 0;
+	}
+
+	h->send_len = 0;
+	return 1;
+}
+
+/** Write data left over from a previous write, when the trunk isn't interested in writes
+ *
+ */
+static void conn_writable_flush(fr_event_list_t *el, UNUSED int fd, UNUSED int flags, void *uctx)
+{
+	fr_trunk_connection_t	*tconn = talloc_get_type_abort(uctx, fr_trunk_connection_t);
+	tcp_handle_t		*h = talloc_get_type_abort(tconn->conn->h, tcp_handle_t);
+
+	switch (send_buffer_flush(h)) {
+	case 0:
+		return;
+
+	case 1:
+		/*
+		 *	Stop asking for write events.
+		 */
+		thread_conn_notify(tconn, tconn->conn, el, h->notify_on, NULL);
+		return;
+
+	default:
+		fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+		return;
+	}
+}
+
+static void thread_conn_notify(fr_trunk_connection_t *tconn, fr_connection_t *conn,
+			       fr_event_list_t *el,
+			       fr_trunk_connection_event_t notify_on, UNUSED void *uctx)
+{
+	tcp_handle_t		*h = talloc_get_type_abort(conn->h, tcp_handle_t);
+	fr_event_fd_cb_t	read_fn = NULL;
+	fr_event_fd_cb_t	write_fn = NULL;
+
+	h->notify_on = notify_on;
+
+	switch (notify_on) {
+	/*
+	 *	Always read from the socket, so that we notice when
+	 *	the other end closes the connection.
+	 */
+	case FR_TRUNK_CONN_EVENT_NONE:
+	case FR_TRUNK_CONN_EVENT_READ:
+		read_fn = fr_trunk_connection_callback_readable;
+		break;
+
+	case FR_TRUNK_CONN_EVENT_WRITE:
+		write_fn = fr_trunk_connection_callback_writable;
+		break;
+
+	case FR_TRUNK_CONN_EVENT_BOTH:
+		read_fn = fr_trunk_connection_callback_readable;
+		write_fn = fr_trunk_connection_callback_writable;
+		break;
+
+	}
+
+	/*
+	 *	A packet was only partially written.  The rest of it
+	 *	has to be written before anything else, even if there
+	 *	are no more requests to send.
+	 */
+	if (h->send_len && !write_fn) write_fn = conn_writable_flush;
+
+	if (fr_event_fd_insert(h, el, h->fd,
+			       read_fn,
+			       write_fn,
+			       conn_error,
+			       tconn) < 0) {
+		PERROR("%s - Failed inserting FD event", h->module_name);
+
+		/*
+		 *	May free the connection!
+		 */
+		fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+	}
+}
+
+/*
+ *  Return negative numbers to put 'a' at the top of the heap.
+ *  Return positive numbers to put 'b' at the top of the heap.
+ *
+ *  We want the value with the lowest timestamp to be prioritized at
+ *  the top of the heap.
+ */
+static int8_t request_prioritise(void const *one, void const *two)
+{
+	tcp_request_t const *a = one;
+	tcp_request_t const *b = two;
+	int8_t ret;
+
+	/*
+	 *	Prioritise status check packets
+	 */
+	ret = (b->status_check - a->status_check);
+	if (ret != 0) return ret;
+
+	/*
+	 *	Larger priority is more important.
+	 */
+	ret = CMP(a->priority, b->priority);
+	if (ret != 0) return ret;
+
+	/*
+	 *	Smaller timestamp (i.e. earlier) is more important.
+	 */
+	return CMP_PREFER_SMALLER(fr_time_unwrap(a->recv_time), fr_time_unwrap(b->recv_time));
+}
+
+/** Decode response packet data, extracting relevant information and validating the packet
+ *
+ * @param[in] ctx			to allocate pairs in.
+ * @param[out] reply			Pointer to head of pair list to add reply attributes to.
+ * @param[out] response_code		The type of response packet.
+ * @param[in] h				connection handle.
+ * @param[in] request			the request.
+ * @param[in] u				TCP request.
+ * @param[in] request_authenticator	from the original request.
+ * @param[in] data			to decode.
+ * @param[in] data_len			Length of input data.
+ * @return
+ *	- DECODE_FAIL_NONE on success.
+ *	- DECODE_FAIL_* on failure.
+ */
+static decode_fail_t decode(TALLOC_CTX *ctx, fr_pair_list_t *reply, uint8_t *response_code,
+			    tcp_handle_t *h, request_t *request, tcp_request_t *u,
+			    uint8_t const request_authenticator[static RADIUS_AUTH_VECTOR_LENGTH],
+			    uint8_t *data, size_t data_len)
+{
+	rlm_radius_tcp_t const *inst = h->thread->inst;
+	uint8_t			code;
+	fr_radius_ctx_t		common_ctx;
+	fr_radius_decode_ctx_t	decode_ctx;
+
+	*response_code = 0;	/* Initialise to keep the rest of the code happy */
+
+	RHEXDUMP3(data, data_len, "Read packet");
+
+	common_ctx = (fr_radius_ctx_t) {
+		.secret = inst->secret,
+		.secret_length = talloc_array_length(inst->secret) - 1,
+	};
+
+	decode_ctx = (fr_radius_decode_ctx_t) {
+		.common = &common_ctx,
+		.request_code = u->code,
+		.request_authenticator = request_authenticator,
+		.tmp_ctx = talloc(ctx, uint8_t),
+		.end = data + data_len,
+		.verify = true,
+	};
+
+	if (fr_radius_decode(ctx, reply, data, data_len, &decode_ctx) < 0) {
+		talloc_free(decode_ctx.tmp_ctx);
+		RPEDEBUG("Failed reading packet");
+		return DECODE_FAIL_UNKNOWN;
+	}
+	talloc_free(decode_ctx.tmp_ctx);
+
+	code = data[0];
+
+	RDEBUG("Received %s ID %d length %ld reply packet on connection %s",
+	       fr_radius_packet_names[code], data[1], data_len, h->name);
+	log_request_pair_list(L_DBG_LVL_2, request, NULL, reply, NULL);
+
+	*response_code = code;
+
+	/*
+	 *	Record the fact we've seen a response
+	 */
+	u->num_replies++;
+
+	if (fr_time_gt(u->retry.start, h->mrs_time)) h->mrs_time = u->retry.start;
+
+	return DECODE_FAIL_NONE;
+}
+
+static int encode(rlm_radius_tcp_t const *inst, request_t *request, tcp_request_t *u, uint8_t id)
+{
+	ssize_t			packet_len;
+	uint8_t			*msg = NULL;
+	int			message_authenticator = u->require_ma * (RADIUS_MESSAGE_AUTHENTICATOR_LENGTH + 2);
+	int			proxy_state = 6;
+	int			extended_id = inst->extended_id * 10;
+
+	fr_assert(inst->parent->allowed[u->code]);
+	fr_assert(!u->packet);
+
+	/*
+	 *	This is essentially free, as this memory was
+	 *	pre-allocated as part of the treq.
+	 */
+	u->packet_len = inst->max_packet_size;
+	MEM(u->packet = talloc_array(u, uint8_t, u->packet_len));
+
+	/*
+	 *	All proxied Access-Request packets MUST have a
+	 *	Message-Authenticator, otherwise they're insecure.
+	 *	Same goes for Status-Server.
+	 *
+	 *	And we set the authentication vector to a random
+	 *	number...
+	 */
+	switch (u->code) {
+	case FR_RADIUS_CODE_ACCESS_REQUEST:
+	case FR_RADIUS_CODE_STATUS_SERVER:
+	{
+		size_t i;
+		uint32_t hash, base;
+
+		message_authenticator = RADIUS_MESSAGE_AUTHENTICATOR_LENGTH + 2;
+
+		base = fr_rand();
+		for (i = 0; i < RADIUS_AUTH_VECTOR_LENGTH; i += sizeof(uint32_t)) {
+			hash = fr_rand() ^ base;
+			memcpy(u->packet + RADIUS_AUTH_VECTOR_OFFSET + i, &hash, sizeof(hash));
+		}
+	}
+		FALL_THROUGH;
+
+	default:
+		break;
+	}
+
+	/*
+	 *	If we're sending a status check packet, update any
+	 *	necessary timestamps.  Also, don't add Proxy-State, as
+	 *	we're originating the packet.
+	 */
+	if (u->status_check) {
+		fr_pair_t *vp;
+
+		proxy_state = 0;
+		vp = fr_pair_find_by_da(&request->request_pairs, NULL, attr_event_timestamp);
+		if (vp) vp->vp_date = fr_time_to_unix_time(u->retry.updated);
+
+	} else if (inst->parent->originate) {
+		/*
+		 *	We're originating packets instead of proxying
+		 *	them.  We don't add a Proxy-State attribute.
+		 */
+		proxy_state = 0;
+	}
+
+	/*
+	 *	We should have at minimum 64-byte packets, so don't
+	 *	bother doing run-time checks here.
+	 */
+	fr_assert(u->packet_len >= (size_t) (RADIUS_HEADER_LENGTH + proxy_state + extended_id + message_authenticator));
+
+	/*
+	 *	Encode it, leaving room for Proxy-State and
+	 *	Message-Authenticator if necessary.
+	 */
+	packet_len = fr_radius_encode(u->packet, u->packet_len - (proxy_state + extended_id + message_authenticator), NULL,
+				      inst->secret, talloc_array_length(inst->secret) - 1,
+				      u->code, id, &request->request_pairs);
+	if (fr_pair_encode_is_error(packet_len)) {
+		RPERROR("Failed encoding packet");
+
+	error:
+		TALLOC_FREE(u->packet);
+		return -1;
+	}
+
+	if (packet_len < 0) {
+		size_t have;
+		size_t need;
+
+		have = u->packet_len - (proxy_state + extended_id + message_authenticator);
+		need = have - packet_len;
+
+		if (need > TCP_MAX_PACKET_SIZE) {
+			RERROR("Failed encoding packet.  Have %zu bytes of buffer, need %zu bytes",
+			       have, need);
+		} else {
+			RERROR("Failed encoding packet.  Have %zu bytes of buffer, need %zu bytes.  "
+			       "Increase 'max_packet_size'", have, need);
+		}
+
+		goto error;
+	}
+	/*
+	 *	The encoded packet should NOT over-run the input buffer.
+	 */
+	fr_assert((size_t) (packet_len + proxy_state + extended_id + message_authenticator) <= u->packet_len);
+
+	/*
+	 *	Add Proxy-State to the tail end of the packet.
+	 *
+	 *	We need to add it here, and NOT in
+	 *	request->request_pairs, because multiple modules
+	 *	may be sending the packets at the same time.
+	 */
+	if (proxy_state) {
+		uint8_t		*attr = u->packet + packet_len;
+		fr_pair_t	*vp;
+		fr_dcursor_t	cursor;
+		int		count = 0;
+
+		/*
+		 *	Count how many Proxy-State attributes have
+		 *	*our* magic number.  Note that we also add a
+		 *	counter to each Proxy-State, so we're double
+		 *	sure that it's a loop.
+		 */
+		if (DEBUG_ENABLED) {
+			for (vp = fr_pair_dcursor_by_da_init(&cursor, &request->request_pairs, attr_proxy_state);
+			     vp;
+			     vp = fr_dcursor_next(&cursor)) {
+				if ((vp->vp_length == 5) && (memcmp(vp->vp_octets, &inst->parent->proxy_state, 4) == 0)) {
+					count++;
+				}
+			}
+
+			/*
+			 *	Some configurations may proxy to
+			 *	ourselves for tests / simplicity.  But
+			 *	warn if there are a large number of
+			 *	identical Proxy-State attributes.
+			 */
+			if (count >= 4) RWARN("Potential proxy loop detected!  Please recheck your configuration.");
+		}
+
+		attr[0] = (uint8_t)attr_proxy_state->attr;
+		attr[1] = 7;
+		memcpy(attr + 2, &inst->parent->proxy_state, 4);
+		attr[6] = count & 0xff;
+		packet_len += 7;
+
+		MEM(vp = fr_pair_afrom_da(u->packet, attr_proxy_state));
+		fr_pair_value_memdup(vp, attr + 2, 5, true);
+		fr_pair_append(&u->extra, vp);
+	}
+
+	/*
+	 *	Add the extended ID as another Proxy-State, after
+	 *	any others.  The home server has to echo it back, so
+	 *	reply_process() can find this packet without
+	 *	checking every other packet with the same ID.
+	 *
+	 *	Status checks and originated packets get one too, as
+	 *	they share the same ID space.
+	 */
+	if (extended_id) {
+		uint8_t		*attr = u->packet + packet_len;
+
+		attr[0] = (uint8_t)attr_proxy_state->attr;
+		attr[1] = extended_id;
+		memcpy(attr + 2, &inst->parent->proxy_state, 4);
+		fr_nbo_from_uint32(attr + 6, u->rr->slot);
+		packet_len += extended_id;
+	}
+
+	/*
+	 *	Add Message-Authenticator manually.
+	 *
+	 *	Note that the length check will always pass, due to
+	 *	the buflen manipulation done above.
+	 */
+	if (message_authenticator) {
+		msg = u->packet + packet_len;
+
+		msg[0] = (uint8_t) attr_message_authenticator->attr;
+		msg[1] = RADIUS_MESSAGE_AUTHENTICATOR_LENGTH + 2;
+		memset(msg + 2, 0,  RADIUS_MESSAGE_AUTHENTICATOR_LENGTH);
+
+		packet_len += msg[1];
+	}
+
+	/*
+	 *	Update the packet header based on the new attributes.
+	 */
+	u->packet[2] = (packet_len >> 8) & 0xff;
+	u->packet[3] = packet_len & 0xff;
+	u->packet_len = packet_len;
+
+	/*
+	 *	Ensure that we update the Acct-Delay-Time based on the
+	 *	time difference between now, and when we originally
+	 *	received the request.
+	 */
+	if ((u->code == FR_RADIUS_CODE_ACCOUNTING_REQUEST) &&
+	    (fr_pair_find_by_da(&request->request_pairs, NULL, attr_acct_delay_time) != NULL)) {
+		uint8_t *attr, *end;
+		uint32_t delay;
+
+		end = u->packet + packet_len;
+
+		for (attr = u->packet + RADIUS_HEADER_LENGTH;
+		     attr < end;
+		     attr += attr[1]) {
+			if (attr[0] != attr_acct_delay_time->attr) continue;
+			if (attr[1] != 6) continue;
+
+			/*
+			 *	Add in the time between when
+			 *	we received the packet, and
+			 *	when we're sending the packet.
+			 */
+			memcpy(&delay, attr + 2, 4);
+			delay = ntohl(delay);
+			delay += fr_time_delta_to_sec(fr_time_sub(u->retry.updated, u->recv_time));
+			delay = htonl(delay);
+			memcpy(attr + 2, &delay, 4);
+			break;
+		}
+	}
+
+	/*
+	 *	Only certain types of packet, and those with a
+	 *	message_authenticator need signing.
+	 */
+	if (message_authenticator) goto sign;
+	switch (u->code) {
+	case FR_RADIUS_CODE_ACCOUNTING_REQUEST:
+	case FR_RADIUS_CODE_DISCONNECT_REQUEST:
+	case FR_RADIUS_CODE_COA_REQUEST:
+	sign:
+		/*
+		 *	Now that we're done mangling the packet, sign it.
+		 */
+		if (fr_radius_sign(u->packet, NULL, (uint8_t const *) inst->secret,
+				   talloc_array_length(inst->secret) - 1) < 0) {
+			RERROR("Failed signing packet");
+			goto error;
+		}
+		break;
+
+	default:
+		break;
+
+	}
+	return 0;
+}
+
+
+/** Revive a connection after "revive_interval"
+ *
+ */
+static void revive_timeout(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	fr_trunk_connection_t	*tconn = talloc_get_type_abort(uctx, fr_trunk_connection_t);
+	tcp_handle_t	 	*h = talloc_get_type_abort(tconn->conn->h, tcp_handle_t);
+
+	INFO("%s - Reviving connection %s", h->module_name, h->name);
+	fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+}
+
+/** Mark a connection dead after "zombie_interval"
+ *
+ */
+static void zombie_timeout(fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	fr_trunk_connection_t	*tconn = talloc_get_type_abort(uctx, fr_trunk_connection_t);
+	tcp_handle_t	 	*h = talloc_get_type_abort(tconn->conn->h, tcp_handle_t);
+
+	INFO("%s - No replies during 'zombie_period', marking connection %s as dead", h->module_name, h->name);
+
+	/*
+	 *	Don't use this connection, and re-queue all of its
+	 *	requests onto other connections.
+	 */
+	fr_trunk_connection_signal_inactive(tconn);
+	(void) fr_trunk_connection_requests_requeue(tconn, FR_TRUNK_REQUEST_STATE_ALL, 0, false);
+
+	/*
+	 *	Revive the connection after a time.
+	 */
+	if (fr_event_timer_at(h, el, &h->zombie_ev,
+			      fr_time_add(now, h->inst->parent->revive_interval), revive_timeout, tconn) < 0) {
+		ERROR("Failed inserting revive timeout for connection");
+		fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+	}
+}
+
+
+/** See if the connection is zombied.
+ *
+ *  The connection may be open, but the home server may not be
+ *  answering.  We check for zombie when a request times out.
+ *
+ * @return
+ *	- true if the connection is zombie.
+ *	- false if the connection is not zombie.
+ */
+static bool check_for_zombie(fr_event_list_t *el, fr_trunk_connection_t *tconn, fr_time_t now, fr_time_t last_sent)
+{
+	tcp_handle_t	*h = talloc_get_type_abort(tconn->conn->h, tcp_handle_t);
+
+	/*
+	 *	If we're status checking OR already zombie, don't go to zombie
+	 */
+	if (h->status_checking || h->zombie_ev) return true;
+
+	if (fr_time_eq(now, fr_time_wrap(0))) now = fr_time();
+
+	/*
+	 *	We received a reply since this packet was sent, the connection isn't zombie.
+	 */
+	if (fr_time_gteq(h->last_reply, last_sent)) return false;
+
+	WARN("%s - Entering Zombie state - connection %s", h->module_name, h->name);
+	if (h->inst->parent->status_check) {
+		h->status_checking = true;
+
+		/*
+		 *	Queue up the status check packet.  It will be sent
+		 *	when the connection is writable.
+		 */
+		h->status_u->retry.start = fr_time_wrap(0);
+		h->status_r->treq = NULL;
+
+		if (fr_trunk_request_enqueue_on_conn(&h->status_r->treq, tconn, h->status_request,
+						     h->status_u, h->status_r, true) != FR_TRUNK_ENQUEUE_OK) {
+			fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+		}
+	} else {
+		if (fr_event_timer_at(h, el, &h->zombie_ev, fr_time_add(now, h->inst->parent->zombie_period),
+				      zombie_timeout, tconn) < 0) {
+			ERROR("Failed inserting zombie timeout for connection");
+			fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+		}
+	}
+
+	return true;
+}
+
+/** How long we wait for a reply to a request
+ *
+ *  There are no retransmissions, so the retransmission timers
+ *  only limit how long we wait in total.
+ */
+static fr_time_delta_t request_lifetime(rlm_radius_t const *parent, tcp_request_t const *u)
+{
+	if (!parent->synchronous && fr_time_delta_ispos(parent->retry[u->code].mrd)) return parent->retry[u->code].mrd;
+
+	return parent->response_window;
+}
+
+/** The home server didn't reply in time
+ *
+ */
+static void request_timeout(fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	fr_trunk_request_t	*treq = talloc_get_type_abort(uctx, fr_trunk_request_t);
+	tcp_request_t		*u = talloc_get_type_abort(treq->preq, tcp_request_t);
+	tcp_result_t		*r = talloc_get_type_abort(treq->rctx, tcp_result_t);
+	request_t		*request = treq->request;
+	fr_trunk_connection_t	*tconn = treq->tconn;
+
+	fr_assert(treq->state == FR_TRUNK_REQUEST_STATE_SENT);		/* No other states should be timing out */
+	fr_assert(treq->preq);						/* Must still have a protocol request */
+	fr_assert(u->rr);
+	fr_assert(tconn);
+
+	fr_assert(!u->status_check);
+
+	REDEBUG("No reply after %pVs, failing request",
+		fr_box_time_delta(fr_time_sub(now, u->retry.start)));
+
+	r->rcode = RLM_MODULE_FAIL;
+	fr_trunk_request_signal_complete(treq);
+
+	check_for_zombie(el, tconn, now, u->retry.start);
+}
+
+static void status_check_retry(UNUSED fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	fr_trunk_request_t	*treq = talloc_get_type_abort(uctx, fr_trunk_request_t);
+	tcp_handle_t		*h;
+	tcp_request_t		*u = talloc_get_type_abort(treq->preq, tcp_request_t);
+	tcp_result_t		*r = talloc_get_type_abort(treq->rctx, tcp_result_t);
+	request_t		*request = treq->request;
+	fr_trunk_connection_t	*tconn = treq->tconn;
+
+	fr_assert(treq->state == FR_TRUNK_REQUEST_STATE_SENT);		/* No other states should be timing out */
+	fr_assert(treq->preq);						/* Must still have a protocol request */
+	fr_assert(u->rr);
+	fr_assert(tconn);
+
+	h = talloc_get_type_abort(treq->tconn->conn->h, tcp_handle_t);
+
+	fr_assert(u->status_check);
+
+	switch (fr_retry_next(&u->retry, now)) {
+	/*
+	 *	Send another status check.  It's a new packet, with
+	 *	a new ID, and not a retransmission.
+	 */
+	case FR_RETRY_CONTINUE:
+		fr_trunk_request_requeue(treq);
+		return;
+
+	case FR_RETRY_MRD:
+		REDEBUG("Reached maximum_retransmit_duration (%pVs > %pVs), failing request",
+			fr_box_time_delta(fr_time_sub(now, u->retry.start)), fr_box_time_delta(u->retry.config->mrd));
+		break;
+
+	case FR_RETRY_MRC:
+		REDEBUG("Reached maximum_retransmit_count (%u > %u), failing request",
+		        u->retry.count, u->retry.config->mrc);
+		break;
+	}
+
+	r->rcode = RLM_MODULE_FAIL;
+	fr_trunk_request_signal_complete(treq);
+
+	WARN("%s - No response to status check, marking connection as dead - %s", h->module_name, h->name);
+
+	/*
+	 *	We're no longer status checking, reconnect the
+	 *	connection.
+	 */
+	h->status_checking = false;
+	fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+}
+
+static void request_mux(fr_event_list_t *el,
+			fr_trunk_connection_t *tconn, fr_connection_t *conn, UNUSED void *uctx)
+{
+	tcp_handle_t		*h = talloc_get_type_abort(conn->h, tcp_handle_t);
+	rlm_radius_tcp_t const	*inst = h->inst;
+
+	/*
+	 *	Finish writing the previous packet.
+	 */
+	switch (send_buffer_flush(h)) {
+	case 0:
+		return;
+
+	case 1:
+		break;
+
+	default:
+		fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+		return;
+	}
+
+	while (true) {
+		fr_trunk_request_t	*treq;
+		tcp_request_t		*u;
+		request_t		*request;
+		ssize_t			slen;
+		char const		*action;
+
+ 		if (unlikely(fr_trunk_connection_pop_request(&treq, tconn) < 0)) return;
+
+		/*
+		 *	No more requests to send
+		 */
+		if (!treq) break;
+
+ 		fr_assert((treq->state == FR_TRUNK_REQUEST_STATE_PENDING) ||
+			   (treq->state == FR_TRUNK_REQUEST_STATE_PARTIAL));
+
+		request = treq->request;
+		u = talloc_get_type_abort(treq->preq, tcp_request_t);
+
+		if (fr_time_eq(u->retry.start, fr_time_wrap(0))) {
+			(void) fr_retry_init(&u->retry, fr_time(), &h->inst->parent->retry[u->code]);
+		}
+
+		/*
+		 *	We never retransmit over TCP, so the packet is
+		 *	always encoded from scratch.  Any previous
+		 *	packet was freed when the request was requeued.
+		 */
+		fr_assert(!u->packet && !u->rr);
+
+		if (unlikely(radius_track_entry_reserve(&u->rr, treq, h->tt, request, u->code, treq) < 0)) {
+#ifndef NDEBUG
+			radius_track_state_log(&default_log, L_ERR, __FILE__, __LINE__,
+					       h->tt, tcp_tracking_entry_log);
+#endif
+			fr_assert_fail("Tracking entry allocation failed: %s", fr_strerror());
+			fr_trunk_request_signal_fail(treq);
+			continue;
+		}
+		u->id = u->rr->id;
+
+		if (encode(h->inst, request, u, u->id) < 0) {
+		fail:
+			/*
+			 *	Need to do this because request_conn_release
+			 *	may not be called.
+			 */
+			tcp_request_reset(u);
+			if (u->ev) (void) fr_event_timer_delete(&u->ev);
+			fr_trunk_request_signal_fail(treq);
+			continue;
+		}
+
+		RDEBUG("Sending %s ID %d length %ld over connection %s",
+		       fr_radius_packet_names[u->code], u->id, u->packet_len, h->name);
+		RHEXDUMP3(u->packet, u->packet_len, "Encoded packet");
+
+		/*
+		 *	Remember the authentication vector, which now has the
+		 *	packet signature.
+		 *
+		 *	With extended_id, the vector is part of the packet
+		 *	identifier, and has to be unique for this ID.
+		 */
+		if (radius_track_entry_update(u->rr, u->packet + RADIUS_AUTH_VECTOR_OFFSET) < 0) {
+			RERROR("Failed sending packet - %s ID %d has the same authenticator as an outstanding packet",
+			       fr_radius_packet_names[u->code], u->id);
+			goto fail;
+		}
+
+		log_request_pair_list(L_DBG_LVL_2, request, NULL, &request->request_pairs, NULL);
+		if (!fr_pair_list_empty(&u->extra)) log_request_pair_list(L_DBG_LVL_2, request, NULL, &u->extra, NULL);
+
+		slen = fr_bio_write(h->bio, NULL, u->packet, u->packet_len);
+		if (slen == fr_bio_error(IO_WOULD_BLOCK)) slen = 0;
+		if (slen < 0) {
+			PERROR("%s - Failed sending data over connection %s", h->module_name, h->name);
+
+			/*
+			 *	Will re-queue any 'sent' requests, so we don't
+			 *	have to do any cleanup.
+			 */
+			fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+			return;
+		}
+
+		/*
+		 *	The rest of the packet has to be written before
+		 *	any other packet.  Save it, and treat the
+		 *	request as sent.
+		 */
+		if ((size_t) slen < u->packet_len) {
+			memcpy(h->send_buffer, u->packet + slen, u->packet_len - slen);
+			h->send_len = u->packet_len - slen;
+		}
+
+		fr_trunk_request_signal_sent(treq);
+
+		action = u->status_check ? "Sent" : (inst->parent->originate ? "Originated" : "Proxied");
+		h->last_sent = u->retry.start;
+		if (fr_time_lteq(h->first_sent, h->last_idle)) h->first_sent = h->last_sent;
+
+		if (u->status_check) {
+			RDEBUG("%s status check.  Expecting response within %pVs", action,
+			       fr_box_time_delta(u->retry.rt));
+
+			if (fr_event_timer_at(u, el, &u->ev, u->retry.next, status_check_retry, treq) < 0) {
+				RERROR("Failed inserting retransmit timeout for connection");
+				fr_trunk_request_signal_fail(treq);
+			}
+
+		} else {
+			fr_time_delta_t lifetime = request_lifetime(inst->parent, u);
+
+			RDEBUG("%s request.  Expecting response within %pVs", action, fr_box_time_delta(lifetime));
+
+			if (fr_event_timer_at(u, el, &u->ev, fr_time_add(u->retry.start, lifetime),
+					      request_timeout, treq) < 0) {
+				RERROR("Failed inserting timeout for connection");
+				fr_trunk_request_signal_fail(treq);
+			}
+		}
+
+		/*
+		 *	Wait until the socket is writable again, even
+		 *	if the trunk is no longer interested.
+		 */
+		if (h->send_len) {
+			thread_conn_notify(tconn, conn, el, h->notify_on, NULL);
+			return;
+		}
+	}
+}
+
+/** Deal with Protocol-Error replies
+ *
+ *  Over TCP the reply buffer is always large enough, so we don't need
+ *  to negotiate Response-Length.
+ */
+static void protocol_error_reply(tcp_request_t *u, tcp_result_t *r, uint8_t const *data)
+{
+	uint8_t const	*attr, *end;
+
+	end = data + fr_nbo_to_uint16(data + 2);
+
+	for (attr = data + RADIUS_HEADER_LENGTH;
+	     attr < end;
+	     attr += attr[1]) {
+		/*
+		 *	Protocol-Error packets MUST contain an
+		 *	Original-Packet-Code attribute.
+		 *
+		 *	The attribute containing the
+		 *	Original-Packet-Code is an extended
+		 *	attribute.
+		 */
+		if (attr[0] != attr_extended_attribute_1->attr) continue;
+
+		/*
+		 *	ATTR + LEN + EXT-Attr + uint32
+		 */
+		if (attr[1] != 7) continue;
+
+		/*
+		 *	See if there's an Original-Packet-Code.
+		 */
+		if (attr[2] != (uint8_t)attr_original_packet_code->attr) continue;
+
+		/*
+		 *	Has to be an 8-bit number, and has to match
+		 *	the packet we sent.
+		 */
+		if ((attr[3] != 0) ||
+		    (attr[4] != 0) ||
+		    (attr[5] != 0) ||
+		    (attr[6] != u->code)) {
+			if (r) r->rcode = RLM_MODULE_FAIL;
+			return;
+		}
+	}
+
+	/*
+	 *	The response is valid, but not useful for anything.
+	 *	See rlm_radius_udp.c
+	 */
+	if (r) r->rcode = RLM_MODULE_HANDLED;
+}
+
+
+/** Handle retries for a status check
+ *
+ */
+static void status_check_next(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
+{
+	fr_trunk_connection_t	*tconn = talloc_get_type_abort(uctx, fr_trunk_connection_t);
+	tcp_handle_t		*h = talloc_get_type_abort(tconn->conn->h, tcp_handle_t);
+
+	if (fr_trunk_request_enqueue_on_conn(&h->status_r->treq, tconn, h->status_request,
+					     h->status_u, h->status_r, true) != FR_TRUNK_ENQUEUE_OK) {
+		fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+	}
+}
+
+
+/** Deal with replies replies to status checks
+ *
+ */
+static void status_check_reply(fr_trunk_request_t *treq, fr_time_t now, uint8_t const *data)
+{
+	tcp_handle_t		*h = talloc_get_type_abort(treq->tconn->conn->h, tcp_handle_t);
+	rlm_radius_t const 	*inst = h->inst->parent;
+	tcp_request_t		*u = talloc_get_type_abort(treq->preq, tcp_request_t);
+	tcp_result_t		*r = talloc_get_type_abort(treq->rctx, tcp_result_t);
+
+	fr_assert(treq->preq == h->status_u);
+	fr_assert(treq->rctx == h->status_r);
+
+	r->treq = NULL;
+
+	if (data[0] == FR_RADIUS_CODE_PROTOCOL_ERROR) protocol_error_reply(u, NULL, data);
+
+	if (u->num_replies < inst->num_answers_to_alive) {
+		DEBUG("Received %d / %u replies for status check, on connection - %s",
+		      u->num_replies, inst->num_answers_to_alive, h->name);
+		DEBUG("Next status check packet will be in %pVs", fr_box_time_delta(fr_time_sub(u->retry.next, now)));
+
+		/*
+		 *	Status checks are never retransmitted, so
+		 *	the next one is a new packet.
+		 */
+		tcp_request_reset(u);
+
+		/*
+		 *	Set the timer for the next status check.
+		 */
+		if (fr_event_timer_at(h, h->thread->el, &u->ev, u->retry.next, status_check_next, treq->tconn) < 0) {
+			fr_trunk_connection_signal_reconnect(treq->tconn, FR_CONNECTION_FAILED);
+		}
+		return;
+	}
+
+	DEBUG("Received enough replies to status check, marking connection as active - %s", h->name);
+
+	/*
+	 *	Set the "last idle" time to now, so that we don't
+	 *	restart zombie_period until sufficient time has
+	 *	passed.
+	 */
+	h->last_idle = fr_time();
+
+	/*
+	 *	Reset retry interval and retransmission counters
+	 *	also frees u->ev.
+	 */
+	status_check_reset(h, u);
+	fr_trunk_connection_signal_active(treq->tconn);
+}
+
+/** Check if a reply is for a particular outstanding packet
+ *
+ *  The Response Authenticator is calculated from the Request
+ *  Authenticator, so only the right packet will verify.
+ */
+static bool reply_match(radius_track_entry_t *te, void *uctx)
+{
+	tcp_match_t		*match = uctx;
+	rlm_radius_tcp_t const	*inst = match->h->inst;
+
+	return (fr_radius_verify(match->packet, te->vector, (uint8_t const *) inst->secret,
+				 talloc_array_length(inst->secret) - 1, false) == 0);
+}
+
+/** Find the extended ID which the home server echoed back
+ *
+ *  The home server echoes Proxy-State attributes in order, so if we
+ *  are proxying to ourselves, ours is the last one with our magic
+ *  number.
+ *
+ * @return
+ *	- true if the reply contains an extended ID.
+ *	- false if it doesn't.
+ */
+static bool reply_extended_id(uint32_t *slot, rlm_radius_tcp_t const *inst, uint8_t const *data, size_t data_len)
+{
+	uint8_t const	*attr, *end = data + data_len;
+	bool		found = false;
+
+	for (attr = data + RADIUS_HEADER_LENGTH;
+	     (attr + 2) <= end;
+	     attr += attr[1]) {
+		if ((attr[1] < 2) || ((attr + attr[1]) > end)) break;
+
+		if (attr[0] != attr_proxy_state->attr) continue;
+		if (attr[1] != 10) continue;
+		if (memcmp(attr + 2, &inst->parent->proxy_state, 4) != 0) continue;
+
+		*slot = fr_nbo_to_uint32(attr + 6);
+		found = true;
+	}
+
+	return found;
+}
+
+/** Process one complete reply from the stream
+ *
+ */
+static void reply_process(tcp_handle_t *h, uint8_t *data, size_t data_len)
+{
+	fr_trunk_request_t	*treq;
+	request_t		*request;
+	tcp_request_t		*u;
+	tcp_result_t		*r;
+	radius_track_entry_t	*rr;
+	decode_fail_t		reason;
+	uint8_t			code = 0;
+	fr_pair_list_t		reply;
+	fr_time_t		now;
+	size_t			packet_len = data_len;
+	uint32_t		slot;
+
+	/*
+	 *	Note that we don't care about packet codes.  All
+	 *	packet codes share the same ID space.
+	 *
+	 *	With extended_id, the echoed extended ID gives us the
+	 *	packet directly.  decode() then verifies the Response
+	 *	Authenticator, in case the slot has been re-used.  If
+	 *	the home server didn't echo Proxy-State, fall back to
+	 *	verifying each packet with the same ID.
+	 */
+	if (!h->inst->extended_id) {
+		rr = radius_track_entry_find(h->tt, data[1], NULL);
+
+	} else if (reply_extended_id(&slot, h->inst, data, data_len)) {
+		rr = radius_track_entry_find_slot(h->tt, data[1], slot);
+
+	} else {
+		rr = radius_track_entry_match(h->tt, data[1], reply_match,
+					      &(tcp_match_t) { .h = h, .packet = data });
+	}
+	if (!rr) {
+		WARN("%s - Ignoring reply with ID %i that arrived too late",
+		     h->module_name, data[1]);
+		return;
+	}
+
+	treq = talloc_get_type_abort(rr->uctx, fr_trunk_request_t);
+	request = treq->request;
+	fr_assert(request != NULL);
+	u = talloc_get_type_abort(treq->preq, tcp_request_t);
+	r = talloc_get_type_abort(treq->rctx, tcp_result_t);
+
+	/*
+	 *	Validate and decode the incoming packet
+	 */
+	if (!fr_radius_ok(data, &packet_len, h->inst->parent->max_attributes, false, NULL)) {
+		RWARN("Ignoring malformed packet");
+		return;
+	}
+
+	fr_pair_list_init(&reply);
+	reason = decode(request->reply_ctx, &reply, &code, h, request, u, rr->vector, data, packet_len);
+	if (reason != DECODE_FAIL_NONE) return;
+
+	/*
+	 *	Only valid packets are processed.  Otherwise an
+	 *	attacker could perform a DoS attack against the
+	 *	proxying servers by sending fake responses for
+	 *	upstream servers.
+	 */
+	h->last_reply = now = fr_time();
+
+	/*
+	 *	Status-Server can have any reply code, we don't care
+	 *	what it is.  So long as it's signed properly, we
+	 *	accept it.
+	 */
+	if (u == h->status_u) {
+		fr_pair_list_free(&reply);
+		status_check_reply(treq, now, data);
+		fr_trunk_request_signal_complete(treq);
+		return;
+	}
+
+	if (code == FR_RADIUS_CODE_PROTOCOL_ERROR) protocol_error_reply(u, r, data);
+
+	/*
+	 *	Mark up the request as being an Access-Challenge, if
+	 *	required.
+	 */
+	if ((u->code == FR_RADIUS_CODE_ACCESS_REQUEST) && (code == FR_RADIUS_CODE_ACCESS_CHALLENGE)) {
+		fr_pair_t	*vp;
+
+		vp = fr_pair_find_by_da(&request->reply_pairs, NULL, attr_packet_type);
+		if (!vp) {
+			MEM(vp = fr_pair_afrom_da(request->reply_ctx, attr_packet_type));
+			vp->vp_uint32 = FR_RADIUS_CODE_ACCESS_CHALLENGE;
+			fr_pair_append(&request->reply_pairs, vp);
+		}
+	}
+
+	/*
+	 *	Delete Proxy-State attributes from the reply.
+	 */
+	fr_pair_delete_by_da(&reply, attr_proxy_state);
+
+	/*
+	 *	If the reply has Message-Authenticator, delete
+	 *	it from the proxy reply so that it isn't
+	 *	copied over to our reply.  But also create a
+	 *	reply.Message-Authenticator attribute, so that
+	 *	it ends up in our reply.
+	 */
+	if (fr_pair_find_by_da(&reply, NULL, attr_message_authenticator)) {
+		fr_pair_t *vp;
+
+		fr_pair_delete_by_da(&reply, attr_message_authenticator);
+
+		MEM(vp = fr_pair_afrom_da(request->reply_ctx, attr_message_authenticator));
+		(void) fr_pair_value_memdup(vp, (uint8_t const *) "", 1, false);
+		fr_pair_append(&request->reply_pairs, vp);
+	}
+
+	treq->request->reply->code = code;
+	if (code != FR_RADIUS_CODE_PROTOCOL_ERROR) r->rcode = radius_code_to_rcode[code];
+	fr_pair_list_append(&request->reply_pairs, &reply);
+	fr_trunk_request_signal_complete(treq);
+}
+
+static void request_demux(UNUSED fr_event_list_t *el, fr_trunk_connection_t *tconn, fr_connection_t *conn, UNUSED void *uctx)
+{
+	tcp_handle_t		*h = talloc_get_type_abort(conn->h, tcp_handle_t);
+
+	DEBUG3("%s - Reading data for connection %s", h->module_name, h->name);
+
+	while (true) {
+		ssize_t			slen;
+		uint8_t			*p, *end;
+
+		/*
+		 *	Drain the socket.  The TLS bio may also have
+		 *	data buffered which the kernel knows nothing
+		 *	about, so we have to read until it says there's
+		 *	nothing left.
+		 */
+		slen = fr_bio_read(h->bio, NULL, h->buffer + h->used, h->buflen - h->used);
+		if (slen == 0) return;
+		if (slen == fr_bio_error(IO_WOULD_BLOCK)) return;
+
+		if (slen < 0) {
+			if (slen == fr_bio_error(EOF)) {
+				ERROR("%s - Connection %s closed by the home server", h->module_name, h->name);
+			} else {
+				PERROR("%s - Failed reading response from connection %s", h->module_name, h->name);
+			}
+			fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+			return;
+		}
+
+		h->used += slen;
+
+		/*
+		 *	Process all of the complete packets, and then
+		 *	move any partial packet to the start of the
+		 *	buffer.
+		 */
+		p = h->buffer;
+		end = h->buffer + h->used;
+
+		while ((end - p) >= RADIUS_HEADER_LENGTH) {
+			size_t packet_len = fr_nbo_to_uint16(p + 2);
+
+			/*
+			 *	We can't find the start of the next
+			 *	packet, so the stream is unusable.
+			 */
+			if (packet_len < RADIUS_HEADER_LENGTH) {
+				ERROR("%s - Invalid packet length %zu on connection %s", h->module_name,
+				      packet_len, h->name);
+				fr_trunk_connection_signal_reconnect(tconn, FR_CONNECTION_FAILED);
+				return;
+			}
+
+			if ((size_t) (end - p) < packet_len) break;
+
+			reply_process(h, p, packet_len);
+			p += packet_len;
+		}
+
+		h->used = end - p;
+		if (h->used && (p != h->buffer)) memmove(h->buffer, p, h->used);
+	}
+}
+
+/** Remove the request from any tracking structures
+ *
+ * Frees encoded packets if the request is being moved to a new connection
+ */
+static void request_cancel(UNUSED fr_connection_t *conn, void *preq_to_reset,
+			   fr_trunk_cancel_reason_t reason, UNUSED void *uctx)
+{
+	tcp_request_t	*u = talloc_get_type_abort(preq_to_reset, tcp_request_t);
+
+	/*
+	 *	The only requests which are requeued on the same
+	 *	connection are status checks.  The next one is a new
+	 *	packet.
+	 */
+	if (reason == FR_TRUNK_CANCEL_REASON_REQUEUE) {
+		if (u->ev) (void) fr_event_timer_delete(&u->ev);
+		tcp_request_reset(u);
+	}
+
+	/*
+	 *      Other cancellations are dealt with by
+	 *      request_conn_release as the request is removed
+	 *	from the trunk.
+	 */
+}
+
+/** Clear out anything associated with the handle from the request
+ *
+ */
+static void request_conn_release(fr_connection_t *conn, void *preq_to_reset, UNUSED void *uctx)
+{
+	tcp_request_t		*u = talloc_get_type_abort(preq_to_reset, tcp_request_t);
+	tcp_handle_t		*h = talloc_get_type_abort(conn->h, tcp_handle_t);
+
+	if (u->ev) (void)fr_event_timer_delete(&u->ev);
+	if (u->packet) tcp_request_reset(u);
+
+	u->num_replies = 0;
+
+	/*
+	 *	If there are no outstanding tracking entries
+	 *	allocated then the connection is "idle".
+	 */
+	if (!h->tt || (h->tt->num_requests == 0)) h->last_idle = fr_time();
+}
+
+/** Write out a canned failure
+ *
+ */
+static void request_fail(request_t *request, void *preq, void *rctx,
+			 NDEBUG_UNUSED fr_trunk_request_state_t state, UNUSED void *uctx)
+{
+	tcp_result_t		*r = talloc_get_type_abort(rctx, tcp_result_t);
+	tcp_request_t		*u = talloc_get_type_abort(preq, tcp_request_t);
+
+	fr_assert(!u->rr && !u->packet && fr_pair_list_empty(&u->extra) && !u->ev);	/* Dealt with by request_conn_release */
+
+	fr_assert(state != FR_TRUNK_REQUEST_STATE_INIT);
+
+	if (u->status_check) return;
+
+	r->rcode = RLM_MODULE_FAIL;
+	r->treq = NULL;
+
+	unlang_interpret_mark_runnable(request);
+}
+
+/** Response has already been written to the rctx at this point
+ *
+ */
+static void request_complete(request_t *request, void *preq, void *rctx, UNUSED void *uctx)
+{
+	tcp_result_t		*r = talloc_get_type_abort(rctx, tcp_result_t);
+	tcp_request_t		*u = talloc_get_type_abort(preq, tcp_request_t);
+
+	fr_assert(!u->rr && !u->packet && fr_pair_list_empty(&u->extra) && !u->ev);	/* Dealt with by request_conn_release */
+
+	if (u->status_check) return;
+
+	r->treq = NULL;
+
+	unlang_interpret_mark_runnable(request);
+}
+
+/** Explicitly free resources associated with the protocol request
+ *
+ */
+static void request_free(UNUSED request_t *request, void *preq_to_free, UNUSED void *uctx)
+{
+	tcp_request_t		*u = talloc_get_type_abort(preq_to_free, tcp_request_t);
+
+	fr_assert(!u->rr && !u->packet && fr_pair_list_empty(&u->extra) && !u->ev);	/* Dealt with by request_conn_release */
+
+	/*
+	 *	Don't free status check requests.
+	 */
+	if (u->status_check) return;
+
+	talloc_free(u);
+}
+
+/** Resume execution of the request, returning the rcode set during trunk execution
+ *
+ */
+static unlang_action_t mod_resume(rlm_rcode_t *p_result, module_ctx_t const *mctx, UNUSED request_t *request)
+{
+	tcp_result_t	*r = talloc_get_type_abort(mctx->rctx, tcp_result_t);
+	rlm_rcode_t	rcode = r->rcode;
+
+	talloc_free(r);
+
+	RETURN_MODULE_RCODE(rcode);
+}
+
+static void mod_signal(module_ctx_t const *mctx, UNUSED request_t *request, fr_signal_t action)
+{
+	tcp_result_t		*r = talloc_get_type_abort(mctx->rctx, tcp_result_t);
+
+	/*
+	 *	See rlm_radius_udp.c for why there may be no treq.
+	 */
+	if (!r->treq) {
+		talloc_free(r);
+		return;
+	}
+
+	switch (action) {
+	/*
+	 *	The request is being cancelled, tell the
+	 *	trunk so it can clean up the treq.
+	 */
+	case FR_SIGNAL_CANCEL:
+		fr_trunk_request_signal_cancel(r->treq);
+		r->treq = NULL;
+		talloc_free(r);		/* Should be freed soon anyway, but better to be explicit */
+		return;
+
+	/*
+	 *	RFC 6613 Section 2.6.  The connection is reliable, so
+	 *	we never retransmit, even if the NAS does.
+	 */
+	case FR_SIGNAL_DUP:
+	default:
+		return;
+	}
+}
+
+#ifndef NDEBUG
+/** Free a tcp_result_t
+ *
+ * Allows us to set break points for debugging.
+ */
+static int _tcp_result_free(tcp_result_t *r)
+{
+	fr_trunk_request_t	*treq;
+	tcp_request_t		*u;
+
+	if (!r->treq) return 0;
+
+	treq = talloc_get_type_abort(r->treq, fr_trunk_request_t);
+	u = talloc_get_type_abort(treq->preq, tcp_request_t);
+
+	fr_assert_msg(!u->ev, "tcp_result_t freed with active timer");
+
+	return 0;
+}
+#endif
+
+/** Free a tcp_request_t
+ */
+static int _tcp_request_free(tcp_request_t *u)
+{
+	if (u->ev) (void) fr_event_timer_delete(&u->ev);
+
+	fr_assert(u->rr == NULL);
+
+	return 0;
+}
+
+static unlang_action_t mod_enqueue(rlm_rcode_t *p_result, void **rctx_out, UNUSED void *instance, void *thread, request_t *request)
+{
+	tcp_thread_t			*t = talloc_get_type_abort(thread, tcp_thread_t);
+	tcp_result_t			*r;
+	tcp_request_t			*u;
+	fr_trunk_request_t		*treq;
+
+	fr_assert(request->packet->code > 0);
+	fr_assert(request->packet->code < FR_RADIUS_CODE_MAX);
+
+	if (request->packet->code == FR_RADIUS_CODE_STATUS_SERVER) {
+		RWDEBUG("Status-Server is reserved for internal use, and cannot be sent manually.");
+		RETURN_MODULE_NOOP;
+	}
+
+	treq = fr_trunk_request_alloc(t->trunk, request);
+	if (!treq) RETURN_MODULE_FAIL;
+
+	MEM(r = talloc_zero(request, tcp_result_t));
+#ifndef NDEBUG
+	talloc_set_destructor(r, _tcp_result_free);
+#endif
+
+	/*
+	 *	Can't use compound literal - const issues.
+	 */
+	MEM(u = talloc_zero(treq, tcp_request_t));
+	u->code = request->packet->code;
+	u->priority = request->async->priority;
+	u->recv_time = request->async->recv_time;
+	fr_pair_list_init(&u->extra);
+
+	r->rcode = RLM_MODULE_FAIL;
+
+	/*
+	 *	Make sure that we print out the actual encoded value
+	 *	of the Message-Authenticator attribute.  If the caller
+	 *	asked for one, delete theirs (which has a bad value),
+	 *	and remember to add one manually when we encode the
+	 *	packet.
+	 */
+	if (fr_pair_find_by_da(&request->request_pairs, NULL, attr_message_authenticator)) {
+		u->require_ma = true;
+		pair_delete_request(attr_message_authenticator);
+	}
+
+	switch(fr_trunk_request_enqueue(&treq, t->trunk, request, u, r)) {
+	case FR_TRUNK_ENQUEUE_OK:
+	case FR_TRUNK_ENQUEUE_IN_BACKLOG:
+		break;
+
+	case FR_TRUNK_ENQUEUE_NO_CAPACITY:
+		REDEBUG("Unable to queue packet - connections at maximum capacity");
+	fail:
+		fr_assert(!u->rr && !u->packet);	/* Should not have been fed to the muxer */
+		fr_trunk_request_free(&treq);		/* Return to the free list */
+		talloc_free(r);
+		RETURN_MODULE_FAIL;
+
+	case FR_TRUNK_ENQUEUE_DST_UNAVAILABLE:
+		REDEBUG("All destinations are down - cannot send packet");
+		goto fail;
+
+	case FR_TRUNK_ENQUEUE_FAIL:
+		REDEBUG("Unable to queue packet");
+		goto fail;
+	}
+
+	r->treq = treq;	/* Remember for signalling purposes */
+
+	talloc_set_destructor(u, _tcp_request_free);
+
+	*rctx_out = r;
+
+	return UNLANG_ACTION_YIELD;
+}
+
+/** Instantiate thread data for the submodule.
+ *
+ */
+static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
+{
+	rlm_radius_tcp_t		*inst = talloc_get_type_abort(mctx->inst->data, rlm_radius_tcp_t);
+	tcp_thread_t			*thread = talloc_get_type_abort(mctx->thread, tcp_thread_t);
+
+	static fr_trunk_io_funcs_t	io_funcs = {
+						.connection_alloc = thread_conn_alloc,
+						.connection_notify = thread_conn_notify,
+						.request_prioritise = request_prioritise,
+						.request_mux = request_mux,
+						.request_demux = request_demux,
+						.request_conn_release = request_conn_release,
+						.request_complete = request_complete,
+						.request_fail = request_fail,
+						.request_cancel = request_cancel,
+						.request_free = request_free
+					};
+
+	inst->trunk_conf = &inst->parent->trunk_conf;
+
+	inst->trunk_conf->req_pool_headers = 4;	/* One for the request, one for the buffer, one for the tracking binding, one for Proxy-State VP */
+	inst->trunk_conf->req_pool_size = sizeof(tcp_request_t) + inst->max_packet_size + sizeof(radius_track_entry_t ***) + sizeof(fr_pair_t) + 20;
+
+	/*
+	 *	When a connection fails, the requests which were sent
+	 *	on it are moved to the backlog, and re-sent on the
+	 *	next connection.  Without this, the trunk refuses them
+	 *	until a connection has been opened again.
+	 */
+	inst->trunk_conf->backlog_on_failed_conn = true;
+
+	thread->el = mctx->el;
+	thread->inst = inst;
+
+#ifdef WITH_TLS
+	if (inst->tls_conf) {
+		thread->ssl_ctx = fr_tls_ctx_alloc(inst->tls_conf, true);
+		if (!thread->ssl_ctx) return -1;
+
+		/*
+		 *	The session cache callbacks need a request to
+		 *	run the TLS virtual server.  We resume sessions
+		 *	ourselves, from the last connection.
+		 */
+		SSL_CTX_sess_set_new_cb(thread->ssl_ctx, NULL);
+		SSL_CTX_sess_set_get_cb(thread->ssl_ctx, NULL);
+		SSL_CTX_sess_set_remove_cb(thread->ssl_ctx, NULL);
+		SSL_CTX_set_session_cache_mode(thread->ssl_ctx, SSL_SESS_CACHE_OFF);
+	}
+#endif
+
+	thread->trunk = fr_trunk_alloc(thread, mctx->el, &io_funcs,
+				       inst->trunk_conf, inst->parent->name, thread, false);
+	if (!thread->trunk) return -1;
+
+	return 0;
+}
+
+/** Free thread specific TLS resources
+ *
+ */
+static int mod_thread_detach(module_thread_inst_ctx_t const *mctx)
+{
+	tcp_thread_t			*thread = talloc_get_type_abort(mctx->thread, tcp_thread_t);
+
+	/*
+	 *	Close the connections first, so that they don't
+	 *	reference the SSL_CTX.
+	 */
+	TALLOC_FREE(thread->trunk);
+
+#ifdef WITH_TLS
+	if (thread->session) SSL_SESSION_free(thread->session);
+	thread->session = NULL;
+
+	if (thread->ssl_ctx) SSL_CTX_free(thread->ssl_ctx);
+	thread->ssl_ctx = NULL;
+#endif
+
+	return 0;
+}
+
+static int mod_instantiate(module_inst_ctx_t const *mctx)
+{
+	rlm_radius_t		*parent = talloc_get_type_abort(mctx->inst->parent->data, rlm_radius_t);
+	rlm_radius_tcp_t	*inst = talloc_get_type_abort(mctx->inst->data, rlm_radius_tcp_t);
+	CONF_SECTION		*conf = mctx->inst->conf;
+	CONF_SECTION		*tls_cs;
+
+	if (!parent) {
+		ERROR("IO module cannot be instantiated directly");
+		return -1;
+	}
+
+	inst->parent = parent;
+	inst->config = conf;
+
+	if (parent->replicate) {
+		cf_log_err(conf, "'replicate' cannot be used with the 'tcp' transport");
+		return -1;
+	}
+
+	/*
+	 *	Without extended_id, there can only be 256 packets
+	 *	outstanding on a connection.
+	 */
+	if (!inst->extended_id) {
+		FR_INTEGER_BOUND_CHECK("trunk.per_connection_max", parent->trunk_conf.max_req_per_conn, <=, 255);
+	} else {
+		FR_INTEGER_BOUND_CHECK("trunk.per_connection_max", parent->trunk_conf.max_req_per_conn, <=, 65535);
+	}
+	FR_INTEGER_BOUND_CHECK("trunk.per_connection_target", parent->trunk_conf.target_req_per_conn, <=,
+			       parent->trunk_conf.max_req_per_conn / 2);
+
+	/*
+	 *	Ensure that we have a destination address.
+	 */
+	if (inst->dst_ipaddr.af == AF_UNSPEC) {
+		cf_log_err(conf, "A value must be given for 'ipaddr'");
+		return -1;
+	}
+
+	/*
+	 *	If src_ipaddr isn't set, make sure it's INADDR_ANY, of
+	 *	the same address family as dst_ipaddr.
+	 */
+	if (inst->src_ipaddr.af == AF_UNSPEC) {
+		memset(&inst->src_ipaddr, 0, sizeof(inst->src_ipaddr));
+
+		inst->src_ipaddr.af = inst->dst_ipaddr.af;
+
+		if (inst->src_ipaddr.af == AF_INET) {
+			inst->src_ipaddr.prefix = 32;
+		} else {
+			inst->src_ipaddr.prefix = 128;
+		}
+	}
+
+	else if (inst->src_ipaddr.af != inst->dst_ipaddr.af) {
+		cf_log_err(conf, "The 'ipaddr' and 'src_ipaddr' configuration items must "
+			   "be both of the same address family");
+		return -1;
+	}
+
+	if (!inst->dst_port) {
+		cf_log_err(conf, "A value must be given for 'port'");
+		return -1;
+	}
+
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 64);
+	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, TCP_MAX_PACKET_SIZE);
+
+	if (inst->recv_buff_is_set) {
+		FR_INTEGER_BOUND_CHECK("recv_buff", inst->recv_buff, >=, inst->max_packet_size);
+		FR_INTEGER_BOUND_CHECK("recv_buff", inst->recv_buff, <=, (1 << 30));
+	}
+
+	if (inst->send_buff_is_set) {
+		FR_INTEGER_BOUND_CHECK("send_buff", inst->send_buff, >=, inst->max_packet_size);
+		FR_INTEGER_BOUND_CHECK("send_buff", inst->send_buff, <=, (1 << 30));
+	}
+
+	/*
+	 *	A "tls" subsection turns the connection into RadSec.
+	 */
+	tls_cs = cf_section_find(conf, "tls", NULL);
+	if (tls_cs) {
+#ifdef WITH_TLS
+		inst->tls_conf = fr_tls_conf_parse_client(tls_cs);
+		if (!inst->tls_conf) {
+			cf_log_err(tls_cs, "Failed parsing TLS configuration");
+			return -1;
+		}
+#else
+		cf_log_err(tls_cs, "TLS is not available in this build");
+		return -1;
+#endif
+	}
+
+	return 0;
+}
+
+extern rlm_radius_io_t rlm_radius_tcp;
+rlm_radius_io_t rlm_radius_tcp = {
+	.common = {
+		.magic			= MODULE_MAGIC_INIT,
+		.name			= "radius_tcp",
+		.inst_size		= sizeof(rlm_radius_tcp_t),
+
+		.thread_inst_size	= sizeof(tcp_thread_t),
+		.thread_inst_type	= "tcp_thread_t",
+
+		.config			= module_config,
+		.instantiate		= mod_instantiate,
+		.thread_instantiate 	= mod_thread_instantiate,
+		.thread_detach		= mod_thread_detach,
+	},
+	.enqueue		= mod_enqueue,
+	.signal			= mod_signal,
+	.resume			= mod_resume,
+};
@@ -0,0 +1,10 @@
+TARGETNAME	:= rlm_radius_tcp
+TARGET		:= $(TARGETNAME)$(L)
+
+SOURCES		:= rlm_radius_tcp.c track.c
+
+TGT_PREREQS	:= libfreeradius-radius$(L) libfreeradius-bio$(L)
+
+ifneq "$(OPENSSL_LIBS)" ""
+TGT_PREREQS	+= libfreeradius-tls$(L)
+endif
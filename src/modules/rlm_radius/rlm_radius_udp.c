@@ -2808,6 +2808,13 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 	inst->parent = parent;
 	inst->replicate = parent->replicate;
 
+	/*
+	 *	There are only 256 IDs.
+	 */
+	FR_INTEGER_BOUND_CHECK("trunk.per_connection_max", parent->trunk_conf.max_req_per_conn, <=, 255);
+	FR_INTEGER_BOUND_CHECK("trunk.per_connection_target", parent->trunk_conf.target_req_per_conn, <=,
+			       parent->trunk_conf.max_req_per_conn / 2);
+
 	/*
 	 *	Always need at least one mmsgvec
 	 */
@@ -76,6 +76,37 @@ static int8_t te_cmp(void const *one, void const *two)
 	return CMP(ret, 0);
 }
 
+/** Give a tracking entry an extended ID
+ *
+ *  The extended ID is an index into tt->slots, so a reply which echoes
+ *  it back can be matched without searching.  The array grows as
+ *  needed, and released slots are re-used.
+ */
+static void radius_track_slot_alloc(radius_track_t *tt, radius_track_entry_t *te)
+{
+	if (!tt->num_free_slots) {
+		uint32_t i, num_slots;
+
+		num_slots = tt->num_slots ? (tt->num_slots * 2) : (UINT8_MAX + 1);
+
+		MEM(tt->slots = talloc_realloc(tt, tt->slots, radius_track_entry_t *, num_slots));
+		MEM(tt->free_slots = talloc_realloc(tt, tt->free_slots, uint32_t, num_slots));
+
+		/*
+		 *	Push the new slots in reverse, so that the
+		 *	lowest one is used first.
+		 */
+		for (i = num_slots; i > tt->num_slots; i--) {
+			tt->slots[i - 1] = NULL;
+			tt->free_slots[tt->num_free_slots++] = i - 1;
+		}
+		tt->num_slots = num_slots;
+	}
+
+	te->slot = tt->free_slots[--tt->num_free_slots];
+	tt->slots[te->slot] = te;
+}
+
 /** Ensures the entry is released when the ctx passed to radius_track_entry_reserve is freed
  *
  * @param[in] te_p		Entry to release.
@@ -160,8 +191,8 @@ retry:
 	 *	If needed, allocate a subtree.
 	 */
 	if (!tt->subtree[tt->next_id]) {
-		MEM(tt->subtree[tt->next_id] = fr_rb_inline_talloc_alloc(tt, radius_track_entry_t, node,
-									 te_cmp, NULL));
+		MEM(tt->subtree[tt->next_id] = fr_rb_inline_alloc(tt, radius_track_entry_t, node,
+								  te_cmp, NULL));
 	}
 
 	/*
@@ -175,6 +206,7 @@ done:
 	te->request = request;
 	te->uctx = uctx;
 	te->code = code;
+	if (tt->use_authenticator) radius_track_slot_alloc(tt, te);
 #ifndef NDEBUG
 	te->operation = te->tt->operation++;
 	te->file = file;
@@ -232,6 +264,11 @@ int radius_track_entry_release(
 
 	te->request = NULL;
 
+	if ((te->slot < tt->num_slots) && (tt->slots[te->slot] == te)) {
+		tt->slots[te->slot] = NULL;
+		tt->free_slots[tt->num_free_slots++] = te->slot;
+	}
+
 	fr_assert(tt->num_requests > 0);
 	tt->num_requests--;
 
@@ -321,6 +358,11 @@ int radius_track_entry_update(radius_track_entry_t *te, uint8_t const *vector)
 	 *	array.  That way if the server responds with
 	 *	Original-Request-Authenticator, we can easily find it.
 	 */
+	if (!tt->subtree[te->id]) {
+		MEM(tt->subtree[te->id] = fr_rb_inline_alloc(tt, radius_track_entry_t, node,
+							     te_cmp, NULL));
+	}
+
 	if (!fr_rb_insert(tt->subtree[te->id], te)) return -1;
 
 	return 0;
@@ -400,6 +442,80 @@ radius_track_entry_t *radius_track_entry_find(radius_track_t *tt, uint8_t packet
 }
 
 
+/** Find a tracking entry from its extended ID
+ *
+ * The home server echoes the extended ID back to us, so there is
+ * exactly one candidate.  The caller still has to verify the Response
+ * Authenticator, as the slot may have been re-used since the reply
+ * was sent.
+ *
+ * @param tt		The radius_track_t tracking table
+ * @param packet_id    	The ID from the RADIUS header
+ * @param slot		The extended ID, from radius_track_entry_t.slot
+ * @return
+ *	- NULL on "not found"
+ *	- radius_track_entry_t on success
+ */
+radius_track_entry_t *radius_track_entry_find_slot(radius_track_t *tt, uint8_t packet_id, uint32_t slot)
+{
+	radius_track_entry_t *te;
+
+	(void) talloc_get_type_abort(tt, radius_track_t);
+
+	if (slot >= tt->num_slots) return NULL;
+
+	te = tt->slots[slot];
+	if (!te || (te->id != packet_id)) return NULL;
+
+	fr_assert(te->request != NULL);
+
+	return te;
+}
+
+/** Find a tracking entry for a reply, when the reply doesn't contain the Request Authenticator
+ *
+ * When the Request Authenticator is used as an identifier, many
+ * requests may be outstanding with the same ID.  A reply only
+ * carries the ID, so the caller has to check each candidate, usually
+ * by verifying the Response Authenticator against the candidate's
+ * Request Authenticator.
+ *
+ * @param tt		The radius_track_t tracking table
+ * @param packet_id    	The ID from the RADIUS header
+ * @param match		called for each entry which is using packet_id.
+ * @param uctx		passed to match
+ * @return
+ *	- NULL on "not found"
+ *	- radius_track_entry_t on success
+ */
+radius_track_entry_t *radius_track_entry_match(radius_track_t *tt, uint8_t packet_id,
+					       radius_track_match_t match, void *uctx)
+{
+	radius_track_entry_t *te;
+
+	(void) talloc_get_type_abort(tt, radius_track_t);
+
+	te = &tt->id[packet_id];
+	if (te->request && match(te, uctx)) return te;
+
+	if (!tt->subtree[packet_id]) return NULL;
+
+	/*
+	 *	The static entry may also be in the subtree, but
+	 *	we've already checked it.
+	 */
+	fr_rb_inorder_foreach(tt->subtree[packet_id], radius_track_entry_t, candidate) {
+		if (candidate == &tt->id[packet_id]) continue;
+
+		fr_assert(candidate->request != NULL);
+
+		if (match(candidate, uctx)) return candidate;
+	}
+	endforeach
+
+	return NULL;
+}
+
 /** Use Request Authenticator (or not) as an Identifier
  *
  * @param tt		The radius_track_t tracking table
@@ -48,6 +48,7 @@ struct radius_track_entry_s {
 
 	uint8_t		code;			//!< packet code (sigh)
 	uint8_t		id;			//!< our ID
+	uint32_t	slot;			//!< extended ID, when using the Request Authenticator
 
 	union {
 		fr_dlist_t	entry;					//!< For free list.
@@ -73,6 +74,11 @@ struct radius_track_s {
 
 	fr_rb_tree_t	*subtree[UINT8_MAX + 1];	//!< for Original-Request-Authenticator
 
+	radius_track_entry_t	**slots;	//!< entries in use, indexed by extended ID
+	uint32_t	*free_slots;		//!< stack of unused extended IDs
+	uint32_t	num_slots;		//!< size of both arrays
+	uint32_t	num_free_slots;		//!< entries in free_slots
+
 #ifndef NDEBUG
 	uint64_t	operation;		//!< Incremented each alloc and de-alloc
 #endif
@@ -120,4 +126,20 @@ int			radius_track_entry_update(radius_track_entry_t *te,
 radius_track_entry_t	*radius_track_entry_find(radius_track_t *tt, uint8_t packet_id,
 						 uint8_t const *vector) CC_HINT(nonnull(1));
 
+radius_track_entry_t	*radius_track_entry_find_slot(radius_track_t *tt, uint8_t packet_id,
+						      uint32_t slot) CC_HINT(nonnull);
+
+/** Check whether a reply matches a tracking entry
+ *
+ * @param[in] te	candidate tracking entry.
+ * @param[in] uctx	passed to radius_track_entry_match().
+ * @return
+ *	- true if the reply is for this entry.
+ *	- false if the reply is not for this entry.
+ */
+typedef bool (*radius_track_match_t)(radius_track_entry_t *te, void *uctx);
+
+radius_track_entry_t	*radius_track_entry_match(radius_track_t *tt, uint8_t packet_id,
+						  radius_track_match_t match, void *uctx) CC_HINT(nonnull(1,3));
+
 void			radius_track_use_authenticator(radius_track_t *te, bool flag) CC_HINT(nonnull);
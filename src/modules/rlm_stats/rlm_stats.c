@@ -26,6 +26,7 @@ RCSID("$Id$")
 #include <freeradius-devel/server/base.h>
 #include <freeradius-devel/server/module_rlm.h>
 #include <freeradius-devel/io/listen.h>
+#include <freeradius-devel/util/btree.h>
 #include <freeradius-devel/util/dlist.h>
 #include <freeradius-devel/util/debug.h>
 #include <freeradius-devel/radius/radius.h>
@@ -57,8 +58,6 @@ typedef struct {
 } rlm_stats_t;
 
 typedef struct {
-	fr_rb_node_t		src_node;
-	fr_rb_node_t		dst_node;
 	fr_ipaddr_t		ipaddr;				//!< IP address of this thing
 	fr_time_t		created;			//!< when it was created
 	fr_time_t		last_packet;			//!< when we last saw a packet
@@ -73,8 +72,8 @@ typedef struct {
 
 	fr_time_t		last_manage;			//!< when we deleted old things
 
-	fr_rb_tree_t		*src;				//!< stats by source
-	fr_rb_tree_t		*dst;				//!< stats by destination
+	fr_btree_t		*src;				//!< stats by source
+	fr_btree_t		*dst;				//!< stats by destination
 
 	uint64_t		stats[FR_RADIUS_CODE_MAX];
 
@@ -110,16 +109,16 @@ static void coalesce(uint64_t final_stats[FR_RADIUS_CODE_MAX], rlm_stats_thread_
 {
 	rlm_stats_data_t *stats;
 	rlm_stats_thread_t *other;
-	fr_rb_tree_t **tree;
+	fr_btree_t **tree;
 	uint64_t local_stats[FR_RADIUS_CODE_MAX];
 
-	tree = (fr_rb_tree_t **) (((uint8_t *) t) + tree_offset);
+	tree = (fr_btree_t **) (((uint8_t *) t) + tree_offset);
 
 	/*
 	 *	Bootstrap with my statistics, where we don't need a
 	 *	lock.
 	 */
-	stats = fr_rb_find(*tree, mydata);
+	stats = fr_btree_find(*tree, mydata);
 	if (!stats) {
 		memset(final_stats, 0, sizeof(uint64_t) * FR_RADIUS_CODE_MAX);
 	} else {
@@ -138,9 +137,9 @@ static void coalesce(uint64_t final_stats[FR_RADIUS_CODE_MAX], rlm_stats_thread_
 
 		if (other == t) continue;
 
-		tree = (fr_rb_tree_t **) (((uint8_t *) other) + tree_offset);
+		tree = (fr_btree_t **) (((uint8_t *) other) + tree_offset);
 		pthread_mutex_lock(&other->mutex);
-		stats = fr_rb_find(*tree, mydata);
+		stats = fr_btree_find(*tree, mydata);
 
 		if (!stats) {
 			pthread_mutex_unlock(&other->mutex);
@@ -200,14 +199,14 @@ static unlang_action_t CC_HINT(nonnull) mod_stats(rlm_rcode_t *p_result, module_
 		 *	Update source statistics
 		 */
 		mydata.ipaddr = request->packet->socket.inet.src_ipaddr;
-		stats = fr_rb_find(t->src, &mydata);
+		stats = fr_btree_find(t->src, &mydata);
 		if (!stats) {
 			MEM(stats = talloc_zero(t, rlm_stats_data_t));
 
 			stats->ipaddr = request->packet->socket.inet.src_ipaddr;
 			stats->created = request->async->recv_time;
 
-			(void) fr_rb_insert(t->src, stats);
+			(void) fr_btree_insert(t->src, stats);
 		}
 
 		stats->last_packet = request->async->recv_time;
@@ -218,14 +217,14 @@ static unlang_action_t CC_HINT(nonnull) mod_stats(rlm_rcode_t *p_result, module_
 		 *	Update destination statistics
 		 */
 		mydata.ipaddr = request->packet->socket.inet.dst_ipaddr;
-		stats = fr_rb_find(t->dst, &mydata);
+		stats = fr_btree_find(t->dst, &mydata);
 		if (!stats) {
 			MEM(stats = talloc_zero(t, rlm_stats_data_t));
 
 			stats->ipaddr = request->packet->socket.inet.dst_ipaddr;
 			stats->created = request->async->recv_time;
 
-			(void) fr_rb_insert(t->dst, stats);
+			(void) fr_btree_insert(t->dst, stats);
 		}
 
 		stats->last_packet = request->async->recv_time;
@@ -355,6 +354,13 @@ static int8_t data_cmp(const void *one, const void *two)
 	return fr_ipaddr_cmp(&a->ipaddr, &b->ipaddr);
 }
 
+static uint64_t data_key(void const *one)
+{
+	rlm_stats_data_t const *a = one;
+
+	return fr_ipaddr_key(&a->ipaddr);
+}
+
 /** Instantiate thread data for the submodule.
  *
  */
@@ -367,10 +373,10 @@ static int mod_thread_instantiate(module_thread_inst_ctx_t const *mctx)
 
 	t->inst = inst;
 
-	t->src = fr_rb_inline_talloc_alloc(t, rlm_stats_data_t, src_node, data_cmp, NULL);
+	t->src = fr_btree_keyed_talloc_alloc(t, rlm_stats_data_t, data_cmp, data_key, NULL);
 	if (unlikely(!t->src)) return -1;
 
-	t->dst = fr_rb_inline_talloc_alloc(t, rlm_stats_data_t, dst_node, data_cmp, NULL);
+	t->dst = fr_btree_keyed_talloc_alloc(t, rlm_stats_data_t, data_cmp, data_key, NULL);
 	if (unlikely(!t->dst)) {
 		TALLOC_FREE(t->src);
 		return -1;
@@ -37,22 +37,16 @@ RCSID("$Id$")
 
 /** PAP authentication direct to winbind via Samba's libwbclient library
  *
- * @param[in] inst Module instance
- * @param[in] request The current request
- * @param[in] env The call_env for the current winbind authentication
- *
- * @return
- *	- 0	Success
- *	- -1	Authentication failure
- *	- -648	Password expired
+ * Runs in an offload thread, so it MUST NOT access the request.
  *
+ * @param[in] uctx	#winbind_auth_job_t for the authentication.
  */
-int do_auth_wbclient_pap(rlm_winbind_t const *inst, request_t *request, winbind_auth_call_env_t *env)
+void auth_wbclient_pap(void *uctx)
 {
-	int				ret = -1;
+	winbind_auth_job_t		*job = talloc_get_type_abort(uctx, winbind_auth_job_t);
+	rlm_winbind_t const		*inst = job->inst;
 	struct wbcContext		*wb_ctx;
 	struct wbcAuthUserParams	authparams;
-	wbcErr				err;
 	struct wbcAuthUserInfo		*info = NULL;
 	struct wbcAuthErrorInfo		*error = NULL;
 
@@ -63,25 +57,14 @@ int do_auth_wbclient_pap(rlm_winbind_t const *inst, request_t *request, winbind_
 	 */
 	memset(&authparams, 0, sizeof(authparams));
 
-	/*
-	 * username must be set for this function to be called
-	 */
-	fr_assert(env->username.type == FR_TYPE_STRING);
-
-	authparams.account_name = env->username.vb_strvalue;
-
-	if (env->domain.type == FR_TYPE_STRING) {
-		authparams.domain_name = env->domain.vb_strvalue;
-	} else {
-		RWDEBUG2("No domain specified; authentication may fail because of this");
-	}
-
+	authparams.account_name = job->username;
+	authparams.domain_name = job->domain;
 
 	/*
 	 * Build the wbcAuthUserParams structure with what we know
 	 */
 	authparams.level = WBC_AUTH_USER_LEVEL_PLAIN;
-	authparams.password.plaintext = env->password.vb_strvalue;
+	authparams.password.plaintext = job->password;
 
 	/*
 	 * Parameters documented as part of the MSV1_0_SUBAUTH_LOGON structure
@@ -92,27 +75,54 @@ int do_auth_wbclient_pap(rlm_winbind_t const *inst, request_t *request, winbind_
 					WBC_MSV1_0_ALLOW_SERVER_TRUST_ACCOUNT;
 
 	/*
-	 * Send auth request across to winbind
+	 * Send auth request across to winbind.  There's no request
+	 * in this thread, so the pool logs without one.
 	 */
-	wb_ctx = fr_pool_connection_get(inst->wb_pool, request);
+	wb_ctx = fr_pool_connection_get(inst->wb_pool, NULL);
 	if (wb_ctx == NULL) {
-		RERROR("Unable to get winbind connection from pool");
-		goto done;
+		job->no_connection = true;
+		return;
 	}
 
-	RDEBUG2("Sending authentication request user='%s' domain='%s'", authparams.account_name,
-									authparams.domain_name);
+	job->err = wbcCtxAuthenticateUserEx(wb_ctx, &authparams, &info, &error);
+
+	fr_pool_connection_release(inst->wb_pool, NULL, wb_ctx);
 
-	err = wbcCtxAuthenticateUserEx(wb_ctx, &authparams, &info, &error);
+	if (error) {
+		job->auth_error = true;
+		job->nt_status = error->nt_status;
+		if (error->display_string) job->display_string = talloc_strdup(job, error->display_string);
+	}
+
+	if (info) wbcFreeMemory(info);
+	if (error) wbcFreeMemory(error);
+}
 
-	fr_pool_connection_release(inst->wb_pool, request, wb_ctx);
+/** Log the result of a PAP authentication, once the request has been resumed
+ *
+ * @param[in] request	The current request.
+ * @param[in] job	The completed authentication.
+ *
+ * @return
+ *	- 0	Success
+ *	- -1	Authentication failure
+ *	- -648	Password expired
+ *
+ */
+int auth_wbclient_pap_result(request_t *request, winbind_auth_job_t const *job)
+{
+	int	ret = -1;
 
+	if (job->no_connection) {
+		RERROR("Unable to get winbind connection from pool");
+		return -1;
+	}
 
 	/*
 	 * Try and give some useful feedback on what happened. There are only
 	 * a few errors that can actually be returned from wbcCtxAuthenticateUserEx.
 	 */
-	switch (err) {
+	switch (job->err) {
 	case WBC_ERR_SUCCESS:
 		ret = 0;
 		RDEBUG2("Authenticated successfully");
@@ -129,7 +139,7 @@ int do_auth_wbclient_pap(rlm_winbind_t const *inst, request_t *request, winbind_
 		break;
 
 	case WBC_ERR_AUTH_ERROR:
-		if (!error) {
+		if (!job->auth_error) {
 			REDEBUG2("Authentication failed");
 			break;
 		}
@@ -137,18 +147,18 @@ int do_auth_wbclient_pap(rlm_winbind_t const *inst, request_t *request, winbind_
 		/*
 		 * The password needs to be changed, set ret appropriately.
 		 */
-		if (error->nt_status == NT_STATUS_PASSWORD_EXPIRED ||
-		    error->nt_status == NT_STATUS_PASSWORD_MUST_CHANGE) {
+		if (job->nt_status == NT_STATUS_PASSWORD_EXPIRED ||
+		    job->nt_status == NT_STATUS_PASSWORD_MUST_CHANGE) {
 			ret = -648;
 		}
 
 		/*
 		 * Return the NT_STATUS human readable error string, if there is one.
 		 */
-		if (error->display_string) {
-			REDEBUG2("%s [0x%X]", error->display_string, error->nt_status);
+		if (job->display_string) {
+			REDEBUG2("%s [0x%X]", job->display_string, job->nt_status);
 		} else {
-			REDEBUG2("Unknown authentication failure [0x%X]", error->nt_status);
+			REDEBUG2("Unknown authentication failure [0x%X]", job->nt_status);
 		}
 		break;
 
@@ -159,19 +169,13 @@ int do_auth_wbclient_pap(rlm_winbind_t const *inst, request_t *request, winbind_
 		 *   WBC_ERR_NO_MEMORY
 		 * neither of which are particularly likely.
 		 */
-		if (error && error->display_string) {
-			REDEBUG2("Failed authenticating user: %s (%s)", error->display_string, wbcErrorString(err));
+		if (job->display_string) {
+			REDEBUG2("Failed authenticating user: %s (%s)", job->display_string, wbcErrorString(job->err));
 		} else {
-			REDEBUG2("Failed authenticating user: Winbind error (%s)", wbcErrorString(err));
+			REDEBUG2("Failed authenticating user: Winbind error (%s)", wbcErrorString(job->err));
 		}
 		break;
 	}
 
-
-done:
-	if (info) wbcFreeMemory(info);
-	if (error) wbcFreeMemory(error);
-
 	return ret;
 }
-
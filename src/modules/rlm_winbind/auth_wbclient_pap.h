@@ -4,4 +4,26 @@
 
 RCSIDH(auth_wbclient_h, "$Id$")
 
-int do_auth_wbclient_pap(rlm_winbind_t const *inst, request_t *request, winbind_auth_call_env_t *env);
+/** A PAP authentication, run in an offload thread
+ *
+ * wbcCtxAuthenticateUserEx blocks until winbindd responds, so it's
+ * called from a helper thread.  Everything the call needs is copied
+ * here, and the results are written back for logging on resume.
+ */
+typedef struct {
+	rlm_winbind_t const	*inst;			//!< Module instance.
+
+	char const		*username;		//!< Copy of the username.
+	char const		*domain;		//!< Copy of the domain, may be NULL.
+	char const		*password;		//!< Copy of the password.
+
+	bool			no_connection;		//!< Couldn't get a winbind connection.
+	wbcErr			err;			//!< Result of the authentication call.
+	bool			auth_error;		//!< Winbind returned error information.
+	uint32_t		nt_status;		//!< NT_STATUS from the error information.
+	char			*display_string;	//!< Human readable error, may be NULL.
+} winbind_auth_job_t;
+
+void auth_wbclient_pap(void *uctx);
+
+int auth_wbclient_pap_result(request_t *request, winbind_auth_job_t const *job);
@@ -44,6 +44,7 @@ static const conf_parser_t group_config[] = {
 
 static const conf_parser_t module_config[] = {
 	{ FR_CONF_POINTER("group", 0, CONF_FLAG_SUBSECTION, NULL), .subcs = (void const *) group_config },
+	{ FR_CONF_OFFSET_SUBSECTION("offload", 0, rlm_winbind_t, offload_config, unlang_offload_pool_config) },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -324,6 +325,12 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 		return -1;
 	}
 
+	inst->offload = unlang_offload_pool_alloc(inst, mctx->inst->name, &inst->offload_config);
+	if (!inst->offload) {
+		cf_log_perr(conf, "Failed starting winbind threads");
+		return -1;
+	}
+
 	inst->auth_type = fr_dict_enum_by_name(attr_auth_type, mctx->inst->name, -1);
 	if (!inst->auth_type) {
 		WARN("Failed to find 'authenticate %s {...}' section.  Winbind authentication will likely not work",
@@ -336,7 +343,7 @@ static int mod_instantiate(module_inst_ctx_t const *mctx)
 
 /** Tidy up module instance
  *
- * Frees up the libwbclient connection pool.
+ * Stops the offload threads, then frees up the libwbclient connection pool.
  *
  * @param[in] mctx	data for this module
  * @return 0
@@ -345,6 +352,11 @@ static int mod_detach(module_detach_ctx_t const *mctx)
 {
 	rlm_winbind_t *inst = talloc_get_type_abort(mctx->inst->data, rlm_winbind_t);
 
+	/*
+	 *	The offload threads use connections from the pool,
+	 *	so they must be stopped first.
+	 */
+	TALLOC_FREE(inst->offload);
 	fr_pool_free(inst->wb_pool);
 
 	return 0;
@@ -387,6 +399,30 @@ static unlang_action_t CC_HINT(nonnull) mod_authorize(rlm_rcode_t *p_result, mod
 }
 
 
+/** Log the result of the winbind authentication, and return the result
+ *
+ */
+static unlang_action_t CC_HINT(nonnull) mod_authenticate_resume(rlm_rcode_t *p_result, module_ctx_t const *mctx,
+								request_t *request)
+{
+	winbind_auth_job_t	*job = talloc_get_type_abort(mctx->rctx, winbind_auth_job_t);
+	int			ret;
+
+	ret = auth_wbclient_pap_result(request, job);
+	talloc_free(job);
+
+	/*
+	 *	No need for many debug outputs or errors as the
+	 *	result function is chatty enough.
+	 */
+	if (ret == 0) {
+		RDEBUG2("User authenticated successfully using winbind");
+		RETURN_MODULE_OK;
+	}
+
+	RETURN_MODULE_REJECT;
+}
+
 /** Authenticate the user via libwbclient and winbind
  *
  * @param[out] p_result		The result of the module call.
@@ -397,6 +433,7 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 {
 	rlm_winbind_t const	*inst = talloc_get_type_abort_const(mctx->inst->data, rlm_winbind_t);
 	winbind_auth_call_env_t	*env = talloc_get_type_abort(mctx->env_data, winbind_auth_call_env_t);
+	winbind_auth_job_t	*job;
 
 	/*
 	 *	Make sure the supplied password isn't empty
@@ -416,16 +453,27 @@ static unlang_action_t CC_HINT(nonnull) mod_authenticate(rlm_rcode_t *p_result,
 	}
 
 	/*
-	 *	Authenticate and return OK if successful. No need for
-	 *	many debug outputs or errors as the auth function is
-	 *	chatty enough.
+	 *	username must be set for this function to be called
 	 */
-	if (do_auth_wbclient_pap(inst, request, env) == 0) {
-		RDEBUG2("User authenticated successfully using winbind");
-		RETURN_MODULE_OK;
+	fr_assert(env->username.type == FR_TYPE_STRING);
+
+	/*
+	 *	The winbind call is done in a helper thread, which may
+	 *	still be running after the request has been freed.
+	 */
+	MEM(job = talloc_zero(NULL, winbind_auth_job_t));
+	job->inst = inst;
+	job->username = talloc_strdup(job, env->username.vb_strvalue);
+	job->password = talloc_strdup(job, env->password.vb_strvalue);
+	if (env->domain.type == FR_TYPE_STRING) {
+		job->domain = talloc_strdup(job, env->domain.vb_strvalue);
+	} else {
+		RWDEBUG2("No domain specified; authentication may fail because of this");
 	}
 
-	RETURN_MODULE_REJECT;
+	RDEBUG2("Sending authentication request user='%s' domain='%s'", job->username, job->domain);
+
+	return unlang_offload_yield(p_result, request, inst->offload, auth_wbclient_pap, mod_authenticate_resume, job);
 }
 
 static const call_env_method_t winbind_autz_method_env = {
@@ -4,6 +4,7 @@
 #include "config.h"
 #include <wbclient.h>
 #include <freeradius-devel/server/pool.h>
+#include <freeradius-devel/unlang/offload.h>
 
 /*
  *      Structure for the module configuration.
@@ -14,6 +15,9 @@ typedef struct {
 
 	/* group config */
 	bool			group_add_domain;
+
+	unlang_offload_pool_config_t	offload_config;
+	unlang_offload_pool_t		*offload;	//!< Helper threads which call winbind.
 } rlm_winbind_t;
 
 typedef struct {
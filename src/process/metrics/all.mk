@@ -0,0 +1,9 @@
+TARGETNAME	:= process_metrics
+
+ifneq "$(TARGETNAME)" ""
+TARGET		:= $(TARGETNAME)$(L)
+endif
+
+SOURCES		:= base.c
+
+TGT_PREREQS	:= libfreeradius-util$(L)
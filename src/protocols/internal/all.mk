@@ -1,11 +1,3 @@
-#
-# Makefile
-#
-# Version:      $Id$
-#
-TARGET		:= libfreeradius-internal$(L)
-
-SOURCES		:= decode.c \
-		   encode.c
-
-TGT_PREREQS	:= libfreeradius-util$(L)
+SUBMAKEFILES := \
+	detail_tests.mk \
+	libfreeradius-internal.mk
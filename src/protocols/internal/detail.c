@@ -0,0 +1,316 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file protocols/internal/detail.c
+ * @brief Functions to encode and decode binary detail records.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+#include <freeradius-devel/internal/internal.h>
+#include <freeradius-devel/internal/detail.h>
+#include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/nbo.h>
+#include <freeradius-devel/util/proto.h>
+
+/*
+ *	Offsets of the fields in the header.
+ */
+#define OFFSET_VERSION		4
+#define OFFSET_HDR_LEN		6
+#define OFFSET_RECORD_LEN	8
+#define OFFSET_CHECKSUM		12
+#define OFFSET_TIMESTAMP	16
+#define OFFSET_PROTOCOL		24
+#define OFFSET_CODE		28
+#define OFFSET_CLIENT_ID	32
+#define OFFSET_LISTENER_ID	36
+#define OFFSET_SRC_AF		40
+#define OFFSET_DST_AF		41
+#define OFFSET_SRC_PORT		42
+#define OFFSET_DST_PORT		44
+#define OFFSET_SRC_ADDR		48
+#define OFFSET_DST_ADDR		64
+
+/** Calculate the checksum of a record
+ *
+ * This covers the version and both lengths, as they decide how the
+ * record is parsed, and everything after the checksum.  The magic is
+ * checked separately, and the flags are excluded so that they can be
+ * updated in place.
+ */
+static uint32_t detail_checksum(uint8_t const *data, size_t record_len)
+{
+	uint32_t hash;
+
+	hash = fr_hash(data + OFFSET_VERSION, 1);
+	hash = fr_hash_update(data + OFFSET_HDR_LEN, OFFSET_CHECKSUM - OFFSET_HDR_LEN, hash);
+
+	return fr_hash_update(data + OFFSET_TIMESTAMP, record_len - OFFSET_TIMESTAMP, hash);
+}
+
+static void detail_ipaddr_to_network(uint8_t *af, uint8_t *addr, fr_ipaddr_t const *ipaddr)
+{
+	switch (ipaddr->af) {
+	case AF_INET:
+		*af = 4;
+		memcpy(addr, &ipaddr->addr.v4, sizeof(ipaddr->addr.v4));
+		break;
+
+	case AF_INET6:
+		*af = 6;
+		memcpy(addr, &ipaddr->addr.v6, sizeof(ipaddr->addr.v6));
+		break;
+
+	default:
+		*af = 0;
+		break;
+	}
+}
+
+static int detail_ipaddr_from_network(fr_ipaddr_t *ipaddr, uint8_t af, uint8_t const *addr)
+{
+	memset(ipaddr, 0, sizeof(*ipaddr));
+
+	switch (af) {
+	case 0:
+		ipaddr->af = AF_UNSPEC;
+		break;
+
+	case 4:
+		ipaddr->af = AF_INET;
+		ipaddr->prefix = 32;
+		memcpy(&ipaddr->addr.v4, addr, sizeof(ipaddr->addr.v4));
+		break;
+
+	case 6:
+		ipaddr->af = AF_INET6;
+		ipaddr->prefix = 128;
+		memcpy(&ipaddr->addr.v6, addr, sizeof(ipaddr->addr.v6));
+		break;
+
+	default:
+		fr_strerror_printf("Invalid address family %u", af);
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Check whether a buffer starts with a binary detail record
+ *
+ * @param[in] data	to check.
+ * @param[in] data_len	length of the data.
+ * @return
+ *	- true if the data starts with the binary detail magic.
+ *	- false otherwise.
+ */
+bool fr_detail_binary_is(uint8_t const *data, size_t data_len)
+{
+	if (data_len < FR_DETAIL_BINARY_MAGIC_LEN) return false;
+
+	return (memcmp(data, FR_DETAIL_BINARY_MAGIC, FR_DETAIL_BINARY_MAGIC_LEN) == 0);
+}
+
+/** Find out how large a binary detail record is
+ *
+ * Only the first #FR_DETAIL_BINARY_MIN_LEN octets of the record are
+ * needed.  The checksum is not verified.
+ *
+ * @param[in] data	the start of the record.
+ * @param[in] data_len	how much data is available.
+ * @return
+ *	- >0 the length of the whole record.
+ *	- 0 not enough data to tell.
+ *	- <0 the data is not a binary detail record.
+ */
+ssize_t fr_detail_binary_record_len(uint8_t const *data, size_t data_len)
+{
+	uint16_t	hdr_len;
+	uint32_t	record_len;
+
+	if (data_len < FR_DETAIL_BINARY_MIN_LEN) return 0;
+
+	if (!fr_detail_binary_is(data, data_len)) {
+		fr_strerror_const("Invalid magic in binary detail record");
+		return -1;
+	}
+
+	if (data[OFFSET_VERSION] != FR_DETAIL_BINARY_VERSION) {
+		fr_strerror_printf("Unsupported binary detail record version %u", data[OFFSET_VERSION]);
+		return -1;
+	}
+
+	hdr_len = fr_nbo_to_uint16(data + OFFSET_HDR_LEN);
+	record_len = fr_nbo_to_uint32(data + OFFSET_RECORD_LEN);
+
+	if ((hdr_len < FR_DETAIL_BINARY_HDR_LEN) || (record_len < hdr_len) || (record_len > (1 << 30))) {
+		fr_strerror_printf("Invalid lengths in binary detail record header (%u / %u)", hdr_len, record_len);
+		return -1;
+	}
+
+	return record_len;
+}
+
+/** Encode a binary detail record
+ *
+ * @param[out] dbuff	where to write the record.
+ * @param[in] hdr	the metadata for the record.
+ * @param[in] cursor	over the attributes to encode.  The cursor may
+ *			filter out attributes which shouldn't be written.
+ * @return
+ *	- >0 the length of the encoded record.
+ *	- <=0 on error.
+ */
+ssize_t fr_detail_binary_encode(fr_dbuff_t *dbuff, fr_detail_binary_t const *hdr, fr_dcursor_t *cursor)
+{
+	fr_dbuff_t			work_dbuff = FR_DBUFF(dbuff);
+	fr_dbuff_marker_t		hdr_m;
+	fr_internal_encode_ctx_t	encode_ctx = { .allow_name_only = false };
+	ssize_t				slen;
+	size_t				record_len;
+	uint8_t				*p;
+
+	fr_dbuff_marker(&hdr_m, &work_dbuff);
+
+	/*
+	 *	Reserve room for the header, and fill it in once we
+	 *	know how large the attributes are.
+	 */
+	FR_DBUFF_MEMSET_RETURN(&work_dbuff, 0, FR_DETAIL_BINARY_HDR_LEN);
+
+	while (fr_dcursor_current(cursor)) {
+		slen = fr_internal_encode_pair(&work_dbuff, cursor, &encode_ctx);
+		if (slen < 0) return slen;
+	}
+
+	record_len = fr_dbuff_used(&work_dbuff);
+	if (record_len > UINT32_MAX) {
+		fr_strerror_const("Binary detail record is too large");
+		return -1;
+	}
+
+	p = fr_dbuff_current(&hdr_m);
+
+	memcpy(p, FR_DETAIL_BINARY_MAGIC, FR_DETAIL_BINARY_MAGIC_LEN);
+	p[OFFSET_VERSION] = FR_DETAIL_BINARY_VERSION;
+	p[FR_DETAIL_BINARY_FLAGS_OFFSET] = hdr->flags;
+	fr_nbo_from_uint16(p + OFFSET_HDR_LEN, FR_DETAIL_BINARY_HDR_LEN);
+	fr_nbo_from_uint32(p + OFFSET_RECORD_LEN, record_len);
+	fr_nbo_from_uint64(p + OFFSET_TIMESTAMP, fr_unix_time_unwrap(hdr->timestamp));
+	fr_nbo_from_uint32(p + OFFSET_PROTOCOL, hdr->protocol);
+	fr_nbo_from_uint32(p + OFFSET_CODE, hdr->code);
+	fr_nbo_from_uint32(p + OFFSET_CLIENT_ID, hdr->client_id);
+	fr_nbo_from_uint32(p + OFFSET_LISTENER_ID, hdr->listener_id);
+	detail_ipaddr_to_network(p + OFFSET_SRC_AF, p + OFFSET_SRC_ADDR, &hdr->src_ipaddr);
+	detail_ipaddr_to_network(p + OFFSET_DST_AF, p + OFFSET_DST_ADDR, &hdr->dst_ipaddr);
+	fr_nbo_from_uint16(p + OFFSET_SRC_PORT, hdr->src_port);
+	fr_nbo_from_uint16(p + OFFSET_DST_PORT, hdr->dst_port);
+
+	fr_nbo_from_uint32(p + OFFSET_CHECKSUM, detail_checksum(p, record_len));
+
+	return fr_dbuff_set(dbuff, &work_dbuff);
+}
+
+/** Decode and verify the header of a binary detail record
+ *
+ * @param[out] hdr	where to write the metadata.
+ * @param[in] data	the start of the record.
+ * @param[in] data_len	how much data is available.  This must include the whole record.
+ * @return
+ *	- >0 the length of the whole record.
+ *	- <0 on error.
+ */
+ssize_t fr_detail_binary_decode_header(fr_detail_binary_t *hdr, uint8_t const *data, size_t data_len)
+{
+	ssize_t		record_len;
+	uint32_t	checksum;
+
+	record_len = fr_detail_binary_record_len(data, data_len);
+	if (record_len <= 0) {
+		if (record_len == 0) fr_strerror_const("Binary detail record is truncated");
+		return -1;
+	}
+
+	if ((size_t) record_len > data_len) {
+		fr_strerror_printf("Binary detail record is truncated (%zu of %zd bytes)", data_len, record_len);
+		return -1;
+	}
+
+	checksum = detail_checksum(data, record_len);
+	if (checksum != fr_nbo_to_uint32(data + OFFSET_CHECKSUM)) {
+		fr_strerror_const("Binary detail record failed checksum validation");
+		return -1;
+	}
+
+	hdr->flags = data[FR_DETAIL_BINARY_FLAGS_OFFSET];
+	hdr->timestamp = fr_unix_time_wrap(fr_nbo_to_uint64(data + OFFSET_TIMESTAMP));
+	hdr->protocol = fr_nbo_to_uint32(data + OFFSET_PROTOCOL);
+	hdr->code = fr_nbo_to_uint32(data + OFFSET_CODE);
+	hdr->client_id = fr_nbo_to_uint32(data + OFFSET_CLIENT_ID);
+	hdr->listener_id = fr_nbo_to_uint32(data + OFFSET_LISTENER_ID);
+	hdr->src_port = fr_nbo_to_uint16(data + OFFSET_SRC_PORT);
+	hdr->dst_port = fr_nbo_to_uint16(data + OFFSET_DST_PORT);
+
+	if (detail_ipaddr_from_network(&hdr->src_ipaddr, data[OFFSET_SRC_AF], data + OFFSET_SRC_ADDR) < 0) return -1;
+	if (detail_ipaddr_from_network(&hdr->dst_ipaddr, data[OFFSET_DST_AF], data + OFFSET_DST_ADDR) < 0) return -1;
+
+	return record_len;
+}
+
+/** Decode a binary detail record
+ *
+ * @param[in] ctx	to allocate attributes in.
+ * @param[out] out	where to write the attributes.
+ * @param[in] parent	to decode attributes under.  If NULL, the root of
+ *			the dictionary named by the record is used.
+ * @param[out] hdr	where to write the metadata.
+ * @param[in] data	the start of the record.
+ * @param[in] data_len	how much data is available.
+ * @return
+ *	- >0 the length of the whole record.
+ *	- <0 on error.
+ */
+ssize_t fr_detail_binary_decode(TALLOC_CTX *ctx, fr_pair_list_t *out, fr_dict_attr_t const *parent,
+				fr_detail_binary_t *hdr, uint8_t const *data, size_t data_len)
+{
+	ssize_t		record_len, slen;
+	uint16_t	hdr_len;
+
+	record_len = fr_detail_binary_decode_header(hdr, data, data_len);
+	if (record_len < 0) return record_len;
+
+	if (!parent) {
+		fr_dict_t const *dict;
+
+		dict = fr_dict_by_protocol_num(hdr->protocol);
+		if (!dict) {
+			fr_strerror_printf("Unknown protocol %u in binary detail record", hdr->protocol);
+			return -1;
+		}
+		parent = fr_dict_root(dict);
+	}
+
+	hdr_len = fr_nbo_to_uint16(data + OFFSET_HDR_LEN);
+
+	slen = fr_internal_decode_list_dbuff(ctx, out, parent,
+					     &FR_DBUFF_TMP(data + hdr_len, (size_t) (record_len - hdr_len)), NULL);
+	if (slen < 0) return slen;
+
+	return record_len;
+}
@@ -0,0 +1,123 @@
+#pragma once
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file protocols/internal/detail.h
+ * @brief Binary detail file records.
+ *
+ * A binary detail record is a fixed size header, followed by the
+ * packet attributes in the internal encoding.  All fields are in
+ * network byte order.
+ *
+ @verbatim
+   0                   1                   2                   3
+   0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |                       Magic ("FRdb")                          |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |    Version    |     Flags     |         Header Length         |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |             Record Length (header + attributes)               |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |                           Checksum                            |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |                Timestamp (nanoseconds since epoch)            |
+  |                                                               |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |                       Protocol Number                         |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |                         Packet Code                           |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |                          Client ID                            |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |                         Listener ID                           |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |  Src Family   |  Dst Family   |           Src Port            |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |           Dst Port            |           Reserved            |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |                 Src Address (16 octets)                       |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |                 Dst Address (16 octets)                       |
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+  |  Attributes (internal encoding) ...
+  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ @endverbatim
+ *
+ * The checksum is the 32-bit FNV based fr_hash() / fr_hash_update()
+ * over the Version, Header Length and Record Length fields, followed by
+ * everything after the checksum.
+ * The "Flags" field is not covered by the checksum, so that a reader
+ * can mark a record as processed by over-writing a single octet.
+ *
+ * @copyright 2024 The FreeRADIUS server project
+ */
+RCSIDH(detail_binary_h, "$Id$")
+
+#include <freeradius-devel/util/dbuff.h>
+#include <freeradius-devel/util/dcursor.h>
+#include <freeradius-devel/util/inet.h>
+#include <freeradius-devel/util/pair.h>
+#include <freeradius-devel/util/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FR_DETAIL_BINARY_MAGIC		"FRdb"
+#define FR_DETAIL_BINARY_MAGIC_LEN	4
+#define FR_DETAIL_BINARY_VERSION	1
+
+#define FR_DETAIL_BINARY_HDR_LEN	80		//!< Fixed header, before the attributes.
+#define FR_DETAIL_BINARY_MIN_LEN	12		//!< Enough to find the record length.
+#define FR_DETAIL_BINARY_FLAGS_OFFSET	5		//!< Where the flags octet lives.
+
+#define FR_DETAIL_BINARY_FLAG_DONE	0x01		//!< The record has been processed.
+
+/** Metadata carried in the header of a binary detail record
+ *
+ */
+typedef struct {
+	uint8_t		flags;			//!< FR_DETAIL_BINARY_FLAG_*.
+	fr_unix_time_t	timestamp;		//!< When the packet was received.
+	uint32_t	protocol;		//!< Protocol number of the dictionary used to encode the attributes.
+	uint32_t	code;			//!< Packet code.
+	uint32_t	client_id;		//!< Hash of the client's short name, or 0.
+	uint32_t	listener_id;		//!< Hash of the listener's name, or 0.
+
+	fr_ipaddr_t	src_ipaddr;		//!< Packet source address.
+	fr_ipaddr_t	dst_ipaddr;		//!< Packet destination address.
+	uint16_t	src_port;		//!< Packet source port.
+	uint16_t	dst_port;		//!< Packet destination port.
+} fr_detail_binary_t;
+
+bool	fr_detail_binary_is(uint8_t const *data, size_t data_len);
+
+ssize_t	fr_detail_binary_record_len(uint8_t const *data, size_t data_len);
+
+ssize_t	fr_detail_binary_encode(fr_dbuff_t *dbuff, fr_detail_binary_t const *hdr, fr_dcursor_t *cursor);
+
+ssize_t	fr_detail_binary_decode_header(fr_detail_binary_t *hdr, uint8_t const *data, size_t data_len);
+
+ssize_t	fr_detail_binary_decode(TALLOC_CTX *ctx, fr_pair_list_t *out, fr_dict_attr_t const *parent,
+				fr_detail_binary_t *hdr, uint8_t const *data, size_t data_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,272 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Tests for the binary detail record codec
+ *
+ * @file src/protocols/internal/detail_tests.c
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#define USE_CONSTRUCTOR
+
+#ifdef USE_CONSTRUCTOR
+static void test_init(void) __attribute__((constructor));
+#else
+static void test_init(void);
+#	define TEST_INIT  test_init()
+#endif
+
+#include <freeradius-devel/util/acutest.h>
+#include <freeradius-devel/util/acutest_helpers.h>
+#include <freeradius-devel/util/conf.h>
+#include <freeradius-devel/util/dict_test.h>
+
+#include <freeradius-devel/internal/detail.h>
+
+static TALLOC_CTX	*autofree;
+static fr_dict_t	*test_dict;
+static fr_dict_t	*internal_dict;
+
+/** Release the internal dictionary before the global dictionary context is freed
+ */
+static void test_free(void)
+{
+	fr_dict_free(&internal_dict, __FILE__);
+}
+
+/** Global initialisation
+ */
+static void test_init(void)
+{
+	autofree = talloc_autofree_context();
+	if (!autofree) {
+	error:
+		fr_perror("detail_tests");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	/*
+	 *	Mismatch between the binary and the libraries it depends on
+	 */
+	if (fr_check_lib_magic(RADIUSD_MAGIC_NUMBER) < 0) goto error;
+
+	if (fr_dict_test_init(autofree, &test_dict, NULL) < 0) goto error;
+
+	/*
+	 *	The internal encoder needs the internal dictionary
+	 */
+	if (fr_dict_internal_afrom_file(&internal_dict, FR_DICTIONARY_INTERNAL_DIR, __FILE__) < 0) goto error;
+	atexit(test_free);
+}
+
+static void test_list_alloc(TALLOC_CTX *ctx, fr_pair_list_t *list)
+{
+	fr_pair_t *vp;
+
+	fr_pair_list_init(list);
+
+	TEST_CHECK(fr_pair_append_by_da(ctx, &vp, list, fr_dict_attr_test_string) == 0);
+	TEST_CHECK(fr_pair_value_strdup(vp, "bob", false) == 0);
+
+	TEST_CHECK(fr_pair_append_by_da(ctx, &vp, list, fr_dict_attr_test_uint32) == 0);
+	vp->vp_uint32 = 0x01020304;
+
+	TEST_CHECK(fr_pair_append_by_da(ctx, &vp, list, fr_dict_attr_test_ipv4_addr) == 0);
+	TEST_CHECK(fr_pair_value_from_str(vp, "192.0.2.1", strlen("192.0.2.1"), NULL, false) == 0);
+}
+
+static void test_hdr_init(fr_detail_binary_t *hdr)
+{
+	*hdr = (fr_detail_binary_t) {
+		.timestamp = fr_unix_time_from_sec(1554226681),
+		.protocol = 4242,
+		.code = 4,
+		.client_id = 0xdeadbeef,
+		.listener_id = 0xcafef00d,
+		.src_port = 1234,
+		.dst_port = 1813
+	};
+
+	TEST_CHECK(fr_inet_pton(&hdr->src_ipaddr, "192.0.2.10", -1, AF_INET, false, false) == 0);
+	TEST_CHECK(fr_inet_pton(&hdr->dst_ipaddr, "2001:db8::1", -1, AF_INET6, false, false) == 0);
+}
+
+/** Encode a record, and return its length
+ *
+ */
+static ssize_t test_encode(uint8_t *buffer, size_t buffer_len, fr_pair_list_t *list)
+{
+	fr_detail_binary_t	hdr;
+	fr_dcursor_t		cursor;
+
+	test_hdr_init(&hdr);
+	fr_pair_dcursor_init(&cursor, list);
+
+	return fr_detail_binary_encode(&FR_DBUFF_TMP(buffer, buffer_len), &hdr, &cursor);
+}
+
+static void test_round_trip(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("test");
+	fr_pair_list_t		in, out;
+	fr_detail_binary_t	hdr, expected;
+	uint8_t			buffer[1024];
+	ssize_t			slen, dlen;
+
+	TEST_CASE("Encode a record");
+	test_list_alloc(ctx, &in);
+	slen = test_encode(buffer, sizeof(buffer), &in);
+	TEST_CHECK(slen > FR_DETAIL_BINARY_HDR_LEN);
+	TEST_MSG("encode failed: %s", fr_strerror());
+
+	TEST_CASE("Find the record length from the start of the record");
+	TEST_CHECK(fr_detail_binary_is(buffer, slen));
+	TEST_CHECK(fr_detail_binary_record_len(buffer, FR_DETAIL_BINARY_MIN_LEN) == slen);
+	TEST_CHECK(fr_detail_binary_record_len(buffer, FR_DETAIL_BINARY_MIN_LEN - 1) == 0);
+
+	TEST_CASE("Decode the record");
+	fr_pair_list_init(&out);
+	dlen = fr_detail_binary_decode(ctx, &out, fr_dict_root(test_dict), &hdr, buffer, slen);
+	TEST_CHECK_SLEN(dlen, slen);
+	TEST_MSG("decode failed: %s", fr_strerror());
+
+	TEST_CASE("Attributes are the same");
+	TEST_CHECK(fr_pair_list_num_elements(&out) == 3);
+	TEST_CHECK(fr_pair_list_cmp(&in, &out) == 0);
+
+	TEST_CASE("Header is the same");
+	test_hdr_init(&expected);
+	TEST_CHECK(hdr.flags == 0);
+	TEST_CHECK(fr_unix_time_eq(hdr.timestamp, expected.timestamp));
+	TEST_CHECK(hdr.protocol == expected.protocol);
+	TEST_CHECK(hdr.code == expected.code);
+	TEST_CHECK(hdr.client_id == expected.client_id);
+	TEST_CHECK(hdr.listener_id == expected.listener_id);
+	TEST_CHECK(hdr.src_port == expected.src_port);
+	TEST_CHECK(hdr.dst_port == expected.dst_port);
+	TEST_CHECK(fr_ipaddr_cmp(&hdr.src_ipaddr, &expected.src_ipaddr) == 0);
+	TEST_CHECK(fr_ipaddr_cmp(&hdr.dst_ipaddr, &expected.dst_ipaddr) == 0);
+
+	talloc_free(ctx);
+}
+
+static void test_done_flag(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("test");
+	fr_pair_list_t		in;
+	fr_detail_binary_t	hdr;
+	uint8_t			buffer[1024];
+	ssize_t			slen;
+
+	test_list_alloc(ctx, &in);
+	slen = test_encode(buffer, sizeof(buffer), &in);
+	TEST_CHECK(slen > 0);
+
+	TEST_CASE("Marking a record as done doesn't invalidate the checksum");
+	buffer[FR_DETAIL_BINARY_FLAGS_OFFSET] |= FR_DETAIL_BINARY_FLAG_DONE;
+	TEST_CHECK_SLEN(fr_detail_binary_decode_header(&hdr, buffer, slen), slen);
+	TEST_CHECK(hdr.flags == FR_DETAIL_BINARY_FLAG_DONE);
+
+	talloc_free(ctx);
+}
+
+static void test_bad_checksum(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("test");
+	fr_pair_list_t		in, out;
+	fr_detail_binary_t	hdr;
+	uint8_t			buffer[1024];
+	ssize_t			slen;
+
+	test_list_alloc(ctx, &in);
+	slen = test_encode(buffer, sizeof(buffer), &in);
+	TEST_CHECK(slen > 0);
+
+	TEST_CASE("Corrupt an attribute");
+	buffer[slen - 1] ^= 0xff;
+
+	fr_pair_list_init(&out);
+	TEST_CHECK(fr_detail_binary_decode(ctx, &out, fr_dict_root(test_dict), &hdr, buffer, slen) < 0);
+	TEST_CHECK(fr_pair_list_num_elements(&out) == 0);
+	buffer[slen - 1] ^= 0xff;
+
+	TEST_CASE("Corrupt the header");
+	buffer[FR_DETAIL_BINARY_HDR_LEN - 1] ^= 0x01;
+	TEST_CHECK(fr_detail_binary_decode_header(&hdr, buffer, slen) < 0);
+	buffer[FR_DETAIL_BINARY_HDR_LEN - 1] ^= 0x01;
+
+	TEST_CASE("Corrupt the header length");
+	buffer[7] ^= 0x01;
+	TEST_CHECK(fr_detail_binary_record_len(buffer, slen) == slen);
+	TEST_CHECK(fr_detail_binary_decode_header(&hdr, buffer, slen) < 0);
+	buffer[7] ^= 0x01;
+
+	TEST_CASE("Corrupt the record length");
+	buffer[11] ^= 0x01;
+	TEST_CHECK(fr_detail_binary_decode_header(&hdr, buffer, slen) < 0);
+	buffer[11] ^= 0x01;
+	TEST_CHECK_SLEN(fr_detail_binary_decode_header(&hdr, buffer, slen), slen);
+
+	TEST_CASE("Corrupt the magic");
+	buffer[0] = 'X';
+	TEST_CHECK(!fr_detail_binary_is(buffer, slen));
+	TEST_CHECK(fr_detail_binary_record_len(buffer, slen) < 0);
+	TEST_CHECK(fr_detail_binary_decode_header(&hdr, buffer, slen) < 0);
+
+	talloc_free(ctx);
+}
+
+static void test_truncated(void)
+{
+	TALLOC_CTX		*ctx = talloc_init_const("test");
+	fr_pair_list_t		in, out;
+	fr_detail_binary_t	hdr;
+	uint8_t			buffer[1024];
+	ssize_t			slen;
+
+	test_list_alloc(ctx, &in);
+	slen = test_encode(buffer, sizeof(buffer), &in);
+	TEST_CHECK(slen > 0);
+
+	TEST_CASE("Record is missing its last octet");
+	fr_pair_list_init(&out);
+	TEST_CHECK(fr_detail_binary_decode(ctx, &out, fr_dict_root(test_dict), &hdr, buffer, slen - 1) < 0);
+	TEST_CHECK(fr_pair_list_num_elements(&out) == 0);
+
+	TEST_CASE("Record is only a partial header");
+	TEST_CHECK(fr_detail_binary_decode_header(&hdr, buffer, FR_DETAIL_BINARY_MIN_LEN - 1) < 0);
+	TEST_CHECK(fr_detail_binary_decode_header(&hdr, buffer, FR_DETAIL_BINARY_HDR_LEN - 1) < 0);
+
+	TEST_CASE("Record length is shorter than the header");
+	buffer[8] = buffer[9] = buffer[10] = 0;
+	buffer[11] = FR_DETAIL_BINARY_HDR_LEN - 1;
+	TEST_CHECK(fr_detail_binary_record_len(buffer, slen) < 0);
+
+	TEST_CASE("Output buffer is too small");
+	TEST_CHECK(test_encode(buffer, FR_DETAIL_BINARY_HDR_LEN - 1, &in) <= 0);
+	TEST_CHECK(test_encode(buffer, slen - 1, &in) <= 0);
+
+	talloc_free(ctx);
+}
+
+TEST_LIST = {
+	{ "round_trip",		test_round_trip },
+	{ "done_flag",		test_done_flag },
+	{ "bad_checksum",	test_bad_checksum },
+	{ "truncated",		test_truncated },
+
+	{ NULL }
+};
@@ -0,0 +1,8 @@
+TARGET		:= detail_tests$(E)
+SOURCES		:= detail_tests.c
+
+TGT_LDLIBS	:= $(LIBS) $(GPERFTOOLS_LIBS)
+TGT_LDFLAGS	:= $(LDFLAGS) $(GPERFTOOLS_LDFLAGS)
+TGT_PREREQS	:= libfreeradius-util$(L) libfreeradius-internal$(L)
+
+TGT_INSTALLDIR	:=
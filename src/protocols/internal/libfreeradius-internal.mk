@@ -0,0 +1,12 @@
+#
+# Makefile
+#
+# Version:      $Id$
+#
+TARGET		:= libfreeradius-internal$(L)
+
+SOURCES		:= decode.c \
+		   detail.c \
+		   encode.c
+
+TGT_PREREQS	:= libfreeradius-util$(L)
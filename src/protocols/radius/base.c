@@ -898,6 +898,7 @@ ssize_t fr_radius_encode_dbuff(fr_dbuff_t *dbuff, uint8_t const *original,
 	packet_ctx.rand_ctx.a = fr_rand();
 	packet_ctx.rand_ctx.b = fr_rand();
 	packet_ctx.disallow_tunnel_passwords = disallow_tunnel_passwords[code];
+	packet_ctx.header_cache = fr_radius_encode_header_cache;
 
 	/*
 	 *	The RADIUS header can't do more than 64K of data.
@@ -1064,6 +1065,9 @@ ssize_t	fr_radius_decode(TALLOC_CTX *ctx, fr_pair_list_t *out,
 	attr = packet + 20;
 	end = packet + packet_len;
 
+	decode_ctx->packet = packet;
+	decode_ctx->packet_end = end;
+
 	/*
 	 *	The caller MUST have called fr_radius_ok() first.  If
 	 *	he doesn't, all hell breaks loose.
@@ -1144,6 +1148,7 @@ void fr_radius_global_free(void)
 
 	if (--instance_count > 0) return;
 
+	fr_radius_encode_header_cache_flush();
 	fr_dict_autofree(libfreeradius_radius_dict);
 }
 
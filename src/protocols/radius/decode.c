@@ -336,12 +336,25 @@ int fr_radius_decode_tlv_ok(uint8_t const *data, size_t length, size_t dv_type,
 	return 0;
 }
 
+/** Whether an octets value can reference the packet, instead of being copied
+ *
+ * Secret values are always copied, as they are scrubbed when freed.
+ * Values which have been decrypted or reassembled don't point into the
+ * packet, and are copied as usual.
+ */
+static inline bool decode_shared(fr_radius_decode_ctx_t const *packet_ctx, fr_dict_attr_t const *da,
+				 uint8_t const *p, size_t len)
+{
+	return packet_ctx->shared && !da->flags.secret &&
+	       (p >= packet_ctx->packet) && ((p + len) <= packet_ctx->packet_end);
+}
+
 /** Convert a "concatenated" attribute to one long VP
  *
  */
 static ssize_t decode_concat(TALLOC_CTX *ctx, fr_pair_list_t *list,
 			     fr_dict_attr_t const *parent, uint8_t const *data,
-			     uint8_t const *end)
+			     uint8_t const *end, fr_radius_decode_ctx_t *packet_ctx)
 {
 	size_t		total;
 	uint8_t		attr;
@@ -389,6 +402,16 @@ static ssize_t decode_concat(TALLOC_CTX *ctx, fr_pair_list_t *list,
 	vp = fr_pair_afrom_da(ctx, parent);
 	if (!vp) return -1;
 
+	/*
+	 *	A single attribute doesn't need to be
+	 *	concatenated, so it can reference the packet.
+	 */
+	if ((total == (size_t) (data[1] - 2)) && decode_shared(packet_ctx, parent, data + 2, total)) {
+		fr_value_box_memdup_shared(&vp->data, vp->da, data + 2, total, true);
+		fr_pair_append(list, vp);
+		return end - data;
+	}
+
 	if (fr_pair_value_mem_alloc(vp, &p, total, true) != 0) {
 		talloc_free(vp);
 		return -1;
@@ -1928,6 +1951,11 @@ ssize_t fr_radius_decode_pair_value(TALLOC_CTX *ctx, fr_pair_list_t *out,
 		 *	doesn't.  Therefore it's malformed.
 		 */
 		if (parent->flags.length && (data_len != parent->flags.length)) goto raw;
+
+		if (decode_shared(packet_ctx, vp->da, p, data_len)) {
+			fr_value_box_memdup_shared(&vp->data, vp->da, p, data_len, true);
+			break;
+		}
 		FALL_THROUGH;
 
 	default:
@@ -2053,7 +2081,7 @@ ssize_t fr_radius_decode_pair(TALLOC_CTX *ctx, fr_pair_list_t *out,
 		 */
 		if (flag_concat(&da->flags)) {
 			FR_PROTO_TRACE("Concat attribute");
-			return decode_concat(ctx, out, da, data, packet_ctx->end);
+			return decode_concat(ctx, out, da, data, packet_ctx->end, packet_ctx);
 		}
 
 		/*
@@ -24,8 +24,10 @@
  */
 RCSID("$Id$")
 
+#include <freeradius-devel/util/atexit.h>
 #include <freeradius-devel/util/dbuff.h>
 #include <freeradius-devel/util/md5.h>
+#include <freeradius-devel/util/nbo.h>
 #include <freeradius-devel/util/struct.h>
 #include <freeradius-devel/io/test_point.h>
 #include <freeradius-devel/protocol/radius/freeradius.internal.h>
@@ -514,7 +516,7 @@ static ssize_t encode_value(fr_dbuff_t *dbuff,
 	case FLAG_ENCRYPT_TUNNEL_PASSWORD:
 		if (packet_ctx->disallow_tunnel_passwords) {
 			fr_strerror_const("Attributes with 'encrypt=2' set cannot go into this packet.");
-			return PAIR_ENCODE_SKIPPED;
+			goto skip;
 		}
 
 		/*
@@ -585,7 +587,7 @@ static ssize_t encode_value(fr_dbuff_t *dbuff,
 		(void) fr_dbuff_out(&msb, &src);
 		if (msb != 0) {
 			fr_strerror_const("Integer overflow for tagged uint32 attribute");
-			return PAIR_ENCODE_SKIPPED;
+			goto skip;
 		}
 		fr_dbuff_set(&dest, &value_start);
 		fr_dbuff_in(&dest, packet_ctx->tag);
@@ -601,6 +603,16 @@ static ssize_t encode_value(fr_dbuff_t *dbuff,
 	fr_proto_da_stack_build(da_stack, vp ? vp->da : NULL);
 
 	return fr_dbuff_set(dbuff, &work_dbuff);
+
+	/*
+	 *	Move past the attribute, otherwise the caller will
+	 *	try to encode it again, forever.
+	 */
+skip:
+	vp = fr_dcursor_next(cursor);
+	fr_proto_da_stack_build(da_stack, vp ? vp->da : NULL);
+
+	return PAIR_ENCODE_SKIPPED;
 }
 
 /** Breaks down large data into pieces, each with a header
@@ -1497,6 +1509,330 @@ static ssize_t encode_rfc(fr_dbuff_t *dbuff, fr_da_stack_t *da_stack, unsigned i
 	return encode_child(dbuff, da_stack, depth, cursor, encode_ctx);
 }
 
+/*
+ *	Per-thread cache of pre-built attribute headers.
+ *
+ *	Most replies are made up of the same small set of attributes,
+ *	e.g. Framed-IP-Address, Session-Timeout, Class, and a few VSAs.
+ *	For those, the generic encoder builds a da_stack, and then walks
+ *	through several layers of functions, just to write a two byte
+ *	header and a fixed size value.
+ *
+ *	Instead, we cache the header for each attribute the first time
+ *	we see it, and then write the header and value directly.  The
+ *	cache is direct mapped, keyed by the address of the dictionary
+ *	attribute.  Collisions just cause the entry to be rebuilt.
+ *
+ *	The dictionaries are read-only once loaded, so the cache is kept
+ *	per thread, and needs no locks.
+ */
+#define ENCODE_CACHE_SIZE	(256)
+#define ENCODE_CACHE_HASH(_da)	((((uintptr_t)(_da) >> 4) ^ ((uintptr_t)(_da) >> 12)) & (ENCODE_CACHE_SIZE - 1))
+
+typedef struct {
+	fr_dict_attr_t const	*da;			//!< the attribute this entry is for
+	uint8_t			hdr[8];			//!< pre-built header, with the length fields zeroed
+	uint8_t			hdr_len;		//!< 0 if the attribute can't use the fast path
+	uint8_t			value_len;		//!< for fixed width types, 0 for string / octets
+	uint8_t			max_len;		//!< maximum value length which fits into one attribute
+} encode_cache_entry_t;
+
+typedef struct {
+	uint64_t		generation;		//!< of the dictionaries the entries were built from
+	encode_cache_entry_t	entry[ENCODE_CACHE_SIZE];
+} encode_cache_t;
+
+/** Use the header cache in fr_radius_encode_dbuff()
+ *
+ * The output is identical either way.  This is mainly so that the
+ * benchmarks can compare the two encoders.
+ */
+bool fr_radius_encode_header_cache = true;
+
+static uint64_t encode_cache_generation = 1;
+
+static _Thread_local encode_cache_t *encode_cache;
+
+static int _encode_cache_free(void *arg)
+{
+	talloc_free(arg);
+	encode_cache = NULL;
+	return 0;
+}
+
+/** Invalidate the header caches of all threads
+ *
+ * Called when the dictionaries are freed, as a new attribute may later
+ * be allocated at the same address as an old one.
+ */
+void fr_radius_encode_header_cache_flush(void)
+{
+	encode_cache_generation++;
+}
+
+/** Fill in a cache entry for an attribute
+ *
+ * Anything which needs special handling (tags, encryption, concat,
+ * extended attributes, TLVs, WiMAX, etc.) is marked as not eligible,
+ * and is always encoded by the generic encoder.
+ */
+static void encode_cache_entry_build(encode_cache_entry_t *entry, fr_dict_attr_t const *da)
+{
+	fr_dict_attr_t const	*parent = da->parent;
+	fr_dict_vendor_t const	*dv;
+	uint8_t			value_len;
+
+	memset(entry, 0, sizeof(*entry));
+	entry->da = da;
+
+	if ((da->dict != dict_radius) ||
+	    da->flags.internal || da->flags.is_unknown || da->flags.is_raw ||
+	    da->flags.subtype || da->flags.extra ||
+	    (da->attr == 0) || (da->attr > UINT8_MAX) ||
+	    (da == attr_chargeable_user_identity) ||
+	    (da == attr_message_authenticator) ||
+	    (da == attr_nas_filter_rule)) return;
+
+	switch (da->type) {
+	case FR_TYPE_UINT8:
+		value_len = 1;
+		break;
+
+	case FR_TYPE_UINT16:
+		value_len = 2;
+		break;
+
+	case FR_TYPE_UINT32:
+	case FR_TYPE_INT32:
+	case FR_TYPE_IPV4_ADDR:
+		value_len = 4;
+		break;
+
+	case FR_TYPE_UINT64:
+		value_len = 8;
+		break;
+
+	case FR_TYPE_IPV6_ADDR:
+		value_len = 16;
+		break;
+
+	case FR_TYPE_STRING:
+	case FR_TYPE_OCTETS:
+		/*
+		 *	Fixed size string / octets get padded or
+		 *	truncated by the generic encoder.
+		 */
+		if (da->flags.length) return;
+		value_len = 0;
+		break;
+
+	default:
+		return;
+	}
+
+	/*
+	 *	RFC attribute.
+	 */
+	if (parent->flags.is_root) {
+		entry->hdr[0] = da->attr;
+		entry->hdr_len = 2;
+		entry->max_len = UINT8_MAX - 2;
+		entry->value_len = value_len;
+		return;
+	}
+
+	/*
+	 *	Vendor-Specific -> Vendor -> attribute, with the
+	 *	standard one octet type and length fields.
+	 */
+	if ((parent->type != FR_TYPE_VENDOR) || (parent->flags.type_size != 1) || (parent->flags.length != 1) ||
+	    (parent->parent != attr_vendor_specific)) return;
+
+	dv = fr_dict_vendor_by_da(parent);
+	if (dv && dv->continuation) return;
+
+	entry->hdr[0] = FR_VENDOR_SPECIFIC;
+	fr_nbo_from_uint32(entry->hdr + 2, parent->attr);
+	entry->hdr[6] = da->attr;
+	entry->hdr_len = 8;
+	entry->max_len = UINT8_MAX - 8;
+	entry->value_len = value_len;
+}
+
+/** Find the cache entry for an attribute, building it if necessary
+ *
+ * @return
+ *	- The cache entry.
+ *	- NULL if the cache couldn't be allocated.  The caller should
+ *	  use the generic encoder.
+ */
+static inline CC_HINT(always_inline) encode_cache_entry_t const *encode_cache_find(fr_dict_attr_t const *da)
+{
+	encode_cache_t		*cache = encode_cache;
+	encode_cache_entry_t	*entry;
+
+	if (unlikely(!cache)) {
+		cache = talloc_zero(NULL, encode_cache_t);
+		if (!cache) return NULL;
+		fr_atexit_thread_local(encode_cache, _encode_cache_free, cache);
+	}
+
+	if (unlikely(cache->generation != encode_cache_generation)) {
+		memset(cache->entry, 0, sizeof(cache->entry));
+		cache->generation = encode_cache_generation;
+	}
+
+	entry = &cache->entry[ENCODE_CACHE_HASH(da)];
+	if (unlikely(entry->da != da)) encode_cache_entry_build(entry, da);
+
+	return entry;
+}
+
+/** Return how many bytes the fast path would write for a pair
+ *
+ * @return
+ *	- 0 the pair has to be encoded by the generic encoder.
+ *	- >0 the length of the encoded attribute.
+ */
+static inline CC_HINT(always_inline) size_t encode_fast_len(encode_cache_entry_t const *entry, fr_pair_t const *vp)
+{
+	size_t	value_len;
+
+	if (!entry || !entry->hdr_len || (vp->vp_type != vp->da->type)) return 0;
+
+	value_len = entry->value_len;
+	if (!value_len) {
+		value_len = vp->vp_length;
+		if ((value_len == 0) || (value_len > entry->max_len)) return 0;
+	}
+
+	return entry->hdr_len + value_len;
+}
+
+/** Write one attribute using its cached header
+ *
+ * The caller has already checked that the attribute fits.
+ *
+ * For RFC attributes, the header length and the attribute length
+ * are the same octet.  For VSAs, the last octet of the header is
+ * the vendor attribute length.  So we can write both without
+ * checking which kind of header we have.
+ */
+static inline CC_HINT(always_inline) void encode_fast_write(uint8_t *p, encode_cache_entry_t const *entry,
+							     fr_pair_t const *vp, size_t len)
+{
+	memcpy(p, entry->hdr, entry->hdr_len);
+	p[1] = len;
+	p[entry->hdr_len - 1] = len - (entry->hdr_len - 2);
+	p += entry->hdr_len;
+
+	switch (vp->vp_type) {
+	case FR_TYPE_UINT8:
+		p[0] = vp->vp_uint8;
+		break;
+
+	case FR_TYPE_UINT16:
+		fr_nbo_from_uint16(p, vp->vp_uint16);
+		break;
+
+	case FR_TYPE_UINT32:
+		fr_nbo_from_uint32(p, vp->vp_uint32);
+		break;
+
+	case FR_TYPE_INT32:
+		fr_nbo_from_int32(p, vp->vp_int32);
+		break;
+
+	case FR_TYPE_UINT64:
+		fr_nbo_from_uint64(p, vp->vp_uint64);
+		break;
+
+	case FR_TYPE_IPV4_ADDR:
+		memcpy(p, &vp->vp_ipv4addr, 4);
+		break;
+
+	case FR_TYPE_IPV6_ADDR:
+		memcpy(p, vp->vp_ipv6addr, 16);
+		break;
+
+	default:
+		memcpy(p, vp->vp_ptr, vp->vp_length);
+		break;
+	}
+
+	FR_PROTO_HEX_DUMP(p - entry->hdr_len, len, "fast %s", vp->da->name);
+}
+
+/** Encode a leaf attribute, or a nested Vendor-Specific, using the cached headers
+ *
+ * @return
+ *	- 0 the generic encoder has to be used.
+ *	- >0 the number of bytes written.  The cursor has been advanced.
+ */
+static ssize_t encode_pair_fast(fr_dbuff_t *dbuff, fr_dcursor_t *cursor, fr_pair_t const *vp)
+{
+	encode_cache_entry_t const	*entry;
+	fr_pair_t const			*vendor, *child;
+	uint8_t				*p;
+	size_t				len, total;
+
+	/*
+	 *	Leaf attributes, either RFC ones, or flat VSAs.
+	 */
+	if (vp->da != attr_vendor_specific) {
+		entry = encode_cache_find(vp->da);
+		len = encode_fast_len(entry, vp);
+		if (!len || (len > fr_dbuff_remaining(dbuff))) return 0;
+
+		encode_fast_write(fr_dbuff_current(dbuff), entry, vp, len);
+		fr_dbuff_advance(dbuff, len);
+		fr_dcursor_next(cursor);
+		return len;
+	}
+
+	/*
+	 *	Nested Vendor-Specific.  Either all of the children
+	 *	can use the fast path, or none of them do.
+	 */
+	total = 0;
+	for (vendor = fr_pair_list_head(&vp->vp_group);
+	     vendor;
+	     vendor = fr_pair_list_next(&vp->vp_group, vendor)) {
+		if ((vendor->da->type != FR_TYPE_VENDOR) || fr_pair_list_empty(&vendor->vp_group)) return 0;
+
+		for (child = fr_pair_list_head(&vendor->vp_group);
+		     child;
+		     child = fr_pair_list_next(&vendor->vp_group, child)) {
+			if (child->da->parent != vendor->da) return 0;
+
+			len = encode_fast_len(encode_cache_find(child->da), child);
+			if (!len) return 0;
+			total += len;
+		}
+	}
+
+	if (!total || (total > fr_dbuff_remaining(dbuff))) return 0;
+
+	p = fr_dbuff_current(dbuff);
+	for (vendor = fr_pair_list_head(&vp->vp_group);
+	     vendor;
+	     vendor = fr_pair_list_next(&vp->vp_group, vendor)) {
+		for (child = fr_pair_list_head(&vendor->vp_group);
+		     child;
+		     child = fr_pair_list_next(&vendor->vp_group, child)) {
+			entry = encode_cache_find(child->da);
+			len = encode_fast_len(entry, child);
+
+			encode_fast_write(p, entry, child, len);
+			p += len;
+		}
+	}
+
+	fr_dbuff_advance(dbuff, total);
+	fr_dcursor_next(cursor);
+	return total;
+}
+
 /** Encode a data structure into a RADIUS attribute
  *
  * This is the main entry point into the encoder.  It sets up the encoder array
@@ -1516,6 +1852,7 @@ ssize_t fr_radius_encode_pair(fr_dbuff_t *dbuff, fr_dcursor_t *cursor, void *enc
 	fr_pair_t const		*vp;
 	ssize_t			slen;
 	fr_dbuff_t		work_dbuff = FR_DBUFF(dbuff);
+	fr_radius_encode_ctx_t	*packet_ctx = encode_ctx;
 
 	fr_da_stack_t		da_stack;
 	fr_dict_attr_t const	*da = NULL;
@@ -1538,8 +1875,6 @@ ssize_t fr_radius_encode_pair(fr_dbuff_t *dbuff, fr_dcursor_t *cursor, void *enc
 	 */
 	if ((vp->vp_type == FR_TYPE_GROUP) && vp->da->flags.internal &&
 	    (vp->da->attr > FR_TAG_BASE) && (vp->da->attr < (FR_TAG_BASE + 0x20))) {
-		fr_radius_encode_ctx_t	*packet_ctx = encode_ctx;
-
 		packet_ctx->tag = vp->da->attr - FR_TAG_BASE;
 		fr_assert(packet_ctx->tag > 0);
 		fr_assert(packet_ctx->tag < 0x20);
@@ -1588,6 +1923,15 @@ ssize_t fr_radius_encode_pair(fr_dbuff_t *dbuff, fr_dcursor_t *cursor, void *enc
 	 *	only use 255 bytes of buffer space at a time.
 	 */
 
+	/*
+	 *	Faster path for common attributes, using the cached
+	 *	headers.
+	 */
+	if (packet_ctx && packet_ctx->header_cache) {
+		slen = encode_pair_fast(&work_dbuff, cursor, vp);
+		if (slen > 0) return fr_dbuff_set(dbuff, &work_dbuff);
+	}
+
 	/*
 	 *	Fast path for the common case.
 	 */
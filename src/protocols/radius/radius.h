@@ -131,6 +131,7 @@ typedef struct {
 
 	bool			disallow_tunnel_passwords; //!< not all packets can have tunnel passwords
 	bool			seen_message_authenticator;
+	bool			header_cache;		//!< use the cached attribute headers where possible
 } fr_radius_encode_ctx_t;
 
 typedef struct {
@@ -147,6 +148,11 @@ typedef struct {
 	bool			verify;			//!< can skip verify for dynamic clients
 	bool			require_message_authenticator;
 
+	bool			shared;			//!< octets values reference the packet, instead of
+							///< copying it.  The packet must outlive the pairs.
+	uint8_t const		*packet;		//!< start of the packet, for checking shared values.
+	uint8_t const		*packet_end;		//!< end of the packet, as "end" changes for fragments.
+
 	fr_radius_tag_ctx_t    	**tags;			//!< for decoding tagged attributes
 	fr_pair_list_t		*tag_root;		//!< Where to insert tag attributes.
 	TALLOC_CTX		*tag_root_ctx;		//!< Where to allocate new tag attributes.
@@ -217,6 +223,10 @@ ssize_t		fr_radius_decode_abinary(fr_pair_t *vp, uint8_t const *data, size_t dat
 /*
  *	protocols/radius/encode.c
  */
+extern bool	fr_radius_encode_header_cache;
+
+void		fr_radius_encode_header_cache_flush(void);
+
 ssize_t		fr_radius_encode_pair(fr_dbuff_t *dbuff, fr_dcursor_t *cursor, void *encode_ctx);
 
 ssize_t		fr_radius_encode_foreign(fr_dbuff_t *dbuff, fr_pair_list_t const *list) CC_HINT(nonnull);
@@ -55,8 +55,12 @@ test: \
 		test.modules	\
 		test.radiusd-c	\
 		test.radclient	\
+		test.radclient_load \
+		test.radsec	\
+		test.radius_tcp	\
 		test.detail	\
 		test.radsniff	\
+		test.performance.compare \
 		test.auth	\
 		test.digest	\
 		test.radmin	\
@@ -82,9 +86,9 @@ ci-test: raddb/test.conf test
 #  The tests do a lot of rooting through files, which slows down non-test builds.
 #
 #  Therefore only include the test subdirectories if we're running the tests.
-#  Or, if we're trying to clean things up.
+#  Or, if we're trying to clean things up.  "perf" runs the performance tests.
 #
-ifneq "$(findstring test,$(MAKECMDGOALS))$(findstring clean,$(MAKECMDGOALS))" ""
+ifneq "$(findstring test,$(MAKECMDGOALS))$(findstring clean,$(MAKECMDGOALS))$(filter perf,$(MAKECMDGOALS))" ""
 
 #
 #  Add LSAN / ASAN options.  And shut them up on OSX, which has leaks in libc.
@@ -26,6 +26,71 @@ $(OUTPUT)/%: $(DIR)/% $(addprefix ${BUILD_DIR}/lib/,proto_detail.la proto_detail
 	fi
 	${Q}touch $@
 
+#
+#	The same entries, converted to the binary format by raddetail.
+#
+#	Converting them back to text, and then to binary again, has to
+#	give exactly the same file.  The server then reads the binary
+#	file, and has to see the same attributes as the text file.
+#
+#	Each run uses the same input file name, so they're chained
+#	after the text test.
+#
+DETAIL_DIR	:= $(DIR)
+DETAIL_BINARY	:= $(addprefix $(OUTPUT)/,$(addsuffix .binary,$(FILES)))
+DETAIL_CORRUPT	:= $(addprefix $(OUTPUT)/,$(addsuffix .corrupt,$(FILES)))
+
+$(OUTPUT)/%.binary: $(DETAIL_DIR)/% $(OUTPUT)/% $(TEST_BIN_DIR)/raddetail
+	${Q}echo "DETAIL-BINARY $(notdir $<)"
+	${Q}rm -f $(dir $@)/$*.bin $(dir $@)/$*.bin.txt $(dir $@)/$*.bin.bin
+	${Q}if ! $(TEST_BIN)/raddetail -D ${top_srcdir}/share/dictionary $< $(dir $@)/$*.bin || \
+	     ! $(TEST_BIN)/raddetail -D ${top_srcdir}/share/dictionary $(dir $@)/$*.bin $(dir $@)/$*.bin.txt || \
+	     ! $(TEST_BIN)/raddetail -D ${top_srcdir}/share/dictionary $(dir $@)/$*.bin.txt $(dir $@)/$*.bin.bin; then \
+		echo "$(TEST_BIN)/raddetail -D ${top_srcdir}/share/dictionary $< $(dir $@)/$*.bin"; \
+		exit 1; \
+	fi
+	${Q}if ! cmp $(dir $@)/$*.bin $(dir $@)/$*.bin.bin; then \
+		echo "FAILED converting $(dir $@)/$*.bin.txt back to binary"; \
+		exit 1; \
+	fi
+	${Q}cp $(dir $@)/$*.bin $(dir $@)/detail.bin
+	${Q}if ! $(TEST_BIN)/radiusd -d $(DETAIL_DIR)/config -D ${top_srcdir}/share/dictionary -X > $@.log; then \
+		tail $@.log; \
+		echo "cp $(dir $@)/$*.bin $(dir $@)/detail.bin; $(TEST_BIN)/radiusd -d $(DETAIL_DIR)/config -D ${top_srcdir}/share/dictionary -X "; \
+		exit 1; \
+	fi
+	${Q}grep '^[[:space:]]' $< | grep -v 'Timestamp = ' | while read -r attr; do \
+		if ! grep -qF "$$attr" $@.log; then \
+			echo "FAILED finding '$$attr' in $@.log"; \
+			exit 1; \
+		fi; \
+	done
+	${Q}touch $@
+
+#
+#	A record with a bad checksum, then a good one, then a truncated
+#	one.  The first and last are skipped, and the good one is read.
+#
+$(OUTPUT)/%.corrupt: $(DETAIL_DIR)/% $(OUTPUT)/%.binary
+	${Q}echo "DETAIL-CORRUPT $(notdir $<)"
+	${Q}cp $(dir $@)/$*.bin $(dir $@)/$*.bad
+	${Q}printf '\377' | dd of=$(dir $@)/$*.bad bs=1 seek=16 conv=notrunc 2>/dev/null
+	${Q}cat $(dir $@)/$*.bad $(dir $@)/$*.bin > $(dir $@)/detail.bin
+	${Q}head -c 40 $(dir $@)/$*.bin >> $(dir $@)/detail.bin
+	${Q}if ! $(TEST_BIN)/radiusd -d $(DETAIL_DIR)/config -D ${top_srcdir}/share/dictionary -X > $@.log; then \
+		tail $@.log; \
+		exit 1; \
+	fi
+	${Q}for msg in "Ignoring entry at offset 0" "Ignoring truncated record" "$$(sed -n 2p $< | sed 's/^[[:space:]]*//')"; do \
+		if ! grep -qF "$$msg" $@.log; then \
+			echo "FAILED finding '$$msg' in $@.log"; \
+			exit 1; \
+		fi; \
+	done
+	${Q}touch $@
+
+$(BUILD_DIR)/tests/$(TEST): $(DETAIL_BINARY) $(DETAIL_CORRUPT)
+
 .NO_PARALLEL: $(TEST)
 $(TEST):
 	@touch $(BUILD_DIR)/tests/$@
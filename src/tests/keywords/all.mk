@@ -68,14 +68,14 @@ endif
 #
 #  Tests for the "update" keyword
 ifneq "$(findstring ${1}, update-remove-index update-to-edit vendor-specific-error )" ""
-$(OUTPUT)/${1}: NEW_COND=
+$(OUTPUT)/${1} $(OUTPUT)/flatten/${1}: NEW_COND=
 
 # Tests for rewriting "update"
 else ifneq "$(findstring ${1}, update-all update-array update-delete update-remove-any update-group update-hex update-remove-value update-index update-list-error update-remove-list update-prepend unknown-update update-error update-error-2 update-exec-error update-list-null-rhs update-exec update-error-3 update-group-error update-null-value-assign update-filter xlat-unknown )" ""
-$(OUTPUT)/${1}: NEW_COND=-S rewrite_update=yes
+$(OUTPUT)/${1} $(OUTPUT)/flatten/${1}: NEW_COND=-S rewrite_update=yes
 
 else
-$(OUTPUT)/${1}: NEW_COND=-S forbid_update=yes
+$(OUTPUT)/${1} $(OUTPUT)/flatten/${1}: NEW_COND=-S forbid_update=yes
 
 ifeq "${1}" "mschap"
 $(OUTPUT)/${1}: $(BUILD_DIR)/lib/local/rlm_mschap.la $(BUILD_DIR)/lib/rlm_mschap.la
@@ -175,8 +175,57 @@ $(OUTPUT)/%: $(DIR)/% $(TEST_BIN_DIR)/unit_test_module | $(KEYWORD_RADDB) $(KEYW
 		fi \
 	fi
 
-$(TEST):
+#
+#  Run the control flow tests again, with each compiled section laid
+#  out contiguously.  See "interpret { flatten }" in radiusd.conf.
+#  The results have to be the same.  Tests which are expected to fail
+#  to compile (i.e. have an ERROR line) are skipped.
+#
+KEYWORD_FLATTEN := $(filter-out $(notdir $(shell grep -l ERROR $(addprefix $(DIR)/,$(FILES)))),\
+			$(filter break% call% case% else% foreach% if if-else if-elsif \
+			if-nested-logic if-skip limit load-balance% parallel% redundant% return% subrequest% switch% \
+			timeout transaction try%,$(FILES)))
+
+$(OUTPUT)/flatten:
+	${Q}mkdir -p $@
+
+$(OUTPUT)/flatten/%: $(OUTPUT)/% | $(OUTPUT)/flatten
+	$(eval CMD:=KEYWORD=$(notdir $@) $(TEST_BIN)/unit_test_module -S flatten=yes $(NEW_COND) $(UNIT_TEST_KEYWORD_ARGS.$(subst -,_,$(notdir $@))) -D share/dictionary -d src/tests/keywords/ -i "$<.attrs" -f "$<.attrs" -r "$@" -xx)
+	@echo "KEYWORD-TEST flatten $(notdir $@)"
+	${Q}if ! $(CMD) > "$@.log" 2>&1 || ! test -f "$@"; then \
+		cat $@.log; \
+		echo "# $@.log"; \
+		echo $(CMD); \
+		rm -f $(BUILD_DIR)/tests/test.keywords; \
+		exit 1; \
+	fi
+
+$(TEST): $(addprefix $(OUTPUT)/flatten/,$(KEYWORD_FLATTEN))
 	@touch $(BUILD_DIR)/tests/$@
 
+#
+#  Interpreter microbenchmark.  Runs each test KEYWORD_BENCH_COUNT times,
+#  with and without "flatten", and prints the time per request.
+#
+#	make test.keywords.bench KEYWORD_BENCH="if-elsif switch-default"
+#
+#  Use a build without --enable-developer.  Developer builds check the
+#  memory used after every request, which swamps the interpreter.
+#
+KEYWORD_BENCH		?= if-elsif switch-default foreach-nested return-within-policy redundant
+KEYWORD_BENCH_COUNT	?= 100000
+
+.PHONY: $(TEST).bench
+$(TEST).bench: BENCH_OUTPUT := $(OUTPUT)
+$(TEST).bench: $(addprefix $(OUTPUT)/,$(addsuffix .attrs,$(KEYWORD_BENCH))) $(TEST_BIN_DIR)/unit_test_module | $(KEYWORD_RADDB) $(KEYWORD_LIBS) build.raddb rlm_test.la rlm_csv.la rlm_unpack.la
+	${Q}for x in $(KEYWORD_BENCH); do \
+		for flatten in no yes; do \
+			printf '%-24s flatten=%-3s ' $$x $$flatten; \
+			KEYWORD=$$x $(TEST_BIN)/unit_test_module -S forbid_update=yes -S flatten=$$flatten -c $(KEYWORD_BENCH_COUNT) \
+				-D share/dictionary -d src/tests/keywords/ -i "$(BENCH_OUTPUT)/$$x.attrs" -f "$(BENCH_OUTPUT)/$$x.attrs" \
+				-r "$(BENCH_OUTPUT)/$$x.bench" 2>&1 | sed -n 's/.*Ran [0-9]* requests in //p'; \
+		done; \
+	done
+
 $(TEST).help:
 	@echo make $(TEST_KEYWORDS_HELP)
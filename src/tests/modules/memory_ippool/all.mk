@@ -0,0 +1,28 @@
+#
+#  Test the "memory_ippool" module
+#
+
+#
+#  The tests share the journals, so they run one at a time, in
+#  order.  "restart_before" leaves leases behind, which "restart"
+#  checks are still there when the module is instantiated again.
+#
+#  The journals are removed whenever any of the tests change, so
+#  that the tests always start from empty pools.
+#
+#  This file is included once for each test, so only define the
+#  rules the first time.
+#
+ifndef MEMORY_IPPOOL_DIR
+MEMORY_IPPOOL_DIR	:= src/tests/modules/memory_ippool
+MEMORY_IPPOOL_OUTPUT	:= $(BUILD_DIR)/tests/modules/memory_ippool
+MEMORY_IPPOOL_TESTS	:= alloc update release restart_before restart
+
+$(MEMORY_IPPOOL_OUTPUT)/journal.clean: $(addprefix $(MEMORY_IPPOOL_DIR)/,module.conf $(addsuffix .unlang,$(MEMORY_IPPOOL_TESTS)))
+	${Q}mkdir -p $(dir $@)
+	${Q}rm -f $(MEMORY_IPPOOL_DIR)/memory_ippool*.journal*
+	${Q}touch $@
+
+MEMORY_IPPOOL_PREV := $(MEMORY_IPPOOL_OUTPUT)/journal.clean
+$(foreach x,$(MEMORY_IPPOOL_TESTS),$(eval $(MEMORY_IPPOOL_OUTPUT)/$x: $(MEMORY_IPPOOL_PREV))$(eval MEMORY_IPPOOL_PREV := $(MEMORY_IPPOOL_OUTPUT)/$x))
+endif
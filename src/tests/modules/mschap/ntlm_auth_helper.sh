@@ -0,0 +1,26 @@
+#!/bin/sh
+#
+#  Pretends to be "ntlm_auth --helper-protocol=ntlm-server-1"
+#
+#  Authenticates "john", and rejects everyone else.
+#
+user=
+while read -r line; do
+	case "$line" in
+	'Username:: '*)
+		user=$(echo "${line#Username:: }" | base64 -d)
+		;;
+
+	.)
+		if [ "$user" = "john" ]; then
+			echo "Authenticated: Yes"
+			echo "User-Session-Key: 000102030405060708090a0b0c0d0e0f"
+		else
+			echo "Authenticated: No"
+			echo "Authentication-Error: Logon failure (0xc000006d)"
+		fi
+		echo "."
+		user=
+		;;
+	esac
+done
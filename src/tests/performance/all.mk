@@ -0,0 +1,179 @@
+#
+#	End-to-end performance tests.
+#
+#	Each scenario starts radiusd with $(DIR)/config/<scenario>.conf.
+#	A proto_load listener generates the load, and the server exits
+#	when the load test is done, leaving a JSON summary behind.  The
+#	summaries are then collected into one results file, which can
+#	be compared between builds.
+#
+#	These tests are not part of "make test", as the results depend
+#	on the machine.  Run them with "make test.performance", or
+#	"make perf".
+#
+#	If $(PERF_BASELINE) exists, the results are compared against it,
+#	and the test fails if any metric is more than $(PERF_THRESHOLD)
+#	percent worse.  "make perf.baseline" saves the results as the
+#	new baseline.
+#
+
+#
+#	Test name
+#
+TEST := test.performance
+
+PERF_DIR	:= $(DIR)
+PERF_OUTPUT	:= $(BUILD_DIR)/tests/performance
+PERF_RESULTS	?= $(PERF_OUTPUT)/results.json
+PERF_BASELINE	?= $(PERF_DIR)/baseline.json
+PERF_THRESHOLD	?= 10
+
+#
+#	pap		PAP against a "users" file.
+#	eap_md5		The first round of EAP-MD5.
+#	acct_sql	Accounting to the SQL "null" driver.
+#	proxy		Proxying to a local home server.
+#
+PERF_SCENARIOS	?= pap eap_md5 acct_sql proxy
+
+#
+#	The load profile.  The rate starts at PERF_START_PPS, and goes up
+#	by PERF_STEP every PERF_DURATION seconds, until it reaches
+#	PERF_MAX_PPS.
+#
+PERF_START_PPS	?= 2000
+PERF_MAX_PPS	?= 20000
+PERF_STEP	?= 6000
+PERF_DURATION	?= 5
+PERF_PARALLEL	?= 25
+PERF_HOME_PORT	?= 12390
+
+PERF_ENV	:= TESTDIR=$(PERF_DIR) OUTPUT=$(PERF_OUTPUT) PERF_HOME_PORT=$(PERF_HOME_PORT) \
+		   PERF_START_PPS=$(PERF_START_PPS) PERF_MAX_PPS=$(PERF_MAX_PPS) PERF_STEP=$(PERF_STEP) \
+		   PERF_DURATION=$(PERF_DURATION) PERF_PARALLEL=$(PERF_PARALLEL)
+
+PERF_JSON	:= $(addprefix $(PERF_OUTPUT)/,$(addsuffix .json,$(PERF_SCENARIOS)))
+
+$(PERF_OUTPUT):
+	${Q}mkdir -p $@
+
+#
+#	Allocations are counted by preloading a wrapper around the glibc
+#	allocator.  Elsewhere the summaries report them as "null".
+#
+ifeq "$(shell uname -s)" "Linux"
+PERF_MALLOC_COUNT := $(PERF_OUTPUT)/malloc_count.so
+
+$(PERF_MALLOC_COUNT): $(PERF_DIR)/malloc_count.c | $(PERF_OUTPUT)
+	${Q}echo "CC $<"
+	${Q}$(CC) -shared -fPIC -O2 -o $@ $<
+
+PERF_PRELOAD := LD_PRELOAD=$(abspath $(PERF_MALLOC_COUNT))
+endif
+
+#
+#	The proxy scenario needs a home server to proxy to.
+#
+$(PERF_OUTPUT)/proxy.json: PERF_HOME_SERVER := yes
+
+#
+#	Run one scenario.  The summaries are always re-generated.
+#
+.PHONY: $(PERF_JSON)
+$(PERF_JSON): $(PERF_OUTPUT)/%.json: $(PERF_DIR)/config/%.conf $(PERF_MALLOC_COUNT) $(TEST_BIN_DIR)/radiusd \
+		$(addprefix $(BUILD_DIR)/lib/local/,proto_load.la proto_load_step.la) | $(PERF_OUTPUT)
+	${Q}echo "PERFORMANCE $*"
+	${Q}rm -f $@ $(PERF_OUTPUT)/$*.log
+	${Q}if [ -n "$(PERF_HOME_SERVER)" ] && \
+	    ! $(PERF_ENV) PERF_SCENARIO=home_server $(TEST_BIN)/radiusd -d $(PERF_DIR)/config -n home_server \
+		-D $(DICT_PATH) -l $(PERF_OUTPUT)/home_server.log; then \
+		echo "FAILED STARTING HOME SERVER"; \
+		tail -n 100 $(PERF_OUTPUT)/home_server.log; \
+		exit 1; \
+	fi
+	${Q}$(PERF_ENV) PERF_SCENARIO=$* $(PERF_PRELOAD) $(TEST_BIN)/radiusd -f -d $(PERF_DIR)/config -n $* \
+		-D $(DICT_PATH) -l $(PERF_OUTPUT)/$*.log; \
+	ret=$$?; \
+	if [ -f $(PERF_OUTPUT)/home_server.pid ]; then \
+		kill -TERM `cat $(PERF_OUTPUT)/home_server.pid` >/dev/null 2>&1; \
+		rm -f $(PERF_OUTPUT)/home_server.pid; \
+	fi; \
+	if [ $$ret -ne 0 ] || [ ! -s $@ ]; then \
+		echo "FAILED $*"; \
+		tail -n 100 $(PERF_OUTPUT)/$*.log; \
+		echo "$(PERF_ENV) PERF_SCENARIO=$* $(TEST_BIN)/radiusd -fxx -d $(PERF_DIR)/config -n $* -D $(DICT_PATH) -l stdout"; \
+		exit 1; \
+	fi
+
+#
+#	The scenarios have to run one at a time, so that they don't
+#	compete for CPU.
+#
+PERF_PREV :=
+$(foreach x,$(PERF_JSON),$(if $(PERF_PREV),$(eval $x: | $(PERF_PREV)))$(eval PERF_PREV := $x))
+
+#
+#	Collect the summaries, along with enough information to tell
+#	which build and load profile they came from.
+#
+.PHONY: $(TEST) perf
+$(TEST): $(PERF_JSON)
+	${Q}( \
+		printf '{"commit":"%s","date":"%s","host":"%s",' \
+			"`git rev-parse --short HEAD 2>/dev/null`" "`date -u +%Y-%m-%dT%H:%M:%SZ`" "`uname -nm`"; \
+		printf '"load":{"start_pps":%s,"max_pps":%s,"step":%s,"duration":%s,"parallel":%s},"scenarios":{' \
+			$(PERF_START_PPS) $(PERF_MAX_PPS) $(PERF_STEP) $(PERF_DURATION) $(PERF_PARALLEL); \
+		sep=""; \
+		for i in $(PERF_SCENARIOS); do \
+			printf '%s"%s":' "$$sep" $$i; \
+			tr -d '\n' < $(PERF_OUTPUT)/$$i.json; \
+			sep=","; \
+		done; \
+		printf '}}\n'; \
+	) > $(PERF_RESULTS)
+	${Q}echo "Results are in $(PERF_RESULTS)"
+	${Q}cat $(PERF_RESULTS)
+	${Q}if [ -f $(PERF_BASELINE) ]; then \
+		echo "COMPARE $(PERF_BASELINE)"; \
+		$(PERF_DIR)/compare.sh $(PERF_BASELINE) $(PERF_RESULTS) $(PERF_THRESHOLD) || exit 1; \
+	else \
+		echo "No baseline in $(PERF_BASELINE), run \"make perf.baseline\" to create one"; \
+	fi
+
+perf: $(TEST)
+
+#
+#	Save the results as the baseline for later runs.
+#
+.PHONY: perf.baseline
+perf.baseline: $(TEST)
+	${Q}cp $(PERF_RESULTS) $(PERF_BASELINE)
+	${Q}echo "Baseline saved to $(PERF_BASELINE)"
+
+#
+#	Check that the comparison catches regressions.  This doesn't
+#	need a server, so it is part of "make test".  The files in
+#	$(PERF_DIR)/compare are synthetic, "regressed.json" has a drop
+#	in throughput, and an increase in allocations.
+#
+.PHONY: test.performance.compare
+test.performance.compare:
+	${Q}if ! command -v jq >/dev/null 2>&1; then \
+		echo "SKIPPING test.performance.compare, jq is not installed"; \
+		exit 0; \
+	fi; \
+	if ! $(PERF_DIR)/compare.sh $(PERF_DIR)/compare/baseline.json $(PERF_DIR)/compare/ok.json > /dev/null; then \
+		echo "FAILED: compare.sh reported a regression in $(PERF_DIR)/compare/ok.json"; \
+		exit 1; \
+	fi; \
+	if $(PERF_DIR)/compare.sh $(PERF_DIR)/compare/baseline.json $(PERF_DIR)/compare/regressed.json > /dev/null; then \
+		echo "FAILED: compare.sh missed the regression in $(PERF_DIR)/compare/regressed.json"; \
+		exit 1; \
+	fi; \
+	echo "PERFORMANCE compare OK"
+
+.PHONY: clean.$(TEST)
+clean.$(TEST):
+	${Q}rm -rf $(PERF_OUTPUT)
+
+clean.test: clean.$(TEST)
@@ -0,0 +1,86 @@
+#!/bin/sh
+#
+#  Compare performance results against a baseline.
+#
+#	compare.sh <baseline.json> <results.json> [threshold]
+#
+#  Every scenario in the baseline must be in the results.  A scenario
+#  has regressed when, by more than "threshold" percent (default 10):
+#
+#	pps				goes down.
+#	latency_us.p50, p99		goes up.
+#	cpu_us_per_request		goes up.
+#	allocations_per_request		goes up.
+#
+#  Metrics which are null in either file (e.g. allocations, when
+#  malloc_count.so wasn't preloaded) are skipped.  Exits non-zero if
+#  anything has regressed.
+#
+#  $Id$
+#
+if [ $# -lt 2 ]; then
+	echo "Usage: $0 <baseline.json> <results.json> [threshold]" >&2
+	exit 2
+fi
+
+BASELINE="$1"
+RESULTS="$2"
+THRESHOLD="${3:-10}"
+
+if ! command -v jq >/dev/null 2>&1; then
+	echo "jq is needed to compare performance results" >&2
+	exit 2
+fi
+
+#
+#  Print one line per metric:
+#
+#	<scenario> <metric> <baseline> <result> <change%> ok|REGRESSED|MISSING
+#
+jq -n -r --slurpfile base "$BASELINE" --slurpfile new "$RESULTS" --argjson threshold "$THRESHOLD" '
+	def metrics: [
+		{ name: "pps",				path: ["pps"],				worse: -1 },
+		{ name: "latency_p50",			path: ["latency_us", "p50"],		worse: 1 },
+		{ name: "latency_p99",			path: ["latency_us", "p99"],		worse: 1 },
+		{ name: "cpu_us_per_request",		path: ["cpu_us_per_request"],		worse: 1 },
+		{ name: "allocations_per_request",	path: ["allocations_per_request"],	worse: 1 }
+	];
+
+	$base[0].scenarios as $b | $new[0].scenarios as $n |
+	$b | keys_unsorted[] as $s |
+	if ($n[$s] == null) then
+		"\($s) - - - - MISSING"
+	else
+		metrics[] as $m |
+		($b[$s] | getpath($m.path)) as $old |
+		($n[$s] | getpath($m.path)) as $cur |
+		select($old != null and $cur != null and $old > 0) |
+		((($cur - $old) * 100 / $old) * 10 | round / 10) as $change |
+		"\($s) \($m.name) \($old) \($cur) \($change) " +
+			(if ($change * $m.worse) > $threshold then "REGRESSED" else "ok" end)
+	end
+' > "${TMPDIR:-/tmp}/perf-compare.$$" || {
+	rm -f "${TMPDIR:-/tmp}/perf-compare.$$"
+	echo "Failed comparing $RESULTS against $BASELINE" >&2
+	exit 2
+}
+
+awk -v threshold="$THRESHOLD" '
+	BEGIN {
+		printf "%-10s %-24s %12s %12s %9s\n", "scenario", "metric", "baseline", "result", "change%"
+	}
+	{
+		printf "%-10s %-24s %12s %12s %9s  %s\n", $1, $2, $3, $4, $5, $6
+		if ($6 != "ok") bad++
+	}
+	END {
+		if (bad) {
+			printf "%d metric(s) regressed by more than %s%%, or are missing\n", bad, threshold
+			exit 1
+		}
+	}
+' "${TMPDIR:-/tmp}/perf-compare.$$"
+ret=$?
+
+rm -f "${TMPDIR:-/tmp}/perf-compare.$$"
+exit $ret
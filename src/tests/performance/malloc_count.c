@@ -0,0 +1,132 @@
+/*
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/**
+ * $Id$
+ *
+ * @file src/tests/performance/malloc_count.c
+ * @brief Count memory allocations made by radiusd.
+ *
+ * This is preloaded into radiusd by the performance tests.  proto_load_step
+ * looks up fr_perf_malloc_count(), and uses it to report the number of
+ * allocations per request.
+ *
+ * glibc exports its allocator as __libc_malloc() etc., so we can wrap it
+ * without having to bootstrap dlsym().  The counters are sharded so that
+ * the workers don't all contend on one cache line.
+ *
+ * The shard is picked from the address of the caller's stack, and not from
+ * a thread local variable.  The first calls to malloc() happen inside the
+ * dynamic loader, before static TLS has been set up for the preloaded
+ * library, and some libcs allocate when a thread's TLS is first used.
+ * Thread stacks are at least MALLOC_COUNT_STACK_SHIFT apart, so each
+ * thread almost always lands on its own shard.  If two threads do share
+ * a shard, the count is still correct, it's just a little slower.
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+#include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+#define MALLOC_COUNT_SHARDS	64
+#define MALLOC_COUNT_STACK_SHIFT	16
+
+static struct {
+	atomic_uint_fast64_t	count;
+	uint8_t			pad[64 - sizeof(atomic_uint_fast64_t)];
+} shard[MALLOC_COUNT_SHARDS];
+
+uint64_t fr_perf_malloc_count(void);
+void *malloc(size_t size);
+void *calloc(size_t nmemb, size_t size);
+void *realloc(void *ptr, size_t size);
+void *memalign(size_t alignment, size_t size);
+void *aligned_alloc(size_t alignment, size_t size);
+int posix_memalign(void **memptr, size_t alignment, size_t size);
+
+static inline void malloc_count_inc(void)
+{
+	int	here;
+	size_t	i = ((uintptr_t)&here >> MALLOC_COUNT_STACK_SHIFT) % MALLOC_COUNT_SHARDS;
+
+	atomic_fetch_add_explicit(&shard[i].count, 1, memory_order_relaxed);
+}
+
+/** Return the number of allocations made so far, by all threads
+ *
+ */
+uint64_t fr_perf_malloc_count(void)
+{
+	uint64_t	total = 0;
+	int		i;
+
+	for (i = 0; i < MALLOC_COUNT_SHARDS; i++) {
+		total += atomic_load_explicit(&shard[i].count, memory_order_relaxed);
+	}
+
+	return total;
+}
+
+void *malloc(size_t size)
+{
+	malloc_count_inc();
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	malloc_count_inc();
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	malloc_count_inc();
+	return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+	malloc_count_inc();
+	return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	malloc_count_inc();
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *p;
+
+	if ((alignment < sizeof(void *)) || (alignment & (alignment - 1))) return EINVAL;
+
+	malloc_count_inc();
+	p = __libc_memalign(alignment, size);
+	if (!p) return ENOMEM;
+
+	*memptr = p;
+	return 0;
+}
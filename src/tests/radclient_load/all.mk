@@ -0,0 +1,48 @@
+#
+#	Tests for the open-loop load generator in radclient-ng.
+#
+#	load.sh starts a radiusd, and sends it Access-Requests and
+#	Accounting-Requests at a fixed rate.  It checks that the
+#	requested rate was achieved, and that every request was
+#	accepted.  The summaries, with the latency percentiles, are
+#	left in $(BUILD_DIR)/tests/radclient_load/.
+#
+
+#
+#	Test name
+#
+TEST := test.radclient_load
+
+RADCLIENT_LOAD_DIR	:= $(DIR)
+RADCLIENT_LOAD_OUTPUT	:= $(BUILD_DIR)/tests/radclient_load
+RADCLIENT_LOAD_PORT	?= 12380
+RADCLIENT_LOAD_RATE	?= 1000
+RADCLIENT_LOAD_DURATION	?= 5
+RADCLIENT_LOAD_THREADS	?= 2
+
+RADCLIENT_LOAD_ENV	:= RADIUSD="$(TEST_BIN)/radiusd" RADCLIENT="$(TEST_BIN)/radclient-ng" \
+			   TESTDIR=$(RADCLIENT_LOAD_DIR) OUTPUT=$(RADCLIENT_LOAD_OUTPUT) SERVER_PORT=$(RADCLIENT_LOAD_PORT) \
+			   RATE=$(RADCLIENT_LOAD_RATE) DURATION=$(RADCLIENT_LOAD_DURATION) THREADS=$(RADCLIENT_LOAD_THREADS)
+
+$(RADCLIENT_LOAD_OUTPUT):
+	${Q}mkdir -p $@
+
+$(BUILD_DIR)/tests/$(TEST): $(RADCLIENT_LOAD_DIR)/load.sh $(RADCLIENT_LOAD_DIR)/config/radiusd.conf \
+		$(TEST_BIN_DIR)/radiusd $(TEST_BIN_DIR)/radclient-ng \
+		$(BUILD_DIR)/lib/local/proto_radius_udp.la | $(RADCLIENT_LOAD_OUTPUT) build.raddb
+	${Q}echo "RADCLIENT-LOAD-TEST rate=$(RADCLIENT_LOAD_RATE) duration=$(RADCLIENT_LOAD_DURATION) threads=$(RADCLIENT_LOAD_THREADS)"
+	${Q}if ! $(RADCLIENT_LOAD_ENV) $(SHELL) $(RADCLIENT_LOAD_DIR)/load.sh; then \
+		echo "RADCLIENT_LOAD: $(RADCLIENT_LOAD_ENV) $(SHELL) $(RADCLIENT_LOAD_DIR)/load.sh"; \
+		exit 1; \
+	fi
+	${Q}touch $@
+
+.PHONY: $(TEST)
+$(TEST): $(BUILD_DIR)/tests/$(TEST)
+
+.PHONY: clean.$(TEST)
+clean.$(TEST):
+	${Q}rm -rf $(RADCLIENT_LOAD_OUTPUT)
+	${Q}rm -f $(BUILD_DIR)/tests/$(TEST)
+
+clean.test: clean.$(TEST)
@@ -0,0 +1,145 @@
+#!/bin/sh
+#
+#  Send load to a radiusd with radclient-ng, at a fixed rate, and
+#  check that it was sent at that rate, and that every request was
+#  accepted.
+#
+#  The load summaries, which include the achieved rate and the
+#  latency percentiles, are left in $OUTPUT/*.out.
+#
+#  Environment:
+#
+#	RADIUSD		How to run radiusd.
+#	RADCLIENT	How to run radclient-ng.
+#	TESTDIR		This directory.
+#	OUTPUT		Where the logs, pid file and summaries go.
+#	SERVER_PORT	UDP port of the server.
+#	RATE		Packets per second to send.
+#	DURATION	Seconds to send packets for.
+#	THREADS		Number of sender threads.
+#
+#  $Id$
+#
+export TESTDIR OUTPUT SERVER_PORT
+
+fail() {
+	echo "FAILED: $*"
+	echo "Last entries in server log ($OUTPUT/radiusd.log):"
+	tail -n 100 "$OUTPUT/radiusd.log" 2> /dev/null
+	stop
+	exit 1
+}
+
+start() {
+	rm -f "$OUTPUT/radiusd.pid"
+	$RADIUSD -d "$TESTDIR/config" -n radiusd -D share/dictionary -l "$OUTPUT/radiusd.log" || fail "starting radiusd"
+
+	i=0
+	while [ ! -f "$OUTPUT/radiusd.pid" ]; do
+		i=`expr $i + 1`
+		[ $i -gt 50 ] && fail "radiusd didn't write a pid file"
+		sleep 0.1
+	done
+}
+
+stop() {
+	if [ -f "$OUTPUT/radiusd.pid" ]; then
+		kill -TERM `cat "$OUTPUT/radiusd.pid"` > /dev/null 2>&1
+		rm -f "$OUTPUT/radiusd.pid"
+	fi
+}
+
+#
+#  Return a field from the load summary, e.g. "Sent".
+#
+field() {
+	sed -n "s/^[[:space:]]*$1[[:space:]]*: \([0-9]*\).*/\1/p" "$OUTPUT/$2.out"
+}
+
+#
+#  Send packets of the given type from the given file, and check
+#  that all of them were sent at the requested rate, and accepted.
+#
+load() {
+	$RADCLIENT -L $RATE -n $DURATION -T $THREADS -I $DURATION -f "$OUTPUT/$1.txt" \
+		-d "$TESTDIR/config" -D share/dictionary 127.0.0.1:$SERVER_PORT $2 testing123 > "$OUTPUT/$1.out" 2>&1 || \
+		fail "$1: radclient-ng failed, see $OUTPUT/$1.out"
+
+	expected=`expr $RATE \* $DURATION`
+	sent=`field Sent $1`
+	accepted=`field Accepted $1`
+
+	#
+	#  Allow for a little slop at the end of the run.
+	#
+	[ -n "$sent" ] && [ $sent -ge `expr $expected \* 95 / 100` ] || \
+		fail "$1: sent $sent packets, expected $expected"
+	[ "$accepted" = "$sent" ] || fail "$1: sent $sent packets, but only $accepted were accepted"
+
+	grep -q "Latency (us)" "$OUTPUT/$1.out" || fail "$1: no latency summary"
+
+	cat "$OUTPUT/$1.out"
+}
+
+mkdir -p "$OUTPUT"
+rm -f "$OUTPUT"/*.log "$OUTPUT"/*.out
+
+cat > "$OUTPUT/auth.txt" <<EOF
+User-Name = "bob",
+User-Password = "testing123"
+EOF
+
+cat > "$OUTPUT/acct.txt" <<EOF
+User-Name = "bob",
+Acct-Status-Type = Start,
+Acct-Session-Id = "00000001"
+EOF
+
+cat > "$OUTPUT/lost.txt" <<EOF
+User-Name = "lost",
+User-Password = "testing123"
+EOF
+
+#
+#  MPSK-Lookup-Info is encrypted like User-Password, using the Request
+#  Authenticator, which changes every time the packet is sent.
+#
+cat > "$OUTPUT/encrypted.txt" <<EOF
+User-Name = "bob",
+User-Password = "testing123",
+Vendor-Specific.Aruba.MPSK-Lookup-Info = "secret"
+EOF
+
+start
+
+load auth auth
+load acct acct
+
+if $RADCLIENT -L $RATE -n 1 -f "$OUTPUT/encrypted.txt" -d "$TESTDIR/config" -D share/dictionary 127.0.0.1:$SERVER_PORT auth testing123 \
+	> "$OUTPUT/encrypted.out" 2>&1; then
+	fail "encrypted: radclient-ng sent an attribute it can't re-encrypt"
+fi
+grep -q "MPSK-Lookup-Info is encrypted using the Request Authenticator" "$OUTPUT/encrypted.out" || \
+	fail "encrypted: radclient-ng didn't say why it rejected the request, see $OUTPUT/encrypted.out"
+
+#
+#  The server never replies to these.  They should all be counted as
+#  lost, and still be in the latency histogram, as taking at least
+#  the timeout.  radclient-ng exits with 1 when packets were lost.
+#
+$RADCLIENT -L 100 -n 2 -t 1 -f "$OUTPUT/lost.txt" -d "$TESTDIR/config" -D share/dictionary 127.0.0.1:$SERVER_PORT auth testing123 \
+	> "$OUTPUT/lost.out" 2>&1
+[ $? -eq 1 ] || fail "lost: radclient-ng didn't report the lost packets, see $OUTPUT/lost.out"
+
+sent=`field Sent lost`
+lost=`field Lost lost`
+[ -n "$sent" ] && [ $sent -gt 0 ] && [ "$lost" = "$sent" ] || fail "lost: sent $sent packets, but $lost were counted as lost"
+
+p50=`sed -n 's/^[[:space:]]*Latency (us)[[:space:]]*: min [0-9.]*, p50 \([0-9]*\).*/\1/p' "$OUTPUT/lost.out"`
+[ -n "$p50" ] && [ $p50 -ge 1000000 ] || fail "lost: median latency was ${p50}us, expected at least the 1s timeout"
+
+cat "$OUTPUT/lost.out"
+
+stop
+
+exit 0
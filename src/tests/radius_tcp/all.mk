@@ -0,0 +1,58 @@
+#
+#	Tests for rlm_radius_tcp against a RADIUS/TCP home server.
+#
+#	reconnect.sh starts a home server, and a proxy which uses
+#	rlm_radius_tcp to talk to it.  It then stops and kills the
+#	home server, and checks that the proxy reconnects, and
+#	re-sends the request which was outstanding.
+#
+#	extended_id.sh sends more requests through the proxy than
+#	there are RADIUS IDs, all outstanding at once on one
+#	connection, and checks that every reply is matched to the
+#	right request.
+#
+
+#
+#	Test name
+#
+TEST := test.radius_tcp
+
+RADIUS_TCP_DIR		:= $(DIR)
+RADIUS_TCP_OUTPUT	:= $(BUILD_DIR)/tests/radius_tcp
+RADIUS_TCP_HOME_PORT	?= 12370
+RADIUS_TCP_PROXY_PORT	?= 12371
+
+$(RADIUS_TCP_OUTPUT):
+	${Q}mkdir -p $@
+
+$(BUILD_DIR)/tests/$(TEST): $(addprefix $(RADIUS_TCP_DIR)/,reconnect.sh extended_id.sh) $(wildcard $(RADIUS_TCP_DIR)/config/*.conf) \
+		$(TEST_BIN_DIR)/radiusd $(TEST_BIN_DIR)/radclient \
+		$(addprefix $(BUILD_DIR)/lib/local/,proto_radius_tcp.la proto_radius_udp.la rlm_radius.la rlm_radius_tcp.la rlm_delay.la) \
+		| $(RADIUS_TCP_OUTPUT) build.raddb
+	${Q}echo "RADIUS-TCP-TEST reconnect"
+	${Q}if ! RADIUSD="$(TEST_BIN)/radiusd" RADCLIENT="$(TEST_BIN)/radclient" \
+		TESTDIR=$(RADIUS_TCP_DIR) OUTPUT=$(RADIUS_TCP_OUTPUT) \
+		HOME_PORT=$(RADIUS_TCP_HOME_PORT) PROXY_PORT=$(RADIUS_TCP_PROXY_PORT) \
+		$(SHELL) $(RADIUS_TCP_DIR)/reconnect.sh; then \
+		echo "RADIUS_TCP: RADIUSD=\"$(TEST_BIN)/radiusd\" RADCLIENT=\"$(TEST_BIN)/radclient\" TESTDIR=$(RADIUS_TCP_DIR) OUTPUT=$(RADIUS_TCP_OUTPUT) HOME_PORT=$(RADIUS_TCP_HOME_PORT) PROXY_PORT=$(RADIUS_TCP_PROXY_PORT) $(SHELL) $(RADIUS_TCP_DIR)/reconnect.sh"; \
+		exit 1; \
+	fi
+	${Q}echo "RADIUS-TCP-TEST extended_id"
+	${Q}if ! RADIUSD="$(TEST_BIN)/radiusd" RADCLIENT="$(TEST_BIN)/radclient" \
+		TESTDIR=$(RADIUS_TCP_DIR) OUTPUT=$(RADIUS_TCP_OUTPUT) \
+		HOME_PORT=$(RADIUS_TCP_HOME_PORT) PROXY_PORT=$(RADIUS_TCP_PROXY_PORT) \
+		$(SHELL) $(RADIUS_TCP_DIR)/extended_id.sh; then \
+		echo "RADIUS_TCP: RADIUSD=\"$(TEST_BIN)/radiusd\" RADCLIENT=\"$(TEST_BIN)/radclient\" TESTDIR=$(RADIUS_TCP_DIR) OUTPUT=$(RADIUS_TCP_OUTPUT) HOME_PORT=$(RADIUS_TCP_HOME_PORT) PROXY_PORT=$(RADIUS_TCP_PROXY_PORT) $(SHELL) $(RADIUS_TCP_DIR)/extended_id.sh"; \
+		exit 1; \
+	fi
+	${Q}touch $@
+
+.PHONY: $(TEST)
+$(TEST): $(BUILD_DIR)/tests/$(TEST)
+
+.PHONY: clean.$(TEST)
+clean.$(TEST):
+	${Q}rm -rf $(RADIUS_TCP_OUTPUT)
+	${Q}rm -f $(BUILD_DIR)/tests/$(TEST)
+
+clean.test: clean.$(TEST)
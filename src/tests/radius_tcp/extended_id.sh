@@ -0,0 +1,99 @@
+#!/bin/sh
+#
+#  Check that rlm_radius_tcp with "extended_id = yes" can have more
+#  requests outstanding on one connection than there are RADIUS IDs,
+#  and that every reply is matched to the right request.
+#
+#  The home server delays each request, so they are all outstanding
+#  at once, and the IDs are re-used.  The proxy rejects any request
+#  whose reply was meant for another one.
+#
+#  Environment:
+#
+#	RADIUSD		How to run radiusd.
+#	RADCLIENT	How to run radclient.
+#	TESTDIR		This directory.
+#	OUTPUT		Where the logs and pid files go.
+#	HOME_PORT	TCP port of the home server.
+#	PROXY_PORT	UDP port of the proxy.
+#
+#  $Id$
+#
+export TESTDIR OUTPUT HOME_PORT PROXY_PORT
+
+CLIENTS=${CLIENTS:-3}
+PER_CLIENT=${PER_CLIENT:-200}
+
+fail() {
+	echo "FAILED: $*"
+	for i in proxy home; do
+		echo "Last entries in $i log ($OUTPUT/$i.log):"
+		tail -n 100 "$OUTPUT/$i.log" 2> /dev/null
+	done
+	stop proxy
+	stop home
+	exit 1
+}
+
+start() {
+	rm -f "$OUTPUT/$1.pid"
+	$RADIUSD -xx -d "$TESTDIR/config" -n "$1" -D share/dictionary -l "$OUTPUT/$1.log" || fail "starting $1"
+
+	i=0
+	while [ ! -f "$OUTPUT/$1.pid" ]; do
+		i=`expr $i + 1`
+		[ $i -gt 50 ] && fail "$1 didn't write a pid file"
+		sleep 0.1
+	done
+}
+
+stop() {
+	if [ -f "$OUTPUT/$1.pid" ]; then
+		kill -${2:-TERM} `cat "$OUTPUT/$1.pid"` > /dev/null 2>&1
+		rm -f "$OUTPUT/$1.pid"
+	fi
+}
+
+mkdir -p "$OUTPUT/extended"
+rm -f "$OUTPUT"/*.log "$OUTPUT"/extended.* "$OUTPUT"/extended/*
+
+#
+#  radclient only reads the first packet from each file, so every
+#  request gets its own.  One radclient can't have more than 256
+#  requests outstanding, so we run several at once.
+#
+start home
+start proxy
+
+c=0
+while [ $c -lt $CLIENTS ]; do
+	files=
+	i=0
+	while [ $i -lt $PER_CLIENT ]; do
+		echo "User-Name = \"extended-$c-$i\", User-Password = \"testing123\"" > "$OUTPUT/extended/$c-$i"
+		files="$files -f $OUTPUT/extended/$c-$i"
+		i=`expr $i + 1`
+	done
+
+	$RADCLIENT -t 15 -r 1 -p $PER_CLIENT -s -D share/dictionary -d "$TESTDIR/config" $files \
+		127.0.0.1:$PROXY_PORT auth testing123 > "$OUTPUT/extended.$c.out" 2>&1 &
+	c=`expr $c + 1`
+done
+wait
+
+NUM=`expr $CLIENTS \* $PER_CLIENT`
+accepted=`cat "$OUTPUT"/extended.*.out | sed -n 's/.*Accepted *: *//p' | awk '{ n += $1 } END { print n + 0 }'`
+[ "$accepted" = "$NUM" ] || fail "$accepted of $NUM requests were accepted, see $OUTPUT/extended.*.out"
+
+#
+#  More requests than there are IDs have to be outstanding at once,
+#  on the one connection.  i.e. they were all sent before the first
+#  reply came back.
+#
+outstanding=`awk '/radius_extended - Received/ { exit } /radius_extended - Sending Access-Request/ { n++ } END { print n + 0 }' "$OUTPUT/proxy.log"`
+[ "$outstanding" -gt 256 ] || fail "only $outstanding requests were outstanding at once, so no ID was re-used"
+
+stop proxy
+stop home
+
+exit 0
@@ -0,0 +1,114 @@
+#!/bin/sh
+#
+#  Check that rlm_radius_tcp reconnects to a home server which has
+#  gone away, and that requests which were outstanding on the old
+#  connection are sent again on the new one.
+#
+#  Environment:
+#
+#	RADIUSD		How to run radiusd.
+#	RADCLIENT	How to run radclient.
+#	TESTDIR		This directory.
+#	OUTPUT		Where the logs and pid files go.
+#	HOME_PORT	TCP port of the home server.
+#	PROXY_PORT	UDP port of the proxy.
+#
+#  $Id$
+#
+export TESTDIR OUTPUT HOME_PORT PROXY_PORT
+
+fail() {
+	echo "FAILED: $*"
+	for i in proxy home; do
+		echo "Last entries in $i log ($OUTPUT/$i.log):"
+		tail -n 100 "$OUTPUT/$i.log" 2> /dev/null
+	done
+	stop proxy
+	stop home
+	exit 1
+}
+
+start() {
+	rm -f "$OUTPUT/$1.pid"
+	$RADIUSD -xxx -d "$TESTDIR/config" -n "$1" -D share/dictionary -l "$OUTPUT/$1.log" || fail "starting $1"
+
+	i=0
+	while [ ! -f "$OUTPUT/$1.pid" ]; do
+		i=`expr $i + 1`
+		[ $i -gt 50 ] && fail "$1 didn't write a pid file"
+		sleep 0.1
+	done
+}
+
+stop() {
+	if [ -f "$OUTPUT/$1.pid" ]; then
+		kill -${2:-TERM} `cat "$OUTPUT/$1.pid"` > /dev/null 2>&1
+		rm -f "$OUTPUT/$1.pid"
+	fi
+}
+
+#
+#  Send an Access-Request for the given user, via the proxy, and
+#  check that the home server replied.
+#
+auth() {
+	echo "User-Name = \"$1\", User-Password = \"testing123\"" | \
+		$RADCLIENT -t 15 -r 1 -D share/dictionary -d "$TESTDIR/config" -x \
+		127.0.0.1:$PROXY_PORT auth testing123 > "$OUTPUT/$1.out" 2>&1
+	grep -q "Reply-Message = \"home $1\"" "$OUTPUT/$1.out"
+}
+
+mkdir -p "$OUTPUT"
+rm -f "$OUTPUT"/*.log "$OUTPUT"/*.out
+
+start home
+start proxy
+
+#
+#  The connection is opened when the proxy starts.
+#
+auth before || fail "no reply before the home server was restarted"
+
+#
+#  The home server closes the connection.
+#
+stop home TERM
+sleep 1
+start home
+
+#
+#  The proxy tried to re-connect while the home server was down.
+#  Until the next attempt succeeds, the trunk refuses new requests.
+#
+sleep 1
+
+auth after_restart || fail "no reply after the home server was restarted"
+
+#
+#  The home server dies with a request outstanding.  The proxy
+#  has to send it again, once the new home server is up.
+#
+mv "$OUTPUT/home.log" "$OUTPUT/home.1.log"
+
+auth slow &
+client=$!
+
+sleep 0.5
+stop home KILL
+sleep 1
+start home
+
+wait $client || fail "no reply to the request which was outstanding when the home server died"
+
+grep -q 'User-Name = "slow"' "$OUTPUT/home.log" || \
+	fail "the outstanding request wasn't sent to the new home server"
+
+#
+#  And everything still works.
+#
+auth after_kill || fail "no reply after the home server was killed"
+
+stop proxy
+stop home
+
+exit 0
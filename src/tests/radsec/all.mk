@@ -0,0 +1,76 @@
+#
+#	Tests for proto_radius_tls, using radsec_bench against radiusd.
+#
+#	Each .txt file contains the radsec_bench arguments, and the
+#	results which it should report.
+#
+#	ARGV:	arguments for radsec_bench
+#	EXPECT:	<column>=<value> ... from the "radsec_bench -p" output
+#
+ifeq "$(OPENSSL_LIBS)" ""
+test.radsec:
+	${Q}echo "WARNING: Can't execute 'test.radsec' without OpenSSL. ignoring."
+else
+
+#
+#	Test name
+#
+TEST  := test.radsec
+FILES := $(subst $(DIR)/,,$(wildcard $(DIR)/*.txt))
+
+$(eval $(call TEST_BOOTSTRAP))
+
+#
+#  Generic rules to start / stop the radius service.
+#
+CLIENT := radsec_bench
+include src/tests/radiusd.mk
+$(eval $(call RADIUSD_SERVICE,radiusd,$(OUTPUT)))
+
+#
+#	Run radsec_bench against the radiusd.
+#
+$(OUTPUT)/%.txt: $(DIR)/%.txt $(BUILD_DIR)/lib/local/proto_radius_tls.la $(BUILD_DIR)/lib/local/rlm_always.la | $(TEST).radiusd_kill $(TEST).radiusd_start build.raddb
+	$(eval ARGV     := $(shell grep "#.*ARGV:" $< | cut -f2 -d ':'))
+	$(eval EXPECT   := $(shell grep "#.*EXPECT:" $< | cut -f2 -d ':'))
+	$(eval FOUND    := $(patsubst %.txt,%.out,$@))
+
+	${Q}echo "RADSEC-TEST INPUT=$(notdir $<) ARGV=\"$(ARGV)\""
+	${Q}[ -f $(dir $@)/radiusd.pid ] || exit 1
+	${Q}if ! $(TEST_BIN)/radsec_bench -p $(ARGV) 127.0.0.1:$(radsec_port) > $(FOUND) 2>&1; then \
+		echo "FAILED";                                              \
+		cat $(FOUND);                                               \
+		rm -f $(BUILD_DIR)/tests/test.radsec;                       \
+		$(MAKE) --no-print-directory test.radsec.radiusd_kill;      \
+		echo "RADIUSD:      $(RADIUSD_RUN)";                        \
+		echo "RADSEC_BENCH: $(TEST_BIN)/radsec_bench -x $(ARGV) 127.0.0.1:$(radsec_port)"; \
+		exit 1;                                                     \
+	fi
+	${Q}if ! awk -F '\t' -v expect="$(EXPECT)" '                        \
+		NR == 1 { for (i = 1; i <= NF; i++) col[$$i] = i; next }    \
+		NR == 2 {                                                   \
+			n = split(expect, e, " ");                          \
+			for (i = 1; i <= n; i++) {                          \
+				split(e[i], kv, "=");                       \
+				if (!(kv[1] in col) || ($$col[kv[1]] != kv[2])) { \
+					printf "%s: expected %s, got %s\n", kv[1], kv[2], $$col[kv[1]]; \
+					bad = 1;                            \
+				}                                           \
+			}                                                   \
+		}                                                           \
+		END { if (NR != 2) bad = 1; exit bad }' $(FOUND); then      \
+		echo "RADSEC FAILED $@";                                    \
+		cat $(FOUND);                                               \
+		rm -f $(BUILD_DIR)/tests/test.radsec;                       \
+		$(MAKE) --no-print-directory test.radsec.radiusd_kill;      \
+		echo "RADIUSD:      $(RADIUSD_RUN)";                        \
+		echo "RADSEC_BENCH: $(TEST_BIN)/radsec_bench -x $(ARGV) 127.0.0.1:$(radsec_port)"; \
+		exit 1;                                                     \
+	fi
+	${Q}touch $@
+
+.NO_PARALLEL: $(TEST)
+$(TEST):
+	${Q}$(MAKE) --no-print-directory $@.radiusd_stop
+	@touch $(BUILD_DIR)/tests/$@
+endif
@@ -84,4 +84,21 @@ $(OUTPUT)/%.txt: $(DIR)/%.txt $(TEST_BIN_DIR)/radsniff $(PCAP_IN)
 		exit 1;                                                                                       \
 	fi
 	${Q}touch $@
+
+#
+#	Replay the .pcap file with several capture threads (-j), and
+#	check that they count the same packets as a single thread.
+#
+RADSNIFF_FANOUT_THREADS ?= 4
+
+$(OUTPUT)/fanout: $(DIR)/fanout.sh $(TEST_BIN_DIR)/radsniff $(PCAP_IN) | $(OUTPUT)
+	${Q}echo "RADSNIFF-TEST fanout THREADS=$(RADSNIFF_FANOUT_THREADS)"
+	${Q}if ! RADSNIFF="$(TEST_BIN)/radsniff" PCAP_IN=$(PCAP_IN) OUTPUT=$(dir $@) THREADS=$(RADSNIFF_FANOUT_THREADS) \
+		$(SHELL) $<; then \
+		echo "RADSNIFF: RADSNIFF=\"$(TEST_BIN)/radsniff\" PCAP_IN=$(PCAP_IN) OUTPUT=$(dir $@) THREADS=$(RADSNIFF_FANOUT_THREADS) $(SHELL) $<"; \
+		exit 1; \
+	fi
+	${Q}touch $@
+
+$(BUILD_DIR)/tests/$(TEST): $(OUTPUT)/fanout
 endif
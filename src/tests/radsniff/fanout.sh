@@ -0,0 +1,93 @@
+#!/bin/sh
+#
+#  Replay a pcap file with several capture threads (-j), and check
+#  that they see the same packets as a single threaded radsniff.
+#
+#  Environment:
+#
+#	RADSNIFF	How to run radsniff.
+#	PCAP_IN		The pcap file to replay.
+#	OUTPUT		Where the radsniff output goes.
+#	THREADS		Number of capture threads.
+#
+#  $Id$
+#
+fail() {
+	echo "FAILED: $*"
+	echo "Single threaded ($OUTPUT/fanout-single.out):"
+	cat "$OUTPUT/fanout-single.out"
+	echo "With $THREADS threads ($OUTPUT/fanout-multi.out):"
+	cat "$OUTPUT/fanout-multi.out"
+	exit 1
+}
+
+TZ=UTC $RADSNIFF -I "$PCAP_IN" -D share/dictionary > "$OUTPUT/fanout-single.out" 2>&1 || \
+	fail "single threaded radsniff failed"
+
+TZ=UTC $RADSNIFF -j $THREADS -I "$PCAP_IN" -D share/dictionary > "$OUTPUT/fanout-multi.out" 2>&1 || \
+	fail "radsniff -j $THREADS failed"
+
+#
+#  The single threaded run prints one line per packet.  Requests
+#  have one "+" time, responses which were linked to their request
+#  have two.
+#
+#	2020-05-21 00:56:58.650943 (1) Access-Request Id 243 <file>:<src> -> <dst> +0.000
+#	2020-05-21 00:56:58.652076 (2) Access-Accept Id 243 <file>:<src> <- <dst> +0.001 +0.001
+#
+#  Retransmissions are marked, which moves the other fields along.
+#  The threaded run counts them as requests, too.
+#
+#	2020-05-21 00:56:58.651002 (1) ** rtx ** Access-Request Id 243 <file>:<src> -> <dst> +0.000
+#
+single() {
+	awk -v want="$1" '
+		($3 ~ /^\([0-9]+\)$/) && ($4 == "**") {
+			if ($11 == "->") requests[$7]++;
+			packets++;
+			next;
+		}
+		$3 ~ /^\([0-9]+\)$/ {
+			if ($8 == "->") requests[$4]++;
+			else if (($8 == "<-") && (NF == 11)) linked++;
+			packets++;
+		}
+		END {
+			if (want == "Packets") print packets + 0;
+			else if (want == "Linked") print linked + 0;
+			else print requests[want] + 0;
+		}' "$OUTPUT/fanout-single.out"
+}
+
+#
+#  The threaded run prints the counts at the end.
+#
+#	Packets   : 100
+#	Access-Request : requests 17, linked 17, rtx 0, reused 0, lost 0
+#
+multi() {
+	awk -v want="$1" '
+		($1 == "Packets") && ($2 == ":") { packets = $3 }
+		($2 == ":") && ($3 == "requests") {
+			n = $4; sub(/,/, "", n); requests[$1] = n;
+			n = $6; sub(/,/, "", n); linked += n;
+		}
+		END {
+			if (want == "Packets") print packets + 0;
+			else if (want == "Linked") print linked + 0;
+			else print requests[want] + 0;
+		}' "$OUTPUT/fanout-multi.out"
+}
+
+grep -q "^Packet counts:" "$OUTPUT/fanout-multi.out" || fail "radsniff -j $THREADS didn't print its packet counts"
+
+[ `single Packets` -gt 0 ] || fail "single threaded radsniff didn't see any packets"
+
+for i in Packets Linked Access-Request Accounting-Request CoA-Request Disconnect-Request Status-Server; do
+	expected=`single $i`
+	found=`multi $i`
+
+	[ "$expected" = "$found" ] || fail "$i: single threaded radsniff counted $expected, with $THREADS threads $found"
+done
+
+exit 0
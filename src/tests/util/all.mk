@@ -1,4 +1,8 @@
-SUBMAKEFILES := ring_buffer_test.mk message_set_test.mk atomic_queue_test.mk 
+SUBMAKEFILES := ring_buffer_test.mk message_set_test.mk atomic_queue_test.mk channel_bench.mk radius_decode_bench.mk radius_encode_bench.mk exec_bench.mk
+
+ifneq "$(OPENSSL_LIBS)" ""
+SUBMAKEFILES += radsec_bench.mk
+endif
 
 #
 #  This uses an old API, and we don't have time to fix it.
@@ -0,0 +1,701 @@
+/*
+ * channel_bench.c	Benchmark for channels, message sets and atomic queues
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/io/channel.h>
+#include <freeradius-devel/io/control.h>
+#include <freeradius-devel/io/message.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/event.h>
+#include <freeradius-devel/util/histogram.h>
+#include <freeradius-devel/util/syserror.h>
+#include <freeradius-devel/util/talloc.h>
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#include <pthread.h>
+
+#define MAX_NETWORKS		(64)
+#define MAX_WORKERS		(256)
+#define MAX_CONTROL_PLANE	(1024)
+
+/*
+ *	Each channel has a fixed size atomic queue.  We can't have
+ *	more than that outstanding on any one channel.
+ */
+#define MAX_OUTSTANDING		(1000)
+
+#define GC_INTERVAL		(1024)
+
+#define MPRINT1 if (debug_lvl) printf
+#define MPRINT2 if (debug_lvl > 1) printf
+
+/** Per-thread benchmark context
+ *
+ * Networks are requestors, and workers are responders, just as
+ * with the real network and worker threads.  Every network opens
+ * a channel to every worker.
+ */
+typedef struct {
+	int			id;			//!< Thread number.
+	pthread_t		pthread_id;
+
+	TALLOC_CTX		*ctx;			//!< Everything for this thread lives here.
+	fr_event_list_t		*el;			//!< Event list, polled by the thread.
+	fr_atomic_queue_t	*aq_control;		//!< Inbound control-plane queue.
+	fr_control_t		*control;		//!< Control plane for signalling.
+
+	fr_message_set_t	*ms;			//!< Network message set.  Workers have one per channel.
+
+	fr_channel_t		*channel[MAX_WORKERS];	//!< Channels from this network to each worker.
+	int			num_channels;		//!< Channels which are open.
+	int			num_closed;		//!< Channels which have been closed.
+	int			next;			//!< Next worker to send a message to.
+
+	uint64_t		sent;			//!< Requests sent, or replies sent by a worker.
+	uint64_t		received;		//!< Replies received, or requests received by a worker.
+	uint64_t		outstanding;		//!< Requests without a reply.
+	uint64_t		signals;		//!< Control-plane messages received.
+	uint64_t		wakeups;		//!< How many times we slept, and were woken up.
+	uint64_t		alloc_failed;		//!< Message set was full.
+	uint64_t		queue_full;		//!< Channel atomic queue was full.
+
+	uint64_t		gc_calls;		//!< Number of explicit message set GCs.
+	uint64_t		gc_time;		//!< Total time spent in GC.
+	uint64_t		gc_max;			//!< Longest GC.
+
+	fr_time_t		start;			//!< When we sent the first request.
+	fr_time_t		end;			//!< When we received the last reply.
+
+	fr_histogram_t		rtt;			//!< Request to reply latency.
+} bench_thread_t;
+
+static int			debug_lvl = 0;
+static int			num_networks = 1;
+static int			num_workers = 1;
+static uint64_t			max_messages = 100000;
+static uint64_t			max_outstanding = 64;
+static size_t			message_size = 256;
+static int			message_set_size = 1024;
+static size_t			ring_buffer_size = 0;
+static bool			touch_memory = false;
+static bool			parseable = false;
+
+static bench_thread_t		*networks[MAX_NETWORKS];
+static bench_thread_t		*workers[MAX_WORKERS];
+
+static pthread_mutex_t		ready_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t		ready_cond = PTHREAD_COND_INITIALIZER;
+static int			num_ready = 0;
+
+static NEVER_RETURNS void usage(void)
+{
+	fprintf(stderr, "usage: channel_bench [OPTS]\n");
+	fprintf(stderr, "  -m <messages>          Number of messages each network sends.\n");
+	fprintf(stderr, "  -M <slots>             Number of messages in each message set.\n");
+	fprintf(stderr, "  -n <networks>          Number of network (requestor) threads.\n");
+	fprintf(stderr, "  -o <outstanding>       Keep number of messages outstanding per network.\n");
+	fprintf(stderr, "  -p                     Print one line of tab separated results.\n");
+	fprintf(stderr, "  -r <size>              Size of each message set ring buffer.\n");
+	fprintf(stderr, "  -s <size>              Size of each message.\n");
+	fprintf(stderr, "  -t                     Touch memory for fake packets.\n");
+	fprintf(stderr, "  -w <workers>           Number of worker (responder) threads.\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	fr_exit_now(EXIT_FAILURE);
+}
+
+/** Wait until all of the worker control planes exist
+ *
+ */
+static void bench_ready(bool wait)
+{
+	pthread_mutex_lock(&ready_mutex);
+	if (!wait) {
+		num_ready++;
+		pthread_cond_broadcast(&ready_cond);
+	} else {
+		while (num_ready < num_workers) pthread_cond_wait(&ready_cond, &ready_mutex);
+	}
+	pthread_mutex_unlock(&ready_mutex);
+}
+
+static void bench_gc(bench_thread_t *bt, fr_message_set_t *ms)
+{
+	fr_time_t	start;
+	uint64_t	delta;
+
+	start = fr_time();
+	fr_message_set_gc(ms);
+	delta = fr_time_delta_unwrap(fr_time_sub(fr_time(), start));
+
+	bt->gc_calls++;
+	bt->gc_time += delta;
+	if (delta > bt->gc_max) bt->gc_max = delta;
+}
+
+static void bench_thread_init(bench_thread_t *bt, char const *name, fr_control_callback_t callback)
+{
+	MEM(bt->ctx = talloc_init("%s %d", name, bt->id));
+
+	bt->el = fr_event_list_alloc(bt->ctx, NULL, NULL);
+	if (!bt->el) {
+		fr_perror("channel_bench: Failed creating event list");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	MEM(bt->aq_control = fr_atomic_queue_alloc(bt->ctx, MAX_CONTROL_PLANE));
+
+	bt->control = fr_control_create(bt->ctx, bt->el, bt->aq_control);
+	if (!bt->control) {
+		fr_perror("channel_bench: Failed creating control plane");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_control_callback_add(bt->control, FR_CONTROL_ID_CHANNEL, bt, callback) < 0) {
+		fr_perror("channel_bench: Failed adding channel callback");
+		fr_exit_now(EXIT_FAILURE);
+	}
+}
+
+/** Wait for, and service events
+ *
+ */
+static int bench_thread_poll(bench_thread_t *bt, bool wait)
+{
+	int num_events;
+
+	num_events = fr_event_corral(bt->el, fr_time(), wait);
+	if (num_events < 0) {
+		fr_perror("channel_bench: Failed retrieving events");
+		return -1;
+	}
+
+	if (wait) bt->wakeups++;
+
+	if (num_events > 0) fr_event_service(bt->el);
+
+	return 0;
+}
+
+/** Worker receives a request, and immediately replies to it
+ *
+ */
+static void worker_recv_request(void *ctx, fr_channel_t *ch, fr_channel_data_t *cd)
+{
+	bench_thread_t		*bt = ctx;
+	fr_message_set_t	*ms;
+	fr_channel_data_t	*reply;
+	fr_time_t		now;
+
+	bt->received++;
+
+	ms = fr_channel_responder_uctx_get(ch);
+	fr_assert(ms != NULL);
+
+	reply = (fr_channel_data_t *) fr_message_alloc(ms, NULL, message_size);
+	if (!reply) {
+		bt->alloc_failed++;
+		bench_gc(bt, ms);
+
+		reply = (fr_channel_data_t *) fr_message_alloc(ms, NULL, message_size);
+		if (!reply) {
+			fprintf(stderr, "channel_bench: Worker %d failed allocating reply\n", bt->id);
+			fr_exit_now(EXIT_FAILURE);
+		}
+	}
+
+	if (touch_memory && message_size) memcpy(reply->m.data, cd->m.data, message_size);
+
+	now = fr_time();
+	reply->m.when = now;
+	reply->reply.request_time = cd->m.when;
+	reply->reply.processing_time = fr_time_sub(now, cd->m.when);
+	reply->reply.cpu_time = reply->reply.processing_time;
+	reply->priority = cd->priority;
+	reply->packet_ctx = NULL;
+	reply->listen = NULL;
+
+	fr_message_done(&cd->m);
+
+	if (fr_channel_send_reply(ch, reply) < 0) {
+		fr_perror("channel_bench: Worker %d failed sending reply", bt->id);
+		fr_exit_now(EXIT_FAILURE);
+	}
+	bt->sent++;
+
+	if ((bt->sent % GC_INTERVAL) == 0) bench_gc(bt, ms);
+}
+
+static void worker_channel_callback(void *ctx, void const *data, size_t data_size, fr_time_t now)
+{
+	bench_thread_t		*bt = ctx;
+	fr_channel_t		*ch;
+	fr_message_set_t	*ms;
+
+	bt->signals++;
+
+	switch (fr_channel_service_message(now, &ch, data, data_size)) {
+	case FR_CHANNEL_ERROR:
+	case FR_CHANNEL_EMPTY:
+	case FR_CHANNEL_NOOP:
+		break;
+
+	case FR_CHANNEL_DATA_READY_RESPONDER:
+		while (fr_channel_recv_request(ch));
+		break;
+
+	case FR_CHANNEL_DATA_READY_REQUESTOR:
+		fr_assert(0 == 1);
+		break;
+
+	case FR_CHANNEL_OPEN:
+		MPRINT1("Worker %d got channel open.\n", bt->id);
+
+		ms = fr_message_set_create(bt->ctx, message_set_size, sizeof(fr_channel_data_t), ring_buffer_size);
+		if (!ms) {
+			fr_perror("channel_bench: Worker %d failed creating message set", bt->id);
+			fr_exit_now(EXIT_FAILURE);
+		}
+		fr_channel_responder_uctx_add(ch, ms);
+		fr_channel_set_recv_request(ch, bt, worker_recv_request);
+		bt->num_channels++;
+		break;
+
+	case FR_CHANNEL_CLOSE:
+		MPRINT1("Worker %d got channel close.\n", bt->id);
+
+		ms = fr_channel_responder_uctx_get(ch);
+		fr_channel_responder_ack_close(ch);
+		bench_gc(bt, ms);
+		bt->num_closed++;
+		break;
+	}
+}
+
+static void *bench_worker(void *arg)
+{
+	bench_thread_t	*bt = arg;
+
+	bench_thread_init(bt, "channel_bench_worker", worker_channel_callback);
+
+	MPRINT1("Worker %d started.\n", bt->id);
+
+	bench_ready(false);
+
+	while (bt->num_closed < num_networks) {
+		if (bench_thread_poll(bt, true) < 0) break;
+	}
+
+	MPRINT1("Worker %d exiting.\n", bt->id);
+
+	return NULL;
+}
+
+/** Network receives a reply, and records the round trip time
+ *
+ */
+static void network_recv_reply(void *ctx, UNUSED fr_channel_t *ch, fr_channel_data_t *cd)
+{
+	bench_thread_t	*bt = ctx;
+	fr_time_t	now = fr_time();
+
+	fr_histogram_record(&bt->rtt, fr_time_delta_unwrap(fr_time_sub(now, cd->reply.request_time)));
+
+	bt->received++;
+	bt->outstanding--;
+
+	if (bt->received == max_messages) bt->end = now;
+
+	fr_message_done(&cd->m);
+
+	if ((bt->received % GC_INTERVAL) == 0) bench_gc(bt, bt->ms);
+}
+
+static void network_channel_callback(void *ctx, void const *data, size_t data_size, fr_time_t now)
+{
+	bench_thread_t	*bt = ctx;
+	fr_channel_t	*ch;
+
+	bt->signals++;
+
+	switch (fr_channel_service_message(now, &ch, data, data_size)) {
+	case FR_CHANNEL_ERROR:
+	case FR_CHANNEL_EMPTY:
+	case FR_CHANNEL_NOOP:
+		break;
+
+	case FR_CHANNEL_DATA_READY_REQUESTOR:
+		while (fr_channel_recv_reply(ch));
+		break;
+
+	case FR_CHANNEL_DATA_READY_RESPONDER:
+	case FR_CHANNEL_OPEN:
+		fr_assert(0 == 1);
+		break;
+
+	case FR_CHANNEL_CLOSE:
+		MPRINT1("Network %d got close ack.\n", bt->id);
+		bt->num_closed++;
+		break;
+	}
+}
+
+/** Send as many requests as we're allowed to have outstanding
+ *
+ */
+static void network_send_requests(bench_thread_t *bt)
+{
+	while ((bt->sent < max_messages) && (bt->outstanding < max_outstanding)) {
+		fr_channel_data_t	*cd;
+		fr_channel_t		*ch;
+
+		cd = (fr_channel_data_t *) fr_message_alloc(bt->ms, NULL, message_size);
+		if (!cd) {
+			bt->alloc_failed++;
+			bench_gc(bt, bt->ms);
+			return;
+		}
+
+		if (touch_memory && message_size) memset(cd->m.data, bt->sent & 0xff, message_size);
+
+		cd->m.when = fr_time();
+		cd->request.recv_time = cd->m.when;
+		cd->priority = PRIORITY_NORMAL;
+		cd->packet_ctx = NULL;
+		cd->listen = NULL;
+
+		ch = bt->channel[bt->next];
+		bt->next = (bt->next + 1) % num_workers;
+
+		if (fr_channel_send_request(ch, cd) < 0) {
+			bt->queue_full++;
+			fr_message_done(&cd->m);
+			return;
+		}
+
+		if (!bt->sent) bt->start = cd->m.when;
+
+		bt->sent++;
+		bt->outstanding++;
+
+		MPRINT2("Network %d sent request %" PRIu64 ", outstanding %" PRIu64 "\n",
+			bt->id, bt->sent, bt->outstanding);
+	}
+}
+
+static void *bench_network(void *arg)
+{
+	int		i;
+	bench_thread_t	*bt = arg;
+
+	bench_thread_init(bt, "channel_bench_network", network_channel_callback);
+
+	bt->ms = fr_message_set_create(bt->ctx, message_set_size, sizeof(fr_channel_data_t), ring_buffer_size);
+	if (!bt->ms) {
+		fr_perror("channel_bench: Network %d failed creating message set", bt->id);
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	fr_histogram_init(&bt->rtt);
+
+	/*
+	 *	The workers have to be running before we can create
+	 *	channels to them.
+	 */
+	bench_ready(true);
+
+	for (i = 0; i < num_workers; i++) {
+		bt->channel[i] = fr_channel_create(bt->ctx, bt->control, workers[i]->control, false);
+		if (!bt->channel[i]) {
+			fr_perror("channel_bench: Network %d failed creating channel", bt->id);
+			fr_exit_now(EXIT_FAILURE);
+		}
+
+		fr_channel_requestor_uctx_add(bt->channel[i], bt);
+		fr_channel_set_recv_reply(bt->channel[i], bt, network_recv_reply);
+
+		if (fr_channel_signal_open(bt->channel[i]) < 0) {
+			fr_perror("channel_bench: Network %d failed signalling open", bt->id);
+			fr_exit_now(EXIT_FAILURE);
+		}
+	}
+
+	MPRINT1("Network %d started.\n", bt->id);
+
+	while (bt->received < max_messages) {
+		network_send_requests(bt);
+
+		/*
+		 *	Only sleep if we can't send anything else.
+		 */
+		if (bench_thread_poll(bt, (bt->sent == max_messages) || (bt->outstanding >= max_outstanding)) < 0) {
+			fr_exit_now(EXIT_FAILURE);
+		}
+	}
+
+	if (debug_lvl > 1) {
+		for (i = 0; i < num_workers; i++) fr_channel_stats_log(bt->channel[i], &default_log, __FILE__, __LINE__);
+	}
+
+	for (i = 0; i < num_workers; i++) {
+		if (fr_channel_signal_responder_close(bt->channel[i]) < 0) {
+			fr_perror("channel_bench: Network %d failed signalling close", bt->id);
+			fr_exit_now(EXIT_FAILURE);
+		}
+	}
+
+	while (bt->num_closed < num_workers) {
+		if (bench_thread_poll(bt, true) < 0) break;
+	}
+
+	bench_gc(bt, bt->ms);
+
+	MPRINT1("Network %d exiting.\n", bt->id);
+
+	return NULL;
+}
+
+static void bench_results(fr_time_t start, fr_time_t end)
+{
+	int		i;
+	fr_histogram_t	rtt;
+	uint64_t	received = 0, signals = 0, net_wakeups = 0, worker_wakeups = 0;
+	uint64_t	alloc_failed = 0, queue_full = 0, gc_calls = 0, gc_time = 0, gc_max = 0;
+	double		elapsed, rate;
+
+	fr_histogram_init(&rtt);
+
+	for (i = 0; i < num_networks; i++) {
+		bench_thread_t *bt = networks[i];
+
+		fr_histogram_merge(&rtt, &bt->rtt);
+		received += bt->received;
+		signals += bt->signals;
+		net_wakeups += bt->wakeups;
+		alloc_failed += bt->alloc_failed;
+		queue_full += bt->queue_full;
+		gc_calls += bt->gc_calls;
+		gc_time += bt->gc_time;
+		if (bt->gc_max > gc_max) gc_max = bt->gc_max;
+	}
+
+	for (i = 0; i < num_workers; i++) {
+		bench_thread_t *bt = workers[i];
+
+		signals += bt->signals;
+		worker_wakeups += bt->wakeups;
+		alloc_failed += bt->alloc_failed;
+		gc_calls += bt->gc_calls;
+		gc_time += bt->gc_time;
+		if (bt->gc_max > gc_max) gc_max = bt->gc_max;
+	}
+
+	elapsed = ((double) fr_time_delta_unwrap(fr_time_sub(end, start))) / NSEC;
+	rate = (elapsed > 0) ? received / elapsed : 0;
+
+#define TO_USEC(_x) (((double) (_x)) / 1000)
+#define PER_K(_x) (received ? (((double) (_x)) * 1000) / received : 0)
+
+	if (parseable) {
+		printf("networks\tworkers\tmessages\toutstanding\tsize\tmessages/s"
+		       "\tp50_us\tp90_us\tp99_us\tp999_us\tmax_us"
+		       "\tsignals/k\tnetwork_wakeups/k\tworker_wakeups/k\tgc_avg_us\tgc_max_us"
+		       "\talloc_failed\tqueue_full\n");
+		printf("%d\t%d\t%" PRIu64 "\t%" PRIu64 "\t%zu\t%.0f"
+		       "\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f"
+		       "\t%.2f\t%.2f\t%.2f\t%.3f\t%.3f"
+		       "\t%" PRIu64 "\t%" PRIu64 "\n",
+		       num_networks, num_workers, received, max_outstanding, message_size, rate,
+		       TO_USEC(fr_histogram_percentile(&rtt, 50)), TO_USEC(fr_histogram_percentile(&rtt, 90)),
+		       TO_USEC(fr_histogram_percentile(&rtt, 99)), TO_USEC(fr_histogram_percentile(&rtt, 99.9)),
+		       TO_USEC(fr_histogram_max(&rtt)),
+		       PER_K(signals), PER_K(net_wakeups), PER_K(worker_wakeups),
+		       gc_calls ? TO_USEC(gc_time / gc_calls) : 0, TO_USEC(gc_max),
+		       alloc_failed, queue_full);
+		return;
+	}
+
+	printf("channel_bench: %d network(s), %d worker(s), %" PRIu64 " messages, "
+	       "%" PRIu64 " outstanding per network, %zu byte messages\n",
+	       num_networks, num_workers, received, max_outstanding, message_size);
+	printf("\telapsed           = %.3fs\n", elapsed);
+	printf("\tthroughput        = %.0f messages/s\n", rate);
+	printf("\trtt (us)          = min %.3f p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f max %.3f\n",
+	       TO_USEC(fr_histogram_min(&rtt)),
+	       TO_USEC(fr_histogram_percentile(&rtt, 50)), TO_USEC(fr_histogram_percentile(&rtt, 90)),
+	       TO_USEC(fr_histogram_percentile(&rtt, 99)), TO_USEC(fr_histogram_percentile(&rtt, 99.9)),
+	       TO_USEC(fr_histogram_max(&rtt)));
+	printf("\tsignals           = %" PRIu64 " (%.2f per 1000 messages)\n", signals, PER_K(signals));
+	printf("\tnetwork wakeups   = %" PRIu64 " (%.2f per 1000 messages)\n", net_wakeups, PER_K(net_wakeups));
+	printf("\tworker wakeups    = %" PRIu64 " (%.2f per 1000 messages)\n", worker_wakeups, PER_K(worker_wakeups));
+	printf("\tmessage set gc    = %" PRIu64 " calls, avg %.3fus, max %.3fus\n",
+	       gc_calls, gc_calls ? TO_USEC(gc_time / gc_calls) : 0, TO_USEC(gc_max));
+	printf("\talloc failed      = %" PRIu64 "\n", alloc_failed);
+	printf("\tqueue full        = %" PRIu64 "\n", queue_full);
+
+	if (debug_lvl) fr_histogram_fprint(stdout, &rtt, "\trtt ");
+}
+
+int main(int argc, char *argv[])
+{
+	int			c, i;
+	pthread_attr_t		attr;
+	fr_time_t		start, end;
+
+	if (fr_time_start() < 0) {
+		fr_perror("channel_bench");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	while ((c = getopt(argc, argv, "hm:M:n:o:pr:s:tw:x")) != -1) switch (c) {
+		case 'm':
+			max_messages = strtoull(optarg, NULL, 10);
+			break;
+
+		case 'M':
+			message_set_size = atoi(optarg);
+			break;
+
+		case 'n':
+			num_networks = atoi(optarg);
+			break;
+
+		case 'o':
+			max_outstanding = strtoull(optarg, NULL, 10);
+			break;
+
+		case 'p':
+			parseable = true;
+			break;
+
+		case 'r':
+			ring_buffer_size = strtoul(optarg, NULL, 10);
+			break;
+
+		case 's':
+			message_size = strtoul(optarg, NULL, 10);
+			break;
+
+		case 't':
+			touch_memory = true;
+			break;
+
+		case 'w':
+			num_workers = atoi(optarg);
+			break;
+
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	if ((num_networks < 1) || (num_networks > MAX_NETWORKS)) {
+		fprintf(stderr, "channel_bench: Number of networks must be 1..%d\n", MAX_NETWORKS);
+		usage();
+	}
+
+	if ((num_workers < 1) || (num_workers > MAX_WORKERS)) {
+		fprintf(stderr, "channel_bench: Number of workers must be 1..%d\n", MAX_WORKERS);
+		usage();
+	}
+
+	if (!max_messages) usage();
+	if (!max_outstanding) max_outstanding = 1;
+	if (max_outstanding > max_messages) max_outstanding = max_messages;
+	if (max_outstanding > ((uint64_t) MAX_OUTSTANDING * num_workers)) {
+		max_outstanding = (uint64_t) MAX_OUTSTANDING * num_workers;
+	}
+
+	if ((message_set_size < 8) || ((message_set_size & (message_set_size - 1)) != 0)) {
+		fprintf(stderr, "channel_bench: Message set size must be a power of 2, and at least 8\n");
+		usage();
+	}
+	if (!ring_buffer_size) ring_buffer_size = message_set_size * message_size;
+
+	(void) pthread_attr_init(&attr);
+	(void) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+	for (i = 0; i < num_workers; i++) {
+		workers[i] = talloc_zero(NULL, bench_thread_t);
+		workers[i]->id = i;
+	}
+
+	for (i = 0; i < num_networks; i++) {
+		networks[i] = talloc_zero(NULL, bench_thread_t);
+		networks[i]->id = i;
+	}
+
+	for (i = 0; i < num_workers; i++) {
+		if (pthread_create(&workers[i]->pthread_id, &attr, bench_worker, workers[i]) != 0) {
+			fprintf(stderr, "channel_bench: Failed creating worker: %s\n", fr_syserror(errno));
+			fr_exit_now(EXIT_FAILURE);
+		}
+	}
+
+	for (i = 0; i < num_networks; i++) {
+		if (pthread_create(&networks[i]->pthread_id, &attr, bench_network, networks[i]) != 0) {
+			fprintf(stderr, "channel_bench: Failed creating network: %s\n", fr_syserror(errno));
+			fr_exit_now(EXIT_FAILURE);
+		}
+	}
+
+	for (i = 0; i < num_networks; i++) (void) pthread_join(networks[i]->pthread_id, NULL);
+	for (i = 0; i < num_workers; i++) (void) pthread_join(workers[i]->pthread_id, NULL);
+
+	/*
+	 *	Measure from the first request sent, to the last reply
+	 *	received, across all of the networks.
+	 */
+	start = networks[0]->start;
+	end = networks[0]->end;
+	for (i = 1; i < num_networks; i++) {
+		if (fr_time_lt(networks[i]->start, start)) start = networks[i]->start;
+		if (fr_time_gt(networks[i]->end, end)) end = networks[i]->end;
+	}
+
+	bench_results(start, end);
+
+	/*
+	 *	Channels are owned by the networks, and referenced by
+	 *	the workers, so we only free things once all of the
+	 *	threads have exited.
+	 */
+	for (i = 0; i < num_networks; i++) {
+		talloc_free(networks[i]->ctx);
+		talloc_free(networks[i]);
+	}
+
+	for (i = 0; i < num_workers; i++) {
+		talloc_free(workers[i]->ctx);
+		talloc_free(workers[i]);
+	}
+
+	fr_exit_now(EXIT_SUCCESS);
+}
@@ -0,0 +1,6 @@
+TARGET 		:= channel_bench$(E)
+
+SOURCES		:= channel_bench.c
+
+TGT_PREREQS	:= $(LIBFREERADIUS_SERVER) libfreeradius-io$(L)
+TGT_LDLIBS	:= $(LIBS)
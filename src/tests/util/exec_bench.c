@@ -0,0 +1,172 @@
+/*
+ * exec_bench.c	Benchmark for starting child processes, with fork() and posix_spawn()
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/server/exec.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/syserror.h>
+
+#include <sys/wait.h>
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#define MPRINT1 if (debug_lvl) printf
+
+static int			debug_lvl = 0;
+
+static NEVER_RETURNS void usage(void)
+{
+	fprintf(stderr, "usage: exec_bench [OPTS]\n");
+	fprintf(stderr, "  -c <program>           Program to run (default /bin/true).\n");
+	fprintf(stderr, "  -m <megabytes>         Grow the resident set by this much before starting (default 0).\n");
+	fprintf(stderr, "  -n <count>             Number of processes to start, in each mode.\n");
+	fprintf(stderr, "  -p                     Print one line of tab separated results.\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	fr_exit_now(EXIT_FAILURE);
+}
+
+/** Start a program many times
+ *
+ * Only the time taken to start the child is measured, as that's how
+ * long the calling worker is stalled.  Waiting for the child to exit
+ * isn't included.
+ *
+ * @param[out] worst	longest time taken to start a child, in nanoseconds.
+ * @param[in] program	to run.
+ * @param[in] count	number of times to run it.
+ * @param[in] spawn	use posix_spawn() instead of fork().
+ * @return total time taken to start the children, in nanoseconds.
+ */
+static uint64_t bench_exec(uint64_t *worst, char const *program, int count, bool spawn)
+{
+	char		*argv[] = { UNCONST(char *, program), NULL };
+	uint64_t	total = 0;
+	int		i;
+
+	*worst = 0;
+
+	if (fr_exec_spawn_set(spawn) < 0) {
+		fr_perror("exec_bench");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < count; i++) {
+		fr_time_t	start;
+		uint64_t	elapsed;
+		pid_t		pid;
+		int		status;
+
+		start = fr_time();
+		if (fr_exec_fork_wait(&pid, NULL, NULL, NULL, argv, NULL, false, false) < 0) {
+			fr_perror("exec_bench");
+			fr_exit_now(EXIT_FAILURE);
+		}
+		elapsed = fr_time_delta_unwrap(fr_time_sub(fr_time(), start));
+
+		total += elapsed;
+		if (elapsed > *worst) *worst = elapsed;
+
+		if (waitpid(pid, &status, 0) < 0) {
+			fprintf(stderr, "exec_bench: waitpid failed: %s\n", fr_syserror(errno));
+			fr_exit_now(EXIT_FAILURE);
+		}
+	}
+
+	return total;
+}
+
+int main(int argc, char *argv[])
+{
+	int		c;
+	int		count = 1000;
+	size_t		megabytes = 0;
+	bool		print_line = false;
+	char const	*program = "/bin/true";
+	uint8_t		*ballast = NULL;
+	uint64_t	fork_time, fork_worst, spawn_time, spawn_worst;
+
+	fr_time_start();
+
+	while ((c = getopt(argc, argv, "c:hm:n:px")) != -1) switch (c) {
+		case 'c':
+			program = optarg;
+			break;
+
+		case 'm':
+			megabytes = strtoul(optarg, NULL, 10);
+			break;
+
+		case 'n':
+			count = atoi(optarg);
+			break;
+
+		case 'p':
+			print_line = true;
+			break;
+
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	if (count < 1) usage();
+
+	/*
+	 *	Touch every page, so that they're all mapped and
+	 *	fork() has to copy the page tables.
+	 */
+	if (megabytes) {
+		ballast = malloc(megabytes * 1024 * 1024);
+		if (!ballast) {
+			fprintf(stderr, "exec_bench: Failed allocating %zu MB\n", megabytes);
+			fr_exit_now(EXIT_FAILURE);
+		}
+		memset(ballast, 0x5a, megabytes * 1024 * 1024);
+	}
+	MPRINT1("Starting %s %d times, with %zu MB of ballast\n", program, count, megabytes);
+
+	fork_time = bench_exec(&fork_worst, program, count, false);
+	spawn_time = bench_exec(&spawn_worst, program, count, true);
+
+	if (print_line) {
+		printf("%zu\t%d\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n",
+		       megabytes, count,
+		       fork_time / count, fork_worst,
+		       spawn_time / count, spawn_worst);
+	} else {
+		printf("ballast\t\t%zu MB\n", megabytes);
+		printf("fork\t\t%" PRIu64 " ns/process\t%" PRIu64 " ns worst\n", fork_time / count, fork_worst);
+		printf("posix_spawn\t%" PRIu64 " ns/process\t%" PRIu64 " ns worst\n", spawn_time / count, spawn_worst);
+	}
+
+	free(ballast);
+
+	return 0;
+}
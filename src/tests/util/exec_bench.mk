@@ -0,0 +1,6 @@
+TARGET 		:= exec_bench$(E)
+
+SOURCES		:= exec_bench.c
+
+TGT_PREREQS	:= libfreeradius-server$(L) libfreeradius-util$(L)
+TGT_LDLIBS	:= $(LIBS)
@@ -0,0 +1,224 @@
+/*
+ * radius_decode_bench.c	Benchmark for decoding RADIUS packets, with and without shared values
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/radius/radius.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/talloc.h>
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#define MPRINT1 if (debug_lvl) printf
+
+static int			debug_lvl = 0;
+
+static NEVER_RETURNS void usage(void)
+{
+	fprintf(stderr, "usage: radius_decode_bench [OPTS]\n");
+	fprintf(stderr, "  -D <dictdir>           Set dictionary directory.\n");
+	fprintf(stderr, "  -e <fragments>         Number of EAP-Message attributes in each packet (default 1).\n");
+	fprintf(stderr, "  -n <packets>           Number of packets to decode, in each mode.\n");
+	fprintf(stderr, "  -p                     Print one line of tab separated results.\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	fr_exit_now(EXIT_FAILURE);
+}
+
+static uint8_t *add_attr(uint8_t *p, uint8_t attr, size_t len)
+{
+	size_t i;
+
+	p[0] = attr;
+	p[1] = len + 2;
+	for (i = 0; i < len; i++) p[2 + i] = fr_rand() & 0xff;
+
+	return p + 2 + len;
+}
+
+/** Build an Access-Request which looks like one in the middle of an EAP conversation
+ *
+ * The EAP-Message attributes are full sized, as they would be for
+ * EAP-TLS, PEAP, or TTLS.
+ */
+static size_t packet_build(uint8_t *packet, int fragments)
+{
+	uint8_t	*p = packet;
+	size_t	len;
+	int	i;
+
+	p[0] = FR_RADIUS_CODE_ACCESS_REQUEST;
+	p[1] = 42;
+	for (i = 0; i < RADIUS_AUTH_VECTOR_LENGTH; i++) p[4 + i] = fr_rand() & 0xff;
+	p += RADIUS_HEADER_LENGTH;
+
+	p = add_attr(p, FR_USER_NAME, 24);
+	p = add_attr(p, FR_STATE, 16);
+	p = add_attr(p, FR_CLASS, 64);
+	p = add_attr(p, FR_CLASS, 64);
+	p = add_attr(p, FR_CHARGEABLE_USER_IDENTITY, 32);
+	p = add_attr(p, FR_CALLED_STATION_ID, 32);
+	p = add_attr(p, FR_CALLING_STATION_ID, 17);
+
+	for (i = 0; i < fragments; i++) p = add_attr(p, FR_EAP_MESSAGE, 253);
+
+	len = p - packet;
+	packet[2] = (len >> 8) & 0xff;
+	packet[3] = len & 0xff;
+
+	return len;
+}
+
+/** Decode a packet many times
+ *
+ * @param[out] blocks	average number of talloc blocks allocated for each packet.
+ * @param[in] packet	to decode.
+ * @param[in] len	of the packet.
+ * @param[in] count	number of times to decode the packet.
+ * @param[in] shared	whether octets values reference the packet.
+ * @return how long the decodes took, in nanoseconds.
+ */
+static uint64_t bench_decode(double *blocks, uint8_t *packet, size_t len, int count, bool shared)
+{
+	fr_radius_ctx_t		common_ctx = { .secret = "testing123", .secret_length = 10 };
+	fr_time_t		start;
+	uint64_t		total_blocks = 0;
+	int			i;
+
+	start = fr_time();
+
+	for (i = 0; i < count; i++) {
+		TALLOC_CTX		*ctx = talloc_init_const("decode");
+		fr_pair_list_t		list;
+		fr_radius_decode_ctx_t	decode_ctx = {
+			.common = &common_ctx,
+			.tmp_ctx = talloc(ctx, uint8_t),
+			.end = packet + len,
+			.shared = shared,
+		};
+
+		fr_pair_list_init(&list);
+
+		if (fr_radius_decode(ctx, &list, packet, len, &decode_ctx) < 0) {
+			fr_perror("radius_decode_bench");
+			fr_exit_now(EXIT_FAILURE);
+		}
+		talloc_free(decode_ctx.tmp_ctx);
+
+		total_blocks += talloc_total_blocks(ctx);
+
+		if ((i == 0) && debug_lvl) fr_pair_list_debug(&list);
+
+		talloc_free(ctx);
+	}
+
+	*blocks = (double) total_blocks / count;
+
+	return fr_time_delta_unwrap(fr_time_sub(fr_time(), start));
+}
+
+int main(int argc, char *argv[])
+{
+	int		c;
+	int		count = 1000000;
+	int		fragments = 1;
+	bool		print_line = false;
+	char const	*dict_dir = DICTDIR;
+	uint8_t		packet[MAX_PACKET_LEN];
+	size_t		len;
+	uint64_t	copy_time, shared_time;
+	double		copy_blocks, shared_blocks;
+	TALLOC_CTX	*autofree;
+
+	autofree = talloc_autofree_context();
+
+	fr_time_start();
+
+	while ((c = getopt(argc, argv, "D:e:hn:px")) != -1) switch (c) {
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'e':
+			fragments = atoi(optarg);
+			break;
+
+		case 'n':
+			count = atoi(optarg);
+			break;
+
+		case 'p':
+			print_line = true;
+			break;
+
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	if ((count < 1) || (fragments < 0) ||
+	    ((RADIUS_HEADER_LENGTH + 300 + (fragments * 255)) > RADIUS_MAX_PACKET_SIZE)) usage();
+
+	if (!fr_dict_global_ctx_init(autofree, true, dict_dir)) {
+		fr_perror("radius_decode_bench");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_radius_global_init() < 0) {
+		fr_perror("radius_decode_bench");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	len = packet_build(packet, fragments);
+	MPRINT1("Packet is %zu bytes, with %d EAP-Message attributes\n", len, fragments);
+
+	/*
+	 *	Warm up the allocator, so that the first mode
+	 *	isn't penalised.
+	 */
+	(void) bench_decode(&copy_blocks, packet, len, (count / 10) + 1, false);
+
+	copy_time = bench_decode(&copy_blocks, packet, len, count, false);
+	shared_time = bench_decode(&shared_blocks, packet, len, count, true);
+
+	if (print_line) {
+		printf("%zu\t%d\t%d\t%" PRIu64 "\t%.1f\t%" PRIu64 "\t%.1f\n",
+		       len, fragments, count,
+		       copy_time / count, copy_blocks,
+		       shared_time / count, shared_blocks);
+	} else {
+		printf("packet size\t%zu bytes, %d EAP-Message\n", len, fragments);
+		printf("copy\t\t%" PRIu64 " ns/packet\t%.1f allocations/packet\n", copy_time / count, copy_blocks);
+		printf("shared\t\t%" PRIu64 " ns/packet\t%.1f allocations/packet\n", shared_time / count, shared_blocks);
+	}
+
+	fr_radius_global_free();
+
+	return 0;
+}
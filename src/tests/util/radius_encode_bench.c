@@ -0,0 +1,318 @@
+/*
+ * radius_encode_bench.c	Benchmark for encoding RADIUS replies, with and without the header cache
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/radius/radius.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/talloc.h>
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#define MPRINT1 if (debug_lvl) printf
+
+static int			debug_lvl = 0;
+
+static fr_dict_t const *dict_radius;
+
+extern fr_dict_autoload_t radius_encode_bench_dict[];
+fr_dict_autoload_t radius_encode_bench_dict[] = {
+	{ .out = &dict_radius, .proto = "radius" },
+	{ NULL }
+};
+
+static fr_dict_attr_t const *attr_framed_ip_address;
+static fr_dict_attr_t const *attr_framed_mtu;
+static fr_dict_attr_t const *attr_session_timeout;
+static fr_dict_attr_t const *attr_idle_timeout;
+static fr_dict_attr_t const *attr_acct_interim_interval;
+static fr_dict_attr_t const *attr_class;
+static fr_dict_attr_t const *attr_state;
+static fr_dict_attr_t const *attr_reply_message;
+static fr_dict_attr_t const *attr_aruba_user_vlan;
+static fr_dict_attr_t const *attr_aruba_user_role;
+static fr_dict_attr_t const *attr_cisco_avpair;
+
+extern fr_dict_attr_autoload_t radius_encode_bench_dict_attr[];
+fr_dict_attr_autoload_t radius_encode_bench_dict_attr[] = {
+	{ .out = &attr_framed_ip_address, .name = "Framed-IP-Address", .type = FR_TYPE_IPV4_ADDR, .dict = &dict_radius },
+	{ .out = &attr_framed_mtu, .name = "Framed-MTU", .type = FR_TYPE_UINT32, .dict = &dict_radius },
+	{ .out = &attr_session_timeout, .name = "Session-Timeout", .type = FR_TYPE_UINT32, .dict = &dict_radius },
+	{ .out = &attr_idle_timeout, .name = "Idle-Timeout", .type = FR_TYPE_UINT32, .dict = &dict_radius },
+	{ .out = &attr_acct_interim_interval, .name = "Acct-Interim-Interval", .type = FR_TYPE_UINT32, .dict = &dict_radius },
+	{ .out = &attr_class, .name = "Class", .type = FR_TYPE_OCTETS, .dict = &dict_radius },
+	{ .out = &attr_state, .name = "State", .type = FR_TYPE_OCTETS, .dict = &dict_radius },
+	{ .out = &attr_reply_message, .name = "Reply-Message", .type = FR_TYPE_STRING, .dict = &dict_radius },
+	{ .out = &attr_aruba_user_vlan, .name = "Vendor-Specific.Aruba.User-Vlan", .type = FR_TYPE_UINT32, .dict = &dict_radius },
+	{ .out = &attr_aruba_user_role, .name = "Vendor-Specific.Aruba.User-Role", .type = FR_TYPE_STRING, .dict = &dict_radius },
+	{ .out = &attr_cisco_avpair, .name = "Vendor-Specific.Cisco.AVPair", .type = FR_TYPE_STRING, .dict = &dict_radius },
+	{ NULL }
+};
+
+static NEVER_RETURNS void usage(void)
+{
+	fprintf(stderr, "usage: radius_encode_bench [OPTS]\n");
+	fprintf(stderr, "  -D <dictdir>           Set dictionary directory.\n");
+	fprintf(stderr, "  -n <packets>           Number of packets to encode, in each mode.\n");
+	fprintf(stderr, "  -p                     Print one line of tab separated results.\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	fr_exit_now(EXIT_FAILURE);
+}
+
+static fr_pair_t *reply_add(TALLOC_CTX *ctx, fr_pair_list_t *list, fr_dict_attr_t const *da)
+{
+	fr_pair_t *vp;
+
+	if (fr_pair_append_by_da_parent(ctx, &vp, list, da) < 0) {
+		fr_perror("radius_encode_bench");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	return vp;
+}
+
+/** Build the attributes of a typical Access-Accept
+ *
+ */
+static void reply_build(TALLOC_CTX *ctx, fr_pair_list_t *list)
+{
+	fr_pair_t	*vp;
+	uint8_t		buffer[64];
+	size_t		i;
+
+	for (i = 0; i < sizeof(buffer); i++) buffer[i] = fr_rand() & 0xff;
+
+	vp = reply_add(ctx, list, attr_framed_ip_address);
+	vp->vp_ipv4addr = htonl(0x0a000001);
+
+	vp = reply_add(ctx, list, attr_framed_mtu);
+	vp->vp_uint32 = 1500;
+
+	vp = reply_add(ctx, list, attr_session_timeout);
+	vp->vp_uint32 = 86400;
+
+	vp = reply_add(ctx, list, attr_idle_timeout);
+	vp->vp_uint32 = 600;
+
+	vp = reply_add(ctx, list, attr_acct_interim_interval);
+	vp->vp_uint32 = 300;
+
+	vp = reply_add(ctx, list, attr_class);
+	fr_pair_value_memdup(vp, buffer, 32, false);
+
+	vp = reply_add(ctx, list, attr_state);
+	fr_pair_value_memdup(vp, buffer + 32, 16, false);
+
+	vp = reply_add(ctx, list, attr_reply_message);
+	fr_pair_value_strdup(vp, "Welcome to the network", false);
+
+	vp = reply_add(ctx, list, attr_aruba_user_vlan);
+	vp->vp_uint32 = 42;
+
+	vp = reply_add(ctx, list, attr_aruba_user_role);
+	fr_pair_value_strdup(vp, "employee", false);
+
+	vp = reply_add(ctx, list, attr_cisco_avpair);
+	fr_pair_value_strdup(vp, "ip:inacl#1=permit ip any any", false);
+}
+
+/** Encode a reply many times
+ *
+ * @param[out] out	where the last encoded packet is written.
+ * @param[out] outlen	the length of the encoded packet.
+ * @param[in] original	request packet.
+ * @param[in] list	of attributes to encode.
+ * @param[in] count	number of times to encode the packet.
+ * @param[in] cache	whether the header cache is used.
+ * @return how long the encodes took, in nanoseconds.
+ */
+static uint64_t bench_encode(uint8_t *out, size_t *outlen, uint8_t const *original,
+			     fr_pair_list_t *list, int count, bool cache)
+{
+	fr_time_t	start;
+	ssize_t		slen = 0;
+	int		i;
+
+	fr_radius_encode_header_cache = cache;
+
+	start = fr_time();
+
+	for (i = 0; i < count; i++) {
+		slen = fr_radius_encode(out, MAX_PACKET_LEN, original, "testing123", 10,
+					FR_RADIUS_CODE_ACCESS_ACCEPT, original[1], list);
+		if (slen < 0) {
+			fr_perror("radius_encode_bench");
+			fr_exit_now(EXIT_FAILURE);
+		}
+	}
+
+	*outlen = slen;
+
+	return fr_time_delta_unwrap(fr_time_sub(fr_time(), start));
+}
+
+/** Decode a reply many times
+ *
+ */
+static uint64_t bench_decode(uint8_t *packet, size_t len, uint8_t const *original, int count)
+{
+	fr_radius_ctx_t		common_ctx = { .secret = "testing123", .secret_length = 10 };
+	fr_time_t		start;
+	int			i;
+
+	start = fr_time();
+
+	for (i = 0; i < count; i++) {
+		TALLOC_CTX		*ctx = talloc_init_const("decode");
+		fr_pair_list_t		list;
+		fr_radius_decode_ctx_t	decode_ctx = {
+			.common = &common_ctx,
+			.request_authenticator = original + 4,
+			.tmp_ctx = talloc(ctx, uint8_t),
+			.end = packet + len,
+		};
+
+		fr_pair_list_init(&list);
+
+		if (fr_radius_decode(ctx, &list, packet, len, &decode_ctx) < 0) {
+			fr_perror("radius_encode_bench");
+			fr_exit_now(EXIT_FAILURE);
+		}
+
+		if ((i == 0) && debug_lvl) fr_pair_list_debug(&list);
+
+		talloc_free(ctx);
+	}
+
+	return fr_time_delta_unwrap(fr_time_sub(fr_time(), start));
+}
+
+int main(int argc, char *argv[])
+{
+	int		c;
+	int		count = 1000000;
+	bool		print_line = false;
+	char const	*dict_dir = DICTDIR;
+	uint8_t		original[RADIUS_HEADER_LENGTH];
+	uint8_t		generic[MAX_PACKET_LEN], cached[MAX_PACKET_LEN];
+	size_t		generic_len, cached_len;
+	uint64_t	generic_time, cached_time, decode_time;
+	fr_pair_list_t	list;
+	size_t		i;
+	TALLOC_CTX	*autofree;
+
+	autofree = talloc_autofree_context();
+
+	fr_time_start();
+
+	while ((c = getopt(argc, argv, "D:hn:px")) != -1) switch (c) {
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'n':
+			count = atoi(optarg);
+			break;
+
+		case 'p':
+			print_line = true;
+			break;
+
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	if (count < 1) usage();
+
+	if (!fr_dict_global_ctx_init(autofree, true, dict_dir)) {
+	error:
+		fr_perror("radius_encode_bench");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	if (fr_radius_global_init() < 0) goto error;
+
+	if (fr_dict_autoload(radius_encode_bench_dict) < 0) goto error;
+
+	if (fr_dict_attr_autoload(radius_encode_bench_dict_attr) < 0) goto error;
+
+	original[0] = FR_RADIUS_CODE_ACCESS_REQUEST;
+	original[1] = 42;
+	original[2] = 0;
+	original[3] = RADIUS_HEADER_LENGTH;
+	for (i = 4; i < sizeof(original); i++) original[i] = fr_rand() & 0xff;
+
+	fr_pair_list_init(&list);
+	reply_build(autofree, &list);
+	if (debug_lvl) fr_pair_list_debug(&list);
+
+	/*
+	 *	Warm up the allocator and the caches, so that the
+	 *	first mode isn't penalised.
+	 */
+	(void) bench_encode(generic, &generic_len, original, &list, (count / 10) + 1, false);
+
+	generic_time = bench_encode(generic, &generic_len, original, &list, count, false);
+	cached_time = bench_encode(cached, &cached_len, original, &list, count, true);
+
+	/*
+	 *	The header cache is an optimisation.  It must not
+	 *	change the output.
+	 */
+	if ((generic_len != cached_len) || (memcmp(generic, cached, generic_len) != 0)) {
+		fprintf(stderr, "radius_encode_bench: Packets encoded with and without the header cache differ\n");
+		if (debug_lvl) {
+			fr_log_hex(&default_log, L_DBG, __FILE__, __LINE__, generic, generic_len, "generic");
+			fr_log_hex(&default_log, L_DBG, __FILE__, __LINE__, cached, cached_len, "cached");
+		}
+		fr_exit_now(EXIT_FAILURE);
+	}
+	MPRINT1("Packet is %zu bytes, and is identical in both modes\n", cached_len);
+
+	decode_time = bench_decode(cached, cached_len, original, count);
+
+	if (print_line) {
+		printf("%zu\t%d\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\n",
+		       cached_len, count,
+		       generic_time / count, cached_time / count, decode_time / count);
+	} else {
+		printf("packet size\t%zu bytes\n", cached_len);
+		printf("encode\t\t%" PRIu64 " ns/packet\n", generic_time / count);
+		printf("encode cached\t%" PRIu64 " ns/packet\n", cached_time / count);
+		printf("decode\t\t%" PRIu64 " ns/packet\n", decode_time / count);
+	}
+
+	fr_pair_list_free(&list);
+	fr_dict_autofree(radius_encode_bench_dict);
+	fr_radius_global_free();
+
+	return 0;
+}
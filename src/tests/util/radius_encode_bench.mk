@@ -0,0 +1,6 @@
+TARGET 		:= radius_encode_bench$(E)
+
+SOURCES		:= radius_encode_bench.c
+
+TGT_PREREQS	:= libfreeradius-radius$(L) libfreeradius-util$(L)
+TGT_LDLIBS	:= $(LIBS)
@@ -0,0 +1,542 @@
+/*
+ * radsec_bench.c	Load generator for RADIUS over TLS listeners
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2026 The FreeRADIUS server project
+ */
+
+RCSID("$Id$")
+
+#include <freeradius-devel/radius/radius.h>
+#include <freeradius-devel/util/debug.h>
+#include <freeradius-devel/util/histogram.h>
+#include <freeradius-devel/util/inet.h>
+#include <freeradius-devel/util/misc.h>
+#include <freeradius-devel/util/nbo.h>
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/socket.h>
+#include <freeradius-devel/util/syserror.h>
+#include <freeradius-devel/util/talloc.h>
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#include <poll.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#define MAX_CONNECTIONS		(1024)
+
+/*
+ *	Packets are identified by the RADIUS ID, so we can't have more
+ *	than 256 outstanding on any one connection.
+ */
+#define MAX_OUTSTANDING		(256)
+
+/*
+ *	Status-Server, with a Message-Authenticator.
+ */
+#define PACKET_LEN		(RADIUS_HEADER_LENGTH + 2 + RADIUS_AUTH_VECTOR_LENGTH)
+
+#define MPRINT1 if (debug_lvl) printf
+
+/** One TLS connection to the server
+ *
+ */
+typedef struct {
+	int			id;
+	int			fd;
+	SSL			*ssl;
+	SSL_SESSION		*session;		//!< From the previous round, for resumption.
+
+	uint64_t		sent;			//!< Packets sent this round.
+	uint64_t		received;		//!< Replies received this round.
+	fr_time_t		sent_at[MAX_OUTSTANDING];
+
+	uint8_t			packet[PACKET_LEN];	//!< Being written.
+	bool			blocked;		//!< SSL_write() must be retried with "packet".
+
+	uint8_t			buffer[4096];		//!< Partial replies.
+	size_t			used;
+} bench_conn_t;
+
+static int			debug_lvl = 0;
+static bool			parseable = false;
+static bool			resume = true;
+
+static int			num_connections = 1;
+static int			num_rounds = 1;
+static uint64_t			num_packets = 1000;
+static uint64_t			max_outstanding = 1;
+
+static char const		*secret = "radsec";
+static char const		*ca_file = NULL;
+static char const		*certificate_file = NULL;
+static char const		*private_key_file = NULL;
+
+static fr_ipaddr_t		server_ipaddr;
+static uint16_t			server_port = 2083;
+
+static bench_conn_t		*conns[MAX_CONNECTIONS];
+
+static uint64_t			handshakes = 0;
+static uint64_t			resumptions = 0;
+static uint64_t			replies = 0;
+static uint64_t			bad_replies = 0;
+static fr_histogram_t		handshake_time;
+static fr_histogram_t		rtt;
+
+static NEVER_RETURNS void usage(void)
+{
+	fprintf(stderr, "usage: radsec_bench [OPTS] server[:port]\n");
+	fprintf(stderr, "  -c <connections>       Number of TLS connections to open.\n");
+	fprintf(stderr, "  -C <file>              CA certificate used to verify the server.\n");
+	fprintf(stderr, "  -k <file>              Client certificate and private key (PEM).\n");
+	fprintf(stderr, "  -n <packets>           Number of packets sent on each connection, per round.\n");
+	fprintf(stderr, "  -N                     Don't resume sessions between rounds.\n");
+	fprintf(stderr, "  -o <outstanding>       Keep number of packets outstanding per connection.\n");
+	fprintf(stderr, "  -p                     Print one line of tab separated results.\n");
+	fprintf(stderr, "  -r <rounds>            Number of times each connection is opened.\n");
+	fprintf(stderr, "  -s <secret>            Shared secret (default \"radsec\").\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	fr_exit_now(EXIT_FAILURE);
+}
+
+static NEVER_RETURNS void bench_fail(char const *msg)
+{
+	unsigned long e;
+
+	fprintf(stderr, "radsec_bench: %s\n", msg);
+	while ((e = ERR_get_error()) != 0) {
+		char buffer[256];
+
+		ERR_error_string_n(e, buffer, sizeof(buffer));
+		fprintf(stderr, "radsec_bench: %s\n", buffer);
+	}
+
+	fr_exit_now(EXIT_FAILURE);
+}
+
+/** Open a connection, and do the TLS handshake
+ *
+ * The handshake is done with a blocking socket, so that its cost can
+ * be measured separately from the cost of sending packets.
+ */
+static void bench_connect(SSL_CTX *ssl_ctx, bench_conn_t *conn)
+{
+	fr_time_t	start;
+
+	start = fr_time();
+
+	conn->fd = fr_socket_client_tcp(NULL, NULL, &server_ipaddr, server_port, false);
+	if (conn->fd < 0) {
+		fr_perror("radsec_bench");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	conn->ssl = SSL_new(ssl_ctx);
+	if (!conn->ssl) bench_fail("Failed allocating SSL");
+
+	SSL_set_fd(conn->ssl, conn->fd);
+	SSL_set_connect_state(conn->ssl);
+	if (resume && conn->session) SSL_set_session(conn->ssl, conn->session);
+
+	if (SSL_connect(conn->ssl) != 1) bench_fail("TLS handshake failed");
+
+	fr_histogram_record(&handshake_time, fr_time_delta_unwrap(fr_time_sub(fr_time(), start)));
+	handshakes++;
+
+	if (SSL_session_reused(conn->ssl)) resumptions++;
+
+	MPRINT1("connection %d - %s %s\n", conn->id, SSL_get_version(conn->ssl),
+		SSL_session_reused(conn->ssl) ? "resumed" : "full handshake");
+
+	/*
+	 *	Packets are sent without blocking, so that we can keep
+	 *	"outstanding" packets in flight.
+	 */
+	if (fr_nonblock(conn->fd) < 0) {
+		fprintf(stderr, "radsec_bench: Failed setting socket non-blocking: %s\n", fr_syserror(errno));
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	conn->sent = conn->received = 0;
+	conn->used = 0;
+	conn->blocked = false;
+}
+
+/** Close a connection, and save the session for the next round
+ *
+ * With TLS 1.3, the session ticket is only sent after the handshake,
+ * so we get the session here and not immediately after connecting.
+ */
+static void bench_disconnect(bench_conn_t *conn)
+{
+	if (conn->session) SSL_SESSION_free(conn->session);
+	conn->session = SSL_get1_session(conn->ssl);
+
+	(void) SSL_shutdown(conn->ssl);
+	SSL_free(conn->ssl);
+	conn->ssl = NULL;
+
+	close(conn->fd);
+	conn->fd = -1;
+}
+
+static bool bench_send(bench_conn_t *conn)
+{
+	uint8_t		*packet = conn->packet;
+	uint8_t		*attr;
+	int		id, rcode;
+
+	id = conn->sent % MAX_OUTSTANDING;
+
+	/*
+	 *	OpenSSL requires that a blocked write is retried with
+	 *	the same data.
+	 */
+	if (conn->blocked) goto write;
+
+	packet[0] = FR_RADIUS_CODE_STATUS_SERVER;
+	packet[1] = id;
+	packet[2] = (PACKET_LEN >> 8) & 0xff;
+	packet[3] = PACKET_LEN & 0xff;
+	fr_rand_buffer(packet + 4, RADIUS_AUTH_VECTOR_LENGTH);
+
+	attr = packet + RADIUS_HEADER_LENGTH;
+	attr[0] = FR_MESSAGE_AUTHENTICATOR;
+	attr[1] = 2 + RADIUS_AUTH_VECTOR_LENGTH;
+	memset(attr + 2, 0, RADIUS_AUTH_VECTOR_LENGTH);
+
+	if (fr_radius_sign(packet, NULL, (uint8_t const *) secret, strlen(secret)) < 0) {
+		fr_perror("radsec_bench");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	conn->sent_at[id] = fr_time();
+
+write:
+	/*
+	 *	The packet is small enough that OpenSSL writes it as
+	 *	one record, or not at all.
+	 */
+	rcode = SSL_write(conn->ssl, packet, PACKET_LEN);
+	if (rcode <= 0) {
+		switch (SSL_get_error(conn->ssl, rcode)) {
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			conn->blocked = true;
+			return false;
+
+		default:
+			bench_fail("Failed writing packet");
+		}
+	}
+
+	conn->blocked = false;
+	conn->sent++;
+	return true;
+}
+
+static void bench_recv(bench_conn_t *conn)
+{
+	int		rcode;
+
+	do {
+		uint8_t	*p, *end;
+
+		rcode = SSL_read(conn->ssl, conn->buffer + conn->used, sizeof(conn->buffer) - conn->used);
+		if (rcode <= 0) {
+			switch (SSL_get_error(conn->ssl, rcode)) {
+			case SSL_ERROR_WANT_READ:
+			case SSL_ERROR_WANT_WRITE:
+				return;
+
+			case SSL_ERROR_ZERO_RETURN:
+				fprintf(stderr, "radsec_bench: Server closed connection %d\n", conn->id);
+				fr_exit_now(EXIT_FAILURE);
+
+			default:
+				bench_fail("Failed reading reply");
+			}
+		}
+		conn->used += rcode;
+
+		p = conn->buffer;
+		end = conn->buffer + conn->used;
+
+		while ((end - p) >= RADIUS_HEADER_LENGTH) {
+			size_t packet_len = fr_nbo_to_uint16(p + 2);
+
+			if ((packet_len < RADIUS_HEADER_LENGTH) || (packet_len > sizeof(conn->buffer))) {
+				fprintf(stderr, "radsec_bench: Invalid reply on connection %d\n", conn->id);
+				fr_exit_now(EXIT_FAILURE);
+			}
+			if ((size_t) (end - p) < packet_len) break;
+
+			if (p[0] == FR_RADIUS_CODE_ACCESS_ACCEPT) {
+				fr_histogram_record(&rtt, fr_time_delta_unwrap(fr_time_sub(fr_time(), conn->sent_at[p[1]])));
+				replies++;
+			} else {
+				bad_replies++;
+			}
+
+			conn->received++;
+			p += packet_len;
+		}
+
+		if (p > conn->buffer) {
+			conn->used = end - p;
+			memmove(conn->buffer, p, conn->used);
+		}
+	} while (SSL_pending(conn->ssl) > 0);
+}
+
+/** Send and receive packets on all connections, until each has had its replies
+ *
+ */
+static void bench_run(void)
+{
+	struct pollfd	pfd[MAX_CONNECTIONS];
+	int		i, done = 0;
+
+	for (i = 0; i < num_connections; i++) {
+		pfd[i].fd = conns[i]->fd;
+		pfd[i].events = POLLIN;
+	}
+
+	while (done < num_connections) {
+		done = 0;
+
+		for (i = 0; i < num_connections; i++) {
+			bench_conn_t *conn = conns[i];
+
+			if (conn->received == num_packets) {
+				pfd[i].events = 0;
+				done++;
+				continue;
+			}
+
+			pfd[i].events = POLLIN;
+			while ((conn->sent < num_packets) && ((conn->sent - conn->received) < max_outstanding)) {
+				if (!bench_send(conn)) {
+					pfd[i].events |= POLLOUT;
+					break;
+				}
+			}
+		}
+
+		if (done == num_connections) break;
+
+		if (poll(pfd, num_connections, -1) < 0) {
+			if (errno == EINTR) continue;
+
+			fprintf(stderr, "radsec_bench: Failed in poll: %s\n", fr_syserror(errno));
+			fr_exit_now(EXIT_FAILURE);
+		}
+
+		for (i = 0; i < num_connections; i++) {
+			if (pfd[i].revents & (POLLIN | POLLERR | POLLHUP)) bench_recv(conns[i]);
+		}
+	}
+}
+
+static void bench_results(fr_time_t start, fr_time_t end)
+{
+	double		elapsed, rate;
+
+	elapsed = ((double) fr_time_delta_unwrap(fr_time_sub(end, start))) / NSEC;
+	rate = (elapsed > 0) ? replies / elapsed : 0;
+
+#define TO_USEC(_x) (((double) (_x)) / 1000)
+
+	if (parseable) {
+		printf("connections\trounds\tpackets\toutstanding\tpackets/s"
+		       "\thandshakes\tresumed\thandshake_p50_us\thandshake_p99_us"
+		       "\tp50_us\tp90_us\tp99_us\tp999_us\tmax_us\tbad_replies\n");
+		printf("%d\t%d\t%" PRIu64 "\t%" PRIu64 "\t%.0f"
+		       "\t%" PRIu64 "\t%" PRIu64 "\t%.3f\t%.3f"
+		       "\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%" PRIu64 "\n",
+		       num_connections, num_rounds, replies, max_outstanding, rate,
+		       handshakes, resumptions,
+		       TO_USEC(fr_histogram_percentile(&handshake_time, 50)),
+		       TO_USEC(fr_histogram_percentile(&handshake_time, 99)),
+		       TO_USEC(fr_histogram_percentile(&rtt, 50)), TO_USEC(fr_histogram_percentile(&rtt, 90)),
+		       TO_USEC(fr_histogram_percentile(&rtt, 99)), TO_USEC(fr_histogram_percentile(&rtt, 99.9)),
+		       TO_USEC(fr_histogram_max(&rtt)), bad_replies);
+		return;
+	}
+
+	printf("radsec_bench: %d connection(s), %d round(s), %" PRIu64 " replies, "
+	       "%" PRIu64 " outstanding per connection\n",
+	       num_connections, num_rounds, replies, max_outstanding);
+	printf("\telapsed           = %.3fs\n", elapsed);
+	printf("\tthroughput        = %.0f packets/s\n", rate);
+	printf("\thandshakes        = %" PRIu64 " (%" PRIu64 " resumed, %.1f%%)\n",
+	       handshakes, resumptions, handshakes ? (((double) resumptions) * 100) / handshakes : 0);
+	printf("\thandshake (us)    = min %.3f p50 %.3f p99 %.3f max %.3f\n",
+	       TO_USEC(fr_histogram_min(&handshake_time)),
+	       TO_USEC(fr_histogram_percentile(&handshake_time, 50)),
+	       TO_USEC(fr_histogram_percentile(&handshake_time, 99)),
+	       TO_USEC(fr_histogram_max(&handshake_time)));
+	printf("\trtt (us)          = min %.3f p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f max %.3f\n",
+	       TO_USEC(fr_histogram_min(&rtt)),
+	       TO_USEC(fr_histogram_percentile(&rtt, 50)), TO_USEC(fr_histogram_percentile(&rtt, 90)),
+	       TO_USEC(fr_histogram_percentile(&rtt, 99)), TO_USEC(fr_histogram_percentile(&rtt, 99.9)),
+	       TO_USEC(fr_histogram_max(&rtt)));
+	printf("\tbad replies       = %" PRIu64 "\n", bad_replies);
+
+	if (debug_lvl) fr_histogram_fprint(stdout, &rtt, "\trtt ");
+}
+
+int main(int argc, char *argv[])
+{
+	int		c, i, round;
+	SSL_CTX		*ssl_ctx;
+	fr_time_t	start, end;
+
+	if (fr_time_start() < 0) {
+		fr_perror("radsec_bench");
+		fr_exit_now(EXIT_FAILURE);
+	}
+
+	while ((c = getopt(argc, argv, "c:C:hk:n:No:pr:s:x")) != -1) switch (c) {
+		case 'c':
+			num_connections = atoi(optarg);
+			break;
+
+		case 'C':
+			ca_file = optarg;
+			break;
+
+		case 'k':
+			certificate_file = private_key_file = optarg;
+			break;
+
+		case 'n':
+			num_packets = strtoull(optarg, NULL, 10);
+			break;
+
+		case 'N':
+			resume = false;
+			break;
+
+		case 'o':
+			max_outstanding = strtoull(optarg, NULL, 10);
+			break;
+
+		case 'p':
+			parseable = true;
+			break;
+
+		case 'r':
+			num_rounds = atoi(optarg);
+			break;
+
+		case 's':
+			secret = optarg;
+			break;
+
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 1) usage();
+
+	if (fr_inet_pton_port(&server_ipaddr, &server_port, argv[0], -1, AF_UNSPEC, true, false) < 0) {
+		fr_perror("radsec_bench");
+		fr_exit_now(EXIT_FAILURE);
+	}
+	if (!server_port) server_port = 2083;
+
+	if ((num_connections < 1) || (num_connections > MAX_CONNECTIONS)) {
+		fprintf(stderr, "radsec_bench: Number of connections must be 1..%d\n", MAX_CONNECTIONS);
+		usage();
+	}
+
+	if (num_rounds < 1) usage();
+	if (!max_outstanding) max_outstanding = 1;
+	if (max_outstanding > MAX_OUTSTANDING) max_outstanding = MAX_OUTSTANDING;
+
+	ssl_ctx = SSL_CTX_new(TLS_client_method());
+	if (!ssl_ctx) bench_fail("Failed allocating SSL_CTX");
+
+	SSL_CTX_set_min_proto_version(ssl_ctx, TLS1_2_VERSION);
+	SSL_CTX_set_mode(ssl_ctx, SSL_MODE_AUTO_RETRY);
+
+	if (ca_file) {
+		if (SSL_CTX_load_verify_locations(ssl_ctx, ca_file, NULL) != 1) bench_fail("Failed loading CA file");
+		SSL_CTX_set_verify(ssl_ctx, SSL_VERIFY_PEER, NULL);
+	}
+
+	if (certificate_file) {
+		if (SSL_CTX_use_certificate_chain_file(ssl_ctx, certificate_file) != 1) {
+			bench_fail("Failed loading certificate file");
+		}
+		if (SSL_CTX_use_PrivateKey_file(ssl_ctx, private_key_file, SSL_FILETYPE_PEM) != 1) {
+			bench_fail("Failed loading private key file");
+		}
+	}
+
+	fr_histogram_init(&handshake_time);
+	fr_histogram_init(&rtt);
+
+	for (i = 0; i < num_connections; i++) {
+		conns[i] = talloc_zero(NULL, bench_conn_t);
+		conns[i]->id = i;
+		conns[i]->fd = -1;
+	}
+
+	/*
+	 *	Each round opens every connection, sends the packets,
+	 *	and closes the connections again.  All but the first
+	 *	round try to resume the session from the previous one.
+	 */
+	start = fr_time();
+	for (round = 0; round < num_rounds; round++) {
+		for (i = 0; i < num_connections; i++) bench_connect(ssl_ctx, conns[i]);
+
+		bench_run();
+
+		for (i = 0; i < num_connections; i++) bench_disconnect(conns[i]);
+	}
+	end = fr_time();
+
+	bench_results(start, end);
+
+	for (i = 0; i < num_connections; i++) {
+		if (conns[i]->session) SSL_SESSION_free(conns[i]->session);
+		talloc_free(conns[i]);
+	}
+	SSL_CTX_free(ssl_ctx);
+
+	/*
+	 *	Not fr_exit_now(), which would lose the buffered results.
+	 */
+	fr_exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,7 @@
+TARGET 		:= radsec_bench$(E)
+
+SOURCES		:= radsec_bench.c
+
+TGT_PREREQS	:= libfreeradius-radius$(L) libfreeradius-util$(L)
+TGT_LDLIBS	:= $(LIBS) $(OPENSSL_LIBS)
+TGT_LDFLAGS	:= $(OPENSSL_FLAGS)